@@ -0,0 +1,48 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-26 09:20:41
+ * @LastEditTime: 2025-06-27 16:48:03
+ * @LastEditors: 星年
+ * @Description: 音频参数：采集格式、采集增强（降噪、波束形成、自动增益）与播放响度、限幅的配置
+ * @FilePath: \ESP32-ChunFeng\components\audio\include\audio_config.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace chunfeng {
+
+/**
+ * @brief 多麦克风合成方式
+ */
+enum class BeamMode : uint8_t {
+    OFF,            ///< 只用第一个麦克风
+    DELAY_AND_SUM,  ///< 前两个麦克风按声源方向对齐后相加
+};
+
+/**
+ * @brief 音频参数
+ */
+struct AudioConfig {
+    uint32_t sample_rate{16000};    ///< 采样率
+    uint8_t channels{1};            ///< 通道数（麦克风个数，采集数据按通道交织）
+    uint8_t bit_depth{16};          ///< 位深度
+
+    // 采集增强
+    bool noise_suppression{true};
+    uint8_t ns_max_attenuation_db{15};  ///< 噪声最多衰减的分贝数，越大残留噪声越少、语音失真越明显
+    BeamMode beam_mode{BeamMode::DELAY_AND_SUM};   ///< channels > 1 时生效
+    uint16_t mic_spacing_mm{45};        ///< 前两个麦克风的间距
+    int8_t steer_deg{0};                ///< 声源方向：0 为阵列正前方，正值偏向第二个麦克风
+    bool agc{true};                     ///< 降噪之后自动增益，离得远、声音小时放大
+    int8_t agc_target_dbfs{-20};        ///< 说话时的目标电平（满量程正弦为 0dBFS）
+    uint8_t agc_max_gain_db{30};
+
+    // 播放
+    bool play_normalize{true};          ///< 不同回复的响度统一到 play_loudness_dbfs
+    int8_t play_loudness_dbfs{-20};
+    int8_t play_ceiling_dbfs{-3};       ///< 峰值上限，小喇叭失真时调低
+};
+
+} // namespace chunfeng
@@ -0,0 +1,168 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-29 09:05:17
+ * @LastEditTime: 2025-06-30 17:46:09
+ * @LastEditors: 星年
+ * @Description: 播放混音：多路输入流按优先级压低（ducking）、增益渐变、逐流重采样，定点累加到播放帧
+ * @FilePath: \ESP32-ChunFeng\components\audio\include\audio_mixer.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+
+namespace chunfeng {
+
+/**
+ * @brief 常用的流优先级，数值大的压低数值小的
+ */
+namespace mix_priority {
+constexpr uint8_t kAmbient = 32;    ///< 背景音乐、白噪声
+constexpr uint8_t kSpeech = 64;     ///< 回复语音：AudioPlayback::write() 写入的主通道
+constexpr uint8_t kNotify = 96;     ///< 提示音，通常与语音叠加而不压低语音
+constexpr uint8_t kAlarm = 128;     ///< 闹钟、计时器
+} // namespace mix_priority
+
+/**
+ * @brief 一路混音输入的参数
+ */
+struct MixStreamConfig {
+    uint32_t sample_rate{16000};                ///< 8000~48000，与播放采样率不同时逐流重采样
+    uint8_t priority{mix_priority::kNotify};
+    int8_t gain_db{0};                          ///< -40~0
+    uint8_t duck_db{0};                         ///< 播放期间把优先级更低的流（含语音）压低的分贝数，0~40
+    uint16_t fade_ms{20};                       ///< 淡入、淡出与增益变化（含被压低、恢复）的过渡时间，5~1000
+};
+
+/**
+ * @brief 播放混音器
+ *
+ * 播放帧本身是主通道（回复语音，优先级 kSpeech，说话时把更低优先级的流压低 kSpeechDuckDb），
+ * 另有 kMaxStreams 路输入流叠加在上面。每路流有自己的单生产者环形缓冲：打开它的任务写入，
+ * 播放任务在 mix() 中取走，双方不加锁。
+ *
+ * 每帧对每路流：先按 8 阶、32 相的加窗 sinc 多相滤波器重采样到播放采样率（降采样时截止频率随之降低，
+ * 采样率相同时直接拷贝），再乘从上一帧增益线性渐变到本帧目标增益的 Q15 增益累加进 32 位缓冲，
+ * 最后统一饱和到 16 位。目标增益 = 流自身增益 x 压低量：正在播放的更高优先级的流中 duck_db 最大者决定压低多少，
+ * 压低后至少保持 kDuckHoldMs，语音句间的短暂停顿不会让背景声忽大忽小。
+ *
+ * 所有缓冲都在对象内（约 44KB），应随 AudioPlayback 单例放在内部 SRAM，mix() 不分配内存。
+ */
+class AudioMixer {
+public:
+    static constexpr size_t kMaxStreams = 4;
+    static constexpr size_t kStreamSamples = 4096;     ///< 每路缓冲，2 的幂；16kHz 约 256ms
+    static constexpr size_t kMaxFrame = 480;           ///< 每帧最多样本数（48kHz 10ms、24kHz 20ms）
+    static constexpr size_t kTaps = 8;
+    static constexpr size_t kPhases = 32;
+    static constexpr uint32_t kMaxRatio = 6;           ///< 输入与输出采样率之比的上限（48kHz -> 8kHz）
+    static constexpr uint8_t kSpeechDuckDb = 12;
+    static constexpr uint32_t kSpeechFadeMs = 20;
+    static constexpr uint32_t kDuckHoldMs = 300;
+
+    AudioMixer();
+
+    AudioMixer(const AudioMixer&) = delete;
+    AudioMixer& operator=(const AudioMixer&) = delete;
+
+    /**
+     * @brief 播放采样率（由播放任务调用），正在播放的流按新采样率重新设计重采样滤波器
+     * @return ESP_ERR_INVALID_ARG 不在 8000~48000
+     */
+    esp_err_t setOutputRate(uint32_t sample_rate);
+
+    /**
+     * @brief 打开一路流，可在任意任务调用；之后的 write/finish/stop 只能由同一个任务调用
+     * @param[out] id 流编号
+     * @return ESP_ERR_INVALID_ARG 参数超出范围；ESP_ERR_NO_MEM 没有空闲的流
+     */
+    esp_err_t open(const MixStreamConfig& config, int* id);
+
+    /**
+     * @brief 写入 16 位单声道 PCM（流自身的采样率），不等待
+     * @return 放入缓冲的样本数，缓冲满时小于 samples
+     */
+    size_t write(int id, const int16_t* pcm, size_t samples);
+
+    /**
+     * @brief 写完了：缓冲里的样本播完后释放，之后 id 不再有效
+     */
+    void finish(int id);
+
+    /**
+     * @brief 立即停止：按 fade_ms 淡出后丢弃剩余样本并释放，之后 id 不再有效
+     */
+    void stop(int id);
+
+    /**
+     * @brief 停止全部正在播放的流（如用户说“停止”），可在任意任务调用；各流的写入方随后写入失败
+     */
+    void stopAll();
+
+    /** id 这路流是否还在接收数据（没有写完、没有被停止） */
+    bool writable(int id) const;
+
+    /**
+     * @brief 把各路流混入一帧（由播放任务调用）
+     * @param frame 主通道的 PCM，混音结果原位写回
+     * @param voice 主通道这一帧是否有语音；没有时 frame 应为静音
+     * @return 有流参与混音（frame 中可能有声音）
+     */
+    bool mix(int16_t* frame, size_t samples, bool voice);
+
+    /** 正在播放的流数（不含主通道） */
+    size_t activeStreams() const;
+
+    /** 上一次 mix() 的 CPU 周期数 */
+    uint32_t lastCycles() const { return last_cycles_; }
+
+private:
+    enum State : uint8_t { FREE, SETUP, PLAYING, DRAINING, STOPPING };
+
+    /** 跟随优先级变化的增益：压低量、保持时间与渐变 */
+    struct Level {
+        int32_t gain{0};            ///< 当前增益（Q15，1 << 15 为 1）
+        int32_t base{1 << 15};      ///< 流自身增益
+        uint32_t fade_samples{1};   ///< 增益从 0 变到满的样本数
+        uint8_t duck_db{0};         ///< 当前压低量
+        uint32_t hold{0};           ///< 压低量还要保持的样本数
+    };
+
+    struct Stream {
+        std::atomic<uint8_t> state{FREE};
+        MixStreamConfig config;
+        std::atomic<uint32_t> head{0};  ///< 混音方已取走的样本
+        std::atomic<uint32_t> tail{0};  ///< 写入方已放入的样本
+        int16_t buffer[kStreamSamples];
+        // 以下只由混音方访问
+        bool started{false};
+        bool played{false};             ///< 已取到过样本，之后缓冲不足才算欠载
+        uint32_t step_q16{0};           ///< 每个输出样本前进的输入样本数（Q16）
+        uint32_t pos_q16{0};            ///< 下一个输出样本在 history 中的位置（Q16）
+        uint32_t flushed{0};            ///< 写完后补零的样本数，够 kTaps 个说明滤波器里的尾巴已输出
+        int16_t history[kTaps];
+        int16_t taps[kPhases][kTaps];
+        Level level;
+    };
+
+    /** 按 step_q16 设计多相滤波器 */
+    void design(Stream& s);
+    /** 重采样一帧到 mono_，返回这路流这一帧是否还有声音可出 */
+    bool render(Stream& s, size_t samples);
+    /** 按压低量更新目标增益，返回本帧结束时的增益 */
+    int32_t nextGain(Level& level, uint8_t duck_db, bool stopping, size_t samples);
+
+    Stream streams_[kMaxStreams];
+    uint32_t out_rate_{16000};
+    Level speech_;
+    int16_t work_[kTaps + kMaxFrame * kMaxRatio];   ///< 历史样本 + 这一帧要用的输入
+    int16_t mono_[kMaxFrame];                       ///< 一路流重采样后的一帧
+    int32_t acc_[kMaxFrame];
+    int32_t db_q15_[41];                            ///< 0 ~ -40dB 的 Q15 幅度
+    uint32_t last_cycles_{0};
+};
+
+} // namespace chunfeng
@@ -0,0 +1,178 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-17 10:41:15
+ * @LastEditTime: 2025-06-30 17:46:09
+ * @LastEditors: 星年
+ * @Description: 音频播放：PCM 帧环形缓冲、多路混音、响度归一与限幅、I2S 输出，以及按 DAC 输出时间发布的响度与频带分析
+ * @FilePath: \ESP32-ChunFeng\components\audio\include\audio_playback.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "audio_config.hpp"
+#include "audio_mixer.hpp"
+#include "audio_spectrum.hpp"
+#include "driver/i2s_std.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lockfree_ring.hpp"
+#include "message_bus.hpp"
+#include "soft_limiter.hpp"
+
+namespace chunfeng {
+
+/**
+ * @brief 播放参数
+ */
+struct PlaybackConfig {
+    uint32_t sample_rate{16000};
+    i2s_port_t port{I2S_NUM_1};
+    int bclk_gpio{-1};
+    int ws_gpio{-1};
+    int dout_gpio{-1};
+    uint32_t dma_desc_num{3};       ///< DMA 描述符个数，每个一帧；写入的数据要等前面 dma_desc_num - 1 帧播完
+    uint32_t dac_latency_us{0};     ///< DAC/功放自身的延迟，加在发布的输出时间上
+    uint32_t tap_budget_us{300};    ///< 每帧分析的 CPU 预算
+};
+
+/**
+ * @brief 音频播放
+ *
+ * 解码任务调用 write() 把 PCM 按 20ms 一帧放入环形缓冲；播放任务逐帧取出写给 I2S，缓冲为空时补静音，
+ * 不等待解码。提示音、闹钟等经 openStream() 打开的流由 AudioMixer 按优先级叠加到语音帧上（可压低语音），
+ * 每帧混音后经 SoftLimiter 统一响度、乘音量并限幅，写入 I2S 后用 SpectrumAnalyzer 分析，连同该帧从 DAC 输出的时间一起发布到
+ * AUDIO_LEVEL 主题。I2S 写入在一个 DMA 描述符播完、腾出位置时返回，此时这一帧排在其余
+ * dma_desc_num - 1 帧之后，输出时间由此推算，不依赖 I2S 时钟与系统时钟的长期一致。
+ * 发布比实际输出提前 (dma_desc_num - 1) 帧，显示端有时间在声音出来的同时把画面推到屏幕上。
+ */
+class AudioPlayback {
+public:
+    static constexpr uint32_t kFrameMs = 20;
+    static constexpr size_t kMaxFrameSamples = 480;     ///< 24kHz 一帧
+    static constexpr size_t kRingFrames = 8;            ///< 环形缓冲 160ms
+
+    static AudioPlayback& getInstance();
+
+    /**
+     * @brief 初始化 I2S 并创建播放任务
+     */
+    esp_err_t start(const PlaybackConfig& config);
+
+    /**
+     * @brief 写入 16 位单声道 PCM（单一写入方）
+     *
+     * 满一帧才放入缓冲，环形缓冲满时等待播放任务取走。
+     * @return 已接收的样本数，超时时小于 samples
+     */
+    size_t write(const int16_t* pcm, size_t samples, uint32_t timeout_ms = portMAX_DELAY);
+
+    /**
+     * @brief 一段语音结束：不足一帧的尾部补静音后放入缓冲
+     */
+    void flush(uint32_t timeout_ms = portMAX_DELAY);
+
+    /**
+     * @brief 每帧样本数（采样率 x 20ms）
+     */
+    size_t frameSamples() const { return frame_samples_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 运行中切换采样率，不影响其他模块
+     *
+     * 播放任务在帧边界重建 I2S 通道；写入方已放入缓冲的帧仍按原长度播放。
+     * 应在两段语音之间调用，之后写入的 PCM 应使用新采样率。
+     * @return ESP_ERR_INVALID_ARG 采样率不能整除成 20ms 的帧或超过帧缓冲
+     */
+    esp_err_t setSampleRate(uint32_t sample_rate);
+
+    /**
+     * @brief 音量 0~100，从下一帧开始生效
+     */
+    void setVolume(uint32_t volume);
+
+    uint32_t volume() const { return volume_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 立即停止播放：丢弃已排队的语音帧，停止全部混音流
+     *
+     * 正在生成的回复应同时停止写入，否则之后写入的帧照常播放。
+     */
+    void stop();
+
+    /**
+     * @brief 播放响度与峰值上限（AudioConfig 的 play_* 字段），从下一帧开始生效
+     * @return ESP_ERR_INVALID_ARG 响度目标不在 -40~-6dBFS、上限不在 -20~0dBFS，或目标高于上限
+     */
+    esp_err_t setLevels(const AudioConfig& config);
+
+    /**
+     * @brief 打开一路混音流（提示音、闹钟、背景音），与 write() 写入的语音同时播放
+     * @param[out] id 流编号，供 writeStream/finishStream/stopStream 使用
+     * @return ESP_ERR_INVALID_ARG 参数超出范围；ESP_ERR_NO_MEM 已有 AudioMixer::kMaxStreams 路在播放
+     */
+    esp_err_t openStream(const MixStreamConfig& config, int* id) { return mixer_.open(config, id); }
+
+    /**
+     * @brief 写入混音流的 PCM（流自身的采样率），缓冲满时每半帧重试一次
+     * @return 已接收的样本数，超时时小于 samples
+     */
+    size_t writeStream(int id, const int16_t* pcm, size_t samples, uint32_t timeout_ms = portMAX_DELAY);
+
+    /** 流写完：播完缓冲里的样本后释放 */
+    void finishStream(int id) { mixer_.finish(id); }
+
+    /** 立即停止流：淡出后释放 */
+    void stopStream(int id) { mixer_.stop(id); }
+
+    /** 流是否还在接收数据（没有写完、没有被 stop() 停止） */
+    bool streamWritable(int id) const { return mixer_.writable(id); }
+
+    uint32_t sampleRate() const { return config_.sample_rate; }
+
+    AudioPlayback(const AudioPlayback&) = delete;
+    AudioPlayback& operator=(const AudioPlayback&) = delete;
+
+private:
+    AudioPlayback() = default;
+    ~AudioPlayback() = default;
+
+    struct Frame {
+        uint32_t samples;
+        int16_t pcm[kMaxFrameSamples];
+    };
+
+    static void playTask(void* arg);
+    void run();
+    /** 把 staging_ 放入环形缓冲，满时等待 */
+    bool pushStaging(uint32_t timeout_ms);
+    /** 按 config_ 创建并启用 I2S 通道 */
+    esp_err_t openChannel();
+    void closeChannel();
+
+    PlaybackConfig config_;
+    std::atomic<size_t> frame_samples_{0};
+    i2s_chan_handle_t tx_{nullptr};
+    TaskHandle_t task_{nullptr};
+    SpectrumAnalyzer analyzer_;
+    SoftLimiter limiter_;
+    AudioMixer mixer_;
+
+    LockFreeRing<Frame, kRingFrames> ring_;
+    Frame staging_{};                           ///< 写入方正在填充的帧
+    size_t staged_{0};
+    std::atomic<TaskHandle_t> writer_{nullptr}; ///< 缓冲满时等待的写入方
+    std::atomic<bool> speaking_{false};         ///< write() 之后、flush() 之前，此时缓冲为空算作欠载
+    std::atomic<uint32_t> pending_rate_{0};     ///< 待播放任务切换的采样率，0 表示没有
+    std::atomic<int32_t> gain_q15_{32767};      ///< 音量对应的 Q15 增益
+    std::atomic<uint32_t> volume_{100};
+    std::atomic<bool> drop_{false};             ///< 播放任务在下一帧前清空环形缓冲
+    std::atomic<uint32_t> pending_levels_{0};   ///< 待播放任务应用的响度设置（packLevels），0 表示没有
+};
+
+} // namespace chunfeng
+
+CF_BUS_TOPIC(AUDIO_LEVEL, chunfeng::AudioLevels)
@@ -0,0 +1,77 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-17 10:02:37
+ * @LastEditTime: 2025-06-26 17:05:12
+ * @LastEditors: 星年
+ * @Description: 播放音频的响度与频带能量分析：Q15 定点 FFT，每帧限定 CPU 预算
+ * @FilePath: \ESP32-ChunFeng\components\audio\include\audio_spectrum.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "fixed_fft.hpp"
+
+namespace chunfeng {
+
+/**
+ * @brief 一帧播放音频的分析结果
+ *
+ * level 与 bands 采用同一刻度：0 对应 -60dBFS 及以下，255 对应满量程正弦波。
+ */
+struct AudioLevels {
+    int64_t play_us;        ///< 这一帧第一个样本从 DAC 输出的时间（esp_timer_get_time）
+    uint32_t frame;         ///< 播放帧序号
+    uint16_t rms;           ///< 均方根幅度（满量程 32767）
+    uint8_t level;          ///< 响度
+    uint8_t fresh_bands;    ///< 1 表示频带在本帧重新计算，0 表示预算不足沿用了上一帧
+    uint8_t bands[8];       ///< 频带能量，低频在前
+};
+
+/**
+ * @brief 响度与频带分析
+ *
+ * 每帧都计算 RMS；频带由最后 kFftSize 个样本加 Hann 窗后做 Q15 定点 FFT 得到，
+ * 按 16kHz 采样时约 125Hz~4kHz 对数划分为 8 个频带。
+ * FFT 的耗时按滑动平均估计，本帧剩余预算放不下时跳过，频带沿用上一帧（口型与电平条看不出 20ms 的停顿），
+ * 保证分析不会挤占播放任务的时间。
+ */
+class SpectrumAnalyzer {
+public:
+    static constexpr size_t kFftSize = 256;
+    static constexpr size_t kBands = 8;
+
+    explicit SpectrumAnalyzer(uint32_t budget_us = 300);
+
+    SpectrumAnalyzer(const SpectrumAnalyzer&) = delete;
+    SpectrumAnalyzer& operator=(const SpectrumAnalyzer&) = delete;
+
+    /**
+     * @brief 每帧 CPU 预算（微秒）
+     */
+    void setBudget(uint32_t budget_us) { budget_us_ = budget_us; }
+
+    /**
+     * @brief 分析一帧 16 位单声道 PCM，填写 out 中除 play_us、frame 以外的字段
+     */
+    void analyze(const int16_t* pcm, size_t samples, AudioLevels& out);
+
+    /**
+     * @brief FFT 与频带计算耗时的估计值（微秒），尚未运行过时为 0
+     */
+    uint32_t fftCostUs() const { return fft_cost_us_; }
+
+private:
+    void computeBands(const int16_t* pcm, size_t samples);
+
+    FixedFft<kFftSize> fft_;
+    int16_t window_[kFftSize];
+    int16_t re_[kFftSize];
+    int16_t im_[kFftSize];
+    uint8_t bands_[kBands]{};
+    uint32_t budget_us_;
+    uint32_t fft_cost_us_{0};
+};
+
+} // namespace chunfeng
@@ -0,0 +1,74 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-27 09:12:26
+ * @LastEditTime: 2025-06-27 16:48:03
+ * @LastEditors: 星年
+ * @Description: 采集自动增益：跟踪说话电平并缓慢调整到目标，预读一段样本限制峰值，输出延迟固定
+ * @FilePath: \ESP32-ChunFeng\components\audio\include\auto_gain.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+
+namespace chunfeng {
+
+/**
+ * @brief 带预读的自动增益
+ *
+ * 以 5ms 为一段：每段的功率高于噪声底 6dB 且高于 -60dBFS 时视为说话，说话电平快升慢降地跟踪，
+ * 增益朝 目标 - 说话电平 调整（放大每秒不超过约 19dB，减小更快；reset 后前 0.5s 的说话快速到位），
+ * 静音时保持不变，不会把底噪拉上来。
+ * 输出比输入晚两段：增益在一段内线性过渡，过渡终点同时满足本段与下一段的峰值不超过 -1dBFS，
+ * 突然变响的开头不会削波。增益在 log2 的 Q8 定点下计算，逐样本只有一次乘法，不分配内存。
+ */
+class AutoGain {
+public:
+    static constexpr uint32_t kSegmentMs = 5;
+    static constexpr size_t kMaxSegment = 48000 * kSegmentMs / 1000;
+
+    AutoGain();
+
+    AutoGain(const AutoGain&) = delete;
+    AutoGain& operator=(const AutoGain&) = delete;
+
+    /**
+     * @param target_dbfs 说话时的目标电平（满量程正弦为 0dBFS）
+     * @param max_gain_db 最大放大量
+     * @return ESP_ERR_INVALID_ARG 采样率不能整除成 5ms 的段或超过 48kHz，目标不在 -40~-3dBFS，或最大放大量超过 40dB
+     */
+    esp_err_t configure(uint32_t sample_rate, int8_t target_dbfs, uint8_t max_gain_db);
+
+    void reset();
+
+    /**
+     * @brief 调整增益，in 与 out 可以是同一块内存
+     */
+    void process(const int16_t* in, int16_t* out, size_t samples);
+
+    size_t latencySamples() const { return 2 * segment_; }
+
+    /** 当前增益（dB，不含峰值限制） */
+    int gainDb() const;
+
+private:
+    void processSegment();
+
+    size_t segment_{80};
+    int32_t target_{0};             ///< 目标功率，log2 Q8
+    int32_t max_gain_{0};           ///< 以下增益均为幅度的 log2 Q8
+    int32_t min_gain_{0};
+    int32_t gain_{0};
+    int32_t speech_{0};             ///< 说话电平（功率 log2 Q8），0 表示还没听到说话
+    uint32_t speech_segments_{0};   ///< reset 后判为说话的段数
+    int32_t floor_{0};              ///< 噪声底
+    uint32_t applied_{4096};        ///< 上一段结束时的线性增益（Q12）
+    int16_t next_[kMaxSegment];     ///< 正在接收的一段（也是预读段）
+    int16_t hold_[kMaxSegment];     ///< 等待调整的一段
+    int16_t out_[kMaxSegment];      ///< 已调整、等待输出的一段
+    size_t fill_{0};
+};
+
+} // namespace chunfeng
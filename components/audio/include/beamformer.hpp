@@ -0,0 +1,62 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-26 09:20:41
+ * @LastEditTime: 2025-06-26 17:05:12
+ * @LastEditors: 星年
+ * @Description: 双麦克风延迟求和波束形成：按声源方向对齐两路（整数延迟加定点分数延迟滤波器）后相加
+ * @FilePath: \ESP32-ChunFeng\components\audio\include\beamformer.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+
+namespace chunfeng {
+
+/**
+ * @brief 延迟求和波束形成
+ *
+ * 声源方向上的声音先到达的一路延迟 d·sin(θ)/c 后与另一路相加：该方向的声音同相叠加，
+ * 两路不相关的噪声（麦克风自噪声、混响尾部）和偏离该方向的高频噪声部分抵消。
+ * 分数延迟用 8 阶加窗 sinc 滤波器（Q15），另一路按滤波器的群延迟整数延迟，两路输出始终对齐。
+ * 逐样本处理，只保存两路最近 kHistory 个样本，不分配内存。
+ */
+class Beamformer {
+public:
+    static constexpr size_t kTaps = 8;
+    static constexpr size_t kHistory = 32;                      ///< 环形历史，2 的幂
+    static constexpr size_t kMaxDelay = kHistory - kTaps;       ///< 48kHz、间距 100mm 约需 14 个样本
+    static constexpr size_t kLatencySamples = kTaps / 2 - 1;
+
+    Beamformer();
+
+    /**
+     * @param spacing_mm 两个麦克风的间距
+     * @param steer_deg 声源方向，0 为正前方（垂直于两麦连线），正值偏向第二个麦克风
+     * @return ESP_ERR_INVALID_ARG 参数超出范围，或所需延迟超过 kMaxDelay
+     */
+    esp_err_t configure(uint32_t sample_rate, uint16_t spacing_mm, int8_t steer_deg);
+
+    void reset();
+
+    /**
+     * @brief 取交织输入的前两路合成单声道
+     * @param channels 输入的通道数（至少 2）
+     */
+    void process(const int16_t* interleaved, size_t channels, int16_t* out, size_t frames);
+
+    /** 对齐延迟（样本，Q8），正值表示延迟第二路 */
+    int32_t delayQ8() const { return delay_q8_; }
+
+private:
+    int16_t taps_[kTaps];           ///< 分数延迟滤波器，作用在先收到声音的一路
+    size_t delay_int_{0};
+    bool lead_second_{false};       ///< 第二路先收到声源方向的声音
+    int32_t delay_q8_{0};
+    int16_t history_[2][kHistory];
+    size_t pos_{0};
+};
+
+} // namespace chunfeng
@@ -0,0 +1,72 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-26 09:20:41
+ * @LastEditTime: 2025-06-27 16:48:03
+ * @LastEditors: 星年
+ * @Description: 采集增强：多麦克风合成为单声道（波束形成）后降噪、自动增益，按 AudioConfig 配置
+ * @FilePath: \ESP32-ChunFeng\components\audio\include\capture_enhancer.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+#include "audio_config.hpp"
+#include "auto_gain.hpp"
+#include "beamformer.hpp"
+#include "noise_suppressor.hpp"
+
+namespace chunfeng {
+
+/**
+ * @brief 采集增强链：交织的多声道采集数据 → 单声道、已降噪的语音
+ *
+ * 在 AUDIO_DSP 任务中逐帧调用（每 20ms 一帧），送往唤醒词、VAD 与上传之前。
+ * channels > 1 且 beam_mode 为 DELAY_AND_SUM 时前两路做波束形成，否则只取第一路；
+ * noise_suppression 打开时再做谱减降噪，agc 打开时最后把说话电平调到 agc_target_dbfs。
+ * 每帧耗时记入 chunfeng_audio_enhance_us，自动增益的当前增益见 chunfeng_audio_agc_gain_db。
+ */
+class CaptureEnhancer {
+public:
+    CaptureEnhancer() = default;
+
+    CaptureEnhancer(const CaptureEnhancer&) = delete;
+    CaptureEnhancer& operator=(const CaptureEnhancer&) = delete;
+
+    /**
+     * @brief 应用配置并清空状态
+     * @return ESP_ERR_INVALID_ARG 通道数为 0、位深度不是 16，或波束形成、自动增益参数超出范围
+     */
+    esp_err_t configure(const AudioConfig& config);
+
+    void reset();
+
+    /**
+     * @brief 处理 frames 个采样点
+     * @param in 按通道交织的 16 位 PCM（frames x channels 个样本）
+     * @param out 单声道输出（frames 个样本），单声道输入时可与 in 相同
+     */
+    void process(const int16_t* in, size_t frames, int16_t* out);
+
+    /** 输出相对输入的延迟（样本） */
+    size_t latencySamples() const;
+
+    /** 上一次 process() 的 CPU 周期数 */
+    uint32_t lastCycles() const { return last_cycles_; }
+
+    const NoiseSuppressor& noiseSuppressor() const { return ns_; }
+    const Beamformer& beamformer() const { return beam_; }
+    const AutoGain& autoGain() const { return agc_; }
+
+private:
+    bool beamforming() const { return config_.channels > 1 && config_.beam_mode == BeamMode::DELAY_AND_SUM; }
+
+    AudioConfig config_;
+    Beamformer beam_;
+    NoiseSuppressor ns_;
+    AutoGain agc_;
+    uint32_t last_cycles_{0};
+};
+
+} // namespace chunfeng
@@ -0,0 +1,157 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-30 09:12:40
+ * @LastEditTime: 2025-06-30 17:46:09
+ * @LastEditors: 星年
+ * @Description: 设备端指令词识别：定点倒谱特征、录入的模板与带约束的动态时间规整（DTW）匹配
+ * @FilePath: \ESP32-ChunFeng\components\audio\include\command_recognizer.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+#include "fixed_fft.hpp"
+
+namespace chunfeng {
+
+/**
+ * @brief 一次识别的结果
+ */
+struct CommandMatch {
+    int command{-1};            ///< 识别出的指令，-1 表示不是已录入的指令（交给云端）
+    uint32_t distance{0};       ///< 最接近的指令的 DTW 距离（每步的平均 L1 距离），没有模板时为 UINT32_MAX
+    uint32_t runner_up{0};      ///< 次接近的另一条指令的距离
+    uint32_t worst{0};          ///< 与最接近的模板对齐后，局部距离最大的一段（约 16 步）的平均距离
+    uint16_t frames{0};         ///< 去掉首尾静音后的帧数
+    uint32_t decode_us{0};      ///< finish() 到得出结果的耗时（特征在 feed() 中随输入计算）
+};
+
+/**
+ * @brief 小词表指令识别（16kHz 单声道）
+ *
+ * 每条指令由用户说几遍录成模板（enroll），识别时把 VAD 截出的一句话与所有模板逐一做 DTW，
+ * 不需要神经网络模型与额外的组件。
+ *
+ * 特征：预加重后每 10ms 取 256 点 Hann 窗做按峰值归一化的 Q15 FFT，频点功率按 Q8 权重并入 20 个 Mel 频带，
+ * 取 log2（Q8）后用 Q14 余弦表变换为 12 维倒谱（不含能量项）。一句话结束时按帧能量去掉首尾的静音，
+ * 减去整句的倒谱均值（抵消麦克风与房间的频响），量化为 int8。
+ *
+ * 匹配：Sakoe-Chiba 带（对角线两侧各为较长一方的 1/4）内的对称 DTW，对角步权重 2，总代价除以两者帧数之和；
+ * 帧数相差超过一倍的模板直接跳过；某一行的最小代价已超过当前次优距离时提前放弃。
+ * 每条指令的接受门限是录入时该指令模板两两之间的平均距离 x kAcceptPct%，且最优距离要比另一条指令的
+ * 最优距离小 kMarginPct% 以上，词表外的话与只说对一半的话（如“小声音乐”之于“小声点”）被拒识。
+ *
+ * 逐帧特征与 DTW 的两行约 15KB 在对象内；模板（kMaxTemplates x kMaxFrames x 12 字节，约 58KB）放在 PSRAM。
+ */
+class CommandRecognizer {
+public:
+    static constexpr uint32_t kSampleRate = 16000;
+    static constexpr size_t kFftSize = 256;
+    static constexpr size_t kHop = 160;
+    static constexpr size_t kBands = 20;
+    static constexpr size_t kCeps = 12;
+    static constexpr size_t kMaxFrames = 200;       ///< 一句话最长 2s，更长的不是指令
+    static constexpr size_t kMaxCommands = 8;
+    static constexpr size_t kMaxTemplates = 24;
+    static constexpr uint32_t kAcceptPct = 160;
+    static constexpr uint32_t kMarginPct = 85;
+    static constexpr uint32_t kStretchPct = 140;
+    static constexpr uint32_t kDefaultDistance = 50;    ///< 只有一个模板、无法估计门限时
+    static constexpr uint32_t kDefaultStretch = 110;
+
+    CommandRecognizer();
+    ~CommandRecognizer();
+
+    CommandRecognizer(const CommandRecognizer&) = delete;
+    CommandRecognizer& operator=(const CommandRecognizer&) = delete;
+
+    /**
+     * @brief 把一句话录成 command 的模板（pcm 可含首尾静音）
+     * @return ESP_ERR_INVALID_ARG command 超出范围或太短；ESP_ERR_NO_MEM 模板已满
+     */
+    esp_err_t enroll(int command, const int16_t* pcm, size_t samples);
+
+    /** 删除全部模板 */
+    void clear();
+
+    size_t templates() const { return count_; }
+
+    /**
+     * @brief 模板存为文件 / 从文件读回
+     * @return ESP_FAIL 文件读写失败；ESP_ERR_INVALID_STATE 文件格式不对（此时 load() 之后没有模板）
+     */
+    esp_err_t save(const char* path) const;
+    esp_err_t load(const char* path);
+
+    /** 开始一句话 */
+    void begin();
+
+    /**
+     * @brief 送入这句话的 PCM，任意长度
+     * @return false 已超过 kMaxFrames，之后的输入被忽略，finish() 的结果是 -1
+     */
+    bool feed(const int16_t* pcm, size_t samples);
+
+    /**
+     * @brief 这句话结束，与模板匹配
+     */
+    CommandMatch finish();
+
+private:
+    struct Template {
+        uint8_t command;
+        uint16_t frames;
+        int8_t features[kMaxFrames][kCeps];
+    };
+
+    /** DTW 的一格：累计代价，以及沿到达这一格的最优路径的局部距离滑动平均与其最大值（Q4） */
+    struct Cell {
+        uint32_t cost;
+        uint16_t recent;
+        uint16_t worst;
+    };
+
+    /** 一条指令的接受门限 */
+    struct Limits {
+        uint32_t distance;
+        uint32_t stretch;
+    };
+
+    /** 算一帧特征，追加到 ceps_/energy_ */
+    void analyzeFrame();
+    /** 去掉首尾静音、减均值、量化到 out，返回帧数 */
+    size_t normalize(int8_t (*out)[kCeps]);
+    /** 第一次录入或读入时分配模板 */
+    bool reserve();
+    /** DTW 距离，超过 limit 时提前放弃并返回 UINT32_MAX */
+    uint32_t distance(const int8_t (*a)[kCeps], size_t n, const int8_t (*b)[kCeps], size_t m,
+                      uint32_t limit, uint32_t* worst);
+    /** 按模板两两之间的距离重算 command 的接受门限 */
+    void updateThreshold(int command);
+
+    FixedFft<kFftSize> fft_;
+    int16_t window_[kFftSize];
+    int16_t dct_[kCeps][kBands];    ///< Q14
+    uint8_t bin_band_[kFftSize / 2 + 1];    ///< 频点并入的较低频带，0xff 表示不用
+    uint8_t bin_weight_[kFftSize / 2 + 1];  ///< 并入较低频带的权重（Q8），其余并入高一个频带
+
+    int16_t in_[kFftSize];
+    size_t fill_{0};
+    int16_t last_{0};               ///< 预加重的上一个样本
+    int16_t re_[kFftSize];
+    int16_t im_[kFftSize];
+    int16_t ceps_[kMaxFrames][kCeps];   ///< 未归一化的倒谱（log2 Q8）
+    int32_t energy_[kMaxFrames];        ///< 帧能量（log2 Q8）
+    size_t frames_{0};
+    bool overflow_{false};
+    int8_t query_[kMaxFrames][kCeps];
+    Cell row_[2][kMaxFrames + 1];       ///< DTW 的上一行与当前行
+
+    Template* templates_{nullptr};
+    size_t count_{0};
+    Limits limits_[kMaxCommands];
+};
+
+} // namespace chunfeng
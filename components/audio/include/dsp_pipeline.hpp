@@ -0,0 +1,187 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-28 09:34:52
+ * @LastEditTime: 2025-06-28 17:21:40
+ * @LastEditors: 星年
+ * @Description: 编译期组装的音频处理链：帧长与各阶段通道数在编译期确定，相邻的逐样本阶段融合为一趟，
+ *               中间结果只用一块静态暂存区，每趟自带周期计数
+ * @FilePath: \ESP32-ChunFeng\components\audio\include\dsp_pipeline.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include "esp_cpu.h"
+
+namespace chunfeng {
+namespace dsp {
+
+/**
+ * @brief 一趟处理的统计
+ *
+ * 融合时一趟包含多个阶段，名字取第一个与最后一个阶段。
+ */
+struct PassCounter {
+    const char* first{nullptr};
+    const char* last{nullptr};
+    uint8_t stages{0};
+    uint32_t calls{0};
+    uint64_t cycles{0};
+};
+
+/**
+ * @brief 处理链
+ *
+ * 阶段分两类，都声明 kName、kIn、kOut（输入、输出通道数）与 kPoint：
+ * - 逐样本阶段（kPoint 为 true）：void apply(int32_t* v)，原位处理一个采样点的 kIn 个通道，结果放在前 kOut 个；
+ * - 整块阶段（kPoint 为 false）：void process(const int16_t* in, int16_t* out, size_t frames)，in 与 out 可以相同。
+ *
+ * Fuse 为 true 时相邻的逐样本阶段合为一趟：每个采样点读一次、在寄存器里依次经过各阶段、写一次，
+ * 中间值保持 32 位，只在一趟结束时饱和到 16 位。Fuse 为 false 时每个阶段单独一趟，用于比较。
+ * 第一趟直接读输入（In 可以是 I2S 的 32 位槽，此时第一个阶段须是逐样本阶段），最后一趟直接写输出，
+ * 中间各趟在成员 scratch_ 上原位进行，因此通道数只能减少。
+ *
+ * 对象应定义为静态变量（.bss 在内部 SRAM），不要从堆上分配：开启 PSRAM 后大块 malloc 可能落到 PSRAM。
+ * process() 不分配内存；每趟的周期数用 esp_cpu_get_cycle_count 累计，见 counter()。
+ */
+template <size_t Frames, typename In, bool Fuse, typename... Stages>
+class Pipeline {
+    static_assert(sizeof...(Stages) > 0, "处理链至少要有一个阶段");
+    static_assert(std::is_same_v<In, int16_t> || std::is_same_v<In, int32_t>, "输入只支持 16 位 PCM 或 32 位 I2S 槽");
+
+    using Tuple = std::tuple<Stages...>;
+    static constexpr size_t kCount = sizeof...(Stages);
+    static constexpr bool kPointAt[] = {Stages::kPoint...};
+    static constexpr size_t kInAt[] = {Stages::kIn...};
+    static constexpr size_t kOutAt[] = {Stages::kOut...};
+    static constexpr const char* kNameAt[] = {Stages::kName...};
+
+    /** 从第 i 个阶段开始的一趟在哪个阶段之前结束 */
+    static constexpr size_t passEnd(size_t i) {
+        if (!Fuse || !kPointAt[i]) return i + 1;
+        size_t j = i + 1;
+        while (j < kCount && kPointAt[j]) ++j;
+        return j;
+    }
+
+    static constexpr size_t countPasses() {
+        size_t n = 0;
+        for (size_t i = 0; i < kCount; i = passEnd(i)) ++n;
+        return n;
+    }
+
+    static constexpr bool channelsShrink() {
+        for (size_t i = 0; i < kCount; ++i) {
+            if (kOutAt[i] > kInAt[i] || (i > 0 && kInAt[i] != kOutAt[i - 1])) return false;
+        }
+        return true;
+    }
+
+public:
+    static constexpr size_t kFrames = Frames;
+    static constexpr size_t kInChannels = kInAt[0];
+    static constexpr size_t kOutChannels = kOutAt[kCount - 1];
+    static constexpr size_t kPasses = countPasses();
+
+    static_assert(channelsShrink(), "相邻阶段的通道数必须一致，且每个阶段的通道数只能减少");
+    static_assert(std::is_same_v<In, int16_t> || kPointAt[0], "32 位输入的第一个阶段必须是逐样本阶段");
+
+    /** 每帧各趟读写的字节数之和（内存流量） */
+    static constexpr size_t trafficBytes() {
+        size_t bytes = 0;
+        for (size_t i = 0; i < kCount; i = passEnd(i)) {
+            size_t in_size = i == 0 ? sizeof(In) : sizeof(int16_t);
+            bytes += Frames * (kInAt[i] * in_size + kOutAt[passEnd(i) - 1] * sizeof(int16_t));
+        }
+        return bytes;
+    }
+
+    Pipeline() {
+        size_t pass = 0;
+        for (size_t i = 0; i < kCount; i = passEnd(i), ++pass) {
+            counters_[pass].first = kNameAt[i];
+            counters_[pass].last = kNameAt[passEnd(i) - 1];
+            counters_[pass].stages = static_cast<uint8_t>(passEnd(i) - i);
+        }
+    }
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    /** 第 I 个阶段，用于配置 */
+    template <size_t I>
+    std::tuple_element_t<I, Tuple>& stage() { return std::get<I>(stages_); }
+
+    /**
+     * @brief 处理一帧：in 为 Frames x kInChannels 个交织样本，out 为 Frames x kOutChannels 个
+     */
+    void process(const In* in, int16_t* out) { run<0, 0>(in, out); }
+
+    const PassCounter& counter(size_t pass) const { return counters_[pass]; }
+
+    void resetCounters() {
+        for (PassCounter& c : counters_) {
+            c.calls = 0;
+            c.cycles = 0;
+        }
+    }
+
+private:
+    static int16_t saturate(int32_t v) {
+        return static_cast<int16_t>(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+    }
+
+    template <size_t I, size_t Pass>
+    void run(const In* in, int16_t* out) {
+        if constexpr (I < kCount) {
+            constexpr size_t kEnd = passEnd(I);
+            int16_t* dst = kEnd == kCount ? out : scratch_;
+            uint32_t start = esp_cpu_get_cycle_count();
+            if constexpr (kPointAt[I]) {
+                if constexpr (I == 0) {
+                    pointPass<I, kEnd>(in, dst);
+                } else {
+                    pointPass<I, kEnd>(static_cast<const int16_t*>(scratch_), dst);
+                }
+            } else if constexpr (I == 0) {
+                std::get<I>(stages_).process(in, dst, Frames);
+            } else {
+                std::get<I>(stages_).process(scratch_, dst, Frames);
+            }
+            counters_[Pass].cycles += esp_cpu_get_cycle_count() - start;
+            counters_[Pass].calls++;
+            run<kEnd, Pass + 1>(in, out);
+        }
+    }
+
+    template <size_t Begin, size_t End, typename Src>
+    void pointPass(const Src* src, int16_t* dst) {
+        constexpr size_t kIn = kInAt[Begin];
+        constexpr size_t kOut = kOutAt[End - 1];
+        for (size_t n = 0; n < Frames; ++n) {
+            int32_t v[kIn];
+            for (size_t c = 0; c < kIn; ++c) v[c] = src[n * kIn + c];
+            applyPoints<Begin, End>(v);
+            // 原位时写入位置不超过已读过的位置：kOut <= kIn
+            for (size_t c = 0; c < kOut; ++c) dst[n * kOut + c] = saturate(v[c]);
+        }
+    }
+
+    template <size_t I, size_t End>
+    void applyPoints(int32_t* v) {
+        if constexpr (I < End) {
+            std::get<I>(stages_).apply(v);
+            applyPoints<I + 1, End>(v);
+        }
+    }
+
+    Tuple stages_;
+    int16_t scratch_[Frames * kInChannels];
+    PassCounter counters_[kPasses];
+};
+
+} // namespace dsp
+} // namespace chunfeng
@@ -0,0 +1,143 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-28 09:34:52
+ * @LastEditTime: 2025-06-28 17:21:40
+ * @LastEditors: 星年
+ * @Description: 处理链的阶段：I2S 槽解包、去直流、增益、混为单声道等逐样本阶段，以及波束形成、降噪、自动增益的整块阶段
+ * @FilePath: \ESP32-ChunFeng\components\audio\include\dsp_stages.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "auto_gain.hpp"
+#include "beamformer.hpp"
+#include "noise_suppressor.hpp"
+
+namespace chunfeng {
+namespace dsp {
+
+/* ---------- 逐样本阶段 ---------- */
+
+/**
+ * @brief I2S 32 位槽中左对齐的麦克风数据右移到 16 位范围（24 位麦克风的低 8 位是噪声）
+ */
+template <size_t Channels, int Shift = 16>
+struct I2sUnpack {
+    static constexpr const char* kName = "i2s_unpack";
+    static constexpr bool kPoint = true;
+    static constexpr size_t kIn = Channels;
+    static constexpr size_t kOut = Channels;
+
+    void apply(int32_t* v) const {
+        for (size_t c = 0; c < Channels; ++c) v[c] >>= Shift;
+    }
+};
+
+/**
+ * @brief 去直流：一阶高通 y = x - x[-1] + a·y[-1]，a = 0.995（16kHz 时约 13Hz）
+ *
+ * 反馈量保留 8 位小数，避免截断误差积成新的直流偏置。
+ */
+template <size_t Channels>
+struct DcBlock {
+    static constexpr const char* kName = "dc_block";
+    static constexpr bool kPoint = true;
+    static constexpr size_t kIn = Channels;
+    static constexpr size_t kOut = Channels;
+
+    void apply(int32_t* v) {
+        for (size_t c = 0; c < Channels; ++c) {
+            int32_t y = static_cast<int32_t>((static_cast<int64_t>(v[c] - x1_[c]) << 8) +
+                                             ((static_cast<int64_t>(y1_[c]) * 32604) >> 15));
+            x1_[c] = v[c];
+            y1_[c] = y;
+            v[c] = y >> 8;
+        }
+    }
+
+    int32_t x1_[Channels]{};
+    int32_t y1_[Channels]{};    ///< Q8
+};
+
+/**
+ * @brief 固定增益（Q12），用于麦克风灵敏度校准
+ */
+template <size_t Channels>
+struct Gain {
+    static constexpr const char* kName = "gain";
+    static constexpr bool kPoint = true;
+    static constexpr size_t kIn = Channels;
+    static constexpr size_t kOut = Channels;
+
+    void apply(int32_t* v) const {
+        for (size_t c = 0; c < Channels; ++c) v[c] = (v[c] * q12 + 2048) >> 12;
+    }
+
+    int32_t q12{4096};
+};
+
+/**
+ * @brief 各通道取平均，混为单声道
+ */
+template <size_t Channels>
+struct Downmix {
+    static constexpr const char* kName = "downmix";
+    static constexpr bool kPoint = true;
+    static constexpr size_t kIn = Channels;
+    static constexpr size_t kOut = 1;
+
+    void apply(int32_t* v) const {
+        int32_t sum = 0;
+        for (size_t c = 0; c < Channels; ++c) sum += v[c];
+        v[0] = sum / static_cast<int32_t>(Channels);
+    }
+};
+
+/* ---------- 整块阶段 ---------- */
+
+/**
+ * @brief 双麦克风波束形成（见 Beamformer），configure 通过 engine 进行
+ */
+struct Beamform {
+    static constexpr const char* kName = "beamform";
+    static constexpr bool kPoint = false;
+    static constexpr size_t kIn = 2;
+    static constexpr size_t kOut = 1;
+
+    void process(const int16_t* in, int16_t* out, size_t frames) { engine.process(in, kIn, out, frames); }
+
+    Beamformer engine;
+};
+
+/**
+ * @brief 谱减降噪（见 NoiseSuppressor）
+ */
+struct Denoise {
+    static constexpr const char* kName = "denoise";
+    static constexpr bool kPoint = false;
+    static constexpr size_t kIn = 1;
+    static constexpr size_t kOut = 1;
+
+    void process(const int16_t* in, int16_t* out, size_t frames) { engine.process(in, out, frames); }
+
+    NoiseSuppressor engine;
+};
+
+/**
+ * @brief 自动增益（见 AutoGain）
+ */
+struct Agc {
+    static constexpr const char* kName = "agc";
+    static constexpr bool kPoint = false;
+    static constexpr size_t kIn = 1;
+    static constexpr size_t kOut = 1;
+
+    void process(const int16_t* in, int16_t* out, size_t frames) { engine.process(in, out, frames); }
+
+    AutoGain engine;
+};
+
+} // namespace dsp
+} // namespace chunfeng
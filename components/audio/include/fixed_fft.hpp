@@ -0,0 +1,100 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-26 09:20:41
+ * @LastEditTime: 2025-06-26 17:05:12
+ * @LastEditors: 星年
+ * @Description: Q15 定点 FFT：基 2 原位变换，正变换每级右移一位（1/N 缩放），逆变换不缩放、饱和
+ * @FilePath: \ESP32-ChunFeng\components\audio\include\fixed_fft.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace chunfeng {
+
+/**
+ * @brief N 点 Q15 定点 FFT
+ *
+ * 系数表只在构造时用浮点计算一次，变换全部是 16x16 位整数乘法。
+ * 正变换结果为 X/N，不会溢出；逆变换不缩放，forward() 后直接 inverse() 还原原始数据，
+ * 频域修改后幅度超出 int16 时饱和。
+ */
+template <size_t N>
+class FixedFft {
+    static_assert(N >= 4 && (N & (N - 1)) == 0, "FFT 点数必须是 2 的幂");
+
+public:
+    static constexpr size_t kSize = N;
+
+    FixedFft() {
+        const double pi = 3.14159265358979323846;
+        for (size_t k = 0; k < N / 2; ++k) {
+            cos_[k] = static_cast<int16_t>(std::lround(32767.0 * std::cos(2 * pi * k / N)));
+            sin_[k] = static_cast<int16_t>(std::lround(32767.0 * std::sin(2 * pi * k / N)));
+        }
+    }
+
+    /** 正变换，结果为 1/N 缩放 */
+    void forward(int16_t* re, int16_t* im) const { transform<false>(re, im); }
+    /** 逆变换，不缩放 */
+    void inverse(int16_t* re, int16_t* im) const { transform<true>(re, im); }
+
+private:
+    static int16_t saturate(int32_t v) {
+        return static_cast<int16_t>(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+    }
+
+    template <bool Inverse>
+    void transform(int16_t* re, int16_t* im) const {
+        // 原位基 2 时域抽取
+        for (size_t i = 1, j = 0; i < N; ++i) {
+            size_t bit = N >> 1;
+            for (; j & bit; bit >>= 1) j ^= bit;
+            j |= bit;
+            if (i < j) {
+                int16_t t = re[i];
+                re[i] = re[j];
+                re[j] = t;
+                t = im[i];
+                im[i] = im[j];
+                im[j] = t;
+            }
+        }
+        for (size_t len = 2; len <= N; len <<= 1) {
+            size_t half = len >> 1;
+            size_t step = N / len;
+            for (size_t i = 0; i < N; i += len) {
+                for (size_t j = 0; j < half; ++j) {
+                    int32_t wr = cos_[j * step];
+                    int32_t wi = Inverse ? sin_[j * step] : -sin_[j * step];
+                    size_t a = i + j;
+                    size_t b = a + half;
+                    int32_t tr = (re[b] * wr - im[b] * wi) >> 15;
+                    int32_t ti = (re[b] * wi + im[b] * wr) >> 15;
+                    int32_t ar = re[a];
+                    int32_t ai = im[a];
+                    if (Inverse) {
+                        re[b] = saturate(ar - tr);
+                        im[b] = saturate(ai - ti);
+                        re[a] = saturate(ar + tr);
+                        im[a] = saturate(ai + ti);
+                    } else {
+                        // 每级右移一位防止溢出
+                        re[b] = static_cast<int16_t>((ar - tr) >> 1);
+                        im[b] = static_cast<int16_t>((ai - ti) >> 1);
+                        re[a] = static_cast<int16_t>((ar + tr) >> 1);
+                        im[a] = static_cast<int16_t>((ai + ti) >> 1);
+                    }
+                }
+            }
+        }
+    }
+
+    int16_t cos_[N / 2];
+    int16_t sin_[N / 2];
+};
+
+} // namespace chunfeng
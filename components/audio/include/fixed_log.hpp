@@ -0,0 +1,49 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-27 09:12:26
+ * @LastEditTime: 2025-06-27 16:48:03
+ * @LastEditors: 星年
+ * @Description: 定点对数与指数：电平、增益在 log2 的 Q8 定点下做加减，需要乘到样本上时再换回线性
+ * @FilePath: \ESP32-ChunFeng\components\audio\include\fixed_log.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace chunfeng {
+
+/** log2(v) 的 Q8 近似（尾数线性插值，偏低不超过 0.09），v 为 0 时返回 0 */
+inline int32_t log2Q8(uint64_t v) {
+    if (v == 0) return 0;
+    int msb = 63 - __builtin_clzll(v);
+    uint32_t frac = msb >= 8 ? static_cast<uint32_t>(v >> (msb - 8)) & 0xff
+                             : static_cast<uint32_t>(v << (8 - msb)) & 0xff;
+    return msb * 256 + static_cast<int32_t>(frac);
+}
+
+/**
+ * @brief 2^(q8 / 256)，结果为 frac_bits 位小数的定点数
+ *
+ * 小数部分用二次多项式 1 + 0.6565x + 0.3435x^2（两端精确，误差小于 0.3%），超出 uint32 时饱和
+ */
+inline uint32_t exp2Q8(int32_t q8, int frac_bits) {
+    int32_t whole = q8 >> 8;
+    uint32_t f = static_cast<uint32_t>(q8 & 0xff);
+    uint32_t mantissa = 16384 + ((10756 * f) >> 8) + ((5628 * f * f) >> 16);   // Q14
+    int shift = whole + frac_bits - 14;
+    if (shift >= 0) {
+        if (shift > 17) return UINT32_MAX;
+        return mantissa << shift;
+    }
+    return shift <= -32 ? 0 : mantissa >> -shift;
+}
+
+/** 幅度的 log2 Q8 换算成 dB（四舍五入） */
+inline int amplitudeQ8ToDb(int32_t q8) {
+    // 20 x log10(2) = 6.0206
+    int32_t scaled = q8 * 602;
+    return static_cast<int>((scaled + (scaled < 0 ? -12800 : 12800)) / 25600);
+}
+
+} // namespace chunfeng
@@ -0,0 +1,86 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-26 09:20:41
+ * @LastEditTime: 2025-06-26 17:05:12
+ * @LastEditors: 星年
+ * @Description: 采集降噪：定点 STFT 谱减，按频点跟踪噪声底，输出延迟固定
+ * @FilePath: \ESP32-ChunFeng\components\audio\include\noise_suppressor.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "fixed_fft.hpp"
+
+namespace chunfeng {
+
+/**
+ * @brief 单声道谱减降噪
+ *
+ * 256 点 sqrt-Hann 窗、50% 重叠的短时傅里叶变换（16kHz 时每 8ms 一块）。每块先按峰值左移归一化再做
+ * Q15 FFT，安静的输入也保留足够精度；各频点功率取对数、换算回绝对刻度后平滑，噪声底取最近约 1.5s 内
+ * 平滑功率的最小值（最小值统计），说话期间不被语音抬高，噪声变化后 1.5s 内跟上。
+ * 增益为 (P - 2N) / P（过减 3dB 抑制音乐噪声），下限由最大衰减决定，增益下降时按块平滑。
+ *
+ * process() 接受任意长度的输入，输出比输入晚 kLatencySamples 个样本；全部状态在对象内，
+ * 不分配内存。开头 kWarmupBlocks 块（约 0.1s）用于估计初始噪声底，视为没有语音。
+ */
+class NoiseSuppressor {
+public:
+    static constexpr size_t kFftSize = 256;
+    static constexpr size_t kHop = kFftSize / 2;
+    static constexpr size_t kBins = kFftSize / 2 + 1;
+    static constexpr size_t kLatencySamples = kFftSize;
+    static constexpr uint32_t kWarmupBlocks = 12;
+    static constexpr size_t kSubWindows = 8;
+
+    explicit NoiseSuppressor(uint8_t max_attenuation_db = 15);
+
+    NoiseSuppressor(const NoiseSuppressor&) = delete;
+    NoiseSuppressor& operator=(const NoiseSuppressor&) = delete;
+
+    void setMaxAttenuation(uint8_t db);
+
+    /**
+     * @brief 清空缓冲与噪声估计，下一段输入重新收敛
+     */
+    void reset();
+
+    /**
+     * @brief 降噪，in 与 out 可以是同一块内存
+     */
+    void process(const int16_t* in, int16_t* out, size_t samples);
+
+    /**
+     * @brief 当前噪声底（全频带，dBFS，满量程正弦为 0），尚无估计时为 -96
+     */
+    int noiseFloorDb() const;
+
+    /** 最近一块的平均增益（Q15） */
+    uint16_t meanGain() const { return mean_gain_; }
+
+private:
+    void processBlock();
+
+    FixedFft<kFftSize> fft_;
+    int16_t window_[kFftSize];      ///< sqrt-Hann，分析与合成各乘一次
+    int16_t in_[kFftSize];          ///< 前一跳与本跳的输入
+    int16_t re_[kFftSize];
+    int16_t im_[kFftSize];
+    int32_t overlap_[kHop];         ///< 上一块合成结果的后半
+    int16_t out_[kHop];             ///< 已完成、等待输出的一跳
+    size_t fill_{0};                ///< 本跳已收到的样本
+    // 频点功率均为 log2 的 Q8 定点、换算到归一化之前的绝对刻度
+    uint16_t power_[kBins];         ///< 快平滑，用于计算增益
+    uint16_t smooth_[kBins];        ///< 慢平滑，用于跟踪噪声
+    uint16_t local_min_[kBins];     ///< 当前子窗口内 smooth_ 的最小值
+    uint16_t window_min_[kSubWindows][kBins];
+    uint16_t noise_[kBins];         ///< 噪声底估计
+    uint16_t gain_[kBins];          ///< 上一块的增益（Q15）
+    uint16_t gain_floor_;
+    uint16_t mean_gain_{32767};
+    uint32_t blocks_{0};
+};
+
+} // namespace chunfeng
@@ -0,0 +1,196 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-22 09:12:40
+ * @LastEditTime: 2025-06-22 15:36:02
+ * @LastEditors: 星年
+ * @Description: 合成语音缓存：按文本、音色与合成参数的哈希把合成结果存在 storage 分区，命中时直接从 Flash 流式播放
+ * @FilePath: \ESP32-ChunFeng\components\audio\include\response_cache.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include "esp_err.h"
+
+namespace chunfeng {
+
+class AudioPlayback;
+
+/**
+ * @brief 缓存键：文本、音色与合成参数的 SHA-256
+ */
+struct CacheKey {
+    uint8_t digest[32];
+};
+
+/**
+ * @brief 由合成请求的内容计算缓存键，任一参数不同都是不同的条目
+ * @param speed_pct 语速百分比
+ */
+CacheKey makeCacheKey(const char* text, const char* voice, uint32_t sample_rate, uint32_t speed_pct = 100);
+
+/**
+ * @brief 缓存文件头，后接 bytes 字节 16 位单声道 PCM
+ */
+struct CachedAudioHeader {
+    char magic[4];          ///< "CFRC"
+    uint32_t sample_rate;
+    uint32_t bytes;
+    uint32_t reserved;
+    uint8_t digest[32];     ///< 完整的缓存键，文件名只取前 8 字节
+};
+
+struct CacheStats {
+    uint32_t entries;
+    uint32_t bytes;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t inserts;
+};
+
+/**
+ * @brief 合成语音缓存
+ *
+ * 每条合成结果是 storage 分区（SPIFFS）中的一个文件 rc_<键的前 8 字节>.pcm，写入时先写临时文件，
+ * 完成后改名，掉电只会留下临时文件。索引（键、大小、最近使用时间）常驻内存，按最近使用顺序
+ * 保存在 rc.idx 中：插入、淘汰时立即保存，命中只每 kIndexSaveHits 次保存一次，以减少 Flash 写入；
+ * 掉电丢失的最近使用顺序只影响淘汰的先后。文件总大小超过预算时按两段 LRU 淘汰：先淘汰写入后没有命中过的
+ * 条目中最久未用的，没有这样的条目时才淘汰命中过的，一次性的回复不会把常用的提示音挤出缓存；
+ * 正在读取的条目不淘汰。
+ *
+ * 命中时用 Reader 边读边播，不需要把整段语音读入内存；未命中时由调用方合成，边播放边经
+ * beginInsert()/write()/commit() 写入。首个音频的耗时按来源（cache/synth）记入直方图：
+ * 命中从 lookup() 到第一次读出数据，未命中从 lookup() 到合成的第一块数据写入缓存。
+ */
+class ResponseCache {
+public:
+    static constexpr const char* kDefaultDir = "/storage";
+    static constexpr size_t kDefaultBudget = 1024 * 1024;  ///< storage 分区 2MB，其余留给日志、字库与 SPIFFS 回收
+    static constexpr size_t kMaxEntries = 128;
+    static constexpr uint32_t kIndexSaveHits = 8;
+
+    /**
+     * @brief 流式读取一条缓存，析构时释放对条目的占用
+     */
+    class Reader {
+    public:
+        Reader() = default;
+        ~Reader() { close(); }
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        bool isOpen() const { return file_ != nullptr; }
+        uint32_t sampleRate() const { return sample_rate_; }
+        /** 剩余样本数 */
+        size_t remaining() const { return remaining_ / sizeof(int16_t); }
+
+        /**
+         * @return 读出的样本数，0 表示读完或出错
+         */
+        size_t read(int16_t* pcm, size_t samples);
+        void close();
+
+    private:
+        friend class ResponseCache;
+
+        ResponseCache* cache_{nullptr};
+        FILE* file_{nullptr};
+        uint64_t tag_{0};
+        uint32_t sample_rate_{0};
+        size_t remaining_{0};
+        int64_t lookup_us_{0};      ///< 0 表示已记录首个音频耗时
+    };
+
+    static ResponseCache& getInstance();
+
+    /**
+     * @brief 读入索引，清理写到一半的临时文件
+     * @param dir 缓存所在目录（已挂载的 SPIFFS）
+     * @param budget_bytes 缓存文件的总大小上限
+     */
+    esp_err_t open(const char* dir = kDefaultDir, size_t budget_bytes = kDefaultBudget);
+    void close();
+
+    bool isOpen() const { return dir_[0] != '\0'; }
+
+    /**
+     * @brief 查找并打开一条缓存
+     * @return 命中时 reader 可读；未命中时记下时间，作为随后 beginInsert() 首个音频耗时的起点
+     */
+    bool lookup(const CacheKey& key, Reader& reader);
+
+    /**
+     * @brief 命中时从 Flash 流式播放整段缓存
+     * @return ESP_ERR_NOT_FOUND 未命中
+     */
+    esp_err_t play(const CacheKey& key, AudioPlayback& playback);
+
+    /**
+     * @brief 开始写入一条合成结果（同一时间只写一条）
+     * @param expected_bytes 预计大小，用于提前腾出空间，不知道时为 0
+     */
+    esp_err_t beginInsert(const CacheKey& key, uint32_t sample_rate, size_t expected_bytes = 0);
+    esp_err_t write(const int16_t* pcm, size_t samples);
+    /** 写完改名并加入索引，超出预算时淘汰最久未用的条目 */
+    esp_err_t commit();
+    /** 放弃写入（合成中断、用户打断） */
+    void abort();
+
+    CacheStats stats() const;
+
+    ResponseCache(const ResponseCache&) = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+
+private:
+    ResponseCache() = default;
+
+    struct IndexEntry {
+        uint64_t tag;           ///< 键的前 8 字节，也是文件名
+        uint32_t bytes;         ///< 文件大小（含文件头）
+        uint32_t last_use;      ///< 最近使用时间（单调计数），0 表示空位
+        uint16_t hits;          ///< 写入后的命中次数，0 的条目先被淘汰
+        uint8_t readers;        ///< 正在读取的 Reader 个数
+    };
+
+    /** rc.idx 中的一项，按最近使用从旧到新排列 */
+    struct IndexRecord {
+        uint64_t tag;
+        uint32_t bytes;
+        uint32_t hits;
+    };
+
+    static uint64_t tagOf(const CacheKey& key);
+    void pathOf(uint64_t tag, char* out, size_t size) const;
+    IndexEntry* findLocked(uint64_t tag);
+    IndexEntry* addLocked(uint64_t tag, uint32_t bytes, uint32_t last_use, uint32_t hits);
+    void removeLocked(IndexEntry& entry);
+    /** 按两段 LRU 淘汰直到能再放下 extra 字节 */
+    bool makeRoomLocked(size_t extra);
+    void loadIndexLocked();
+    void saveIndexLocked();
+    void release(uint64_t tag);
+    void noteFirstAudio(int64_t since_us, bool hit);
+
+    mutable std::mutex mutex_;
+    char dir_[32]{};
+    size_t budget_{0};
+    IndexEntry entries_[kMaxEntries]{};
+    size_t used_bytes_{0};
+    uint32_t clock_{0};
+    uint32_t hits_since_save_{0};
+
+    // 写入中的条目
+    FILE* insert_file_{nullptr};
+    CachedAudioHeader insert_header_{};
+    int64_t insert_since_us_{0};    ///< 对应未命中的查找时间，0 表示已记录首个音频耗时
+    int64_t miss_us_{0};            ///< 最近一次未命中的时间
+    uint64_t miss_tag_{0};
+
+    CacheStats stats_{};
+};
+
+} // namespace chunfeng
@@ -0,0 +1,78 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-27 09:12:26
+ * @LastEditTime: 2025-06-27 16:48:03
+ * @LastEditors: 星年
+ * @Description: 播放响度与限幅：不同回复的响度统一到目标，软拐点限制峰值，保护小喇叭不削波
+ * @FilePath: \ESP32-ChunFeng\components\audio\include\soft_limiter.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+
+namespace chunfeng {
+
+/**
+ * @brief 播放响度归一与软限幅，在播放任务中逐帧原位处理
+ *
+ * 响度：高于 -50dBFS 的帧计入响度估计（约 160ms 平滑），增益朝 目标 - 响度 调整（±12dB 以内，
+ * 每帧最多 0.5dB）。静音超过 1.5s 后算新的一段回复：第一帧直接按该帧定增益，前 8 帧的响度取平均、
+ * 增益每帧最多调 2dB，每段回复很快到达目标响度。
+ * 限幅：每帧分 10 小段，按峰值与上限的差计算压缩量（上限以下 6dB 开始的软拐点），
+ * 小段之间线性过渡并预读下一小段，压缩立即生效、约 60ms 释放；最后按上限饱和兜底。
+ * 不引入额外延迟，音量也在这里一并乘上。
+ */
+class SoftLimiter {
+public:
+    static constexpr size_t kSubBlocks = 10;
+
+    SoftLimiter();
+
+    SoftLimiter(const SoftLimiter&) = delete;
+    SoftLimiter& operator=(const SoftLimiter&) = delete;
+
+    /**
+     * @param normalize 是否统一响度；关闭时只乘音量并限幅
+     * @param loudness_dbfs 响度目标（满量程正弦为 0dBFS）
+     * @param ceiling_dbfs 峰值上限
+     * @return ESP_ERR_INVALID_ARG 响度目标不在 -40~-6dBFS、上限不在 -20~0dBFS，或目标高于上限
+     */
+    esp_err_t configure(bool normalize, int8_t loudness_dbfs, int8_t ceiling_dbfs);
+
+    void reset();
+
+    /**
+     * @brief 处理一帧
+     * @param volume_q15 音量（Q15）
+     */
+    void process(int16_t* pcm, size_t samples, int32_t volume_q15);
+
+    /**
+     * @brief 这一帧没有语音（补了静音）
+     */
+    void idle();
+
+    /** 当前响度增益（dB） */
+    int gainDb() const;
+
+    /** 上一帧的最大压缩量（dB，0 表示没有压缩） */
+    int reductionDb() const;
+
+private:
+    bool normalize_{true};
+    int32_t target_{0};             ///< 响度目标（功率 log2 Q8）
+    int32_t ceiling_log_{0};        ///< 上限（幅度 log2 Q8）
+    int32_t ceiling_{0};            ///< 上限（线性）
+    int32_t loudness_{0};           ///< 响度估计，0 表示还没有
+    int32_t gain_{0};               ///< 响度增益（幅度 log2 Q8）
+    uint32_t envelope_{32768};      ///< 限幅增益（Q15）
+    uint32_t min_envelope_{32768};
+    int32_t applied_{8192};         ///< 上一小段结束时的总增益（Q13）
+    uint32_t idle_frames_{0};
+    uint32_t frames_{0};            ///< 本段回复计入响度的帧数
+};
+
+} // namespace chunfeng
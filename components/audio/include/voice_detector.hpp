@@ -0,0 +1,72 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-30 09:12:40
+ * @LastEditTime: 2025-06-30 17:46:09
+ * @LastEditors: 星年
+ * @Description: 语音端点检测：按 10ms 分段的能量与跟踪的噪声底判断一句话的开始与结束
+ * @FilePath: \ESP32-ChunFeng\components\audio\include\voice_detector.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace chunfeng {
+
+/**
+ * @brief 能量端点检测
+ *
+ * 输入按 10ms 一段（segmentSamples()）送入。每段取均方值的 log2（Q8 定点），噪声底只在没有语音时跟踪
+ * （时间常数 80~160ms，落在噪声电平起伏的中间偏下，每段最多抬高 0.25dB），说话期间保持不变。
+ * 连续 kStartSegments 段高出噪声底 kStartMarginDb 且不低于 kMinSpeechDbfs 时报告 START，
+ * 这句话实际从 kStartSegments 段之前开始；之后平滑后的电平连续 kEndSegments 段（300ms）低于
+ * 噪声底 + kEndMarginDb 或这句话的最大电平 - kEndBelowPeakDb（两者取高）时报告 END：
+ * 说话后降噪残留的噪声往往比说话前高几 dB，只看噪声底会迟迟不结束。
+ * 开头 kWarmupSegments 段（200ms，也是前级降噪收敛的时间）只跟踪噪声底，不报告 START。
+ * 超过 kMaxSegments（10s）仍未结束时也报告 END，并从当前电平重新跟踪噪声底。
+ * 应接在降噪之后，不分配内存。
+ */
+class VoiceDetector {
+public:
+    enum class Event : uint8_t { NONE, START, END };
+
+    static constexpr uint32_t kSegmentMs = 10;
+    static constexpr uint32_t kWarmupSegments = 20;
+    static constexpr uint32_t kStartSegments = 3;
+    static constexpr uint32_t kEndSegments = 30;
+    static constexpr uint32_t kMaxSegments = 1000;
+    static constexpr int kStartMarginDb = 10;
+    static constexpr int kEndMarginDb = 9;
+    static constexpr int kEndBelowPeakDb = 25;
+    static constexpr int kMinSpeechDbfs = -55;
+
+    explicit VoiceDetector(uint32_t sample_rate = 16000);
+
+    void reset();
+
+    /**
+     * @brief 送入一段 segmentSamples() 个样本
+     * @return 这一段上发生的事件
+     */
+    Event feed(const int16_t* segment);
+
+    size_t segmentSamples() const { return segment_samples_; }
+    bool speaking() const { return speaking_; }
+
+    /** 当前噪声底（dBFS，满量程正弦为 0） */
+    int noiseFloorDb() const;
+
+private:
+    size_t segment_samples_;
+    int32_t floor_{0};          ///< 噪声底（均方值的 log2 Q8）
+    int32_t smooth_{0};         ///< 平滑后的电平，用于判断结束
+    int32_t peak_{0};           ///< 这句话中 smooth_ 的最大值
+    bool primed_{false};
+    bool speaking_{false};
+    uint32_t run_{0};           ///< 连续满足开始或结束条件的段数
+    uint32_t warmup_{0};        ///< 已跟踪噪声底的段数，到 kWarmupSegments 为止
+    uint32_t length_{0};        ///< 这句话已有的段数
+};
+
+} // namespace chunfeng
@@ -0,0 +1,305 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-29 09:05:17
+ * @LastEditTime: 2025-06-30 17:46:09
+ * @LastEditors: 星年
+ * @Description: 播放混音：流的打开与单生产者缓冲、多相重采样、压低与增益渐变、定点累加
+ * @FilePath: \ESP32-ChunFeng\components\audio\src\audio_mixer.cpp
+ * @遇事不决，可问春风
+ */
+#include "audio_mixer.hpp"
+#include "metrics.hpp"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace chunfeng {
+
+namespace {
+
+// 混音耗时分桶（微秒）
+const uint32_t kMixUsBuckets[] = {10, 25, 50, 100, 200, 500};
+
+metrics::Histogram s_mix_us("chunfeng_audio_mix_us", "每帧混音（重采样、压低与累加）耗时（微秒）", kMixUsBuckets,
+                            sizeof(kMixUsBuckets) / sizeof(kMixUsBuckets[0]));
+metrics::Gauge s_streams("chunfeng_audio_mix_streams", "正在播放的混音流数（不含语音主通道）");
+metrics::Counter s_underruns("chunfeng_audio_mix_underruns_total", "混音流播放中途缓冲不足、补零的帧数");
+
+// 增益以 1 << 15 为 1：满增益时乘法与移位不改变样本
+constexpr int32_t kUnity = 1 << 15;
+constexpr uint32_t kOneQ16 = 1u << 16;
+constexpr int kPhaseShift = 16 - 5;     // Q16 小数部分的高 5 位选相位（kPhases = 32）
+
+int16_t saturate(int32_t v) {
+    return static_cast<int16_t>(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+}
+
+/**
+ * acc[i] += src[i] x g，g 在本帧内从 g0 线性变到 g1（Q15）
+ *
+ * 连续数组、循环体没有分支，编译器可以向量化；增益不变时走更短的循环。
+ */
+void accumulate(int32_t* acc, const int16_t* src, size_t n, int32_t g0, int32_t g1) {
+    if (g0 == g1) {
+        if (g0 == 0) return;
+        for (size_t i = 0; i < n; ++i) acc[i] += (static_cast<int32_t>(src[i]) * g0) >> 15;
+        return;
+    }
+    // 增益放大 2^8 后逐样本累加步长，帧尾正好到 g1
+    const int32_t step = ((g1 - g0) * 256) / static_cast<int32_t>(n);
+    int32_t g = g0 * 256;
+    for (size_t i = 0; i < n; ++i) {
+        g += step;
+        acc[i] += (static_cast<int32_t>(src[i]) * (g >> 8)) >> 15;
+    }
+}
+
+} // namespace
+
+static_assert(AudioMixer::kPhases == 1u << (16 - kPhaseShift), "相位数与 kPhaseShift 不一致");
+static_assert((AudioMixer::kStreamSamples & (AudioMixer::kStreamSamples - 1)) == 0, "流缓冲必须为 2 的幂");
+
+AudioMixer::AudioMixer() {
+    for (size_t db = 0; db < sizeof(db_q15_) / sizeof(db_q15_[0]); ++db) {
+        db_q15_[db] = static_cast<int32_t>(std::lround(kUnity * std::pow(10.0, -static_cast<double>(db) / 20)));
+    }
+    speech_.gain = kUnity;
+    speech_.base = kUnity;
+    setOutputRate(16000);
+}
+
+esp_err_t AudioMixer::setOutputRate(uint32_t sample_rate) {
+    if (sample_rate < 8000 || sample_rate > 48000) return ESP_ERR_INVALID_ARG;
+    out_rate_ = sample_rate;
+    speech_.fade_samples = kSpeechFadeMs * sample_rate / 1000;
+    for (Stream& s : streams_) {
+        if (!s.started) continue;
+        s.step_q16 = static_cast<uint32_t>((static_cast<uint64_t>(s.config.sample_rate) << 16) / out_rate_);
+        s.level.fade_samples = std::max<uint32_t>(1, s.config.fade_ms * out_rate_ / 1000);
+        design(s);
+    }
+    return ESP_OK;
+}
+
+void AudioMixer::design(Stream& s) {
+    if (s.step_q16 == kOneQ16) return;
+    // 系数只在流开始或采样率切换时用浮点计算；降采样时截止频率按比例降低，留 10% 过渡带
+    const double pi = 3.14159265358979323846;
+    const double ratio = static_cast<double>(s.step_q16) / kOneQ16;
+    const double cutoff = std::min(1.0, 1.0 / ratio) * 0.9;
+    for (size_t p = 0; p < kPhases; ++p) {
+        const double center = kTaps / 2 - 1 + static_cast<double>(p) / kPhases;
+        double h[kTaps];
+        double sum = 0;
+        for (size_t k = 0; k < kTaps; ++k) {
+            double x = k - center;
+            double sinc = std::fabs(x) < 1e-9 ? 1.0 : std::sin(pi * cutoff * x) / (pi * cutoff * x);
+            double window = 0.5 + 0.5 * std::cos(pi * x / (kTaps / 2.0));
+            h[k] = sinc * window;
+            sum += h[k];
+        }
+        // 每个相位的直流增益归一化为 1
+        for (size_t k = 0; k < kTaps; ++k) s.taps[p][k] = static_cast<int16_t>(std::lround(32767.0 * h[k] / sum));
+    }
+}
+
+esp_err_t AudioMixer::open(const MixStreamConfig& config, int* id) {
+    if (config.sample_rate < 8000 || config.sample_rate > 48000 || config.gain_db < -40 || config.gain_db > 0 ||
+        config.duck_db > 40 || config.fade_ms < 5 || config.fade_ms > 1000 || !id) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < kMaxStreams; ++i) {
+        Stream& s = streams_[i];
+        uint8_t expected = FREE;
+        if (!s.state.compare_exchange_strong(expected, SETUP, std::memory_order_acquire)) continue;
+        // SETUP 期间混音方不碰这路流，其余字段在首次混音时由混音方初始化
+        s.config = config;
+        s.head.store(0, std::memory_order_relaxed);
+        s.tail.store(0, std::memory_order_relaxed);
+        s.state.store(PLAYING, std::memory_order_release);
+        *id = static_cast<int>(i);
+        return ESP_OK;
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+size_t AudioMixer::write(int id, const int16_t* pcm, size_t samples) {
+    if (id < 0 || static_cast<size_t>(id) >= kMaxStreams) return 0;
+    Stream& s = streams_[id];
+    if (s.state.load(std::memory_order_relaxed) != PLAYING) return 0;
+    const uint32_t head = s.head.load(std::memory_order_acquire);
+    const uint32_t tail = s.tail.load(std::memory_order_relaxed);
+    const size_t n = std::min<size_t>(samples, kStreamSamples - (tail - head));
+    const size_t at = tail & (kStreamSamples - 1);
+    const size_t first = std::min(n, kStreamSamples - at);
+    memcpy(s.buffer + at, pcm, first * sizeof(int16_t));
+    memcpy(s.buffer, pcm + first, (n - first) * sizeof(int16_t));
+    s.tail.store(tail + static_cast<uint32_t>(n), std::memory_order_release);
+    return n;
+}
+
+void AudioMixer::finish(int id) {
+    if (id < 0 || static_cast<size_t>(id) >= kMaxStreams) return;
+    uint8_t expected = PLAYING;
+    streams_[id].state.compare_exchange_strong(expected, DRAINING, std::memory_order_acq_rel);
+}
+
+void AudioMixer::stop(int id) {
+    if (id < 0 || static_cast<size_t>(id) >= kMaxStreams) return;
+    // 写完的流可能恰好被混音方释放，只从 PLAYING/DRAINING 切换，不会复活已释放的流
+    std::atomic<uint8_t>& state = streams_[id].state;
+    uint8_t current = state.load(std::memory_order_relaxed);
+    while ((current == PLAYING || current == DRAINING) &&
+           !state.compare_exchange_weak(current, STOPPING, std::memory_order_acq_rel)) {
+    }
+}
+
+void AudioMixer::stopAll() {
+    for (size_t i = 0; i < kMaxStreams; ++i) stop(static_cast<int>(i));
+}
+
+bool AudioMixer::writable(int id) const {
+    if (id < 0 || static_cast<size_t>(id) >= kMaxStreams) return false;
+    return streams_[id].state.load(std::memory_order_relaxed) == PLAYING;
+}
+
+size_t AudioMixer::activeStreams() const {
+    size_t active = 0;
+    for (const Stream& s : streams_) active += s.state.load(std::memory_order_relaxed) >= PLAYING;
+    return active;
+}
+
+int32_t AudioMixer::nextGain(Level& level, uint8_t duck_db, bool stopping, size_t samples) {
+    // 压低量立即跟上更大的值，变小要先保持 kDuckHoldMs
+    if (duck_db >= level.duck_db) {
+        level.duck_db = duck_db;
+        level.hold = duck_db ? kDuckHoldMs * out_rate_ / 1000 : 0;
+    } else if (level.hold > samples) {
+        level.hold -= static_cast<uint32_t>(samples);
+    } else {
+        level.hold = 0;
+        level.duck_db = duck_db;
+    }
+    const int32_t target = stopping ? 0 : (level.base * db_q15_[level.duck_db]) >> 15;
+    const int32_t delta = std::max<int32_t>(1, static_cast<int32_t>(kUnity * samples / level.fade_samples));
+    if (level.gain < target) {
+        level.gain = std::min(target, level.gain + delta);
+    } else {
+        level.gain = std::max(target, level.gain - delta);
+    }
+    return level.gain;
+}
+
+bool AudioMixer::render(Stream& s, size_t samples) {
+    // work_ 前 kTaps 个是上一帧留下的历史，后面是这一帧要取走的输入
+    const uint32_t end_q16 = s.pos_q16 + s.step_q16 * static_cast<uint32_t>(samples);
+    const size_t consumed = end_q16 >> 16;
+    memcpy(work_, s.history, sizeof(s.history));
+
+    const uint32_t head = s.head.load(std::memory_order_relaxed);
+    const uint32_t tail = s.tail.load(std::memory_order_acquire);
+    const size_t take = std::min<size_t>(consumed, tail - head);
+    const size_t at = head & (kStreamSamples - 1);
+    const size_t first = std::min(take, kStreamSamples - at);
+    memcpy(work_ + kTaps, s.buffer + at, first * sizeof(int16_t));
+    memcpy(work_ + kTaps + first, s.buffer, (take - first) * sizeof(int16_t));
+    s.head.store(head + static_cast<uint32_t>(take), std::memory_order_release);
+    // 缓冲不足时补零：写完的流借此把滤波器里的尾巴送出去，还在写的流记一次欠载
+    memset(work_ + kTaps + take, 0, (consumed - take) * sizeof(int16_t));
+    const uint8_t state = s.state.load(std::memory_order_relaxed);
+    if (take) s.played = true;
+    if (take < consumed) {
+        if (state == DRAINING) {
+            s.flushed += static_cast<uint32_t>(consumed - take);
+        } else if (state == PLAYING && s.played) {
+            s_underruns.inc();
+        }
+    }
+
+    if (s.step_q16 == kOneQ16) {
+        memcpy(mono_, work_ + kTaps / 2 - 1, samples * sizeof(int16_t));
+    } else {
+        uint32_t pos = s.pos_q16;
+        for (size_t n = 0; n < samples; ++n) {
+            const int16_t* x = work_ + (pos >> 16);
+            const int16_t* h = s.taps[(pos & 0xFFFF) >> kPhaseShift];
+            int32_t acc = 0;
+            for (size_t k = 0; k < kTaps; ++k) acc += static_cast<int32_t>(x[k]) * h[k];
+            mono_[n] = saturate((acc + (1 << 14)) >> 15);
+            pos += s.step_q16;
+        }
+    }
+    memcpy(s.history, work_ + consumed, sizeof(s.history));
+    s.pos_q16 = end_q16 & 0xFFFF;
+    return !(state == DRAINING && s.flushed >= kTaps);
+}
+
+bool AudioMixer::mix(int16_t* frame, size_t samples, bool voice) {
+    const uint32_t start_cycles = esp_cpu_get_cycle_count();
+    const int64_t start_us = esp_timer_get_time();
+    samples = std::min(samples, kMaxFrame);
+
+    uint8_t state[kMaxStreams];
+    size_t active = 0;
+    for (size_t i = 0; i < kMaxStreams; ++i) {
+        Stream& s = streams_[i];
+        state[i] = s.state.load(std::memory_order_acquire);
+        if (state[i] < PLAYING) continue;
+        ++active;
+        if (s.started) continue;
+        // 新打开的流：从静音淡入
+        s.started = true;
+        s.played = false;
+        s.pos_q16 = 0;
+        s.flushed = 0;
+        memset(s.history, 0, sizeof(s.history));
+        s.level = Level{};
+        s.level.base = db_q15_[-s.config.gain_db];
+        s.step_q16 = static_cast<uint32_t>((static_cast<uint64_t>(s.config.sample_rate) << 16) / out_rate_);
+        s.level.fade_samples = std::max<uint32_t>(1, s.config.fade_ms * out_rate_ / 1000);
+        design(s);
+    }
+    s_streams.set(static_cast<int32_t>(active));
+    // 只有语音、也没有在恢复被压低的增益：帧原样输出
+    if (!active && speech_.gain == kUnity && speech_.duck_db == 0) {
+        last_cycles_ = esp_cpu_get_cycle_count() - start_cycles;
+        return false;
+    }
+
+    // 压低量：正在播放的更高优先级的流（停止中的除外）里 duck_db 最大者
+    auto duckFor = [&](uint8_t priority) {
+        uint8_t db = voice && mix_priority::kSpeech > priority ? kSpeechDuckDb : 0;
+        for (size_t i = 0; i < kMaxStreams; ++i) {
+            if ((state[i] == PLAYING || state[i] == DRAINING) && streams_[i].config.priority > priority) {
+                db = std::max(db, streams_[i].config.duck_db);
+            }
+        }
+        return db;
+    };
+
+    memset(acc_, 0, samples * sizeof(acc_[0]));
+    const int32_t speech_from = speech_.gain;
+    accumulate(acc_, frame, samples, speech_from, nextGain(speech_, duckFor(mix_priority::kSpeech), false, samples));
+    for (size_t i = 0; i < kMaxStreams; ++i) {
+        if (state[i] < PLAYING) continue;
+        Stream& s = streams_[i];
+        const bool stopping = state[i] == STOPPING;
+        const int32_t from = s.level.gain;
+        const int32_t to = nextGain(s.level, duckFor(s.config.priority), stopping, samples);
+        const bool alive = render(s, samples);
+        accumulate(acc_, mono_, samples, from, to);
+        if (!alive || (stopping && to == 0)) {
+            s.started = false;
+            s.state.store(FREE, std::memory_order_release);
+        }
+    }
+    for (size_t n = 0; n < samples; ++n) frame[n] = saturate(acc_[n]);
+
+    last_cycles_ = esp_cpu_get_cycle_count() - start_cycles;
+    s_mix_us.observe(static_cast<uint32_t>(esp_timer_get_time() - start_us));
+    return active > 0;
+}
+
+} // namespace chunfeng
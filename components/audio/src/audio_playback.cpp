@@ -0,0 +1,323 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-17 10:41:15
+ * @LastEditTime: 2025-06-30 17:46:09
+ * @LastEditors: 星年
+ * @Description: 音频播放：PCM 帧环形缓冲、混音、响度与限幅、I2S 输出与播放分析
+ * @FilePath: \ESP32-ChunFeng\components\audio\src\audio_playback.cpp
+ * @遇事不决，可问春风
+ */
+#include "audio_playback.hpp"
+#include "cf_log.hpp"
+#include "metrics.hpp"
+#include "status_board.hpp"
+#include "task_topology.hpp"
+#include "esp_timer.h"
+#include <cstring>
+
+namespace chunfeng {
+
+namespace {
+
+const char* TAG = "AudioPlayback";
+
+metrics::Counter s_frames("chunfeng_audio_play_frames_total", "写入 I2S 的语音帧数（不含补的静音）");
+metrics::Counter s_underruns("chunfeng_audio_play_underruns_total", "语音播放中途缓冲为空、补静音的帧数");
+metrics::Counter s_limited("chunfeng_audio_play_limited_frames_total", "限幅压缩超过 1dB 的语音帧数");
+metrics::Gauge s_play_gain("chunfeng_audio_play_gain_db", "播放响度归一的当前增益（dB）");
+
+} // namespace
+
+AudioPlayback& AudioPlayback::getInstance() {
+    static AudioPlayback instance;
+    return instance;
+}
+
+namespace {
+
+// 响度设置打包成一个原子量交给播放任务：bit24 有效，bit16 归一开关，bit8 响度目标，bit0 上限
+uint32_t packLevels(const AudioConfig& config) {
+    return (1u << 24) | (config.play_normalize ? 1u << 16 : 0) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(config.play_loudness_dbfs)) << 8) |
+           static_cast<uint8_t>(config.play_ceiling_dbfs);
+}
+
+bool frameSamplesFor(uint32_t sample_rate, size_t& samples) {
+    if (sample_rate * AudioPlayback::kFrameMs % 1000 != 0) return false;
+    samples = sample_rate * AudioPlayback::kFrameMs / 1000;
+    return samples > 0 && samples <= AudioPlayback::kMaxFrameSamples;
+}
+
+} // namespace
+
+esp_err_t AudioPlayback::start(const PlaybackConfig& config) {
+    if (task_) return ESP_OK;
+    size_t frame_samples = 0;
+    if (!frameSamplesFor(config.sample_rate, frame_samples) || config.dma_desc_num < 2) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    config_ = config;
+    frame_samples_ = frame_samples;
+    analyzer_.setBudget(config.tap_budget_us);
+    mixer_.setOutputRate(config.sample_rate);
+
+    esp_err_t err = openChannel();
+    if (err != ESP_OK) return err;
+    if (tasks::spawn(tasks::TaskId::AUDIO_PLAY, playTask, this, &task_) != pdPASS) {
+        closeChannel();
+        return ESP_FAIL;
+    }
+    CF_LOGI(TAG, "播放 %u Hz，输出延迟 %u ms", static_cast<unsigned>(config.sample_rate),
+            static_cast<unsigned>((config.dma_desc_num - 1) * kFrameMs + config.dac_latency_us / 1000));
+    return ESP_OK;
+}
+
+esp_err_t AudioPlayback::openChannel() {
+    const PlaybackConfig& config = config_;
+    // 每个 DMA 描述符正好一帧：写入返回的时刻就是一帧播完的时刻
+    i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(config.port, I2S_ROLE_MASTER);
+    chan_cfg.dma_desc_num = config.dma_desc_num;
+    chan_cfg.dma_frame_num = frame_samples_;
+    chan_cfg.auto_clear = true;     // 欠载时输出静音而不是重复旧数据
+    esp_err_t err = i2s_new_channel(&chan_cfg, &tx_, nullptr);
+    if (err != ESP_OK) {
+        CF_LOGE(TAG, "I2S 通道创建失败: %d", err);
+        return err;
+    }
+    i2s_std_config_t std_cfg = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(config.sample_rate),
+        .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO),
+        .gpio_cfg = {
+            .mclk = I2S_GPIO_UNUSED,
+            .bclk = static_cast<gpio_num_t>(config.bclk_gpio),
+            .ws = static_cast<gpio_num_t>(config.ws_gpio),
+            .dout = static_cast<gpio_num_t>(config.dout_gpio),
+            .din = I2S_GPIO_UNUSED,
+            .invert_flags = {
+                .mclk_inv = false,
+                .bclk_inv = false,
+                .ws_inv = false,
+            },
+        },
+    };
+    err = i2s_channel_init_std_mode(tx_, &std_cfg);
+    if (err == ESP_OK) err = i2s_channel_enable(tx_);
+    if (err != ESP_OK) {
+        CF_LOGE(TAG, "I2S 初始化失败: %d", err);
+        i2s_del_channel(tx_);
+        tx_ = nullptr;
+        return err;
+    }
+    return ESP_OK;
+}
+
+void AudioPlayback::closeChannel() {
+    i2s_channel_disable(tx_);
+    i2s_del_channel(tx_);
+    tx_ = nullptr;
+}
+
+esp_err_t AudioPlayback::setSampleRate(uint32_t sample_rate) {
+    size_t frame_samples = 0;
+    if (!frameSamplesFor(sample_rate, frame_samples)) return ESP_ERR_INVALID_ARG;
+    if (!task_) {
+        config_.sample_rate = sample_rate;
+        return ESP_OK;
+    }
+    pending_rate_.store(sample_rate, std::memory_order_release);
+    return ESP_OK;
+}
+
+void AudioPlayback::setVolume(uint32_t volume) {
+    if (volume > 100) volume = 100;
+    volume_.store(volume, std::memory_order_relaxed);
+    gain_q15_.store(static_cast<int32_t>(volume * 32767 / 100), std::memory_order_relaxed);
+}
+
+esp_err_t AudioPlayback::setLevels(const AudioConfig& config) {
+    // 先在调用方校验，播放任务应用时不会失败
+    SoftLimiter check;
+    esp_err_t err = check.configure(config.play_normalize, config.play_loudness_dbfs, config.play_ceiling_dbfs);
+    if (err != ESP_OK) return err;
+    pending_levels_.store(packLevels(config), std::memory_order_release);
+    return ESP_OK;
+}
+
+void AudioPlayback::stop() {
+    mixer_.stopAll();
+    drop_.store(true, std::memory_order_release);
+}
+
+size_t AudioPlayback::writeStream(int id, const int16_t* pcm, size_t samples, uint32_t timeout_ms) {
+    size_t done = mixer_.write(id, pcm, samples);
+    const TickType_t start = xTaskGetTickCount();
+    while (done < samples && mixer_.writable(id)) {
+        if (timeout_ms != portMAX_DELAY && xTaskGetTickCount() - start >= pdMS_TO_TICKS(timeout_ms)) break;
+        // 播放任务每帧取走一批，不必逐帧唤醒写入方
+        vTaskDelay(pdMS_TO_TICKS(kFrameMs / 2));
+        done += mixer_.write(id, pcm + done, samples - done);
+    }
+    return done;
+}
+
+bool AudioPlayback::pushStaging(uint32_t timeout_ms) {
+    if (ring_.tryPush(staging_)) return true;
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    const bool forever = timeout_ms == portMAX_DELAY;
+    const TickType_t timeout = forever ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    const TickType_t start = xTaskGetTickCount();
+    while (true) {
+        // 先登记再重试：播放任务在两者之间取走一帧时也能看到登记并唤醒
+        writer_.store(self, std::memory_order_seq_cst);
+        if (ring_.tryPush(staging_)) {
+            writer_.store(nullptr, std::memory_order_relaxed);
+            return true;
+        }
+        TickType_t wait = portMAX_DELAY;
+        if (!forever) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (elapsed >= timeout) {
+                writer_.store(nullptr, std::memory_order_relaxed);
+                return false;
+            }
+            wait = timeout - elapsed;
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+size_t AudioPlayback::write(const int16_t* pcm, size_t samples, uint32_t timeout_ms) {
+    if (!task_) return 0;
+    speaking_.store(true, std::memory_order_relaxed);
+    size_t done = 0;
+    while (done < samples) {
+        // 采样率切换后，已暂存的部分按新帧长补齐
+        const size_t frame_samples = frameSamples();
+        size_t n = staged_ < frame_samples ? frame_samples - staged_ : 0;
+        if (n > samples - done) n = samples - done;
+        memcpy(staging_.pcm + staged_, pcm + done, n * sizeof(int16_t));
+        staged_ += n;
+        if (staged_ >= frame_samples) {
+            staging_.samples = static_cast<uint32_t>(staged_);
+            if (!pushStaging(timeout_ms)) {
+                staged_ -= n;
+                break;
+            }
+            staged_ = 0;
+        }
+        done += n;
+    }
+    return done;
+}
+
+void AudioPlayback::flush(uint32_t timeout_ms) {
+    if (!task_) return;
+    const size_t frame_samples = frameSamples();
+    if (staged_ > 0) {
+        if (staged_ < frame_samples) {
+            memset(staging_.pcm + staged_, 0, (frame_samples - staged_) * sizeof(int16_t));
+            staged_ = frame_samples;
+        }
+        staging_.samples = static_cast<uint32_t>(staged_);
+        if (pushStaging(timeout_ms)) staged_ = 0;
+    }
+    speaking_.store(false, std::memory_order_relaxed);
+}
+
+void AudioPlayback::playTask(void* arg) {
+    static_cast<AudioPlayback*>(arg)->run();
+}
+
+void AudioPlayback::run() {
+    static Frame frame;     // 播放任务独占，不占任务栈
+    size_t frame_samples = frameSamples();
+    const int64_t frame_us = kFrameMs * 1000;
+    const int64_t queue_us = static_cast<int64_t>(config_.dma_desc_num - 1) * frame_us;
+    int64_t next_play_us = 0;
+    uint32_t seq = 0;
+    bool published_silence = true;
+    status::AudioStatus audio_status{};
+
+    while (true) {
+        uint32_t rate = pending_rate_.exchange(0, std::memory_order_acquire);
+        if (rate && rate != config_.sample_rate) {
+            // 重建通道：DMA 描述符仍是一帧 20ms，输出时间的推算保持不变
+            closeChannel();
+            config_.sample_rate = rate;
+            frameSamplesFor(rate, frame_samples);
+            frame_samples_.store(frame_samples, std::memory_order_relaxed);
+            mixer_.setOutputRate(rate);
+            if (openChannel() != ESP_OK) {
+                CF_LOGE(TAG, "切换到 %u Hz 失败，播放停止", static_cast<unsigned>(rate));
+                vTaskDelete(nullptr);
+                return;
+            }
+            next_play_us = 0;
+            CF_LOGI(TAG, "采样率切换为 %u Hz", static_cast<unsigned>(rate));
+        }
+
+        uint32_t levels_cfg = pending_levels_.exchange(0, std::memory_order_acquire);
+        if (levels_cfg) {
+            limiter_.configure((levels_cfg >> 16) & 1, static_cast<int8_t>(levels_cfg >> 8),
+                               static_cast<int8_t>(levels_cfg));
+        }
+
+        if (drop_.exchange(false, std::memory_order_acquire)) {
+            // 停止：排队的语音帧直接丢弃，等待中的写入方随之可以继续
+            while (ring_.tryPop(frame)) {
+            }
+            TaskHandle_t writer = writer_.exchange(nullptr, std::memory_order_seq_cst);
+            if (writer) xTaskNotifyGive(writer);
+        }
+
+        bool voice = ring_.tryPop(frame);
+        if (voice) {
+            TaskHandle_t writer = writer_.exchange(nullptr, std::memory_order_seq_cst);
+            if (writer) xTaskNotifyGive(writer);
+            s_frames.inc();
+            ++audio_status.frames;
+        } else {
+            if (speaking_.load(std::memory_order_relaxed)) {
+                s_underruns.inc();
+                ++audio_status.underruns;
+            }
+            frame.samples = static_cast<uint32_t>(frame_samples);
+            memset(frame.pcm, 0, frame.samples * sizeof(int16_t));
+        }
+        // 混入其余的流后，语音与提示音一起统一响度、乘音量并限幅
+        const bool audible = mixer_.mix(frame.pcm, frame.samples, voice) || voice;
+        if (audible) {
+            limiter_.process(frame.pcm, frame.samples, gain_q15_.load(std::memory_order_relaxed));
+            s_play_gain.set(limiter_.gainDb());
+            if (limiter_.reductionDb() > 1) s_limited.inc();
+        } else {
+            limiter_.idle();
+        }
+
+        int64_t before = esp_timer_get_time();
+        size_t written = 0;
+        i2s_channel_write(tx_, frame.pcm, frame.samples * sizeof(int16_t), &written, portMAX_DELAY);
+        int64_t now = esp_timer_get_time();
+        // 写入阻塞过说明 DMA 已排满、刚播完一帧，这一帧排在其余描述符之后；
+        // 没有阻塞（刚启动或欠载后）时按上一帧连续推算，且不早于现在
+        int64_t play_us = now - before > frame_us / 4 ? now + queue_us : (next_play_us > now ? next_play_us : now);
+        next_play_us = play_us + frame_us;
+        ++seq;
+
+        // 静音期间只发布一次归零，之后不再占用总线
+        if (!audible && published_silence) continue;
+        AudioLevels levels{};
+        levels.play_us = play_us + config_.dac_latency_us;
+        levels.frame = seq;
+        analyzer_.analyze(frame.pcm, frame.samples, levels);
+        bus::publish<bus::Topic::AUDIO_LEVEL>(levels);
+        published_silence = !audible;
+
+        // 状态快照：写入只是几次原子存储，不会被读取方拖慢
+        audio_status.playing = audible;
+        audio_status.level = levels.level;
+        status::updateAudio(audio_status);
+    }
+}
+
+} // namespace chunfeng
@@ -0,0 +1,118 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-17 10:02:37
+ * @LastEditTime: 2025-06-27 16:48:03
+ * @LastEditors: 星年
+ * @Description: 播放音频的响度与频带能量分析
+ * @FilePath: \ESP32-ChunFeng\components\audio\src\audio_spectrum.cpp
+ * @遇事不决，可问春风
+ */
+#include "audio_spectrum.hpp"
+#include "fixed_log.hpp"
+#include "metrics.hpp"
+#include "esp_timer.h"
+#include <cmath>
+#include <cstring>
+
+namespace chunfeng {
+
+namespace {
+
+// 分析耗时分桶（微秒）
+const uint32_t kTapUsBuckets[] = {25, 50, 100, 200, 300, 500, 1000};
+
+metrics::Histogram s_tap_us("chunfeng_audio_tap_us", "每帧播放音频分析耗时（微秒）", kTapUsBuckets,
+                            sizeof(kTapUsBuckets) / sizeof(kTapUsBuckets[0]));
+metrics::Counter s_skipped("chunfeng_audio_tap_skipped_total", "预算不足跳过频带计算的帧数");
+
+// 频带边界（FFT 序号，16kHz 采样时每个序号 62.5Hz）
+const uint16_t kBandEdges[SpectrumAnalyzer::kBands + 1] = {2, 4, 6, 9, 13, 19, 28, 42, 64};
+
+// 满量程正弦波的均方值约 2^29；FFT 每级右移一位，加窗后峰值序号的功率约 2^26
+constexpr int kRmsTopLog2 = 29;
+constexpr int kBandTopLog2 = 26;
+constexpr int kRangeLog2 = 20;      // 60dB
+
+/** 功率映射到 0~255：top_log2 为 255，低 60dB 为 0 */
+uint8_t toLevel(uint64_t power, int top_log2) {
+    int32_t floor_q8 = (top_log2 - kRangeLog2) * 256;
+    int32_t v = static_cast<int32_t>(log2Q8(power)) - floor_q8;
+    if (v <= 0) return 0;
+    v = v * 255 / (kRangeLog2 * 256);
+    return static_cast<uint8_t>(v > 255 ? 255 : v);
+}
+
+uint32_t isqrt(uint32_t v) {
+    uint32_t root = 0;
+    uint32_t bit = 1u << 30;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= root + bit) {
+            v -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+} // namespace
+
+SpectrumAnalyzer::SpectrumAnalyzer(uint32_t budget_us) : budget_us_(budget_us) {
+    // 窗函数与 FFT 系数表只在构造时用浮点计算一次，逐帧处理全部是整数运算
+    const double pi = 3.14159265358979323846;
+    for (size_t n = 0; n < kFftSize; ++n) {
+        window_[n] = static_cast<int16_t>(std::lround(32767.0 * 0.5 * (1.0 - std::cos(2 * pi * n / kFftSize))));
+    }
+}
+
+void SpectrumAnalyzer::analyze(const int16_t* pcm, size_t samples, AudioLevels& out) {
+    int64_t t0 = esp_timer_get_time();
+    uint64_t sum = 0;
+    for (size_t i = 0; i < samples; ++i) {
+        sum += static_cast<uint32_t>(static_cast<int32_t>(pcm[i]) * pcm[i]);
+    }
+    uint32_t mean_square = samples ? static_cast<uint32_t>(sum / samples) : 0;
+    out.rms = static_cast<uint16_t>(isqrt(mean_square));
+    out.level = toLevel(mean_square, kRmsTopLog2);
+
+    uint32_t elapsed = static_cast<uint32_t>(esp_timer_get_time() - t0);
+    if (elapsed + fft_cost_us_ <= budget_us_) {
+        int64_t t1 = esp_timer_get_time();
+        computeBands(pcm, samples);
+        uint32_t cost = static_cast<uint32_t>(esp_timer_get_time() - t1);
+        fft_cost_us_ = fft_cost_us_ ? (fft_cost_us_ * 3 + cost) / 4 : cost;
+        out.fresh_bands = 1;
+    } else {
+        // 估计值偏高（如一次被中断拉长）时逐帧回落，之后会再次尝试
+        fft_cost_us_ -= fft_cost_us_ / 8;
+        out.fresh_bands = 0;
+        s_skipped.inc();
+    }
+    memcpy(out.bands, bands_, sizeof(out.bands));
+    s_tap_us.observe(static_cast<uint32_t>(esp_timer_get_time() - t0));
+}
+
+void SpectrumAnalyzer::computeBands(const int16_t* pcm, size_t samples) {
+    // 取帧尾的 kFftSize 个样本，帧较短时前面补零
+    size_t take = samples < kFftSize ? samples : kFftSize;
+    const int16_t* src = pcm + samples - take;
+    size_t pad = kFftSize - take;
+    for (size_t n = 0; n < kFftSize; ++n) {
+        re_[n] = n < pad ? 0 : static_cast<int16_t>((static_cast<int32_t>(src[n - pad]) * window_[n]) >> 15);
+        im_[n] = 0;
+    }
+    fft_.forward(re_, im_);
+    for (size_t b = 0; b < kBands; ++b) {
+        uint64_t power = 0;
+        for (uint16_t k = kBandEdges[b]; k < kBandEdges[b + 1]; ++k) {
+            power += static_cast<uint32_t>(static_cast<int32_t>(re_[k]) * re_[k]) +
+                     static_cast<uint32_t>(static_cast<int32_t>(im_[k]) * im_[k]);
+        }
+        bands_[b] = toLevel(power / (kBandEdges[b + 1] - kBandEdges[b]), kBandTopLog2);
+    }
+}
+
+} // namespace chunfeng
@@ -0,0 +1,140 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-27 09:12:26
+ * @LastEditTime: 2025-06-27 16:48:03
+ * @LastEditors: 星年
+ * @Description: 采集自动增益：分段电平检测、噪声门、增益跟踪与预读峰值限制
+ * @FilePath: \ESP32-ChunFeng\components\audio\src\auto_gain.cpp
+ * @遇事不决，可问春风
+ */
+#include "auto_gain.hpp"
+#include "fixed_log.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace chunfeng {
+
+namespace {
+
+// 满量程正弦的功率 32767^2 / 2，log2 Q8
+constexpr int32_t kFullScale = 29 * 256;
+
+// 功率每 dB 对应的 log2 Q8；幅度为它的一半
+constexpr double kPowerPerDb = 256 / 3.0103;
+
+int32_t powerDb(double db) { return static_cast<int32_t>(std::lround(db * kPowerPerDb)); }
+
+// 低于 -60dBFS 的段不算说话
+const int32_t kGate = kFullScale + powerDb(-60);
+
+// 说话判定：高于噪声底 6dB；噪声底每段最多上升 2（约 5dB/s），下降立即跟上
+constexpr int32_t kSpeechMargin = 512;
+constexpr int32_t kFloorRise = 2;
+
+// 增益调整：每段放大最多 4（约 19dB/s），减小最多 40（约 1dB）；
+// 开机后前 0.5s 的说话两个方向都按 kFall 调整，一开始离得远也能很快到位
+constexpr int32_t kRise = 4;
+constexpr int32_t kFall = 40;
+constexpr uint32_t kFastSegments = 100;
+
+// 峰值上限 -1dBFS
+constexpr uint32_t kCeiling = 29204;
+
+} // namespace
+
+AutoGain::AutoGain() {
+    configure(16000, -20, 30);
+}
+
+esp_err_t AutoGain::configure(uint32_t sample_rate, int8_t target_dbfs, uint8_t max_gain_db) {
+    size_t segment = sample_rate * kSegmentMs / 1000;
+    if (sample_rate * kSegmentMs % 1000 != 0 || segment == 0 || segment > kMaxSegment || target_dbfs < -40 ||
+        target_dbfs > -3 || max_gain_db > 40) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    segment_ = segment;
+    target_ = kFullScale + powerDb(target_dbfs);
+    max_gain_ = powerDb(max_gain_db) / 2;
+    min_gain_ = powerDb(-12) / 2;
+    reset();
+    return ESP_OK;
+}
+
+void AutoGain::reset() {
+    memset(next_, 0, sizeof(next_));
+    memset(hold_, 0, sizeof(hold_));
+    memset(out_, 0, sizeof(out_));
+    fill_ = 0;
+    gain_ = 0;
+    speech_ = 0;
+    speech_segments_ = 0;
+    floor_ = 0;
+    applied_ = 4096;
+}
+
+void AutoGain::process(const int16_t* in, int16_t* out, size_t samples) {
+    for (size_t i = 0; i < samples; ++i) {
+        int16_t x = in[i];
+        out[i] = out_[fill_];
+        next_[fill_] = x;
+        if (++fill_ == segment_) {
+            processSegment();
+            fill_ = 0;
+        }
+    }
+}
+
+void AutoGain::processSegment() {
+    // 电平检测用刚收到的一段，比正在调整的一段早 5ms
+    uint64_t energy = 0;
+    int32_t peak = 0;
+    for (size_t n = 0; n < segment_; ++n) {
+        int32_t v = next_[n];
+        energy += static_cast<uint64_t>(v * v);
+        int32_t a = std::abs(static_cast<int32_t>(hold_[n]));
+        peak = std::max(peak, std::max(a, v < 0 ? -v : v));
+    }
+    int32_t level = log2Q8(energy / segment_);
+    if (floor_ == 0 || level < floor_) {
+        floor_ = level;
+    } else {
+        floor_ += kFloorRise;
+    }
+    if (level > kGate && level > floor_ + kSpeechMargin) {
+        // 说话电平快升慢降：约 20ms 跟上变响，约 160ms 跟上变轻
+        if (speech_ == 0) {
+            speech_ = level;
+        } else {
+            speech_ += (level - speech_) / (level > speech_ ? 4 : 32);
+        }
+        int32_t desired = std::clamp((target_ - speech_) / 2, min_gain_, max_gain_);
+        const int32_t rise = speech_segments_ < kFastSegments ? kFall : kRise;
+        speech_segments_++;
+        if (desired > gain_) {
+            gain_ += std::min(rise, desired - gain_);
+        } else {
+            gain_ -= std::min(kFall, gain_ - desired);
+        }
+    }
+
+    // 过渡终点不超过两段的峰值限制；起点是上一段的终点，已满足本段的限制
+    uint32_t target = exp2Q8(gain_, 12);
+    if (peak > 0) target = std::min(target, (kCeiling << 12) / static_cast<uint32_t>(peak));
+    const int32_t start = static_cast<int32_t>(applied_);
+    const int32_t step = ((static_cast<int32_t>(target) - start) << 8) / static_cast<int32_t>(segment_);
+    int32_t ramp = start << 8;
+    for (size_t n = 0; n < segment_; ++n) {
+        ramp += step;
+        int32_t v = (static_cast<int32_t>(hold_[n]) * (ramp >> 8) + 2048) >> 12;
+        out_[n] = static_cast<int16_t>(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+    }
+    applied_ = target;
+    memcpy(hold_, next_, segment_ * sizeof(int16_t));
+}
+
+int AutoGain::gainDb() const {
+    return amplitudeQ8ToDb(gain_);
+}
+
+} // namespace chunfeng
@@ -0,0 +1,83 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-26 09:20:41
+ * @LastEditTime: 2025-06-26 17:05:12
+ * @LastEditors: 星年
+ * @Description: 双麦克风延迟求和波束形成：延迟计算、分数延迟滤波器设计与逐样本合成
+ * @FilePath: \ESP32-ChunFeng\components\audio\src\beamformer.cpp
+ * @遇事不决，可问春风
+ */
+#include "beamformer.hpp"
+#include <cmath>
+#include <cstring>
+
+namespace chunfeng {
+
+namespace {
+
+constexpr double kSpeedOfSound = 343.0;     // m/s，室温
+
+} // namespace
+
+Beamformer::Beamformer() {
+    configure(16000, 45, 0);
+}
+
+esp_err_t Beamformer::configure(uint32_t sample_rate, uint16_t spacing_mm, int8_t steer_deg) {
+    if (sample_rate < 8000 || sample_rate > 48000 || spacing_mm == 0 || steer_deg < -90 || steer_deg > 90) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // 系数只在配置时用浮点计算，逐样本处理全部是整数运算
+    const double pi = 3.14159265358979323846;
+    double delay = spacing_mm / 1000.0 * std::sin(steer_deg * pi / 180.0) / kSpeedOfSound * sample_rate;
+    bool lead_second = delay > 0;
+    double magnitude = std::fabs(delay);
+    size_t whole = static_cast<size_t>(magnitude);
+    if (whole > kMaxDelay) return ESP_ERR_INVALID_ARG;
+    double frac = magnitude - whole;
+
+    // 延迟 (kTaps/2 - 1) + frac 的加窗 sinc，直流增益归一化为 1
+    const double center = kLatencySamples + frac;
+    double h[kTaps];
+    double sum = 0;
+    for (size_t i = 0; i < kTaps; ++i) {
+        double x = i - center;
+        double sinc = std::fabs(x) < 1e-9 ? 1.0 : std::sin(pi * x) / (pi * x);
+        double window = 0.5 + 0.5 * std::cos(pi * x / (kTaps / 2.0));
+        h[i] = sinc * window;
+        sum += h[i];
+    }
+    for (size_t i = 0; i < kTaps; ++i) taps_[i] = static_cast<int16_t>(std::lround(32767.0 * h[i] / sum));
+    delay_int_ = whole;
+    lead_second_ = lead_second;
+    delay_q8_ = static_cast<int32_t>(std::lround(delay * 256));
+    reset();
+    return ESP_OK;
+}
+
+void Beamformer::reset() {
+    memset(history_, 0, sizeof(history_));
+    pos_ = 0;
+}
+
+void Beamformer::process(const int16_t* interleaved, size_t channels, int16_t* out, size_t frames) {
+    constexpr size_t kMask = kHistory - 1;
+    const size_t lead = lead_second_ ? 1 : 0;
+    const size_t lag = 1 - lead;
+    for (size_t n = 0; n < frames; ++n) {
+        history_[0][pos_] = interleaved[n * channels];
+        history_[1][pos_] = interleaved[n * channels + 1];
+        // 先收到的一路：整数延迟后过分数延迟滤波器
+        const int16_t* h = history_[lead];
+        size_t base = pos_ - delay_int_;
+        int32_t acc = 0;
+        for (size_t i = 0; i < kTaps; ++i) acc += static_cast<int32_t>(h[(base - i) & kMask]) * taps_[i];
+        // 另一路：按滤波器的群延迟整数延迟
+        int32_t other = history_[lag][(pos_ - kLatencySamples) & kMask];
+        int32_t v = ((acc >> 15) + other) >> 1;
+        out[n] = static_cast<int16_t>(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+        pos_ = (pos_ + 1) & kMask;
+    }
+}
+
+} // namespace chunfeng
@@ -0,0 +1,88 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-26 09:20:41
+ * @LastEditTime: 2025-06-27 16:48:03
+ * @LastEditors: 星年
+ * @Description: 采集增强：配置校验、通道合成、降噪与自动增益的串联、耗时统计
+ * @FilePath: \ESP32-ChunFeng\components\audio\src\capture_enhancer.cpp
+ * @遇事不决，可问春风
+ */
+#include "capture_enhancer.hpp"
+#include "metrics.hpp"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <cstring>
+
+namespace chunfeng {
+
+namespace {
+
+const char* TAG = "CaptureEnhancer";
+
+// 每帧耗时分桶（微秒），AUDIO_DSP 任务每 20ms 的预算为 6000
+const uint32_t kEnhanceUsBuckets[] = {100, 250, 500, 1000, 2000, 4000, 6000};
+
+metrics::Histogram s_enhance_us("chunfeng_audio_enhance_us", "每帧采集增强（波束形成、降噪与自动增益）耗时（微秒）",
+                                kEnhanceUsBuckets, sizeof(kEnhanceUsBuckets) / sizeof(kEnhanceUsBuckets[0]));
+metrics::Gauge s_agc_gain("chunfeng_audio_agc_gain_db", "采集自动增益的当前增益（dB）");
+
+} // namespace
+
+esp_err_t CaptureEnhancer::configure(const AudioConfig& config) {
+    if (config.channels == 0 || config.bit_depth != 16) {
+        ESP_LOGE(TAG, "不支持的采集格式：%u 通道 %u 位", config.channels, config.bit_depth);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (config.channels > 1 && config.beam_mode == BeamMode::DELAY_AND_SUM) {
+        esp_err_t ret = beam_.configure(config.sample_rate, config.mic_spacing_mm, config.steer_deg);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "波束形成参数无效：间距 %umm，方向 %d°", config.mic_spacing_mm, config.steer_deg);
+            return ret;
+        }
+    }
+    if (config.agc && agc_.configure(config.sample_rate, config.agc_target_dbfs, config.agc_max_gain_db) != ESP_OK) {
+        ESP_LOGE(TAG, "自动增益参数无效：目标 %ddBFS，最大 %udB", config.agc_target_dbfs, config.agc_max_gain_db);
+        return ESP_ERR_INVALID_ARG;
+    }
+    ns_.setMaxAttenuation(config.ns_max_attenuation_db);
+    config_ = config;
+    reset();
+    ESP_LOGI(TAG, "%u 通道%s%s%s，延迟 %u 样本", config.channels, beamforming() ? "，波束形成" : "",
+             config.noise_suppression ? "，降噪" : "", config.agc ? "，自动增益" : "",
+             static_cast<unsigned>(latencySamples()));
+    return ESP_OK;
+}
+
+void CaptureEnhancer::reset() {
+    beam_.reset();
+    ns_.reset();
+    agc_.reset();
+}
+
+void CaptureEnhancer::process(const int16_t* in, size_t frames, int16_t* out) {
+    int64_t start_us = esp_timer_get_time();
+    uint32_t start_cycles = esp_cpu_get_cycle_count();
+    if (beamforming()) {
+        beam_.process(in, config_.channels, out, frames);
+    } else if (config_.channels > 1) {
+        for (size_t n = 0; n < frames; ++n) out[n] = in[n * config_.channels];
+    } else if (out != in) {
+        memcpy(out, in, frames * sizeof(int16_t));
+    }
+    if (config_.noise_suppression) ns_.process(out, out, frames);
+    if (config_.agc) {
+        agc_.process(out, out, frames);
+        s_agc_gain.set(agc_.gainDb());
+    }
+    last_cycles_ = esp_cpu_get_cycle_count() - start_cycles;
+    s_enhance_us.observe(static_cast<uint32_t>(esp_timer_get_time() - start_us));
+}
+
+size_t CaptureEnhancer::latencySamples() const {
+    return (beamforming() ? Beamformer::kLatencySamples : 0) +
+           (config_.noise_suppression ? NoiseSuppressor::kLatencySamples : 0) +
+           (config_.agc ? agc_.latencySamples() : 0);
+}
+
+} // namespace chunfeng
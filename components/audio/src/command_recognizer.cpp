@@ -0,0 +1,402 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-30 09:12:40
+ * @LastEditTime: 2025-06-30 17:46:09
+ * @LastEditors: 星年
+ * @Description: 设备端指令词识别：预加重、Mel 频带倒谱、去静音与均值、DTW 模板匹配与拒识
+ * @FilePath: \ESP32-ChunFeng\components\audio\src\command_recognizer.cpp
+ * @遇事不决，可问春风
+ */
+#include "command_recognizer.hpp"
+#include "fixed_log.hpp"
+#include "metrics.hpp"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace chunfeng {
+
+namespace {
+
+// 与降噪相同的按峰值归一化：功率换算到绝对刻度时加 2 x (kMaxShift - shift) 个 log2
+constexpr int kMaxShift = 15;
+
+/** 功率分贝数换算为 log2 的 Q8 */
+constexpr int32_t dbToQ8(int db) {
+    return db * 256 * 1000 / 3010;
+}
+
+// 每帧频带对数功率的下限：比最强的频带低 50dB，安静频带的起伏不影响倒谱
+constexpr int32_t kBandRangeQ8 = dbToQ8(20);
+
+// 首尾静音：帧能量低于整句最大值 25dB，或不比最安静的帧高 8dB
+constexpr int32_t kTrimBelowPeakQ8 = dbToQ8(25);
+constexpr int32_t kTrimAboveFloorQ8 = dbToQ8(8);
+
+// 去掉均值后的倒谱（log2 Q8）右移 kQuantShift 位量化为 int8
+constexpr int kQuantShift = 5;
+
+// 路径上局部距离的滑动平均每步跟上 1/16，约等于最近 16 步（一个音节的大半）的平均
+constexpr int kRecentShift = 4;
+
+// 少于 kMinFrames 帧（0.1s）的不是一句话
+constexpr size_t kMinFrames = 10;
+
+// Mel 频带覆盖的频率范围：低于 150Hz 多是风扇、电源的噪声
+constexpr double kMelLowHz = 150;
+constexpr double kMelHighHz = 7000;
+
+constexpr uint32_t kInfinity = UINT32_MAX;
+
+const uint32_t kDecodeUsBuckets[] = {1000, 2000, 5000, 10000, 20000, 50000, 100000};
+
+metrics::Histogram s_decode_us("chunfeng_kws_decode_us", "一句话结束到指令识别出结果的耗时（微秒）", kDecodeUsBuckets,
+                               sizeof(kDecodeUsBuckets) / sizeof(kDecodeUsBuckets[0]));
+
+/** 模板文件头，后接每个模板的指令（1 字节）、帧数（2 字节）与 帧数 x kCeps 字节特征 */
+struct FileHeader {
+    char magic[4];          ///< "CFKW"
+    uint16_t version;
+    uint16_t count;
+};
+
+constexpr uint16_t kFileVersion = 1;
+
+double hzToMel(double hz) {
+    return 2595.0 * std::log10(1.0 + hz / 700.0);
+}
+
+} // namespace
+
+CommandRecognizer::CommandRecognizer() {
+    // 窗、余弦表与频带权重只在构造时用浮点计算一次，逐帧处理全部是整数运算
+    const double pi = 3.14159265358979323846;
+    for (size_t n = 0; n < kFftSize; ++n) {
+        window_[n] = static_cast<int16_t>(std::lround(32767.0 * 0.5 * (1.0 - std::cos(2 * pi * n / kFftSize))));
+    }
+    // 正交 DCT-II 的缩放 sqrt(2 / kBands)，50dB 范围内的频带值变换后不超出 int16
+    const double scale = std::sqrt(2.0 / kBands);
+    for (size_t i = 0; i < kCeps; ++i) {
+        for (size_t b = 0; b < kBands; ++b) {
+            dct_[i][b] = static_cast<int16_t>(std::lround(16384.0 * scale * std::cos(pi * (i + 1) * (b + 0.5) / kBands)));
+        }
+    }
+    // 三角形频带：第 b 个的峰在 Mel 刻度上第 b + 1 个等分点，两个相邻峰之间的频点按距离分给这两个频带
+    const double low = hzToMel(kMelLowHz);
+    const double step = (hzToMel(kMelHighHz) - low) / (kBands + 1);
+    for (size_t k = 0; k <= kFftSize / 2; ++k) {
+        double pos = (hzToMel(static_cast<double>(k) * kSampleRate / kFftSize) - low) / step;   // 以等分点计
+        if (pos <= 0 || pos >= kBands + 1) {
+            bin_band_[k] = 0xff;
+            bin_weight_[k] = 0;
+            continue;
+        }
+        // pos 在第 j 与 j + 1 个峰之间（峰 j 属于频带 j - 1）
+        int j = static_cast<int>(pos);
+        double frac = pos - j;
+        bin_band_[k] = static_cast<uint8_t>(j == 0 ? 0xfe : j - 1);  // 0xfe：只有上面一个频带
+        bin_weight_[k] = static_cast<uint8_t>(std::lround(255.0 * (j == 0 ? frac : 1.0 - frac)));
+    }
+    clear();
+    begin();
+}
+
+CommandRecognizer::~CommandRecognizer() {
+    heap_caps_free(templates_);
+}
+
+void CommandRecognizer::begin() {
+    fill_ = 0;
+    last_ = 0;
+    frames_ = 0;
+    overflow_ = false;
+}
+
+bool CommandRecognizer::feed(const int16_t* pcm, size_t samples) {
+    for (size_t i = 0; i < samples && !overflow_; ++i) {
+        // 预加重 y = x - 0.97 x[-1]：抬高高频，擦音与共振峰的细节在倒谱中占更多分量
+        int32_t y = pcm[i] - ((31785 * static_cast<int32_t>(last_)) >> 15);
+        last_ = pcm[i];
+        in_[fill_] = static_cast<int16_t>(y > 32767 ? 32767 : y < -32768 ? -32768 : y);
+        if (++fill_ < kFftSize) continue;
+        if (frames_ == kMaxFrames) {
+            overflow_ = true;
+            break;
+        }
+        analyzeFrame();
+        memmove(in_, in_ + kHop, (kFftSize - kHop) * sizeof(in_[0]));
+        fill_ = kFftSize - kHop;
+    }
+    return !overflow_;
+}
+
+void CommandRecognizer::analyzeFrame() {
+    int32_t peak = 0;
+    for (size_t n = 0; n < kFftSize; ++n) {
+        int32_t v = (static_cast<int32_t>(in_[n]) * window_[n]) >> 15;
+        re_[n] = static_cast<int16_t>(v);
+        im_[n] = 0;
+        peak = std::max(peak, v < 0 ? -v : v);
+    }
+    int shift = 0;
+    while (shift < kMaxShift && peak && (peak << (shift + 1)) < 16384) shift++;
+    if (shift) {
+        for (size_t n = 0; n < kFftSize; ++n) re_[n] = static_cast<int16_t>(re_[n] << shift);
+    }
+    fft_.forward(re_, im_);
+
+    uint64_t bands[kBands + 1] = {};    // 多一个位置接住最高频带上面的权重
+    uint64_t total = 0;
+    for (size_t k = 0; k <= kFftSize / 2; ++k) {
+        uint32_t p = static_cast<uint32_t>(static_cast<int32_t>(re_[k]) * re_[k]) +
+                     static_cast<uint32_t>(static_cast<int32_t>(im_[k]) * im_[k]);
+        total += p;
+        const uint8_t band = bin_band_[k];
+        if (band == 0xff) continue;
+        const uint64_t weighted = static_cast<uint64_t>(p) * bin_weight_[k];
+        if (band == 0xfe) {
+            bands[0] += weighted;
+        } else {
+            bands[band] += weighted;
+            bands[band + 1] += static_cast<uint64_t>(p) * 255 - weighted;
+        }
+    }
+
+    // 频带取 log2 后减去最大值（只影响不参与匹配的 0 阶倒谱），下限为最大值以下 kBandRangeQ8
+    const int32_t scale = 2 * (kMaxShift - shift) * 256;
+    int32_t level[kBands];
+    int32_t top = 0;
+    for (size_t b = 0; b < kBands; ++b) {
+        level[b] = log2Q8(bands[b] + 1);
+        top = std::max(top, level[b]);
+    }
+    for (size_t b = 0; b < kBands; ++b) level[b] = std::max(level[b] - top, -kBandRangeQ8);
+    for (size_t i = 0; i < kCeps; ++i) {
+        int32_t sum = 0;
+        for (size_t b = 0; b < kBands; ++b) sum += dct_[i][b] * level[b];
+        ceps_[frames_][i] = static_cast<int16_t>(sum >> 14);
+    }
+    energy_[frames_] = log2Q8(total + 1) + scale;
+    frames_++;
+}
+
+size_t CommandRecognizer::normalize(int8_t (*out)[kCeps]) {
+    if (frames_ < kMinFrames) return 0;
+    int32_t high = energy_[0];
+    int32_t low = energy_[0];
+    for (size_t t = 1; t < frames_; ++t) {
+        high = std::max(high, energy_[t]);
+        low = std::min(low, energy_[t]);
+    }
+    const int32_t gate = std::max(high - kTrimBelowPeakQ8, low + kTrimAboveFloorQ8);
+    size_t first = 0;
+    size_t last = frames_ - 1;
+    while (first < last && energy_[first] < gate) first++;
+    while (last > first && energy_[last] < gate) last--;
+    const size_t count = last - first + 1;
+    if (count < kMinFrames) return 0;
+
+    for (size_t i = 0; i < kCeps; ++i) {
+        int32_t sum = 0;
+        for (size_t t = first; t <= last; ++t) sum += ceps_[t][i];
+        const int32_t mean = sum / static_cast<int32_t>(count);
+        for (size_t t = first; t <= last; ++t) {
+            int32_t q = (ceps_[t][i] - mean) >> kQuantShift;
+            out[t - first][i] = static_cast<int8_t>(q > 127 ? 127 : q < -128 ? -128 : q);
+        }
+    }
+    return count;
+}
+
+uint32_t CommandRecognizer::distance(const int8_t (*a)[kCeps], size_t n, const int8_t (*b)[kCeps], size_t m,
+                                     uint32_t limit, uint32_t* worst) {
+    if (n > 2 * m || m > 2 * n) return kInfinity;
+    const size_t band = std::max(n, m) / 4 + 1;
+    const uint64_t abandon = limit == kInfinity ? UINT64_MAX : static_cast<uint64_t>(limit) * (n + m);
+    Cell* prev = row_[0];
+    Cell* cur = row_[1];
+    const Cell empty{kInfinity, 0, 0};
+    std::fill(prev, prev + m + 1, empty);
+    prev[0].cost = 0;
+    for (size_t i = 1; i <= n; ++i) {
+        std::fill(cur, cur + m + 1, empty);
+        const size_t center = i * m / n;
+        const size_t lo = center > band ? center - band : 1;
+        const size_t hi = std::min(m, center + band);
+        uint32_t row_min = kInfinity;
+        for (size_t j = lo; j <= hi; ++j) {
+            uint32_t d = 0;
+            for (size_t c = 0; c < kCeps; ++c) {
+                int32_t diff = a[i - 1][c] - b[j - 1][c];
+                d += static_cast<uint32_t>(diff < 0 ? -diff : diff);
+            }
+            // 对角步权重 2，横竖步权重 1
+            const Cell* from = prev[j].cost <= cur[j - 1].cost ? &prev[j] : &cur[j - 1];
+            uint32_t cost = from->cost == kInfinity ? kInfinity : from->cost + d;
+            if (prev[j - 1].cost != kInfinity && prev[j - 1].cost + 2 * d <= cost) {
+                from = &prev[j - 1];
+                cost = prev[j - 1].cost + 2 * d;
+            }
+            if (cost == kInfinity) continue;
+            // 沿最优路径的局部距离滑动平均（Q4），记下最大值
+            Cell& cell = cur[j];
+            cell.cost = cost;
+            const int32_t local = static_cast<int32_t>(std::min<uint32_t>(d, 4095) << 4);
+            const int32_t recent = i == 1 && j == 1 ? local : from->recent + ((local - from->recent) >> kRecentShift);
+            cell.recent = static_cast<uint16_t>(recent);
+            cell.worst = std::max(from->worst, cell.recent);
+            row_min = std::min(row_min, cost);
+        }
+        if (row_min == kInfinity || row_min > abandon) return kInfinity;
+        std::swap(prev, cur);
+    }
+    if (prev[m].cost == kInfinity) return kInfinity;
+    if (worst) *worst = prev[m].worst >> 4;
+    return static_cast<uint32_t>(prev[m].cost / (n + m));
+}
+
+CommandMatch CommandRecognizer::finish() {
+    const int64_t t0 = esp_timer_get_time();
+    CommandMatch match;
+    match.distance = kInfinity;
+    match.runner_up = kInfinity;
+    const size_t n = overflow_ ? 0 : normalize(query_);
+    match.frames = static_cast<uint16_t>(n);
+    if (n > 0 && count_ > 0) {
+        uint32_t best[kMaxCommands];
+        std::fill(best, best + kMaxCommands, kInfinity);
+        uint32_t worst[kMaxCommands] = {};
+        int first = -1;
+        for (size_t t = 0; t < count_; ++t) {
+            const Template& tpl = templates_[t];
+            // 只有可能成为最优或次优的结果才需要算完：同一条指令以当前最优为限，其他指令以次优为限
+            uint32_t second = kInfinity;
+            for (size_t c = 0; c < kMaxCommands; ++c) {
+                if (static_cast<int>(c) != first) second = std::min(second, best[c]);
+            }
+            const uint32_t limit = tpl.command == first ? best[first] : second;
+            uint32_t stretch = 0;
+            const uint32_t d = distance(query_, n, tpl.features, tpl.frames, limit, &stretch);
+            if (d >= best[tpl.command]) continue;
+            best[tpl.command] = d;
+            worst[tpl.command] = stretch;
+            if (first < 0 || d < best[first]) first = tpl.command;
+        }
+        if (first >= 0) {
+            match.distance = best[first];
+            match.worst = worst[first];
+            for (size_t c = 0; c < kMaxCommands; ++c) {
+                if (static_cast<int>(c) != first) match.runner_up = std::min(match.runner_up, best[c]);
+            }
+            const bool close = match.distance <= limits_[first].distance && match.worst <= limits_[first].stretch;
+            const bool distinct = match.runner_up == kInfinity ||
+                                  static_cast<uint64_t>(match.distance) * 100 <=
+                                      static_cast<uint64_t>(match.runner_up) * kMarginPct;
+            if (close && distinct) match.command = first;
+        }
+    }
+    match.decode_us = static_cast<uint32_t>(esp_timer_get_time() - t0);
+    s_decode_us.observe(match.decode_us);
+    return match;
+}
+
+bool CommandRecognizer::reserve() {
+    if (templates_) return true;
+    templates_ = static_cast<Template*>(heap_caps_malloc(sizeof(Template) * kMaxTemplates, MALLOC_CAP_SPIRAM));
+    if (!templates_) {
+        templates_ = static_cast<Template*>(heap_caps_malloc(sizeof(Template) * kMaxTemplates, MALLOC_CAP_DEFAULT));
+    }
+    return templates_ != nullptr;
+}
+
+esp_err_t CommandRecognizer::enroll(int command, const int16_t* pcm, size_t samples) {
+    if (command < 0 || static_cast<size_t>(command) >= kMaxCommands) return ESP_ERR_INVALID_ARG;
+    if (count_ == kMaxTemplates) return ESP_ERR_NO_MEM;
+    if (!reserve()) return ESP_ERR_NO_MEM;
+    begin();
+    feed(pcm, samples);
+    Template& tpl = templates_[count_];
+    const size_t frames = overflow_ ? 0 : normalize(tpl.features);
+    begin();
+    if (frames == 0) return ESP_ERR_INVALID_ARG;
+    tpl.command = static_cast<uint8_t>(command);
+    tpl.frames = static_cast<uint16_t>(frames);
+    count_++;
+    updateThreshold(command);
+    return ESP_OK;
+}
+
+void CommandRecognizer::updateThreshold(int command) {
+    uint64_t distance_sum = 0;
+    uint64_t stretch_sum = 0;
+    uint32_t pairs = 0;
+    for (size_t i = 0; i < count_; ++i) {
+        if (templates_[i].command != command) continue;
+        for (size_t j = i + 1; j < count_; ++j) {
+            if (templates_[j].command != command) continue;
+            uint32_t stretch = 0;
+            uint32_t d = distance(templates_[i].features, templates_[i].frames, templates_[j].features,
+                                  templates_[j].frames, kInfinity, &stretch);
+            if (d == kInfinity) continue;
+            distance_sum += d;
+            stretch_sum += stretch;
+            pairs++;
+        }
+    }
+    if (!pairs) {
+        limits_[command] = {kDefaultDistance, kDefaultStretch};
+        return;
+    }
+    limits_[command].distance = static_cast<uint32_t>(distance_sum * kAcceptPct / (100 * pairs));
+    limits_[command].stretch = static_cast<uint32_t>(stretch_sum * kStretchPct / (100 * pairs));
+}
+
+void CommandRecognizer::clear() {
+    count_ = 0;
+    for (Limits& limits : limits_) limits = {kDefaultDistance, kDefaultStretch};
+}
+
+esp_err_t CommandRecognizer::save(const char* path) const {
+    FILE* f = fopen(path, "wb");
+    if (!f) return ESP_FAIL;
+    FileHeader header{{'C', 'F', 'K', 'W'}, kFileVersion, static_cast<uint16_t>(count_)};
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for (size_t t = 0; t < count_ && ok; ++t) {
+        const Template& tpl = templates_[t];
+        ok = fwrite(&tpl.command, sizeof(tpl.command), 1, f) == 1 && fwrite(&tpl.frames, sizeof(tpl.frames), 1, f) == 1 &&
+             fwrite(tpl.features, kCeps, tpl.frames, f) == tpl.frames;
+    }
+    ok = fclose(f) == 0 && ok;
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t CommandRecognizer::load(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return ESP_FAIL;
+    FileHeader header{};
+    esp_err_t err = ESP_OK;
+    if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, "CFKW", 4) != 0 ||
+        header.version != kFileVersion || header.count > kMaxTemplates) {
+        err = ESP_ERR_INVALID_STATE;
+    }
+    if (err == ESP_OK && !reserve()) err = ESP_ERR_NO_MEM;
+    clear();
+    for (size_t t = 0; t < header.count && err == ESP_OK; ++t) {
+        Template& tpl = templates_[t];
+        if (fread(&tpl.command, sizeof(tpl.command), 1, f) != 1 || fread(&tpl.frames, sizeof(tpl.frames), 1, f) != 1 ||
+            tpl.command >= kMaxCommands || tpl.frames < kMinFrames || tpl.frames > kMaxFrames ||
+            fread(tpl.features, kCeps, tpl.frames, f) != tpl.frames) {
+            err = ESP_ERR_INVALID_STATE;
+        }
+    }
+    fclose(f);
+    if (err != ESP_OK) return err;
+    count_ = header.count;
+    for (size_t c = 0; c < kMaxCommands; ++c) updateThreshold(static_cast<int>(c));
+    return ESP_OK;
+}
+
+} // namespace chunfeng
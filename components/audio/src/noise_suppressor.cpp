@@ -0,0 +1,194 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-26 09:20:41
+ * @LastEditTime: 2025-06-27 16:48:03
+ * @LastEditors: 星年
+ * @Description: 采集降噪：块归一化 FFT、对数域功率平滑与最小值跟踪、查表增益、重叠相加
+ * @FilePath: \ESP32-ChunFeng\components\audio\src\noise_suppressor.cpp
+ * @遇事不决，可问春风
+ */
+#include "noise_suppressor.hpp"
+#include "fixed_log.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace chunfeng {
+
+namespace {
+
+// 归一化左移的上限：功率换算到绝对刻度时乘 2^(2 x (kMaxShift - shift))
+constexpr int kMaxShift = 15;
+
+// 功率以 log2 的 Q8 定点表示，比较、平滑与求比值都是整数加减
+constexpr int kLogOne = 256;
+
+// 最小值跟踪：每 kSubBlocks 块记一个局部最小值，取最近 kSubWindows 个中的最小值（16kHz 时约 1.5s）
+constexpr uint32_t kSubBlocks = 24;
+
+// 平滑后功率的最小值低于平均噪声功率，按白噪声标定的补偿（约 6.5dB）
+constexpr int kMinBias = 550;
+
+// 增益表：按后验信噪比（log2 Q8）每 1/16 倍频程一项，覆盖 0~10 倍频程（约 30dB）
+constexpr int kGainStep = kLogOne / 16;
+constexpr size_t kGainTable = 160;
+
+// 过减系数 2（3dB）：噪声功率的起伏不会漏成一闪一闪的“音乐噪声”
+constexpr double kOverSubtraction = 2.0;
+
+struct GainTable {
+    uint16_t q15[kGainTable];
+    GainTable() {
+        for (size_t i = 0; i < kGainTable; ++i) {
+            double ratio = std::exp2(static_cast<double>(i * kGainStep) / kLogOne);
+            double g = 1.0 - kOverSubtraction / ratio;
+            q15[i] = static_cast<uint16_t>(g > 0 ? std::lround(32767.0 * std::sqrt(g)) : 0);
+        }
+    }
+};
+
+const GainTable s_gain;
+
+} // namespace
+
+NoiseSuppressor::NoiseSuppressor(uint8_t max_attenuation_db) {
+    const double pi = 3.14159265358979323846;
+    for (size_t n = 0; n < kFftSize; ++n) {
+        // 周期 sqrt-Hann：分析、合成各乘一次，50% 重叠相加后增益为 1
+        window_[n] = static_cast<int16_t>(std::lround(32767.0 * std::sin(pi * n / kFftSize)));
+    }
+    setMaxAttenuation(max_attenuation_db);
+    reset();
+}
+
+void NoiseSuppressor::setMaxAttenuation(uint8_t db) {
+    gain_floor_ = static_cast<uint16_t>(std::lround(32767.0 * std::pow(10.0, -db / 20.0)));
+}
+
+void NoiseSuppressor::reset() {
+    memset(in_, 0, sizeof(in_));
+    memset(overlap_, 0, sizeof(overlap_));
+    memset(out_, 0, sizeof(out_));
+    memset(power_, 0, sizeof(power_));
+    memset(smooth_, 0, sizeof(smooth_));
+    memset(local_min_, 0, sizeof(local_min_));
+    memset(window_min_, 0, sizeof(window_min_));
+    memset(noise_, 0, sizeof(noise_));
+    for (size_t k = 0; k < kBins; ++k) gain_[k] = 32767;
+    fill_ = 0;
+    blocks_ = 0;
+    mean_gain_ = 32767;
+}
+
+void NoiseSuppressor::process(const int16_t* in, int16_t* out, size_t samples) {
+    for (size_t i = 0; i < samples; ++i) {
+        int16_t x = in[i];
+        out[i] = out_[fill_];
+        in_[kHop + fill_] = x;
+        if (++fill_ == kHop) {
+            processBlock();
+            fill_ = 0;
+        }
+    }
+}
+
+void NoiseSuppressor::processBlock() {
+    // 加窗并按峰值归一化：安静的输入左移后再做 FFT，频点功率保留足够的有效位
+    int32_t peak = 0;
+    for (size_t n = 0; n < kFftSize; ++n) {
+        int32_t v = (static_cast<int32_t>(in_[n]) * window_[n]) >> 15;
+        re_[n] = static_cast<int16_t>(v);
+        im_[n] = 0;
+        peak = std::max(peak, v < 0 ? -v : v);
+    }
+    int shift = 0;
+    while (shift < kMaxShift && peak && (peak << (shift + 1)) < 16384) shift++;
+    if (shift) {
+        for (size_t n = 0; n < kFftSize; ++n) re_[n] = static_cast<int16_t>(re_[n] << shift);
+    }
+    fft_.forward(re_, im_);
+
+    // 对数域绝对刻度：log2(功率) + 2 x (kMaxShift - shift)
+    const int32_t scale = 2 * (kMaxShift - shift) * kLogOne;
+    const bool warmup = blocks_ < kWarmupBlocks;
+    const uint32_t sub = blocks_ % kSubBlocks;
+    const size_t slot = (blocks_ / kSubBlocks) % kSubWindows;
+    uint32_t gain_sum = 0;
+    for (size_t k = 0; k < kBins; ++k) {
+        uint32_t p = static_cast<uint32_t>(static_cast<int32_t>(re_[k]) * re_[k]) +
+                     static_cast<uint32_t>(static_cast<int32_t>(im_[k]) * im_[k]);
+        int32_t level = p ? log2Q8(p) + scale : 0;
+
+        // 快平滑用于增益，慢平滑后取最近约 1.5s 的最小值作为噪声底
+        int32_t fast = blocks_ ? (static_cast<int32_t>(power_[k]) + level) / 2 : level;
+        int32_t slow = blocks_ ? smooth_[k] + (level - smooth_[k]) / 8 : level;
+        power_[k] = static_cast<uint16_t>(fast);
+        smooth_[k] = static_cast<uint16_t>(slow);
+        if (sub == 0) {
+            local_min_[k] = static_cast<uint16_t>(slow);
+        } else {
+            local_min_[k] = std::min<uint16_t>(local_min_[k], static_cast<uint16_t>(slow));
+        }
+        uint16_t floor = local_min_[k];
+        size_t filled = std::min<size_t>(blocks_ / kSubBlocks, kSubWindows);
+        for (size_t w = 0; w < filled; ++w) floor = std::min(floor, window_min_[w][k]);
+        if (sub == kSubBlocks - 1) window_min_[slot][k] = local_min_[k];
+        if (warmup) {
+            // 开头没有足够的历史，按平均功率估计
+            noise_[k] = static_cast<uint16_t>(blocks_ ? (noise_[k] * blocks_ + level) / (blocks_ + 1) : level);
+        } else {
+            noise_[k] = static_cast<uint16_t>(floor + kMinBias);
+        }
+
+        // 增益：后验信噪比查表，不低于下限；下降时每块最多降 1/4，避免频点忽开忽关
+        int32_t snr = fast - static_cast<int32_t>(noise_[k]);
+        uint16_t g = 32767;
+        if (snr <= 0) {
+            g = 0;
+        } else if (static_cast<size_t>(snr / kGainStep) < kGainTable) {
+            g = s_gain.q15[snr / kGainStep];
+        }
+        g = std::max(g, gain_floor_);
+        uint16_t release = static_cast<uint16_t>(gain_[k] - (gain_[k] >> 2));
+        if (g < release) g = release;
+        gain_[k] = g;
+        gain_sum += g;
+    }
+    mean_gain_ = static_cast<uint16_t>(gain_sum / kBins);
+    blocks_++;
+
+    // 共轭对称的两半乘同一个增益，逆变换后仍是实信号
+    for (size_t k = 0; k < kBins; ++k) {
+        re_[k] = static_cast<int16_t>((static_cast<int32_t>(re_[k]) * gain_[k]) >> 15);
+        im_[k] = static_cast<int16_t>((static_cast<int32_t>(im_[k]) * gain_[k]) >> 15);
+        if (k > 0 && k < kFftSize / 2) {
+            size_t m = kFftSize - k;
+            re_[m] = static_cast<int16_t>((static_cast<int32_t>(re_[m]) * gain_[k]) >> 15);
+            im_[m] = static_cast<int16_t>((static_cast<int32_t>(im_[m]) * gain_[k]) >> 15);
+        }
+    }
+    fft_.inverse(re_, im_);
+
+    // 合成窗、撤销归一化、与上一块的后半重叠相加
+    const int round_shift = 15 + shift;
+    const int32_t round = 1 << (round_shift - 1);
+    for (size_t n = 0; n < kHop; ++n) {
+        int32_t head = (static_cast<int32_t>(re_[n]) * window_[n] + round) >> round_shift;
+        int32_t tail = (static_cast<int32_t>(re_[n + kHop]) * window_[n + kHop] + round) >> round_shift;
+        int32_t v = overlap_[n] + head;
+        out_[n] = static_cast<int16_t>(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+        overlap_[n] = tail;
+    }
+    memmove(in_, in_ + kHop, kHop * sizeof(in_[0]));
+}
+
+int NoiseSuppressor::noiseFloorDb() const {
+    if (blocks_ == 0) return -96;
+    // 满量程正弦经 sqrt-Hann 窗后单边频点功率之和约为 32767^2 / 8
+    const double ref_log2 = std::log2(32767.0 * 32767.0 / 8) + 2 * kMaxShift;
+    double total = 0;
+    for (size_t k = 0; k < kBins; ++k) total += std::exp2(static_cast<double>(noise_[k]) / kLogOne);
+    return static_cast<int>(std::lround(10 * std::log10(2.0) * (std::log2(total) - ref_log2)));
+}
+
+} // namespace chunfeng
@@ -0,0 +1,428 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-22 09:12:40
+ * @LastEditTime: 2025-06-22 15:36:02
+ * @LastEditors: 星年
+ * @Description: 合成语音缓存：内存索引、两段 LRU 淘汰、临时文件改名提交与流式读取
+ * @FilePath: \ESP32-ChunFeng\components\audio\src\response_cache.cpp
+ * @遇事不决，可问春风
+ */
+#include "response_cache.hpp"
+#include "audio_playback.hpp"
+#include "cf_log.hpp"
+#include "metrics.hpp"
+#include "esp_timer.h"
+#include "mbedtls/sha256.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+
+namespace chunfeng {
+
+namespace {
+
+const char* TAG = "ResponseCache";
+const char kIndexMagic[4] = {'C', 'F', 'R', 'I'};
+const char kFileMagic[4] = {'C', 'F', 'R', 'C'};
+
+// 首个音频耗时分桶（毫秒）
+const uint32_t kFirstAudioBucketsMs[] = {5, 10, 20, 50, 100, 200, 300, 500, 750, 1000, 2000};
+
+metrics::Counter s_hits("chunfeng_response_cache_lookups_total", "合成语音缓存查找次数", "result=\"hit\"");
+metrics::Counter s_misses("chunfeng_response_cache_lookups_total", "合成语音缓存查找次数", "result=\"miss\"");
+metrics::Counter s_evictions("chunfeng_response_cache_evictions_total", "超出预算淘汰的缓存条目");
+metrics::Gauge s_hit_pct("chunfeng_response_cache_hit_pct", "开机以来的缓存命中率（百分比）");
+metrics::Gauge s_bytes("chunfeng_response_cache_bytes", "缓存文件总大小");
+metrics::Histogram s_first_audio_cache("chunfeng_response_first_audio_ms", "从查找缓存到第一块音频的耗时（毫秒）",
+                                       kFirstAudioBucketsMs,
+                                       sizeof(kFirstAudioBucketsMs) / sizeof(kFirstAudioBucketsMs[0]),
+                                       "source=\"cache\"");
+metrics::Histogram s_first_audio_synth("chunfeng_response_first_audio_ms", "从查找缓存到第一块音频的耗时（毫秒）",
+                                       kFirstAudioBucketsMs,
+                                       sizeof(kFirstAudioBucketsMs) / sizeof(kFirstAudioBucketsMs[0]),
+                                       "source=\"synth\"");
+
+/** rc.idx 文件头，后接 count 个 IndexRecord */
+struct IndexFileHeader {
+    char magic[4];
+    uint32_t count;
+};
+
+} // namespace
+
+CacheKey makeCacheKey(const char* text, const char* voice, uint32_t sample_rate, uint32_t speed_pct) {
+    CacheKey key;
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    // 字符串连同结尾的 0 一起计算，避免 ("ab", "c") 与 ("a", "bc") 相同
+    mbedtls_sha256_update(&sha, reinterpret_cast<const unsigned char*>(text), strlen(text) + 1);
+    mbedtls_sha256_update(&sha, reinterpret_cast<const unsigned char*>(voice), strlen(voice) + 1);
+    const uint32_t params[2] = {sample_rate, speed_pct};
+    mbedtls_sha256_update(&sha, reinterpret_cast<const unsigned char*>(params), sizeof(params));
+    mbedtls_sha256_finish(&sha, key.digest);
+    mbedtls_sha256_free(&sha);
+    return key;
+}
+
+/* ---------- Reader ---------- */
+
+size_t ResponseCache::Reader::read(int16_t* pcm, size_t samples) {
+    if (!file_) return 0;
+    size_t n = std::min(samples, remaining());
+    n = n ? fread(pcm, sizeof(int16_t), n, file_) : 0;
+    remaining_ -= n * sizeof(int16_t);
+    if (n && lookup_us_) {
+        cache_->noteFirstAudio(lookup_us_, true);
+        lookup_us_ = 0;
+    }
+    return n;
+}
+
+void ResponseCache::Reader::close() {
+    if (!file_) return;
+    fclose(file_);
+    file_ = nullptr;
+    cache_->release(tag_);
+}
+
+/* ---------- ResponseCache ---------- */
+
+ResponseCache& ResponseCache::getInstance() {
+    static ResponseCache instance;
+    return instance;
+}
+
+esp_err_t ResponseCache::open(const char* dir, size_t budget_bytes) {
+    if (!dir || strlen(dir) >= sizeof(dir_)) return ESP_ERR_INVALID_ARG;
+    close();
+    std::lock_guard<std::mutex> lock(mutex_);
+    strcpy(dir_, dir);
+    budget_ = budget_bytes;
+    memset(entries_, 0, sizeof(entries_));
+    used_bytes_ = 0;
+    clock_ = 0;
+    stats_ = CacheStats();
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s/rc_tmp.pcm", dir_);
+    unlink(path);
+    loadIndexLocked();
+    makeRoomLocked(0);
+    saveIndexLocked();
+    size_t count = std::count_if(std::begin(entries_), std::end(entries_),
+                                 [](const IndexEntry& e) { return e.last_use != 0; });
+    CF_LOGI(TAG, "缓存 %u 条，%u/%u 字节", static_cast<unsigned>(count), static_cast<unsigned>(used_bytes_),
+            static_cast<unsigned>(budget_));
+    return ESP_OK;
+}
+
+void ResponseCache::close() {
+    abort();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!isOpen()) return;
+    if (hits_since_save_) saveIndexLocked();
+    dir_[0] = '\0';
+}
+
+uint64_t ResponseCache::tagOf(const CacheKey& key) {
+    uint64_t tag;
+    memcpy(&tag, key.digest, sizeof(tag));
+    return tag;
+}
+
+void ResponseCache::pathOf(uint64_t tag, char* out, size_t size) const {
+    snprintf(out, size, "%s/rc_%016" PRIx64 ".pcm", dir_, tag);
+}
+
+ResponseCache::IndexEntry* ResponseCache::findLocked(uint64_t tag) {
+    for (IndexEntry& e : entries_) {
+        if (e.last_use && e.tag == tag) return &e;
+    }
+    return nullptr;
+}
+
+ResponseCache::IndexEntry* ResponseCache::addLocked(uint64_t tag, uint32_t bytes, uint32_t last_use,
+                                                    uint32_t hits) {
+    for (IndexEntry& e : entries_) {
+        if (e.last_use) continue;
+        e = IndexEntry{tag, bytes, last_use, static_cast<uint16_t>(std::min<uint32_t>(hits, UINT16_MAX)), 0};
+        used_bytes_ += bytes;
+        s_bytes.set(static_cast<int32_t>(used_bytes_));
+        return &e;
+    }
+    return nullptr;
+}
+
+void ResponseCache::removeLocked(IndexEntry& entry) {
+    char path[64];
+    pathOf(entry.tag, path, sizeof(path));
+    unlink(path);
+    used_bytes_ -= entry.bytes;
+    s_bytes.set(static_cast<int32_t>(used_bytes_));
+    entry = IndexEntry();
+}
+
+bool ResponseCache::makeRoomLocked(size_t extra) {
+    if (extra > budget_) return false;
+    while (true) {
+        size_t count = 0;
+        IndexEntry* oldest = nullptr;
+        for (IndexEntry& e : entries_) {
+            if (!e.last_use) continue;
+            count++;
+            if (e.readers) continue;
+            // 没有命中过的排在前面，同一段内按最近使用时间
+            if (!oldest || (e.hits == 0) > (oldest->hits == 0) ||
+                ((e.hits == 0) == (oldest->hits == 0) && e.last_use < oldest->last_use)) {
+                oldest = &e;
+            }
+        }
+        bool fits = used_bytes_ + extra <= budget_ && (extra == 0 || count < kMaxEntries);
+        if (fits) return true;
+        if (!oldest) return false;
+        removeLocked(*oldest);
+        stats_.evictions++;
+        s_evictions.inc();
+    }
+}
+
+void ResponseCache::loadIndexLocked() {
+    char path[64];
+    struct stat st;
+    // rc.idx 中的条目按保存时的使用顺序恢复，其中文件已不存在或大小不对的丢弃
+    snprintf(path, sizeof(path), "%s/rc.idx", dir_);
+    clock_ = 1;
+    FILE* fp = fopen(path, "rb");
+    IndexFileHeader header;
+    if (fp && fread(&header, sizeof(header), 1, fp) == 1 && memcmp(header.magic, kIndexMagic, 4) == 0) {
+        IndexRecord record;
+        for (uint32_t i = 0; i < header.count && fread(&record, sizeof(record), 1, fp) == 1; ++i) {
+            char file[64];
+            pathOf(record.tag, file, sizeof(file));
+            if (findLocked(record.tag) || stat(file, &st) != 0 || static_cast<uint32_t>(st.st_size) != record.bytes) {
+                continue;
+            }
+            addLocked(record.tag, record.bytes, ++clock_, record.hits);
+        }
+    }
+    if (fp) fclose(fp);
+
+    // 提交后、保存索引前掉电留下的文件：当作最久未用
+    DIR* d = opendir(dir_);
+    if (!d) return;
+    while (struct dirent* ent = readdir(d)) {
+        uint64_t tag;
+        char tail[8];
+        if (sscanf(ent->d_name, "rc_%16" SCNx64 "%7s", &tag, tail) != 2 || strcmp(tail, ".pcm") != 0) continue;
+        if (findLocked(tag)) continue;
+        char file[64];
+        pathOf(tag, file, sizeof(file));
+        if (stat(file, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(CachedAudioHeader)) ||
+            !addLocked(tag, static_cast<uint32_t>(st.st_size), 1, 0)) {
+            unlink(file);
+        }
+    }
+    closedir(d);
+}
+
+void ResponseCache::saveIndexLocked() {
+    // 按最近使用从旧到新写入临时文件后改名，掉电时保留旧索引
+    IndexRecord records[kMaxEntries];
+    const IndexEntry* sorted[kMaxEntries];
+    uint32_t count = 0;
+    for (const IndexEntry& e : entries_) {
+        if (e.last_use) sorted[count++] = &e;
+    }
+    std::sort(sorted, sorted + count, [](const IndexEntry* a, const IndexEntry* b) { return a->last_use < b->last_use; });
+    for (uint32_t i = 0; i < count; ++i) records[i] = IndexRecord{sorted[i]->tag, sorted[i]->bytes, sorted[i]->hits};
+
+    char path[64];
+    char tmp[64];
+    snprintf(path, sizeof(path), "%s/rc.idx", dir_);
+    snprintf(tmp, sizeof(tmp), "%s/rc_idx.tmp", dir_);
+    FILE* fp = fopen(tmp, "wb");
+    if (!fp) return;
+    IndexFileHeader header;
+    memcpy(header.magic, kIndexMagic, 4);
+    header.count = count;
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              (count == 0 || fwrite(records, sizeof(IndexRecord), count, fp) == count);
+    ok = fclose(fp) == 0 && ok;
+    unlink(ok ? path : tmp);
+    if (ok && rename(tmp, path) != 0) ok = false;
+    if (!ok) CF_LOGW(TAG, "保存索引失败");
+    hits_since_save_ = 0;
+}
+
+bool ResponseCache::lookup(const CacheKey& key, Reader& reader) {
+    reader.close();
+    int64_t now = esp_timer_get_time();
+    uint64_t tag = tagOf(key);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!isOpen()) return false;
+    IndexEntry* e = findLocked(tag);
+    FILE* fp = nullptr;
+    CachedAudioHeader header;
+    if (e) {
+        char path[64];
+        pathOf(tag, path, sizeof(path));
+        fp = fopen(path, "rb");
+        bool valid = fp && fread(&header, sizeof(header), 1, fp) == 1 && memcmp(header.magic, kFileMagic, 4) == 0 &&
+                     memcmp(header.digest, key.digest, sizeof(key.digest)) == 0 &&
+                     header.bytes + sizeof(header) == e->bytes;
+        if (!valid) {
+            // 前 8 字节相同的另一个键，或文件损坏
+            if (fp) fclose(fp);
+            fp = nullptr;
+            if (!e->readers) removeLocked(*e);
+            saveIndexLocked();
+        }
+    }
+    if (!fp) {
+        stats_.misses++;
+        s_misses.inc();
+        miss_us_ = now;
+        miss_tag_ = tag;
+    } else {
+        e->last_use = ++clock_;
+        if (e->hits < UINT16_MAX) e->hits++;
+        e->readers++;
+        stats_.hits++;
+        s_hits.inc();
+        if (++hits_since_save_ >= kIndexSaveHits) saveIndexLocked();
+        reader.cache_ = this;
+        reader.file_ = fp;
+        reader.tag_ = tag;
+        reader.sample_rate_ = header.sample_rate;
+        reader.remaining_ = header.bytes;
+        reader.lookup_us_ = now;
+    }
+    s_hit_pct.set(static_cast<int32_t>(100ull * stats_.hits / (stats_.hits + stats_.misses)));
+    return fp != nullptr;
+}
+
+esp_err_t ResponseCache::play(const CacheKey& key, AudioPlayback& playback) {
+    Reader reader;
+    if (!lookup(key, reader)) return ESP_ERR_NOT_FOUND;
+    if (reader.sampleRate() != playback.sampleRate()) {
+        esp_err_t err = playback.setSampleRate(reader.sampleRate());
+        if (err != ESP_OK) return err;
+    }
+    int16_t pcm[AudioPlayback::kMaxFrameSamples];
+    while (size_t n = reader.read(pcm, playback.frameSamples())) {
+        playback.write(pcm, n);
+    }
+    playback.flush();
+    return reader.remaining() ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+esp_err_t ResponseCache::beginInsert(const CacheKey& key, uint32_t sample_rate, size_t expected_bytes) {
+    abort();
+    uint64_t tag = tagOf(key);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!isOpen()) return ESP_ERR_INVALID_STATE;
+        if (findLocked(tag)) return ESP_ERR_INVALID_STATE;
+        if (!makeRoomLocked(expected_bytes + sizeof(CachedAudioHeader))) return ESP_ERR_NO_MEM;
+        insert_since_us_ = miss_tag_ == tag ? miss_us_ : 0;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "%s/rc_tmp.pcm", dir_);
+    insert_file_ = fopen(path, "wb");
+    if (!insert_file_) return ESP_FAIL;
+    memset(&insert_header_, 0, sizeof(insert_header_));
+    memcpy(insert_header_.magic, kFileMagic, 4);
+    insert_header_.sample_rate = sample_rate;
+    memcpy(insert_header_.digest, key.digest, sizeof(key.digest));
+    if (fwrite(&insert_header_, sizeof(insert_header_), 1, insert_file_) != 1) {
+        abort();
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ResponseCache::write(const int16_t* pcm, size_t samples) {
+    if (!insert_file_) return ESP_ERR_INVALID_STATE;
+    size_t bytes = samples * sizeof(int16_t);
+    if (insert_header_.bytes + bytes + sizeof(insert_header_) > budget_) {
+        abort();
+        return ESP_ERR_NO_MEM;
+    }
+    if (bytes && fwrite(pcm, 1, bytes, insert_file_) != bytes) {
+        abort();
+        return ESP_FAIL;
+    }
+    insert_header_.bytes += static_cast<uint32_t>(bytes);
+    if (bytes && insert_since_us_) {
+        noteFirstAudio(insert_since_us_, false);
+        insert_since_us_ = 0;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ResponseCache::commit() {
+    if (!insert_file_) return ESP_ERR_INVALID_STATE;
+    bool ok = fseek(insert_file_, 0, SEEK_SET) == 0 &&
+              fwrite(&insert_header_, sizeof(insert_header_), 1, insert_file_) == 1;
+    ok = fclose(insert_file_) == 0 && ok;
+    insert_file_ = nullptr;
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "%s/rc_tmp.pcm", dir_);
+    uint32_t bytes = insert_header_.bytes + sizeof(insert_header_);
+    uint64_t tag;
+    memcpy(&tag, insert_header_.digest, sizeof(tag));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!ok || findLocked(tag) || !makeRoomLocked(bytes)) {
+        unlink(tmp);
+        return ok ? ESP_ERR_NO_MEM : ESP_FAIL;
+    }
+    char path[64];
+    pathOf(tag, path, sizeof(path));
+    unlink(path);
+    if (rename(tmp, path) != 0) {
+        unlink(tmp);
+        return ESP_FAIL;
+    }
+    addLocked(tag, bytes, ++clock_, 0);
+    stats_.inserts++;
+    saveIndexLocked();
+    return ESP_OK;
+}
+
+void ResponseCache::abort() {
+    if (!insert_file_) return;
+    fclose(insert_file_);
+    insert_file_ = nullptr;
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "%s/rc_tmp.pcm", dir_);
+    unlink(tmp);
+}
+
+void ResponseCache::release(uint64_t tag) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    IndexEntry* e = findLocked(tag);
+    if (e && e->readers) e->readers--;
+}
+
+void ResponseCache::noteFirstAudio(int64_t since_us, bool hit) {
+    uint32_t ms = static_cast<uint32_t>((esp_timer_get_time() - since_us) / 1000);
+    (hit ? s_first_audio_cache : s_first_audio_synth).observe(ms);
+}
+
+CacheStats ResponseCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CacheStats out = stats_;
+    out.entries = 0;
+    for (const IndexEntry& e : entries_) {
+        if (e.last_use) out.entries++;
+    }
+    out.bytes = static_cast<uint32_t>(used_bytes_);
+    return out;
+}
+
+} // namespace chunfeng
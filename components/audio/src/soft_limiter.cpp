@@ -0,0 +1,146 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-27 09:12:26
+ * @LastEditTime: 2025-06-27 16:48:03
+ * @LastEditors: 星年
+ * @Description: 播放响度与限幅：响度估计与增益调整、分段软拐点压缩、饱和兜底
+ * @FilePath: \ESP32-ChunFeng\components\audio\src\soft_limiter.cpp
+ * @遇事不决，可问春风
+ */
+#include "soft_limiter.hpp"
+#include "fixed_log.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace chunfeng {
+
+namespace {
+
+constexpr int32_t kFullScale = 29 * 256;            // 满量程正弦的功率 32767^2 / 2，log2 Q8
+constexpr double kPowerPerDb = 256 / 3.0103;
+
+int32_t powerDb(double db) { return static_cast<int32_t>(std::lround(db * kPowerPerDb)); }
+
+const int32_t kGate = kFullScale + powerDb(-50);    // 低于 -50dBFS 的帧不计入响度
+const int32_t kMaxGain = powerDb(12) / 2;           // 响度增益 ±12dB
+// 帧功率取对数后平均低于功率平均（语音帧间起伏大），按合成语音标定的补偿
+const int32_t kLogMeanBias = powerDb(4);
+const int32_t kGainStep = powerDb(0.5) / 2;         // 之后每帧最多调整 0.5dB
+const int32_t kWarmupStep = powerDb(2) / 2;
+constexpr uint32_t kRestartFrames = 75;             // 静音 1.5s 后算新的一段回复（句间停顿不算）
+constexpr uint32_t kWarmupFrames = 8;               // 新回复的前 8 帧响度取平均，增益每帧最多调 2dB
+
+constexpr int32_t kKnee = 256;                      // 软拐点宽 6dB（幅度 log2 Q8）
+constexpr uint32_t kReleaseShift = 2;               // 每小段释放剩余差距的 1/4，约 60ms
+
+/** 峰值 peak 对应的限幅增益（Q15） */
+uint32_t reduction(int32_t peak, int32_t ceiling_log) {
+    if (peak <= 0) return 32768;
+    // 幅度 log2 = 功率 log2 的一半
+    int32_t over = log2Q8(static_cast<uint64_t>(peak) * static_cast<uint64_t>(peak)) / 2 - ceiling_log;
+    if (over <= -kKnee / 2) return 32768;
+    int32_t cut = over >= kKnee / 2 ? over : (over + kKnee / 2) * (over + kKnee / 2) / (2 * kKnee);
+    return exp2Q8(-cut, 15);
+}
+
+} // namespace
+
+SoftLimiter::SoftLimiter() {
+    configure(true, -20, -3);
+}
+
+esp_err_t SoftLimiter::configure(bool normalize, int8_t loudness_dbfs, int8_t ceiling_dbfs) {
+    if (loudness_dbfs < -40 || loudness_dbfs > -6 || ceiling_dbfs < -20 || ceiling_dbfs > 0 ||
+        loudness_dbfs >= ceiling_dbfs) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    normalize_ = normalize;
+    target_ = kFullScale + powerDb(loudness_dbfs);
+    ceiling_ = static_cast<int32_t>(std::lround(32767.0 * std::pow(10.0, ceiling_dbfs / 20.0)));
+    ceiling_log_ = log2Q8(static_cast<uint64_t>(ceiling_) * static_cast<uint64_t>(ceiling_)) / 2;
+    reset();
+    return ESP_OK;
+}
+
+void SoftLimiter::reset() {
+    loudness_ = 0;
+    gain_ = 0;
+    envelope_ = 32768;
+    min_envelope_ = 32768;
+    applied_ = 8192;
+    frames_ = 0;
+    idle_frames_ = kRestartFrames;
+}
+
+void SoftLimiter::idle() {
+    if (idle_frames_ < kRestartFrames) idle_frames_++;
+}
+
+void SoftLimiter::process(int16_t* pcm, size_t samples, int32_t volume_q15) {
+    if (samples == 0) return;
+    // 响度：帧功率（log2 Q8）
+    uint64_t energy = 0;
+    for (size_t i = 0; i < samples; ++i) energy += static_cast<uint64_t>(pcm[i] * pcm[i]);
+    int32_t level = log2Q8(energy / samples);
+    if (normalize_ && level > kGate) {
+        if (idle_frames_ >= kRestartFrames || loudness_ == 0) {
+            // 新的一段回复：前面是静音，第一帧的增益直接到位不会有跳变
+            loudness_ = level;
+            frames_ = 1;
+            gain_ = std::clamp((target_ - loudness_ - kLogMeanBias) / 2, -kMaxGain, kMaxGain);
+        } else {
+            // 开头几帧取平均，之后约 160ms 平滑
+            frames_ = std::min(frames_ + 1, kWarmupFrames + 1);
+            const int32_t weight = static_cast<int32_t>(std::min(frames_, kWarmupFrames));
+            loudness_ += (level - loudness_) / weight;
+            const int32_t step = frames_ <= kWarmupFrames ? kWarmupStep : kGainStep;
+            int32_t desired = std::clamp((target_ - loudness_ - kLogMeanBias) / 2, -kMaxGain, kMaxGain);
+            gain_ += std::clamp(desired - gain_, -step, step);
+        }
+    }
+    idle_frames_ = level > kGate ? 0 : std::min(idle_frames_ + 1, kRestartFrames);
+
+    // 响度增益与音量合成一个 Q15 增益（最大约 4 倍）
+    const int64_t gain = (static_cast<int64_t>(exp2Q8(normalize_ ? gain_ : 0, 15)) * volume_q15) >> 15;
+
+    // 各小段乘增益后的峰值对应的限幅增益
+    uint32_t cut[kSubBlocks];
+    size_t edge[kSubBlocks + 1];
+    for (size_t j = 0; j <= kSubBlocks; ++j) edge[j] = samples * j / kSubBlocks;
+    for (size_t j = 0; j < kSubBlocks; ++j) {
+        int32_t peak = 0;
+        for (size_t i = edge[j]; i < edge[j + 1]; ++i) peak = std::max(peak, std::abs(static_cast<int32_t>(pcm[i])));
+        cut[j] = reduction(static_cast<int32_t>((peak * gain) >> 15), ceiling_log_);
+    }
+
+    // 逐样本只乘一个 Q13 的总增益（最大 4 倍，乘积放得下 int32），小段内从上一小段的终点线性过渡
+    min_envelope_ = 32768;
+    for (size_t j = 0; j < kSubBlocks; ++j) {
+        // 过渡终点：本小段与下一小段中压缩更多的一个；比当前包络高时按释放速度回升
+        uint32_t envelope = j + 1 < kSubBlocks ? std::min(cut[j], cut[j + 1]) : cut[j];
+        if (envelope > envelope_) envelope = envelope_ + ((envelope - envelope_) >> kReleaseShift);
+        envelope_ = envelope;
+        min_envelope_ = std::min(min_envelope_, envelope);
+        const int32_t target = static_cast<int32_t>(std::min<int64_t>((gain * envelope) >> 17, 32767));
+        const size_t count = edge[j + 1] - edge[j];
+        if (count == 0) continue;
+        const int32_t step = ((target - applied_) << 8) / static_cast<int32_t>(count);
+        int32_t ramp = applied_ << 8;
+        for (size_t i = edge[j]; i < edge[j + 1]; ++i) {
+            ramp += step;
+            int32_t v = (static_cast<int32_t>(pcm[i]) * (ramp >> 8) + 4096) >> 13;
+            pcm[i] = static_cast<int16_t>(v > ceiling_ ? ceiling_ : v < -ceiling_ ? -ceiling_ : v);
+        }
+        applied_ = target;
+    }
+}
+
+int SoftLimiter::gainDb() const {
+    return amplitudeQ8ToDb(gain_);
+}
+
+int SoftLimiter::reductionDb() const {
+    return amplitudeQ8ToDb(15 * 256 - log2Q8(min_envelope_));
+}
+
+} // namespace chunfeng
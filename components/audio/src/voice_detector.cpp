@@ -0,0 +1,100 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-30 09:12:40
+ * @LastEditTime: 2025-06-30 17:46:09
+ * @LastEditors: 星年
+ * @Description: 语音端点检测：分段能量、噪声底跟踪与开始、结束的连续段计数
+ * @FilePath: \ESP32-ChunFeng\components\audio\src\voice_detector.cpp
+ * @遇事不决，可问春风
+ */
+#include "voice_detector.hpp"
+#include "fixed_log.hpp"
+#include <algorithm>
+
+namespace chunfeng {
+
+namespace {
+
+// 满量程正弦的均方值约 2^29，作为 0dBFS
+constexpr int32_t kFullScaleQ8 = 29 * 256;
+
+/** 功率分贝数换算为 log2 的 Q8（1dB 约 85） */
+constexpr int32_t dbToQ8(int db) {
+    return db * 256 * 1000 / 3010;
+}
+
+// 没有语音时噪声底向当前电平靠近：高于时每段跟上差值的 1/16，低于时跟上 1/8，
+// 降噪后的残留噪声起伏较大（10ms 的电平相差可达 20dB），噪声底落在起伏的中间偏下。
+// 每段最多抬高 kMaxRiseQ8（约 0.25dB），语音开头的几段不会把噪声底抬到语音上
+constexpr int kRiseShift = 4;
+constexpr int kFallShift = 3;
+constexpr int32_t kMaxRiseQ8 = 21;
+
+// 判断结束用的电平平滑（每段跟上 1/4，约 40ms），个别噪声尖峰不会让结束计数清零
+constexpr int kSmoothShift = 2;
+
+} // namespace
+
+VoiceDetector::VoiceDetector(uint32_t sample_rate) : segment_samples_(sample_rate * kSegmentMs / 1000) {}
+
+void VoiceDetector::reset() {
+    floor_ = 0;
+    primed_ = false;
+    warmup_ = 0;
+    speaking_ = false;
+    run_ = 0;
+    length_ = 0;
+}
+
+VoiceDetector::Event VoiceDetector::feed(const int16_t* segment) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < segment_samples_; ++i) {
+        sum += static_cast<uint32_t>(static_cast<int32_t>(segment[i]) * segment[i]);
+    }
+    // 加 1 使全零输入也有确定的电平
+    const int32_t level = log2Q8(sum / segment_samples_ + 1);
+    if (!primed_) {
+        floor_ = level;
+        smooth_ = level;
+        primed_ = true;
+    }
+    smooth_ += (level - smooth_) / (1 << kSmoothShift);
+
+    if (speaking_) {
+        // 说话期间噪声底不动；说得太久多半是噪声突然变大（如风扇开到高档），结束并从当前电平重新跟踪
+        peak_ = std::max(peak_, smooth_);
+        const int32_t quiet = std::max(floor_ + dbToQ8(kEndMarginDb), peak_ - dbToQ8(kEndBelowPeakDb));
+        run_ = smooth_ < quiet ? run_ + 1 : 0;
+        if (run_ < kEndSegments && ++length_ < kMaxSegments) return Event::NONE;
+        if (length_ >= kMaxSegments) floor_ = level;
+        speaking_ = false;
+        run_ = 0;
+        return Event::END;
+    }
+
+    if (warmup_ < kWarmupSegments) {
+        // 开头取平均值作为初始噪声底
+        floor_ = (floor_ * static_cast<int32_t>(warmup_) + level) / static_cast<int32_t>(warmup_ + 1);
+        warmup_++;
+        return Event::NONE;
+    }
+    if (level < floor_) {
+        floor_ -= (floor_ - level) >> kFallShift;
+    } else {
+        floor_ += std::min((level - floor_) >> kRiseShift, kMaxRiseQ8);
+    }
+    const bool loud = level > floor_ + dbToQ8(kStartMarginDb) && level > kFullScaleQ8 + dbToQ8(kMinSpeechDbfs);
+    run_ = loud ? run_ + 1 : 0;
+    if (run_ < kStartSegments) return Event::NONE;
+    speaking_ = true;
+    run_ = 0;
+    length_ = 0;
+    peak_ = smooth_;
+    return Event::START;
+}
+
+int VoiceDetector::noiseFloorDb() const {
+    return primed_ ? (floor_ - kFullScaleQ8) * 3010 / (256 * 1000) : -96;
+}
+
+} // namespace chunfeng
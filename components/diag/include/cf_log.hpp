@@ -0,0 +1,209 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-04 10:05:31
+ * @LastEditTime: 2025-07-02 09:41:26
+ * @LastEditors: 星年
+ * @Description: 低开销结构化日志：编译期级别过滤 + 延迟格式化 + 无锁环形缓冲
+ * @FilePath: \ESP32-ChunFeng\components\diag\include\cf_log.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+/**
+ * 日志级别（数值越大越详细）
+ */
+#define CF_LOG_LEVEL_NONE    0
+#define CF_LOG_LEVEL_ERROR   1
+#define CF_LOG_LEVEL_WARN    2
+#define CF_LOG_LEVEL_INFO    3
+#define CF_LOG_LEVEL_DEBUG   4
+#define CF_LOG_LEVEL_VERBOSE 5
+
+/**
+ * 编译期日志级别，高于该级别的日志调用在编译期被完全移除。
+ * 可通过 target_compile_definitions 覆盖。
+ */
+#ifndef CF_LOG_LEVEL
+#define CF_LOG_LEVEL CF_LOG_LEVEL_INFO
+#endif
+
+/**
+ * 格式串必须是字符串字面量（"" fmt 保证这一点），只保存指针，在日志任务中再格式化。
+ * 参数按值拷贝进记录，字符串参数拷贝到记录内（超长截断）。
+ */
+#define CF_LOG_IMPL(level, tag, fmt, ...)                                            \
+    do {                                                                              \
+        if constexpr ((level) <= CF_LOG_LEVEL) {                                      \
+            ::chunfeng::log::write((level), (tag), "" fmt, ##__VA_ARGS__);            \
+        }                                                                             \
+    } while (0)
+
+#define CF_LOGE(tag, fmt, ...) CF_LOG_IMPL(CF_LOG_LEVEL_ERROR, tag, fmt, ##__VA_ARGS__)
+#define CF_LOGW(tag, fmt, ...) CF_LOG_IMPL(CF_LOG_LEVEL_WARN, tag, fmt, ##__VA_ARGS__)
+#define CF_LOGI(tag, fmt, ...) CF_LOG_IMPL(CF_LOG_LEVEL_INFO, tag, fmt, ##__VA_ARGS__)
+#define CF_LOGD(tag, fmt, ...) CF_LOG_IMPL(CF_LOG_LEVEL_DEBUG, tag, fmt, ##__VA_ARGS__)
+#define CF_LOGV(tag, fmt, ...) CF_LOG_IMPL(CF_LOG_LEVEL_VERBOSE, tag, fmt, ##__VA_ARGS__)
+
+namespace chunfeng {
+namespace log {
+
+constexpr size_t kMaxArgs = 6;          ///< 单条日志最多参数个数
+constexpr size_t kStringPool = 40;      ///< 单条日志内字符串参数总长度上限
+constexpr size_t kRingCapacity = 64;    ///< 环形缓冲记录数
+
+/**
+ * @brief 参数类型
+ */
+enum class ArgType : uint8_t {
+    INT,
+    UINT,
+    DOUBLE,
+    STRING,     ///< 值为 strings 中的偏移
+    POINTER,
+};
+
+/**
+ * @brief 二进制日志记录（定长，直接放入环形缓冲）
+ */
+struct Record {
+    int64_t timestamp_us;           ///< 记录时间（自启动以来微秒）
+    const char* tag;                ///< 模块标签（静态字符串）
+    const char* fmt;                ///< 格式串（字符串字面量）
+    uint8_t level;
+    uint8_t nargs;
+    uint8_t string_used;
+    ArgType types[kMaxArgs];
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const void* p;
+    } values[kMaxArgs];
+    char strings[kStringPool];
+};
+
+/**
+ * @brief 日志输出目的地
+ * @param line 已格式化的一行（含换行）
+ * @param len 长度
+ * @param ctx 注册时传入的上下文
+ */
+using SinkFn = void (*)(const char* line, size_t len, void* ctx);
+
+/**
+ * @brief 启动后台日志任务
+ *
+ * 低优先级任务负责把环形缓冲中的记录格式化并写到各输出目的地。
+ * 未启动前的日志暂存在环形缓冲中，满则丢弃并计数。
+ */
+void start();
+
+/**
+ * @brief 同步排空环形缓冲（用于崩溃前、主机测试等场景）
+ * @return 本次输出的记录数
+ */
+size_t flush();
+
+/**
+ * @brief 添加输出目的地（最多 4 个，默认已包含串口）
+ */
+bool addSink(SinkFn fn, void* ctx);
+
+/**
+ * @brief 添加文件输出（如挂载在 /storage 的 SPIFFS 分区）
+ * @param path 文件路径
+ * @param max_bytes 超过该大小时轮转为 path.1
+ */
+bool addFileSink(const char* path, size_t max_bytes);
+
+/**
+ * @brief 启动以来因缓冲区满被丢弃的日志总条数（输出丢弃提示后不清零）
+ */
+uint32_t droppedCount();
+
+/**
+ * @brief 将记录格式化为一行文本（"I (1234) Tag: msg\n"）
+ * @return 写入的字节数（不含结尾 '\0'）
+ */
+size_t formatRecord(const Record& rec, char* out, size_t out_size);
+
+namespace detail {
+
+Record* beginRecord(uint8_t level, const char* tag, const char* fmt, uint32_t& ticket);
+void commitRecord(uint32_t ticket);
+
+inline void putString(Record& rec, const char* s, size_t len) {
+    size_t room = kStringPool - rec.string_used;
+    if (room == 0) {
+        rec.values[rec.nargs].u = kStringPool - 1;  // 指向最后一个 '\0'
+    } else {
+        size_t n = len < room - 1 ? len : room - 1;
+        memcpy(rec.strings + rec.string_used, s, n);
+        rec.strings[rec.string_used + n] = '\0';
+        rec.values[rec.nargs].u = rec.string_used;
+        rec.string_used += n + 1;
+    }
+    rec.types[rec.nargs] = ArgType::STRING;
+}
+
+template <typename T>
+inline void putArg(Record& rec, const T& v) {
+    using U = typename std::decay<T>::type;
+    if constexpr (std::is_same<U, bool>::value) {
+        rec.types[rec.nargs] = ArgType::INT;
+        rec.values[rec.nargs].i = v ? 1 : 0;
+    } else if constexpr (std::is_enum<U>::value) {
+        rec.types[rec.nargs] = ArgType::INT;
+        rec.values[rec.nargs].i = static_cast<int64_t>(v);
+    } else if constexpr (std::is_integral<U>::value && std::is_signed<U>::value) {
+        rec.types[rec.nargs] = ArgType::INT;
+        rec.values[rec.nargs].i = v;
+    } else if constexpr (std::is_integral<U>::value) {
+        rec.types[rec.nargs] = ArgType::UINT;
+        rec.values[rec.nargs].u = v;
+    } else if constexpr (std::is_floating_point<U>::value) {
+        rec.types[rec.nargs] = ArgType::DOUBLE;
+        rec.values[rec.nargs].d = v;
+    } else if constexpr (std::is_same<U, std::string>::value) {
+        putString(rec, v.data(), v.size());
+    } else if constexpr (std::is_array<T>::value &&
+                         std::is_same<typename std::remove_cv<typename std::remove_extent<T>::type>::type,
+                                      char>::value) {
+        // 字符数组（结构体中的 ssid、分区名等）：最多取到数组末尾，不要求以 '\0' 结尾
+        putString(rec, v, strnlen(v, std::extent<T>::value));
+    } else if constexpr (std::is_same<U, const char*>::value || std::is_same<U, char*>::value) {
+        putString(rec, v ? v : "(null)", v ? strlen(v) : 6);
+    } else if constexpr (std::is_pointer<U>::value) {
+        rec.types[rec.nargs] = ArgType::POINTER;
+        rec.values[rec.nargs].p = v;
+    } else {
+        static_assert(std::is_pointer<U>::value, "不支持的日志参数类型");
+    }
+    rec.nargs++;
+}
+
+} // namespace detail
+
+/**
+ * @brief 写入一条日志（热路径，不做格式化）
+ *
+ * 请使用 CF_LOGx 宏，以获得编译期级别过滤和格式串字面量检查。
+ */
+template <typename... Args>
+inline void write(uint8_t level, const char* tag, const char* fmt, const Args&... args) {
+    static_assert(sizeof...(Args) <= kMaxArgs, "日志参数过多");
+    uint32_t ticket;
+    Record* rec = detail::beginRecord(level, tag, fmt, ticket);
+    if (!rec) return;
+    (detail::putArg(*rec, args), ...);
+    detail::commitRecord(ticket);
+}
+
+} // namespace log
+} // namespace chunfeng
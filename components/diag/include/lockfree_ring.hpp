@@ -0,0 +1,140 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-04 09:40:18
+ * @LastEditTime: 2025-06-04 11:02:45
+ * @LastEditors: 星年
+ * @Description: 有界无锁环形队列（多生产者/多消费者），供日志、消息总线等模块复用
+ * @FilePath: \ESP32-ChunFeng\components\diag\include\lockfree_ring.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace chunfeng {
+
+/**
+ * @brief 有界无锁环形队列
+ *
+ * 基于每个槽位的序号实现（Vyukov MPMC 队列），push/pop 均不加锁、不分配内存，
+ * 可在多个任务之间并发使用。仅使用 32 位原子操作，在 ESP32-S3 上为无锁实现。
+ *
+ * @tparam T 元素类型，必须可平凡拷贝
+ * @tparam Capacity 容量，必须为 2 的幂
+ */
+template <typename T, size_t Capacity>
+class LockFreeRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity 必须为 2 的幂");
+    static_assert(std::is_trivially_copyable<T>::value, "T 必须可平凡拷贝");
+
+public:
+    LockFreeRing() {
+        for (size_t i = 0; i < Capacity; ++i) {
+            slots_[i].seq.store(static_cast<uint32_t>(i), std::memory_order_relaxed);
+        }
+    }
+
+    LockFreeRing(const LockFreeRing&) = delete;
+    LockFreeRing& operator=(const LockFreeRing&) = delete;
+
+    /**
+     * @brief 预留一个槽位，由调用方原地填充后调用 commit()
+     *
+     * 避免大记录先在栈上构造再拷贝一次。
+     * @return 槽位指针，队列已满返回 nullptr
+     */
+    T* reserve(uint32_t& ticket) {
+        uint32_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots_[pos & kMask];
+            uint32_t seq = slot.seq.load(std::memory_order_acquire);
+            int32_t diff = static_cast<int32_t>(seq - pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    ticket = pos;
+                    return &slot.value;
+                }
+            } else if (diff < 0) {
+                return nullptr;  // 已满
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief 发布 reserve() 预留并填充好的槽位
+     */
+    void commit(uint32_t ticket) {
+        slots_[ticket & kMask].seq.store(ticket + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief 入队
+     * @return true 成功
+     * @return false 队列已满
+     */
+    bool tryPush(const T& value) {
+        uint32_t ticket;
+        T* slot = reserve(ticket);
+        if (!slot) return false;
+        *slot = value;
+        commit(ticket);
+        return true;
+    }
+
+    /**
+     * @brief 出队
+     * @return true 取到元素
+     * @return false 队列为空
+     */
+    bool tryPop(T& out) {
+        uint32_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots_[pos & kMask];
+            uint32_t seq = slot.seq.load(std::memory_order_acquire);
+            int32_t diff = static_cast<int32_t>(seq - (pos + 1));
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    out = slot.value;
+                    slot.seq.store(pos + Capacity, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // 为空
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief 当前元素个数（并发时仅为近似值）
+     */
+    size_t size() const {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        return static_cast<size_t>(tail - head);
+    }
+
+    bool empty() const { return size() == 0; }
+
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    static constexpr uint32_t kMask = Capacity - 1;
+
+    struct Slot {
+        std::atomic<uint32_t> seq;
+        T value;
+    };
+
+    Slot slots_[Capacity];
+    std::atomic<uint32_t> tail_{0};   ///< 生产者位置
+    std::atomic<uint32_t> head_{0};   ///< 消费者位置
+};
+
+} // namespace chunfeng
@@ -0,0 +1,186 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-14 09:26:13
+ * @LastEditTime: 2025-06-14 16:48:37
+ * @LastEditors: 星年
+ * @Description: 模块间消息总线：按主题发布、订阅，定长消息槽，每个订阅者一个无锁队列，发布方从不阻塞
+ * @FilePath: \ESP32-ChunFeng\components\diag\include\message_bus.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lockfree_ring.hpp"
+
+namespace chunfeng {
+namespace bus {
+
+/**
+ * @brief 主题
+ *
+ * 每个主题的负载类型由发布方头文件中的 CF_BUS_TOPIC 绑定，未绑定的主题无法发布。
+ */
+enum class Topic : uint8_t {
+    NETWORK_STATE,  ///< 网络状态变化（NetworkManager）
+    WIFI_LINK,      ///< WiFi 连接结果（WiFiConnector）
+    SYSTEM_STATE,   ///< 系统状态（开机阶段、低功耗）
+    AUDIO_STATE,    ///< 音频状态（录音、播放、唤醒）
+    AUDIO_LEVEL,    ///< 播放音频每帧的响度与频带，带 DAC 输出时间（AudioPlayback）
+    COZE_STATE,     ///< 云端对话状态
+    PING,           ///< 诊断与基准
+    COUNT
+};
+
+constexpr size_t kPayloadSize = 32;     ///< 消息负载上限，超出的数据应放在发布方，消息中只带索引
+constexpr size_t kQueueDepth = 16;      ///< 每个订阅者的队列长度
+constexpr size_t kMaxSubscribers = 16;
+
+constexpr uint32_t topicBit(Topic topic) {
+    return 1u << static_cast<uint8_t>(topic);
+}
+
+constexpr uint32_t kAllTopics = (1u << static_cast<uint8_t>(Topic::COUNT)) - 1;
+
+/**
+ * @brief 定长消息，按值拷贝进订阅者队列
+ */
+struct Message {
+    Topic topic;
+    uint8_t size;           ///< 负载实际字节数
+    uint16_t reserved;
+    uint32_t seq;           ///< 该主题的发布序号，订阅者可据此发现丢失的消息
+    int64_t time_us;        ///< 发布时间
+    alignas(8) uint8_t payload[kPayloadSize];
+};
+
+/**
+ * @brief 主题与负载类型的绑定，由 CF_BUS_TOPIC 特化
+ */
+template <Topic T>
+struct TopicType;
+
+/**
+ * @brief 绑定主题的负载类型，需在全局命名空间中使用
+ * @code
+ * struct NetworkStateChanged { uint8_t state; uint8_t previous; };
+ * CF_BUS_TOPIC(NETWORK_STATE, chunfeng::NetworkStateChanged)
+ * @endcode
+ */
+#define CF_BUS_TOPIC(topic, Type)                                                      \
+    namespace chunfeng {                                                               \
+    namespace bus {                                                                    \
+    template <>                                                                        \
+    struct TopicType<Topic::topic> {                                                   \
+        using type = Type;                                                             \
+        static_assert(std::is_trivially_copyable<Type>::value, #Type " 必须可平凡拷贝"); \
+        static_assert(sizeof(Type) <= kPayloadSize, #Type " 超出消息负载上限");          \
+    };                                                                                 \
+    }                                                                                  \
+    }
+
+/**
+ * @brief 订阅者
+ *
+ * 每个订阅者持有一个定长无锁队列，由自己的任务调用 receive() 取出消息，发布方只负责入队和唤醒。
+ * 队列满时丢弃新消息并计数，不阻塞发布方；状态类主题的订阅者在发现丢失（seq 不连续）时
+ * 应以发布方的当前状态为准。
+ *
+ * 订阅者注册后不会注销，应定义为静态对象或与所属单例同寿命的成员。
+ * receive() 通过任务通知等待，订阅者所在任务不能再将任务通知用于其他用途。
+ */
+class Subscriber {
+public:
+    /**
+     * @param name 名称（静态字符串），用于日志
+     * @param topics topicBit() 的按位或
+     */
+    Subscriber(const char* name, uint32_t topics);
+
+    Subscriber(const Subscriber&) = delete;
+    Subscriber& operator=(const Subscriber&) = delete;
+
+    /**
+     * @brief 取出一条消息，队列为空时等待
+     * @param timeout_ms 最长等待时间，portMAX_DELAY 表示一直等待
+     * @return true 取到消息；false 超时或被 interrupt() 打断
+     */
+    bool receive(Message& out, uint32_t timeout_ms = portMAX_DELAY);
+
+    /**
+     * @brief 让正在（或下一次）等待的 receive() 立即返回 false
+     *
+     * 订阅者所在任务除总线消息外还有其他事件要处理时（如直接调用的接口修改了状态），用它唤醒任务。
+     */
+    void interrupt();
+
+    /**
+     * @brief 取出一条消息，不等待
+     */
+    bool tryReceive(Message& out) { return queue_.tryPop(out); }
+
+    /**
+     * @brief 注册成功（超过 kMaxSubscribers 时失败，收不到任何消息）
+     */
+    bool registered() const { return registered_; }
+
+    /**
+     * @brief 因队列满被丢弃的消息数
+     */
+    uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    const char* name() const { return name_; }
+    uint32_t topics() const { return topics_; }
+
+private:
+    friend size_t publishRaw(Topic topic, const void* data, size_t size);
+
+    /**
+     * @brief 发布方调用：入队
+     * @param wake 订阅者正在等待时返回需要唤醒的任务，由发布方在投递完全部订阅者后唤醒
+     */
+    bool offer(const Message& message, TaskHandle_t& wake);
+
+    const char* name_;
+    uint32_t topics_;
+    bool registered_{false};
+    std::atomic<uint32_t> dropped_{0};
+    std::atomic<TaskHandle_t> waiter_{nullptr};    ///< 正在 receive() 中等待的任务
+    std::atomic<bool> interrupted_{false};
+    LockFreeRing<Message, kQueueDepth> queue_;
+};
+
+/**
+ * @brief 发布未经类型检查的负载，供 publish() 使用
+ * @return 成功投递的订阅者数
+ */
+size_t publishRaw(Topic topic, const void* data, size_t size);
+
+/**
+ * @brief 发布消息
+ *
+ * 不加锁、不分配内存、不阻塞，可在任意任务中调用（不可在中断中调用）。
+ * @return 成功投递的订阅者数
+ */
+template <Topic T>
+size_t publish(const typename TopicType<T>::type& value) {
+    return publishRaw(T, &value, sizeof(value));
+}
+
+/**
+ * @brief 按主题类型取出消息负载
+ */
+template <Topic T>
+typename TopicType<T>::type payload(const Message& message) {
+    typename TopicType<T>::type value;
+    memcpy(&value, message.payload, sizeof(value));
+    return value;
+}
+
+} // namespace bus
+} // namespace chunfeng
@@ -0,0 +1,204 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-05 09:18:27
+ * @LastEditTime: 2025-07-02 10:18:37
+ * @LastEditors: 星年
+ * @Description: 运行时指标注册表：计数器、仪表、定长桶直方图，支持 Prometheus 文本格式输出
+ * @FilePath: \ESP32-ChunFeng\components\diag\include\metrics.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace chunfeng {
+namespace metrics {
+
+/**
+ * @brief 指标基类
+ *
+ * 所有指标以静态对象形式定义，构造时无锁地挂到全局链表上，不做动态分配。
+ * 更新操作只使用 32 位原子操作，可在中断中调用。
+ *
+ * 用法：
+ * @code
+ * static metrics::Counter s_reconnects("chunfeng_network_reconnects_total", "网络重连次数");
+ * s_reconnects.inc();
+ * @endcode
+ */
+class Metric {
+public:
+    enum class Type : uint8_t {
+        COUNTER,
+        GAUGE,
+        HISTOGRAM,
+    };
+
+    /**
+     * @param name 指标名（静态字符串，遵循 Prometheus 命名）
+     * @param help 说明（静态字符串）
+     * @param labels 常量标签，如 "caps=\"internal\""，可为 nullptr
+     */
+    Metric(const char* name, const char* help, const char* labels, Type type);
+
+    Metric(const Metric&) = delete;
+    Metric& operator=(const Metric&) = delete;
+
+    const char* name() const { return name_; }
+    const char* help() const { return help_; }
+    const char* labels() const { return labels_; }
+    Type type() const { return type_; }
+    const Metric* next() const { return next_; }
+
+private:
+    const char* name_;
+    const char* help_;
+    const char* labels_;
+    Type type_;
+    Metric* next_{nullptr};
+};
+
+/**
+ * @brief 单调递增计数器
+ */
+class Counter : public Metric {
+public:
+    Counter(const char* name, const char* help, const char* labels = nullptr)
+        : Metric(name, help, labels, Type::COUNTER) {}
+
+    void inc(uint32_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    uint32_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint32_t> value_{0};
+};
+
+/**
+ * @brief 可增可减的瞬时值
+ */
+class Gauge : public Metric {
+public:
+    Gauge(const char* name, const char* help, const char* labels = nullptr)
+        : Metric(name, help, labels, Type::GAUGE) {}
+
+    void set(int32_t v) { value_.store(v, std::memory_order_relaxed); }
+    void add(int32_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+    int32_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int32_t> value_{0};
+};
+
+/**
+ * @brief 定长桶直方图
+ *
+ * 桶上界在构造时给定（升序，最多 kMaxBuckets 个），另有一个 +Inf 桶。
+ * observe() 不分配内存、不加锁。_sum 为 64 位累计值，微秒级耗时累计数千年也不会回绕；
+ * Xtensa 上 64 位原子操作要经 libatomic 的全局自旋锁，因此拆成两个 32 位字：低位 fetch_add，
+ * 回绕时向高位进位。进位完成前的一瞬间读到的值可能少 2^32，下一次读取即恢复。
+ */
+class Histogram : public Metric {
+public:
+    static constexpr size_t kMaxBuckets = 12;
+
+    /**
+     * @param bounds 桶上界数组（静态存储，升序）
+     * @param count 桶个数
+     */
+    Histogram(const char* name, const char* help, const uint32_t* bounds, size_t count,
+              const char* labels = nullptr);
+
+    void observe(uint32_t v);
+
+    size_t bucketCount() const { return bucket_count_; }
+    uint32_t bound(size_t i) const { return bounds_[i]; }
+    /** 第 i 个桶（非累计）的计数，i == bucketCount() 为 +Inf 桶 */
+    uint32_t bucket(size_t i) const { return buckets_[i].load(std::memory_order_relaxed); }
+    uint32_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum() const;
+
+private:
+    const uint32_t* bounds_;
+    size_t bucket_count_;
+    std::atomic<uint32_t> buckets_[kMaxBuckets + 1]{};
+    std::atomic<uint32_t> count_{0};
+    std::atomic<uint32_t> sum_lo_{0};
+    std::atomic<uint32_t> sum_hi_{0};
+};
+
+/**
+ * @brief 输出回调
+ * @return false 中止输出（如 HTTP 连接已断开）
+ */
+using WriteFn = bool (*)(const char* data, size_t len, void* ctx);
+
+/**
+ * @brief 渲染器，负责 Prometheus 文本格式
+ */
+class Renderer {
+public:
+    Renderer(WriteFn fn, void* ctx) : fn_(fn), ctx_(ctx) {}
+
+    /**
+     * @brief 输出一个不在注册表中的样本（供采集回调输出动态标签，如每个任务的 CPU 占用）
+     */
+    void sample(const char* name, const char* help, Metric::Type type, const char* labels, int64_t value);
+
+    /**
+     * @brief 输出一个已注册指标
+     */
+    void metric(const Metric& m, bool with_header);
+
+    bool ok() const { return ok_; }
+
+private:
+    void header(const char* name, const char* help, Metric::Type type);
+    void write(const char* data, size_t len);
+    void line(const char* name, const char* suffix, const char* labels, const char* extra_label, int64_t value);
+
+    WriteFn fn_;
+    void* ctx_;
+    bool ok_{true};
+};
+
+/**
+ * @brief 采集回调，在每次渲染前调用（如刷新堆内存、任务 CPU 占用）
+ */
+class Collector {
+public:
+    using CollectFn = void (*)(Renderer& r);
+
+    explicit Collector(CollectFn fn);
+
+    Collector(const Collector&) = delete;
+    Collector& operator=(const Collector&) = delete;
+
+    CollectFn fn() const { return fn_; }
+    const Collector* next() const { return next_; }
+
+private:
+    CollectFn fn_;
+    Collector* next_{nullptr};
+};
+
+/**
+ * @brief 注册表头（按注册顺序的逆序）
+ */
+const Metric* first();
+
+/**
+ * @brief 输出全部指标（Prometheus 文本格式 0.0.4）
+ * @return false 输出被回调中止
+ */
+bool render(WriteFn fn, void* ctx);
+
+/**
+ * @brief 输出全部指标到字符串（主机测试、调试用）
+ */
+std::string renderToString();
+
+} // namespace metrics
+} // namespace chunfeng
@@ -0,0 +1,101 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-18 09:14:52
+ * @LastEditTime: 2025-06-18 15:37:20
+ * @LastEditors: 星年
+ * @Description: 顺序锁：单一写入方不等待，读取方拿到一致的副本，冲突时重试
+ * @FilePath: \ESP32-ChunFeng\components\diag\include\seqlock.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+namespace chunfeng {
+
+/**
+ * @brief 顺序锁
+ *
+ * 写入时序号先变为奇数，写完再变为偶数；读取方在序号为偶数且前后不变时得到的副本一定完整。
+ * 数据按 32 位原子字存放，读写都不加锁、不关中断。
+ *
+ * 只允许一个写入方（通常是某个模块自己的任务）；读取方数量不限。
+ * 读取方与写入方在同一核心且优先级更高时，写入方可能正好在写入途中被抢占，
+ * read() 重试几次仍失败后会让出 CPU 一个节拍，不会在这种情况下空转。
+ *
+ * @tparam T 必须可平凡拷贝
+ */
+template <typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "T 必须可平凡拷贝");
+
+public:
+    static constexpr int kSpinTries = 4;
+
+    SeqLock() {
+        T zero{};
+        write(zero);
+        seq_.store(0, std::memory_order_relaxed);
+    }
+
+    SeqLock(const SeqLock&) = delete;
+    SeqLock& operator=(const SeqLock&) = delete;
+
+    /**
+     * @brief 写入（只能由唯一的写入方调用），不等待
+     */
+    void write(const T& value) {
+        uint32_t buf[kWords] = {};
+        memcpy(buf, &value, sizeof(T));
+        uint32_t seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < kWords; ++i) words_[i].store(buf[i], std::memory_order_relaxed);
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    /**
+     * @brief 读取一次，正好与写入冲突时返回 false
+     */
+    bool tryRead(T& out) const {
+        uint32_t buf[kWords];
+        uint32_t before = seq_.load(std::memory_order_acquire);
+        if (before & 1) return false;
+        for (size_t i = 0; i < kWords; ++i) buf[i] = words_[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq_.load(std::memory_order_relaxed) != before) return false;
+        memcpy(&out, buf, sizeof(T));
+        return true;
+    }
+
+    /**
+     * @brief 读取一致的副本
+     * @return 重试次数
+     */
+    uint32_t read(T& out) const {
+        uint32_t retries = 0;
+        while (!tryRead(out)) {
+            if (++retries % kSpinTries == 0) vTaskDelay(1);
+        }
+        return retries;
+    }
+
+    /**
+     * @brief 已完成的写入次数
+     */
+    uint32_t version() const { return seq_.load(std::memory_order_acquire) / 2; }
+
+private:
+    static constexpr size_t kWords = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    std::atomic<uint32_t> seq_{0};
+    std::atomic<uint32_t> words_[kWords];
+};
+
+} // namespace chunfeng
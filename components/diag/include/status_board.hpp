@@ -0,0 +1,136 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-18 09:40:06
+ * @LastEditTime: 2025-07-02 14:26:08
+ * @LastEditors: 星年
+ * @Description: 系统状态快照：各模块在自己的任务中无锁更新所属分区，读取方拿到一致的副本，可输出紧凑 JSON 或二进制
+ * @FilePath: \ESP32-ChunFeng\components\diag\include\status_board.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace chunfeng {
+namespace status {
+
+/**
+ * @brief 网络分区，由网络状态机任务写入
+ */
+struct NetworkStatus {
+    uint8_t state;          ///< NetworkState 的取值
+    uint8_t link;           ///< 0 未连接、1 WiFi、2 4G
+    int8_t rssi;            ///< WiFi 信号强度（dBm），未连接 WiFi 时为 0
+    uint8_t channel;
+    uint32_t state_since_ms;    ///< 进入当前状态的时间（自启动）
+    uint32_t transitions;       ///< 状态变化次数
+};
+
+/**
+ * @brief 音频分区，由播放任务写入
+ */
+struct AudioStatus {
+    uint8_t playing;        ///< 正在播放语音
+    uint8_t level;          ///< 最近一帧的响度（0~255）
+    uint16_t reserved;
+    uint32_t frames;        ///< 已播放的语音帧数
+    uint32_t underruns;     ///< 播放中途缓冲为空的帧数
+};
+
+/**
+ * @brief 云端对话分区，由对话会话任务写入
+ */
+struct CozeStatus {
+    uint8_t state;
+    uint8_t reserved[3];
+    uint32_t turns;             ///< 完成的对话轮数
+    uint32_t last_latency_ms;   ///< 最近一轮从说完到开始播放回复的耗时
+};
+
+/**
+ * @brief 电源分区，由电源管理在切换模式时写入（持有电源管理的锁）
+ */
+struct PowerStatus {
+    uint8_t mode;               ///< power::Mode 的取值
+    uint8_t wifi_ps;            ///< 最近一次成功设置的 WiFi 省电模式（wifi_ps_type_t）
+    uint16_t reserved;
+    int32_t wifi_ps_error;      ///< 设置 WiFi 省电模式的错误码，0 表示已生效（配网 AP 开启时失败）
+    uint32_t wifi_ps_failures;  ///< 设置失败的次数
+};
+
+/**
+ * @brief 设置分区，由后台管理在推送应用完成时写入（持有后台管理的锁）
+ */
+struct SettingsStatus {
+    uint32_t version;       ///< 当前生效的设置版本
+    uint32_t pending;       ///< 已接受、仍在后台应用（切换 WiFi）的推送版本，0 表示没有
+    uint32_t last;          ///< 最近一次应用完成（生效或撤销）的推送版本
+    int32_t last_error;     ///< 其结果：0 表示已生效，否则为撤销原因的错误码
+};
+
+/**
+ * @brief 系统分区，读取时现场采集
+ */
+struct SystemStatus {
+    uint32_t uptime_s;
+    uint32_t free_internal;
+    uint32_t min_free_internal;
+    uint32_t largest_internal;
+    uint32_t free_spiram;
+};
+
+/**
+ * @brief 完整快照，各分区分别一致
+ */
+struct Snapshot {
+    NetworkStatus network;
+    AudioStatus audio;
+    CozeStatus coze;
+    PowerStatus power;
+    SettingsStatus settings;
+    SystemStatus system;
+};
+
+static_assert(sizeof(Snapshot) == 84, "二进制格式要求各分区无填充");
+
+/**
+ * @brief 二进制格式的头部，后接 Snapshot（小端、无填充）
+ */
+struct BinaryHeader {
+    char magic[4];          ///< "CFST"
+    uint8_t version;        ///< kBinaryVersion
+    uint8_t reserved;
+    uint16_t size;          ///< sizeof(Snapshot)
+};
+
+constexpr uint8_t kBinaryVersion = 3;     ///< 2：增加电源分区；3：增加设置分区
+constexpr size_t kBinarySize = sizeof(BinaryHeader) + sizeof(Snapshot);
+constexpr size_t kMaxJsonSize = 448;
+
+/** 各分区只能由一个任务（或持同一把锁的多个任务）写入 */
+void updateNetwork(const NetworkStatus& value);
+void updateAudio(const AudioStatus& value);
+void updateCoze(const CozeStatus& value);
+void updatePower(const PowerStatus& value);
+void updateSettings(const SettingsStatus& value);
+
+/**
+ * @brief 读取快照，不阻塞写入方
+ */
+void read(Snapshot& out);
+
+/**
+ * @brief 输出紧凑 JSON
+ * @return 字符数（不含结尾 0），缓冲不足时返回 0
+ */
+size_t formatJson(const Snapshot& snapshot, char* buf, size_t size);
+
+/**
+ * @brief 输出二进制格式
+ * @return 字节数，缓冲不足时返回 0
+ */
+size_t formatBinary(const Snapshot& snapshot, uint8_t* buf, size_t size);
+
+} // namespace status
+} // namespace chunfeng
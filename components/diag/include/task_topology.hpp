@@ -0,0 +1,130 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-13 09:18:40
+ * @LastEditTime: 2025-06-25 10:41:37
+ * @LastEditors: 星年
+ * @Description: 任务拓扑：全部应用任务的核心、优先级、栈大小与栈内存类型集中在一张表里，按表创建任务并检查
+ * @FilePath: \ESP32-ChunFeng\components\diag\include\task_topology.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+namespace chunfeng {
+namespace tasks {
+
+/**
+ * @brief 任务标识，顺序与 task_topology.cpp 中的表一致
+ *
+ * SYS_ 开头的是 ESP-IDF 自己创建的任务，只参与检查，不由 spawn() 创建。
+ */
+enum class TaskId : uint8_t {
+    NETWORK,        ///< 网络状态机
+    DNS_REFRESH,    ///< DNS 缓存后台解析
+    HTTPD,          ///< 配网 HTTP 服务（esp_http_server 创建，参数取自本表）
+    LOG,            ///< 日志后台写出
+    AUDIO_CAPTURE,  ///< I2S 采集
+    AUDIO_DSP,      ///< 降噪、回声消除、唤醒
+    AUDIO_CODEC,    ///< Opus 编解码
+    AUDIO_PLAY,     ///< I2S 播放
+    COZE_SESSION,   ///< 云端对话会话（WebSocket）
+    DISPLAY,        ///< 屏幕刷新
+    BACKEND,        ///< 后台服务上报
+    OTA,            ///< 固件升级（按需创建，升级完成后退出）
+    SPOOL,          ///< 离线语音写入 Flash 与联网后补传
+    POWER,          ///< 电源模式切换
+    BOOT_0,         ///< 开机编排（每核一个，全部阶段完成后退出）
+    BOOT_1,
+    MAIN,           ///< app_main，创建完其他任务后定期输出运行报告
+    SYS_WIFI,
+    SYS_TCPIP,
+    SYS_TIMER,
+    COUNT
+};
+
+/**
+ * @brief 任务栈所在内存
+ */
+enum class StackMem : uint8_t {
+    INTERNAL,   ///< 内部 RAM
+    SPIRAM,     ///< PSRAM：节省内部 RAM，但访问 Flash（NVS、SPIFFS）期间 cache 关闭，不可使用
+};
+
+/** 任务会读写 Flash，栈必须放在内部 RAM */
+constexpr uint8_t kFlashAccess = 1 << 0;
+/** 由 ESP-IDF 创建，表中数值来自 sdkconfig 或组件默认值 */
+constexpr uint8_t kSystem = 1 << 1;
+
+constexpr int8_t kAnyCore = -1;
+
+constexpr uint32_t dependsOn(TaskId id) {
+    return 1u << static_cast<uint8_t>(id);
+}
+
+/**
+ * @brief 任务规格
+ *
+ * period_ms / budget_us 描述 CPU 负载：每 period_ms 最多运行 budget_us（事件驱动的任务按最短触发间隔填写），
+ * 用于检查每个核心的总负载。depends 为该任务阻塞等待其输出的任务（队列、条件变量），用于检查优先级反转。
+ */
+struct TaskSpec {
+    TaskId id;
+    const char* name;
+    int8_t core;            ///< 0、1 或 kAnyCore
+    uint8_t priority;
+    uint32_t stack_bytes;
+    StackMem stack_mem;
+    uint32_t period_ms;
+    uint32_t budget_us;
+    uint8_t flags;
+    uint32_t depends;       ///< dependsOn() 的按位或
+};
+
+constexpr uint32_t kCoreLoadLimitPercent = 75;      ///< 每个核心的 CPU 预算上限，余量留给中断与突发
+constexpr size_t kInternalStackBudget = 64 * 1024;  ///< 表中任务栈可占用的内部 RAM
+constexpr size_t kSpiramStackBudget = 128 * 1024;   ///< 表中任务栈可占用的 PSRAM
+
+/**
+ * @brief 任务表
+ */
+const TaskSpec* table(size_t* count);
+
+/**
+ * @brief 查询某个任务的规格
+ */
+const TaskSpec& spec(TaskId id);
+
+/**
+ * @brief 按表创建任务（核心、优先级、栈大小与栈内存类型都取自表）
+ * @return pdPASS 成功
+ */
+BaseType_t spawn(TaskId id, TaskFunction_t fn, void* arg, TaskHandle_t* handle = nullptr);
+
+/**
+ * @brief 登记不是由 spawn() 创建的表内任务（如 app_main 所在的主任务），以便纳入运行报告
+ */
+void adopt(TaskId id, TaskHandle_t handle);
+
+/**
+ * @brief 已创建（或登记）的任务句柄，未创建时为空
+ */
+TaskHandle_t handle(TaskId id);
+
+/**
+ * @brief 检查任务表：优先级反转、每核 CPU 预算、栈内存预算与栈内存类型
+ * @param out 每条问题调用一次，可为空
+ * @return 问题条数
+ */
+size_t validate(void (*out)(const char* message) = nullptr);
+
+/**
+ * @brief 输出表内任务的栈余量与 CPU 占用（自上次报告以来），栈余量不足 10% 或超出 CPU 预算时告警
+ */
+void logReport();
+
+} // namespace tasks
+} // namespace chunfeng
@@ -0,0 +1,127 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-06 09:30:12
+ * @LastEditTime: 2025-06-06 18:05:37
+ * @LastEditors: 星年
+ * @Description: 热路径追踪：周期计数器时间戳、每核无锁缓冲，导出 Chrome/Perfetto JSON
+ * @FilePath: \ESP32-ChunFeng\components\diag\include\trace.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "metrics.hpp"  // WriteFn
+
+/**
+ * 编译期开关，关闭后所有 CF_TRACE_xxx 宏为空
+ */
+#ifndef CF_TRACE_ENABLED
+#define CF_TRACE_ENABLED 1
+#endif
+
+#define CF_TRACE_CONCAT_(a, b) a##b
+#define CF_TRACE_CONCAT(a, b) CF_TRACE_CONCAT_(a, b)
+
+#if CF_TRACE_ENABLED
+/** 作用域事件：构造时 begin，析构时 end。name 必须是静态字符串 */
+#define CF_TRACE_SCOPE(name) ::chunfeng::trace::Scope CF_TRACE_CONCAT(cf_trace_scope_, __LINE__)(name)
+/** 成对使用的开始/结束事件，适用于无法用作用域包住的代码段 */
+#define CF_TRACE_BEGIN(name) ::chunfeng::trace::begin(name)
+#define CF_TRACE_END(name) ::chunfeng::trace::end(name)
+/** 瞬时事件 */
+#define CF_TRACE_INSTANT(name) ::chunfeng::trace::instant(name)
+/** 计数器事件（如队列深度） */
+#define CF_TRACE_COUNTER(name, value) ::chunfeng::trace::counter((name), (value))
+#else
+#define CF_TRACE_SCOPE(name) do {} while (0)
+#define CF_TRACE_BEGIN(name) do {} while (0)
+#define CF_TRACE_END(name) do {} while (0)
+#define CF_TRACE_INSTANT(name) do {} while (0)
+#define CF_TRACE_COUNTER(name, value) do {} while (0)
+#endif
+
+namespace chunfeng {
+namespace trace {
+
+constexpr size_t kMaxCores = 2;
+constexpr size_t kEventsPerCore = 4096;    ///< 每核环形缓冲事件数（2 的幂），循环覆盖
+
+/**
+ * @brief 事件类型，取值与 Chrome trace 的 ph 字段一致
+ */
+enum class Phase : uint8_t {
+    BEGIN = 'B',
+    END = 'E',
+    INSTANT = 'i',
+    COUNTER = 'C',
+};
+
+/**
+ * @brief 追踪事件（定长，16 字节 @ 32 位平台）
+ */
+struct Event {
+    uint32_t cycles;        ///< 本核周期计数器低 32 位，导出时按顺序展开为 64 位
+    const char* name;       ///< 事件名（静态字符串）
+    int32_t value;          ///< 计数器事件的值
+    uint16_t task;          ///< 任务编号
+    Phase phase;
+    uint8_t core;
+};
+
+/**
+ * @brief 开始记录（首次调用时在 PSRAM 中分配缓冲区）
+ * @return false 内存不足
+ */
+bool start();
+
+/**
+ * @brief 停止记录，已记录的数据保留，可随后导出
+ */
+void stop();
+
+/**
+ * @brief 清空已记录的数据
+ */
+void clear();
+
+/**
+ * @brief 当前是否在记录
+ */
+bool isRecording();
+
+void begin(const char* name);
+void end(const char* name);
+void instant(const char* name);
+void counter(const char* name, int32_t value);
+
+/**
+ * @brief 作用域事件辅助类
+ */
+class Scope {
+public:
+    explicit Scope(const char* name) : name_(name) { begin(name_); }
+    ~Scope() { end(name_); }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const char* name_;
+};
+
+/**
+ * @brief 导出为 Chrome trace JSON（chrome://tracing、ui.perfetto.dev 可直接打开）
+ *
+ * 导出期间暂停记录，结束后恢复原状态。
+ * @return false 输出被回调中止
+ */
+bool exportChromeJson(metrics::WriteFn fn, void* ctx);
+
+/**
+ * @brief 导出到文件（如 /storage/trace.json）
+ */
+bool dumpToFile(const char* path);
+
+} // namespace trace
+} // namespace chunfeng
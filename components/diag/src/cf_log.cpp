@@ -0,0 +1,293 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-04 10:41:56
+ * @LastEditTime: 2025-06-25 10:41:37
+ * @LastEditors: 星年
+ * @Description: 低开销结构化日志实现：记录入环、后台任务格式化输出
+ * @FilePath: \ESP32-ChunFeng\components\diag\src\cf_log.cpp
+ * @遇事不决，可问春风
+ */
+#include "cf_log.hpp"
+#include "lockfree_ring.hpp"
+#include "task_topology.hpp"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include <atomic>
+#include <cstdio>
+
+namespace chunfeng {
+namespace log {
+
+namespace {
+
+constexpr size_t kMaxSinks = 4;
+constexpr size_t kLineMax = 256;
+constexpr uint32_t kIdlePollMs = 20;
+constexpr uint32_t kParkAfterIdlePolls = 5;     ///< 连续这么多次没有日志后停止轮询，等下一条日志唤醒
+
+struct Sink {
+    SinkFn fn;
+    void* ctx;
+};
+
+struct FileSink {
+    char path[48];
+    size_t max_bytes;
+    size_t written;
+    FILE* fp;
+};
+
+LockFreeRing<Record, kRingCapacity> s_ring;
+std::atomic<uint32_t> s_dropped{0};         ///< 上次输出丢弃提示之后丢弃的条数
+std::atomic<uint32_t> s_dropped_total{0};   ///< 启动以来丢弃的总条数
+Sink s_sinks[kMaxSinks];
+std::atomic<size_t> s_sink_count{0};
+FileSink s_file_sink{};
+TaskHandle_t s_task = nullptr;
+std::atomic<bool> s_parked{false};  ///< 后台任务停止轮询，等待通知
+
+// 串口输出（控制台）
+void uartSink(const char* line, size_t len, void*) {
+    if (len == 0) {
+        fflush(stdout);
+        return;
+    }
+    fwrite(line, 1, len, stdout);
+}
+
+// 文件输出，超过上限时轮转
+void fileSink(const char* line, size_t len, void* ctx) {
+    auto* fs = static_cast<FileSink*>(ctx);
+    if (!fs->fp) return;
+    if (len == 0) {
+        fflush(fs->fp);
+        return;
+    }
+    if (fs->written + len > fs->max_bytes) {
+        char old_path[sizeof(fs->path) + 2];
+        snprintf(old_path, sizeof(old_path), "%s.1", fs->path);
+        fclose(fs->fp);
+        remove(old_path);
+        rename(fs->path, old_path);
+        fs->fp = fopen(fs->path, "w");
+        fs->written = 0;
+        if (!fs->fp) return;
+    }
+    fs->written += fwrite(line, 1, len, fs->fp);
+}
+
+// 按格式说明符输出单个参数
+int formatArg(const Record& rec, size_t idx, const char* spec, size_t spec_len, char conv,
+              char* out, size_t out_size) {
+    // spec 为 '%' 到转换字符之前的标志/宽度/精度（已去掉长度修饰）
+    char f[24];
+    if (spec_len > sizeof(f) - 4) spec_len = sizeof(f) - 4;
+    memcpy(f, spec, spec_len);
+    size_t n = spec_len;
+
+    ArgType type = rec.types[idx];
+    const auto& v = rec.values[idx];
+    switch (type) {
+        case ArgType::STRING:
+            f[n++] = 's'; f[n] = '\0';
+            return snprintf(out, out_size, f, rec.strings + v.u);
+        case ArgType::POINTER:
+            f[n++] = 'p'; f[n] = '\0';
+            return snprintf(out, out_size, f, v.p);
+        case ArgType::DOUBLE:
+            f[n++] = (conv == 'e' || conv == 'E' || conv == 'g' || conv == 'G' || conv == 'F') ? conv : 'f';
+            f[n] = '\0';
+            return snprintf(out, out_size, f, v.d);
+        case ArgType::INT:
+        case ArgType::UINT:
+        default:
+            if (conv == 'c') {
+                f[n++] = 'c'; f[n] = '\0';
+                return snprintf(out, out_size, f, static_cast<int>(v.i));
+            }
+            if (conv == 'f' || conv == 'e' || conv == 'g') {
+                f[n++] = conv; f[n] = '\0';
+                return snprintf(out, out_size, f, type == ArgType::INT ? static_cast<double>(v.i)
+                                                                       : static_cast<double>(v.u));
+            }
+            f[n++] = 'l'; f[n++] = 'l';
+            if (conv == 'x' || conv == 'X' || conv == 'o' || conv == 'u') {
+                f[n++] = conv; f[n] = '\0';
+                return snprintf(out, out_size, f, static_cast<unsigned long long>(v.u));
+            }
+            f[n++] = type == ArgType::INT ? 'd' : 'u';
+            f[n] = '\0';
+            if (type == ArgType::INT) {
+                return snprintf(out, out_size, f, static_cast<long long>(v.i));
+            }
+            return snprintf(out, out_size, f, static_cast<unsigned long long>(v.u));
+    }
+}
+
+size_t drainOnce(size_t max_records) {
+    Record rec;
+    char line[kLineMax];
+    size_t count = 0;
+    size_t sinks = s_sink_count.load(std::memory_order_acquire);
+    while (count < max_records && s_ring.tryPop(rec)) {
+        size_t len = formatRecord(rec, line, sizeof(line));
+        for (size_t i = 0; i < sinks; ++i) {
+            s_sinks[i].fn(line, len, s_sinks[i].ctx);
+        }
+        count++;
+    }
+    uint32_t dropped = s_dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped) {
+        int len = snprintf(line, sizeof(line), "W (%lld) log: %u 条日志因缓冲区满被丢弃\n",
+                           static_cast<long long>(esp_timer_get_time() / 1000), static_cast<unsigned>(dropped));
+        for (size_t i = 0; i < sinks; ++i) {
+            s_sinks[i].fn(line, len, s_sinks[i].ctx);
+        }
+    }
+    if (count || dropped) {
+        for (size_t i = 0; i < sinks; ++i) {
+            s_sinks[i].fn(nullptr, 0, s_sinks[i].ctx);  // 批次结束，刷新
+        }
+    }
+    return count;
+}
+
+// 有日志时每 kIdlePollMs 轮询一次；长时间没有日志后停止轮询，空闲时不周期唤醒 CPU（自动 light sleep）
+void logTask(void*) {
+    uint32_t idle_polls = 0;
+    while (true) {
+        if (drainOnce(kRingCapacity) > 0) {
+            idle_polls = 0;
+            continue;
+        }
+        if (++idle_polls < kParkAfterIdlePolls) {
+            vTaskDelay(pdMS_TO_TICKS(kIdlePollMs));
+            continue;
+        }
+        // 先标记再检查一次，与 commitRecord() 中的先提交再检查标记配对，不会漏掉停止前提交的日志
+        s_parked.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (drainOnce(kRingCapacity) > 0) {
+            s_parked.store(false);
+            idle_polls = 0;
+            continue;
+        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        idle_polls = 0;
+    }
+}
+
+struct DefaultSinks {
+    DefaultSinks() { addSink(uartSink, nullptr); }
+};
+DefaultSinks s_default_sinks;
+
+} // namespace
+
+namespace detail {
+
+Record* beginRecord(uint8_t level, const char* tag, const char* fmt, uint32_t& ticket) {
+    Record* rec = s_ring.reserve(ticket);
+    if (!rec) {
+        s_dropped.fetch_add(1, std::memory_order_relaxed);
+        s_dropped_total.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    rec->timestamp_us = esp_timer_get_time();
+    rec->tag = tag;
+    rec->fmt = fmt;
+    rec->level = level;
+    rec->nargs = 0;
+    rec->string_used = 0;
+    return rec;
+}
+
+void commitRecord(uint32_t ticket) {
+    s_ring.commit(ticket);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (s_parked.load(std::memory_order_relaxed) && s_parked.exchange(false)) {
+        xTaskNotifyGive(s_task);
+    }
+}
+
+} // namespace detail
+
+size_t formatRecord(const Record& rec, char* out, size_t out_size) {
+    static const char kLevelChar[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+    char level = rec.level < sizeof(kLevelChar) ? kLevelChar[rec.level] : '?';
+    int n = snprintf(out, out_size, "%c (%lld) %s: ", level,
+                     static_cast<long long>(rec.timestamp_us / 1000), rec.tag);
+    size_t pos = n > 0 ? static_cast<size_t>(n) : 0;
+    size_t arg = 0;
+    const size_t limit = out_size - 2;  // 保留换行和 '\0'
+
+    for (const char* p = rec.fmt; *p && pos < limit; ++p) {
+        if (*p != '%') {
+            out[pos++] = *p;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[pos++] = '%';
+            ++p;
+            continue;
+        }
+        // 解析 %[flags][width][.precision][length]conv
+        const char* spec = p;
+        const char* q = p + 1;
+        while (*q && strchr("-+ #0123456789.*", *q)) ++q;
+        size_t spec_len = q - spec;
+        while (*q && strchr("hlLqjzt", *q)) ++q;
+        char conv = *q;
+        if (!conv) break;
+        p = q;
+        if (arg >= rec.nargs) continue;
+        int w = formatArg(rec, arg++, spec, spec_len, conv, out + pos, limit - pos + 1);
+        if (w > 0) pos += static_cast<size_t>(w) < limit - pos ? static_cast<size_t>(w) : limit - pos;
+    }
+    if (pos > limit) pos = limit;
+    out[pos++] = '\n';
+    out[pos] = '\0';
+    return pos;
+}
+
+void start() {
+    if (s_task) return;
+    tasks::spawn(tasks::TaskId::LOG, logTask, nullptr, &s_task);
+}
+
+size_t flush() {
+    size_t total = 0;
+    size_t n;
+    while ((n = drainOnce(kRingCapacity)) > 0) {
+        total += n;
+    }
+    return total;
+}
+
+bool addSink(SinkFn fn, void* ctx) {
+    size_t idx = s_sink_count.load(std::memory_order_relaxed);
+    if (idx >= kMaxSinks) return false;
+    s_sinks[idx] = {fn, ctx};
+    s_sink_count.store(idx + 1, std::memory_order_release);
+    return true;
+}
+
+bool addFileSink(const char* path, size_t max_bytes) {
+    if (s_file_sink.fp) return false;
+    snprintf(s_file_sink.path, sizeof(s_file_sink.path), "%s", path);
+    s_file_sink.fp = fopen(path, "a");
+    if (!s_file_sink.fp) return false;
+    fseek(s_file_sink.fp, 0, SEEK_END);
+    long size = ftell(s_file_sink.fp);
+    s_file_sink.written = size > 0 ? static_cast<size_t>(size) : 0;
+    s_file_sink.max_bytes = max_bytes;
+    return addSink(fileSink, &s_file_sink);
+}
+
+uint32_t droppedCount() {
+    return s_dropped_total.load(std::memory_order_relaxed);
+}
+
+} // namespace log
+} // namespace chunfeng
@@ -0,0 +1,132 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-14 09:26:13
+ * @LastEditTime: 2025-06-14 16:48:37
+ * @LastEditors: 星年
+ * @Description: 模块间消息总线
+ * @FilePath: \ESP32-ChunFeng\components\diag\src\message_bus.cpp
+ * @遇事不决，可问春风
+ */
+#include "message_bus.hpp"
+#include "cf_log.hpp"
+#include "metrics.hpp"
+#include "esp_timer.h"
+
+namespace chunfeng {
+namespace bus {
+
+namespace {
+
+const char* TAG = "bus";
+
+// 订阅者可以是其他编译单元的静态对象，注册表只用零初始化的原子量，不依赖静态构造顺序
+std::atomic<Subscriber*> s_subscribers[kMaxSubscribers];
+std::atomic<size_t> s_reserved{0};      ///< 已占用的槽位数（槽位写入前可能短暂为空）
+std::atomic<uint32_t> s_seq[static_cast<size_t>(Topic::COUNT)];
+
+metrics::Counter s_published("chunfeng_bus_published_total", "消息总线发布的消息数");
+metrics::Counter s_dropped("chunfeng_bus_dropped_total", "订阅者队列满被丢弃的投递数");
+
+} // namespace
+
+Subscriber::Subscriber(const char* name, uint32_t topics) : name_(name), topics_(topics) {
+    size_t idx = s_reserved.fetch_add(1, std::memory_order_relaxed);
+    if (idx >= kMaxSubscribers) {
+        s_reserved.fetch_sub(1, std::memory_order_relaxed);
+        CF_LOGE(TAG, "订阅者 %s 注册失败：超过 %u 个", name, static_cast<unsigned>(kMaxSubscribers));
+        return;
+    }
+    s_subscribers[idx].store(this, std::memory_order_release);
+    registered_ = true;
+}
+
+bool Subscriber::offer(const Message& message, TaskHandle_t& wake) {
+    wake = nullptr;
+    if (!queue_.tryPush(message)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        s_dropped.inc();
+        return false;
+    }
+    // 与 receive() 中先登记等待者、再检查队列的顺序配对：两边都使用顺序一致的原子操作，
+    // 不会出现消息已入队而等待者未被唤醒
+    if (waiter_.load(std::memory_order_seq_cst) != nullptr) {
+        wake = waiter_.exchange(nullptr, std::memory_order_seq_cst);
+    }
+    return true;
+}
+
+void Subscriber::interrupt() {
+    interrupted_.store(true, std::memory_order_seq_cst);
+    TaskHandle_t task = waiter_.exchange(nullptr, std::memory_order_seq_cst);
+    if (task) xTaskNotifyGive(task);
+}
+
+bool Subscriber::receive(Message& out, uint32_t timeout_ms) {
+    if (queue_.tryPop(out)) return true;
+    if (timeout_ms == 0) return false;
+
+    const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    const bool forever = timeout_ms == portMAX_DELAY;
+    const TickType_t timeout = forever ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    const TickType_t start = xTaskGetTickCount();
+    while (true) {
+        waiter_.store(self, std::memory_order_seq_cst);
+        if (queue_.tryPop(out)) {
+            waiter_.store(nullptr, std::memory_order_relaxed);
+            return true;
+        }
+        if (interrupted_.exchange(false, std::memory_order_seq_cst)) {
+            waiter_.store(nullptr, std::memory_order_relaxed);
+            return false;
+        }
+        TickType_t wait = portMAX_DELAY;
+        if (!forever) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (elapsed >= timeout) {
+                waiter_.store(nullptr, std::memory_order_relaxed);
+                return false;
+            }
+            wait = timeout - elapsed;
+        }
+        // 唤醒也可能来自上一次等待超时后才到达的通知，回到循环开头重新检查
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+size_t publishRaw(Topic topic, const void* data, size_t size) {
+    if (topic >= Topic::COUNT || size > kPayloadSize) return 0;
+
+    Message message;
+    message.topic = topic;
+    message.size = static_cast<uint8_t>(size);
+    message.reserved = 0;
+    message.seq = s_seq[static_cast<size_t>(topic)].fetch_add(1, std::memory_order_relaxed);
+    message.time_us = esp_timer_get_time();
+    memcpy(message.payload, data, size);
+    s_published.inc();
+
+    const uint32_t bit = topicBit(topic);
+    size_t count = s_reserved.load(std::memory_order_acquire);
+    if (count > kMaxSubscribers) count = kMaxSubscribers;
+    size_t delivered = 0;
+    // 先投递给全部订阅者再统一唤醒：被唤醒的任务优先级更高时会立即抢占发布方，
+    // 边投递边唤醒会让排在后面的订阅者多等前面订阅者的处理时间
+    TaskHandle_t wake[kMaxSubscribers];
+    size_t wake_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+        Subscriber* sub = s_subscribers[i].load(std::memory_order_acquire);
+        if (!sub || !(sub->topics_ & bit)) continue;
+        TaskHandle_t task;
+        if (sub->offer(message, task)) {
+            ++delivered;
+            if (task) wake[wake_count++] = task;
+        }
+    }
+    for (size_t i = 0; i < wake_count; ++i) {
+        xTaskNotifyGive(wake[i]);
+    }
+    return delivered;
+}
+
+} // namespace bus
+} // namespace chunfeng
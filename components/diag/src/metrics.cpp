@@ -0,0 +1,181 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-05 09:52:03
+ * @LastEditTime: 2025-07-02 10:18:37
+ * @LastEditors: 星年
+ * @Description: 运行时指标注册表实现与 Prometheus 文本渲染（不依赖 ESP-IDF）
+ * @FilePath: \ESP32-ChunFeng\components\diag\src\metrics.cpp
+ * @遇事不决，可问春风
+ */
+#include "metrics.hpp"
+#include <cstdio>
+#include <cstring>
+
+namespace chunfeng {
+namespace metrics {
+
+namespace {
+
+// 常量初始化，保证其他编译单元的静态指标构造时已可用
+std::atomic<Metric*> s_metrics{nullptr};
+std::atomic<Collector*> s_collectors{nullptr};
+
+template <typename Node>
+void pushFront(std::atomic<Node*>& head, Node* node, Node*& next) {
+    Node* old = head.load(std::memory_order_relaxed);
+    do {
+        next = old;
+    } while (!head.compare_exchange_weak(old, node, std::memory_order_release, std::memory_order_relaxed));
+}
+
+const char* typeName(Metric::Type type) {
+    switch (type) {
+        case Metric::Type::COUNTER: return "counter";
+        case Metric::Type::GAUGE: return "gauge";
+        case Metric::Type::HISTOGRAM: return "histogram";
+    }
+    return "untyped";
+}
+
+bool stringWriter(const char* data, size_t len, void* ctx) {
+    static_cast<std::string*>(ctx)->append(data, len);
+    return true;
+}
+
+} // namespace
+
+Metric::Metric(const char* name, const char* help, const char* labels, Type type)
+    : name_(name), help_(help), labels_(labels), type_(type) {
+    pushFront(s_metrics, this, next_);
+}
+
+Histogram::Histogram(const char* name, const char* help, const uint32_t* bounds, size_t count,
+                     const char* labels)
+    : Metric(name, help, labels, Type::HISTOGRAM),
+      bounds_(bounds),
+      bucket_count_(count < kMaxBuckets ? count : kMaxBuckets) {}
+
+void Histogram::observe(uint32_t v) {
+    size_t i = 0;
+    while (i < bucket_count_ && v > bounds_[i]) {
+        ++i;
+    }
+    buckets_[i].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    uint32_t lo = sum_lo_.fetch_add(v, std::memory_order_relaxed);
+    if (lo + v < lo) sum_hi_.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::sum() const {
+    // 两次读到的高位相同，说明低位是同一轮的值
+    uint32_t hi, lo;
+    do {
+        hi = sum_hi_.load(std::memory_order_acquire);
+        lo = sum_lo_.load(std::memory_order_acquire);
+    } while (sum_hi_.load(std::memory_order_acquire) != hi);
+    return (static_cast<uint64_t>(hi) << 32) | lo;
+}
+
+Collector::Collector(CollectFn fn) : fn_(fn) {
+    pushFront(s_collectors, this, next_);
+}
+
+void Renderer::write(const char* data, size_t len) {
+    if (ok_ && !fn_(data, len, ctx_)) {
+        ok_ = false;
+    }
+}
+
+void Renderer::header(const char* name, const char* help, Metric::Type type) {
+    char buf[192];
+    int n = snprintf(buf, sizeof(buf), "# HELP %s %s\n# TYPE %s %s\n", name, help ? help : "", name,
+                     typeName(type));
+    if (n > 0) write(buf, static_cast<size_t>(n) < sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+void Renderer::line(const char* name, const char* suffix, const char* labels, const char* extra_label,
+                    int64_t value) {
+    char buf[192];
+    bool has_labels = labels && *labels;
+    bool has_extra = extra_label && *extra_label;
+    int n;
+    if (has_labels || has_extra) {
+        n = snprintf(buf, sizeof(buf), "%s%s{%s%s%s} %lld\n", name, suffix, has_labels ? labels : "",
+                     (has_labels && has_extra) ? "," : "", has_extra ? extra_label : "",
+                     static_cast<long long>(value));
+    } else {
+        n = snprintf(buf, sizeof(buf), "%s%s %lld\n", name, suffix, static_cast<long long>(value));
+    }
+    if (n > 0) write(buf, static_cast<size_t>(n) < sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+void Renderer::sample(const char* name, const char* help, Metric::Type type, const char* labels,
+                      int64_t value) {
+    if (help) header(name, help, type);
+    line(name, "", labels, nullptr, value);
+}
+
+void Renderer::metric(const Metric& m, bool with_header) {
+    if (with_header) header(m.name(), m.help(), m.type());
+    switch (m.type()) {
+        case Metric::Type::COUNTER:
+            line(m.name(), "", m.labels(), nullptr, static_cast<const Counter&>(m).value());
+            break;
+        case Metric::Type::GAUGE:
+            line(m.name(), "", m.labels(), nullptr, static_cast<const Gauge&>(m).value());
+            break;
+        case Metric::Type::HISTOGRAM: {
+            const auto& h = static_cast<const Histogram&>(m);
+            char le[24];
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < h.bucketCount(); ++i) {
+                cumulative += h.bucket(i);
+                snprintf(le, sizeof(le), "le=\"%u\"", static_cast<unsigned>(h.bound(i)));
+                line(m.name(), "_bucket", m.labels(), le, static_cast<int64_t>(cumulative));
+            }
+            cumulative += h.bucket(h.bucketCount());
+            line(m.name(), "_bucket", m.labels(), "le=\"+Inf\"", static_cast<int64_t>(cumulative));
+            line(m.name(), "_sum", m.labels(), nullptr, static_cast<int64_t>(h.sum()));
+            line(m.name(), "_count", m.labels(), nullptr, h.count());
+            break;
+        }
+    }
+}
+
+const Metric* first() {
+    return s_metrics.load(std::memory_order_acquire);
+}
+
+bool render(WriteFn fn, void* ctx) {
+    Renderer r(fn, ctx);
+    for (const Collector* c = s_collectors.load(std::memory_order_acquire); c && r.ok(); c = c->next()) {
+        c->fn()(r);
+    }
+    for (const Metric* m = first(); m && r.ok(); m = m->next()) {
+        // 同名指标（仅标签不同）归为一组，只输出一次 HELP/TYPE
+        bool seen = false;
+        for (const Metric* p = first(); p != m; p = p->next()) {
+            if (strcmp(p->name(), m->name()) == 0) {
+                seen = true;
+                break;
+            }
+        }
+        if (seen) continue;
+        r.metric(*m, true);
+        for (const Metric* p = m->next(); p; p = p->next()) {
+            if (strcmp(p->name(), m->name()) == 0) {
+                r.metric(*p, false);
+            }
+        }
+    }
+    return r.ok();
+}
+
+std::string renderToString() {
+    std::string out;
+    render(stringWriter, &out);
+    return out;
+}
+
+} // namespace metrics
+} // namespace chunfeng
@@ -0,0 +1,115 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-05 14:26:44
+ * @LastEditTime: 2025-06-05 17:40:51
+ * @LastEditors: 星年
+ * @Description: 系统级指标采集：各类内存堆、任务 CPU 占用与栈余量、运行时间
+ * @FilePath: \ESP32-ChunFeng\components\diag\src\metrics_system.cpp
+ * @遇事不决，可问春风
+ */
+#include "metrics.hpp"
+#include "sdkconfig.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <cstdio>
+
+namespace chunfeng {
+namespace metrics {
+
+namespace {
+
+Gauge s_uptime("chunfeng_uptime_seconds", "自启动以来的运行时间");
+
+Gauge s_heap_free_internal("chunfeng_heap_free_bytes", "各类内存当前空闲字节数", "caps=\"internal\"");
+Gauge s_heap_free_spiram("chunfeng_heap_free_bytes", "各类内存当前空闲字节数", "caps=\"spiram\"");
+Gauge s_heap_free_dma("chunfeng_heap_free_bytes", "各类内存当前空闲字节数", "caps=\"dma\"");
+
+Gauge s_heap_min_internal("chunfeng_heap_min_free_bytes", "各类内存历史最低空闲字节数", "caps=\"internal\"");
+Gauge s_heap_min_spiram("chunfeng_heap_min_free_bytes", "各类内存历史最低空闲字节数", "caps=\"spiram\"");
+
+Gauge s_heap_largest_internal("chunfeng_heap_largest_free_block_bytes", "各类内存最大连续空闲块", "caps=\"internal\"");
+Gauge s_heap_largest_spiram("chunfeng_heap_largest_free_block_bytes", "各类内存最大连续空闲块", "caps=\"spiram\"");
+
+void collectHeap(Renderer&) {
+    s_uptime.set(static_cast<int32_t>(esp_timer_get_time() / 1000000));
+
+    s_heap_free_internal.set(heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+    s_heap_free_spiram.set(heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    s_heap_free_dma.set(heap_caps_get_free_size(MALLOC_CAP_DMA));
+
+    s_heap_min_internal.set(heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+    s_heap_min_spiram.set(heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
+
+    s_heap_largest_internal.set(heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+    s_heap_largest_spiram.set(heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM));
+}
+
+Collector s_heap_collector(collectHeap);
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+
+constexpr size_t kMaxTasks = 32;
+
+// 上一次采集时各任务的累计运行时间，用于计算区间 CPU 占用
+struct TaskRuntime {
+    UBaseType_t number;
+    uint32_t runtime;
+};
+TaskRuntime s_last[kMaxTasks];
+size_t s_last_count = 0;
+uint32_t s_last_total = 0;
+
+uint32_t lastRuntime(UBaseType_t number) {
+    for (size_t i = 0; i < s_last_count; ++i) {
+        if (s_last[i].number == number) return s_last[i].runtime;
+    }
+    return 0;
+}
+
+void collectTasks(Renderer& r) {
+    static TaskStatus_t status[kMaxTasks];
+    uint32_t total = 0;
+    UBaseType_t n = uxTaskGetSystemState(status, kMaxTasks, &total);
+    // total 为墙钟时间，双核时可用的 CPU 时间是它的 portNUM_PROCESSORS 倍
+    uint32_t window = (total - s_last_total) * portNUM_PROCESSORS;
+
+    bool first = true;
+    char labels[64];
+    for (UBaseType_t i = 0; i < n; ++i) {
+        uint32_t delta = status[i].ulRunTimeCounter - lastRuntime(status[i].xTaskNumber);
+        int64_t percent = window ? static_cast<int64_t>(delta) * 100 / window : 0;
+#if CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+        int core = status[i].xCoreID == tskNO_AFFINITY ? -1 : static_cast<int>(status[i].xCoreID);
+        snprintf(labels, sizeof(labels), "task=\"%s\",core=\"%d\"", status[i].pcTaskName, core);
+#else
+        snprintf(labels, sizeof(labels), "task=\"%s\"", status[i].pcTaskName);
+#endif
+        r.sample("chunfeng_task_cpu_percent", first ? "任务在两次采集之间的 CPU 占用百分比" : nullptr,
+                 Metric::Type::GAUGE, labels, percent);
+        first = false;
+    }
+    first = true;
+    for (UBaseType_t i = 0; i < n; ++i) {
+        snprintf(labels, sizeof(labels), "task=\"%s\"", status[i].pcTaskName);
+        r.sample("chunfeng_task_stack_free_min_bytes", first ? "任务栈历史最小剩余字节数" : nullptr,
+                 Metric::Type::GAUGE, labels, status[i].usStackHighWaterMark);
+        first = false;
+    }
+
+    s_last_count = n < kMaxTasks ? n : kMaxTasks;
+    for (size_t i = 0; i < s_last_count; ++i) {
+        s_last[i] = {status[i].xTaskNumber, status[i].ulRunTimeCounter};
+    }
+    s_last_total = total;
+}
+
+Collector s_task_collector(collectTasks);
+
+#endif
+
+} // namespace
+
+} // namespace metrics
+} // namespace chunfeng
@@ -0,0 +1,103 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-18 09:40:06
+ * @LastEditTime: 2025-07-02 14:26:08
+ * @LastEditors: 星年
+ * @Description: 系统状态快照
+ * @FilePath: \ESP32-ChunFeng\components\diag\src\status_board.cpp
+ * @遇事不决，可问春风
+ */
+#include "status_board.hpp"
+#include "seqlock.hpp"
+#include "metrics.hpp"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include <cstdio>
+#include <cstring>
+
+namespace chunfeng {
+namespace status {
+
+namespace {
+
+// 每个分区一把顺序锁：写入方只写自己的分区，互不等待
+SeqLock<NetworkStatus> s_network;
+SeqLock<AudioStatus> s_audio;
+SeqLock<CozeStatus> s_coze;
+SeqLock<PowerStatus> s_power;
+SeqLock<SettingsStatus> s_settings;
+
+metrics::Counter s_reads("chunfeng_status_reads_total", "状态快照读取次数");
+metrics::Counter s_retries("chunfeng_status_read_retries_total", "读取状态快照时与写入冲突的重试次数");
+
+} // namespace
+
+void updateNetwork(const NetworkStatus& value) {
+    s_network.write(value);
+}
+
+void updateAudio(const AudioStatus& value) {
+    s_audio.write(value);
+}
+
+void updateCoze(const CozeStatus& value) {
+    s_coze.write(value);
+}
+
+void updatePower(const PowerStatus& value) {
+    s_power.write(value);
+}
+
+void updateSettings(const SettingsStatus& value) {
+    s_settings.write(value);
+}
+
+void read(Snapshot& out) {
+    uint32_t retries = s_network.read(out.network);
+    retries += s_audio.read(out.audio);
+    retries += s_coze.read(out.coze);
+    retries += s_power.read(out.power);
+    retries += s_settings.read(out.settings);
+    out.system.uptime_s = static_cast<uint32_t>(esp_timer_get_time() / 1000000);
+    out.system.free_internal = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    out.system.min_free_internal = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+    out.system.largest_internal = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+    out.system.free_spiram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    s_reads.inc();
+    if (retries) s_retries.inc(retries);
+}
+
+size_t formatJson(const Snapshot& s, char* buf, size_t size) {
+    int n = snprintf(buf, size,
+                     "{\"uptime\":%u,"
+                     "\"net\":{\"state\":%u,\"link\":%u,\"rssi\":%d,\"ch\":%u,\"since\":%u,\"changes\":%u},"
+                     "\"audio\":{\"playing\":%u,\"level\":%u,\"frames\":%u,\"underruns\":%u},"
+                     "\"coze\":{\"state\":%u,\"turns\":%u,\"latency\":%u},"
+                     "\"power\":{\"mode\":%u,\"wifi_ps\":%u,\"wifi_ps_err\":%d,\"wifi_ps_failures\":%u},"
+                     "\"settings\":{\"version\":%u,\"pending\":%u,\"last\":%u,\"err\":%d},"
+                     "\"heap\":{\"free\":%u,\"min\":%u,\"largest\":%u,\"psram\":%u}}",
+                     static_cast<unsigned>(s.system.uptime_s), s.network.state, s.network.link, s.network.rssi,
+                     s.network.channel, static_cast<unsigned>(s.network.state_since_ms),
+                     static_cast<unsigned>(s.network.transitions), s.audio.playing, s.audio.level,
+                     static_cast<unsigned>(s.audio.frames), static_cast<unsigned>(s.audio.underruns), s.coze.state,
+                     static_cast<unsigned>(s.coze.turns), static_cast<unsigned>(s.coze.last_latency_ms),
+                     s.power.mode, s.power.wifi_ps, static_cast<int>(s.power.wifi_ps_error),
+                     static_cast<unsigned>(s.power.wifi_ps_failures), static_cast<unsigned>(s.settings.version),
+                     static_cast<unsigned>(s.settings.pending), static_cast<unsigned>(s.settings.last),
+                     static_cast<int>(s.settings.last_error),
+                     static_cast<unsigned>(s.system.free_internal), static_cast<unsigned>(s.system.min_free_internal),
+                     static_cast<unsigned>(s.system.largest_internal), static_cast<unsigned>(s.system.free_spiram));
+    if (n < 0 || static_cast<size_t>(n) >= size) return 0;
+    return static_cast<size_t>(n);
+}
+
+size_t formatBinary(const Snapshot& snapshot, uint8_t* buf, size_t size) {
+    if (size < kBinarySize) return 0;
+    BinaryHeader header = {{'C', 'F', 'S', 'T'}, kBinaryVersion, 0, static_cast<uint16_t>(sizeof(Snapshot))};
+    memcpy(buf, &header, sizeof(header));
+    memcpy(buf + sizeof(header), &snapshot, sizeof(snapshot));
+    return kBinarySize;
+}
+
+} // namespace status
+} // namespace chunfeng
@@ -0,0 +1,317 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-13 09:52:16
+ * @LastEditTime: 2025-06-25 10:41:37
+ * @LastEditors: 星年
+ * @Description: 任务拓扑表、按表创建任务、表检查与运行报告
+ * @FilePath: \ESP32-ChunFeng\components\diag\src\task_topology.cpp
+ * @遇事不决，可问春风
+ */
+#include "task_topology.hpp"
+#include "cf_log.hpp"
+#include "sdkconfig.h"
+#include "esp_heap_caps.h"
+#include "freertos/idf_additions.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+namespace chunfeng {
+namespace tasks {
+
+static const char* TAG = "Tasks";
+
+/*
+ * 核心分配：
+ * - 核心 0：WiFi 驱动、lwIP、esp_timer 以及所有联网任务（网络状态机、DNS、HTTP、云端会话、后台上报）
+ * - 核心 1：音频链路（采集 > 播放 > DSP > 编解码，优先级依次降低）与屏幕刷新
+ * 音频各级之间用队列衔接，下游等待上游时上游优先级更高，不会被同核的其他任务卡住。
+ * 会读写 Flash 的任务（NVS、SPIFFS）栈放内部 RAM，其余大栈任务放 PSRAM。
+ */
+
+#if CONFIG_ESP_WIFI_TASK_PINNED_TO_CORE_0
+#define WIFI_TASK_CORE 0
+#else
+#define WIFI_TASK_CORE 1
+#endif
+
+#if CONFIG_LWIP_TCPIP_TASK_AFFINITY_CPU0
+#define TCPIP_TASK_CORE 0
+#elif CONFIG_LWIP_TCPIP_TASK_AFFINITY_CPU1
+#define TCPIP_TASK_CORE 1
+#else
+#define TCPIP_TASK_CORE kAnyCore
+#endif
+
+#if CONFIG_ESP_TIMER_TASK_AFFINITY_CPU0
+#define TIMER_TASK_CORE 0
+#elif CONFIG_ESP_TIMER_TASK_AFFINITY_CPU1
+#define TIMER_TASK_CORE 1
+#else
+#define TIMER_TASK_CORE kAnyCore
+#endif
+
+#if CONFIG_ESP_MAIN_TASK_AFFINITY_CPU0
+#define MAIN_TASK_CORE 0
+#elif CONFIG_ESP_MAIN_TASK_AFFINITY_CPU1
+#define MAIN_TASK_CORE 1
+#else
+#define MAIN_TASK_CORE kAnyCore
+#endif
+
+// clang-format off
+static const TaskSpec kTable[] = {
+    // id                    名称           核心 优先级 栈      栈内存             周期ms 预算us  标志
+    {TaskId::NETWORK,       "net_mgr",      0,  5,  6144,  StackMem::INTERNAL, 1000,  2000, kFlashAccess, 0},
+    {TaskId::DNS_REFRESH,   "dns_refresh",  0,  3,  6144,  StackMem::INTERNAL, 1000,  3000, kFlashAccess,
+     dependsOn(TaskId::SYS_TCPIP)},
+    {TaskId::HTTPD,         "httpd",        0,  5,  4096,  StackMem::INTERNAL,  100,  2000, kFlashAccess,
+     dependsOn(TaskId::SYS_TCPIP)},
+    {TaskId::LOG,           "cf_log",       0,  1,  3072,  StackMem::INTERNAL,   20,   200, kFlashAccess, 0},
+    {TaskId::AUDIO_CAPTURE, "audio_in",     1, 20,  4096,  StackMem::INTERNAL,   20,   800, 0, 0},
+    {TaskId::AUDIO_DSP,     "audio_dsp",    1, 18,  8192,  StackMem::INTERNAL,   20,  6000, 0,
+     dependsOn(TaskId::AUDIO_CAPTURE)},
+    {TaskId::AUDIO_CODEC,   "audio_codec",  1, 16, 24576,  StackMem::SPIRAM,     60, 12000, 0,
+     dependsOn(TaskId::AUDIO_DSP)},
+    // 播放从抖动缓冲取数据，缓冲为空时补静音，不阻塞等待解码；预算含每帧 300us 的播放分析
+    {TaskId::AUDIO_PLAY,    "audio_out",    1, 19,  4096,  StackMem::INTERNAL,   20,   900, 0, 0},
+    {TaskId::COZE_SESSION,  "coze",         0,  7,  8192,  StackMem::SPIRAM,     60,  3000, 0,
+     dependsOn(TaskId::AUDIO_CODEC) | dependsOn(TaskId::SYS_TCPIP)},
+    // 播放时每帧（20ms）按音频输出时间刷新一次口型与电平条
+    {TaskId::DISPLAY,       "display",      1,  4,  4096,  StackMem::INTERNAL,   20,  2500, kFlashAccess, 0},
+    {TaskId::BACKEND,       "backend",      0,  3,  6144,  StackMem::SPIRAM,   1000,  3000, 0,
+     dependsOn(TaskId::SYS_TCPIP)},
+    // 升级包边收边写 Flash；优先级低于所有常驻任务，下载与解包只用空闲 CPU
+    {TaskId::OTA,           "ota",          0,  2,  8192,  StackMem::INTERNAL,  100,  5000, kFlashAccess,
+     dependsOn(TaskId::SYS_TCPIP)},
+    // 断网时写入录下的语音（每秒约 2KB，偶尔擦除一个扇区），联网后补传；上传函数在本任务中执行
+    {TaskId::SPOOL,         "spool",        0,  3,  6144,  StackMem::INTERNAL, 1000,  5000, kFlashAccess,
+     dependsOn(TaskId::SYS_TCPIP)},
+    // 只在系统状态变化与空闲计时到期时醒来切换电源模式；唤醒时由调用方同步恢复全速，不经过本任务
+    {TaskId::POWER,         "power",        0,  8,  3072,  StackMem::INTERNAL, 60000,  200, 0, 0},
+    // 开机阶段（挂载、NVS、WiFi 初始化）在这两个任务中并行运行，app_main 等待它们完成；栈不小于主任务
+    {TaskId::BOOT_0,        "boot0",        0,  6,  4096,  StackMem::INTERNAL, 60000, 1000, kFlashAccess, 0},
+    {TaskId::BOOT_1,        "boot1",        1,  6,  4096,  StackMem::INTERNAL, 60000, 1000, kFlashAccess, 0},
+    {TaskId::MAIN,          "main",         MAIN_TASK_CORE, 1, CONFIG_ESP_MAIN_TASK_STACK_SIZE,
+     StackMem::INTERNAL, 60000, 20000, kSystem | kFlashAccess, 0},
+    // 以下由 ESP-IDF 创建，负载为估计值
+    {TaskId::SYS_WIFI,      "wifi",         WIFI_TASK_CORE, 23, 6656,
+     StackMem::INTERNAL,   10,  1500, kSystem, 0},
+    {TaskId::SYS_TCPIP,     "tiT",          TCPIP_TASK_CORE, CONFIG_LWIP_TCPIP_TASK_PRIO,
+     CONFIG_LWIP_TCPIP_TASK_STACK_SIZE, StackMem::INTERNAL, 10, 800, kSystem, 0},
+    {TaskId::SYS_TIMER,     "esp_timer",    TIMER_TASK_CORE, 22, CONFIG_ESP_TIMER_TASK_STACK_SIZE,
+     StackMem::INTERNAL,   10,   100, kSystem, 0},
+};
+// clang-format on
+
+static_assert(sizeof(kTable) / sizeof(kTable[0]) == static_cast<size_t>(TaskId::COUNT), "任务表与 TaskId 不一致");
+
+static constexpr size_t kCount = static_cast<size_t>(TaskId::COUNT);
+
+static std::atomic<TaskHandle_t> s_handles[kCount];
+
+const TaskSpec* table(size_t* count) {
+    if (count) *count = kCount;
+    return kTable;
+}
+
+const TaskSpec& spec(TaskId id) {
+    return kTable[static_cast<size_t>(id)];
+}
+
+BaseType_t spawn(TaskId id, TaskFunction_t fn, void* arg, TaskHandle_t* handle) {
+    const TaskSpec& s = spec(id);
+    TaskHandle_t h = nullptr;
+    BaseType_t rc = pdFAIL;
+    if (!(s.flags & kSystem)) {
+        BaseType_t core = s.core == kAnyCore ? tskNO_AFFINITY : s.core;
+        if (s.stack_mem == StackMem::SPIRAM) {
+            rc = xTaskCreatePinnedToCoreWithCaps(fn, s.name, s.stack_bytes, arg, s.priority, &h, core,
+                                                 MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        } else {
+            rc = xTaskCreatePinnedToCore(fn, s.name, s.stack_bytes, arg, s.priority, &h, core);
+        }
+    }
+    if (rc == pdPASS) {
+        s_handles[static_cast<size_t>(id)].store(h);
+    } else {
+        CF_LOGE(TAG, "创建任务 %s 失败", s.name);
+    }
+    if (handle) *handle = h;
+    return rc;
+}
+
+void adopt(TaskId id, TaskHandle_t handle) {
+    s_handles[static_cast<size_t>(id)].store(handle);
+}
+
+TaskHandle_t handle(TaskId id) {
+    return s_handles[static_cast<size_t>(id)].load();
+}
+
+/* ---------- 表检查 ---------- */
+
+/**
+ * @brief 万分比表示的 CPU 负载（相对单个核心）
+ */
+static uint32_t loadBasisPoints(const TaskSpec& s) {
+    if (s.period_ms == 0) return 0;
+    return static_cast<uint32_t>(static_cast<uint64_t>(s.budget_us) * 10 / s.period_ms);
+}
+
+static bool sameCore(int8_t a, int8_t b) {
+    return a == kAnyCore || b == kAnyCore || a == b;
+}
+
+size_t validate(void (*out)(const char* message)) {
+    size_t issues = 0;
+    char msg[160];
+    auto issue = [&](int n) {
+        if (n > 0 && out) out(msg);
+        ++issues;
+    };
+
+    size_t internal = 0, spiram = 0;
+    uint32_t load[2] = {0, 0};
+    uint32_t load_any = 0;
+
+    for (size_t i = 0; i < kCount; ++i) {
+        const TaskSpec& t = kTable[i];
+        if (static_cast<size_t>(t.id) != i) {
+            issue(snprintf(msg, sizeof(msg), "%s: 表中位置与 TaskId 不一致", t.name));
+        }
+        if (strlen(t.name) >= CONFIG_FREERTOS_MAX_TASK_NAME_LEN) {
+            issue(snprintf(msg, sizeof(msg), "%s: 名称超过 %d 字节会被截断", t.name,
+                           CONFIG_FREERTOS_MAX_TASK_NAME_LEN - 1));
+        }
+        if (t.priority >= configMAX_PRIORITIES) {
+            issue(snprintf(msg, sizeof(msg), "%s: 优先级 %u 超出范围", t.name, t.priority));
+        }
+        if (t.core != kAnyCore && (t.core < 0 || t.core >= portNUM_PROCESSORS)) {
+            issue(snprintf(msg, sizeof(msg), "%s: 核心 %d 不存在", t.name, t.core));
+        }
+        for (size_t j = 0; j < i; ++j) {
+            if (strcmp(kTable[j].name, t.name) == 0) {
+                issue(snprintf(msg, sizeof(msg), "%s: 名称重复", t.name));
+            }
+        }
+        if (t.stack_mem == StackMem::SPIRAM) {
+            if (t.flags & kFlashAccess) {
+                issue(snprintf(msg, sizeof(msg), "%s: 读写 Flash 的任务栈不能放在 PSRAM", t.name));
+            }
+#if !CONFIG_SPIRAM_ALLOW_STACK_EXTERNAL_MEMORY
+            issue(snprintf(msg, sizeof(msg), "%s: 未开启 CONFIG_SPIRAM_ALLOW_STACK_EXTERNAL_MEMORY", t.name));
+#endif
+        }
+        if (t.depends & dependsOn(t.id)) {
+            issue(snprintf(msg, sizeof(msg), "%s: 依赖自身", t.name));
+        }
+
+        if (!(t.flags & kSystem)) {
+            (t.stack_mem == StackMem::SPIRAM ? spiram : internal) += t.stack_bytes;
+        }
+        uint32_t bp = loadBasisPoints(t);
+        if (t.core == kAnyCore) {
+            load_any += bp;
+        } else if (t.core >= 0 && t.core < 2) {
+            load[t.core] += bp;
+        }
+    }
+
+    // 优先级反转：T 等待低优先级的 D 时，与 D 同核、优先级介于两者之间的 M 可以一直抢占 D，T 被间接阻塞
+    for (const TaskSpec& t : kTable) {
+        for (const TaskSpec& d : kTable) {
+            if (!(t.depends & dependsOn(d.id)) || d.priority >= t.priority) continue;
+            for (const TaskSpec& m : kTable) {
+                if (&m == &t || &m == &d) continue;
+                if (m.priority > d.priority && m.priority < t.priority && sameCore(m.core, d.core)) {
+                    issue(snprintf(msg, sizeof(msg), "优先级反转: %s(%u) 等待 %s(%u)，%s(%u) 可抢占 %s", t.name,
+                                   t.priority, d.name, d.priority, m.name, m.priority, d.name));
+                }
+            }
+        }
+    }
+
+    // CPU 预算：固定核心的任务分别计入，不固定核心的任务与两核总余量比较
+    uint32_t limit = kCoreLoadLimitPercent * 100;
+    for (int c = 0; c < 2; ++c) {
+        if (load[c] > limit) {
+            issue(snprintf(msg, sizeof(msg), "核心 %d 预算负载 %u.%02u%% 超过 %u%%", c, load[c] / 100,
+                           load[c] % 100, kCoreLoadLimitPercent));
+        }
+    }
+    if (load[0] + load[1] + load_any > 2 * limit) {
+        issue(snprintf(msg, sizeof(msg), "两核合计预算负载 %u.%02u%% 超过 %u%%", (load[0] + load[1] + load_any) / 100,
+                       (load[0] + load[1] + load_any) % 100, 2 * kCoreLoadLimitPercent));
+    }
+
+    if (internal > kInternalStackBudget) {
+        issue(snprintf(msg, sizeof(msg), "内部 RAM 任务栈合计 %u 字节超过预算 %u", static_cast<unsigned>(internal),
+                       static_cast<unsigned>(kInternalStackBudget)));
+    }
+    if (spiram > kSpiramStackBudget) {
+        issue(snprintf(msg, sizeof(msg), "PSRAM 任务栈合计 %u 字节超过预算 %u", static_cast<unsigned>(spiram),
+                       static_cast<unsigned>(kSpiramStackBudget)));
+    }
+    return issues;
+}
+
+/* ---------- 运行报告 ---------- */
+
+void logReport() {
+    static uint32_t s_last_runtime[kCount];
+    static uint32_t s_last_total = 0;
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    constexpr size_t kMaxTasks = 32;
+    static TaskStatus_t status[kMaxTasks];
+    uint32_t total = 0;
+    UBaseType_t n = uxTaskGetSystemState(status, kMaxTasks, &total);
+    uint32_t window = total - s_last_total;
+#else
+    UBaseType_t n = 0;
+    uint32_t total = 0;
+    uint32_t window = 0;
+#endif
+
+    for (size_t i = 0; i < kCount; ++i) {
+        TaskHandle_t h = s_handles[i].load();
+        if (!h) continue;
+        const TaskSpec& s = kTable[i];
+
+        unsigned free_bytes = uxTaskGetStackHighWaterMark(h);
+        uint32_t free_percent = s.stack_bytes ? free_bytes * 100 / s.stack_bytes : 0;
+
+        // 相对单个核心的占用（万分比），与 budget_us / period_ms 同一口径
+        uint32_t cpu_bp = 0;
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        for (UBaseType_t k = 0; k < n; ++k) {
+            if (status[k].xHandle != h) continue;
+            uint32_t delta = status[k].ulRunTimeCounter - s_last_runtime[i];
+            s_last_runtime[i] = status[k].ulRunTimeCounter;
+            if (window && s_last_total) cpu_bp = static_cast<uint32_t>(static_cast<uint64_t>(delta) * 10000 / window);
+            break;
+        }
+#endif
+        uint32_t budget_bp = loadBasisPoints(s);
+        bool stack_low = free_percent < 10;
+        bool over_budget = s_last_total && cpu_bp > budget_bp;
+        unsigned stack = s.stack_bytes;
+        double cpu = cpu_bp / 100.0;
+        double budget = budget_bp / 100.0;
+        if (stack_low) {
+            CF_LOGW(TAG, "%s 栈余量不足: 剩余 %u/%u 字节，CPU %.2f%%（预算 %.2f%%）", s.name, free_bytes, stack, cpu,
+                    budget);
+        } else if (over_budget) {
+            CF_LOGW(TAG, "%s 超出 CPU 预算: 栈剩余 %u/%u 字节，CPU %.2f%%（预算 %.2f%%）", s.name, free_bytes, stack,
+                    cpu, budget);
+        } else {
+            CF_LOGI(TAG, "%s 栈剩余 %u/%u 字节，CPU %.2f%%（预算 %.2f%%）", s.name, free_bytes, stack, cpu, budget);
+        }
+    }
+    (void)n;
+    s_last_total = total;
+}
+
+} // namespace tasks
+} // namespace chunfeng
@@ -0,0 +1,251 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-06 10:02:48
+ * @LastEditTime: 2025-07-02 11:02:15
+ * @LastEditors: 星年
+ * @Description: 热路径追踪实现
+ * @FilePath: \ESP32-ChunFeng\components\diag\src\trace.cpp
+ * @遇事不决，可问春风
+ */
+#include "trace.hpp"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+namespace chunfeng {
+namespace trace {
+
+namespace {
+
+constexpr uint32_t kMask = kEventsPerCore - 1;
+static_assert((kEventsPerCore & kMask) == 0, "kEventsPerCore 必须为 2 的幂");
+
+constexpr size_t kMaxTaskNames = 64;
+constexpr size_t kTaskNameLen = 16;
+
+/**
+ * 每核时间锚点：(周期计数, esp_timer 微秒)，记录时每秒刷新一次。
+ * S3 两个核的周期计数器互不同步，导出时各核分别以自己的锚点换算到 esp_timer 时间轴。
+ * 刷新在 record() 屏蔽本核中断时进行，导出方可能在另一个核上读取，用序号做简单的 seqlock。
+ */
+struct Anchor {
+    std::atomic<uint32_t> seq{0};
+    uint32_t cycles{0};
+    int64_t us{0};
+};
+
+Event* s_buffers[kMaxCores] = {};
+std::atomic<uint32_t> s_index[kMaxCores] = {};
+Anchor s_anchor[kMaxCores];
+std::atomic<bool> s_recording{false};
+uint32_t s_ticks_per_us = 1;
+
+// 任务编号 -> 任务名（0 未登记，1 写入中，2 可读）
+std::atomic<uint8_t> s_task_state[kMaxTaskNames] = {};
+char s_task_names[kMaxTaskNames][kTaskNameLen];
+// 下一个分配的任务编号：uxTaskNumber 只有 vTaskSetTaskNumber() 设置过才非 0，
+// 第一次记录时给当前任务分配（只有任务自己会设置自己的编号，不会重复分配）
+std::atomic<uint16_t> s_next_task{1};
+
+uint16_t taskNumber(TaskHandle_t handle) {
+    UBaseType_t number = uxTaskGetTaskNumber(handle);
+    if (number == 0) {
+        number = s_next_task.fetch_add(1, std::memory_order_relaxed);
+        vTaskSetTaskNumber(handle, number);
+    }
+    return static_cast<uint16_t>(number);
+}
+
+void noteTask(uint16_t task, TaskHandle_t handle) {
+    if (task >= kMaxTaskNames) return;
+    if (s_task_state[task].load(std::memory_order_acquire) != 0) return;
+    uint8_t expected = 0;
+    if (!s_task_state[task].compare_exchange_strong(expected, 1, std::memory_order_acq_rel)) return;
+    const char* name = pcTaskGetName(handle);
+    snprintf(s_task_names[task], kTaskNameLen, "%s", name ? name : "?");
+    s_task_state[task].store(2, std::memory_order_release);
+}
+
+void refreshAnchor(uint8_t core, uint32_t cycles) {
+    Anchor& a = s_anchor[core];
+    uint32_t seq = a.seq.load(std::memory_order_relaxed);
+    if (seq != 0 && static_cast<int32_t>(cycles - a.cycles) < static_cast<int32_t>(s_ticks_per_us * 1000000)) {
+        return;
+    }
+    if (seq & 1) return;  // 锚点只由本核在屏蔽中断时刷新，不会出现；防御
+    if (!a.seq.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire)) return;
+    a.cycles = esp_cpu_get_cycle_count();
+    a.us = esp_timer_get_time();
+    a.seq.store(seq + 2, std::memory_order_release);
+}
+
+void record(Phase phase, const char* name, int32_t value) {
+    if (!s_recording.load(std::memory_order_relaxed)) return;
+    // 周期计数、核号与锚点在屏蔽本核中断时读取：不绑核的任务在两者之间被换到另一个核，
+    // 就会用这个核的锚点换算另一个核的周期计数
+    UBaseType_t irq = portSET_INTERRUPT_MASK_FROM_ISR();
+    uint32_t cycles = esp_cpu_get_cycle_count();
+    uint8_t core = static_cast<uint8_t>(xPortGetCoreID()) % kMaxCores;
+    refreshAnchor(core, cycles);
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(irq);
+    TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+    uint16_t task = taskNumber(handle);
+    noteTask(task, handle);
+
+    uint32_t idx = s_index[core].fetch_add(1, std::memory_order_relaxed);
+    Event& e = s_buffers[core][idx & kMask];
+    e.cycles = cycles;
+    e.name = name;
+    e.value = value;
+    e.task = task;
+    e.phase = phase;
+    e.core = core;
+}
+
+struct Output {
+    metrics::WriteFn fn;
+    void* ctx;
+    bool ok;
+    bool first;
+
+    void raw(const char* s, size_t len) {
+        if (ok && !fn(s, len, ctx)) ok = false;
+    }
+
+    void event(const char* buf, int n, size_t cap) {
+        if (n <= 0) return;
+        if (!first) raw(",\n", 2);
+        first = false;
+        raw(buf, static_cast<size_t>(n) < cap ? n : cap - 1);
+    }
+};
+
+void exportCore(Output& out, size_t core) {
+    const Event* buf = s_buffers[core];
+    uint32_t end = s_index[core].load(std::memory_order_acquire);
+    uint32_t count = end < kEventsPerCore ? end : kEventsPerCore;
+    if (!buf || count == 0) return;
+
+    uint32_t anchor_cycles;
+    int64_t anchor_us;
+    uint32_t seq;
+    do {
+        seq = s_anchor[core].seq.load(std::memory_order_acquire);
+        anchor_cycles = s_anchor[core].cycles;
+        anchor_us = s_anchor[core].us;
+    } while ((seq & 1) || seq != s_anchor[core].seq.load(std::memory_order_acquire));
+
+    // 从最新事件向前展开 32 位周期计数：相邻事件间隔小于约 8.9 秒（240MHz）即可正确处理回绕
+    char line[192];
+    int64_t rel = 0;
+    uint32_t prev = anchor_cycles;
+    for (uint32_t i = 0; i < count && out.ok; ++i) {
+        const Event& e = buf[(end - 1 - i) & kMask];
+        rel += static_cast<int32_t>(e.cycles - prev);
+        prev = e.cycles;
+        double ts = static_cast<double>(anchor_us) + static_cast<double>(rel) / s_ticks_per_us;
+        int n;
+        switch (e.phase) {
+            case Phase::COUNTER:
+                n = snprintf(line, sizeof(line),
+                             "{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"value\":%d}}",
+                             e.name, ts, e.task, static_cast<int>(e.value));
+                break;
+            case Phase::INSTANT:
+                n = snprintf(line, sizeof(line),
+                             "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"core\":%u}}",
+                             e.name, ts, e.task, e.core);
+                break;
+            default:
+                n = snprintf(line, sizeof(line),
+                             "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"core\":%u}}",
+                             e.name, static_cast<char>(e.phase), ts, e.task, e.core);
+                break;
+        }
+        out.event(line, n, sizeof(line));
+    }
+}
+
+bool fileWriter(const char* data, size_t len, void* ctx) {
+    return fwrite(data, 1, len, static_cast<FILE*>(ctx)) == len;
+}
+
+} // namespace
+
+bool start() {
+    s_ticks_per_us = esp_rom_get_cpu_ticks_per_us();
+    if (s_ticks_per_us == 0) s_ticks_per_us = 1;
+    for (size_t i = 0; i < kMaxCores; ++i) {
+        if (s_buffers[i]) continue;
+        // 优先放在 PSRAM，追踪缓冲不需要内部 RAM 的速度
+        void* mem = heap_caps_malloc(sizeof(Event) * kEventsPerCore, MALLOC_CAP_SPIRAM);
+        if (!mem) mem = heap_caps_malloc(sizeof(Event) * kEventsPerCore, MALLOC_CAP_DEFAULT);
+        if (!mem) return false;
+        s_buffers[i] = static_cast<Event*>(mem);
+    }
+    s_recording.store(true, std::memory_order_release);
+    return true;
+}
+
+void stop() {
+    s_recording.store(false, std::memory_order_release);
+}
+
+void clear() {
+    bool was = s_recording.exchange(false);
+    for (size_t i = 0; i < kMaxCores; ++i) {
+        s_index[i].store(0, std::memory_order_relaxed);
+    }
+    s_recording.store(was);
+}
+
+bool isRecording() {
+    return s_recording.load(std::memory_order_relaxed);
+}
+
+void begin(const char* name) { record(Phase::BEGIN, name, 0); }
+void end(const char* name) { record(Phase::END, name, 0); }
+void instant(const char* name) { record(Phase::INSTANT, name, 0); }
+void counter(const char* name, int32_t value) { record(Phase::COUNTER, name, value); }
+
+bool exportChromeJson(metrics::WriteFn fn, void* ctx) {
+    bool was = s_recording.exchange(false);
+    Output out{fn, ctx, true, true};
+    static const char kHead[] = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out.raw(kHead, sizeof(kHead) - 1);
+
+    char line[128];
+    int n = snprintf(line, sizeof(line),
+                     "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"ChunFeng\"}}");
+    out.event(line, n, sizeof(line));
+    for (size_t t = 0; t < kMaxTaskNames; ++t) {
+        if (s_task_state[t].load(std::memory_order_acquire) != 2) continue;
+        n = snprintf(line, sizeof(line),
+                     "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                     static_cast<unsigned>(t), s_task_names[t]);
+        out.event(line, n, sizeof(line));
+    }
+    for (size_t core = 0; core < kMaxCores && out.ok; ++core) {
+        exportCore(out, core);
+    }
+    out.raw("\n]}\n", 4);
+    s_recording.store(was, std::memory_order_release);
+    return out.ok;
+}
+
+bool dumpToFile(const char* path) {
+    FILE* fp = fopen(path, "w");
+    if (!fp) return false;
+    bool ok = exportChromeJson(fileWriter, fp);
+    fclose(fp);
+    return ok;
+}
+
+} // namespace trace
+} // namespace chunfeng
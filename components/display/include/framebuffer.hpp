@@ -0,0 +1,109 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-16 10:05:31
+ * @LastEditTime: 2025-06-16 16:31:08
+ * @LastEditors: 星年
+ * @Description: PSRAM 帧缓冲：RGB565 像素与按 16x16 图块记录的脏区域，只有像素真正变化的图块才会被推送到屏幕
+ * @FilePath: \ESP32-ChunFeng\components\display\include\framebuffer.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+
+namespace chunfeng {
+
+/**
+ * @brief 矩形区域（像素）
+ */
+struct Rect {
+    int16_t x{0};
+    int16_t y{0};
+    int16_t w{0};
+    int16_t h{0};
+
+    bool empty() const { return w <= 0 || h <= 0; }
+    int32_t area() const { return static_cast<int32_t>(w) * h; }
+};
+
+/**
+ * @brief RGB565 颜色
+ */
+constexpr uint16_t rgb565(uint8_t r, uint8_t g, uint8_t b) {
+    return static_cast<uint16_t>((r & 0xf8) << 8 | (g & 0xfc) << 3 | b >> 3);
+}
+
+/**
+ * @brief 帧缓冲
+ *
+ * 像素放在 PSRAM，脏标记按 kTile x kTile 的图块存放在对象内（每行图块一个 32 位掩码）。
+ * 写入接口先与原像素比较，只有内容变化的图块才标记为脏，
+ * 因此整块重绘一个控件也只会推送文字实际变化的部分。非线程安全，由显示任务独占使用。
+ */
+class Framebuffer {
+public:
+    static constexpr int kTile = 16;
+    static constexpr int kMaxTiles = 32;    ///< 每个方向最多的图块数，宽高上限 512 像素
+
+    Framebuffer() = default;
+    ~Framebuffer();
+
+    Framebuffer(const Framebuffer&) = delete;
+    Framebuffer& operator=(const Framebuffer&) = delete;
+
+    /**
+     * @brief 分配像素内存（优先 PSRAM），初始为黑色且整屏为脏
+     */
+    esp_err_t init(int width, int height);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    /**
+     * @brief 第 y 行像素
+     */
+    const uint16_t* row(int y) const { return pixels_ + static_cast<size_t>(y) * width_; }
+
+    /**
+     * @brief 填充矩形
+     */
+    void fill(const Rect& rect, uint16_t color);
+
+    /**
+     * @brief 把 src 中 rect 大小的像素写到 rect 位置，只标记内容变化的图块
+     * @param stride src 每行的像素数
+     */
+    void blit(const Rect& rect, const uint16_t* src, int stride);
+
+    /**
+     * @brief 强制标记区域为脏（屏幕内容未知时，如初始化或唤醒后）
+     */
+    void invalidate(const Rect& rect);
+    void invalidateAll();
+
+    bool dirty() const;
+
+    /**
+     * @brief 取出并清空脏区域
+     *
+     * 每行图块中连续的脏图块合成一段，与上一行位置相同的段向下合并为矩形；
+     * 矩形数超过 max 时并入面积增长最小的矩形。
+     * @return 矩形数
+     */
+    size_t takeDirty(Rect* out, size_t max);
+
+private:
+    bool clip(Rect& rect) const;
+    void markTiles(int x0, int y0, int x1, int y1);
+
+    uint16_t* pixels_{nullptr};
+    int width_{0};
+    int height_{0};
+    int tiles_x_{0};
+    int tiles_y_{0};
+    uint32_t dirty_[kMaxTiles]{};
+};
+
+} // namespace chunfeng
@@ -0,0 +1,104 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-16 10:48:16
+ * @LastEditTime: 2025-06-16 16:31:08
+ * @LastEditors: 星年
+ * @Description: 点阵字库与字形缓存：字库文件放在 storage 分区，常用的中文状态文字缓存在内存中，避免每次刷新都读 Flash
+ * @FilePath: \ESP32-ChunFeng\components\display\include\glyph_cache.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include "esp_err.h"
+
+namespace chunfeng {
+
+/**
+ * @brief 字库文件头
+ *
+ * 文件布局：FontHeader，count 个升序排列的 uint32_t 码位，count 个字形点阵。
+ * 每个点阵 height 行，每行 (width + 7) / 8 字节，高位在左。
+ * ASCII（码位小于 0x80）按半角绘制，只使用点阵左半部分。
+ * 只需收录界面用到的字符，放在 storage 分区（/storage/font16.bin）。
+ */
+struct FontHeader {
+    char magic[4];      ///< "CFNT"
+    uint8_t version;    ///< kFontVersion
+    uint8_t width;
+    uint8_t height;
+    uint8_t reserved;
+    uint32_t count;
+};
+
+constexpr uint8_t kFontVersion = 1;
+
+/**
+ * @brief 从 UTF-8 字符串中取出一个码位并前移指针，遇到非法序列返回 U+FFFD
+ */
+uint32_t utf8Next(const char*& s);
+
+/**
+ * @brief 字形缓存
+ *
+ * 字库的码位索引在打开时读入内存（PSRAM），点阵按需读取，
+ * 缓存为 kSets 组 x kWays 路组相联，组内按最近使用替换。非线程安全，由显示任务独占使用。
+ */
+class GlyphCache {
+public:
+    static constexpr size_t kSets = 32;
+    static constexpr size_t kWays = 4;
+    static constexpr uint8_t kMaxGlyphSize = 32;
+
+    GlyphCache() = default;
+    ~GlyphCache() { close(); }
+
+    GlyphCache(const GlyphCache&) = delete;
+    GlyphCache& operator=(const GlyphCache&) = delete;
+
+    /**
+     * @brief 打开字库文件
+     */
+    esp_err_t open(const char* path);
+    void close();
+
+    bool isOpen() const { return file_ != nullptr; }
+    uint8_t width() const { return width_; }
+    uint8_t height() const { return height_; }
+    size_t rowBytes() const { return (width_ + 7) / 8; }
+
+    /**
+     * @brief 字符的步进宽度（ASCII 为半角）
+     */
+    uint8_t advance(uint32_t codepoint) const { return codepoint < 0x80 ? width_ / 2 : width_; }
+
+    /**
+     * @brief 查找字形点阵
+     * @return 点阵，在下一次 glyph() 调用前有效；字库中没有该字符时返回 nullptr
+     */
+    const uint8_t* glyph(uint32_t codepoint);
+
+private:
+    struct Entry {
+        uint32_t codepoint;
+        uint32_t last_use;
+        bool valid;
+        bool missing;   ///< 字库中没有：缓存否定结果，避免重复二分查找
+    };
+
+    bool load(uint32_t codepoint, uint8_t* out);
+
+    FILE* file_{nullptr};
+    uint32_t* index_{nullptr};
+    uint32_t count_{0};
+    uint8_t width_{0};
+    uint8_t height_{0};
+    size_t glyph_bytes_{0};
+    uint8_t* bitmaps_{nullptr};     ///< kSets * kWays 个点阵
+    Entry entries_[kSets * kWays]{};
+    uint32_t clock_{0};
+};
+
+} // namespace chunfeng
@@ -0,0 +1,111 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-16 11:37:02
+ * @LastEditTime: 2025-06-16 16:31:08
+ * @LastEditors: 星年
+ * @Description: SPI LCD 输出：只推送帧缓冲的脏区域，两块内部 RAM 的 DMA 缓冲轮流使用，CPU 准备下一块时上一块在传输
+ * @FilePath: \ESP32-ChunFeng\components\display\include\lcd_display.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "driver/spi_master.h"
+#include "esp_err.h"
+#include "esp_lcd_panel_io.h"
+#include "esp_lcd_types.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "framebuffer.hpp"
+
+namespace chunfeng {
+
+/**
+ * @brief 屏幕与引脚配置（ST7789，SPI）
+ */
+struct LcdConfig {
+    int width{320};             ///< 旋转后的宽高
+    int height{240};
+    spi_host_device_t host{SPI2_HOST};
+    int sclk_gpio{-1};
+    int mosi_gpio{-1};
+    int cs_gpio{-1};
+    int dc_gpio{-1};
+    int reset_gpio{-1};
+    int backlight_gpio{-1};
+    uint32_t pclk_hz{40 * 1000 * 1000};
+    bool swap_xy{true};         ///< 竖屏面板横向使用
+    bool mirror_x{true};
+    bool mirror_y{false};
+    bool invert_color{true};    ///< IPS 面板需要反色
+};
+
+/**
+ * @brief 一次刷新的统计
+ */
+struct FlushStats {
+    uint16_t rects{0};          ///< 脏矩形数
+    uint16_t transfers{0};      ///< draw_bitmap 调用次数（矩形按 DMA 缓冲大小切分）
+    uint32_t bytes{0};          ///< 总线字节数（颜色数据与窗口命令）
+    uint32_t cpu_us{0};         ///< flush() 的耗时，不含返回后仍在进行的最后一块传输
+    uint32_t tail_us{0};        ///< 最后一块的总线传输时间（按 pclk 估算），cpu_us + tail_us 即画面完整上屏的时间
+};
+
+/**
+ * @brief SPI LCD
+ *
+ * flush() 把帧缓冲的脏矩形按行切成不超过 kChunkBytes 的块，逐块从 PSRAM 拷贝到 DMA 缓冲
+ * （同时转换为面板要求的大端字节序）后交给 esp_lcd 异步发送。
+ * 两块缓冲轮流使用，拷贝下一块时上一块正在传输；最后一块排队后即返回，
+ * 显示任务可以在传输期间绘制下一帧（DMA 读的是缓冲而不是帧缓冲）。
+ */
+class LcdDisplay {
+public:
+    static constexpr size_t kChunkBytes = 8 * 1024;
+    static constexpr size_t kMaxRects = 16;
+    /** 每次 draw_bitmap 的窗口命令与参数：CASET、RASET、RAMWR */
+    static constexpr uint32_t kWindowBytes = 11;
+
+    LcdDisplay() = default;
+    ~LcdDisplay();
+
+    LcdDisplay(const LcdDisplay&) = delete;
+    LcdDisplay& operator=(const LcdDisplay&) = delete;
+
+    /**
+     * @brief 初始化 SPI 总线与面板，分配 DMA 缓冲并打开背光
+     */
+    esp_err_t init(const LcdConfig& config);
+
+    /**
+     * @brief 推送帧缓冲的脏区域
+     */
+    FlushStats flush(Framebuffer& fb);
+
+    /**
+     * @brief 等待已排队的传输全部完成（修改面板设置或进入低功耗前调用）
+     */
+    void waitIdle();
+
+    /**
+     * @brief 整帧推送的总线字节数，用于与差分刷新对比
+     */
+    uint32_t fullFrameBytes() const;
+
+private:
+    static bool onTransferDone(esp_lcd_panel_io_handle_t io, esp_lcd_panel_io_event_data_t* edata, void* ctx);
+
+    /** 取得一块空闲的 DMA 缓冲，两块都在传输时等待较早的一块完成 */
+    uint8_t* acquireChunk();
+
+    LcdConfig config_;
+    esp_lcd_panel_io_handle_t io_{nullptr};
+    esp_lcd_panel_handle_t panel_{nullptr};
+    SemaphoreHandle_t done_{nullptr};   ///< 每完成一块传输释放一次
+    uint8_t* chunks_[2]{};
+    int next_chunk_{0};
+    int in_flight_{0};
+};
+
+} // namespace chunfeng
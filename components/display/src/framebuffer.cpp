@@ -0,0 +1,181 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-16 10:05:31
+ * @LastEditTime: 2025-06-16 16:31:08
+ * @LastEditors: 星年
+ * @Description: PSRAM 帧缓冲与脏区域合并
+ * @FilePath: \ESP32-ChunFeng\components\display\src\framebuffer.cpp
+ * @遇事不决，可问春风
+ */
+#include "framebuffer.hpp"
+#include "esp_heap_caps.h"
+#include <algorithm>
+#include <cstring>
+
+namespace chunfeng {
+
+namespace {
+
+Rect unite(const Rect& a, const Rect& b) {
+    int16_t x0 = std::min(a.x, b.x);
+    int16_t y0 = std::min(a.y, b.y);
+    int16_t x1 = std::max<int16_t>(a.x + a.w, b.x + b.w);
+    int16_t y1 = std::max<int16_t>(a.y + a.h, b.y + b.h);
+    return Rect{x0, y0, static_cast<int16_t>(x1 - x0), static_cast<int16_t>(y1 - y0)};
+}
+
+} // namespace
+
+Framebuffer::~Framebuffer() {
+    heap_caps_free(pixels_);
+}
+
+esp_err_t Framebuffer::init(int width, int height) {
+    if (width <= 0 || height <= 0 || width > kTile * kMaxTiles || height > kTile * kMaxTiles) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t bytes = static_cast<size_t>(width) * height * sizeof(uint16_t);
+    heap_caps_free(pixels_);
+    pixels_ = static_cast<uint16_t*>(heap_caps_calloc(1, bytes, MALLOC_CAP_SPIRAM));
+    if (!pixels_) pixels_ = static_cast<uint16_t*>(heap_caps_calloc(1, bytes, MALLOC_CAP_DEFAULT));
+    if (!pixels_) return ESP_ERR_NO_MEM;
+    width_ = width;
+    height_ = height;
+    tiles_x_ = (width + kTile - 1) / kTile;
+    tiles_y_ = (height + kTile - 1) / kTile;
+    invalidateAll();
+    return ESP_OK;
+}
+
+bool Framebuffer::clip(Rect& rect) const {
+    int x0 = std::max<int>(rect.x, 0);
+    int y0 = std::max<int>(rect.y, 0);
+    int x1 = std::min<int>(rect.x + rect.w, width_);
+    int y1 = std::min<int>(rect.y + rect.h, height_);
+    if (x1 <= x0 || y1 <= y0) return false;
+    rect = Rect{static_cast<int16_t>(x0), static_cast<int16_t>(y0), static_cast<int16_t>(x1 - x0),
+                static_cast<int16_t>(y1 - y0)};
+    return true;
+}
+
+void Framebuffer::markTiles(int x0, int y0, int x1, int y1) {
+    // [x0, x1) x [y0, y1) 像素所覆盖的图块
+    int tx0 = x0 / kTile, tx1 = (x1 - 1) / kTile;
+    uint32_t bits = (tx1 - tx0 == 31) ? 0xffffffffu : ((1u << (tx1 - tx0 + 1)) - 1) << tx0;
+    for (int ty = y0 / kTile; ty <= (y1 - 1) / kTile; ++ty) {
+        dirty_[ty] |= bits;
+    }
+}
+
+void Framebuffer::fill(const Rect& rect, uint16_t color) {
+    Rect r = rect;
+    if (!pixels_ || !clip(r)) return;
+    for (int y = r.y; y < r.y + r.h; ++y) {
+        uint16_t* dst = pixels_ + static_cast<size_t>(y) * width_;
+        for (int x = r.x; x < r.x + r.w; ++x) {
+            if (dst[x] != color) {
+                dst[x] = color;
+                dirty_[y / kTile] |= 1u << (x / kTile);
+            }
+        }
+    }
+}
+
+void Framebuffer::blit(const Rect& rect, const uint16_t* src, int stride) {
+    Rect r = rect;
+    if (!pixels_ || !clip(r)) return;
+    src += (r.y - rect.y) * stride + (r.x - rect.x);
+    for (int y = r.y; y < r.y + r.h; ++y, src += stride) {
+        uint16_t* dst = pixels_ + static_cast<size_t>(y) * width_;
+        // 按图块边界分段比较：相同的段不写 PSRAM，也不标脏
+        for (int x = r.x; x < r.x + r.w;) {
+            int end = std::min<int>((x / kTile + 1) * kTile, r.x + r.w);
+            size_t bytes = static_cast<size_t>(end - x) * sizeof(uint16_t);
+            const uint16_t* s = src + (x - r.x);
+            if (memcmp(dst + x, s, bytes) != 0) {
+                memcpy(dst + x, s, bytes);
+                dirty_[y / kTile] |= 1u << (x / kTile);
+            }
+            x = end;
+        }
+    }
+}
+
+void Framebuffer::invalidate(const Rect& rect) {
+    Rect r = rect;
+    if (!clip(r)) return;
+    markTiles(r.x, r.y, r.x + r.w, r.y + r.h);
+}
+
+void Framebuffer::invalidateAll() {
+    invalidate(Rect{0, 0, static_cast<int16_t>(width_), static_cast<int16_t>(height_)});
+}
+
+bool Framebuffer::dirty() const {
+    for (int ty = 0; ty < tiles_y_; ++ty) {
+        if (dirty_[ty]) return true;
+    }
+    return false;
+}
+
+size_t Framebuffer::takeDirty(Rect* out, size_t max) {
+    if (max == 0) return 0;
+    size_t count = 0;
+    auto emit = [&](int tx0, int tx1, int ty0, int ty1) {
+        // 图块坐标 [tx0, tx1) x [ty0, ty1) 转为像素并裁剪到屏幕内
+        Rect r{static_cast<int16_t>(tx0 * kTile), static_cast<int16_t>(ty0 * kTile),
+               static_cast<int16_t>((tx1 - tx0) * kTile), static_cast<int16_t>((ty1 - ty0) * kTile)};
+        clip(r);
+        if (count < max) {
+            out[count++] = r;
+            return;
+        }
+        size_t best = 0;
+        int32_t best_growth = INT32_MAX;
+        for (size_t i = 0; i < count; ++i) {
+            int32_t growth = unite(out[i], r).area() - out[i].area();
+            if (growth < best_growth) {
+                best_growth = growth;
+                best = i;
+            }
+        }
+        out[best] = unite(out[best], r);
+    };
+
+    struct Run {
+        int8_t tx0, tx1, ty0;
+    };
+    Run open[kMaxTiles / 2 + 1];
+    size_t open_count = 0;
+    for (int ty = 0; ty <= tiles_y_; ++ty) {
+        uint32_t mask = ty < tiles_y_ ? dirty_[ty] : 0;
+        if (ty < tiles_y_) dirty_[ty] = 0;
+        Run next[kMaxTiles / 2 + 1];
+        size_t next_count = 0;
+        for (int tx = 0; tx < tiles_x_;) {
+            if (!(mask & (1u << tx))) {
+                ++tx;
+                continue;
+            }
+            int start = tx;
+            while (tx < tiles_x_ && (mask & (1u << tx))) ++tx;
+            Run run{static_cast<int8_t>(start), static_cast<int8_t>(tx), static_cast<int8_t>(ty)};
+            for (size_t i = 0; i < open_count; ++i) {
+                if (open[i].tx0 == run.tx0 && open[i].tx1 == run.tx1) {
+                    run.ty0 = open[i].ty0;      // 与上一行同宽的段向下延伸
+                    open[i].tx0 = -1;
+                    break;
+                }
+            }
+            next[next_count++] = run;
+        }
+        for (size_t i = 0; i < open_count; ++i) {
+            if (open[i].tx0 >= 0) emit(open[i].tx0, open[i].tx1, open[i].ty0, ty);
+        }
+        memcpy(open, next, sizeof(Run) * next_count);
+        open_count = next_count;
+    }
+    return count;
+}
+
+} // namespace chunfeng
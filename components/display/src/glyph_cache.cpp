@@ -0,0 +1,150 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-16 10:48:16
+ * @LastEditTime: 2025-06-16 16:31:08
+ * @LastEditors: 星年
+ * @Description: 点阵字库与字形缓存
+ * @FilePath: \ESP32-ChunFeng\components\display\src\glyph_cache.cpp
+ * @遇事不决，可问春风
+ */
+#include "glyph_cache.hpp"
+#include "cf_log.hpp"
+#include "metrics.hpp"
+#include "esp_heap_caps.h"
+#include <cstring>
+
+namespace chunfeng {
+
+namespace {
+
+const char* TAG = "GlyphCache";
+
+metrics::Counter s_hits("chunfeng_glyph_cache_hits_total", "字形缓存命中次数");
+metrics::Counter s_misses("chunfeng_glyph_cache_misses_total", "字形缓存未命中（读取字库文件）次数");
+
+} // namespace
+
+uint32_t utf8Next(const char*& s) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(s);
+    uint32_t cp;
+    size_t len;
+    if (p[0] < 0x80) {
+        cp = p[0];
+        len = 1;
+    } else if ((p[0] & 0xe0) == 0xc0) {
+        cp = p[0] & 0x1f;
+        len = 2;
+    } else if ((p[0] & 0xf0) == 0xe0) {
+        cp = p[0] & 0x0f;
+        len = 3;
+    } else if ((p[0] & 0xf8) == 0xf0) {
+        cp = p[0] & 0x07;
+        len = 4;
+    } else {
+        s += 1;
+        return 0xfffd;
+    }
+    for (size_t i = 1; i < len; ++i) {
+        if ((p[i] & 0xc0) != 0x80) {
+            s += i;     // 截断的序列：停在下一个字符的起始字节
+            return 0xfffd;
+        }
+        cp = cp << 6 | (p[i] & 0x3f);
+    }
+    s += len;
+    return cp;
+}
+
+esp_err_t GlyphCache::open(const char* path) {
+    close();
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        CF_LOGW(TAG, "字库 %s 不存在", path);
+        return ESP_ERR_NOT_FOUND;
+    }
+    FontHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, "CFNT", 4) != 0 ||
+        header.version != kFontVersion || header.width == 0 || header.height == 0 ||
+        header.width > kMaxGlyphSize || header.height > kMaxGlyphSize || header.count == 0) {
+        CF_LOGE(TAG, "字库 %s 格式错误", path);
+        fclose(fp);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    size_t index_bytes = header.count * sizeof(uint32_t);
+    size_t glyph_bytes = static_cast<size_t>((header.width + 7) / 8) * header.height;
+    index_ = static_cast<uint32_t*>(heap_caps_malloc(index_bytes, MALLOC_CAP_SPIRAM));
+    if (!index_) index_ = static_cast<uint32_t*>(heap_caps_malloc(index_bytes, MALLOC_CAP_DEFAULT));
+    bitmaps_ = static_cast<uint8_t*>(heap_caps_malloc(kSets * kWays * glyph_bytes, MALLOC_CAP_INTERNAL));
+    if (!index_ || !bitmaps_ || fread(index_, index_bytes, 1, fp) != 1) {
+        fclose(fp);
+        file_ = nullptr;
+        close();
+        return ESP_ERR_NO_MEM;
+    }
+    file_ = fp;
+    count_ = header.count;
+    width_ = header.width;
+    height_ = header.height;
+    glyph_bytes_ = glyph_bytes;
+    memset(entries_, 0, sizeof(entries_));
+    CF_LOGI(TAG, "字库 %s：%u 个字符，%ux%u", path, static_cast<unsigned>(count_), width_, height_);
+    return ESP_OK;
+}
+
+void GlyphCache::close() {
+    if (file_) fclose(file_);
+    file_ = nullptr;
+    heap_caps_free(index_);
+    heap_caps_free(bitmaps_);
+    index_ = nullptr;
+    bitmaps_ = nullptr;
+    count_ = 0;
+}
+
+bool GlyphCache::load(uint32_t codepoint, uint8_t* out) {
+    // 索引已在内存中，二分查找后只读一个点阵
+    uint32_t lo = 0, hi = count_;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (index_[mid] < codepoint) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo >= count_ || index_[lo] != codepoint) return false;
+    long offset = static_cast<long>(sizeof(FontHeader) + count_ * sizeof(uint32_t) + lo * glyph_bytes_);
+    return fseek(file_, offset, SEEK_SET) == 0 && fread(out, glyph_bytes_, 1, file_) == 1;
+}
+
+const uint8_t* GlyphCache::glyph(uint32_t codepoint) {
+    if (!file_) return nullptr;
+    size_t set = (codepoint * 2654435761u >> 16) % kSets;
+    Entry* ways = &entries_[set * kWays];
+    ++clock_;
+    for (size_t i = 0; i < kWays; ++i) {
+        if (ways[i].valid && ways[i].codepoint == codepoint) {
+            ways[i].last_use = clock_;
+            s_hits.inc();
+            return ways[i].missing ? nullptr : bitmaps_ + (set * kWays + i) * glyph_bytes_;
+        }
+    }
+    s_misses.inc();
+    size_t victim = 0;
+    for (size_t i = 0; i < kWays; ++i) {
+        if (!ways[i].valid) {
+            victim = i;
+            break;
+        }
+        if (ways[i].last_use < ways[victim].last_use) victim = i;
+    }
+    uint8_t* bitmap = bitmaps_ + (set * kWays + victim) * glyph_bytes_;
+    Entry& e = ways[victim];
+    e.codepoint = codepoint;
+    e.last_use = clock_;
+    e.valid = true;
+    e.missing = !load(codepoint, bitmap);
+    return e.missing ? nullptr : bitmap;
+}
+
+} // namespace chunfeng
@@ -0,0 +1,182 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-16 11:37:02
+ * @LastEditTime: 2025-06-16 16:31:08
+ * @LastEditors: 星年
+ * @Description: SPI LCD 输出：脏区域切块、DMA 双缓冲
+ * @FilePath: \ESP32-ChunFeng\components\display\src\lcd_display.cpp
+ * @遇事不决，可问春风
+ */
+#include "lcd_display.hpp"
+#include "cf_log.hpp"
+#include "metrics.hpp"
+#include "driver/gpio.h"
+#include "esp_heap_caps.h"
+#include "esp_lcd_panel_ops.h"
+#include "esp_lcd_panel_vendor.h"
+#include "esp_timer.h"
+#include <algorithm>
+
+namespace chunfeng {
+
+namespace {
+
+const char* TAG = "LcdDisplay";
+
+// 单次刷新的总线字节数分桶：一个字、一行文字、半屏、整屏（320x240）
+const uint32_t kFlushBytesBuckets[] = {1024, 4096, 16384, 65536, 160000};
+
+metrics::Counter s_flushes("chunfeng_display_flushes_total", "推送到屏幕的刷新次数");
+metrics::Counter s_bytes("chunfeng_display_bytes_total", "推送到屏幕的总线字节数");
+metrics::Histogram s_flush_bytes("chunfeng_display_flush_bytes", "单次刷新的总线字节数", kFlushBytesBuckets,
+                                 sizeof(kFlushBytesBuckets) / sizeof(kFlushBytesBuckets[0]));
+
+} // namespace
+
+LcdDisplay::~LcdDisplay() {
+    waitIdle();
+    if (panel_) esp_lcd_panel_del(panel_);
+    if (io_) esp_lcd_panel_io_del(io_);
+    if (done_) vSemaphoreDelete(done_);
+    heap_caps_free(chunks_[0]);
+    heap_caps_free(chunks_[1]);
+}
+
+esp_err_t LcdDisplay::init(const LcdConfig& config) {
+    config_ = config;
+    done_ = xSemaphoreCreateCounting(2, 0);
+    // DMA 只能读内部 RAM，帧缓冲在 PSRAM，由 CPU 逐块拷贝过来
+    for (auto& chunk : chunks_) {
+        chunk = static_cast<uint8_t*>(heap_caps_malloc(kChunkBytes, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL));
+    }
+    if (!done_ || !chunks_[0] || !chunks_[1]) return ESP_ERR_NO_MEM;
+
+    spi_bus_config_t bus = {};
+    bus.mosi_io_num = config.mosi_gpio;
+    bus.miso_io_num = -1;
+    bus.sclk_io_num = config.sclk_gpio;
+    bus.quadwp_io_num = -1;
+    bus.quadhd_io_num = -1;
+    bus.max_transfer_sz = kChunkBytes;
+    esp_err_t err = spi_bus_initialize(config.host, &bus, SPI_DMA_CH_AUTO);
+    if (err != ESP_OK) {
+        CF_LOGE(TAG, "SPI 总线初始化失败: %d", err);
+        return err;
+    }
+
+    esp_lcd_panel_io_spi_config_t io_config = {};
+    io_config.cs_gpio_num = config.cs_gpio;
+    io_config.dc_gpio_num = config.dc_gpio;
+    io_config.spi_mode = 0;
+    io_config.pclk_hz = config.pclk_hz;
+    io_config.trans_queue_depth = 2;
+    io_config.on_color_trans_done = onTransferDone;
+    io_config.user_ctx = this;
+    io_config.lcd_cmd_bits = 8;
+    io_config.lcd_param_bits = 8;
+    err = esp_lcd_new_panel_io_spi(static_cast<esp_lcd_spi_bus_handle_t>(config.host), &io_config, &io_);
+    if (err != ESP_OK) {
+        CF_LOGE(TAG, "LCD IO 创建失败: %d", err);
+        return err;
+    }
+
+    esp_lcd_panel_dev_config_t panel_config = {};
+    panel_config.reset_gpio_num = config.reset_gpio;
+    panel_config.rgb_ele_order = LCD_RGB_ELEMENT_ORDER_RGB;
+    panel_config.bits_per_pixel = 16;
+    err = esp_lcd_new_panel_st7789(io_, &panel_config, &panel_);
+    if (err != ESP_OK) {
+        CF_LOGE(TAG, "LCD 面板创建失败: %d", err);
+        return err;
+    }
+    esp_lcd_panel_reset(panel_);
+    esp_lcd_panel_init(panel_);
+    esp_lcd_panel_invert_color(panel_, config.invert_color);
+    esp_lcd_panel_swap_xy(panel_, config.swap_xy);
+    esp_lcd_panel_mirror(panel_, config.mirror_x, config.mirror_y);
+    esp_lcd_panel_disp_on_off(panel_, true);
+
+    if (config.backlight_gpio >= 0) {
+        gpio_config_t bl = {};
+        bl.pin_bit_mask = 1ULL << config.backlight_gpio;
+        bl.mode = GPIO_MODE_OUTPUT;
+        gpio_config(&bl);
+        gpio_set_level(static_cast<gpio_num_t>(config.backlight_gpio), 1);
+    }
+    CF_LOGI(TAG, "LCD %dx%d，SPI %u MHz", config.width, config.height,
+            static_cast<unsigned>(config.pclk_hz / 1000000));
+    return ESP_OK;
+}
+
+bool LcdDisplay::onTransferDone(esp_lcd_panel_io_handle_t, esp_lcd_panel_io_event_data_t*, void* ctx) {
+    auto* self = static_cast<LcdDisplay*>(ctx);
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(self->done_, &woken);
+    return woken == pdTRUE;
+}
+
+uint8_t* LcdDisplay::acquireChunk() {
+    // 传输按提交顺序完成：两块都在传输时，等到的一定是较早提交、即将被复用的那块
+    if (in_flight_ == 2) {
+        xSemaphoreTake(done_, portMAX_DELAY);
+        --in_flight_;
+    }
+    uint8_t* chunk = chunks_[next_chunk_];
+    next_chunk_ ^= 1;
+    return chunk;
+}
+
+void LcdDisplay::waitIdle() {
+    while (in_flight_ > 0) {
+        xSemaphoreTake(done_, portMAX_DELAY);
+        --in_flight_;
+    }
+}
+
+uint32_t LcdDisplay::fullFrameBytes() const {
+    uint32_t row_bytes = static_cast<uint32_t>(config_.width) * 2;
+    uint32_t rows_per_chunk = std::max<uint32_t>(1, kChunkBytes / row_bytes);
+    uint32_t chunks = (config_.height + rows_per_chunk - 1) / rows_per_chunk;
+    return row_bytes * config_.height + chunks * kWindowBytes;
+}
+
+FlushStats LcdDisplay::flush(Framebuffer& fb) {
+    FlushStats stats;
+    if (!panel_) return stats;
+    int64_t t0 = esp_timer_get_time();
+    Rect rects[kMaxRects];
+    size_t count = fb.takeDirty(rects, kMaxRects);
+    for (size_t i = 0; i < count; ++i) {
+        const Rect& r = rects[i];
+        int rows_per_chunk = std::max<int>(1, static_cast<int>(kChunkBytes / (r.w * 2)));
+        for (int y = r.y; y < r.y + r.h;) {
+            int rows = std::min(rows_per_chunk, r.y + r.h - y);
+            uint8_t* out = acquireChunk();
+            uint8_t* p = out;
+            for (int row = y; row < y + rows; ++row) {
+                const uint16_t* src = fb.row(row) + r.x;
+                for (int x = 0; x < r.w; ++x) {
+                    *p++ = static_cast<uint8_t>(src[x] >> 8);   // 面板按大端接收 RGB565
+                    *p++ = static_cast<uint8_t>(src[x]);
+                }
+            }
+            esp_lcd_panel_draw_bitmap(panel_, r.x, y, r.x + r.w, y + rows, out);
+            ++in_flight_;
+            ++stats.transfers;
+            uint32_t bytes = static_cast<uint32_t>(r.w) * rows * 2 + kWindowBytes;
+            stats.bytes += bytes;
+            stats.tail_us = static_cast<uint32_t>(static_cast<uint64_t>(bytes) * 8 * 1000000 / config_.pclk_hz);
+            y += rows;
+        }
+    }
+    stats.rects = static_cast<uint16_t>(count);
+    stats.cpu_us = static_cast<uint32_t>(esp_timer_get_time() - t0);
+    if (count) {
+        s_flushes.inc();
+        s_bytes.inc(stats.bytes);
+        s_flush_bytes.observe(stats.bytes);
+    }
+    return stats;
+}
+
+} // namespace chunfeng
@@ -2,18 +2,23 @@
  * @Author: xingnian j_xingnian@163.com
  * @Date: 2025-05-30 20:17:11
  * @LastEditors: 星年 && j_xingnian@163.com
- * @LastEditTime: 2025-05-30 20:25:27
+ * @LastEditTime: 2025-07-01 18:07:41
  * @FilePath: \ESP32-ChunFeng\components\network\include\bsp_config_network.hpp
  * @Description: 
  * 
  * Copyright (c) 2025 by ${git_name_email}, All Rights Reserved. 
  */
 #pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
 #include <string>
 #include <vector>
 
 namespace chunfeng {
 
+struct ConnectStatus;
+
 /**
  * @brief WiFi信息结构体
  */
@@ -25,6 +30,9 @@ struct WiFiInfo {
 
 /**
  * @brief 配网管理类，支持AP+STA模式和网页配置
+ *
+ * HTTP服务器一直运行（STA接口上可访问状态、指标与设置）；配网AP只在需要时开启，
+ * 开启期间WiFi不能进入省电模式，设备也无法 light sleep。
  */
 class BspConfigNetwork {
 public:
@@ -32,10 +40,22 @@ public:
     ~BspConfigNetwork();
 
     /**
-     * @brief 启动AP+STA模式和HTTP服务器
+     * @brief 启动WiFi和HTTP服务器
+     * @param portal 是否同时开启配网AP（AP+STA），否则只开STA
      * @return true 启动成功
      */
-    bool start();
+    bool start(bool portal = true);
+
+    /**
+     * @brief 开启或关闭配网AP，STA连接与HTTP服务器不受影响
+     * @return true 成功；false WiFi未启动或切换模式失败
+     */
+    bool setPortal(bool open);
+
+    /**
+     * @brief 配网AP是否开启
+     */
+    bool portalOpen() const { return portal_open_.load(); }
 
     /**
      * @brief 停止AP+STA和HTTP服务器
@@ -43,16 +63,18 @@ public:
     void stop();
 
     /**
-     * @brief 扫描周围WiFi
+     * @brief 扫描周围WiFi（阻塞，需 WiFi 驱动已启动）
      * @return WiFi列表
      */
-    std::vector<WiFiInfo> scanWiFi();
+    static std::vector<WiFiInfo> scanWiFi();
 
     /**
-     * @brief 连接指定WiFi
+     * @brief 连接指定WiFi（异步）
+     *
+     * 立即返回，获取到IP后才把网络加入已保存列表。
      * @param ssid WiFi名称
      * @param password 密码
-     * @return true 连接成功
+     * @return true 连接请求已发出
      */
     bool connectWiFi(const std::string& ssid, const std::string& password);
 
@@ -68,11 +90,52 @@ public:
      */
     std::string getCurrentWiFiInfo();
 
+    /**
+     * @brief 设置文档的处理函数，body 为 nullptr 时返回当前设置
+     * @param out [out] 响应正文（JSON）
+     * @return HTTP 状态行，如 "200 OK"
+     */
+    using SettingsHandler = const char* (*)(const char* body, size_t len, char* out, size_t out_size);
+
+    /**
+     * @brief 注册 /settings 的处理函数（由上层的后台管理模块提供），未注册时返回 404
+     */
+    static void setSettingsHandler(SettingsHandler handler);
+
+    /**
+     * @brief /commands 的操作：GET 列出、POST 录入一遍、DELETE 全部删除
+     */
+    enum class TemplateAction : uint8_t { LIST, ENROLL, CLEAR };
+
+    /**
+     * @brief 设备端指令模板的处理函数
+     * @param command 录入的指令名（仅 ENROLL，取自 ?command=）
+     * @param pcm 录入的一句话：16kHz 单声道 s16le，含首尾静音（仅 ENROLL）
+     * @param out [out] 响应正文（JSON）
+     * @return HTTP 状态行，如 "200 OK"
+     */
+    using CommandsHandler = const char* (*)(TemplateAction action, const char* command, const int16_t* pcm,
+                                            size_t samples, char* out, size_t out_size);
+
+    /**
+     * @brief 注册 /commands 的处理函数（由上层的设备端指令模块提供），未注册时返回 404
+     */
+    static void setCommandsHandler(CommandsHandler handler);
+
 private:
-    bool ap_sta_started_{false};      ///< AP+STA是否已启动
+    /**
+     * @brief 异步连接完成回调，成功时经 WiFiManager 保存网络
+     */
+    static void onConnectComplete(const ConnectStatus& status, void* ctx);
+
+    bool ap_sta_started_{false};      ///< WiFi是否已启动
+    std::atomic<bool> portal_open_{false};  ///< 配网AP是否开启
     void* http_server_{nullptr};      ///< HTTP服务器句柄
     std::string last_ssid_;           ///< 最近连接的SSID
     std::string last_password_;       ///< 最近连接的密码
+    std::mutex pending_mutex_;        ///< 保护 pending_*（回调在事件循环任务中执行）
+    std::string pending_ssid_;        ///< 正在连接的SSID
+    std::string pending_password_;    ///< 正在连接的密码
 };
 
 } // namespace chunfeng
\ No newline at end of file
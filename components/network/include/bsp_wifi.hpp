@@ -9,6 +9,8 @@
  */
 #pragma once
 #include <string>
+#include "wifi_network_list.hpp"
+#include "wifi_connector.hpp"
 
 namespace chunfeng {
 
@@ -25,14 +27,25 @@ public:
     // 删除NVS中的WiFi信息
     bool deleteWiFiInfo();
 
-    // 连接指定WiFi
+    // 保存多网络列表到NVS（不依赖WiFi初始化）
+    static bool saveNetworkList(const WiFiNetworkList& list);
+    // 从NVS读取多网络列表，兼容旧版单组ssid/pwd
+    static bool loadNetworkList(WiFiNetworkList& list);
+    // 删除NVS中的多网络列表
+    static bool deleteNetworkList();
+
+    // 连接指定WiFi，阻塞到获取IP或失败（由WiFiConnector完成重试与超时）
     bool connect(const std::string& ssid, const std::string& password);
+    // 异步连接指定WiFi，结果通过句柄或 options.on_complete 获取
+    ConnectHandle connectAsync(const std::string& ssid, const std::string& password,
+                               const ConnectOptions& options = ConnectOptions());
     // 断开WiFi连接
     void disconnect();
+    // 是否已连接并获取到IP
+    bool isConnected() const;
 
 private:
     bool initialized_; // WiFi是否已初始化
-    bool connected_;   // WiFi是否已连接
 };
 
 } // namespace chunfeng
@@ -1,7 +1,7 @@
 /*** 
  * @Author: jixingnian@gmail.com
  * @Date: 2025-05-30 12:20:10
- * @LastEditTime: 2025-05-30 14:36:23
+ * @LastEditTime: 2025-07-01 16:22:10
  * @LastEditors: 星年
  * @Description: 配网管理类，负责配网的初始化、反初始化及相关操作
  * @FilePath: \ESP32-ChunFeng\components\network\include\config_manager.hpp
@@ -43,17 +43,34 @@ public:
     bool isInitialized() const;
 
     /**
-     * @brief 启动配网
+     * @brief 启动配网（WiFi驱动与HTTP服务器）
+     * @param portal 是否开启配网AP；已配网的设备只开STA，连不上WiFi时再经 openPortal() 开启
      * @return true 启动成功
      * @return false 启动失败
      */
-    bool startConfig();
+    bool startConfig(bool portal = true);
 
     /**
      * @brief 停止配网
      */
     void stopConfig();
 
+    /**
+     * @brief 开启配网AP（AP+STA），需先 startConfig()
+     * @return true 已开启
+     */
+    bool openPortal();
+
+    /**
+     * @brief 关闭配网AP，只保留STA，WiFi 才能进入省电模式
+     */
+    void closePortal();
+
+    /**
+     * @brief 配网AP是否开启
+     */
+    bool portalOpen() const;
+
     // TODO: 可扩展配网相关接口，如获取配网状态等
 
 private:
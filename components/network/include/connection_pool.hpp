@@ -0,0 +1,174 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-12 10:36:52
+ * @LastEditTime: 2025-06-12 16:05:44
+ * @LastEditors: 星年
+ * @Description: HTTPS 连接池：云端接口共用的 TLS 长连接、会话票据恢复与按内存预算限制的连接数
+ * @FilePath: \ESP32-ChunFeng\components\network\include\connection_pool.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "esp_err.h"
+#include "esp_tls.h"
+
+namespace chunfeng {
+
+/**
+ * @brief 连接池参数
+ */
+struct PoolConfig {
+    size_t memory_budget{128 * 1024};   ///< 所有 TLS 连接可占用的内存（PSRAM），决定连接数上限
+    uint8_t max_per_host{2};            ///< 同一主机最多同时打开的连接
+    uint32_t idle_timeout_ms{30000};    ///< 空闲连接保留时间，应小于服务器的 keep-alive 超时
+    uint32_t timeout_ms{10000};         ///< 连接、握手与单次读写超时（esp_tls 共用一个超时）
+    uint32_t acquire_timeout_ms{5000};  ///< 连接数已满时等待其他请求归还连接的时间
+};
+
+/**
+ * @brief HTTP 响应
+ */
+struct HttpResponse {
+    int status{0};
+    std::string body;
+    bool keep_alive{false};     ///< 服务器允许复用该连接
+};
+
+struct PoolConnection;
+class ConnectionPool;
+
+/**
+ * @brief 从连接池借出的连接，析构时自动归还
+ *
+ * 只能移动不能复制。WebSocket 等升级后的连接不再是 HTTP 语义，
+ * 用完应调用 release(false) 关闭而不是放回池中。
+ */
+class PooledConnection {
+public:
+    PooledConnection() = default;
+    PooledConnection(PooledConnection&& other) noexcept;
+    PooledConnection& operator=(PooledConnection&& other) noexcept;
+    ~PooledConnection() { release(); }
+
+    PooledConnection(const PooledConnection&) = delete;
+    PooledConnection& operator=(const PooledConnection&) = delete;
+
+    bool valid() const { return conn_ != nullptr; }
+    esp_tls_t* tls() const;
+
+    /**
+     * @brief 借到的是池中已有的空闲连接（没有握手）
+     */
+    bool reused() const;
+
+    /**
+     * @brief 新建的连接通过会话票据恢复了 TLS 会话（一个往返，无证书校验与密钥交换）
+     */
+    bool resumed() const;
+
+    /**
+     * @brief 写入全部数据
+     * @return 写入的字节数，出错返回负数
+     */
+    ssize_t write(const void* data, size_t len);
+
+    /**
+     * @brief 读取数据
+     * @return 读到的字节数，0 对端关闭，负数出错或超时
+     */
+    ssize_t read(void* data, size_t len);
+
+    /**
+     * @brief 归还连接
+     * @param reusable false 表示连接已不可复用（出错、对端要求关闭、协议升级），直接关闭
+     */
+    void release(bool reusable = true);
+
+private:
+    friend class ConnectionPool;
+    explicit PooledConnection(PoolConnection* conn) : conn_(conn) {}
+
+    PoolConnection* conn_{nullptr};
+};
+
+/**
+ * @brief HTTPS 连接池
+ *
+ * 按主机和端口复用 TLS 连接，HTTP/1.1 keep-alive 下后续请求不再握手；
+ * 连接被服务器关闭后，新连接携带该主机上次的会话票据，只需简化握手。
+ * 每个 mbedTLS 连接约占输入输出缓冲加会话状态的内存，连接数上限由 memory_budget 折算，
+ * 达到上限时优先关闭其他主机的空闲连接，否则等待其他请求归还。
+ */
+class ConnectionPool {
+public:
+    static ConnectionPool& getInstance();
+
+    /**
+     * @brief 修改参数，只影响之后的借出
+     */
+    void configure(const PoolConfig& config);
+
+    /**
+     * @brief 借出一条到 host:port 的连接
+     * @return 连接；连接数已满且等待超时或建立连接失败时返回无效连接
+     */
+    PooledConnection acquire(const std::string& host, uint16_t port = 443);
+
+    /**
+     * @brief 发送 HTTP/1.1 请求并读取完整响应
+     *
+     * 复用的连接可能已被服务器关闭，如果在收到任何响应字节前失败，换一条新连接重试一次。
+     * @param extra_headers 附加请求头，每行以 "\r\n" 结尾
+     */
+    esp_err_t request(const char* method, const std::string& host, const std::string& path,
+                      const std::string& body, HttpResponse& response,
+                      const char* content_type = "application/json",
+                      const std::string& extra_headers = "", uint16_t port = 443);
+
+    /**
+     * @brief 关闭所有空闲连接（网络切换或进入低功耗前调用），保留会话票据
+     */
+    void closeIdle();
+
+    /**
+     * @brief 由内存预算折算的连接数上限
+     */
+    size_t maxConnections() const;
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+private:
+    friend class PooledConnection;
+
+    ConnectionPool();
+    ~ConnectionPool() = default;
+
+    struct Session;
+
+    void giveBack(PoolConnection* conn, bool reusable);
+    PoolConnection* connect(const std::string& host, uint16_t port);
+    void reapIdleLocked(int64_t now_us, std::vector<PoolConnection*>& closed);
+    size_t limitLocked() const;
+    size_t countLocked(const std::string& host, uint16_t port) const;
+    std::shared_ptr<Session> sessionLocked(const std::string& host, uint16_t port);
+    void removeLocked(PoolConnection* conn);
+
+    static void destroy(PoolConnection* conn);
+
+    mutable std::mutex mutex_;
+    std::condition_variable released_;          ///< 有连接归还或关闭
+    PoolConfig config_;
+    std::vector<PoolConnection*> conns_;        ///< 已打开的连接（空闲与借出）
+    std::vector<std::string> connecting_;       ///< 正在握手的 "host:port"
+    std::vector<std::shared_ptr<Session>> sessions_;
+};
+
+} // namespace chunfeng
@@ -0,0 +1,111 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-11 09:20:16
+ * @LastEditTime: 2025-06-11 15:37:52
+ * @LastEditors: 星年
+ * @Description: DNS 缓存：按记录 TTL 缓存服务域名的 IPv4 地址并持久化到 NVS，过期后先用旧值、后台重新解析
+ * @FilePath: \ESP32-ChunFeng\components\network\include\dns_cache.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+namespace chunfeng {
+
+/**
+ * @brief DNS 缓存
+ *
+ * 开机后从 NVS 恢复上次的解析结果，联网后第一个请求无需等待 DNS：
+ * - 未过期（fresh）：直接返回；
+ * - 已过期但未超过 kMaxStaleSec（stale）：直接返回旧地址，同时交给后台任务重新解析；
+ * - 未缓存（miss）：在调用方任务中同步解析。
+ *
+ * 自行发送 DNS A 记录查询以拿到记录的 TTL（lwIP 的 getaddrinfo 不返回 TTL）。
+ * 重启后剩余 TTL 依赖系统时间：时间未同步时已恢复的记录一律视为 stale。
+ * 解析经由 STA 网卡的 DNS 服务器，4G（AT 模组）在线时只使用缓存。
+ */
+class DnsCache {
+public:
+    static constexpr size_t kMaxEntries = 8;            ///< 最多缓存的域名数
+    static constexpr size_t kMaxHostLen = 63;           ///< 域名最大长度
+    static constexpr uint32_t kMinTtlSec = 30;          ///< TTL 下限，避免频繁查询
+    static constexpr uint32_t kMaxTtlSec = 24 * 3600;   ///< TTL 上限
+    static constexpr uint32_t kMaxStaleSec = 7 * 24 * 3600;  ///< 过期后仍可乐观使用的最长时间
+
+    static DnsCache& getInstance();
+
+    /**
+     * @brief 登记固定的服务域名，联网时会预先解析
+     */
+    void addHost(const std::string& host);
+
+    /**
+     * @brief 解析域名
+     * @param host 域名
+     * @param addr [out] IPv4 地址（网络字节序）
+     * @param timeout_ms 未命中时同步查询的超时
+     * @return true 得到了地址（可能是过期的旧地址）
+     */
+    bool resolve(const std::string& host, uint32_t* addr, uint32_t timeout_ms = 3000);
+
+    /**
+     * @brief 网络已连通：后台重新解析过期或尚未解析的服务域名
+     */
+    void onNetworkUp();
+
+    /**
+     * @brief 指定 DNS 服务器（调试或主机测试用），addr 为 0 时恢复使用 STA 网卡的 DNS
+     * @param addr IPv4 地址（网络字节序）
+     * @param port UDP 端口（主机字节序）
+     */
+    void setServer(uint32_t addr, uint16_t port = 53);
+
+    DnsCache(const DnsCache&) = delete;
+    DnsCache& operator=(const DnsCache&) = delete;
+
+private:
+    DnsCache();
+    ~DnsCache() = default;
+
+    struct Entry {
+        std::string host;
+        uint32_t addr{0};           ///< 0 表示尚未解析
+        uint32_t ttl_sec{0};
+        uint32_t saved_at{0};       ///< NVS 中记录的解析时间（Unix 秒），0 表示未知
+        int64_t expires_us{0};      ///< 过期时刻（esp_timer 时间），0 表示已过期
+        int64_t stale_until_us{0};  ///< 过期后仍可使用的截止时刻
+        bool service{false};        ///< addHost() 登记的服务域名
+        bool refreshing{false};     ///< 已交给后台任务
+    };
+
+    int findLocked(const std::string& host) const;
+    int insertLocked(const std::string& host);
+    void scheduleRefreshLocked(int index);
+
+    /**
+     * @brief 发送查询并更新缓存（不持锁调用）
+     */
+    bool refresh(const std::string& host, uint32_t timeout_ms, uint32_t* addr);
+    bool serverAddress(uint32_t* addr, uint16_t* port);
+
+    void load();
+    void saveLocked();
+
+    static void refreshTask(void* arg);
+
+    mutable std::mutex mutex_;
+    std::condition_variable refreshed_;     ///< 后台解析完成一条记录
+    std::vector<Entry> entries_;
+    uint32_t server_addr_{0};
+    uint16_t server_port_{53};
+    QueueHandle_t refresh_queue_{nullptr};
+};
+
+} // namespace chunfeng
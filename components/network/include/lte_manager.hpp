@@ -1,14 +1,18 @@
-/*** 
+/***
  * @Author: jixingnian@gmail.com
  * @Date: 2025-05-30 12:19:57
- * @LastEditTime: 2025-05-30 17:42:26
+ * @LastEditTime: 2025-06-25 10:41:37
  * @LastEditors: 星年
- * @Description: LTE（4G）管理类，负责 LTE 的初始化、连接、断开、反初始化与状态查询
+ * @Description: LTE（4G）管理类：按需上电附着，不用后保持待机一段时间再断电释放，查询状态与驻留内存
  * @FilePath: \ESP32-ChunFeng\components\network\include\lte_manager.hpp
  * @遇事不决，可问春风
  */
 #pragma once
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
 #include "esp_log.h"
 #include "ml307_at_modem.h"
 #include "ml307_ssl_transport.h"
@@ -17,75 +21,107 @@
 
 namespace chunfeng {
 
+/**
+ * @brief 4G 模组的电源与使用状态
+ */
+enum class LteState : uint8_t {
+    OFF,        ///< 断电，不占用 UART 驱动与缓冲
+    ATTACHING,  ///< 上电并等待附着
+    ACTIVE,     ///< 已附着，正在使用
+    STANDBY,    ///< 已附着但不再使用，linger 到期后断电
+};
+
 /**
  * @brief LTE（4G）管理类
- * 
- * 该类采用单例模式，负责LTE模块的初始化、反初始化、连接、断开和状态查询。
- * 主要功能包括：
- *   1. 初始化和反初始化底层LTE硬件及相关资源
- *   2. 连接和断开LTE网络
- *   3. 查询当前LTE连接状态
+ *
+ * 该类采用单例模式。模组是按需启用的后备链路：只有故障切换需要 4G 时 connect() 才上电并附着，
+ * 单例本身只是状态与计时，始终用 WiFi 的设备不会为 4G 付出开机时间、内存与电流。
+ * disconnect() 后模组保持附着 linger 时间（待机），期间再次 connect() 直接恢复使用、无需重新附着；
+ * 超过后由 poll() 断电并释放 UART 驱动与缓冲。
+ *
+ * connect()、disconnect()、poll() 与 powerDown() 由网络任务调用，其余接口可在任意任务中调用。
  */
 class LTEManager {
 public:
+    static constexpr uint32_t kDefaultLingerMs = 60 * 1000;
+
     /**
      * @brief 获取 LTEManager 单例实例
-     * 
+     *
      * 该方法返回 LTEManager 的唯一实例，确保全局只有一个 LTEManager 对象。
-     * 
+     *
      * @return LTEManager& 单例引用
      */
     static LTEManager& getInstance();
 
-    /**
-     * @brief 初始化 LTE（4G）网络
-     * 
-     * 尝试连接到配置的 LTE 网络。调用前需确保已初始化。
-     * 
-     * @return true 连接成功
-     * @return false 连接失败
-     */
-    bool initialize();
-
     /**
      * @brief 连接 LTE（4G）网络
-     * 
-     * 尝试连接到配置的 LTE 网络。调用前需确保已初始化。
-     * 
+     *
+     * 断电时上电并阻塞到附着完成；待机时直接恢复使用。附着失败时断电。
+     *
      * @return true 连接成功
      * @return false 连接失败
      */
     bool connect();
 
     /**
-     * @brief 断开 LTE（4G）网络连接
-     * 
-     * 断开当前的 LTE 连接并释放相关资源。调用后 LTE 处于断开状态。
-     * 若未连接，则该方法应为幂等操作。
+     * @brief 不再使用 LTE（4G）网络
+     *
+     * 转入待机，linger 到期后由 poll() 断电；linger 为 0 时立即断电。未连接时为幂等操作。
      */
     void disconnect();
 
     /**
-     * @brief 查询 LTE 是否已连接
-     * 
-     * 用于判断当前 LTE 网络连接状态。
-     * 
+     * @brief 立即断电并释放模组驱动
+     */
+    void powerDown();
+
+    /**
+     * @brief 待机超过 linger 时断电，由网络任务每轮调用
+     */
+    void poll();
+
+    /**
+     * @brief 查询 LTE 是否已连接（正在使用）
+     *
      * @return true 已连接
      * @return false 未连接
      */
     bool isConnected() const;
 
-    LTEManager(); // 构造函数声明
-    ~LTEManager(); // 增加析构函数声明
+    LteState state() const { return state_.load(); }
 
-private:
     /**
-     * @brief 构造函数私有化，禁止外部实例化
-     * 
-     * 仅允许通过 getInstance() 获取单例对象。
+     * @brief 设置待机保持时间，正在待机的按新值计算到期时间
      */
-    bool initialized_{false};
-    bool connected_{false};
+    void setLinger(uint32_t ms);
+    uint32_t linger() const { return linger_ms_.load(); }
+
+    /** 待机时 poll() 将会断电的时间（esp_timer 微秒），不在待机时为 0；网络任务据此安排下一次醒来 */
+    int64_t powerDownAtUs() const;
+
+    /** 上电期间模组驱动占用的内部 RAM（上电前后的空闲内存之差），断电时为 0 */
+    size_t residentBytes() const { return resident_bytes_.load(); }
+    /** 从断电到上电附着的次数 */
+    uint32_t powerUps() const { return power_ups_.load(); }
+
+    LTEManager(const LTEManager&) = delete;
+    LTEManager& operator=(const LTEManager&) = delete;
+
+private:
+    LTEManager(); // 仅允许通过 getInstance() 获取单例对象
+    ~LTEManager();
+
+    void setState(LteState state);
+    void powerDownLocked();
+
+    mutable std::mutex mutex_;
+    Ml307AtModem* modem_{nullptr};          ///< 上电期间存在，断电时释放
+    std::atomic<LteState> state_{LteState::OFF};
+    std::atomic<uint32_t> linger_ms_{kDefaultLingerMs};
+    int64_t standby_since_us_{0};
+    std::atomic<size_t> resident_bytes_{0};
+    std::atomic<uint32_t> power_ups_{0};
 };
 
-} // namespace chunfeng 
\ No newline at end of file
+} // namespace chunfeng
@@ -0,0 +1,199 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-10 10:25:17
+ * @LastEditTime: 2025-07-02 14:26:08
+ * @LastEditors: 星年
+ * @Description: WiFi 异步连接：由 STA_CONNECTED / GOT_IP / DISCONNECTED 事件驱动完成，支持超时与指数退避重试
+ * @FilePath: \ESP32-ChunFeng\components\network\include\wifi_connector.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "message_bus.hpp"
+
+namespace chunfeng {
+
+/**
+ * @brief 连接结果
+ */
+enum class ConnectResult : uint8_t {
+    PENDING,        ///< 进行中
+    CONNECTED,      ///< 已关联并获取到 IP
+    NO_AP_FOUND,    ///< 找不到 AP
+    AUTH_FAILED,    ///< 认证失败（多为密码错误）
+    LINK_FAILED,    ///< 关联失败或连接过程中链路断开
+    DHCP_TIMEOUT,   ///< 已关联但未获取到 IP
+    TIMEOUT,        ///< 整体超时
+    CANCELLED,      ///< 被新的连接请求或断开操作取消
+    DRIVER_ERROR,   ///< esp_wifi_connect() 调用失败（驱动未初始化/未启动）
+};
+
+/**
+ * @brief 结果名称（日志、指标标签用）
+ */
+const char* connectResultName(ConnectResult result);
+
+/**
+ * @brief 连接状态与各阶段耗时
+ *
+ * ESP-IDF 在关联与 WPA 四次握手都完成后才上报 STA_CONNECTED，两者之间没有事件，
+ * 因此 link_ms 包含扫描、802.11 认证/关联和四次握手。
+ */
+struct ConnectStatus {
+    ConnectResult result{ConnectResult::PENDING};
+    uint8_t attempts{0};        ///< 已尝试次数
+    uint8_t last_reason{0};     ///< 最近一次断开原因（wifi_err_reason_t）
+    uint32_t link_ms{0};        ///< 最后一次尝试：esp_wifi_connect() 到 STA_CONNECTED
+    uint32_t dhcp_ms{0};        ///< STA_CONNECTED 到 GOT_IP
+    uint32_t total_ms{0};       ///< 发起连接到完成（含重试与退避）
+    uint32_t ip{0};             ///< 获取到的 IPv4 地址（网络字节序）
+};
+
+/**
+ * @brief 连接完成回调，在事件循环或 esp_timer 任务中调用，不要在其中阻塞
+ */
+using ConnectCallback = void (*)(const ConnectStatus& status, void* ctx);
+
+/**
+ * @brief 连接参数
+ */
+struct ConnectOptions {
+    uint32_t timeout_ms{15000};         ///< 整体超时（含所有重试）
+    uint32_t dhcp_timeout_ms{5000};     ///< 关联后等待 IP 的超时
+    uint8_t max_attempts{4};            ///< 最多尝试次数
+    uint32_t backoff_initial_ms{250};   ///< 首次重试前的等待，之后每次翻倍
+    uint32_t backoff_max_ms{4000};      ///< 退避上限
+    bool retry_auth_failure{false};     ///< 认证失败是否重试（密码错误时重试无意义）
+    ConnectCallback on_complete{nullptr};
+    void* ctx{nullptr};
+};
+
+struct ConnectOperation;
+
+/**
+ * @brief 一次连接请求的句柄，可等待、查询或取消
+ */
+class ConnectHandle {
+public:
+    ConnectHandle() = default;
+
+    bool valid() const { return op_ != nullptr; }
+
+    /**
+     * @brief 是否已完成（成功或失败）
+     */
+    bool done() const;
+
+    /**
+     * @brief 阻塞等待完成
+     * @param timeout_ms 等待时间，UINT32_MAX 表示一直等到连接请求自身超时
+     * @return 连接结果，等待超时返回 PENDING
+     */
+    ConnectResult wait(uint32_t timeout_ms = UINT32_MAX) const;
+
+    /**
+     * @brief 当前状态快照
+     */
+    ConnectStatus status() const;
+
+    /**
+     * @brief 取消连接（已完成时无效果）
+     */
+    void cancel();
+
+private:
+    friend class WiFiConnector;
+    explicit ConnectHandle(std::shared_ptr<ConnectOperation> op) : op_(std::move(op)) {}
+
+    std::shared_ptr<ConnectOperation> op_;
+};
+
+/**
+ * @brief STA 连接管理
+ *
+ * 负责注册 WIFI_EVENT / IP_EVENT 处理函数，同一时间只有一个连接请求，
+ * 新请求会取消旧请求。不负责驱动初始化（esp_wifi_init/start 由调用方完成）。
+ */
+class WiFiConnector {
+public:
+    /**
+     * @brief 获取单例实例（首次调用时注册事件处理函数）
+     */
+    static WiFiConnector& getInstance();
+
+    /**
+     * @brief 发起异步连接
+     *
+     * 已用相同的 SSID 与密码连上时不重新关联，句柄立即以 CONNECTED 完成（同样调用 on_complete 并发布 WIFI_LINK）；
+     * 密码不同时（如配网页面重新提交了改正的密码）按新请求重新连接。
+     * @return 连接句柄；驱动调用失败时句柄立即以 DRIVER_ERROR 完成
+     */
+    ConnectHandle connect(const std::string& ssid, const std::string& password,
+                          const ConnectOptions& options = ConnectOptions());
+
+    /**
+     * @brief 断开当前连接并取消进行中的连接请求
+     */
+    void disconnect();
+
+    /**
+     * @brief 是否已关联且获取到 IP
+     */
+    bool isConnected() const;
+
+    /**
+     * @brief 当前（或最近一次请求）的 SSID
+     */
+    std::string currentSsid() const;
+
+    /**
+     * @brief 读取当前链路的 SSID 与密码（切换网络前记下，失败时据此连回）
+     * @return 已关联且获取到 IP 时返回 true，否则不修改参数
+     */
+    bool currentLink(std::string& ssid, std::string& password) const;
+
+    WiFiConnector(const WiFiConnector&) = delete;
+    WiFiConnector& operator=(const WiFiConnector&) = delete;
+
+private:
+    friend class ConnectHandle;
+
+    WiFiConnector();
+    ~WiFiConnector() = default;
+
+    void cancel(const std::shared_ptr<ConnectOperation>& op);
+
+    static void onWiFiEvent(void* arg, esp_event_base_t base, int32_t id, void* data);
+    static void onIpEvent(void* arg, esp_event_base_t base, int32_t id, void* data);
+    static void onRetryTimer(void* arg);
+    static void onDhcpTimer(void* arg);
+    static void onDeadlineTimer(void* arg);
+
+    /** 以下函数均在持锁时调用，返回后由调用方在锁外执行驱动操作与回调 */
+    struct Deferred;
+    void startAttemptLocked(Deferred& d);
+    void failAttemptLocked(ConnectResult cls, uint8_t reason, Deferred& d);
+    void completeLocked(ConnectResult result, Deferred& d);
+    void run(Deferred& d);
+
+    mutable std::mutex mutex_;
+    std::shared_ptr<ConnectOperation> current_;
+    bool link_up_{false};           ///< 已收到 STA_CONNECTED 且之后未断开
+    bool has_ip_{false};
+    std::string ssid_;
+    std::string password_;          ///< ssid_ 对应的密码，判断能否沿用当前连接
+    esp_timer_handle_t retry_timer_{nullptr};
+    esp_timer_handle_t dhcp_timer_{nullptr};
+    esp_timer_handle_t deadline_timer_{nullptr};
+};
+
+} // namespace chunfeng
+
+// 每个连接请求完成时（含失败与取消）发布一次；已连接的链路断开时以 LINK_FAILED 发布一次
+CF_BUS_TOPIC(WIFI_LINK, chunfeng::ConnectStatus)
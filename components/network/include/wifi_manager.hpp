@@ -1,7 +1,7 @@
 /*** 
  * @Author: jixingnian@gmail.com
  * @Date: 2025-05-30 12:19:31
- * @LastEditTime: 2025-05-30 17:47:16
+ * @LastEditTime: 2025-07-01 10:26:42
  * @LastEditors: 星年
  * @Description: WiFi 管理类，负责 WiFi 的初始化、反初始化、连接、断开与状态查询
  * @FilePath: \ESP32-ChunFeng\components\network\include\wifi_manager.hpp
@@ -9,7 +9,11 @@
  */
 #pragma once
 
+#include <mutex>
 #include <string>
+#include <vector>
+#include "wifi_network_list.hpp"
+#include "wifi_connector.hpp"
 
 namespace chunfeng {
 
@@ -23,6 +27,10 @@ namespace chunfeng {
  * - 连接和断开 WiFi 网络
  * - 查询当前 WiFi 连接状态
  * - WiFi 信息的保存、读取与删除
+ * - 多网络凭据列表管理，并根据扫描结果选择最佳网络连接
+ *
+ * 已保存网络列表只由本类读写（配网页面、后台设置也经由本类保存），内存中的列表与 NVS 保持一致；
+ * 列表由互斥锁保护，连接过程中不持锁。
  */
 class WiFiManager {
 public:
@@ -37,8 +45,8 @@ public:
     /**
      * @brief 连接 WiFi
      * 
-     * 尝试连接到指定的 WiFi 网络。
-     * 连接前应确保已初始化。
+     * 尝试连接到指定的 WiFi 网络，阻塞到获取 IP 或失败。
+     * 连接前应确保 WiFi 驱动已启动。
      * @param ssid WiFi 名称
      * @param password WiFi 密码
      * @return true 连接成功
@@ -46,6 +54,18 @@ public:
      */
     bool connect(const std::string& ssid, const std::string& password);
 
+    /**
+     * @brief 异步连接 WiFi
+     * 
+     * 立即返回，结果通过句柄或 options.on_complete 获取。
+     * @param ssid WiFi 名称
+     * @param password WiFi 密码
+     * @param options 超时、重试等参数
+     * @return ConnectHandle 连接句柄
+     */
+    ConnectHandle connectAsync(const std::string& ssid, const std::string& password,
+                               const ConnectOptions& options = ConnectOptions());
+
     /**
      * @brief 断开 WiFi 连接
      * 
@@ -57,7 +77,7 @@ public:
     /**
      * @brief 查询 WiFi 是否已连接
      * 
-     * 检查当前 WiFi 连接状态。
+     * 检查当前 WiFi 是否已关联并获取到 IP。
      * @return true 已连接
      * @return false 未连接
      */
@@ -66,7 +86,7 @@ public:
     /**
      * @brief 保存 WiFi 信息
      * 
-     * 保存指定的 WiFi SSID 和密码到持久化存储（或内存示例）。
+     * 将指定的 WiFi 加入已保存网络列表（已存在则更新密码），并持久化到NVS。
      * @param ssid WiFi 名称
      * @param password WiFi 密码
      * @return true 保存成功
@@ -77,7 +97,7 @@ public:
     /**
      * @brief 读取已保存的 WiFi 信息
      * 
-     * 读取已保存的 WiFi SSID 和密码。
+     * 读取首选网络（优先级最高、最近成功）的 SSID 和密码。
      * @param ssid [out] 读取到的 WiFi 名称
      * @param password [out] 读取到的 WiFi 密码
      * @return true 读取成功
@@ -88,12 +108,62 @@ public:
     /**
      * @brief 删除已保存的 WiFi 信息
      * 
-     * 删除已保存的 WiFi SSID 和密码。
+     * 清空已保存网络列表。
      * @return true 删除成功
      * @return false 删除失败
      */
     bool deleteWiFiInfo();
 
+    /**
+     * @brief 添加或更新已保存网络
+     * 
+     * @param ssid WiFi 名称
+     * @param password WiFi 密码
+     * @param priority 优先级，越大越优先
+     * @return true 保存成功
+     * @return false 参数无效或持久化失败
+     */
+    bool addNetwork(const std::string& ssid, const std::string& password, uint8_t priority);
+
+    /**
+     * @brief 删除指定的已保存网络
+     * @param ssid WiFi 名称
+     * @return true 删除成功
+     * @return false 未找到
+     */
+    bool removeNetwork(const std::string& ssid);
+
+    /**
+     * @brief 获取已保存网络列表（副本）
+     */
+    std::vector<SavedNetwork> getNetworks() const;
+
+    /**
+     * @brief 扫描周围 WiFi（阻塞，需 WiFi 驱动已启动）
+     * @return 扫描结果
+     */
+    std::vector<WiFiInfo> scan();
+
+    /**
+     * @brief 根据一次扫描结果连接最佳网络
+     * 
+     * 按 RSSI、优先级和历史成功率对匹配的网络排序，依次尝试连接，
+     * 并记录每次尝试的结果。被新的连接请求取消时停止尝试，不计入历史。
+     * @param scan 扫描结果
+     * @return true 已连接
+     * @return false 没有可用网络或全部连接失败
+     */
+    bool connectBest(const std::vector<WiFiInfo>& scan);
+
+    /**
+     * @brief 扫描后连接最佳网络
+     *
+     * 只保存了一个网络时无需比较，不扫描直接连接（省去一次全信道扫描），同样记录结果。
+     * @return true 已连接
+     * @return false 没有已保存网络或全部连接失败
+     */
+    bool connectBest();
+
     WiFiManager(); // 构造函数声明
     ~WiFiManager(); // 析构函数声明
 
@@ -102,12 +172,15 @@ private:
     WiFiManager(const WiFiManager&) = delete;
     WiFiManager& operator=(const WiFiManager&) = delete;
 
+    /**
+     * @brief 将已保存网络列表写入NVS（调用方持锁）
+     */
+    bool persistNetworks();
+
     bool initialized_{false};
-    bool connected_{false};
 
-    // 内存保存的 WiFi 信息（实际应持久化到NVS等）
-    std::string saved_ssid_;
-    std::string saved_password_;
+    mutable std::mutex mutex_;  ///< 保护 networks_（配网回调在事件循环任务中执行）
+    WiFiNetworkList networks_;  ///< 已保存的网络列表（NVS持久化）
 };
 
 } // namespace chunfeng 
\ No newline at end of file
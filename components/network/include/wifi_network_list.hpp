@@ -0,0 +1,138 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-03 10:12:40
+ * @LastEditTime: 2025-06-03 15:31:05
+ * @LastEditors: 星年
+ * @Description: 多网络凭据列表，负责已保存网络的优先级、连接历史与最佳AP选择
+ * @FilePath: \ESP32-ChunFeng\components\network\include\wifi_network_list.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "bsp_config_network.hpp"  // WiFiInfo
+
+namespace chunfeng {
+
+/**
+ * @brief 已保存的 WiFi 网络
+ */
+struct SavedNetwork {
+    std::string ssid;               ///< WiFi名称
+    std::string password;           ///< WiFi密码
+    uint8_t priority{0};            ///< 用户优先级（越大越优先）
+    uint32_t last_success{0};       ///< 最近一次连接成功时间（秒，0 表示从未成功）
+    uint16_t success_count{0};      ///< 成功次数（随时间衰减）
+    uint16_t attempt_count{0};      ///< 尝试次数（随时间衰减）
+
+    /**
+     * @brief 连接成功率，未尝试过的网络按 0.5 计
+     */
+    float successRate() const;
+};
+
+/**
+ * @brief 扫描结果与已保存网络匹配后的候选项
+ */
+struct NetworkCandidate {
+    size_t index;       ///< 在 WiFiNetworkList 中的下标
+    int rssi;           ///< 本次扫描到的信号强度（同名多AP取最强）
+    int score;          ///< 综合评分（越大越优先）
+};
+
+/**
+ * @brief 多网络凭据列表
+ *
+ * 不依赖 ESP-IDF，可在主机上单元测试。持久化由调用方通过
+ * serialize()/deserialize() 完成（见 BspWiFi::saveNetworkList）。
+ *
+ * 评分规则：
+ * - 基础分为 RSSI（dBm），低于 kMinRssi 的 AP 不参与选择
+ * - 每级优先级 +kPriorityWeight
+ * - 历史成功率 0~1 映射到 ±kHistoryWeight/2
+ * - 近 24 小时成功过 +kRecentBonus，近 7 天成功过 +kRecentBonus/2
+ */
+class WiFiNetworkList {
+public:
+    static constexpr size_t kMaxNetworks = 8;       ///< 最多保存的网络数
+    static constexpr int kMinRssi = -88;            ///< 参与选择的最低信号强度
+    static constexpr int kPriorityWeight = 10;
+    static constexpr int kHistoryWeight = 20;
+    static constexpr int kRecentBonus = 10;
+
+    /**
+     * @brief 添加或更新网络
+     *
+     * 同名网络更新密码和优先级并保留历史；列表已满时淘汰
+     * 优先级最低且最久未成功的网络。
+     * @return true 成功
+     * @return false SSID 为空或超长
+     */
+    bool upsert(const std::string& ssid, const std::string& password, uint8_t priority);
+
+    /**
+     * @brief 删除指定网络
+     * @return true 已删除
+     * @return false 未找到
+     */
+    bool remove(const std::string& ssid);
+
+    /**
+     * @brief 清空列表
+     */
+    void clear();
+
+    /**
+     * @brief 查找网络
+     * @return 下标，未找到返回 -1
+     */
+    int find(const std::string& ssid) const;
+
+    /**
+     * @brief 记录一次连接结果
+     * @param ssid WiFi 名称
+     * @param success 是否成功
+     * @param now 当前时间（秒）
+     */
+    void recordResult(const std::string& ssid, bool success, uint32_t now);
+
+    /**
+     * @brief 将一次扫描结果与列表匹配并排序
+     * @param scan 扫描结果
+     * @param now 当前时间（秒）
+     * @return 按评分从高到低排列的候选网络
+     */
+    std::vector<NetworkCandidate> rank(const std::vector<WiFiInfo>& scan, uint32_t now) const;
+
+    /**
+     * @brief 获取首选网络（不依赖扫描，按优先级与最近成功时间）
+     * @return 下标，列表为空返回 -1
+     */
+    int preferred() const;
+
+    const std::vector<SavedNetwork>& networks() const { return networks_; }
+    const SavedNetwork& at(size_t index) const { return networks_[index]; }
+    size_t size() const { return networks_.size(); }
+    bool empty() const { return networks_.empty(); }
+
+    /**
+     * @brief 序列化为定长二进制记录
+     */
+    std::vector<uint8_t> serialize() const;
+
+    /**
+     * @brief 从二进制记录恢复
+     * @return true 成功
+     * @return false 数据损坏或版本不符（列表保持不变）
+     */
+    bool deserialize(const uint8_t* data, size_t len);
+
+private:
+    int scoreOf(const SavedNetwork& net, int rssi, uint32_t now) const;
+
+    std::vector<SavedNetwork> networks_;
+};
+
+} // namespace chunfeng
@@ -1,11 +1,19 @@
 #include "bsp_config_network.hpp"
 #include "bsp_config_network_page.h"
+#include "wifi_connector.hpp"
+#include "wifi_manager.hpp"
+#include "metrics.hpp"
+#include "status_board.hpp"
+#include "trace.hpp"
+#include "task_topology.hpp"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_http_server.h"
 #include "nvs_flash.h"
 #include "nvs.h"
+#include <atomic>
 #include <cstring>
 #include <sstream>
 #include <vector>
@@ -15,6 +23,103 @@ static const char* TAG = "BspConfigNetwork";
 
 namespace chunfeng {
 
+// 扫描耗时分桶（毫秒）
+static const uint32_t kScanBucketsMs[] = {500, 1000, 1500, 2000, 3000, 5000, 8000};
+
+static metrics::Histogram s_scan_duration("chunfeng_wifi_scan_duration_ms", "WiFi 扫描耗时（毫秒）",
+                                          kScanBucketsMs, sizeof(kScanBucketsMs) / sizeof(kScanBucketsMs[0]));
+static metrics::Gauge s_scan_ap_count("chunfeng_wifi_scan_ap_count", "最近一次扫描到的 AP 数量");
+
+static std::atomic<BspConfigNetwork::SettingsHandler> s_settings_handler{nullptr};
+static const size_t kSettingsBodyMax = 1024;
+static const size_t kSettingsReplyMax = 512;
+
+// /settings：GET 返回当前设置，POST 推送设置文档（JSON）
+static esp_err_t settingsHandler(httpd_req_t *req) {
+    CF_TRACE_SCOPE("http.settings");
+    BspConfigNetwork::SettingsHandler handler = s_settings_handler.load();
+    // 文档与回复放在堆上，httpd 任务栈只有 4KB，应用设置还要用栈
+    std::string reply(kSettingsReplyMax, '\0');
+    const char* status;
+    if (!handler) {
+        status = HTTPD_404;
+        reply = "{\"error\":\"settings not available\"}";
+    } else if (req->method == HTTP_POST) {
+        if (req->content_len == 0 || req->content_len > kSettingsBodyMax) {
+            httpd_resp_set_status(req, HTTPD_400);
+            return httpd_resp_send(req, "{\"error\":\"bad document size\"}", HTTPD_RESP_USE_STRLEN);
+        }
+        std::string body(req->content_len, '\0');
+        size_t received = 0;
+        while (received < body.size()) {
+            int n = httpd_req_recv(req, &body[received], body.size() - received);
+            if (n <= 0) return ESP_FAIL;
+            received += n;
+        }
+        status = handler(body.data(), body.size(), &reply[0], reply.size());
+    } else {
+        status = handler(nullptr, 0, &reply[0], reply.size());
+    }
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return httpd_resp_send(req, reply.c_str(), HTTPD_RESP_USE_STRLEN);
+}
+
+static std::atomic<BspConfigNetwork::CommandsHandler> s_commands_handler{nullptr};
+// 录入的一句话最长 4s（16kHz s16le），超过 16KB 的分配在 PSRAM 上
+static const size_t kCommandsBodyMax = 16000 * 2 * 4;
+static const size_t kCommandsReplyMax = 256;
+
+// /commands：GET 列出模板，POST ?command=<指令名> 录入一遍（正文为 PCM），DELETE 删除全部模板
+static esp_err_t commandsHandler(httpd_req_t *req) {
+    CF_TRACE_SCOPE("http.commands");
+    BspConfigNetwork::CommandsHandler handler = s_commands_handler.load();
+    std::string reply(kCommandsReplyMax, '\0');
+    const char* status;
+    if (!handler) {
+        status = HTTPD_404;
+        reply = "{\"error\":\"commands not available\"}";
+    } else if (req->method == HTTP_POST) {
+        char query[48] = {0};
+        char command[24] = {0};
+        if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+            httpd_query_key_value(query, "command", command, sizeof(command)) != ESP_OK) {
+            httpd_resp_set_status(req, HTTPD_400);
+            return httpd_resp_send(req, "{\"error\":\"missing command\"}", HTTPD_RESP_USE_STRLEN);
+        }
+        if (req->content_len < sizeof(int16_t) || req->content_len > kCommandsBodyMax ||
+            req->content_len % sizeof(int16_t) != 0) {
+            httpd_resp_set_status(req, HTTPD_400);
+            return httpd_resp_send(req, "{\"error\":\"bad pcm size\"}", HTTPD_RESP_USE_STRLEN);
+        }
+        std::vector<int16_t> pcm(req->content_len / sizeof(int16_t));
+        char* dst = reinterpret_cast<char*>(pcm.data());
+        size_t received = 0;
+        while (received < req->content_len) {
+            int n = httpd_req_recv(req, dst + received, req->content_len - received);
+            if (n == HTTPD_SOCK_ERR_TIMEOUT) continue;
+            if (n <= 0) return ESP_FAIL;
+            received += n;
+        }
+        status = handler(BspConfigNetwork::TemplateAction::ENROLL, command, pcm.data(), pcm.size(),
+                         &reply[0], reply.size());
+    } else {
+        BspConfigNetwork::TemplateAction action = req->method == HTTP_DELETE
+            ? BspConfigNetwork::TemplateAction::CLEAR : BspConfigNetwork::TemplateAction::LIST;
+        status = handler(action, nullptr, nullptr, 0, &reply[0], reply.size());
+    }
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return httpd_resp_send(req, reply.c_str(), HTTPD_RESP_USE_STRLEN);
+}
+
+// 工具函数：指标/追踪数据分块输出到 HTTP 响应
+static bool metricsChunkWriter(const char* data, size_t len, void* ctx) {
+    return httpd_resp_send_chunk(static_cast<httpd_req_t*>(ctx), data, len) == ESP_OK;
+}
+
 // 工具函数：将WiFi扫描结果转为JSON字符串
 static std::string wifiListToJson(const std::vector<WiFiInfo>& list) {
     std::ostringstream oss;
@@ -35,7 +140,7 @@ BspConfigNetwork::~BspConfigNetwork() {
     stop();
 }
 
-bool BspConfigNetwork::start() {
+bool BspConfigNetwork::start(bool portal) {
     // 1. 初始化NVS
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -53,25 +158,22 @@ bool BspConfigNetwork::start() {
     if (!ap_netif) ap_netif = esp_netif_create_default_wifi_ap();
     if (!sta_netif) sta_netif = esp_netif_create_default_wifi_sta();
 
-    // 2. 启动AP+STA模式
+    // 2. 启动WiFi：需要配网时AP+STA，已配网时只开STA（softAP 开启时WiFi不能休眠）
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     esp_wifi_init(&cfg);
 
-    wifi_config_t ap_config = {};
-    strcpy((char*)ap_config.ap.ssid, "ChunFeng_Config");
-    ap_config.ap.ssid_len = strlen("ChunFeng_Config");
-    strcpy((char*)ap_config.ap.password, "12345678");
-    ap_config.ap.max_connection = 4;
-    ap_config.ap.authmode = WIFI_AUTH_WPA_WPA2_PSK;
-
-    esp_wifi_set_mode(WIFI_MODE_APSTA);
-    esp_wifi_set_config(WIFI_IF_AP, &ap_config);
+    esp_wifi_set_mode(WIFI_MODE_STA);
     esp_wifi_start();
-
     ap_sta_started_ = true;
+    setPortal(portal);
 
     // 3. 启动HTTP服务器
     httpd_config_t server_config = HTTPD_DEFAULT_CONFIG();
+    server_config.max_uri_handlers = 16;
+    const tasks::TaskSpec& httpd_task = tasks::spec(tasks::TaskId::HTTPD);
+    server_config.core_id = httpd_task.core == tasks::kAnyCore ? tskNO_AFFINITY : httpd_task.core;
+    server_config.task_priority = httpd_task.priority;
+    server_config.stack_size = httpd_task.stack_bytes;
     httpd_handle_t server = nullptr;
     if (httpd_start(&server, &server_config) == ESP_OK) {
         http_server_ = server;
@@ -81,6 +183,7 @@ bool BspConfigNetwork::start() {
             .uri = "/",
             .method = HTTP_GET,
             .handler = [](httpd_req_t *req) {
+                CF_TRACE_SCOPE("http.root");
                 // 兼容手机浏览器特殊请求
                 std::string uri = req->uri;
                 if (uri == "/generate_204" || uri == "/favicon.ico" || uri == "/hotspot-detect.html") {
@@ -100,6 +203,7 @@ bool BspConfigNetwork::start() {
             .uri = "/scan",
             .method = HTTP_GET,
             .handler = [](httpd_req_t *req) {
+                CF_TRACE_SCOPE("http.scan");
                 auto* self = reinterpret_cast<BspConfigNetwork*>(req->user_ctx);
                 auto list = self->scanWiFi();
                 std::string json = wifiListToJson(list);
@@ -116,6 +220,7 @@ bool BspConfigNetwork::start() {
             .uri = "/connect",
             .method = HTTP_POST,
             .handler = [](httpd_req_t *req) {
+                CF_TRACE_SCOPE("http.connect");
                 char buf[128] = {0};
                 httpd_req_recv(req, buf, sizeof(buf) - 1);
                 std::string body(buf);
@@ -143,6 +248,7 @@ bool BspConfigNetwork::start() {
             .uri = "/delete",
             .method = HTTP_POST,
             .handler = [](httpd_req_t *req) {
+                CF_TRACE_SCOPE("http.delete");
                 auto* self = reinterpret_cast<BspConfigNetwork*>(req->user_ctx);
                 bool ok = self->deleteWiFi();
                 httpd_resp_send(req, ok ? "已删除" : "删除失败", HTTPD_RESP_USE_STRLEN);
@@ -157,6 +263,7 @@ bool BspConfigNetwork::start() {
             .uri = "/info",
             .method = HTTP_GET,
             .handler = [](httpd_req_t *req) {
+                CF_TRACE_SCOPE("http.info");
                 auto* self = reinterpret_cast<BspConfigNetwork*>(req->user_ctx);
                 std::string info = self->getCurrentWiFiInfo();
                 httpd_resp_set_type(req, "text/plain; charset=utf-8"); // 新增，确保编码
@@ -166,9 +273,138 @@ bool BspConfigNetwork::start() {
             .user_ctx = this
         };
         httpd_register_uri_handler(server, &info);
+
+        // 运行时指标（Prometheus 文本格式）
+        httpd_uri_t metrics_uri = {
+            .uri = "/metrics",
+            .method = HTTP_GET,
+            .handler = [](httpd_req_t *req) {
+                CF_TRACE_SCOPE("http.metrics");
+                httpd_resp_set_type(req, "text/plain; version=0.0.4; charset=utf-8");
+                metrics::render(metricsChunkWriter, req);
+                httpd_resp_send_chunk(req, nullptr, 0);
+                return ESP_OK;
+            },
+            .user_ctx = nullptr
+        };
+        httpd_register_uri_handler(server, &metrics_uri);
+
+        // 系统状态快照：默认紧凑 JSON，/status?format=bin 为二进制（见 status_board.hpp）
+        // 读取不阻塞任何写入方，面板高频轮询也不会影响音频任务
+        httpd_uri_t status_uri = {
+            .uri = "/status",
+            .method = HTTP_GET,
+            .handler = [](httpd_req_t *req) {
+                CF_TRACE_SCOPE("http.status");
+                char query[32] = {0};
+                char format[8] = "json";
+                if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+                    httpd_query_key_value(query, "format", format, sizeof(format));
+                }
+                status::Snapshot snapshot;
+                status::read(snapshot);
+                httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+                if (strcmp(format, "bin") == 0) {
+                    uint8_t bin[status::kBinarySize];
+                    size_t len = status::formatBinary(snapshot, bin, sizeof(bin));
+                    httpd_resp_set_type(req, "application/octet-stream");
+                    httpd_resp_send(req, reinterpret_cast<const char*>(bin), len);
+                } else {
+                    char json[status::kMaxJsonSize];
+                    size_t len = status::formatJson(snapshot, json, sizeof(json));
+                    httpd_resp_set_type(req, "application/json");
+                    httpd_resp_send(req, json, len);
+                }
+                return ESP_OK;
+            },
+            .user_ctx = nullptr
+        };
+        httpd_register_uri_handler(server, &status_uri);
+
+        // 设置文档：读取与推送（处理函数由后台管理模块注册）
+        httpd_uri_t settings_get = {
+            .uri = "/settings",
+            .method = HTTP_GET,
+            .handler = settingsHandler,
+            .user_ctx = nullptr
+        };
+        httpd_register_uri_handler(server, &settings_get);
+        httpd_uri_t settings_post = {
+            .uri = "/settings",
+            .method = HTTP_POST,
+            .handler = settingsHandler,
+            .user_ctx = nullptr
+        };
+        httpd_register_uri_handler(server, &settings_post);
+
+        // 设备端指令模板：列出、录入、删除（处理函数由设备端指令模块注册）
+        for (httpd_method_t method : {HTTP_GET, HTTP_POST, HTTP_DELETE}) {
+            httpd_uri_t commands_uri = {
+                .uri = "/commands",
+                .method = method,
+                .handler = commandsHandler,
+                .user_ctx = nullptr
+            };
+            httpd_register_uri_handler(server, &commands_uri);
+        }
+
+        // 追踪控制与导出：/trace?action=start|stop|clear|save|dump（默认 dump）
+        httpd_uri_t trace_uri = {
+            .uri = "/trace",
+            .method = HTTP_GET,
+            .handler = [](httpd_req_t *req) {
+                char query[32] = {0};
+                char action[16] = "dump";
+                if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+                    httpd_query_key_value(query, "action", action, sizeof(action));
+                }
+                std::string cmd = action;
+                bool ok = true;
+                if (cmd == "start") {
+                    ok = trace::start();
+                } else if (cmd == "stop") {
+                    trace::stop();
+                } else if (cmd == "clear") {
+                    trace::clear();
+                } else if (cmd == "save") {
+                    ok = trace::dumpToFile("/storage/trace.json");
+                } else {
+                    httpd_resp_set_type(req, "application/json");
+                    trace::exportChromeJson(metricsChunkWriter, req);
+                    httpd_resp_send_chunk(req, nullptr, 0);
+                    return ESP_OK;
+                }
+                httpd_resp_send(req, ok ? "OK" : "FAILED", HTTPD_RESP_USE_STRLEN);
+                return ESP_OK;
+            },
+            .user_ctx = nullptr
+        };
+        httpd_register_uri_handler(server, &trace_uri);
     }
 
-    ESP_LOGI(TAG, "AP+STA和HTTP服务器已启动");
+    ESP_LOGI(TAG, "WiFi（%s）和HTTP服务器已启动", portal ? "AP+STA" : "STA");
+    return true;
+}
+
+bool BspConfigNetwork::setPortal(bool open) {
+    if (!ap_sta_started_) return false;
+    if (open == portal_open_) return true;
+    // 切换模式不影响STA的连接，HTTP服务器在STA接口上继续可用
+    if (esp_wifi_set_mode(open ? WIFI_MODE_APSTA : WIFI_MODE_STA) != ESP_OK) {
+        ESP_LOGE(TAG, "%s配网AP失败", open ? "开启" : "关闭");
+        return false;
+    }
+    if (open) {
+        wifi_config_t ap_config = {};
+        strcpy((char*)ap_config.ap.ssid, "ChunFeng_Config");
+        ap_config.ap.ssid_len = strlen("ChunFeng_Config");
+        strcpy((char*)ap_config.ap.password, "12345678");
+        ap_config.ap.max_connection = 4;
+        ap_config.ap.authmode = WIFI_AUTH_WPA_WPA2_PSK;
+        esp_wifi_set_config(WIFI_IF_AP, &ap_config);
+    }
+    portal_open_ = open;
+    ESP_LOGI(TAG, "配网AP已%s", open ? "开启" : "关闭");
     return true;
 }
 
@@ -177,6 +413,7 @@ void BspConfigNetwork::stop() {
         esp_wifi_stop();
         esp_wifi_deinit();
         ap_sta_started_ = false;
+        portal_open_ = false;
     }
     if (http_server_) {
         httpd_stop((httpd_handle_t)http_server_);
@@ -187,6 +424,7 @@ void BspConfigNetwork::stop() {
 // 扫描周围WiFi
 std::vector<WiFiInfo> BspConfigNetwork::scanWiFi() {
     std::vector<WiFiInfo> result;
+    int64_t start_us = esp_timer_get_time();
     wifi_scan_config_t scan_config = {};
     esp_wifi_scan_start(&scan_config, true); // 阻塞扫描
     uint16_t ap_num = 0;
@@ -201,38 +439,64 @@ std::vector<WiFiInfo> BspConfigNetwork::scanWiFi() {
         result.push_back(info);
     }
     delete[] ap_records;
+    s_scan_duration.observe(static_cast<uint32_t>((esp_timer_get_time() - start_us) / 1000));
+    s_scan_ap_count.set(ap_num);
     return result;
 }
 
 // 连接指定WiFi
 bool BspConfigNetwork::connectWiFi(const std::string& ssid, const std::string& password) {
-    wifi_config_t sta_config = {};
-    strncpy((char*)sta_config.sta.ssid, ssid.c_str(), sizeof(sta_config.sta.ssid) - 1);
-    strncpy((char*)sta_config.sta.password, password.c_str(), sizeof(sta_config.sta.password) - 1);
-    esp_wifi_set_config(WIFI_IF_STA, &sta_config);
-    esp_err_t err = esp_wifi_connect();
-    if (err == ESP_OK) {
-        last_ssid_ = ssid;
-        last_password_ = password;
-        // 可保存到NVS
-        return true;
-    }
-    return false;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        pending_ssid_ = ssid;
+        pending_password_ = password;
+    }
+    ConnectOptions options;
+    options.on_complete = onConnectComplete;
+    options.ctx = this;
+    ConnectHandle handle = WiFiConnector::getInstance().connect(ssid, password, options);
+    return handle.status().result != ConnectResult::DRIVER_ERROR;
+}
+
+void BspConfigNetwork::setSettingsHandler(SettingsHandler handler) {
+    s_settings_handler.store(handler);
+}
+
+void BspConfigNetwork::setCommandsHandler(CommandsHandler handler) {
+    s_commands_handler.store(handler);
+}
+
+// 异步连接完成：只有真正获取到IP才保存，避免把输错的密码写入NVS
+void BspConfigNetwork::onConnectComplete(const ConnectStatus& status, void* ctx) {
+    auto* self = static_cast<BspConfigNetwork*>(ctx);
+    if (status.result != ConnectResult::CONNECTED) {
+        ESP_LOGW(TAG, "配网连接失败: %s", connectResultName(status.result));
+        return;
+    }
+    std::string ssid, password;
+    {
+        std::lock_guard<std::mutex> lock(self->pending_mutex_);
+        ssid = self->pending_ssid_;
+        password = self->pending_password_;
+        self->last_ssid_ = ssid;
+        self->last_password_ = password;
+    }
+    // 加入已保存网络列表（不覆盖其他网络）；列表由 WiFiManager 统一维护，直接写 NVS 会被它的缓存覆盖
+    if (!WiFiManager::getInstance().saveWiFiInfo(ssid, password)) {
+        ESP_LOGW(TAG, "保存WiFi到网络列表失败: %s", ssid.c_str());
+    }
 }
 
 // 删除已保存WiFi
 bool BspConfigNetwork::deleteWiFi() {
-    // 删除NVS中保存的WiFi信息
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("wifi_cfg", NVS_READWRITE, &nvs_handle);
-    if (err != ESP_OK) return false;
-    nvs_erase_key(nvs_handle, "ssid");
-    nvs_erase_key(nvs_handle, "pwd");
-    nvs_commit(nvs_handle);
-    nvs_close(nvs_handle);
-    last_ssid_.clear();
-    last_password_.clear();
-    esp_wifi_disconnect();
+    // 删除保存的WiFi信息（包括多网络列表）
+    if (!WiFiManager::getInstance().deleteWiFiInfo()) return false;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        last_ssid_.clear();
+        last_password_.clear();
+    }
+    WiFiConnector::getInstance().disconnect();
     return true;
 }
 
@@ -20,9 +20,10 @@ namespace chunfeng {
 #define WIFI_NVS_NAMESPACE "wifi_cfg"
 #define WIFI_NVS_KEY_SSID  "ssid"
 #define WIFI_NVS_KEY_PWD   "pwd"
+#define WIFI_NVS_KEY_LIST  "nets"
 
 // 构造函数：初始化NVS和WiFi（STA模式）
-BspWiFi::BspWiFi() : initialized_(false), connected_(false) {
+BspWiFi::BspWiFi() : initialized_(false) {
     // 初始化NVS（非易失性存储），用于保存WiFi信息
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -61,8 +62,8 @@ bool BspWiFi::saveWiFiInfo(const std::string& ssid, const std::string& password)
     return true;
 }
 
-// 从NVS读取WiFi信息（SSID和密码）
-bool BspWiFi::loadWiFiInfo(std::string& ssid, std::string& password) {
+// 读取NVS中的单组WiFi信息（也用于旧版数据迁移）
+static bool readWiFiInfo(std::string& ssid, std::string& password) {
     nvs_handle_t nvs_handle;
     // 以只读方式打开NVS命名空间
     esp_err_t err = nvs_open(WIFI_NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
@@ -86,6 +87,11 @@ bool BspWiFi::loadWiFiInfo(std::string& ssid, std::string& password) {
     return true;
 }
 
+// 从NVS读取WiFi信息（SSID和密码）
+bool BspWiFi::loadWiFiInfo(std::string& ssid, std::string& password) {
+    return readWiFiInfo(ssid, password);
+}
+
 // 删除NVS中保存的WiFi信息
 bool BspWiFi::deleteWiFiInfo() {
     nvs_handle_t nvs_handle;
@@ -100,26 +106,75 @@ bool BspWiFi::deleteWiFiInfo() {
     return true;
 }
 
-// 连接指定WiFi（STA模式）
+// 保存多网络列表到NVS（二进制blob）
+bool BspWiFi::saveNetworkList(const WiFiNetworkList& list) {
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) return false;
+    std::vector<uint8_t> blob = list.serialize();
+    err = nvs_set_blob(nvs_handle, WIFI_NVS_KEY_LIST, blob.data(), blob.size());
+    if (err == ESP_OK) err = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+    return err == ESP_OK;
+}
+
+// 从NVS读取多网络列表
+bool BspWiFi::loadNetworkList(WiFiNetworkList& list) {
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(WIFI_NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (err != ESP_OK) return false;
+
+    size_t len = 0;
+    err = nvs_get_blob(nvs_handle, WIFI_NVS_KEY_LIST, nullptr, &len);
+    if (err == ESP_OK && len > 0) {
+        std::vector<uint8_t> blob(len);
+        err = nvs_get_blob(nvs_handle, WIFI_NVS_KEY_LIST, blob.data(), &len);
+        nvs_close(nvs_handle);
+        return err == ESP_OK && list.deserialize(blob.data(), len);
+    }
+    nvs_close(nvs_handle);
+
+    // 兼容旧版：仅保存了一组ssid/pwd时迁移为列表的第一项
+    std::string ssid, password;
+    if (!readWiFiInfo(ssid, password)) return false;
+    list.clear();
+    return list.upsert(ssid, password, 0);
+}
+
+// 删除NVS中的多网络列表
+bool BspWiFi::deleteNetworkList() {
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) return false;
+    nvs_erase_key(nvs_handle, WIFI_NVS_KEY_LIST);
+    nvs_erase_key(nvs_handle, WIFI_NVS_KEY_SSID);
+    nvs_erase_key(nvs_handle, WIFI_NVS_KEY_PWD);
+    nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+    return true;
+}
+
+// 连接指定WiFi（STA模式），阻塞等待结果
 bool BspWiFi::connect(const std::string& ssid, const std::string& password) {
     if (!initialized_) return false;
-    wifi_config_t wifi_config = {};
-    // 拷贝SSID和密码到配置结构体
-    strncpy((char*)wifi_config.sta.ssid, ssid.c_str(), sizeof(wifi_config.sta.ssid) - 1);
-    strncpy((char*)wifi_config.sta.password, password.c_str(), sizeof(wifi_config.sta.password) - 1);
-    // 设置WiFi配置
-    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
-    // 发起连接
-    esp_err_t err = esp_wifi_connect();
-    connected_ = (err == ESP_OK);
-    return connected_;
+    return connectAsync(ssid, password).wait() == ConnectResult::CONNECTED;
+}
+
+// 异步连接指定WiFi
+ConnectHandle BspWiFi::connectAsync(const std::string& ssid, const std::string& password,
+                                    const ConnectOptions& options) {
+    return WiFiConnector::getInstance().connect(ssid, password, options);
 }
 
 // 断开WiFi连接
 void BspWiFi::disconnect() {
     if (!initialized_) return;
-    esp_wifi_disconnect();
-    connected_ = false;
+    WiFiConnector::getInstance().disconnect();
+}
+
+// 是否已连接并获取到IP
+bool BspWiFi::isConnected() const {
+    return initialized_ && WiFiConnector::getInstance().isConnected();
 }
 
 // 头文件实现
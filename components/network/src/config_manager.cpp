@@ -9,18 +9,20 @@
  * Copyright (c) 2025 by ${git_name_email}, All Rights Reserved. 
  */
 #include "config_manager.hpp"
-#include <iostream>
+#include "cf_log.hpp"
 
 namespace chunfeng {
 
+static const char* TAG = "ConfigManager";
+
 ConfigManager::ConfigManager() {
-    std::cout << "[ConfigManager] 初始化..." << std::endl;
+    CF_LOGI(TAG, "初始化...");
     initialized_ = true;
     started_ = false;
 }
 
 ConfigManager::~ConfigManager() {
-    std::cout << "[ConfigManager] 析构..." << std::endl;
+    CF_LOGI(TAG, "析构...");
     stopConfig();
     initialized_ = false;
     started_ = false;
@@ -35,19 +37,19 @@ bool ConfigManager::isInitialized() const {
     return initialized_;
 }
 
-bool ConfigManager::startConfig() {
+bool ConfigManager::startConfig(bool portal) {
     if (!initialized_) {
-        std::cerr << "[ConfigManager] 错误：未初始化，无法启动配网。" << std::endl;
+        CF_LOGE(TAG, "错误：未初始化，无法启动配网。");
         return false;
     }
     if (started_) {
-        std::cout << "[ConfigManager] 配网已启动，无需重复启动。" << std::endl;
+        CF_LOGI(TAG, "配网已启动，无需重复启动。");
         return true;
     }
-    std::cout << "[ConfigManager] 启动配网（AP+STA+网页）..." << std::endl;
+    CF_LOGI(TAG, "启动配网（%s+网页）...", portal ? "AP+STA" : "STA");
     // 启动配网驱动
-    if (!config_network_.start()) {
-        std::cerr << "[ConfigManager] 配网驱动启动失败！" << std::endl;
+    if (!config_network_.start(portal)) {
+        CF_LOGE(TAG, "配网驱动启动失败！");
         return false;
     }
     started_ = true;
@@ -56,13 +58,29 @@ bool ConfigManager::startConfig() {
 
 void ConfigManager::stopConfig() {
     if (!started_) {
-        std::cout << "[ConfigManager] 配网未启动，无需停止。" << std::endl;
+        CF_LOGI(TAG, "配网未启动，无需停止。");
         return;
     }
-    std::cout << "[ConfigManager] 停止配网..." << std::endl;
+    CF_LOGI(TAG, "停止配网...");
     // 停止配网驱动
     config_network_.stop();
     started_ = false;
 }
 
+bool ConfigManager::openPortal() {
+    if (!started_) {
+        CF_LOGE(TAG, "错误：配网未启动，无法开启配网AP。");
+        return false;
+    }
+    return config_network_.setPortal(true);
+}
+
+void ConfigManager::closePortal() {
+    if (started_) config_network_.setPortal(false);
+}
+
+bool ConfigManager::portalOpen() const {
+    return config_network_.portalOpen();
+}
+
 } // namespace chunfeng 
\ No newline at end of file
@@ -0,0 +1,554 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-12 11:02:19
+ * @LastEditTime: 2025-06-12 16:05:44
+ * @LastEditors: 星年
+ * @Description: HTTPS 连接池实现：连接复用、会话票据、空闲回收与 HTTP/1.1 请求
+ * @FilePath: \ESP32-ChunFeng\components\network\src\connection_pool.cpp
+ * @遇事不决，可问春风
+ */
+#include "connection_pool.hpp"
+#include "cf_log.hpp"
+#include "metrics.hpp"
+#include "esp_crt_bundle.h"
+#include "esp_timer.h"
+#include "mbedtls/ssl.h"
+#include "sdkconfig.h"
+#include <sys/select.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+namespace chunfeng {
+
+static const char* TAG = "ConnPool";
+
+/**
+ * @brief 每条连接除 mbedTLS 收发缓冲外的开销：ssl 上下文、会话、握手时的证书链与密钥交换临时数据
+ */
+static constexpr size_t kConnOverhead = 8 * 1024;
+static constexpr size_t kMasterLen = 48;
+static constexpr size_t kMaxHeaderLen = 4096;
+static constexpr size_t kReadChunk = 1024;
+
+// 耗时分桶（毫秒）
+static const uint32_t kHandshakeBucketsMs[] = {25, 50, 100, 200, 300, 500, 750, 1000, 2000, 5000};
+static const uint32_t kRequestBucketsMs[] = {25, 50, 100, 200, 300, 500, 750, 1000, 2000, 5000};
+
+static metrics::Counter s_handshake_full("chunfeng_tls_handshakes_total", "TLS 握手次数", "mode=\"full\"");
+static metrics::Counter s_handshake_resumed("chunfeng_tls_handshakes_total", "TLS 握手次数", "mode=\"resumed\"");
+static metrics::Histogram s_handshake_full_ms("chunfeng_tls_handshake_ms", "TCP 连接加 TLS 握手耗时（毫秒）",
+                                              kHandshakeBucketsMs,
+                                              sizeof(kHandshakeBucketsMs) / sizeof(kHandshakeBucketsMs[0]),
+                                              "mode=\"full\"");
+static metrics::Histogram s_handshake_resumed_ms("chunfeng_tls_handshake_ms", "TCP 连接加 TLS 握手耗时（毫秒）",
+                                                 kHandshakeBucketsMs,
+                                                 sizeof(kHandshakeBucketsMs) / sizeof(kHandshakeBucketsMs[0]),
+                                                 "mode=\"resumed\"");
+static metrics::Counter s_connect_errors("chunfeng_tls_connect_errors_total", "TCP 连接或 TLS 握手失败次数");
+static metrics::Counter s_pool_reused("chunfeng_pool_reused_total", "复用空闲连接次数（每次省去一次握手）");
+static metrics::Counter s_pool_stale("chunfeng_pool_stale_total", "复用时发现已被服务器关闭的空闲连接");
+static metrics::Counter s_pool_waits("chunfeng_pool_waits_total", "连接数已满时等待归还的次数");
+static metrics::Counter s_pool_wait_timeouts("chunfeng_pool_wait_timeouts_total", "等待归还超时次数");
+static metrics::Gauge s_pool_open("chunfeng_pool_connections", "已打开的 TLS 连接数");
+static metrics::Histogram s_request_ms("chunfeng_https_request_ms", "HTTPS 请求耗时（含借出连接，毫秒）",
+                                       kRequestBucketsMs, sizeof(kRequestBucketsMs) / sizeof(kRequestBucketsMs[0]));
+static metrics::Counter s_request_errors("chunfeng_https_request_errors_total", "HTTPS 请求失败次数");
+
+/**
+ * @brief 一条 TLS 连接
+ */
+struct PoolConnection {
+    ConnectionPool* pool{nullptr};
+    std::string host;
+    uint16_t port{0};
+    esp_tls_t* tls{nullptr};
+    int64_t idle_since_us{0};
+    uint32_t requests{0};       ///< 已借出次数
+    bool in_use{false};
+    bool reused{false};         ///< 本次借出的是空闲连接
+    bool resumed{false};        ///< 建立时恢复了会话
+};
+
+/**
+ * @brief 某个主机最近一次握手得到的会话票据
+ */
+struct ConnectionPool::Session {
+    std::string host;
+    uint16_t port{0};
+    std::shared_ptr<esp_tls_client_session_t> ticket;
+    uint8_t master[kMasterLen]{};   ///< 票据对应的主密钥，用来判断下次握手是否恢复了会话
+    bool has_master{false};
+};
+
+static int64_t elapsedMs(int64_t start_us) {
+    return (esp_timer_get_time() - start_us) / 1000;
+}
+
+/**
+ * @brief 读取当前连接的主密钥
+ *
+ * esp_tls 不提供"会话是否恢复"的接口；TLS 1.2 恢复会话沿用原主密钥，完整握手重新协商，
+ * 比较前后两次的主密钥即可区分。mbedtls_ssl_get_session() 每条连接只能导出一次
+ * （已留给 esp_tls_get_client_session），这里用只读的 get_session_pointer。
+ */
+static bool masterSecret(esp_tls_t* tls, uint8_t* out) {
+    auto* ssl = static_cast<const mbedtls_ssl_context*>(esp_tls_get_ssl_context(tls));
+    if (!ssl) return false;
+    const mbedtls_ssl_session* session = mbedtls_ssl_get_session_pointer(ssl);
+    if (!session) return false;
+    memcpy(out, session->MBEDTLS_PRIVATE(master), kMasterLen);
+    return true;
+}
+
+/**
+ * @brief 空闲连接是否仍可用：空闲时不应有数据可读，可读说明对端已发来 FIN 或 close_notify
+ */
+static bool idleAlive(esp_tls_t* tls) {
+    if (esp_tls_get_bytes_avail(tls) > 0) return false;
+    int fd = -1;
+    if (esp_tls_get_conn_sockfd(tls, &fd) != ESP_OK || fd < 0) return false;
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    FD_SET(fd, &rfds);
+    struct timeval tv = {0, 0};
+    return select(fd + 1, &rfds, nullptr, nullptr, &tv) == 0;
+}
+
+/* ---------- PooledConnection ---------- */
+
+PooledConnection::PooledConnection(PooledConnection&& other) noexcept : conn_(other.conn_) {
+    other.conn_ = nullptr;
+}
+
+PooledConnection& PooledConnection::operator=(PooledConnection&& other) noexcept {
+    if (this != &other) {
+        release();
+        conn_ = other.conn_;
+        other.conn_ = nullptr;
+    }
+    return *this;
+}
+
+esp_tls_t* PooledConnection::tls() const {
+    return conn_ ? conn_->tls : nullptr;
+}
+
+bool PooledConnection::reused() const {
+    return conn_ && conn_->reused;
+}
+
+bool PooledConnection::resumed() const {
+    return conn_ && conn_->resumed;
+}
+
+ssize_t PooledConnection::write(const void* data, size_t len) {
+    if (!conn_) return -1;
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = esp_tls_conn_write(conn_->tls, p + written, len - written);
+        if (n == ESP_TLS_ERR_SSL_WANT_WRITE || n == ESP_TLS_ERR_SSL_WANT_READ) continue;
+        if (n <= 0) return n < 0 ? n : -1;
+        written += n;
+    }
+    return static_cast<ssize_t>(written);
+}
+
+ssize_t PooledConnection::read(void* data, size_t len) {
+    if (!conn_) return -1;
+    return esp_tls_conn_read(conn_->tls, data, len);
+}
+
+void PooledConnection::release(bool reusable) {
+    if (!conn_) return;
+    PoolConnection* conn = conn_;
+    conn_ = nullptr;
+    conn->pool->giveBack(conn, reusable);
+}
+
+/* ---------- ConnectionPool ---------- */
+
+ConnectionPool& ConnectionPool::getInstance() {
+    static ConnectionPool instance;
+    return instance;
+}
+
+ConnectionPool::ConnectionPool() = default;
+
+void ConnectionPool::configure(const PoolConfig& config) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    config_ = config;
+}
+
+size_t ConnectionPool::maxConnections() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return limitLocked();
+}
+
+size_t ConnectionPool::limitLocked() const {
+    size_t per_conn = CONFIG_MBEDTLS_SSL_IN_CONTENT_LEN + CONFIG_MBEDTLS_SSL_OUT_CONTENT_LEN + kConnOverhead;
+    return std::max<size_t>(1, config_.memory_budget / per_conn);
+}
+
+size_t ConnectionPool::countLocked(const std::string& host, uint16_t port) const {
+    size_t n = 0;
+    for (const PoolConnection* c : conns_) {
+        if (c->port == port && c->host == host) ++n;
+    }
+    std::string key = host + ":" + std::to_string(port);
+    n += std::count(connecting_.begin(), connecting_.end(), key);
+    return n;
+}
+
+std::shared_ptr<ConnectionPool::Session> ConnectionPool::sessionLocked(const std::string& host, uint16_t port) {
+    for (auto& s : sessions_) {
+        if (s->port == port && s->host == host) return s;
+    }
+    auto s = std::make_shared<Session>();
+    s->host = host;
+    s->port = port;
+    sessions_.push_back(s);
+    return s;
+}
+
+void ConnectionPool::removeLocked(PoolConnection* conn) {
+    conns_.erase(std::remove(conns_.begin(), conns_.end(), conn), conns_.end());
+    s_pool_open.set(static_cast<int32_t>(conns_.size()));
+}
+
+void ConnectionPool::reapIdleLocked(int64_t now_us, std::vector<PoolConnection*>& closed) {
+    int64_t limit_us = static_cast<int64_t>(config_.idle_timeout_ms) * 1000;
+    for (PoolConnection* c : conns_) {
+        if (!c->in_use && now_us - c->idle_since_us >= limit_us) closed.push_back(c);
+    }
+    for (PoolConnection* c : closed) removeLocked(c);
+}
+
+void ConnectionPool::destroy(PoolConnection* conn) {
+    esp_tls_conn_destroy(conn->tls);
+    delete conn;
+}
+
+PooledConnection ConnectionPool::acquire(const std::string& host, uint16_t port) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(config_.acquire_timeout_ms);
+    bool waited = false;
+
+    while (true) {
+        std::vector<PoolConnection*> closed;
+        int64_t now_us = esp_timer_get_time();
+        reapIdleLocked(now_us, closed);
+
+        // 1. 同一主机的空闲连接，最近归还的优先（更不容易被服务器超时关闭）
+        PoolConnection* idle = nullptr;
+        for (PoolConnection* c : conns_) {
+            if (c->in_use || c->port != port || c->host != host) continue;
+            if (!idle || c->idle_since_us > idle->idle_since_us) idle = c;
+        }
+        if (idle) {
+            if (idleAlive(idle->tls)) {
+                idle->in_use = true;
+                idle->reused = true;
+                ++idle->requests;
+                s_pool_reused.inc();
+                lock.unlock();
+                for (PoolConnection* c : closed) destroy(c);
+                return PooledConnection(idle);
+            }
+            s_pool_stale.inc();
+            removeLocked(idle);
+            closed.push_back(idle);
+        }
+
+        // 2. 未达上限则新建
+        size_t open = conns_.size() + connecting_.size();
+        size_t limit = limitLocked();
+        bool host_full = countLocked(host, port) >= config_.max_per_host;
+
+        // 3. 总数已满但本主机未满：关闭其他主机最久未用的空闲连接腾出名额
+        if (open >= limit && !host_full) {
+            PoolConnection* victim = nullptr;
+            for (PoolConnection* c : conns_) {
+                if (!c->in_use && (!victim || c->idle_since_us < victim->idle_since_us)) victim = c;
+            }
+            if (victim) {
+                removeLocked(victim);
+                closed.push_back(victim);
+                --open;
+            }
+        }
+
+        if (open < limit && !host_full) {
+            std::string key = host + ":" + std::to_string(port);
+            connecting_.push_back(key);
+            lock.unlock();
+            for (PoolConnection* c : closed) destroy(c);
+
+            PoolConnection* conn = connect(host, port);
+
+            lock.lock();
+            connecting_.erase(std::find(connecting_.begin(), connecting_.end(), key));
+            if (conn) {
+                conns_.push_back(conn);
+                s_pool_open.set(static_cast<int32_t>(conns_.size()));
+                return PooledConnection(conn);
+            }
+            released_.notify_all();     // 让出的名额给其他等待者
+            return PooledConnection();
+        }
+
+        if (!closed.empty()) {
+            lock.unlock();
+            for (PoolConnection* c : closed) destroy(c);
+            lock.lock();
+            continue;
+        }
+
+        // 4. 等待其他请求归还
+        if (!waited) {
+            waited = true;
+            s_pool_waits.inc();
+        }
+        if (released_.wait_until(lock, deadline) == std::cv_status::timeout) {
+            s_pool_wait_timeouts.inc();
+            CF_LOGW(TAG, "等待 %s 的连接超时（已打开 %u 条）", host.c_str(), static_cast<unsigned>(open));
+            return PooledConnection();
+        }
+    }
+}
+
+PoolConnection* ConnectionPool::connect(const std::string& host, uint16_t port) {
+    std::shared_ptr<Session> session;
+    std::shared_ptr<esp_tls_client_session_t> ticket;
+    uint8_t prev_master[kMasterLen];
+    bool has_master = false;
+    uint32_t timeout_ms;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        session = sessionLocked(host, port);
+        ticket = session->ticket;
+        has_master = session->has_master;
+        memcpy(prev_master, session->master, kMasterLen);
+        timeout_ms = config_.timeout_ms;
+    }
+
+    esp_tls_cfg_t cfg = {};
+    cfg.timeout_ms = static_cast<int>(timeout_ms);
+    cfg.crt_bundle_attach = esp_crt_bundle_attach;
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    cfg.client_session = ticket.get();
+#endif
+
+    int64_t start = esp_timer_get_time();
+    esp_tls_t* tls = esp_tls_init();
+    if (!tls || esp_tls_conn_new_sync(host.c_str(), static_cast<int>(host.size()), port, &cfg, tls) != 1) {
+        s_connect_errors.inc();
+        CF_LOGE(TAG, "连接 %s:%u 失败", host.c_str(), port);
+        if (tls) esp_tls_conn_destroy(tls);
+        return nullptr;
+    }
+    uint32_t handshake_ms = static_cast<uint32_t>(elapsedMs(start));
+
+    uint8_t master[kMasterLen];
+    bool got_master = masterSecret(tls, master);
+    bool resumed = ticket && has_master && got_master && memcmp(master, prev_master, kMasterLen) == 0;
+    if (resumed) {
+        s_handshake_resumed.inc();
+        s_handshake_resumed_ms.observe(handshake_ms);
+    } else {
+        s_handshake_full.inc();
+        s_handshake_full_ms.observe(handshake_ms);
+    }
+    CF_LOGI(TAG, "已连接 %s:%u（%s握手 %u ms）", host.c_str(), port, resumed ? "恢复会话" : "完整",
+            static_cast<unsigned>(handshake_ms));
+
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    // 保存最新的票据：服务器可能在恢复会话时换发新票据
+    esp_tls_client_session_t* fresh = esp_tls_get_client_session(tls);
+    if (fresh) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        session->ticket.reset(fresh, esp_tls_free_client_session);
+        session->has_master = got_master;
+        if (got_master) memcpy(session->master, master, kMasterLen);
+    }
+#endif
+
+    auto* conn = new PoolConnection();
+    conn->pool = this;
+    conn->host = host;
+    conn->port = port;
+    conn->tls = tls;
+    conn->in_use = true;
+    conn->requests = 1;
+    conn->resumed = resumed;
+    return conn;
+}
+
+void ConnectionPool::giveBack(PoolConnection* conn, bool reusable) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        conn->in_use = false;
+        conn->reused = false;
+        conn->idle_since_us = esp_timer_get_time();
+        if (reusable) {
+            conn = nullptr;
+        } else {
+            removeLocked(conn);
+        }
+    }
+    released_.notify_all();
+    if (conn) destroy(conn);
+}
+
+void ConnectionPool::closeIdle() {
+    std::vector<PoolConnection*> closed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (PoolConnection* c : conns_) {
+            if (!c->in_use) closed.push_back(c);
+        }
+        for (PoolConnection* c : closed) removeLocked(c);
+    }
+    for (PoolConnection* c : closed) destroy(c);
+    if (!closed.empty()) {
+        released_.notify_all();
+        CF_LOGI(TAG, "关闭 %u 条空闲连接", static_cast<unsigned>(closed.size()));
+    }
+}
+
+/* ---------- HTTP/1.1 ---------- */
+
+/**
+ * @brief 一次请求/响应交换
+ * @param received [out] 是否收到了响应字节（用于判断能否在新连接上重试）
+ */
+static esp_err_t exchange(PooledConnection& conn, const std::string& request, HttpResponse& response,
+                          bool* received) {
+    *received = false;
+    if (conn.write(request.data(), request.size()) != static_cast<ssize_t>(request.size())) return ESP_FAIL;
+
+    std::string buf;
+    char chunk[kReadChunk];
+    // 阻塞读，超时（WANT_READ）与对端关闭一样视为失败
+    auto fill = [&]() -> bool {
+        ssize_t n = conn.read(chunk, sizeof(chunk));
+        if (n <= 0) return false;
+        *received = true;
+        buf.append(chunk, n);
+        return true;
+    };
+
+    // 状态行与响应头
+    size_t header_end;
+    while ((header_end = buf.find("\r\n\r\n")) == std::string::npos) {
+        if (buf.size() > kMaxHeaderLen || !fill()) return ESP_FAIL;
+    }
+    if (buf.compare(0, 5, "HTTP/") != 0) return ESP_ERR_INVALID_RESPONSE;
+    size_t sp = buf.find(' ');
+    response.status = sp < header_end ? atoi(buf.c_str() + sp + 1) : 0;
+    bool http10 = buf.compare(0, 8, "HTTP/1.0") == 0;
+    response.keep_alive = !http10;
+
+    long content_length = -1;
+    bool chunked = false;
+    size_t line = buf.find("\r\n") + 2;
+    while (line < header_end) {
+        size_t eol = buf.find("\r\n", line);
+        size_t colon = buf.find(':', line);
+        if (colon != std::string::npos && colon < eol) {
+            std::string name = buf.substr(line, colon - line);
+            size_t v = buf.find_first_not_of(' ', colon + 1);
+            std::string value = buf.substr(v, eol - v);
+            if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+                content_length = strtol(value.c_str(), nullptr, 10);
+            } else if (strcasecmp(name.c_str(), "Transfer-Encoding") == 0) {
+                chunked = strcasestr(value.c_str(), "chunked") != nullptr;
+            } else if (strcasecmp(name.c_str(), "Connection") == 0) {
+                if (strcasestr(value.c_str(), "close")) response.keep_alive = false;
+                if (strcasestr(value.c_str(), "keep-alive")) response.keep_alive = true;
+            }
+        }
+        line = eol + 2;
+    }
+    buf.erase(0, header_end + 4);
+
+    response.body.clear();
+    if (response.status == 204 || response.status == 304 || (response.status >= 100 && response.status < 200)) {
+        return ESP_OK;
+    }
+    if (chunked) {
+        while (true) {
+            size_t eol;
+            while ((eol = buf.find("\r\n")) == std::string::npos) {
+                if (!fill()) return ESP_FAIL;
+            }
+            size_t size = strtoul(buf.c_str(), nullptr, 16);
+            buf.erase(0, eol + 2);
+            if (size == 0) {
+                // 忽略 trailer，读到空行为止
+                while (buf.find("\r\n") == std::string::npos) {
+                    if (!fill()) return ESP_FAIL;
+                }
+                return ESP_OK;
+            }
+            while (buf.size() < size + 2) {
+                if (!fill()) return ESP_FAIL;
+            }
+            response.body.append(buf, 0, size);
+            buf.erase(0, size + 2);
+        }
+    }
+    if (content_length >= 0) {
+        while (buf.size() < static_cast<size_t>(content_length)) {
+            if (!fill()) return ESP_FAIL;
+        }
+        response.body.assign(buf, 0, content_length);
+        return ESP_OK;
+    }
+    // 没有长度：读到对端关闭，连接不能复用
+    response.keep_alive = false;
+    while (fill()) {}
+    response.body = std::move(buf);
+    return ESP_OK;
+}
+
+esp_err_t ConnectionPool::request(const char* method, const std::string& host, const std::string& path,
+                                  const std::string& body, HttpResponse& response, const char* content_type,
+                                  const std::string& extra_headers, uint16_t port) {
+    std::string req;
+    req.reserve(256 + extra_headers.size() + body.size());
+    req.append(method).append(" ").append(path).append(" HTTP/1.1\r\n");
+    req.append("Host: ").append(host).append("\r\n");
+    req.append("Connection: keep-alive\r\n");
+    if (!body.empty() || strcmp(method, "POST") == 0 || strcmp(method, "PUT") == 0) {
+        req.append("Content-Type: ").append(content_type).append("\r\n");
+        req.append("Content-Length: ").append(std::to_string(body.size())).append("\r\n");
+    }
+    req.append(extra_headers).append("\r\n").append(body);
+
+    int64_t start = esp_timer_get_time();
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        PooledConnection conn = acquire(host, port);
+        if (!conn.valid()) break;
+        bool reused = conn.reused();
+        bool received = false;
+        esp_err_t err = exchange(conn, req, response, &received);
+        if (err == ESP_OK) {
+            conn.release(response.keep_alive);
+            s_request_ms.observe(static_cast<uint32_t>(elapsedMs(start)));
+            return ESP_OK;
+        }
+        conn.release(false);
+        // 服务器可能刚好在我们复用前关闭了空闲连接：请求没有被处理，换新连接重试一次
+        if (!reused || received) break;
+        s_pool_stale.inc();
+        CF_LOGW(TAG, "复用的连接已失效，重新连接 %s", host.c_str());
+    }
+    s_request_errors.inc();
+    return ESP_FAIL;
+}
+
+} // namespace chunfeng
@@ -0,0 +1,486 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-11 09:48:03
+ * @LastEditTime: 2025-06-11 15:37:52
+ * @LastEditors: 星年
+ * @Description: DNS 缓存实现：A 记录查询、TTL 管理、NVS 持久化与后台重新解析
+ * @FilePath: \ESP32-ChunFeng\components\network\src\dns_cache.cpp
+ * @遇事不决，可问春风
+ */
+#include "dns_cache.hpp"
+#include "cf_log.hpp"
+#include "metrics.hpp"
+#include "task_topology.hpp"
+#include "esp_netif.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+namespace chunfeng {
+
+static const char* TAG = "DnsCache";
+
+#define DNS_NVS_NAMESPACE "dns_cache"
+#define DNS_NVS_KEY       "entries"
+
+static constexpr uint8_t kStoreVersion = 1;
+static constexpr time_t kClockValidAfter = 1704067200;  // 2024-01-01，早于此说明尚未同步时间
+static constexpr size_t kMaxPacket = 512;
+
+// 查询耗时分桶（毫秒）
+static const uint32_t kQueryBucketsMs[] = {10, 25, 50, 100, 250, 500, 1000, 2000};
+
+static metrics::Counter s_lookup_fresh("chunfeng_dns_cache_lookups_total", "DNS 缓存查找结果", "result=\"fresh\"");
+static metrics::Counter s_lookup_stale("chunfeng_dns_cache_lookups_total", "DNS 缓存查找结果", "result=\"stale\"");
+static metrics::Counter s_lookup_miss("chunfeng_dns_cache_lookups_total", "DNS 缓存查找结果", "result=\"miss\"");
+static metrics::Histogram s_query_ms("chunfeng_dns_query_ms", "DNS 查询耗时（毫秒）", kQueryBucketsMs,
+                                     sizeof(kQueryBucketsMs) / sizeof(kQueryBucketsMs[0]));
+static metrics::Counter s_query_errors("chunfeng_dns_query_errors_total", "DNS 查询失败次数");
+
+/**
+ * @brief NVS 中保存的一条记录
+ */
+struct StoredEntry {
+    char host[DnsCache::kMaxHostLen + 1];
+    uint32_t addr;          ///< 网络字节序
+    uint32_t ttl_sec;
+    uint32_t resolved_at;   ///< Unix 秒，0 表示解析时时间未同步
+};
+
+struct StoredHeader {
+    uint8_t version;
+    uint8_t count;
+    uint16_t reserved;
+};
+
+/**
+ * @brief 当前 Unix 时间，未同步时返回 0
+ */
+static uint32_t wallClock() {
+    time_t now = time(nullptr);
+    return now > kClockValidAfter ? static_cast<uint32_t>(now) : 0;
+}
+
+static uint32_t clampTtl(uint32_t ttl) {
+    if (ttl < DnsCache::kMinTtlSec) return DnsCache::kMinTtlSec;
+    if (ttl > DnsCache::kMaxTtlSec) return DnsCache::kMaxTtlSec;
+    return ttl;
+}
+
+/* ---------- DNS 报文 ---------- */
+
+static uint16_t readU16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+static uint32_t readU32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+/**
+ * @brief 构造 A 记录查询报文
+ * @return 报文长度，域名非法时返回 0
+ */
+static size_t buildQuery(uint8_t* buf, uint16_t id, const std::string& host) {
+    if (host.empty() || host.size() > DnsCache::kMaxHostLen) return 0;
+    memset(buf, 0, 12);
+    buf[0] = static_cast<uint8_t>(id >> 8);
+    buf[1] = static_cast<uint8_t>(id);
+    buf[2] = 0x01;  // RD：请求递归
+    buf[5] = 1;     // QDCOUNT
+    size_t pos = 12;
+    size_t start = 0;
+    while (start <= host.size()) {
+        size_t dot = host.find('.', start);
+        if (dot == std::string::npos) dot = host.size();
+        size_t len = dot - start;
+        if (len == 0 || len > 63) return 0;
+        buf[pos++] = static_cast<uint8_t>(len);
+        memcpy(buf + pos, host.data() + start, len);
+        pos += len;
+        start = dot + 1;
+    }
+    buf[pos++] = 0;
+    buf[pos++] = 0;
+    buf[pos++] = 1;  // QTYPE A
+    buf[pos++] = 0;
+    buf[pos++] = 1;  // QCLASS IN
+    return pos;
+}
+
+/**
+ * @brief 跳过报文中的域名（支持压缩指针）
+ */
+static bool skipName(const uint8_t* buf, size_t len, size_t& pos) {
+    while (pos < len) {
+        uint8_t b = buf[pos];
+        if (b == 0) {
+            pos += 1;
+            return true;
+        }
+        if ((b & 0xC0) == 0xC0) {
+            pos += 2;
+            return pos <= len;
+        }
+        if (b & 0xC0) return false;
+        pos += b + 1u;
+    }
+    return false;
+}
+
+/**
+ * @brief 解析应答，取第一条 A 记录
+ *
+ * TTL 取 CNAME 链与 A 记录中的最小值，链上任何一环过期都需要重新解析。
+ */
+static bool parseResponse(const uint8_t* buf, size_t len, uint16_t id, uint32_t* addr, uint32_t* ttl) {
+    if (len < 12 || readU16(buf) != id) return false;
+    if (!(buf[2] & 0x80) || (buf[3] & 0x0F) != 0) return false;  // 非应答或 RCODE 非 0
+    uint16_t qdcount = readU16(buf + 4);
+    uint16_t ancount = readU16(buf + 6);
+    size_t pos = 12;
+    for (uint16_t i = 0; i < qdcount; ++i) {
+        if (!skipName(buf, len, pos)) return false;
+        pos += 4;
+    }
+    uint32_t min_ttl = UINT32_MAX;
+    for (uint16_t i = 0; i < ancount; ++i) {
+        if (!skipName(buf, len, pos) || pos + 10 > len) return false;
+        uint16_t type = readU16(buf + pos);
+        uint16_t cls = readU16(buf + pos + 2);
+        uint32_t rr_ttl = readU32(buf + pos + 4);
+        uint16_t rdlen = readU16(buf + pos + 8);
+        pos += 10;
+        if (pos + rdlen > len) return false;
+        if (rr_ttl < min_ttl) min_ttl = rr_ttl;
+        if (type == 1 && cls == 1 && rdlen == 4) {
+            memcpy(addr, buf + pos, 4);
+            *ttl = min_ttl;
+            return true;
+        }
+        pos += rdlen;
+    }
+    return false;
+}
+
+/**
+ * @brief 向指定服务器发送一次 A 记录查询
+ */
+static bool queryA(uint32_t server, uint16_t port, const std::string& host, uint32_t timeout_ms,
+                   uint32_t* addr, uint32_t* ttl) {
+    uint8_t buf[kMaxPacket];
+    uint16_t id = static_cast<uint16_t>(esp_random());
+    size_t qlen = buildQuery(buf, id, host);
+    if (qlen == 0) return false;
+
+    int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0) return false;
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    struct sockaddr_in sa = {};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    sa.sin_addr.s_addr = server;
+    bool ok = false;
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&sa), sizeof(sa)) == 0 &&
+        send(fd, buf, qlen, 0) == static_cast<ssize_t>(qlen)) {
+        // 丢弃 ID 不匹配的迟到应答，直到超时
+        while (true) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) break;
+            if (parseResponse(buf, static_cast<size_t>(n), id, addr, ttl)) {
+                ok = true;
+                break;
+            }
+            if (n >= 2 && readU16(buf) == id) break;  // 本次查询的应答，但没有 A 记录
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+/* ---------- DnsCache ---------- */
+
+DnsCache& DnsCache::getInstance() {
+    static DnsCache instance;
+    return instance;
+}
+
+DnsCache::DnsCache() {
+    entries_.reserve(kMaxEntries);
+    load();
+    refresh_queue_ = xQueueCreate(kMaxEntries, sizeof(uint8_t));
+    tasks::spawn(tasks::TaskId::DNS_REFRESH, refreshTask, this);
+}
+
+void DnsCache::addHost(const std::string& host) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int idx = findLocked(host);
+    if (idx < 0) idx = insertLocked(host);
+    if (idx < 0) {
+        CF_LOGW(TAG, "缓存已满，无法登记: %s", host);
+        return;
+    }
+    entries_[idx].service = true;
+}
+
+void DnsCache::setServer(uint32_t addr, uint16_t port) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    server_addr_ = addr;
+    server_port_ = port;
+}
+
+bool DnsCache::resolve(const std::string& host, uint32_t* addr, uint32_t timeout_ms) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        int idx = findLocked(host);
+        if (idx >= 0 && entries_[idx].addr == 0 && entries_[idx].refreshing) {
+            // 后台正在预解析同一域名：等它的结果，不重复查询
+            refreshed_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                [&] { return !entries_[idx].refreshing; });
+        }
+        int64_t now = esp_timer_get_time();
+        if (idx >= 0 && entries_[idx].addr != 0) {
+            Entry& e = entries_[idx];
+            if (e.expires_us > now) {
+                s_lookup_fresh.inc();
+                *addr = e.addr;
+                return true;
+            }
+            if (e.stale_until_us > now) {
+                // 乐观使用旧地址，后台重新解析
+                s_lookup_stale.inc();
+                *addr = e.addr;
+                scheduleRefreshLocked(idx);
+                return true;
+            }
+        }
+    }
+    s_lookup_miss.inc();
+    return refresh(host, timeout_ms, addr);
+}
+
+void DnsCache::onNetworkUp() {
+    int64_t now = esp_timer_get_time();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        const Entry& e = entries_[i];
+        if (e.service && (e.addr == 0 || e.expires_us <= now)) {
+            scheduleRefreshLocked(static_cast<int>(i));
+        }
+    }
+}
+
+int DnsCache::findLocked(const std::string& host) const {
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        if (entries_[i].host == host) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+int DnsCache::insertLocked(const std::string& host) {
+    if (host.empty() || host.size() > kMaxHostLen) return -1;
+    if (entries_.size() < kMaxEntries) {
+        entries_.push_back(Entry());
+        entries_.back().host = host;
+        return static_cast<int>(entries_.size() - 1);
+    }
+    // 已满：替换最早过期的非服务域名（下标不变，后台任务持有的下标仍指向同一位置）
+    int victim = -1;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        const Entry& e = entries_[i];
+        if (e.service || e.refreshing) continue;
+        if (victim < 0 || e.expires_us < entries_[victim].expires_us) victim = static_cast<int>(i);
+    }
+    if (victim >= 0) {
+        entries_[victim] = Entry();
+        entries_[victim].host = host;
+    }
+    return victim;
+}
+
+void DnsCache::scheduleRefreshLocked(int index) {
+    Entry& e = entries_[index];
+    if (e.refreshing || !refresh_queue_) return;
+    uint8_t item = static_cast<uint8_t>(index);
+    if (xQueueSend(refresh_queue_, &item, 0) == pdTRUE) {
+        e.refreshing = true;
+    }
+}
+
+bool DnsCache::serverAddress(uint32_t* addr, uint16_t* port) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (server_addr_ != 0) {
+            *addr = server_addr_;
+            *port = server_port_;
+            return true;
+        }
+    }
+    esp_netif_t* sta = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    if (!sta) return false;
+    esp_netif_dns_info_t dns;
+    if (esp_netif_get_dns_info(sta, ESP_NETIF_DNS_MAIN, &dns) != ESP_OK ||
+        dns.ip.type != ESP_IPADDR_TYPE_V4 || dns.ip.u_addr.ip4.addr == 0) {
+        return false;
+    }
+    *addr = dns.ip.u_addr.ip4.addr;
+    *port = 53;
+    return true;
+}
+
+bool DnsCache::refresh(const std::string& host, uint32_t timeout_ms, uint32_t* addr) {
+    uint32_t server;
+    uint16_t port;
+    if (!serverAddress(&server, &port)) {
+        CF_LOGW(TAG, "没有可用的 DNS 服务器，无法解析 %s", host);
+        return false;
+    }
+
+    // UDP 可能丢包：超时时间分成两次尝试
+    int64_t t0 = esp_timer_get_time();
+    uint32_t resolved = 0, ttl = 0;
+    bool ok = false;
+    for (int attempt = 0; attempt < 2 && !ok; ++attempt) {
+        ok = queryA(server, port, host, timeout_ms / 2, &resolved, &ttl);
+    }
+    if (!ok) {
+        s_query_errors.inc();
+        CF_LOGW(TAG, "解析失败: %s", host);
+        return false;
+    }
+    s_query_ms.observe(static_cast<uint32_t>((esp_timer_get_time() - t0) / 1000));
+    ttl = clampTtl(ttl);
+    *addr = resolved;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    int idx = findLocked(host);
+    if (idx < 0) idx = insertLocked(host);
+    if (idx < 0) return true;   // 缓存已满，本次结果不缓存
+    Entry& e = entries_[idx];
+    int64_t now = esp_timer_get_time();
+    uint32_t now_s = wallClock();
+    // 控制 NVS 写入频率：地址变化，或距上次保存已超过一个 TTL 时才写
+    bool dirty = e.addr != resolved || (now_s != 0 && (e.saved_at == 0 || now_s - e.saved_at >= ttl));
+    e.addr = resolved;
+    e.ttl_sec = ttl;
+    e.expires_us = now + static_cast<int64_t>(ttl) * 1000000;
+    e.stale_until_us = e.expires_us + static_cast<int64_t>(kMaxStaleSec) * 1000000;
+    if (dirty) {
+        e.saved_at = now_s;
+        saveLocked();
+    }
+    esp_ip4_addr_t ip = {resolved};
+    CF_LOGI(TAG, "%s -> " IPSTR " (TTL %u s)", host, IP2STR(&ip), ttl);
+    return true;
+}
+
+void DnsCache::refreshTask(void* arg) {
+    auto* self = static_cast<DnsCache*>(arg);
+    uint8_t index;
+    while (true) {
+        if (xQueueReceive(self->refresh_queue_, &index, portMAX_DELAY) != pdTRUE) continue;
+        std::string host;
+        bool needed;
+        {
+            std::lock_guard<std::mutex> lock(self->mutex_);
+            if (index >= self->entries_.size()) continue;
+            const Entry& e = self->entries_[index];
+            host = e.host;
+            // 排队期间可能已被同步解析刷新
+            needed = e.addr == 0 || e.expires_us <= esp_timer_get_time();
+        }
+        uint32_t addr;
+        if (needed) self->refresh(host, 3000, &addr);
+        {
+            std::lock_guard<std::mutex> lock(self->mutex_);
+            self->entries_[index].refreshing = false;
+        }
+        self->refreshed_.notify_all();
+    }
+}
+
+/* ---------- NVS 持久化 ---------- */
+
+void DnsCache::load() {
+    nvs_handle_t handle;
+    if (nvs_open(DNS_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return;
+    size_t len = 0;
+    std::vector<uint8_t> blob;
+    if (nvs_get_blob(handle, DNS_NVS_KEY, nullptr, &len) == ESP_OK && len >= sizeof(StoredHeader)) {
+        blob.resize(len);
+        if (nvs_get_blob(handle, DNS_NVS_KEY, blob.data(), &len) != ESP_OK) blob.clear();
+    }
+    nvs_close(handle);
+    if (blob.empty()) return;
+
+    StoredHeader header;
+    memcpy(&header, blob.data(), sizeof(header));
+    if (header.version != kStoreVersion || header.count > kMaxEntries ||
+        blob.size() < sizeof(header) + header.count * sizeof(StoredEntry)) {
+        CF_LOGW(TAG, "NVS 中的 DNS 缓存格式不兼容，忽略");
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    uint32_t now_s = wallClock();
+    for (uint8_t i = 0; i < header.count; ++i) {
+        StoredEntry rec;
+        memcpy(&rec, blob.data() + sizeof(header) + i * sizeof(StoredEntry), sizeof(rec));
+        rec.host[kMaxHostLen] = '\0';
+        if (rec.addr == 0 || rec.host[0] == '\0') continue;
+        Entry e;
+        e.host = rec.host;
+        e.addr = rec.addr;
+        e.ttl_sec = clampTtl(rec.ttl_sec);
+        e.saved_at = rec.resolved_at;
+        if (now_s != 0 && rec.resolved_at != 0 && now_s >= rec.resolved_at) {
+            uint32_t age = now_s - rec.resolved_at;
+            if (age > e.ttl_sec + kMaxStaleSec) continue;
+            if (age < e.ttl_sec) e.expires_us = now + static_cast<int64_t>(e.ttl_sec - age) * 1000000;
+            e.stale_until_us = now + static_cast<int64_t>(e.ttl_sec + kMaxStaleSec - age) * 1000000;
+        } else {
+            // 不知道记录的年龄：先用着，联网后立即重新解析
+            e.stale_until_us = INT64_MAX;
+        }
+        entries_.push_back(e);
+    }
+    CF_LOGI(TAG, "从 NVS 恢复 %u 条 DNS 记录", static_cast<uint32_t>(entries_.size()));
+}
+
+void DnsCache::saveLocked() {
+    std::vector<uint8_t> blob(sizeof(StoredHeader));
+    StoredHeader header = {kStoreVersion, 0, 0};
+    for (const Entry& e : entries_) {
+        if (e.addr == 0) continue;
+        StoredEntry rec = {};
+        strncpy(rec.host, e.host.c_str(), kMaxHostLen);
+        rec.addr = e.addr;
+        rec.ttl_sec = e.ttl_sec;
+        rec.resolved_at = e.saved_at;
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&rec);
+        blob.insert(blob.end(), p, p + sizeof(rec));
+        header.count++;
+    }
+    memcpy(blob.data(), &header, sizeof(header));
+
+    nvs_handle_t handle;
+    if (nvs_open(DNS_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) return;
+    esp_err_t err = nvs_set_blob(handle, DNS_NVS_KEY, blob.data(), blob.size());
+    if (err == ESP_OK) err = nvs_commit(handle);
+    nvs_close(handle);
+    if (err != ESP_OK) CF_LOGW(TAG, "保存 DNS 缓存失败: %d", err);
+}
+
+} // namespace chunfeng
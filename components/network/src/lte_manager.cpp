@@ -1,33 +1,34 @@
 /*** 
  * @Author: jixingnian@gmail.com
  * @Date: 2025-05-30 12:20:50
- * @LastEditTime: 2025-05-30 17:48:22
+ * @LastEditTime: 2025-06-25 10:41:37
  * @LastEditors: 星年
- * @Description: LTE 管理类实现，负责 LTE 的初始化、连接、断开与状态查询
+ * @Description: LTE 管理类实现：按需上电附着、待机保持与到期断电、状态与驻留内存统计
  * @FilePath: \ESP32-ChunFeng\components\network\src\lte_manager.cpp
  * @遇事不决，可问春风
  */
 #include "lte_manager.hpp"
-#include <iostream>
+#include "cf_log.hpp"
+#include "metrics.hpp"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
 
-static const char *TAG = "ML307";
+static const char *TAG = "LTEManager";
 
 namespace chunfeng {
 
-// 构造函数
-LTEManager::LTEManager()
-    : initialized_{false}, connected_{false}
-{
-    std::cout << "[LTEManager] 构造: 初始化 LTE 管理器..." << std::endl;
-}
+static metrics::Gauge s_state("chunfeng_lte_state", "4G 模组状态（LteState 枚举值，0 为断电）");
+static metrics::Gauge s_resident("chunfeng_lte_resident_bytes", "4G 模组上电期间占用的内部 RAM（字节）");
+static metrics::Counter s_power_ups("chunfeng_lte_power_ups_total", "4G 模组从断电到上电附着的次数");
+static metrics::Counter s_warm_resumes("chunfeng_lte_warm_resumes_total", "待机中再次使用、无需重新附着的次数");
+
+// 构造函数：只有状态与计时，模组在第一次 connect() 时才上电
+LTEManager::LTEManager() = default;
 
 // 析构函数
 LTEManager::~LTEManager()
 {
-    std::cout << "[LTEManager] 析构: 释放 LTE 相关资源..." << std::endl;
-    // 这里可以添加资源释放代码
-    initialized_ = false;
-    connected_ = false;
+    powerDown();
 }
 
 // 获取 LTEManager 单例实例
@@ -70,61 +71,102 @@ LTEManager& LTEManager::getInstance() {
 //     ws.Close();
 // }
 
-bool LTEManager::initialize(){
-    Ml307AtModem modem(GPIO_NUM_13, GPIO_NUM_14, 2048);
-    modem.SetDebug(true);
-    modem.SetBaudRate(921600);
-
-    modem.WaitForNetworkReady();
-
-    // Print IP Address
-    ESP_LOGI(TAG, "IP Address: %s", modem.ip_address().c_str());
-    // Print IMEI, ICCID, Product ID, Carrier Name
-    ESP_LOGI(TAG, "IMEI: %s", modem.GetImei().c_str());
-    ESP_LOGI(TAG, "ICCID: %s", modem.GetIccid().c_str());
-    ESP_LOGI(TAG, "Product ID: %s", modem.GetModuleName().c_str());
-    ESP_LOGI(TAG, "Carrier Name: %s", modem.GetCarrierName().c_str());
-    // Print CSQ
-    ESP_LOGI(TAG, "CSQ: %d", modem.GetCsq());
-    return true;
-    // TestWebSocket(modem);
+void LTEManager::setState(LteState state) {
+    state_.store(state);
+    s_state.set(static_cast<int32_t>(state));
 }
 
 // 连接 LTE（4G）网络
 bool LTEManager::connect() {
-    if (!initialized_) {
-        std::cerr << "[LTEManager] 错误：LTE 管理器未初始化，无法连接 4G。" << std::endl;
-        return false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    switch (state_.load()) {
+        case LteState::ACTIVE:
+            CF_LOGI(TAG, "已连接 4G，无需重复连接。");
+            return true;
+        case LteState::STANDBY:
+            CF_LOGI(TAG, "4G 待机中，直接恢复使用");
+            setState(LteState::ACTIVE);
+            s_warm_resumes.inc();
+            return true;
+        default:
+            break;
     }
-    if (connected_) {
-        std::cout << "[LTEManager] 已连接 4G，无需重复连接。" << std::endl;
-        return true;
+    CF_LOGI(TAG, "4G 模组上电，等待附着...");
+    setState(LteState::ATTACHING);
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    int64_t t0 = esp_timer_get_time();
+    modem_ = new Ml307AtModem(GPIO_NUM_13, GPIO_NUM_14, 2048);
+    modem_->SetDebug(false);
+    modem_->SetBaudRate(921600);
+    power_ups_++;
+    s_power_ups.inc();
+    size_t free_after = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    resident_bytes_.store(free_before > free_after ? free_before - free_after : 0);
+    s_resident.set(static_cast<int32_t>(resident_bytes_.load()));
+
+    if (modem_->WaitForNetworkReady() < 0) {
+        CF_LOGE(TAG, "4G 附着失败，断电");
+        powerDownLocked();
+        return false;
     }
-    std::cout << "[LTEManager] 正在连接 4G..." << std::endl;
-    // 这里添加实际的 4G 连接代码
-    // 假定连接成功
-    connected_ = true;
-    return connected_;
+    CF_LOGI(TAG, "4G 已附着，耗时 %u ms，IP %s，CSQ %d，驱动占用 %u 字节",
+            static_cast<unsigned>((esp_timer_get_time() - t0) / 1000), modem_->ip_address().c_str(),
+            modem_->GetCsq(), static_cast<unsigned>(resident_bytes_.load()));
+    CF_LOGI(TAG, "IMEI: %s，ICCID: %s，模组: %s，运营商: %s", modem_->GetImei().c_str(),
+            modem_->GetIccid().c_str(), modem_->GetModuleName().c_str(), modem_->GetCarrierName().c_str());
+    setState(LteState::ACTIVE);
+    return true;
 }
 
-// 断开 LTE（4G）网络连接
+// 不再使用 LTE（4G）网络：待机保持附着，linger 到期后断电
 void LTEManager::disconnect() {
-    if (!initialized_) {
-        std::cerr << "[LTEManager] 错误：LTE 管理器未初始化，无法断开 4G。" << std::endl;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_.load() != LteState::ACTIVE) return;
+    if (linger_ms_.load() == 0) {
+        powerDownLocked();
         return;
     }
-    if (!connected_) {
-        std::cout << "[LTEManager] 4G 已断开，无需重复断开。" << std::endl;
-        return;
+    CF_LOGI(TAG, "4G 不再使用，待机 %u ms 后断电", static_cast<unsigned>(linger_ms_.load()));
+    standby_since_us_ = esp_timer_get_time();
+    setState(LteState::STANDBY);
+}
+
+void LTEManager::powerDown() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    powerDownLocked();
+}
+
+void LTEManager::poll() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_.load() != LteState::STANDBY) return;
+    if (esp_timer_get_time() - standby_since_us_ >= static_cast<int64_t>(linger_ms_.load()) * 1000) {
+        powerDownLocked();
     }
-    std::cout << "[LTEManager] 正在断开 4G..." << std::endl;
-    // 这里添加实际的 4G 断开代码
-    connected_ = false;
+}
+
+void LTEManager::powerDownLocked() {
+    if (!modem_) return;
+    CF_LOGI(TAG, "4G 模组断电，释放驱动");
+    delete modem_;
+    modem_ = nullptr;
+    resident_bytes_.store(0);
+    s_resident.set(0);
+    setState(LteState::OFF);
+}
+
+int64_t LTEManager::powerDownAtUs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_.load() != LteState::STANDBY) return 0;
+    return standby_since_us_ + static_cast<int64_t>(linger_ms_.load()) * 1000;
+}
+
+void LTEManager::setLinger(uint32_t ms) {
+    linger_ms_.store(ms);
 }
 
 // 查询 LTE 是否已连接
 bool LTEManager::isConnected() const {
-    return connected_;
+    return state_.load() == LteState::ACTIVE;
 }
 
-} // namespace chunfeng 
\ No newline at end of file
+} // namespace chunfeng
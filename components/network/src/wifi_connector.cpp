@@ -0,0 +1,479 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-10 11:02:44
+ * @LastEditTime: 2025-07-02 14:26:08
+ * @LastEditors: 星年
+ * @Description: WiFi 异步连接实现
+ * @FilePath: \ESP32-ChunFeng\components\network\src\wifi_connector.cpp
+ * @遇事不决，可问春风
+ */
+#include "wifi_connector.hpp"
+#include "cf_log.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "esp_bit_defs.h"
+#include "esp_wifi.h"
+#include "esp_netif.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include <cstring>
+
+namespace chunfeng {
+
+static const char* TAG = "WiFiConnector";
+
+static constexpr EventBits_t kDoneBit = BIT0;
+
+// 各阶段耗时分桶（毫秒）
+static const uint32_t kPhaseBucketsMs[] = {50, 100, 250, 500, 1000, 2000, 4000, 8000, 15000};
+static constexpr size_t kPhaseBucketCount = sizeof(kPhaseBucketsMs) / sizeof(kPhaseBucketsMs[0]);
+
+static metrics::Histogram s_link_ms("chunfeng_wifi_connect_phase_ms", "WiFi 连接各阶段耗时（毫秒）",
+                                    kPhaseBucketsMs, kPhaseBucketCount, "phase=\"link\"");
+static metrics::Histogram s_dhcp_ms("chunfeng_wifi_connect_phase_ms", "WiFi 连接各阶段耗时（毫秒）",
+                                    kPhaseBucketsMs, kPhaseBucketCount, "phase=\"dhcp\"");
+static metrics::Histogram s_total_ms("chunfeng_wifi_connect_phase_ms", "WiFi 连接各阶段耗时（毫秒）",
+                                     kPhaseBucketsMs, kPhaseBucketCount, "phase=\"total\"");
+
+static metrics::Counter s_result_connected("chunfeng_wifi_connect_total", "WiFi 连接请求结果", "result=\"connected\"");
+static metrics::Counter s_result_no_ap("chunfeng_wifi_connect_total", "WiFi 连接请求结果", "result=\"no_ap_found\"");
+static metrics::Counter s_result_auth("chunfeng_wifi_connect_total", "WiFi 连接请求结果", "result=\"auth_failed\"");
+static metrics::Counter s_result_link("chunfeng_wifi_connect_total", "WiFi 连接请求结果", "result=\"link_failed\"");
+static metrics::Counter s_result_dhcp("chunfeng_wifi_connect_total", "WiFi 连接请求结果", "result=\"dhcp_timeout\"");
+static metrics::Counter s_result_timeout("chunfeng_wifi_connect_total", "WiFi 连接请求结果", "result=\"timeout\"");
+static metrics::Counter s_result_cancelled("chunfeng_wifi_connect_total", "WiFi 连接请求结果", "result=\"cancelled\"");
+static metrics::Counter s_result_driver("chunfeng_wifi_connect_total", "WiFi 连接请求结果", "result=\"driver_error\"");
+
+static metrics::Counter s_retries("chunfeng_wifi_connect_retries_total", "WiFi 连接失败后的重试次数");
+static metrics::Counter s_link_lost("chunfeng_wifi_link_lost_total", "已连接状态下链路意外断开的次数");
+
+static metrics::Counter* resultCounter(ConnectResult result) {
+    switch (result) {
+        case ConnectResult::CONNECTED: return &s_result_connected;
+        case ConnectResult::NO_AP_FOUND: return &s_result_no_ap;
+        case ConnectResult::AUTH_FAILED: return &s_result_auth;
+        case ConnectResult::LINK_FAILED: return &s_result_link;
+        case ConnectResult::DHCP_TIMEOUT: return &s_result_dhcp;
+        case ConnectResult::TIMEOUT: return &s_result_timeout;
+        case ConnectResult::CANCELLED: return &s_result_cancelled;
+        case ConnectResult::DRIVER_ERROR: return &s_result_driver;
+        default: return nullptr;
+    }
+}
+
+const char* connectResultName(ConnectResult result) {
+    switch (result) {
+        case ConnectResult::PENDING: return "pending";
+        case ConnectResult::CONNECTED: return "connected";
+        case ConnectResult::NO_AP_FOUND: return "no_ap_found";
+        case ConnectResult::AUTH_FAILED: return "auth_failed";
+        case ConnectResult::LINK_FAILED: return "link_failed";
+        case ConnectResult::DHCP_TIMEOUT: return "dhcp_timeout";
+        case ConnectResult::TIMEOUT: return "timeout";
+        case ConnectResult::CANCELLED: return "cancelled";
+        case ConnectResult::DRIVER_ERROR: return "driver_error";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief 断开原因归类
+ */
+static ConnectResult classifyReason(uint8_t reason) {
+    switch (reason) {
+        case WIFI_REASON_NO_AP_FOUND:
+            return ConnectResult::NO_AP_FOUND;
+        case WIFI_REASON_AUTH_FAIL:
+        case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT:
+        case WIFI_REASON_HANDSHAKE_TIMEOUT:
+            return ConnectResult::AUTH_FAILED;
+        default:
+            return ConnectResult::LINK_FAILED;
+    }
+}
+
+static uint32_t msSince(int64_t since_us) {
+    return static_cast<uint32_t>((esp_timer_get_time() - since_us) / 1000);
+}
+
+/**
+ * @brief 一次连接请求的内部状态（除 done_event 外均由 WiFiConnector::mutex_ 保护）
+ */
+struct ConnectOperation {
+    enum class Phase : uint8_t {
+        LINKING,    ///< 已调用 esp_wifi_connect()，等待 STA_CONNECTED
+        DHCP,       ///< 已关联，等待 GOT_IP
+        BACKOFF,    ///< 失败后等待重试
+        DONE,
+    };
+
+    std::string ssid;
+    std::string password;
+    ConnectOptions options;
+    ConnectStatus status;
+    Phase phase{Phase::LINKING};
+    int64_t start_us{0};
+    int64_t attempt_us{0};
+    int64_t linked_us{0};
+    EventGroupHandle_t done_event;
+
+    ConnectOperation() : done_event(xEventGroupCreate()) {}
+    ~ConnectOperation() { vEventGroupDelete(done_event); }
+
+    bool active() const { return phase == Phase::LINKING || phase == Phase::DHCP; }
+};
+
+/**
+ * @brief 持锁期间决定、解锁后执行的操作
+ */
+struct WiFiConnector::Deferred {
+    bool connect{false};
+    bool disconnect{false};
+    bool link_lost{false};      ///< 已获取 IP 的链路断开，发布到消息总线
+    uint8_t lost_reason{0};
+    std::string ssid;
+    std::string password;
+    std::shared_ptr<ConnectOperation> attempt;      ///< 发起连接的请求（驱动调用失败时回填结果）
+    std::shared_ptr<ConnectOperation> completed[2]; ///< 需要通知完成的请求（被取消的旧请求 + 当前请求）
+};
+
+/* ---------- ConnectHandle ---------- */
+
+bool ConnectHandle::done() const {
+    return status().result != ConnectResult::PENDING;
+}
+
+ConnectResult ConnectHandle::wait(uint32_t timeout_ms) const {
+    if (!op_) return ConnectResult::DRIVER_ERROR;
+    TickType_t ticks = timeout_ms == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    xEventGroupWaitBits(op_->done_event, kDoneBit, pdFALSE, pdTRUE, ticks);
+    return status().result;
+}
+
+ConnectStatus ConnectHandle::status() const {
+    if (!op_) return ConnectStatus{ConnectResult::DRIVER_ERROR};
+    std::lock_guard<std::mutex> lock(WiFiConnector::getInstance().mutex_);
+    return op_->status;
+}
+
+void ConnectHandle::cancel() {
+    if (op_) WiFiConnector::getInstance().cancel(op_);
+}
+
+/* ---------- WiFiConnector ---------- */
+
+WiFiConnector& WiFiConnector::getInstance() {
+    static WiFiConnector instance;
+    return instance;
+}
+
+WiFiConnector::WiFiConnector() {
+    // 默认事件循环可能已由配网驱动创建，重复创建返回 ESP_ERR_INVALID_STATE
+    esp_err_t err = esp_event_loop_create_default();
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        CF_LOGE(TAG, "创建默认事件循环失败: %d", err);
+    }
+    esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, onWiFiEvent, this, nullptr);
+    esp_event_handler_instance_register(IP_EVENT, ESP_EVENT_ANY_ID, onIpEvent, this, nullptr);
+
+    esp_timer_create_args_t args = {};
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.callback = onRetryTimer;
+    args.name = "wifi_retry";
+    esp_timer_create(&args, &retry_timer_);
+    args.callback = onDhcpTimer;
+    args.name = "wifi_dhcp";
+    esp_timer_create(&args, &dhcp_timer_);
+    args.callback = onDeadlineTimer;
+    args.name = "wifi_deadline";
+    esp_timer_create(&args, &deadline_timer_);
+}
+
+ConnectHandle WiFiConnector::connect(const std::string& ssid, const std::string& password,
+                                     const ConnectOptions& options) {
+    auto op = std::make_shared<ConnectOperation>();
+    op->ssid = ssid;
+    op->password = password;
+    op->options = options;
+    if (op->options.max_attempts == 0) op->options.max_attempts = 1;
+    op->start_us = esp_timer_get_time();
+
+    Deferred d;
+    bool reuse = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // 已用同样的 SSID 与密码连上时不重新关联，但照常完成：回调（如配网保存）与 WIFI_LINK 发布不会被跳过
+        reuse = has_ip_ && ssid_ == ssid && password_ == password &&
+                (!current_ || current_->phase == ConnectOperation::Phase::DONE);
+        if (reuse) {
+            current_ = op;
+            completeLocked(ConnectResult::CONNECTED, d);
+        } else {
+            if (current_ && current_->phase != ConnectOperation::Phase::DONE) {
+                completeLocked(ConnectResult::CANCELLED, d);
+            }
+            current_ = op;
+            ssid_ = ssid;
+            password_ = password;
+            link_up_ = false;
+            has_ip_ = false;
+            esp_timer_start_once(deadline_timer_, static_cast<uint64_t>(op->options.timeout_ms) * 1000);
+            startAttemptLocked(d);
+        }
+    }
+    if (reuse) {
+        CF_LOGI(TAG, "已连接到 %s，沿用当前连接", ssid);
+    } else {
+        CF_LOGI(TAG, "开始连接: SSID=%s", ssid);
+    }
+    run(d);
+    return ConnectHandle(op);
+}
+
+void WiFiConnector::disconnect() {
+    Deferred d;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (current_ && current_->phase != ConnectOperation::Phase::DONE) {
+            completeLocked(ConnectResult::CANCELLED, d);
+        }
+        link_up_ = false;
+        has_ip_ = false;
+        d.disconnect = true;
+    }
+    run(d);
+}
+
+void WiFiConnector::cancel(const std::shared_ptr<ConnectOperation>& op) {
+    Deferred d;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (op != current_ || op->phase == ConnectOperation::Phase::DONE) return;
+        d.disconnect = op->active();
+        completeLocked(ConnectResult::CANCELLED, d);
+    }
+    run(d);
+}
+
+bool WiFiConnector::isConnected() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return has_ip_;
+}
+
+std::string WiFiConnector::currentSsid() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ssid_;
+}
+
+bool WiFiConnector::currentLink(std::string& ssid, std::string& password) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!has_ip_) return false;
+    ssid = ssid_;
+    password = password_;
+    return true;
+}
+
+void WiFiConnector::startAttemptLocked(Deferred& d) {
+    ConnectOperation& op = *current_;
+    op.status.attempts++;
+    op.phase = ConnectOperation::Phase::LINKING;
+    op.attempt_us = esp_timer_get_time();
+    d.connect = true;
+    d.ssid = op.ssid;
+    d.password = op.password;
+    d.attempt = current_;
+}
+
+void WiFiConnector::failAttemptLocked(ConnectResult cls, uint8_t reason, Deferred& d) {
+    ConnectOperation& op = *current_;
+    op.status.last_reason = reason;
+    esp_timer_stop(dhcp_timer_);
+    bool give_up = op.status.attempts >= op.options.max_attempts ||
+                   (cls == ConnectResult::AUTH_FAILED && !op.options.retry_auth_failure);
+    if (give_up) {
+        completeLocked(cls, d);
+        return;
+    }
+    // 指数退避：initial, 2*initial, 4*initial ... 不超过上限
+    uint32_t shift = op.status.attempts - 1u;
+    uint32_t delay = op.options.backoff_initial_ms << (shift < 16 ? shift : 16);
+    if (delay > op.options.backoff_max_ms) delay = op.options.backoff_max_ms;
+    op.phase = ConnectOperation::Phase::BACKOFF;
+    s_retries.inc();
+    esp_timer_start_once(retry_timer_, static_cast<uint64_t>(delay) * 1000);
+    CF_LOGW(TAG, "连接失败(%s, reason=%u)，%u ms 后第 %u 次重试", connectResultName(cls), reason, delay,
+            op.status.attempts + 1u);
+}
+
+void WiFiConnector::completeLocked(ConnectResult result, Deferred& d) {
+    ConnectOperation& op = *current_;
+    op.phase = ConnectOperation::Phase::DONE;
+    op.status.result = result;
+    op.status.total_ms = msSince(op.start_us);
+    esp_timer_stop(retry_timer_);
+    esp_timer_stop(dhcp_timer_);
+    esp_timer_stop(deadline_timer_);
+
+    if (metrics::Counter* c = resultCounter(result)) c->inc();
+    if (result == ConnectResult::CONNECTED) {
+        s_total_ms.observe(op.status.total_ms);
+    }
+    d.completed[d.completed[0] ? 1 : 0] = current_;
+}
+
+void WiFiConnector::run(Deferred& d) {
+    if (d.disconnect) {
+        esp_wifi_disconnect();
+    }
+    if (d.connect) {
+        wifi_config_t config = {};
+        strncpy(reinterpret_cast<char*>(config.sta.ssid), d.ssid.c_str(), sizeof(config.sta.ssid) - 1);
+        strncpy(reinterpret_cast<char*>(config.sta.password), d.password.c_str(), sizeof(config.sta.password) - 1);
+        esp_err_t err = esp_wifi_set_config(WIFI_IF_STA, &config);
+        if (err == ESP_OK) err = esp_wifi_connect();
+        if (err != ESP_OK) {
+            CF_LOGE(TAG, "esp_wifi_connect 失败: %d", err);
+            Deferred again;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (current_ == d.attempt && current_->phase == ConnectOperation::Phase::LINKING) {
+                    completeLocked(ConnectResult::DRIVER_ERROR, again);
+                }
+            }
+            run(again);
+        }
+    }
+    for (auto& op : d.completed) {
+        if (!op) continue;
+        const ConnectStatus& s = op->status;  // DONE 之后不再修改，可在锁外读取
+        if (s.result == ConnectResult::CONNECTED) {
+            CF_LOGI(TAG, "已连接 %s：关联 %u ms，DHCP %u ms，共 %u ms（第 %u 次尝试）", op->ssid, s.link_ms, s.dhcp_ms,
+                    s.total_ms, s.attempts);
+        } else if (s.result != ConnectResult::CANCELLED) {
+            CF_LOGW(TAG, "连接 %s 失败: %s（reason=%u，尝试 %u 次，耗时 %u ms）", op->ssid,
+                    connectResultName(s.result), s.last_reason, s.attempts, s.total_ms);
+        }
+        xEventGroupSetBits(op->done_event, kDoneBit);
+        if (op->options.on_complete) op->options.on_complete(s, op->options.ctx);
+        bus::publish<bus::Topic::WIFI_LINK>(s);
+    }
+    if (d.link_lost) {
+        // 不经连接请求的断开：订阅者（网络状态机）不必轮询 isConnected()
+        ConnectStatus lost;
+        lost.result = ConnectResult::LINK_FAILED;
+        lost.last_reason = d.lost_reason;
+        bus::publish<bus::Topic::WIFI_LINK>(lost);
+    }
+}
+
+/* ---------- 事件与定时器 ---------- */
+
+void WiFiConnector::onWiFiEvent(void* arg, esp_event_base_t, int32_t id, void* data) {
+    auto* self = static_cast<WiFiConnector*>(arg);
+    Deferred d;
+    {
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        ConnectOperation* op = self->current_.get();
+        if (id == WIFI_EVENT_STA_CONNECTED) {
+            CF_TRACE_INSTANT("wifi.sta_connected");
+            self->link_up_ = true;
+            if (op && op->phase == ConnectOperation::Phase::LINKING) {
+                op->linked_us = esp_timer_get_time();
+                op->status.link_ms = msSince(op->attempt_us);
+                s_link_ms.observe(op->status.link_ms);
+                op->phase = ConnectOperation::Phase::DHCP;
+                esp_timer_start_once(self->dhcp_timer_, static_cast<uint64_t>(op->options.dhcp_timeout_ms) * 1000);
+            }
+        } else if (id == WIFI_EVENT_STA_DISCONNECTED) {
+            CF_TRACE_INSTANT("wifi.sta_disconnected");
+            auto* ev = static_cast<const wifi_event_sta_disconnected_t*>(data);
+            uint8_t reason = ev ? ev->reason : 0;
+            bool had_ip = self->has_ip_;
+            self->link_up_ = false;
+            self->has_ip_ = false;
+            if (op && op->active()) {
+                // 重新连接时驱动先离开旧 AP，上报的 ASSOC_LEAVE 不是本次尝试的结果
+                if (!(op->phase == ConnectOperation::Phase::LINKING && reason == WIFI_REASON_ASSOC_LEAVE)) {
+                    self->failAttemptLocked(classifyReason(reason), reason, d);
+                }
+            } else if (had_ip && reason != WIFI_REASON_ASSOC_LEAVE) {
+                s_link_lost.inc();
+                CF_LOGW(TAG, "链路断开: reason=%u", reason);
+                d.link_lost = true;
+                d.lost_reason = reason;
+            }
+        }
+    }
+    self->run(d);
+}
+
+void WiFiConnector::onIpEvent(void* arg, esp_event_base_t, int32_t id, void* data) {
+    auto* self = static_cast<WiFiConnector*>(arg);
+    Deferred d;
+    {
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        if (id == IP_EVENT_STA_LOST_IP) {
+            self->has_ip_ = false;
+            return;
+        }
+        if (id != IP_EVENT_STA_GOT_IP) return;
+        CF_TRACE_INSTANT("wifi.got_ip");
+        self->has_ip_ = true;
+        ConnectOperation* op = self->current_.get();
+        if (op && op->active()) {
+            if (op->phase == ConnectOperation::Phase::LINKING) {
+                // 未收到 STA_CONNECTED（事件丢失），整段计入关联阶段
+                op->status.link_ms = msSince(op->attempt_us);
+                op->linked_us = esp_timer_get_time();
+            }
+            op->status.dhcp_ms = msSince(op->linked_us);
+            s_dhcp_ms.observe(op->status.dhcp_ms);
+            auto* ev = static_cast<const ip_event_got_ip_t*>(data);
+            if (ev) op->status.ip = ev->ip_info.ip.addr;
+            self->completeLocked(ConnectResult::CONNECTED, d);
+        }
+    }
+    self->run(d);
+}
+
+void WiFiConnector::onRetryTimer(void* arg) {
+    auto* self = static_cast<WiFiConnector*>(arg);
+    Deferred d;
+    {
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        if (!self->current_ || self->current_->phase != ConnectOperation::Phase::BACKOFF) return;
+        self->startAttemptLocked(d);
+    }
+    self->run(d);
+}
+
+void WiFiConnector::onDhcpTimer(void* arg) {
+    auto* self = static_cast<WiFiConnector*>(arg);
+    Deferred d;
+    {
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        if (!self->current_ || self->current_->phase != ConnectOperation::Phase::DHCP) return;
+        self->current_->status.dhcp_ms = msSince(self->current_->linked_us);
+        // 先退出 DHCP 阶段，主动断开产生的 ASSOC_LEAVE 事件不再计入
+        self->failAttemptLocked(ConnectResult::DHCP_TIMEOUT, 0, d);
+        self->link_up_ = false;
+        d.disconnect = true;
+    }
+    self->run(d);
+}
+
+void WiFiConnector::onDeadlineTimer(void* arg) {
+    auto* self = static_cast<WiFiConnector*>(arg);
+    Deferred d;
+    {
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        if (!self->current_ || self->current_->phase == ConnectOperation::Phase::DONE) return;
+        d.disconnect = self->current_->active();
+        self->completeLocked(ConnectResult::TIMEOUT, d);
+        self->link_up_ = false;
+    }
+    self->run(d);
+}
+
+} // namespace chunfeng
@@ -1,34 +1,39 @@
 /*** 
  * @Author: jixingnian@gmail.com
  * @Date: 2025-05-30 12:20:35
- * @LastEditTime: 2025-05-30 16:20:18
+ * @LastEditTime: 2025-07-01 10:26:42
  * @LastEditors: 星年
  * @Description: WiFi 管理类实现，负责 WiFi 的初始化、连接、断开与状态查询
  * @FilePath: \ESP32-ChunFeng\components\network\src\wifi_manager.cpp
  * @遇事不决，可问春风
  */
 #include "wifi_manager.hpp"
-#include <iostream>
+#include "bsp_wifi.hpp"
+#include "cf_log.hpp"
+#include <ctime>
 
 namespace chunfeng {
 
+static const char* TAG = "WiFiManager";
+
 // 构造函数
 WiFiManager::WiFiManager()
-    : initialized_{false}, connected_{false}
+    : initialized_{false}
 {
-    std::cout << "[WiFiManager] 构造: 初始化 WiFi 管理器..." << std::endl;
+    CF_LOGI(TAG, "构造: 初始化 WiFi 管理器...");
     // 这里可以进行必要的成员初始化
+    if (BspWiFi::loadNetworkList(networks_)) {
+        CF_LOGI(TAG, "已加载 %u 个已保存网络", networks_.size());
+    }
     initialized_ = true;
-    connected_ = false;
 }
 
 // 析构函数
 WiFiManager::~WiFiManager()
 {
-    std::cout << "[WiFiManager] 析构: 释放 WiFi 相关资源..." << std::endl;
+    CF_LOGI(TAG, "析构: 释放 WiFi 相关资源...");
     // 这里可以添加资源释放代码
     initialized_ = false;
-    connected_ = false;
 }
 
 // 获取 WiFiManager 单例实例
@@ -40,76 +45,181 @@ WiFiManager& WiFiManager::getInstance() {
 // 连接 WiFi
 bool WiFiManager::connect(const std::string& ssid, const std::string& password) {
     if (!initialized_) {
-        std::cerr << "[WiFiManager] 错误：WiFi 管理器未初始化，无法连接 WiFi。" << std::endl;
+        CF_LOGE(TAG, "错误：WiFi 管理器未初始化，无法连接 WiFi。");
         return false;
     }
-    if (connected_) {
-        std::cout << "[WiFiManager] 已连接 WiFi，无需重复连接。" << std::endl;
-        return true;
+    CF_LOGI(TAG, "正在连接 WiFi，SSID: %s", ssid);
+    ConnectHandle handle = connectAsync(ssid, password);
+    ConnectResult result = handle.wait();
+    if (result != ConnectResult::CONNECTED) {
+        ConnectStatus st = handle.status();
+        CF_LOGW(TAG, "连接 WiFi 失败: %s（尝试 %u 次）", connectResultName(result), st.attempts);
+        return false;
     }
-    std::cout << "[WiFiManager] 正在连接 WiFi，SSID: " << ssid << std::endl;
-    // 这里添加实际的 WiFi 连接代码
-    // 例如：esp_wifi_connect()，并处理连接结果
-    // 假定连接成功
-    connected_ = true;
-    return connected_;
+    return true;
+}
+
+// 异步连接 WiFi
+ConnectHandle WiFiManager::connectAsync(const std::string& ssid, const std::string& password,
+                                        const ConnectOptions& options) {
+    return WiFiConnector::getInstance().connect(ssid, password, options);
 }
 
 // 断开 WiFi 连接
 void WiFiManager::disconnect() {
     if (!initialized_) {
-        std::cerr << "[WiFiManager] 错误：WiFi 管理器未初始化，无法断开 WiFi。" << std::endl;
-        return;
-    }
-    if (!connected_) {
-        std::cout << "[WiFiManager] WiFi 已断开，无需重复断开。" << std::endl;
+        CF_LOGE(TAG, "错误：WiFi 管理器未初始化，无法断开 WiFi。");
         return;
     }
-    std::cout << "[WiFiManager] 正在断开 WiFi..." << std::endl;
-    // 这里添加实际的 WiFi 断开代码
-    // 例如：esp_wifi_disconnect()
-    connected_ = false;
+    CF_LOGI(TAG, "正在断开 WiFi...");
+    WiFiConnector::getInstance().disconnect();
 }
 
 // 查询 WiFi 是否已连接
 bool WiFiManager::isConnected() const {
-    // 这里返回 WiFi 连接状态
-    // 实际实现可查询底层 WiFi 状态
-    // 例如：esp_wifi_sta_get_ap_info() 或维护内部状态
-    return connected_;
+    return WiFiConnector::getInstance().isConnected();
 }
 
 // 保存 WiFi 信息
 bool WiFiManager::saveWiFiInfo(const std::string& ssid, const std::string& password) {
-    // 实际实现应保存到NVS等持久化存储
-    // 这里只做内存保存示例
-    saved_ssid_ = ssid;
-    saved_password_ = password;
-    std::cout << "[WiFiManager] 已保存 WiFi 信息: SSID=" << ssid << std::endl;
+    std::lock_guard<std::mutex> lock(mutex_);
+    int idx = networks_.find(ssid);
+    uint8_t priority = idx >= 0 ? networks_.at(idx).priority : 0;
+    if (!networks_.upsert(ssid, password, priority)) {
+        CF_LOGW(TAG, "无效的 WiFi 信息: SSID=%s", ssid);
+        return false;
+    }
+    if (!persistNetworks()) {
+        return false;
+    }
+    CF_LOGI(TAG, "已保存 WiFi 信息: SSID=%s", ssid);
     return true;
 }
 
 // 读取已保存的 WiFi 信息
 bool WiFiManager::loadWiFiInfo(std::string& ssid, std::string& password) {
-    // 实际实现应从NVS等持久化存储读取
-    // 这里只做内存读取示例
-    if (saved_ssid_.empty() || saved_password_.empty()) {
-        std::cerr << "[WiFiManager] 未找到已保存的 WiFi 信息" << std::endl;
+    std::lock_guard<std::mutex> lock(mutex_);
+    int idx = networks_.preferred();
+    if (idx < 0) {
+        CF_LOGW(TAG, "未找到已保存的 WiFi 信息");
         return false;
     }
-    ssid = saved_ssid_;
-    password = saved_password_;
-    std::cout << "[WiFiManager] 已读取 WiFi 信息: SSID=" << ssid << std::endl;
+    ssid = networks_.at(idx).ssid;
+    password = networks_.at(idx).password;
+    CF_LOGI(TAG, "已读取 WiFi 信息: SSID=%s", ssid);
     return true;
 }
 
 // 删除已保存的 WiFi 信息
 bool WiFiManager::deleteWiFiInfo() {
-    // 实际实现应从NVS等持久化存储删除
-    // 这里只做内存删除示例
-    saved_ssid_.clear();
-    saved_password_.clear();
-    std::cout << "[WiFiManager] 已删除保存的 WiFi 信息" << std::endl;
+    std::lock_guard<std::mutex> lock(mutex_);
+    networks_.clear();
+    CF_LOGI(TAG, "已删除保存的 WiFi 信息");
+    return BspWiFi::deleteNetworkList();
+}
+
+// 添加或更新已保存网络
+bool WiFiManager::addNetwork(const std::string& ssid, const std::string& password, uint8_t priority) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!networks_.upsert(ssid, password, priority)) {
+        CF_LOGW(TAG, "无效的 WiFi 信息: SSID=%s", ssid);
+        return false;
+    }
+    return persistNetworks();
+}
+
+// 删除指定的已保存网络
+bool WiFiManager::removeNetwork(const std::string& ssid) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!networks_.remove(ssid)) {
+        return false;
+    }
+    return persistNetworks();
+}
+
+std::vector<SavedNetwork> WiFiManager::getNetworks() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return networks_.networks();
+}
+
+// 扫描周围 WiFi
+std::vector<WiFiInfo> WiFiManager::scan() {
+    return BspConfigNetwork::scanWiFi();
+}
+
+// 根据扫描结果连接最佳网络
+bool WiFiManager::connectBest(const std::vector<WiFiInfo>& scan) {
+    uint32_t now = static_cast<uint32_t>(time(nullptr));
+    // 排序后复制凭据，连接过程中不持锁（配网回调可能同时保存网络）
+    struct Candidate {
+        std::string ssid;
+        std::string password;
+        int rssi;
+        int score;
+    };
+    std::vector<Candidate> candidates;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& c : networks_.rank(scan, now)) {
+            const SavedNetwork& net = networks_.at(c.index);
+            candidates.push_back({net.ssid, net.password, c.rssi, c.score});
+        }
+    }
+    if (candidates.empty()) {
+        CF_LOGW(TAG, "扫描结果中没有已保存的网络");
+        return false;
+    }
+    // 有多个候选时每个网络少重试几次，尽快轮到下一个
+    ConnectOptions options;
+    if (candidates.size() > 1) options.max_attempts = 2;
+    bool ok = false;
+    bool attempted = false;
+    for (const auto& c : candidates) {
+        CF_LOGI(TAG, "候选网络: SSID=%s RSSI=%d 评分=%d", c.ssid, c.rssi, c.score);
+        ConnectHandle handle = connectAsync(c.ssid, c.password, options);
+        ConnectResult result = handle.wait();
+        if (result == ConnectResult::CANCELLED) {
+            // 配网页面等发起了新的连接，由它接管链路
+            CF_LOGI(TAG, "连接 %s 被新的连接请求取消", c.ssid);
+            break;
+        }
+        ok = result == ConnectResult::CONNECTED;
+        if (!ok) {
+            CF_LOGW(TAG, "连接 %s 失败: %s", c.ssid, connectResultName(result));
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        networks_.recordResult(c.ssid, ok, now);
+        attempted = true;
+        if (ok) break;
+    }
+    if (attempted) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        persistNetworks();
+    }
+    return ok;
+}
+
+// 扫描后连接最佳网络
+bool WiFiManager::connectBest() {
+    std::vector<WiFiInfo> visible;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (networks_.empty()) {
+            return false;
+        }
+        if (networks_.size() == 1) {
+            visible.push_back({networks_.at(0).ssid, WiFiNetworkList::kMinRssi, true});
+        }
+    }
+    return connectBest(visible.empty() ? scan() : visible);
+}
+
+// 将已保存网络列表写入NVS
+bool WiFiManager::persistNetworks() {
+    if (!BspWiFi::saveNetworkList(networks_)) {
+        CF_LOGE(TAG, "保存网络列表到NVS失败");
+        return false;
+    }
     return true;
 }
 
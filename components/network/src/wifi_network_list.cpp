@@ -0,0 +1,196 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-03 10:20:12
+ * @LastEditTime: 2025-06-03 15:31:05
+ * @LastEditors: 星年
+ * @Description: 多网络凭据列表实现
+ * @FilePath: \ESP32-ChunFeng\components\network\src\wifi_network_list.cpp
+ * @遇事不决，可问春风
+ */
+#include "wifi_network_list.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace chunfeng {
+
+namespace {
+
+constexpr uint16_t kMagic = 0x4346;         // "CF"
+constexpr uint8_t kVersion = 1;
+constexpr size_t kSsidMax = 32;
+constexpr size_t kPasswordMax = 64;
+constexpr size_t kHeaderSize = 4;           // magic(2) + version(1) + count(1)
+// ssid(33) + password(65) + priority(1) + last_success(4) + success(2) + attempts(2)
+constexpr size_t kRecordSize = (kSsidMax + 1) + (kPasswordMax + 1) + 1 + 4 + 2 + 2;
+constexpr uint16_t kAgingThreshold = 64;    // 尝试次数达到该值后历史减半
+constexpr uint32_t kDay = 24 * 3600;
+
+void putU16(uint8_t* p, uint16_t v) { p[0] = v & 0xff; p[1] = v >> 8; }
+void putU32(uint8_t* p, uint32_t v) { for (int i = 0; i < 4; ++i) p[i] = (v >> (8 * i)) & 0xff; }
+uint16_t getU16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+uint32_t getU32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+} // namespace
+
+float SavedNetwork::successRate() const {
+    if (attempt_count == 0) return 0.5f;
+    return static_cast<float>(success_count) / attempt_count;
+}
+
+bool WiFiNetworkList::upsert(const std::string& ssid, const std::string& password, uint8_t priority) {
+    if (ssid.empty() || ssid.size() > kSsidMax || password.size() > kPasswordMax) {
+        return false;
+    }
+    int idx = find(ssid);
+    if (idx >= 0) {
+        networks_[idx].password = password;
+        networks_[idx].priority = priority;
+        return true;
+    }
+    if (networks_.size() >= kMaxNetworks) {
+        // 淘汰优先级最低、最久未成功的网络
+        auto victim = std::min_element(networks_.begin(), networks_.end(),
+            [](const SavedNetwork& a, const SavedNetwork& b) {
+                if (a.priority != b.priority) return a.priority < b.priority;
+                return a.last_success < b.last_success;
+            });
+        networks_.erase(victim);
+    }
+    SavedNetwork net;
+    net.ssid = ssid;
+    net.password = password;
+    net.priority = priority;
+    networks_.push_back(net);
+    return true;
+}
+
+bool WiFiNetworkList::remove(const std::string& ssid) {
+    int idx = find(ssid);
+    if (idx < 0) return false;
+    networks_.erase(networks_.begin() + idx);
+    return true;
+}
+
+void WiFiNetworkList::clear() {
+    networks_.clear();
+}
+
+int WiFiNetworkList::find(const std::string& ssid) const {
+    for (size_t i = 0; i < networks_.size(); ++i) {
+        if (networks_[i].ssid == ssid) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+void WiFiNetworkList::recordResult(const std::string& ssid, bool success, uint32_t now) {
+    int idx = find(ssid);
+    if (idx < 0) return;
+    SavedNetwork& net = networks_[idx];
+    if (net.attempt_count >= kAgingThreshold) {
+        // 衰减旧历史，让最近的结果占更大比重
+        net.attempt_count /= 2;
+        net.success_count /= 2;
+    }
+    net.attempt_count++;
+    if (success) {
+        net.success_count++;
+        net.last_success = now;
+    }
+}
+
+int WiFiNetworkList::scoreOf(const SavedNetwork& net, int rssi, uint32_t now) const {
+    int score = rssi;
+    score += net.priority * kPriorityWeight;
+    score += static_cast<int>((net.successRate() - 0.5f) * kHistoryWeight);
+    if (net.last_success != 0 && now >= net.last_success) {
+        uint32_t age = now - net.last_success;
+        if (age < kDay) {
+            score += kRecentBonus;
+        } else if (age < 7 * kDay) {
+            score += kRecentBonus / 2;
+        }
+    }
+    return score;
+}
+
+std::vector<NetworkCandidate> WiFiNetworkList::rank(const std::vector<WiFiInfo>& scan, uint32_t now) const {
+    std::vector<NetworkCandidate> result;
+    for (size_t i = 0; i < networks_.size(); ++i) {
+        // 同名多AP时取最强信号
+        int best_rssi = kMinRssi - 1;
+        for (const auto& ap : scan) {
+            if (ap.ssid == networks_[i].ssid && ap.rssi > best_rssi) {
+                best_rssi = ap.rssi;
+            }
+        }
+        if (best_rssi < kMinRssi) continue;
+        result.push_back({i, best_rssi, scoreOf(networks_[i], best_rssi, now)});
+    }
+    std::stable_sort(result.begin(), result.end(),
+        [](const NetworkCandidate& a, const NetworkCandidate& b) { return a.score > b.score; });
+    return result;
+}
+
+int WiFiNetworkList::preferred() const {
+    int best = -1;
+    for (size_t i = 0; i < networks_.size(); ++i) {
+        if (best < 0) { best = static_cast<int>(i); continue; }
+        const SavedNetwork& a = networks_[i];
+        const SavedNetwork& b = networks_[best];
+        if (a.priority > b.priority ||
+            (a.priority == b.priority && a.last_success > b.last_success)) {
+            best = static_cast<int>(i);
+        }
+    }
+    return best;
+}
+
+std::vector<uint8_t> WiFiNetworkList::serialize() const {
+    std::vector<uint8_t> out(kHeaderSize + networks_.size() * kRecordSize, 0);
+    putU16(&out[0], kMagic);
+    out[2] = kVersion;
+    out[3] = static_cast<uint8_t>(networks_.size());
+    uint8_t* p = out.data() + kHeaderSize;
+    for (const auto& net : networks_) {
+        memcpy(p, net.ssid.data(), net.ssid.size());
+        p += kSsidMax + 1;
+        memcpy(p, net.password.data(), net.password.size());
+        p += kPasswordMax + 1;
+        *p++ = net.priority;
+        putU32(p, net.last_success); p += 4;
+        putU16(p, net.success_count); p += 2;
+        putU16(p, net.attempt_count); p += 2;
+    }
+    return out;
+}
+
+bool WiFiNetworkList::deserialize(const uint8_t* data, size_t len) {
+    if (len < kHeaderSize || getU16(data) != kMagic || data[2] != kVersion) {
+        return false;
+    }
+    size_t count = data[3];
+    if (count > kMaxNetworks || len < kHeaderSize + count * kRecordSize) {
+        return false;
+    }
+    std::vector<SavedNetwork> loaded;
+    const uint8_t* p = data + kHeaderSize;
+    for (size_t i = 0; i < count; ++i) {
+        SavedNetwork net;
+        net.ssid.assign(reinterpret_cast<const char*>(p), strnlen(reinterpret_cast<const char*>(p), kSsidMax));
+        p += kSsidMax + 1;
+        net.password.assign(reinterpret_cast<const char*>(p), strnlen(reinterpret_cast<const char*>(p), kPasswordMax));
+        p += kPasswordMax + 1;
+        net.priority = *p++;
+        net.last_success = getU32(p); p += 4;
+        net.success_count = getU16(p); p += 2;
+        net.attempt_count = getU16(p); p += 2;
+        if (net.ssid.empty()) return false;
+        loaded.push_back(net);
+    }
+    networks_.swap(loaded);
+    return true;
+}
+
+} // namespace chunfeng
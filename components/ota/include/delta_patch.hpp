@@ -0,0 +1,199 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-20 10:05:37
+ * @LastEditTime: 2025-06-20 14:52:08
+ * @LastEditors: 星年
+ * @Description: 增量升级包格式（CFDP）与流式解包：边接收边解压、按 bsdiff 指令与旧固件合成新固件并直接写入 Flash
+ * @FilePath: \ESP32-ChunFeng\components\ota\include\delta_patch.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "mbedtls/sha256.h"
+
+namespace chunfeng {
+namespace ota {
+
+/*
+ * 增量包格式（小端）：
+ *
+ *   PatchHeader
+ *   { BlockHeader, 压缩数据[compressed_size] } × 块数
+ *
+ * 新固件按 block_kib 切成块，每块的指令流单独压缩、单独校验，块之间不共享压缩窗口与指令状态，
+ * 所以下载中断后可以从任一块的开头继续。解压后的指令流是 bsdiff 三元组的序列：
+ *
+ *   uvarint diff_len, uvarint extra_len, svarint seek, diff[diff_len], extra[extra_len]
+ *
+ * 输出 diff_len 字节 old[pos + i] + diff[i]（pos 随之前进），再原样输出 extra_len 字节，最后 pos += seek。
+ * 每块开始时 pos = BlockHeader::source_pos。改动集中的固件里 diff 大部分是 0，由压缩消化。
+ *
+ * 压缩是 heatshrink 式的 LZSS（窗口 2^kWindowBits，按位 MSB 在前）：
+ *   1 + 8 位字面字节，或 0 + kWindowBits 位 (距离 - 1) + kLengthBits 位 (长度 - kMinMatch)
+ */
+
+constexpr char kPatchMagic[4] = {'C', 'F', 'D', 'P'};
+constexpr uint16_t kPatchVersion = 1;
+constexpr int kWindowBits = 10;
+constexpr int kLengthBits = 8;
+constexpr size_t kWindowSize = 1u << kWindowBits;
+constexpr size_t kMinMatch = 3;
+constexpr size_t kMaxMatch = kMinMatch + (1u << kLengthBits) - 1;
+
+struct __attribute__((packed)) PatchHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t block_kib;             ///< 每块输出的大小，必须是 Flash 扇区的整数倍
+    uint32_t source_size;           ///< 旧固件（正在运行的分区）参与比较的长度
+    uint32_t target_size;
+    uint8_t source_sha256[32];
+    uint8_t target_sha256[32];
+};
+static_assert(sizeof(PatchHeader) == 80, "PatchHeader 是升级包格式的一部分");
+
+struct __attribute__((packed)) BlockHeader {
+    uint32_t compressed_size;
+    uint32_t output_size;           ///< 除最后一块外都等于 block_kib * 1024
+    uint32_t source_pos;            ///< 块开始时旧固件的读取位置
+    uint8_t sha256[32];             ///< 本块输出的哈希
+};
+static_assert(sizeof(BlockHeader) == 44, "BlockHeader 是升级包格式的一部分");
+
+/**
+ * @brief 已完成的位置：全部在块边界上，可作为断点
+ */
+struct PatchPosition {
+    uint32_t block{0};              ///< 下一块的序号
+    uint32_t patch_offset{sizeof(PatchHeader)};  ///< 下一块在升级包中的偏移
+    uint32_t target_offset{0};      ///< 已写入新固件的字节数
+};
+
+/**
+ * @brief 校验包头
+ * @return ESP_ERR_INVALID_VERSION 格式不认识，ESP_ERR_INVALID_ARG 字段不合理
+ */
+esp_err_t parseHeader(const uint8_t* data, size_t len, PatchHeader& out);
+
+/**
+ * @brief 计算分区开头 size 字节的 SHA-256
+ * @param buf 读取用的缓冲
+ */
+esp_err_t hashPartition(const esp_partition_t* partition, size_t size, uint8_t* buf, size_t buf_size,
+                        uint8_t out[32]);
+
+/**
+ * @brief 流式增量解包
+ *
+ * 升级包按任意长度分段送入 feed()，不缓存整块也不缓存整个固件：工作集只有 LZSS 窗口、
+ * 旧固件读缓存与写缓冲，合计约 3KB（sizeof(DeltaPatcher)）。
+ * 新固件写入前逐扇区擦除（写到哪擦到哪），块边界与扇区对齐，从断点继续时不会写入已编程的位置。
+ * 每块输出完成时核对块哈希，写缓冲落盘后 position() 才前进。
+ */
+class DeltaPatcher {
+public:
+    static constexpr size_t kSourceCacheSize = 512;
+    static constexpr size_t kWriteBufferSize = 1024;
+
+    DeltaPatcher();
+    ~DeltaPatcher();
+
+    DeltaPatcher(const DeltaPatcher&) = delete;
+    DeltaPatcher& operator=(const DeltaPatcher&) = delete;
+
+    /**
+     * @brief 从 from 开始解包，之后送入的数据从升级包的 from.patch_offset 处开始
+     *
+     * 可重复调用：下载中断后以 position() 重新开始，未完成的块作废重来。
+     */
+    esp_err_t begin(const PatchHeader& header, const esp_partition_t* source, const esp_partition_t* target,
+                    const PatchPosition& from);
+
+    /**
+     * @brief 送入升级包数据
+     * @return ESP_ERR_INVALID_CRC 块哈希不符，ESP_ERR_INVALID_SIZE 数据损坏，其他为 Flash 读写错误；
+     *         出错后需要重新 begin()
+     */
+    esp_err_t feed(const uint8_t* data, size_t len);
+
+    /**
+     * @brief 所有块都已写入
+     */
+    bool done() const { return position_.target_offset == header_.target_size; }
+
+    const PatchPosition& position() const { return position_; }
+
+    /**
+     * @brief 读回整个新固件核对包头中的哈希（断点续传时块哈希只覆盖本次写入的部分）
+     */
+    esp_err_t verify();
+
+private:
+    enum class Stage : uint8_t {
+        BLOCK_HEADER,
+        BLOCK_DATA,
+    };
+
+    enum class OpStage : uint8_t {
+        DIFF_LEN,
+        EXTRA_LEN,
+        SEEK,
+        DIFF,
+        EXTRA,
+    };
+
+    esp_err_t startBlock();
+    esp_err_t finishBlock();
+    esp_err_t decode();
+    esp_err_t opByte(uint8_t b);
+    esp_err_t emit(uint8_t b);
+    esp_err_t sourceByte(uint8_t& out);
+    esp_err_t flush();
+
+    PatchHeader header_{};
+    const esp_partition_t* source_{nullptr};
+    const esp_partition_t* target_{nullptr};
+    PatchPosition position_;
+    Stage stage_{Stage::BLOCK_HEADER};
+    esp_err_t error_{ESP_OK};
+
+    BlockHeader block_{};
+    size_t header_fill_{0};
+    uint32_t compressed_left_{0};
+    uint32_t block_out_{0};         ///< 本块已输出的字节数
+    uint32_t patch_in_{0};          ///< 本块已消耗的升级包字节（含块头）
+
+    // LZSS
+    uint32_t bits_{0};
+    int bit_count_{0};
+    uint32_t window_pos_{0};
+    uint8_t window_[kWindowSize];
+
+    // bsdiff 指令
+    OpStage op_stage_{OpStage::DIFF_LEN};
+    uint64_t varint_{0};
+    int varint_shift_{0};
+    uint32_t diff_left_{0};
+    uint32_t extra_left_{0};
+    int64_t seek_{0};
+    uint32_t source_pos_{0};
+
+    // 旧固件读缓存
+    uint32_t cache_start_{0};
+    uint32_t cache_len_{0};
+    uint8_t cache_[kSourceCacheSize];
+
+    // 新固件写缓冲：buffer_[0, buffer_len_) 对应 Flash 上 write_pos_ 开始的位置
+    uint32_t write_pos_{0};
+    uint32_t erased_until_{0};
+    size_t buffer_len_{0};
+    uint8_t buffer_[kWriteBufferSize];
+
+    mbedtls_sha256_context sha_;
+};
+
+} // namespace ota
+} // namespace chunfeng
@@ -0,0 +1,140 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-20 11:26:03
+ * @LastEditTime: 2025-07-01 19:26:48
+ * @LastEditors: 星年
+ * @Description: 固件升级：A/B 分区、增量包流式写入、断点续传与启动后确认/回滚
+ * @FilePath: \ESP32-ChunFeng\components\ota\include\ota_updater.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include "esp_err.h"
+#include "delta_patch.hpp"
+#include "patch_source.hpp"
+
+namespace chunfeng {
+namespace ota {
+
+enum class UpdateState : uint8_t {
+    IDLE,
+    DOWNLOADING,    ///< 接收并写入新固件
+    VERIFYING,      ///< 读回核对
+    READY,          ///< 已设为下次启动的分区，等待重启
+    FAILED,
+};
+
+/**
+ * @brief 升级进度
+ */
+struct UpdateProgress {
+    UpdateState state{UpdateState::IDLE};
+    uint32_t target_size{0};
+    uint32_t target_written{0};
+    uint32_t patch_received{0};     ///< 本次下载收到的升级包字节（不含断点之前的部分）
+    uint32_t reconnects{0};
+    bool resumed{false};            ///< 从上次保存的断点继续
+    esp_err_t last_error{ESP_OK};
+};
+
+/**
+ * @brief 新固件的自检参数
+ */
+struct HealthCheck {
+    const char* host{nullptr};          ///< 后端主机，GET path 收到状态码低于 500 的响应即往返成功
+    const char* path{"/"};
+    uint16_t port{443};
+    uint32_t stable_ms{60 * 1000};      ///< 往返成功后应用任务持续运行、链路不断开的时间
+    uint32_t timeout_ms{300 * 1000};    ///< 超过仍未确认即判定新固件有问题
+    uint32_t retry_ms{5000};            ///< 链路未通或往返失败后的重试间隔
+};
+
+/**
+ * @brief 固件升级
+ *
+ * 新固件写入不在运行的那个 OTA 分区，每完成一块在 NVS 中保存断点（升级包的目标哈希、块序号与偏移）。
+ * 链路中断时从断点重新打开来源，重试用完后保留断点，下次 apply() 同一个升级包时直接续传，
+ * 换了链路（WiFi 换成 4G）也一样。全部写完后读回核对哈希，才设为下次启动的分区。
+ *
+ * 新固件第一次启动处于待确认状态：确认前重启（崩溃、看门狗）会被引导程序回滚到旧固件。
+ * 启动完成后调用 verify()：与后端往返成功、之后稳定运行一段时间才确认，链路通了不等于新固件可用。
+ */
+class OtaUpdater {
+public:
+    using DoneCallback = void (*)(esp_err_t err, void* arg);
+
+    static OtaUpdater& getInstance();
+
+    /**
+     * @brief 应用一个增量包，阻塞到完成、失败或重试用完
+     * @return ESP_ERR_INVALID_STATE 已有升级在进行，ESP_ERR_INVALID_VERSION 升级包不是基于正在运行的固件，
+     *         ESP_ERR_INVALID_CRC 数据损坏（断点作废），ESP_ERR_TIMEOUT 链路中断且重试用完（断点保留）
+     */
+    esp_err_t apply(PatchSource& source);
+
+    /**
+     * @brief 在 OTA 任务中执行 apply()，完成后调用 on_done（在 OTA 任务中）
+     */
+    esp_err_t startUpdate(std::unique_ptr<PatchSource> source, DoneCallback on_done = nullptr,
+                          void* arg = nullptr);
+
+    UpdateProgress progress() const;
+
+    /**
+     * @brief 正在运行的是尚未确认的新固件
+     */
+    bool pendingVerify() const;
+
+    /**
+     * @brief 确认新固件：healthy 为 false 时标记无效并重启回旧固件
+     */
+    esp_err_t confirm(bool healthy);
+
+    /**
+     * @brief 新固件自检，阻塞到有结论：链路已通且与后端往返成功后，再稳定运行 check.stable_ms
+     *        （期间链路断开则重新往返）才 confirm(true)；超过 check.timeout_ms 则 confirm(false)
+     * @return true 已确认，或运行的不是待确认的新固件
+     */
+    bool verify(const HealthCheck& check);
+
+    /**
+     * @brief 丢弃保存的断点
+     */
+    void clearCheckpoint();
+
+    /** 链路中断后的重试次数（每完成一块重新计数） */
+    void setMaxRetries(uint8_t retries) { max_retries_ = retries; }
+
+    OtaUpdater(const OtaUpdater&) = delete;
+    OtaUpdater& operator=(const OtaUpdater&) = delete;
+
+private:
+    OtaUpdater() = default;
+
+    /** NVS 中的断点 */
+    struct Checkpoint {
+        uint8_t target_sha256[32];
+        uint8_t slot;               ///< 目标分区的子类型，运行分区变了断点就不适用
+        PatchPosition position;
+    };
+
+    esp_err_t run(PatchSource& source);
+    esp_err_t download(PatchSource& source, DeltaPatcher& patcher, const PatchHeader& header,
+                       const esp_partition_t* target, PatchPosition from, bool opened, uint8_t* buf,
+                       bool& transport_error);
+    bool loadCheckpoint(Checkpoint& out);
+    void saveCheckpoint(const Checkpoint& checkpoint);
+    void setState(UpdateState state, esp_err_t err = ESP_OK);
+
+    mutable std::mutex mutex_;      ///< 保护 progress_
+    UpdateProgress progress_;
+    std::atomic<bool> busy_{false};
+    uint8_t max_retries_{5};
+};
+
+} // namespace ota
+} // namespace chunfeng
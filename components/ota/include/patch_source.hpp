@@ -0,0 +1,77 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-20 10:41:22
+ * @LastEditTime: 2025-06-20 14:52:08
+ * @LastEditors: 星年
+ * @Description: 升级包来源：可从任意偏移开始读取的字节流，与传输方式无关，断点续传靠它重新打开
+ * @FilePath: \ESP32-ChunFeng\components\ota\include\patch_source.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include "esp_err.h"
+#include "connection_pool.hpp"
+
+namespace chunfeng {
+namespace ota {
+
+/**
+ * @brief 升级包来源
+ *
+ * WiFi 与 4G 都通过它读取升级包：OtaUpdater 不关心数据从哪条链路来，
+ * 链路切换或中断后从断点偏移重新 open() 即可。
+ */
+class PatchSource {
+public:
+    virtual ~PatchSource() = default;
+
+    /**
+     * @brief 从 offset 开始读取
+     */
+    virtual esp_err_t open(uint32_t offset) = 0;
+
+    /**
+     * @brief 读取数据
+     * @return 读到的字节数，0 数据已读完，负数出错或超时
+     */
+    virtual ssize_t read(uint8_t* buf, size_t len) = 0;
+
+    virtual void close() = 0;
+};
+
+/**
+ * @brief 通过 HTTPS Range 请求读取升级包
+ *
+ * 每次 open() 发一个 "Range: bytes=offset-" 的 GET，响应体边收边交给调用方，不缓存。
+ * 连接从连接池借用，读完整个响应后放回池中；中途关闭的连接不再复用。
+ * 只支持 Content-Length 响应（升级包是静态文件）。
+ */
+class HttpsPatchSource : public PatchSource {
+public:
+    HttpsPatchSource(std::string host, std::string path, uint16_t port = 443);
+    ~HttpsPatchSource() override { close(); }
+
+    esp_err_t open(uint32_t offset) override;
+    ssize_t read(uint8_t* buf, size_t len) override;
+    void close() override;
+
+private:
+    static constexpr size_t kHeadSize = 768;
+
+    std::string host_;
+    std::string path_;
+    uint16_t port_;
+    PooledConnection conn_;
+    bool keep_alive_{false};
+    size_t body_left_{0};
+    char head_[kHeadSize];          ///< 响应头，以及和响应头一起收到的响应体开头
+    size_t pending_start_{0};       ///< head_ 中尚未交出的响应体 [pending_start_, pending_end_)
+    size_t pending_end_{0};
+};
+
+} // namespace ota
+} // namespace chunfeng
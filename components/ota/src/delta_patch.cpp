@@ -0,0 +1,288 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-20 10:05:37
+ * @LastEditTime: 2025-06-20 14:52:08
+ * @LastEditors: 星年
+ * @Description: 增量升级包的流式解包：LZSS 解压、bsdiff 指令执行、按扇区擦写与逐块校验
+ * @FilePath: \ESP32-ChunFeng\components\ota\src\delta_patch.cpp
+ * @遇事不决，可问春风
+ */
+#include "delta_patch.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace chunfeng {
+namespace ota {
+
+namespace {
+
+constexpr uint32_t kWindowMask = kWindowSize - 1;
+
+} // namespace
+
+esp_err_t parseHeader(const uint8_t* data, size_t len, PatchHeader& out) {
+    if (len < sizeof(PatchHeader)) return ESP_ERR_INVALID_SIZE;
+    memcpy(&out, data, sizeof(out));
+    if (memcmp(out.magic, kPatchMagic, sizeof(kPatchMagic)) != 0 || out.version != kPatchVersion) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (out.block_kib == 0 || (out.block_kib * 1024u) % SPI_FLASH_SEC_SIZE != 0 || out.target_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+esp_err_t hashPartition(const esp_partition_t* partition, size_t size, uint8_t* buf, size_t buf_size,
+                        uint8_t out[32]) {
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    esp_err_t err = ESP_OK;
+    for (size_t pos = 0; pos < size && err == ESP_OK;) {
+        size_t n = std::min(buf_size, size - pos);
+        err = esp_partition_read(partition, pos, buf, n);
+        if (err == ESP_OK) mbedtls_sha256_update(&sha, buf, n);
+        pos += n;
+    }
+    if (err == ESP_OK) mbedtls_sha256_finish(&sha, out);
+    mbedtls_sha256_free(&sha);
+    return err;
+}
+
+DeltaPatcher::DeltaPatcher() {
+    mbedtls_sha256_init(&sha_);
+}
+
+DeltaPatcher::~DeltaPatcher() {
+    mbedtls_sha256_free(&sha_);
+}
+
+esp_err_t DeltaPatcher::begin(const PatchHeader& header, const esp_partition_t* source,
+                              const esp_partition_t* target, const PatchPosition& from) {
+    if (!source || !target || header.source_size > source->size || header.target_size > target->size ||
+        from.target_offset > header.target_size ||
+        (from.target_offset != header.target_size && from.target_offset % SPI_FLASH_SEC_SIZE != 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    header_ = header;
+    source_ = source;
+    target_ = target;
+    position_ = from;
+    stage_ = Stage::BLOCK_HEADER;
+    error_ = ESP_OK;
+    header_fill_ = 0;
+    patch_in_ = 0;
+    cache_len_ = 0;
+    // 断点在扇区边界上，之后的扇区可能写过一部分，写入前重新擦除
+    write_pos_ = from.target_offset;
+    erased_until_ = from.target_offset;
+    buffer_len_ = 0;
+    return ESP_OK;
+}
+
+esp_err_t DeltaPatcher::feed(const uint8_t* data, size_t len) {
+    if (error_ != ESP_OK) return error_;
+    esp_err_t err = ESP_OK;
+    while (len > 0 && !done() && err == ESP_OK) {
+        if (stage_ == Stage::BLOCK_HEADER) {
+            size_t n = std::min(len, sizeof(BlockHeader) - header_fill_);
+            memcpy(reinterpret_cast<uint8_t*>(&block_) + header_fill_, data, n);
+            header_fill_ += n;
+            patch_in_ += n;
+            data += n;
+            len -= n;
+            if (header_fill_ == sizeof(BlockHeader)) err = startBlock();
+            continue;
+        }
+        while (len > 0 && compressed_left_ > 0 && bit_count_ <= 24) {
+            bits_ = (bits_ << 8) | *data++;
+            bit_count_ += 8;
+            --len;
+            --compressed_left_;
+            ++patch_in_;
+        }
+        err = decode();
+        if (err != ESP_OK) break;
+        bool complete = block_out_ == block_.output_size && op_stage_ == OpStage::DIFF_LEN;
+        if (complete) {
+            // 最后一个字节中不足一个记号的填充位之外不应再有数据
+            err = compressed_left_ == 0 && bit_count_ < 8 ? finishBlock() : ESP_ERR_INVALID_SIZE;
+        } else if (compressed_left_ == 0) {
+            err = ESP_ERR_INVALID_SIZE;
+        }
+    }
+    error_ = err;
+    return err;
+}
+
+esp_err_t DeltaPatcher::verify() {
+    uint8_t hash[32];
+    esp_err_t err = hashPartition(target_, header_.target_size, buffer_, sizeof(buffer_), hash);
+    if (err != ESP_OK) return err;
+    return memcmp(hash, header_.target_sha256, sizeof(hash)) == 0 ? ESP_OK : ESP_ERR_INVALID_CRC;
+}
+
+esp_err_t DeltaPatcher::startBlock() {
+    const uint32_t remaining = header_.target_size - position_.target_offset;
+    const uint32_t expected = std::min<uint32_t>(header_.block_kib * 1024u, remaining);
+    if (block_.output_size != expected || block_.compressed_size == 0 || block_.source_pos > header_.source_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    stage_ = Stage::BLOCK_DATA;
+    compressed_left_ = block_.compressed_size;
+    block_out_ = 0;
+    bits_ = 0;
+    bit_count_ = 0;
+    window_pos_ = 0;
+    op_stage_ = OpStage::DIFF_LEN;
+    varint_ = 0;
+    varint_shift_ = 0;
+    source_pos_ = block_.source_pos;
+    mbedtls_sha256_starts(&sha_, 0);
+    return ESP_OK;
+}
+
+esp_err_t DeltaPatcher::finishBlock() {
+    esp_err_t err = flush();
+    if (err != ESP_OK) return err;
+    uint8_t hash[32];
+    mbedtls_sha256_finish(&sha_, hash);
+    if (memcmp(hash, block_.sha256, sizeof(hash)) != 0) return ESP_ERR_INVALID_CRC;
+    position_.block++;
+    position_.patch_offset += patch_in_;
+    position_.target_offset += block_.output_size;
+    patch_in_ = 0;
+    header_fill_ = 0;
+    stage_ = Stage::BLOCK_HEADER;
+    return ESP_OK;
+}
+
+esp_err_t DeltaPatcher::decode() {
+    while (!(block_out_ == block_.output_size && op_stage_ == OpStage::DIFF_LEN) && bit_count_ > 0) {
+        esp_err_t err = ESP_OK;
+        if ((bits_ >> (bit_count_ - 1)) & 1) {
+            if (bit_count_ < 9) break;
+            bit_count_ -= 9;
+            uint8_t b = static_cast<uint8_t>(bits_ >> bit_count_);
+            window_[window_pos_++ & kWindowMask] = b;
+            err = opByte(b);
+        } else {
+            constexpr int kTokenBits = 1 + kWindowBits + kLengthBits;
+            if (bit_count_ < kTokenBits) break;
+            bit_count_ -= kTokenBits;
+            uint32_t token = static_cast<uint32_t>(bits_ >> bit_count_);
+            uint32_t distance = ((token >> kLengthBits) & kWindowMask) + 1;
+            uint32_t length = (token & ((1u << kLengthBits) - 1)) + kMinMatch;
+            if (distance > window_pos_) return ESP_ERR_INVALID_SIZE;
+            for (uint32_t i = 0; i < length && err == ESP_OK; ++i) {
+                uint8_t b = window_[(window_pos_ - distance) & kWindowMask];
+                window_[window_pos_++ & kWindowMask] = b;
+                err = opByte(b);
+            }
+        }
+        bits_ &= (1u << bit_count_) - 1;
+        if (err != ESP_OK) return err;
+    }
+    return ESP_OK;
+}
+
+esp_err_t DeltaPatcher::opByte(uint8_t b) {
+    auto endOp = [this]() {
+        int64_t pos = static_cast<int64_t>(source_pos_) + seek_;
+        if (pos < 0 || pos > header_.source_size) return ESP_ERR_INVALID_SIZE;
+        source_pos_ = static_cast<uint32_t>(pos);
+        op_stage_ = OpStage::DIFF_LEN;
+        return ESP_OK;
+    };
+
+    switch (op_stage_) {
+    case OpStage::DIFF_LEN:
+    case OpStage::EXTRA_LEN:
+    case OpStage::SEEK: {
+        if (varint_shift_ > 28) return ESP_ERR_INVALID_SIZE;
+        varint_ |= static_cast<uint64_t>(b & 0x7F) << varint_shift_;
+        if (b & 0x80) {
+            varint_shift_ += 7;
+            return ESP_OK;
+        }
+        uint64_t value = varint_;
+        varint_ = 0;
+        varint_shift_ = 0;
+        if (op_stage_ == OpStage::DIFF_LEN) {
+            diff_left_ = static_cast<uint32_t>(value);
+            op_stage_ = OpStage::EXTRA_LEN;
+            return ESP_OK;
+        }
+        if (op_stage_ == OpStage::EXTRA_LEN) {
+            extra_left_ = static_cast<uint32_t>(value);
+            op_stage_ = OpStage::SEEK;
+            return ESP_OK;
+        }
+        seek_ = static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+        if (static_cast<uint64_t>(diff_left_) + extra_left_ > block_.output_size - block_out_) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        if (diff_left_) op_stage_ = OpStage::DIFF;
+        else if (extra_left_) op_stage_ = OpStage::EXTRA;
+        else return endOp();
+        return ESP_OK;
+    }
+    case OpStage::DIFF: {
+        uint8_t old;
+        esp_err_t err = sourceByte(old);
+        if (err == ESP_OK) err = emit(static_cast<uint8_t>(old + b));
+        if (err != ESP_OK) return err;
+        if (--diff_left_ == 0) {
+            if (extra_left_) op_stage_ = OpStage::EXTRA;
+            else return endOp();
+        }
+        return ESP_OK;
+    }
+    case OpStage::EXTRA: {
+        esp_err_t err = emit(b);
+        if (err != ESP_OK) return err;
+        return --extra_left_ == 0 ? endOp() : ESP_OK;
+    }
+    }
+    return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t DeltaPatcher::emit(uint8_t b) {
+    buffer_[buffer_len_++] = b;
+    ++block_out_;
+    return buffer_len_ == sizeof(buffer_) ? flush() : ESP_OK;
+}
+
+esp_err_t DeltaPatcher::sourceByte(uint8_t& out) {
+    if (source_pos_ >= header_.source_size) return ESP_ERR_INVALID_SIZE;
+    if (source_pos_ < cache_start_ || source_pos_ >= cache_start_ + cache_len_) {
+        cache_start_ = source_pos_;
+        cache_len_ = std::min<uint32_t>(sizeof(cache_), header_.source_size - source_pos_);
+        esp_err_t err = esp_partition_read(source_, cache_start_, cache_, cache_len_);
+        if (err != ESP_OK) {
+            cache_len_ = 0;
+            return err;
+        }
+    }
+    out = cache_[source_pos_++ - cache_start_];
+    return ESP_OK;
+}
+
+esp_err_t DeltaPatcher::flush() {
+    if (buffer_len_ == 0) return ESP_OK;
+    const uint32_t end = write_pos_ + static_cast<uint32_t>(buffer_len_);
+    while (erased_until_ < end) {
+        esp_err_t err = esp_partition_erase_range(target_, erased_until_, SPI_FLASH_SEC_SIZE);
+        if (err != ESP_OK) return err;
+        erased_until_ += SPI_FLASH_SEC_SIZE;
+    }
+    esp_err_t err = esp_partition_write(target_, write_pos_, buffer_, buffer_len_);
+    if (err != ESP_OK) return err;
+    mbedtls_sha256_update(&sha_, buffer_, buffer_len_);
+    write_pos_ = end;
+    buffer_len_ = 0;
+    return ESP_OK;
+}
+
+} // namespace ota
+} // namespace chunfeng
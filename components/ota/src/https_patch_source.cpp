@@ -0,0 +1,120 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-20 10:41:22
+ * @LastEditTime: 2025-06-20 14:52:08
+ * @LastEditors: 星年
+ * @Description: 通过 HTTPS Range 请求流式读取升级包
+ * @FilePath: \ESP32-ChunFeng\components\ota\src\https_patch_source.cpp
+ * @遇事不决，可问春风
+ */
+#include "patch_source.hpp"
+#include "cf_log.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+namespace chunfeng {
+namespace ota {
+
+static const char* TAG = "OtaSource";
+
+HttpsPatchSource::HttpsPatchSource(std::string host, std::string path, uint16_t port)
+    : host_(std::move(host)), path_(std::move(path)), port_(port) {}
+
+esp_err_t HttpsPatchSource::open(uint32_t offset) {
+    close();
+    conn_ = ConnectionPool::getInstance().acquire(host_, port_);
+    if (!conn_.valid()) return ESP_ERR_TIMEOUT;
+
+    char request[384];
+    int n = snprintf(request, sizeof(request),
+                     "GET %s HTTP/1.1\r\nHost: %s\r\nRange: bytes=%u-\r\nConnection: keep-alive\r\n\r\n",
+                     path_.c_str(), host_.c_str(), static_cast<unsigned>(offset));
+    if (n <= 0 || static_cast<size_t>(n) >= sizeof(request)) {
+        close();
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (conn_.write(request, n) != n) {
+        close();
+        return ESP_FAIL;
+    }
+
+    // 读到响应头结束，和响应头一起收到的响应体留在 head_ 中
+    size_t len = 0;
+    char* header_end = nullptr;
+    while (!header_end) {
+        if (len + 1 >= sizeof(head_)) {
+            close();
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        ssize_t r = conn_.read(head_ + len, sizeof(head_) - 1 - len);
+        if (r <= 0) {
+            close();
+            return ESP_FAIL;
+        }
+        len += static_cast<size_t>(r);
+        head_[len] = '\0';
+        header_end = strstr(head_, "\r\n\r\n");
+    }
+    *header_end = '\0';
+    pending_start_ = header_end + 4 - head_;
+    pending_end_ = len;
+
+    int status = strncmp(head_, "HTTP/1.", 7) == 0 ? atoi(head_ + 9) : 0;
+    bool keep_alive = strncmp(head_, "HTTP/1.0", 8) != 0;
+    long content_length = -1;
+    long range_start = -1;
+    for (char* line = strstr(head_, "\r\n"); line; line = strstr(line, "\r\n")) {
+        line += 2;
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            content_length = strtol(line + 15, nullptr, 10);
+        } else if (strncasecmp(line, "Content-Range:", 14) == 0) {
+            const char* bytes = strcasestr(line, "bytes");
+            if (bytes) range_start = strtol(bytes + 5, nullptr, 10);
+        } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+            content_length = -1;
+            break;
+        } else if (strncasecmp(line, "Connection:", 11) == 0) {
+            keep_alive = strncasecmp(line + 11 + strspn(line + 11, " "), "close", 5) != 0;
+        }
+    }
+    // 从中间开始时服务器必须按 Range 应答，否则收到的是整个文件
+    bool ranged = status == 206 && range_start == static_cast<long>(offset);
+    if (!(ranged || (status == 200 && offset == 0)) || content_length < 0) {
+        CF_LOGW(TAG, "升级包请求失败: 状态 %d，偏移 %u", status, static_cast<unsigned>(offset));
+        close();
+        return status == 200 || content_length < 0 ? ESP_ERR_NOT_SUPPORTED : ESP_ERR_INVALID_RESPONSE;
+    }
+    keep_alive_ = keep_alive;
+    body_left_ = static_cast<size_t>(content_length);
+    return ESP_OK;
+}
+
+ssize_t HttpsPatchSource::read(uint8_t* buf, size_t len) {
+    if (!conn_.valid()) return -1;
+    if (body_left_ == 0) return 0;
+    len = std::min(len, body_left_);
+    ssize_t n;
+    if (pending_start_ < pending_end_) {
+        n = static_cast<ssize_t>(std::min(len, pending_end_ - pending_start_));
+        memcpy(buf, head_ + pending_start_, n);
+        pending_start_ += n;
+    } else {
+        n = conn_.read(buf, len);
+        if (n <= 0) return -1;      // 响应体没读完对端就关闭也是错误
+    }
+    body_left_ -= static_cast<size_t>(n);
+    return n;
+}
+
+void HttpsPatchSource::close() {
+    if (conn_.valid()) conn_.release(keep_alive_ && body_left_ == 0 && pending_start_ == pending_end_);
+    keep_alive_ = false;
+    body_left_ = 0;
+    pending_start_ = pending_end_ = 0;
+}
+
+} // namespace ota
+} // namespace chunfeng
@@ -0,0 +1,336 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-20 11:26:03
+ * @LastEditTime: 2025-07-01 19:26:48
+ * @LastEditors: 星年
+ * @Description: 固件升级：断点保存与续传、读回核对、切换启动分区与启动后确认
+ * @FilePath: \ESP32-ChunFeng\components\ota\src\ota_updater.cpp
+ * @遇事不决，可问春风
+ */
+#include "ota_updater.hpp"
+#include "cf_log.hpp"
+#include "connection_pool.hpp"
+#include "metrics.hpp"
+#include "status_board.hpp"
+#include "task_topology.hpp"
+#include "esp_ota_ops.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace chunfeng {
+namespace ota {
+
+namespace {
+
+const char* TAG = "OtaUpdater";
+const char* NVS_NAMESPACE = "ota";
+const char* NVS_KEY = "ckpt";
+
+constexpr size_t kReadChunk = 1024;
+constexpr uint32_t kRetryBackoffMs = 200;
+constexpr uint32_t kMaxBackoffMs = 5000;
+
+metrics::Counter s_updates("chunfeng_ota_updates_total", "写入并核对通过的固件升级次数");
+metrics::Counter s_failures("chunfeng_ota_failures_total", "失败的固件升级次数（含重试用完）");
+metrics::Counter s_reconnects("chunfeng_ota_reconnects_total", "升级包下载中断后从断点重新打开的次数");
+
+struct Job {
+    std::unique_ptr<PatchSource> source;
+    OtaUpdater::DoneCallback on_done;
+    void* arg;
+};
+
+esp_err_t readFully(PatchSource& source, uint8_t* buf, size_t len) {
+    for (size_t got = 0; got < len;) {
+        ssize_t n = source.read(buf + got, len - got);
+        if (n <= 0) return ESP_FAIL;
+        got += static_cast<size_t>(n);
+    }
+    return ESP_OK;
+}
+
+} // namespace
+
+OtaUpdater& OtaUpdater::getInstance() {
+    static OtaUpdater instance;
+    return instance;
+}
+
+esp_err_t OtaUpdater::apply(PatchSource& source) {
+    if (busy_.exchange(true)) return ESP_ERR_INVALID_STATE;
+    esp_err_t err = run(source);
+    busy_ = false;
+    return err;
+}
+
+esp_err_t OtaUpdater::startUpdate(std::unique_ptr<PatchSource> source, DoneCallback on_done, void* arg) {
+    if (!source) return ESP_ERR_INVALID_ARG;
+    if (busy_.exchange(true)) return ESP_ERR_INVALID_STATE;
+    Job* job = new (std::nothrow) Job{std::move(source), on_done, arg};
+    auto task = [](void* param) {
+        Job* job = static_cast<Job*>(param);
+        OtaUpdater& self = getInstance();
+        esp_err_t err = self.run(*job->source);
+        job->source.reset();
+        self.busy_ = false;
+        if (job->on_done) job->on_done(err, job->arg);
+        delete job;
+        vTaskDelete(nullptr);
+    };
+    if (!job || tasks::spawn(tasks::TaskId::OTA, task, job) != pdPASS) {
+        delete job;
+        busy_ = false;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+UpdateProgress OtaUpdater::progress() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return progress_;
+}
+
+bool OtaUpdater::pendingVerify() const {
+    esp_ota_img_states_t state;
+    return esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK &&
+           state == ESP_OTA_IMG_PENDING_VERIFY;
+}
+
+esp_err_t OtaUpdater::confirm(bool healthy) {
+    if (!pendingVerify()) return ESP_OK;
+    if (healthy) {
+        CF_LOGI(TAG, "新固件已确认");
+        return esp_ota_mark_app_valid_cancel_rollback();
+    }
+    CF_LOGE(TAG, "新固件自检失败，回滚到旧固件");
+    log::flush();
+    return esp_ota_mark_app_invalid_rollback_and_reboot();
+}
+
+bool OtaUpdater::verify(const HealthCheck& check) {
+    if (!pendingVerify()) return true;
+    CF_LOGI(TAG, "新固件待确认，等待与后端 %s 往返", check.host);
+    const int64_t start_us = esp_timer_get_time();
+    const int64_t deadline_us = start_us + static_cast<int64_t>(check.timeout_ms) * 1000;
+    int64_t stable_since_us = 0;    // 最近一次往返成功的时刻，0 表示还没有
+    while (esp_timer_get_time() < deadline_us) {
+        status::Snapshot snapshot;
+        status::read(snapshot);
+        const int64_t now_us = esp_timer_get_time();
+        if (snapshot.network.link == 0) {
+            stable_since_us = 0;
+        } else if (stable_since_us == 0) {
+            HttpResponse response;
+            esp_err_t err = ConnectionPool::getInstance().request("GET", check.host, check.path, "", response,
+                                                                  "application/json", "", check.port);
+            if (err == ESP_OK && response.status > 0 && response.status < 500) {
+                CF_LOGI(TAG, "与后端往返成功（%d），稳定运行 %u 秒后确认", response.status,
+                        static_cast<unsigned>(check.stable_ms / 1000));
+                stable_since_us = esp_timer_get_time();
+            } else {
+                CF_LOGW(TAG, "与后端往返失败: %s，状态码 %d", esp_err_to_name(err), response.status);
+            }
+        } else if (now_us - stable_since_us >= static_cast<int64_t>(check.stable_ms) * 1000) {
+            CF_LOGI(TAG, "自检用时 %u 毫秒", static_cast<unsigned>((now_us - start_us) / 1000));
+            return confirm(true) == ESP_OK;
+        }
+        // 稳定运行期间每秒看一次链路，其余情况按重试间隔
+        uint32_t wait_ms = stable_since_us ? std::min<uint32_t>(check.retry_ms, 1000) : check.retry_ms;
+        vTaskDelay(pdMS_TO_TICKS(wait_ms));
+    }
+    confirm(false);
+    return false;
+}
+
+void OtaUpdater::clearCheckpoint() {
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) return;
+    if (nvs_erase_key(handle, NVS_KEY) == ESP_OK) nvs_commit(handle);
+    nvs_close(handle);
+}
+
+bool OtaUpdater::loadCheckpoint(Checkpoint& out) {
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return false;
+    size_t len = sizeof(out);
+    esp_err_t err = nvs_get_blob(handle, NVS_KEY, &out, &len);
+    nvs_close(handle);
+    return err == ESP_OK && len == sizeof(out);
+}
+
+void OtaUpdater::saveCheckpoint(const Checkpoint& checkpoint) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, NVS_KEY, &checkpoint, sizeof(checkpoint));
+        if (err == ESP_OK) err = nvs_commit(handle);
+        nvs_close(handle);
+    }
+    // 断点保存失败只影响续传，升级本身继续
+    if (err != ESP_OK) CF_LOGW(TAG, "保存断点失败: %d", err);
+}
+
+void OtaUpdater::setState(UpdateState state, esp_err_t err) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    progress_.state = state;
+    if (err != ESP_OK) progress_.last_error = err;
+}
+
+esp_err_t OtaUpdater::run(PatchSource& source) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        progress_ = UpdateProgress();
+        progress_.state = UpdateState::DOWNLOADING;
+    }
+    auto fail = [this](esp_err_t err) {
+        setState(UpdateState::FAILED, err);
+        s_failures.inc();
+        return err;
+    };
+
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    const esp_partition_t* target = esp_ota_get_next_update_partition(nullptr);
+    if (!running || !target) return fail(ESP_ERR_NOT_FOUND);
+    std::unique_ptr<DeltaPatcher> patcher(new (std::nothrow) DeltaPatcher());
+    if (!patcher) return fail(ESP_ERR_NO_MEM);
+    uint8_t buf[kReadChunk];
+
+    // 包头：确认升级包基于正在运行的固件，有同一升级包的断点时从断点继续
+    PatchHeader header;
+    esp_err_t err = source.open(0);
+    if (err == ESP_OK) err = readFully(source, buf, sizeof(PatchHeader));
+    if (err != ESP_OK) {
+        source.close();
+        return fail(ESP_ERR_TIMEOUT);
+    }
+    err = parseHeader(buf, sizeof(PatchHeader), header);
+    if (err != ESP_OK) {
+        source.close();
+        return fail(err);
+    }
+
+    Checkpoint checkpoint;
+    PatchPosition pos;
+    bool resumed = loadCheckpoint(checkpoint) &&
+                   memcmp(checkpoint.target_sha256, header.target_sha256, sizeof(header.target_sha256)) == 0 &&
+                   checkpoint.slot == target->subtype;
+    if (resumed) {
+        pos = checkpoint.position;
+        CF_LOGI(TAG, "从断点继续: 第 %u 块，已写入 %u/%u", static_cast<unsigned>(pos.block),
+                static_cast<unsigned>(pos.target_offset), static_cast<unsigned>(header.target_size));
+    } else {
+        uint8_t hash[32];
+        err = hashPartition(running, header.source_size, buf, sizeof(buf), hash);
+        if (err == ESP_OK && memcmp(hash, header.source_sha256, sizeof(hash)) != 0) {
+            CF_LOGE(TAG, "升级包不是基于正在运行的固件（%s）", running->label);
+            err = ESP_ERR_INVALID_VERSION;
+        }
+        if (err != ESP_OK) {
+            source.close();
+            return fail(err);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        progress_.target_size = header.target_size;
+        progress_.target_written = pos.target_offset;
+        progress_.resumed = resumed;
+    }
+
+    // 下载：从头开始时沿用读包头的请求；每次重新打开都从最近完成的块开始，未完成的块作废重来
+    bool opened = !resumed;
+    if (resumed) source.close();
+    uint32_t retries = 0;
+    err = patcher->begin(header, running, target, pos);
+    if (err != ESP_OK) {
+        clearCheckpoint();
+        return fail(err);
+    }
+    while (!patcher->done()) {
+        // 来源的错误（链路中断、超时）可以从断点重试；升级包或 Flash 的错误不行
+        bool transport_error = false;
+        err = download(source, *patcher, header, target, pos, opened, buf, transport_error);
+        opened = false;
+        source.close();
+        if (err != ESP_OK && !transport_error) {
+            // 数据损坏或 Flash 出错：断点作废，下次重新开始
+            CF_LOGE(TAG, "写入新固件失败: %d", err);
+            clearCheckpoint();
+            return fail(err);
+        }
+        if (patcher->position().block != pos.block) retries = 0;
+        pos = patcher->position();
+        if (err == ESP_OK) break;
+        if (++retries > max_retries_) {
+            CF_LOGW(TAG, "下载中断，已写入 %u/%u，保留断点", static_cast<unsigned>(pos.target_offset),
+                    static_cast<unsigned>(header.target_size));
+            return fail(ESP_ERR_TIMEOUT);
+        }
+        s_reconnects.inc();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            progress_.reconnects++;
+        }
+        vTaskDelay(pdMS_TO_TICKS(std::min(kRetryBackoffMs * retries, kMaxBackoffMs)));
+        patcher->begin(header, running, target, pos);
+    }
+
+    setState(UpdateState::VERIFYING);
+    err = patcher->verify();
+    patcher.reset();
+    if (err != ESP_OK) {
+        CF_LOGE(TAG, "新固件读回核对失败: %d", err);
+        clearCheckpoint();
+        return fail(err);
+    }
+    err = esp_ota_set_boot_partition(target);
+    clearCheckpoint();
+    if (err != ESP_OK) return fail(err);
+    setState(UpdateState::READY);
+    s_updates.inc();
+    CF_LOGI(TAG, "新固件已写入 %s（%u 字节），重启后生效", target->label,
+            static_cast<unsigned>(header.target_size));
+    return ESP_OK;
+}
+
+esp_err_t OtaUpdater::download(PatchSource& source, DeltaPatcher& patcher, const PatchHeader& header,
+                               const esp_partition_t* target, PatchPosition from, bool opened, uint8_t* buf,
+                               bool& transport_error) {
+    esp_err_t err = opened ? ESP_OK : source.open(from.patch_offset);
+    if (err != ESP_OK) {
+        transport_error = true;
+        return err;
+    }
+    Checkpoint checkpoint;
+    memcpy(checkpoint.target_sha256, header.target_sha256, sizeof(checkpoint.target_sha256));
+    checkpoint.slot = static_cast<uint8_t>(target->subtype);
+    while (!patcher.done()) {
+        ssize_t n = source.read(buf, kReadChunk);
+        if (n <= 0) {
+            transport_error = true;
+            return ESP_FAIL;
+        }
+        err = patcher.feed(buf, static_cast<size_t>(n));
+        if (err != ESP_OK) return err;
+        uint32_t written = patcher.position().target_offset;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            progress_.patch_received += static_cast<uint32_t>(n);
+            progress_.target_written = written;
+        }
+        if (patcher.position().block != from.block) {
+            from = patcher.position();
+            checkpoint.position = from;
+            saveCheckpoint(checkpoint);
+        }
+    }
+    return ESP_OK;
+}
+
+} // namespace ota
+} // namespace chunfeng
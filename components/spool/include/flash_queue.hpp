@@ -0,0 +1,177 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-21 10:02:35
+ * @LastEditTime: 2025-06-21 15:18:44
+ * @LastEditors: 星年
+ * @Description: 掉电安全的 Flash 记录队列：在裸分区上按扇区循环追加，条目由连续的记录组成，送达后原地标记
+ * @FilePath: \ESP32-ChunFeng\components\spool\include\flash_queue.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+namespace chunfeng {
+namespace spool {
+
+constexpr size_t kSectorSize = SPI_FLASH_SEC_SIZE;
+constexpr uint32_t kSectorMagic = 0x51534643;   ///< "CFSQ"
+constexpr uint16_t kRecordMagic = 0xC5A7;
+
+/**
+ * @brief 扇区头，擦除后立即写入
+ */
+struct SectorHeader {
+    uint32_t magic;
+    uint32_t seq;           ///< 启用顺序，按扇区号循环使用，序号连续的扇区构成队列
+    uint32_t erase_count;
+    uint32_t crc;           ///< 前三个字段的 CRC32
+};
+
+/**
+ * @brief 记录头，后接 length 字节数据，整条按 4 字节对齐
+ *
+ * state 不计入 CRC：送达后把它写成 0（NOR Flash 只能把 1 写成 0，不需要擦除）。
+ */
+struct RecordHeader {
+    uint16_t magic;
+    uint8_t flags;          ///< kFirst、kLast
+    uint8_t state;          ///< kPending 或 kDelivered
+    uint16_t length;
+    uint16_t reserved;
+    uint32_t entry;         ///< 所属条目
+    uint32_t crc;           ///< 头部（state、crc 除外）与数据的 CRC32
+};
+
+static_assert(sizeof(SectorHeader) == 16 && sizeof(RecordHeader) == 16, "Flash 格式要求无填充");
+
+constexpr uint8_t kFirst = 1 << 0;
+constexpr uint8_t kLast = 1 << 1;
+constexpr uint8_t kPending = 0xFF;
+constexpr uint8_t kDelivered = 0x00;
+/** 一条记录的数据上限：一个扇区除去扇区头与记录头 */
+constexpr size_t kMaxRecordData = kSectorSize - sizeof(SectorHeader) - sizeof(RecordHeader);
+
+/**
+ * @brief 记录在分区中的位置
+ */
+struct Location {
+    uint16_t sector;
+    uint16_t offset;
+
+    bool operator==(const Location& o) const { return sector == o.sector && offset == o.offset; }
+};
+
+/**
+ * @brief 一个完整、未送达的条目
+ */
+struct Entry {
+    uint32_t id;
+    Location first;         ///< 第一条记录
+    uint32_t bytes;         ///< 各记录数据长度之和
+    uint16_t records;
+};
+
+struct QueueStats {
+    uint32_t sectors;
+    uint32_t pending;               ///< 完整、未送达的条目数
+    uint32_t used_sectors;          ///< 从最早未送达的记录到写入位置占用的扇区
+    uint32_t dropped;               ///< 队列满时丢弃的最早条目
+    uint32_t discarded;             ///< 打开时发现的写坏记录（掉电时正在写入）
+    uint64_t bytes_appended;        ///< 追加的数据
+    uint64_t bytes_programmed;      ///< 实际写入 Flash 的字节（含扇区头、记录头与送达标记）
+    uint32_t erases;
+};
+
+/**
+ * @brief 掉电安全的 Flash 记录队列
+ *
+ * 分区按扇区循环使用：写满一个扇区后擦除下一个并写入序号加一的扇区头，只在需要时擦除，
+ * 每个扇区每轮只擦一次，磨损自然均匀。条目由 kFirst 到 kLast 的连续记录组成，只有完整的条目可读；
+ * 缺少 kLast（写到一半放弃或掉电）的记录会被跳过。
+ *
+ * 掉电安全：记录先写头部再写数据，open() 时逐条核对最后一个扇区的 CRC，写坏的记录把 magic 写成 0 封住，
+ * 写入位置移到下一个扇区，已有的数据不会被覆盖。送达标记是对 state 字节的一次写 0，掉电时最多重复送达一次。
+ *
+ * 队列满时丢弃最早的整个条目。所有接口加锁，但一般只由一个任务使用。
+ */
+class FlashQueue {
+public:
+    FlashQueue() = default;
+    FlashQueue(const FlashQueue&) = delete;
+    FlashQueue& operator=(const FlashQueue&) = delete;
+
+    /**
+     * @brief 扫描分区，恢复写入位置与未送达的条目；分区为空时初始化
+     */
+    esp_err_t open(const esp_partition_t* partition);
+
+    bool isOpen() const { return partition_ != nullptr; }
+
+    /**
+     * @brief 追加一条记录
+     * @param flags 条目的第一条记录带 kFirst，最后一条带 kLast（可以同时带）
+     * @param len 不超过 kMaxRecordData
+     */
+    esp_err_t append(uint32_t entry, uint8_t flags, const void* data, size_t len);
+
+    /**
+     * @brief 比分区中已有的所有条目都大的编号，作为下一个条目的编号
+     */
+    uint32_t nextEntryId() const;
+
+    /**
+     * @brief 最早的完整、未送达的条目
+     */
+    bool front(Entry& out);
+
+    /**
+     * @brief 按顺序读取条目中的记录，cursor 初始为 entry.first
+     * @return ESP_ERR_NOT_FOUND 条目已被丢弃，ESP_ERR_INVALID_CRC 数据损坏，ESP_ERR_INVALID_SIZE 缓冲不足
+     */
+    esp_err_t read(const Entry& entry, Location& cursor, uint8_t* buf, size_t size, size_t& len, bool& last);
+
+    /**
+     * @brief 标记条目已送达
+     */
+    esp_err_t ack(const Entry& entry);
+
+    QueueStats stats() const;
+
+private:
+    struct SectorInfo {
+        uint32_t seq;           ///< 0 表示没有有效的扇区头
+        uint32_t erase_count;
+    };
+
+    /** 读取 loc 处的记录头，跨过扇区末尾与空白；到达写入位置时返回 false */
+    bool readHeaderLocked(Location& loc, RecordHeader& out);
+    Location nextLocked(const Location& loc, const RecordHeader& header) const;
+    bool frontLocked(Entry& out);
+    /** 写入位置移到下一个扇区：队列满时丢弃最早的条目，擦除并写入扇区头 */
+    esp_err_t advanceHeadLocked();
+    esp_err_t startSectorLocked(uint16_t sector, uint32_t seq);
+    esp_err_t writeLocked(size_t offset, const void* data, size_t len);
+    bool verifyLocked(const Location& loc, const RecordHeader& header);
+    uint16_t nextSector(uint16_t sector) const { return static_cast<uint16_t>((sector + 1) % sectors_.size()); }
+    size_t address(const Location& loc) const { return static_cast<size_t>(loc.sector) * kSectorSize + loc.offset; }
+
+    mutable std::mutex mutex_;
+    const esp_partition_t* partition_{nullptr};
+    std::vector<SectorInfo> sectors_;
+    Location head_{};               ///< 下一条记录的写入位置，offset 为 kSectorSize 表示该扇区已封闭
+    Location tail_{};               ///< 最早可能未送达的记录，等于 head_ 时队列为空
+    uint32_t head_seq_{0};
+    uint32_t next_entry_{1};
+    uint32_t writing_entry_{0};     ///< 正在追加的条目（已写入 kFirst、尚未写入 kLast）
+    uint32_t dropped_through_{0};   ///< 编号不大于它的条目已被丢弃（条目按编号顺序写入）
+    QueueStats stats_{};
+};
+
+} // namespace spool
+} // namespace chunfeng
@@ -0,0 +1,336 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-21 10:02:35
+ * @LastEditTime: 2025-06-21 15:18:44
+ * @LastEditors: 星年
+ * @Description: 掉电安全的 Flash 记录队列：恢复扫描、循环追加、丢弃最早条目与送达标记
+ * @FilePath: \ESP32-ChunFeng\components\spool\src\flash_queue.cpp
+ * @遇事不决，可问春风
+ */
+#include "flash_queue.hpp"
+#include "cf_log.hpp"
+#include "esp_rom_crc.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace chunfeng {
+namespace spool {
+
+namespace {
+
+const char* TAG = "FlashQueue";
+
+constexpr size_t recordSize(size_t len) {
+    return (sizeof(RecordHeader) + len + 3) & ~static_cast<size_t>(3);
+}
+
+uint32_t sectorCrc(const SectorHeader& header) {
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(&header), offsetof(SectorHeader, crc));
+}
+
+/** 头部的 CRC，state 按未送达计算；数据部分接着它算 */
+uint32_t headerCrc(const RecordHeader& header) {
+    RecordHeader h = header;
+    h.state = kPending;
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(&h), offsetof(RecordHeader, crc));
+}
+
+bool blank(const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    return std::all_of(p, p + len, [](uint8_t b) { return b == 0xFF; });
+}
+
+} // namespace
+
+esp_err_t FlashQueue::open(const esp_partition_t* partition) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!partition || partition->size < 2 * kSectorSize) return ESP_ERR_INVALID_ARG;
+    partition_ = partition;
+    stats_ = QueueStats();
+    dropped_through_ = 0;
+    writing_entry_ = 0;
+    const size_t count = std::min<size_t>(partition->size / kSectorSize, UINT16_MAX);
+    sectors_.assign(count, SectorInfo{0, 0});
+    stats_.sectors = static_cast<uint32_t>(count);
+
+    // 扇区头：序号最大的是写入中的扇区
+    uint16_t newest = 0;
+    for (size_t i = 0; i < count; ++i) {
+        SectorHeader sh;
+        if (esp_partition_read(partition_, i * kSectorSize, &sh, sizeof(sh)) != ESP_OK) continue;
+        if (sh.magic != kSectorMagic || sh.crc != sectorCrc(sh) || sh.seq == 0) continue;
+        sectors_[i] = SectorInfo{sh.seq, sh.erase_count};
+        if (sh.seq > sectors_[newest].seq) newest = static_cast<uint16_t>(i);
+    }
+    if (sectors_[newest].seq == 0) {
+        esp_err_t err = startSectorLocked(0, 1);
+        if (err != ESP_OK) {
+            partition_ = nullptr;
+            return err;
+        }
+        head_ = tail_ = Location{0, sizeof(SectorHeader)};
+        next_entry_ = 1;
+        return ESP_OK;
+    }
+    head_seq_ = sectors_[newest].seq;
+
+    // 最早的扇区：从写入中的扇区往前，序号连续的扇区都在队列中
+    uint16_t oldest = newest;
+    for (size_t n = 1; n < count; ++n) {
+        uint16_t prev = static_cast<uint16_t>((oldest + count - 1) % count);
+        if (sectors_[prev].seq == 0 || sectors_[prev].seq + 1 != sectors_[oldest].seq) break;
+        oldest = prev;
+    }
+
+    // 写入位置：逐条核对写入中的扇区，掉电时写坏的记录封住，之后从下一个扇区开始写
+    Location loc{newest, sizeof(SectorHeader)};
+    while (loc.offset + sizeof(RecordHeader) <= kSectorSize) {
+        RecordHeader h;
+        if (esp_partition_read(partition_, address(loc), &h, sizeof(h)) != ESP_OK) break;
+        if (blank(&h, sizeof(h))) break;
+        if (h.magic != kRecordMagic || h.length > kMaxRecordData || loc.offset + recordSize(h.length) > kSectorSize ||
+            !verifyLocked(loc, h)) {
+            const uint16_t sealed = 0;
+            esp_partition_write(partition_, address(loc), &sealed, sizeof(sealed));
+            stats_.discarded++;
+            loc.offset = kSectorSize;
+            break;
+        }
+        loc.offset = static_cast<uint16_t>(loc.offset + recordSize(h.length));
+    }
+    head_ = loc;
+
+    // 从最早的扇区统计未送达的完整条目，找出最大的条目编号
+    tail_ = Location{oldest, sizeof(SectorHeader)};
+    uint32_t max_id = 0, open_id = 0;
+    bool open = false;
+    loc = tail_;
+    RecordHeader h;
+    while (readHeaderLocked(loc, h)) {
+        max_id = std::max(max_id, h.entry);
+        bool pending = h.state == kPending;
+        if (pending && (h.flags & kFirst)) {
+            open = true;
+            open_id = h.entry;
+        }
+        if (open && pending && h.entry == open_id) {
+            if (h.flags & kLast) {
+                stats_.pending++;
+                open = false;
+            }
+        } else {
+            open = false;
+        }
+        loc = nextLocked(loc, h);
+    }
+    next_entry_ = max_id + 1;
+    Entry first;
+    frontLocked(first);
+    CF_LOGI(TAG, "%s: %u 条待送达，写坏 %u 条，扇区 %u/%u", partition_->label,
+            static_cast<unsigned>(stats_.pending), static_cast<unsigned>(stats_.discarded),
+            static_cast<unsigned>((head_.sector + count - tail_.sector) % count + 1), static_cast<unsigned>(count));
+    return ESP_OK;
+}
+
+esp_err_t FlashQueue::append(uint32_t entry, uint8_t flags, const void* data, size_t len) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!partition_) return ESP_ERR_INVALID_STATE;
+    if (len > kMaxRecordData || (len && !data)) return ESP_ERR_INVALID_SIZE;
+    if (head_.offset + recordSize(len) > kSectorSize) {
+        esp_err_t err = advanceHeadLocked();
+        if (err != ESP_OK) return err;
+    }
+    RecordHeader h{kRecordMagic, flags, kPending, static_cast<uint16_t>(len), 0xFFFF, entry, 0};
+    h.crc = esp_rom_crc32_le(headerCrc(h), static_cast<const uint8_t*>(data), static_cast<uint32_t>(len));
+    // 先写头部再写数据：中途掉电时 CRC 对不上，open() 能认出来
+    esp_err_t err = writeLocked(address(head_), &h, sizeof(h));
+    if (err == ESP_OK && len) err = writeLocked(address(head_) + sizeof(h), data, len);
+    if (err != ESP_OK) {
+        head_.offset = kSectorSize;     // 写了一半的位置不再使用
+        return err;
+    }
+    head_.offset = static_cast<uint16_t>(head_.offset + recordSize(len));
+    stats_.bytes_appended += len;
+    next_entry_ = std::max(next_entry_, entry + 1);
+
+    if (flags & kFirst) writing_entry_ = entry;
+    else if (writing_entry_ != entry) writing_entry_ = 0;
+    if ((flags & kLast) && writing_entry_ == entry) {
+        stats_.pending++;
+        writing_entry_ = 0;
+    }
+    return ESP_OK;
+}
+
+uint32_t FlashQueue::nextEntryId() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return next_entry_;
+}
+
+bool FlashQueue::front(Entry& out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return partition_ && frontLocked(out);
+}
+
+esp_err_t FlashQueue::read(const Entry& entry, Location& cursor, uint8_t* buf, size_t size, size_t& len,
+                           bool& last) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!partition_) return ESP_ERR_INVALID_STATE;
+    RecordHeader h;
+    if (entry.id <= dropped_through_ || !readHeaderLocked(cursor, h) || h.entry != entry.id ||
+        h.state != kPending) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (h.length > size) return ESP_ERR_INVALID_SIZE;
+    esp_err_t err = esp_partition_read(partition_, address(cursor) + sizeof(h), buf, h.length);
+    if (err != ESP_OK) return err;
+    if (esp_rom_crc32_le(headerCrc(h), buf, h.length) != h.crc) return ESP_ERR_INVALID_CRC;
+    len = h.length;
+    last = (h.flags & kLast) != 0;
+    cursor = nextLocked(cursor, h);
+    return ESP_OK;
+}
+
+esp_err_t FlashQueue::ack(const Entry& entry) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!partition_) return ESP_ERR_INVALID_STATE;
+    if (entry.id <= dropped_through_) return ESP_ERR_NOT_FOUND;
+    // 从第一条记录开始标记：第一条标记后整个条目就不再可读，掉电也不会重复送达
+    Location loc = entry.first;
+    RecordHeader h;
+    for (uint16_t i = 0; i < entry.records; ++i) {
+        if (!readHeaderLocked(loc, h) || h.entry != entry.id) return ESP_ERR_NOT_FOUND;
+        if (h.state == kPending) {
+            const uint8_t delivered = kDelivered;
+            esp_err_t err = writeLocked(address(loc) + offsetof(RecordHeader, state), &delivered, 1);
+            if (err != ESP_OK) return err;
+        }
+        loc = nextLocked(loc, h);
+    }
+    if (tail_ == entry.first) tail_ = loc;
+    if (stats_.pending) stats_.pending--;
+    return ESP_OK;
+}
+
+QueueStats FlashQueue::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    QueueStats out = stats_;
+    if (!sectors_.empty()) {
+        out.used_sectors = static_cast<uint32_t>((head_.sector + sectors_.size() - tail_.sector) % sectors_.size() + 1);
+    }
+    return out;
+}
+
+bool FlashQueue::readHeaderLocked(Location& loc, RecordHeader& out) {
+    while (true) {
+        if (loc.sector == head_.sector && loc.offset >= head_.offset) return false;
+        if (loc.offset + sizeof(RecordHeader) <= kSectorSize &&
+            esp_partition_read(partition_, address(loc), &out, sizeof(out)) == ESP_OK && out.magic == kRecordMagic &&
+            out.length <= kMaxRecordData && loc.offset + recordSize(out.length) <= kSectorSize) {
+            return true;
+        }
+        // 扇区剩余部分为空白或被封住，转到下一个扇区
+        if (loc.sector == head_.sector) return false;
+        loc = Location{nextSector(loc.sector), sizeof(SectorHeader)};
+    }
+}
+
+Location FlashQueue::nextLocked(const Location& loc, const RecordHeader& header) const {
+    return Location{loc.sector, static_cast<uint16_t>(loc.offset + recordSize(header.length))};
+}
+
+bool FlashQueue::frontLocked(Entry& out) {
+    // 跳过已送达的记录与不完整的条目，tail_ 停在第一个可能完整的条目上
+    Location loc = tail_;
+    RecordHeader h;
+    Entry current{};
+    bool open = false;
+    while (readHeaderLocked(loc, h)) {
+        Location after = nextLocked(loc, h);
+        bool pending = h.state == kPending;
+        if (pending && (h.flags & kFirst)) {
+            open = true;
+            current = Entry{h.entry, loc, 0, 0};
+        }
+        if (open && pending && h.entry == current.id) {
+            current.bytes += h.length;
+            current.records++;
+            if (h.flags & kLast) {
+                tail_ = current.first;
+                out = current;
+                return true;
+            }
+        } else {
+            open = false;
+        }
+        if (!open) tail_ = after;
+        loc = after;
+    }
+    return false;
+}
+
+esp_err_t FlashQueue::advanceHeadLocked() {
+    const uint16_t next = nextSector(head_.sector);
+    // 下一个扇区还有未送达的数据：队列已满，按条目丢弃最早的数据
+    uint32_t dropped = 0;
+    while (tail_.sector == next) {
+        Entry oldest;
+        if (!frontLocked(oldest)) {
+            tail_ = head_;
+            break;
+        }
+        if (tail_.sector != next) break;
+        Location loc = oldest.first;
+        RecordHeader h;
+        for (uint16_t i = 0; i < oldest.records && readHeaderLocked(loc, h); ++i) loc = nextLocked(loc, h);
+        tail_ = loc;
+        dropped_through_ = oldest.id;
+        if (stats_.pending) stats_.pending--;
+        ++dropped;
+    }
+    if (dropped) {
+        stats_.dropped += dropped;
+        CF_LOGW(TAG, "队列已满，丢弃最早的 %u 个条目", static_cast<unsigned>(dropped));
+    }
+    esp_err_t err = startSectorLocked(next, head_seq_ + 1);
+    if (err != ESP_OK) return err;
+    head_ = Location{next, sizeof(SectorHeader)};
+    return ESP_OK;
+}
+
+esp_err_t FlashQueue::startSectorLocked(uint16_t sector, uint32_t seq) {
+    const size_t offset = static_cast<size_t>(sector) * kSectorSize;
+    esp_err_t err = esp_partition_erase_range(partition_, offset, kSectorSize);
+    if (err != ESP_OK) return err;
+    stats_.erases++;
+    SectorHeader sh{kSectorMagic, seq, sectors_[sector].erase_count + 1, 0};
+    sh.crc = sectorCrc(sh);
+    err = writeLocked(offset, &sh, sizeof(sh));
+    if (err != ESP_OK) return err;
+    sectors_[sector] = SectorInfo{seq, sh.erase_count};
+    head_seq_ = seq;
+    return ESP_OK;
+}
+
+esp_err_t FlashQueue::writeLocked(size_t offset, const void* data, size_t len) {
+    esp_err_t err = esp_partition_write(partition_, offset, data, len);
+    if (err == ESP_OK) stats_.bytes_programmed += len;
+    return err;
+}
+
+bool FlashQueue::verifyLocked(const Location& loc, const RecordHeader& header) {
+    uint8_t buf[256];
+    uint32_t crc = headerCrc(header);
+    size_t offset = address(loc) + sizeof(header);
+    for (size_t done = 0; done < header.length;) {
+        size_t n = std::min(sizeof(buf), header.length - done);
+        if (esp_partition_read(partition_, offset + done, buf, n) != ESP_OK) return false;
+        crc = esp_rom_crc32_le(crc, buf, static_cast<uint32_t>(n));
+        done += n;
+    }
+    return crc == header.crc;
+}
+
+} // namespace spool
+} // namespace chunfeng
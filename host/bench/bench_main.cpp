@@ -0,0 +1,3905 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 09:00:00
+ * @LastEditTime: 2025-07-01 10:26:42
+ * @LastEditors: 星年
+ * @Description: 主机基准：开机到联网耗时、WiFi -> 4G 故障切换耗时、4G 按需上电与待机断电、多网络按信号、优先级与连接历史的选择、冷/热启动到首个请求可发出的耗时、
+ *               HTTPS 连接池与会话恢复、配网 HTTP 服务吞吐与延迟、消息总线扇出、结构化日志与 printf/iostream 的每条耗时、屏幕差分刷新字节数、
+ *               播放音频与口型的音画同步、状态快照轮询对播放的影响、设置推送的差异应用、增量固件升级、离线语音队列的掉电恢复与补传、合成语音缓存的命中率、开机阶段并行编排的耗时、电源模式策略与唤醒耗时、采集降噪与波束形成的信噪比改善与每帧耗时、采集自动增益与播放限幅在电平扫描下的输出电平、处理链融合与否的每帧耗时、多路混音的每帧耗时与压低、重采样效果、设备端指令词的识别率与拒识率及本地执行。每次测量在 fork 出的子进程中进行，保证单例与模拟驱动状态互不干扰
+ * @FilePath: \ESP32-ChunFeng\host\bench\bench_main.cpp
+ * @遇事不决，可问春风
+ */
+#include "network_manager.hpp"
+#include "config_manager.hpp"
+#include "lte_manager.hpp"
+#include "bsp_wifi.hpp"
+#include "wifi_manager.hpp"
+#include "dns_cache.hpp"
+#include "connection_pool.hpp"
+#include "display_manager.hpp"
+#include "backend_manager.hpp"
+#include "settings.hpp"
+#include "ota_updater.hpp"
+#include "delta_patch.hpp"
+#include "delta_encoder.hpp"
+#include "audio_playback.hpp"
+#include "glyph_cache.hpp"
+#include "message_bus.hpp"
+#include "seqlock.hpp"
+#include "status_board.hpp"
+#include "utterance_spool.hpp"
+#include "response_cache.hpp"
+#include "boot_sequencer.hpp"
+#include "power_manager.hpp"
+#include "power_policy.hpp"
+#include "capture_enhancer.hpp"
+#include "soft_limiter.hpp"
+#include "audio_mixer.hpp"
+#include "command_recognizer.hpp"
+#include "command_router.hpp"
+#include "voice_detector.hpp"
+#include "noise_suppressor.hpp"
+#include "dsp_pipeline.hpp"
+#include "dsp_stages.hpp"
+#include "audio_fixtures.hpp"
+#include "flash_queue.hpp"
+#include "system_state.hpp"
+#include "cf_log.hpp"
+#include "metrics.hpp"
+#include "task_topology.hpp"
+#include "trace.hpp"
+#include "host_sim.hpp"
+#include "esp_timer.h"
+#include "esp_tls.h"
+#include "esp_ota_ops.h"
+#include "esp_wifi.h"
+#include "esp_heap_caps.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace chunfeng;
+
+/** 消息总线基准的负载：发布时刻（steady_clock 纳秒）与序号 */
+struct BenchPing {
+    int64_t t_ns;
+    uint32_t n;
+};
+CF_BUS_TOPIC(PING, BenchPing)
+
+namespace {
+
+struct Options {
+    int iterations = 5;
+    int requests = 2000;
+    bool verbose = false;
+    std::vector<std::string> scenarios;
+};
+
+const char* kHomeSsid = "ChunFeng-Home";
+const char* kHomePassword = "12345678";
+
+/* ---------- 子进程与结果汇总 ---------- */
+
+int s_result_fd = -1;
+int s_boot_index = 0;           ///< 同一轮中的第几次启动（0 为冷启动）
+std::string s_nvs_image;        ///< 同一轮多次启动之间保存 NVS 内容的文件
+std::string s_spool_image;      ///< 同一轮多次启动之间保存 spool 分区内容的文件
+
+/** 子进程上报一个测量值 */
+void report(const char* key, double value) {
+    char line[128];
+    int n = snprintf(line, sizeof(line), "%s %.3f\n", key, value);
+    (void)!write(s_result_fd, line, n);
+}
+
+using ChildFn = void (*)(const Options&);
+
+/**
+ * @brief 在子进程中运行一次测量，收集 "key value" 行
+ */
+bool runChild(ChildFn fn, const Options& opt, std::map<std::string, std::vector<double>>& results) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        s_result_fd = fds[1];
+        if (!opt.verbose) {
+            int null_fd = open("/dev/null", O_WRONLY);
+            dup2(null_fd, STDOUT_FILENO);
+        }
+        fn(opt);
+        fflush(stdout);
+        _exit(0);
+    }
+    close(fds[1]);
+    std::string out;
+    char buf[512];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+        out.append(buf, static_cast<size_t>(n));
+    }
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    size_t pos = 0;
+    while (pos < out.size()) {
+        size_t eol = out.find('\n', pos);
+        if (eol == std::string::npos) break;
+        std::string line = out.substr(pos, eol - pos);
+        pos = eol + 1;
+        size_t sp = line.find(' ');
+        if (sp == std::string::npos) continue;
+        results[line.substr(0, sp)].push_back(strtod(line.c_str() + sp + 1, nullptr));
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * @brief 场景检查失败的结果项：errors、errors.<阶段>、<用例>.errors，任一次运行大于 0 即失败
+ */
+bool failed(const std::string& key, const std::vector<double>& values) {
+    const bool is_error = key == "errors" || key.compare(0, 7, "errors.") == 0 ||
+                          (key.size() > 7 && key.compare(key.size() - 7, 7, ".errors") == 0);
+    return is_error && std::any_of(values.begin(), values.end(), [](double v) { return v > 0; });
+}
+
+double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t idx = static_cast<size_t>(p * (v.size() - 1) + 0.5);
+    return v[std::min(idx, v.size() - 1)];
+}
+
+void printResults(const char* scenario, const std::map<std::string, std::vector<double>>& results) {
+    printf("[%s]\n", scenario);
+    for (const auto& kv : results) {
+        const auto& v = kv.second;
+        if (v.size() == 1) {
+            printf("  %-34s %12.3f\n", kv.first.c_str(), v[0]);
+        } else {
+            printf("  %-34s min %10.3f  p50 %10.3f  max %10.3f  (n=%zu)\n", kv.first.c_str(),
+                   *std::min_element(v.begin(), v.end()), percentile(v, 0.5),
+                   *std::max_element(v.begin(), v.end()), v.size());
+        }
+    }
+}
+
+/* ---------- 公共辅助 ---------- */
+
+const metrics::Metric* findMetric(const char* name) {
+    for (const metrics::Metric* m = metrics::first(); m; m = m->next()) {
+        if (strcmp(m->name(), name) == 0) return m;
+    }
+    return nullptr;
+}
+
+const metrics::Metric* findMetric(const char* name, const char* labels) {
+    for (const metrics::Metric* m = metrics::first(); m; m = m->next()) {
+        if (strcmp(m->name(), name) == 0 && m->labels() && strcmp(m->labels(), labels) == 0) return m;
+    }
+    return nullptr;
+}
+
+int32_t networkState() {
+    const auto* m = findMetric("chunfeng_network_state");
+    return m ? static_cast<const metrics::Gauge*>(m)->value() : -1;
+}
+
+double elapsedMs(int64_t since_us) {
+    return (esp_timer_get_time() - since_us) / 1000.0;
+}
+
+/** 模拟出厂后已配网的设备：NVS 中保存了家里的 WiFi */
+void provisionHomeNetwork() {
+    nvs_flash_init();
+    WiFiNetworkList list;
+    list.upsert(kHomeSsid, kHomePassword, 1);
+    BspWiFi::saveNetworkList(list);
+}
+
+/** 与 app_main 一样在任务中构造 NetworkManager（构造函数运行状态机，不返回） */
+void startNetworkManager() {
+    tasks::spawn(tasks::TaskId::NETWORK, [](void*) { NetworkManager::getInstance(); }, nullptr);
+}
+
+/* ---------- 场景：开机到联网 ---------- */
+
+void bootChild(const Options& opt) {
+    host_sim::httpdSetPortOverride(0);
+    host_sim::wifiSetAccessPoints({{kHomeSsid, kHomePassword, -48, 6, 80, 40}});
+    provisionHomeNetwork();
+
+    int64_t t0 = esp_timer_get_time();
+    startNetworkManager();
+    double portal_ms = -1, ip_ms = -1;
+    int32_t state = -1;
+    while (elapsedMs(t0) < 10000) {
+        if (portal_ms < 0 && host_sim::httpdBoundPort() != 0) portal_ms = elapsedMs(t0);
+        if (ip_ms < 0 && host_sim::wifiHasIp()) ip_ms = elapsedMs(t0);
+        state = networkState();
+        if (state == static_cast<int32_t>(NetworkState::WIFI_CONNECTED)) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    report("state_wifi_connected_ms", state == static_cast<int32_t>(NetworkState::WIFI_CONNECTED) ? elapsedMs(t0) : -1);
+    report("config_portal_up_ms", portal_ms);
+    // 状态机报告 WiFi 已连接时驱动是否真的拿到了 IP（-1 表示没有）
+    report("driver_got_ip_ms", ip_ms);
+    report("esp_wifi_connect_calls", host_sim::wifiConnectCount());
+    // 有 WiFi 时 4G 模组不上电
+    report("lte_power_ups", LTEManager::getInstance().powerUps());
+    // 主机栈帧比设备大，这里的剩余量偏保守
+    TaskHandle_t net = tasks::handle(tasks::TaskId::NETWORK);
+    report("net_mgr_stack_free_bytes", net ? uxTaskGetStackHighWaterMark(net) : -1);
+    if (opt.verbose) {
+        tasks::logReport();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        tasks::logReport();
+        log::flush();
+    }
+}
+
+/* ---------- 场景：WiFi 不可用时切换到 4G ---------- */
+
+void failoverChild(const Options&) {
+    host_sim::httpdSetPortOverride(0);
+    host_sim::wifiSetAccessPoints({});        // 保存的 AP 不在范围内
+    host_sim::wifiSetNoApTimeout(1500);
+    host_sim::lteSetBehaviour(800, true);
+    provisionHomeNetwork();
+
+    int64_t t0 = esp_timer_get_time();
+    startNetworkManager();
+    int32_t state = -1;
+    // WiFi 连接含重试与退避（默认 4 次），留足时间让状态机走到 4G
+    while (elapsedMs(t0) < 20000) {
+        state = networkState();
+        // 保存的 AP 不在范围内时停在 WIFI_CONNECTED 说明状态机没有检查真实连接结果
+        if (state == static_cast<int32_t>(NetworkState::WIFI_CONNECTED) ||
+            state == static_cast<int32_t>(NetworkState::LTE_CONNECTED) ||
+            state == static_cast<int32_t>(NetworkState::FAILED)) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    report("final_state", state);
+    report("boot_to_final_state_ms", elapsedMs(t0));
+    const auto* hist = findMetric("chunfeng_network_failover_latency_ms");
+    const auto* h = static_cast<const metrics::Histogram*>(hist);
+    report("failovers_recorded", h ? h->count() : 0);
+    report("lte_resident_bytes", LTEManager::getInstance().residentBytes());
+    if (h && h->count() > 0) {
+        report("failover_latency_mean_ms", static_cast<double>(h->sum()) / h->count());
+    }
+}
+
+/* ---------- 场景：4G 按需上电与待机 ---------- */
+
+/**
+ * @brief WiFi 不可用时 4G 上电附着；WiFi 恢复后切回，4G 待机 linger 后断电并释放驱动内存；
+ *        随后直接调用 LTEManager 比较断电时与待机时的连接耗时
+ */
+void lteChild(const Options& opt) {
+    bool ok = true;
+    auto check = [&](const char* what, bool cond) {
+        if (!cond) {
+            ok = false;
+            if (opt.verbose) printf("失败: %s\n", what);
+        }
+    };
+    auto waitFor = [](const std::function<bool()>& cond, int64_t timeout_ms) {
+        int64_t t0 = esp_timer_get_time();
+        while (!cond()) {
+            if (elapsedMs(t0) > timeout_ms) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return true;
+    };
+    LTEManager& lte = LTEManager::getInstance();
+    lte.setLinger(500);
+    host_sim::httpdSetPortOverride(0);
+    host_sim::wifiSetAccessPoints({});
+    host_sim::wifiSetNoApTimeout(500);
+    host_sim::lteSetBehaviour(800, true);
+    provisionHomeNetwork();
+    check("boot.off", lte.state() == LteState::OFF && lte.residentBytes() == 0);
+
+    startNetworkManager();
+    check("lte", waitFor([] { return networkState() == static_cast<int32_t>(NetworkState::LTE_CONNECTED); }, 20000));
+    report("active.resident_bytes", lte.residentBytes());
+    size_t free_active = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+
+    // 家里的路由器恢复：状态机定期尝试 WiFi，连上后 4G 待机，linger 到期断电
+    host_sim::wifiSetAccessPoints({{kHomeSsid, kHomePassword, -48, 6, 80, 40}});
+    int64_t t0 = esp_timer_get_time();
+    check("failback",
+          waitFor([] { return networkState() == static_cast<int32_t>(NetworkState::WIFI_CONNECTED); }, 25000));
+    report("failback_ms", elapsedMs(t0));
+    check("standby", lte.state() == LteState::STANDBY || lte.state() == LteState::OFF);
+    t0 = esp_timer_get_time();
+    check("released", waitFor([&] { return lte.state() == LteState::OFF; }, 3000));
+    report("standby_to_off_ms", elapsedMs(t0));
+    check("resident.off", lte.residentBytes() == 0);
+    size_t free_released = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    report("off.freed_bytes", free_released > free_active ? free_released - free_active : 0);
+
+    // 断电时连接需要上电附着；待机时直接恢复
+    t0 = esp_timer_get_time();
+    check("cold", lte.connect());
+    report("cold_connect_ms", elapsedMs(t0));
+    lte.setLinger(60 * 1000);
+    lte.disconnect();
+    t0 = esp_timer_get_time();
+    check("warm", lte.connect() && lte.state() == LteState::ACTIVE);
+    report("warm_connect_ms", elapsedMs(t0));
+    lte.setLinger(0);
+    lte.disconnect();
+    check("linger0", lte.state() == LteState::OFF && lte.residentBytes() == 0);
+    report("power_ups", lte.powerUps());
+    check("power_ups", lte.powerUps() == 2);
+    report("errors", ok ? 0 : 1);
+}
+
+/* ---------- 场景：多网络选择 ---------- */
+
+/**
+ * @brief 先直接检查 WiFiNetworkList::rank() 按优先级、信号与连接历史的排序；再经 WiFiManager 扫描连接：
+ *        信号最强的网络密码已改，失败后换下一个并记入历史，下次扫描排到后面；
+ *        最后经配网页面连接新网络，检查保存进 WiFiManager 的列表，之后的连接也不会把它从 NVS 覆盖掉
+ */
+void wifiChild(const Options& opt) {
+    bool ok = true;
+    auto check = [&](const char* what, bool cond) {
+        if (!cond) {
+            ok = false;
+            if (opt.verbose) printf("失败: %s\n", what);
+        }
+    };
+    auto first = [](const WiFiNetworkList& list, const std::vector<WiFiInfo>& scan, uint32_t now) {
+        auto ranked = list.rank(scan, now);
+        return ranked.empty() ? std::string() : list.at(ranked[0].index).ssid;
+    };
+    const uint32_t now = 100 * 24 * 3600;
+
+    // 同优先级、无历史：信号强的在前；同名多 AP 取最强；低于 kMinRssi 和不在范围内的不参与
+    WiFiNetworkList list;
+    list.upsert("A", "pa", 0);
+    list.upsert("B", "pb", 0);
+    list.upsert("C", "pc", 0);
+    std::vector<WiFiInfo> scan = {{"A", -70, true}, {"B", -55, true}, {"A", -50, true},
+                                  {"C", WiFiNetworkList::kMinRssi - 1, true}, {"X", -30, true}};
+    auto ranked = list.rank(scan, now);
+    check("rank.count", ranked.size() == 2);
+    check("rank.rssi", first(list, scan, now) == "A" && ranked.size() == 2 && ranked[0].rssi == -50);
+    // 优先级：每级抵 kPriorityWeight dB
+    list.upsert("B", "pb", 1);
+    check("rank.priority", first(list, scan, now) == "B");
+    list.upsert("B", "pb", 0);
+    // 连接历史：信号略强但屡次失败的排在一直成功的后面
+    for (int i = 0; i < 5; ++i) {
+        list.recordResult("A", false, now - 3600);
+        list.recordResult("B", true, now - 3600);
+    }
+    check("rank.history", first(list, scan, now) == "B");
+    // 成功时间超过 7 天不再加分，但成功率仍然占优
+    check("rank.history_old", first(list, scan, now + 30 * 24 * 3600) == "B");
+    // 没有历史的新网络按成功率 0.5 计，排在屡次失败的网络前面
+    list.upsert("D", "pd", 0);
+    scan.push_back({"D", -52, true});
+    ranked = list.rank(scan, now);
+    check("rank.order", ranked.size() == 3 && list.at(ranked[0].index).ssid == "B" &&
+                        list.at(ranked[1].index).ssid == "D" && list.at(ranked[2].index).ssid == "A");
+
+    // 经 WiFiManager 扫描连接：Office 信号最强但密码已改，Home 次之
+    host_sim::httpdSetPortOverride(0);
+    host_sim::wifiSetScanDuration(200);
+    host_sim::wifiSetAccessPoints({{"ChunFeng-Office", "new-password", -45, 1, 80, 40},
+                                   {kHomeSsid, kHomePassword, -60, 6, 80, 40},
+                                   {"ChunFeng-Cafe", "latte123", -65, 11, 80, 40}});
+    nvs_flash_init();
+    check("driver", ConfigManager::getInstance().startConfig());
+    WiFiManager& wifi = WiFiManager::getInstance();
+    check("add", wifi.addNetwork("ChunFeng-Office", "old-password", 0) &&
+                 wifi.addNetwork(kHomeSsid, kHomePassword, 0));
+    auto saved = [&](const char* ssid) -> SavedNetwork {
+        for (const auto& net : wifi.getNetworks()) {
+            if (net.ssid == ssid) return net;
+        }
+        return SavedNetwork();
+    };
+    int64_t t0 = esp_timer_get_time();
+    check("connect_best", wifi.connectBest());
+    report("connect_best_ms", elapsedMs(t0));
+    wifi_ap_record_t ap{};
+    check("connected_home", esp_wifi_sta_get_ap_info(&ap) == ESP_OK &&
+                            strcmp(reinterpret_cast<const char*>(ap.ssid), kHomeSsid) == 0);
+    SavedNetwork office = saved("ChunFeng-Office");
+    SavedNetwork home = saved(kHomeSsid);
+    check("history.office", office.attempt_count == 1 && office.success_count == 0);
+    check("history.home", home.attempt_count == 1 && home.success_count == 1);
+    // 历史已写入 NVS
+    WiFiNetworkList stored;
+    check("persisted", BspWiFi::loadNetworkList(stored) && stored.find("ChunFeng-Office") >= 0 &&
+                       stored.at(stored.find("ChunFeng-Office")).attempt_count == 1);
+    // 再扫描一次：失败过的 Office 排到 Home 后面
+    check("rerank", first(stored, wifi.scan(), static_cast<uint32_t>(time(nullptr))) == kHomeSsid);
+
+    // 配网页面连接新网络：成功后经 WiFiManager 保存
+    BspConfigNetwork portal;
+    uint32_t connects = host_sim::wifiConnectCount();
+    check("portal.request", portal.connectWiFi("ChunFeng-Cafe", "latte123"));
+    t0 = esp_timer_get_time();
+    while (saved("ChunFeng-Cafe").ssid.empty() && elapsedMs(t0) < 5000) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    report("portal_saved_ms", elapsedMs(t0));
+    check("portal.cache", saved("ChunFeng-Cafe").password == "latte123");
+    check("portal.connects", host_sim::wifiConnectCount() == connects + 1);
+    // 之后的连接写回列表时不覆盖配网页面保存的网络
+    check("reconnect", wifi.connectBest(wifi.scan()));
+    stored.clear();
+    check("portal.persisted", BspWiFi::loadNetworkList(stored) && stored.size() == 3 &&
+                              stored.find("ChunFeng-Cafe") >= 0);
+    report("saved_networks", stored.size());
+    report("errors", ok ? 0 : 1);
+}
+
+/* ---------- 场景：冷/热启动到首个请求 ---------- */
+
+/**
+ * @brief 模拟上游 DNS：对任何 A 查询在固定延迟后应答，TTL 300s
+ */
+class FakeDnsServer {
+public:
+    explicit FakeDnsServer(uint32_t latency_ms) : latency_ms_(latency_ms) {
+        fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        socklen_t len = sizeof(addr);
+        getsockname(fd_, reinterpret_cast<sockaddr*>(&addr), &len);
+        port_ = ntohs(addr.sin_port);
+        std::thread([this] { serve(); }).detach();
+    }
+
+    uint16_t port() const { return port_; }
+    uint32_t queries() const { return queries_.load(); }
+
+private:
+    void serve() {
+        uint8_t buf[512];
+        while (true) {
+            sockaddr_in peer{};
+            socklen_t plen = sizeof(peer);
+            ssize_t n = recvfrom(fd_, buf, sizeof(buf) - 16, 0, reinterpret_cast<sockaddr*>(&peer), &plen);
+            if (n < 12) continue;
+            ++queries_;
+            std::this_thread::sleep_for(std::chrono::milliseconds(latency_ms_));
+            buf[2] = 0x81;  // QR + RD
+            buf[3] = 0x80;  // RA，RCODE 0
+            buf[7] = 1;     // ANCOUNT
+            static const uint8_t kAnswer[] = {0xC0, 0x0C, 0, 1, 0, 1, 0, 0, 0x01, 0x2C, 0, 4, 10, 0, 0, 1};
+            memcpy(buf + n, kAnswer, sizeof(kAnswer));
+            sendto(fd_, buf, n + sizeof(kAnswer), 0, reinterpret_cast<sockaddr*>(&peer), plen);
+        }
+    }
+
+    int fd_;
+    uint16_t port_{0};
+    uint32_t latency_ms_;
+    std::atomic<uint32_t> queries_{0};
+};
+
+/**
+ * @brief 第一次启动 NVS 为空；第二次沿用第一次留下的 NVS（DHCP 租约、DNS 缓存）
+ *
+ * 计时到 WiFi 已连接且首个云端域名解析完成，即可以发出第一个请求。
+ */
+void wakeChild(const Options&) {
+    bool warm = s_boot_index > 0;
+    host_sim::httpdSetPortOverride(0);
+    // 家用路由器：DORA 两个往返约 150ms，上游 DNS 递归查询约 120ms
+    host_sim::wifiSetAccessPoints({{kHomeSsid, kHomePassword, -48, 6, 80, 150}});
+    if (warm) {
+        host_sim::nvsLoad(s_nvs_image);
+        nvs_flash_init();
+    } else {
+        provisionHomeNetwork();
+    }
+    static FakeDnsServer dns(120);
+    DnsCache::getInstance().setServer(htonl(INADDR_LOOPBACK), dns.port());
+
+    int64_t t0 = esp_timer_get_time();
+    startNetworkManager();
+    double ip_ms = -1;
+    int32_t state = -1;
+    while (elapsedMs(t0) < 10000) {
+        if (ip_ms < 0 && host_sim::wifiHasIp()) ip_ms = elapsedMs(t0);
+        state = networkState();
+        if (state == static_cast<int32_t>(NetworkState::WIFI_CONNECTED)) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    const char* prefix = warm ? "warm." : "cold.";
+    std::string key;
+    if (state != static_cast<int32_t>(NetworkState::WIFI_CONNECTED)) {
+        report((key = std::string(prefix) + "not_connected").c_str(), 1);
+        report("errors", 1);
+        return;
+    }
+    double connected_ms = elapsedMs(t0);
+    int64_t t_dns = esp_timer_get_time();
+    uint32_t addr = 0;
+    bool ok = DnsCache::getInstance().resolve("api.coze.cn", &addr);
+    double dns_ms = elapsedMs(t_dns);
+
+    report((key = std::string(prefix) + "got_ip_ms").c_str(), ip_ms);
+    report((key = std::string(prefix) + "wifi_connected_ms").c_str(), connected_ms);
+    report((key = std::string(prefix) + "first_dns_ms").c_str(), ok ? dns_ms : -1);
+    report((key = std::string(prefix) + "first_request_ready_ms").c_str(), ok ? elapsedMs(t0) : -1);
+
+    // 等后台预解析写完 NVS 再保存，作为下一次启动的 NVS
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    report((key = std::string(prefix) + "dns_queries").c_str(), dns.queries());
+    host_sim::nvsSave(s_nvs_image);
+}
+
+/* ---------- 场景：HTTPS 连接池 ---------- */
+
+/**
+ * @brief 模拟云端 HTTPS 服务：自签名 EC 证书，TLS 1.2 会话票据，HTTP/1.1 keep-alive
+ *
+ * 每个请求在 latency_ms 后应答（请求往返 + 服务端处理），奇数次响应用 chunked 编码；
+ * 同一连接处理 max_requests 个请求后回 "Connection: close" 并关闭，模拟服务端的 keep-alive 上限。
+ */
+class FakeTlsServer {
+public:
+    FakeTlsServer(uint32_t latency_ms, int max_requests) : latency_ms_(latency_ms), max_requests_(max_requests) {
+        // 客户端读到一半关闭连接（断点续传）时，服务端继续写入不应让进程收到 SIGPIPE 退出
+        signal(SIGPIPE, SIG_IGN);
+        ctx_ = SSL_CTX_new(TLS_server_method());
+        SSL_CTX_set_max_proto_version(ctx_, TLS1_2_VERSION);
+        static const unsigned char kSessionCtx[] = "chunfeng-bench";
+        SSL_CTX_set_session_id_context(ctx_, kSessionCtx, sizeof(kSessionCtx) - 1);
+        EVP_PKEY* key = EVP_EC_gen("P-256");
+        X509* cert = X509_new();
+        X509_set_version(cert, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+        X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+        X509_set_pubkey(cert, key);
+        X509_NAME* name = X509_get_subject_name(cert);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"),
+                                   -1, -1, 0);
+        X509_set_issuer_name(cert, name);
+        X509_sign(cert, key, EVP_sha256());
+        SSL_CTX_use_certificate(ctx_, cert);
+        SSL_CTX_use_PrivateKey(ctx_, key);
+
+        fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        socklen_t len = sizeof(addr);
+        getsockname(fd_, reinterpret_cast<sockaddr*>(&addr), &len);
+        port_ = ntohs(addr.sin_port);
+        listen(fd_, 16);
+        std::thread([this] { acceptLoop(); }).detach();
+    }
+
+    uint16_t port() const { return port_; }
+    int maxActive() const { return max_active_.load(); }
+    void resetMaxActive() { max_active_ = active_.load(); }
+
+    /** 按请求头生成完整响应（状态行、响应头与响应体），替代固定的 JSON 响应 */
+    using Responder = std::function<std::string(const std::string& head)>;
+    void setResponder(Responder responder) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        responder_ = std::move(responder);
+    }
+
+    /** 下一个响应只发出前 bytes 字节就断开连接，模拟链路中断 */
+    void dropNextResponseAfter(size_t bytes) { drop_after_ = bytes; }
+
+private:
+    void acceptLoop() {
+        while (true) {
+            int fd = accept(fd_, nullptr, nullptr);
+            if (fd < 0) continue;
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            std::thread([this, fd] { serve(fd); }).detach();
+        }
+    }
+
+    void serve(int fd) {
+        int active = ++active_;
+        int prev = max_active_.load();
+        while (active > prev && !max_active_.compare_exchange_weak(prev, active)) {}
+
+        SSL* ssl = SSL_new(ctx_);
+        SSL_set_fd(ssl, fd);
+        if (SSL_accept(ssl) == 1) {
+            std::string buf;
+            char tmp[2048];
+            for (int served = 1; served <= max_requests_; ++served) {
+                size_t header_end;
+                bool ok = true;
+                while ((header_end = buf.find("\r\n\r\n")) == std::string::npos && ok) {
+                    int n = SSL_read(ssl, tmp, sizeof(tmp));
+                    ok = n > 0;
+                    if (ok) buf.append(tmp, n);
+                }
+                if (!ok) break;
+                const char* cl = strcasestr(buf.c_str(), "Content-Length:");
+                size_t body_len = cl && cl < buf.c_str() + header_end ? strtoul(cl + 15, nullptr, 10) : 0;
+                while (buf.size() < header_end + 4 + body_len && ok) {
+                    int n = SSL_read(ssl, tmp, sizeof(tmp));
+                    ok = n > 0;
+                    if (ok) buf.append(tmp, n);
+                }
+                if (!ok) break;
+                bool close_after = served == max_requests_ ||
+                                   strcasestr(buf.substr(0, header_end).c_str(), "Connection: close") != nullptr;
+                std::string head = buf.substr(0, header_end);
+                buf.erase(0, header_end + 4 + body_len);
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(latency_ms_));
+                Responder responder;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    responder = responder_;
+                }
+                std::string body = "{\"code\":0,\"msg\":\"\",\"data\":\"" + std::string(384, 'x') + "\"}";
+                std::string resp = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n";
+                resp += close_after ? "Connection: close\r\n" : "Connection: keep-alive\r\n";
+                if (responder) {
+                    resp = responder(head);
+                    size_t drop = drop_after_.exchange(0);
+                    if (drop) {
+                        SSL_write(ssl, resp.data(), static_cast<int>(std::min(drop, resp.size())));
+                        break;
+                    }
+                } else if (served % 2) {
+                    char size[16];
+                    snprintf(size, sizeof(size), "%zx\r\n", body.size());
+                    resp += "Transfer-Encoding: chunked\r\n\r\n" + std::string(size) + body + "\r\n0\r\n\r\n";
+                } else {
+                    resp += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+                }
+                if (SSL_write(ssl, resp.data(), static_cast<int>(resp.size())) <= 0 || close_after) break;
+            }
+            SSL_shutdown(ssl);
+        }
+        SSL_free(ssl);
+        close(fd);
+        --active_;
+    }
+
+    SSL_CTX* ctx_;
+    int fd_;
+    uint16_t port_{0};
+    uint32_t latency_ms_;
+    int max_requests_;
+    std::atomic<int> active_{0};
+    std::atomic<int> max_active_{0};
+    std::mutex mutex_;
+    Responder responder_;
+    std::atomic<size_t> drop_after_{0};
+};
+
+/**
+ * @brief 对照组：与 esp_http_client 默认用法一样，每个请求新建连接并做完整握手
+ */
+bool oneShotRequest(const char* host, uint16_t port, const std::string& request) {
+    esp_tls_cfg_t cfg = {};
+    cfg.timeout_ms = 5000;
+    esp_tls_t* tls = esp_tls_init();
+    bool ok = esp_tls_conn_new_sync(host, static_cast<int>(strlen(host)), port, &cfg, tls) == 1 &&
+              esp_tls_conn_write(tls, request.data(), request.size()) == static_cast<ssize_t>(request.size());
+    std::string resp;
+    char buf[1024];
+    ssize_t n;
+    while (ok && (n = esp_tls_conn_read(tls, buf, sizeof(buf))) > 0) {
+        resp.append(buf, static_cast<size_t>(n));
+    }
+    esp_tls_conn_destroy(tls);
+    return ok && resp.compare(0, 12, "HTTP/1.1 200") == 0;
+}
+
+void reportLatency(const char* phase, const std::vector<double>& ms) {
+    std::string key;
+    report((key = std::string(phase) + ".p50_ms").c_str(), percentile(ms, 0.50));
+    report((key = std::string(phase) + ".p99_ms").c_str(), percentile(ms, 0.99));
+}
+
+/**
+ * @brief 对照组与连接池（顺序、并发）各发 kRequests 个请求，统计握手次数与延迟
+ *
+ * 链路按 LTE 下访问云端估算：往返 30ms；S3 上 ECDHE-ECDSA 完整握手的计算约 250ms，恢复会话约 5ms。
+ */
+void httpsChild(const Options&) {
+    static constexpr int kRequests = 24;
+    static constexpr int kThreads = 4;
+    static constexpr uint32_t kRttMs = 30;
+    const char* host = "localhost";
+    host_sim::tlsSetLinkProfile(kRttMs, 250, 5);
+    static FakeTlsServer server(kRttMs, 8);
+    const std::string body = "{\"bot_id\":\"bench\",\"user\":\"chunfeng\",\"query\":\"hello\"}";
+
+    auto handshakes = [](uint32_t* full, uint32_t* resumed) {
+        *full = host_sim::tlsHandshakeCount(false);
+        *resumed = host_sim::tlsHandshakeCount(true);
+    };
+    uint32_t full0, resumed0, full1, resumed1;
+    int errors = 0;
+
+    // 对照组：每次完整握手
+    std::string request = "POST /v1/chat HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n"
+                          "Content-Type: application/json\r\nContent-Length: " +
+                          std::to_string(body.size()) + "\r\n\r\n" + body;
+    std::vector<double> ms;
+    handshakes(&full0, &resumed0);
+    for (int i = 0; i < kRequests; ++i) {
+        int64_t t0 = esp_timer_get_time();
+        if (!oneShotRequest(host, server.port(), request)) ++errors;
+        ms.push_back(elapsedMs(t0));
+    }
+    handshakes(&full1, &resumed1);
+    reportLatency("per_request", ms);
+    report("per_request.handshakes_full", full1 - full0);
+
+    // 连接池，顺序请求：服务器每 8 个请求关闭一次连接，之后的新连接恢复会话
+    ConnectionPool& pool = ConnectionPool::getInstance();
+    ms.clear();
+    handshakes(&full0, &resumed0);
+    for (int i = 0; i < kRequests; ++i) {
+        HttpResponse resp;
+        int64_t t0 = esp_timer_get_time();
+        if (pool.request("POST", host, "/v1/chat", body, resp, "application/json", "", server.port()) != ESP_OK ||
+            resp.status != 200 || resp.body.size() < 384) {
+            ++errors;
+        }
+        ms.push_back(elapsedMs(t0));
+    }
+    handshakes(&full1, &resumed1);
+    reportLatency("pool", ms);
+    report("pool.handshakes_full", full1 - full0);
+    report("pool.handshakes_resumed", resumed1 - resumed0);
+    report("pool.handshakes_saved", kRequests - (full1 - full0) - (resumed1 - resumed0));
+
+    // 连接池，4 个任务并发，每个主机最多 2 条连接
+    PoolConfig config;
+    config.max_per_host = 2;
+    pool.configure(config);
+    pool.closeIdle();
+    server.resetMaxActive();
+    std::vector<std::vector<double>> per_thread(kThreads);
+    std::atomic<int> thread_errors{0};
+    handshakes(&full0, &resumed0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < kRequests / kThreads; ++i) {
+                HttpResponse resp;
+                int64_t t0 = esp_timer_get_time();
+                if (pool.request("POST", host, "/v1/chat", body, resp, "application/json", "", server.port()) !=
+                        ESP_OK ||
+                    resp.status != 200) {
+                    ++thread_errors;
+                }
+                per_thread[t].push_back(elapsedMs(t0));
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+    handshakes(&full1, &resumed1);
+    ms.clear();
+    for (const auto& v : per_thread) ms.insert(ms.end(), v.begin(), v.end());
+    reportLatency("pool.c4", ms);
+    report("pool.c4.handshakes_full", full1 - full0);
+    report("pool.c4.handshakes_resumed", resumed1 - resumed0);
+    report("pool.c4.max_server_conns", server.maxActive());
+    report("pool.max_connections", static_cast<double>(pool.maxConnections()));
+    const auto* waits = findMetric("chunfeng_pool_waits_total");
+    report("pool.c4.waits", waits ? static_cast<const metrics::Counter*>(waits)->value() : 0);
+    // 连接池自己通过主密钥判断的恢复次数，应与替身统计的一致
+    const auto* detected = findMetric("chunfeng_tls_handshakes_total", "mode=\"resumed\"");
+    report("pool.resumed_detected", detected ? static_cast<const metrics::Counter*>(detected)->value() : -1);
+    errors += thread_errors;
+    if (errors) report("errors", errors);
+}
+
+/* ---------- 场景：配网 HTTP 服务 ---------- */
+
+/** 读取一个完整 HTTP 响应（Content-Length 或 chunked） */
+bool readResponse(int fd, std::string& buf, size_t& body_bytes) {
+    auto fill = [&]() {
+        char tmp[8192];
+        ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+        if (n <= 0) return false;
+        buf.append(tmp, static_cast<size_t>(n));
+        return true;
+    };
+    size_t header_end;
+    while ((header_end = buf.find("\r\n\r\n")) == std::string::npos) {
+        if (!fill()) return false;
+    }
+    std::string head = buf.substr(0, header_end);
+    buf.erase(0, header_end + 4);
+    if (head.compare(0, 12, "HTTP/1.1 200") != 0) return false;
+    size_t cl = head.find("Content-Length: ");
+    if (cl != std::string::npos) {
+        size_t len = strtoul(head.c_str() + cl + 16, nullptr, 10);
+        while (buf.size() < len) {
+            if (!fill()) return false;
+        }
+        buf.erase(0, len);
+        body_bytes = len;
+        return true;
+    }
+    body_bytes = 0;
+    while (true) {
+        size_t eol;
+        while ((eol = buf.find("\r\n")) == std::string::npos) {
+            if (!fill()) return false;
+        }
+        size_t len = strtoul(buf.c_str(), nullptr, 16);
+        while (buf.size() < eol + 2 + len + 2) {
+            if (!fill()) return false;
+        }
+        buf.erase(0, eol + 2 + len + 2);
+        body_bytes += len;
+        if (len == 0) return true;
+    }
+}
+
+struct ClientResult {
+    std::vector<double> latency_us;
+    size_t body_bytes{0};
+    bool ok{true};
+};
+
+void httpClient(uint16_t port, const char* path, int requests, ClientResult& out) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        out.ok = false;
+        close(fd);
+        return;
+    }
+    std::string request = std::string("GET ") + path + " HTTP/1.1\r\nHost: 192.168.4.1\r\n\r\n";
+    std::string buf;
+    out.latency_us.reserve(requests);
+    for (int i = 0; i < requests; ++i) {
+        auto t0 = std::chrono::steady_clock::now();
+        size_t body = 0;
+        if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size()) ||
+            !readResponse(fd, buf, body)) {
+            out.ok = false;
+            break;
+        }
+        out.latency_us.push_back(
+            std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+        out.body_bytes = body;
+    }
+    close(fd);
+}
+
+void httpChild(const Options& opt) {
+    host_sim::httpdSetPortOverride(0);
+    nvs_flash_init();
+    ConfigManager::getInstance().startConfig();
+    uint16_t port = host_sim::httpdBoundPort();
+    if (port == 0) {
+        report("server_start_failed", 1);
+        report("errors", 1);
+        return;
+    }
+
+    static const char* kPaths[] = {"/info", "/metrics", "/status", "/"};
+    static const int kConcurrency[] = {1, 4};
+    for (const char* path : kPaths) {
+        for (int conc : kConcurrency) {
+            std::vector<ClientResult> results(conc);
+            std::vector<std::thread> clients;
+            int per_client = opt.requests / conc;
+            auto t0 = std::chrono::steady_clock::now();
+            for (int c = 0; c < conc; ++c) {
+                clients.emplace_back(httpClient, port, path, per_client, std::ref(results[c]));
+            }
+            for (auto& t : clients) t.join();
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+            std::vector<double> all;
+            bool ok = true;
+            size_t body = 0;
+            for (const auto& r : results) {
+                all.insert(all.end(), r.latency_us.begin(), r.latency_us.end());
+                ok = ok && r.ok;
+                body = r.body_bytes;
+            }
+            char key[96];
+            const char* name = strcmp(path, "/") == 0 ? "root" : path + 1;
+            snprintf(key, sizeof(key), "%s.c%d.req_per_s", name, conc);
+            report(key, all.size() / secs);
+            snprintf(key, sizeof(key), "%s.c%d.p50_us", name, conc);
+            report(key, percentile(all, 0.50));
+            snprintf(key, sizeof(key), "%s.c%d.p99_us", name, conc);
+            report(key, percentile(all, 0.99));
+            if (conc == 1) {
+                snprintf(key, sizeof(key), "%s.body_bytes", name);
+                report(key, static_cast<double>(body));
+            }
+            if (!ok) {
+                snprintf(key, sizeof(key), "%s.c%d.errors", name, conc);
+                report(key, 1);
+            }
+        }
+    }
+}
+
+/* ---------- 场景：消息总线 ---------- */
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct BusSink {
+    bus::Subscriber* sub{nullptr};
+    std::atomic<uint64_t> received{0};
+    std::atomic<bool> record{false};
+    std::vector<double> latency_us;     ///< record 期间由订阅任务写入，收齐后主线程读取
+};
+
+std::atomic<bool> s_bus_stop{false};
+
+void busSinkTask(void* arg) {
+    auto* sink = static_cast<BusSink*>(arg);
+    bus::Message m;
+    while (!s_bus_stop.load(std::memory_order_relaxed)) {
+        if (!sink->sub->receive(m, 100)) continue;
+        if (sink->record.load(std::memory_order_relaxed)) {
+            sink->latency_us.push_back((nowNs() - bus::payload<bus::Topic::PING>(m).t_ns) / 1000.0);
+        }
+        sink->received.fetch_add(1, std::memory_order_release);
+    }
+    vTaskDelete(nullptr);
+}
+
+/** 已投递的消息都被取走（或因队列满被丢弃） */
+bool busDrained(const std::vector<BusSink*>& sinks, const std::vector<uint64_t>& expected) {
+    int64_t t0 = esp_timer_get_time();
+    for (size_t i = 0; i < sinks.size(); ++i) {
+        while (sinks[i]->received.load(std::memory_order_acquire) + sinks[i]->sub->dropped() < expected[i]) {
+            if (elapsedMs(t0) > 5000) return false;
+            std::this_thread::yield();
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 8 个与 16 个订阅者下的发布耗时、投递延迟与扇出吞吐
+ *
+ * paced：每 200us 发布一条，统计发布调用耗时与发布到订阅任务取出的延迟；
+ * batch：每次发布一个队列长度的消息后等全部订阅者取完，统计不丢消息时的扇出吞吐；
+ * burst：连续发布，订阅者跟不上时队列满丢弃，验证发布方不被阻塞。
+ */
+void busChild(const Options&) {
+    static constexpr int kPaced = 2000;
+    static constexpr int kBatchMessages = 20000;
+    static constexpr int kBurst = 20000;
+    static constexpr size_t kSubscriberCounts[] = {8, 16};
+
+    std::vector<BusSink*> sinks;
+    std::vector<uint64_t> expected;
+    uint32_t n = 0;
+    bool ok = true;
+    for (size_t count : kSubscriberCounts) {
+        while (sinks.size() < count) {
+            auto* sink = new BusSink();
+            sink->sub = new bus::Subscriber("bench", bus::topicBit(bus::Topic::PING));
+            xTaskCreate(busSinkTask, "bus_sink", 4096, sink, 5, nullptr);
+            sinks.push_back(sink);
+            expected.push_back(0);
+        }
+        for (size_t i = 0; i < sinks.size(); ++i) {
+            expected[i] = sinks[i]->received.load() + sinks[i]->sub->dropped();
+        }
+        auto deliver = [&](size_t delivered) {
+            for (size_t i = 0; i < sinks.size(); ++i) expected[i]++;
+            return delivered;
+        };
+        char key[64];
+        auto put = [&](const char* name, double value) {
+            snprintf(key, sizeof(key), "s%zu.%s", count, name);
+            report(key, value);
+        };
+
+        // paced
+        std::vector<double> publish_ns;
+        publish_ns.reserve(kPaced);
+        for (BusSink* s : sinks) s->record = true;
+        uint32_t dropped0 = 0;
+        for (BusSink* s : sinks) dropped0 += s->sub->dropped();
+        int64_t next = nowNs();
+        for (int i = 0; i < kPaced; ++i) {
+            while (nowNs() < next) std::this_thread::yield();
+            next += 200000;
+            int64_t t0 = nowNs();
+            deliver(bus::publish<bus::Topic::PING>(BenchPing{t0, n++}));
+            publish_ns.push_back(static_cast<double>(nowNs() - t0));
+        }
+        ok = busDrained(sinks, expected) && ok;
+        std::vector<double> latency;
+        uint32_t dropped1 = 0;
+        for (BusSink* s : sinks) {
+            s->record = false;
+            latency.insert(latency.end(), s->latency_us.begin(), s->latency_us.end());
+            s->latency_us.clear();
+            dropped1 += s->sub->dropped();
+        }
+        put("paced.publish_p50_ns", percentile(publish_ns, 0.50));
+        put("paced.publish_p99_ns", percentile(publish_ns, 0.99));
+        put("paced.deliver_p50_us", percentile(latency, 0.50));
+        put("paced.deliver_p99_us", percentile(latency, 0.99));
+        put("paced.dropped", dropped1 - dropped0);
+
+        // batch
+        int64_t t0 = esp_timer_get_time();
+        for (int sent = 0; sent < kBatchMessages;) {
+            for (size_t b = 0; b < bus::kQueueDepth && sent < kBatchMessages; ++b, ++sent) {
+                deliver(bus::publish<bus::Topic::PING>(BenchPing{0, n++}));
+            }
+            if (!busDrained(sinks, expected)) {
+                ok = false;
+                break;
+            }
+        }
+        double secs = (esp_timer_get_time() - t0) / 1e6;
+        put("batch.msgs_per_s", kBatchMessages / secs);
+        put("batch.deliveries_per_s", kBatchMessages * static_cast<double>(count) / secs);
+
+        // burst
+        publish_ns.clear();
+        publish_ns.reserve(kBurst);
+        size_t delivered = 0;
+        for (int i = 0; i < kBurst; ++i) {
+            int64_t p0 = nowNs();
+            delivered += deliver(bus::publish<bus::Topic::PING>(BenchPing{p0, n++}));
+            publish_ns.push_back(static_cast<double>(nowNs() - p0));
+        }
+        ok = busDrained(sinks, expected) && ok;
+        put("burst.publish_p50_ns", percentile(publish_ns, 0.50));
+        put("burst.publish_p99_ns", percentile(publish_ns, 0.99));
+        put("burst.delivered_ratio", static_cast<double>(delivered) / (static_cast<double>(kBurst) * count));
+    }
+    s_bus_stop = true;
+    if (!ok) report("errors", 1);
+}
+
+/* ---------- 场景：结构化日志 ---------- */
+
+// 同一条状态日志分别经 CF_LOGx（写入环形缓冲，格式化推迟到 flush）、printf 与 std::cout << ... << std::endl 输出，
+// 比较调用方一侧的每条耗时；非 -v 时 stdout 指向 /dev/null，对照组只含格式化、加锁与逐行刷新的开销。
+// 编译期被过滤的 CF_LOGV 什么也不做，它的耗时即两次取时间本身的开销
+
+void logChild(const Options& opt) {
+    bool ok = true;
+    auto check = [&](const char* what, bool cond) {
+        if (!cond) {
+            ok = false;
+            if (opt.verbose) printf("失败: %s\n", what);
+        }
+    };
+    static const char* TAG = "Bench";
+    constexpr int kBatches = 200;
+    constexpr size_t kBatch = log::kRingCapacity / 2;  // 每批之后排空，热路径不会因缓冲满而丢弃
+    const char* state = "CONNECTING";
+    int rssi = -48;
+    unsigned channel = 6;
+
+    auto measure = [&](auto&& emit, auto&& after_batch) {
+        std::vector<double> ns;
+        ns.reserve(kBatches * kBatch);
+        for (int b = 0; b < kBatches; ++b) {
+            for (size_t i = 0; i < kBatch; ++i) {
+                int64_t t0 = nowNs();
+                emit(i);
+                ns.push_back(static_cast<double>(nowNs() - t0));
+            }
+            after_batch();
+        }
+        return ns;
+    };
+    log::flush();
+    const uint32_t dropped0 = log::droppedCount();
+
+    std::vector<double> cf = measure([&](size_t i) { CF_LOGI(TAG, "状态: %s rssi %d 信道 %u 第 %u 次", state, rssi, channel,
+                                                             static_cast<unsigned>(i)); },
+                                     [] { log::flush(); });
+    std::vector<double> filtered = measure([&](size_t i) { CF_LOGV(TAG, "状态: %s rssi %d 信道 %u 第 %u 次", state, rssi,
+                                                                   channel, static_cast<unsigned>(i)); },
+                                           [] {});
+    // 排空的开销（日志任务一侧）：每条记录的格式化与输出
+    for (size_t i = 0; i < kBatch; ++i) CF_LOGI(TAG, "状态: %s rssi %d 信道 %u 第 %u 次", state, rssi, channel,
+                                                  static_cast<unsigned>(i));
+    int64_t t0 = nowNs();
+    const size_t drained = log::flush();
+    const double drain_ns = drained ? static_cast<double>(nowNs() - t0) / drained : 0;
+    std::vector<double> pf = measure([&](size_t i) { printf("I (%lld) %s: 状态: %s rssi %d 信道 %u 第 %u 次\n",
+                                                            static_cast<long long>(esp_timer_get_time() / 1000), TAG,
+                                                            state, rssi, channel, static_cast<unsigned>(i)); },
+                                     [] { fflush(stdout); });
+    std::vector<double> io = measure([&](size_t i) { std::cout << "I (" << esp_timer_get_time() / 1000 << ") " << TAG
+                                                               << ": 状态: " << state << " rssi " << rssi << " 信道 "
+                                                               << channel << " 第 " << i << " 次" << std::endl; },
+                                     [] {});
+
+    report("cf_log.p50_ns", percentile(cf, 0.50));
+    report("cf_log.p99_ns", percentile(cf, 0.99));
+    report("cf_log.filtered_p50_ns", percentile(filtered, 0.50));
+    report("cf_log.drain_ns_per_record", drain_ns);
+    report("printf.p50_ns", percentile(pf, 0.50));
+    report("printf.p99_ns", percentile(pf, 0.99));
+    report("iostream.p50_ns", percentile(io, 0.50));
+    report("iostream.p99_ns", percentile(io, 0.99));
+    report("record_bytes", sizeof(log::Record));
+    check("cf_log.faster", percentile(cf, 0.50) < percentile(io, 0.50));
+    check("cf_log.no_drop", log::droppedCount() == dropped0);
+
+    // 缓冲满时丢弃并计数；输出丢弃提示后总数不清零
+    for (size_t i = 0; i < log::kRingCapacity + 10; ++i) CF_LOGI(TAG, "溢出 %u", static_cast<unsigned>(i));
+    const uint32_t overflow = log::droppedCount() - dropped0;
+    log::flush();
+    report("overflow_dropped", overflow);
+    check("dropped.count", overflow == 10);
+    check("dropped.cumulative", log::droppedCount() - dropped0 == overflow);
+
+    // 字符数组参数按数组长度截取，结构体中占满、没有 '\0' 的字段也不会越界
+    static std::string last_line;
+    log::addSink([](const char* line, size_t len, void*) { if (line) last_line.assign(line, len); }, nullptr);
+    struct {
+        char ssid[8];
+        char tail[4];
+    } fields;
+    memcpy(fields.ssid, "ChunFeng", 8);
+    memcpy(fields.tail, "XYZ", 4);
+    char label[16] = "ota_1";
+    CF_LOGI(TAG, "数组 [%s] [%s]", fields.ssid, label);
+    log::flush();
+    check("array_arg", last_line.find("数组 [ChunFeng] [ota_1]") != std::string::npos);
+
+    // 追踪：每个任务一条轨道。设备上 uxTaskNumber 默认为 0，编号由追踪在第一次记录时分配
+    trace::clear();
+    trace::start();
+    static std::atomic<int> traced{0};
+    for (const char* name : {"trace_a", "trace_b"}) {
+        // 事件名只保存指针，用静态的任务名字面量
+        xTaskCreate([](void* arg) {
+            CF_TRACE_INSTANT(static_cast<const char*>(arg));
+            ++traced;
+            vTaskDelete(nullptr);
+        }, name, 4096, const_cast<char*>(name), 5, nullptr);
+    }
+    for (int i = 0; i < 200 && traced < 2; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    trace::stop();
+    std::string json;
+    trace::exportChromeJson([](const char* data, size_t len, void* ctx) {
+        static_cast<std::string*>(ctx)->append(data, len);
+        return true;
+    }, &json);
+    auto tidOf = [&](const std::string& needle) -> long {
+        size_t at = json.find(needle);
+        if (at == std::string::npos) return -1;
+        size_t start = json.rfind('{', at);
+        size_t tid = json.find("\"tid\":", start);
+        return tid == std::string::npos ? -1 : strtol(json.c_str() + tid + 6, nullptr, 10);
+    };
+    const long tid_a = tidOf("\"args\":{\"name\":\"trace_a\"}");
+    const long tid_b = tidOf("\"args\":{\"name\":\"trace_b\"}");
+    report("trace.tid_a", tid_a);
+    report("trace.tid_b", tid_b);
+    check("trace.tracks", tid_a > 0 && tid_b > 0 && tid_a != tid_b && tidOf("{\"name\":\"trace_a\",\"ph\":\"i\"") == tid_a &&
+                              tidOf("{\"name\":\"trace_b\",\"ph\":\"i\"") == tid_b);
+    report("errors", ok ? 0 : 1);
+}
+
+/* ---------- 场景：屏幕差分刷新 ---------- */
+
+// 状态文字用到的全部字符；合成字库只包含这些字符与 ASCII
+const char* kDisplayCharset =
+    "网络初始化正在联网已连接失败启动中待机聆听思考回复升级休眠故障音频对话"
+    "等待唤醒播放今天北京晴，气温二十五六度…";
+
+/**
+ * @brief 生成 16x16 合成字库：每个字符的点阵由码位决定，外加边框，便于在 PPM 中分辨
+ */
+bool writeSyntheticFont(const std::string& path) {
+    std::vector<uint32_t> cps;
+    for (uint32_t c = 0x20; c < 0x7f; ++c) cps.push_back(c);
+    for (const char* p = kDisplayCharset; *p;) cps.push_back(utf8Next(p));
+    std::sort(cps.begin(), cps.end());
+    cps.erase(std::unique(cps.begin(), cps.end()), cps.end());
+
+    FontHeader header = {{'C', 'F', 'N', 'T'}, kFontVersion, 16, 16, 0, static_cast<uint32_t>(cps.size())};
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp) return false;
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(cps.data(), sizeof(uint32_t), cps.size(), fp);
+    for (uint32_t cp : cps) {
+        int w = cp < 0x80 ? 8 : 16;
+        uint8_t bitmap[32] = {};
+        uint32_t h = cp * 2654435761u;
+        for (int y = 1; y < 15; ++y) {
+            h = h * 1103515245u + 12345u;
+            for (int x = 1; x < w - 1; ++x) {
+                bool edge = y == 1 || y == 14 || x == 1 || x == w - 2;
+                if (edge || (h >> (x + 8)) & 1) bitmap[y * 2 + x / 8] |= 0x80 >> (x % 8);
+            }
+        }
+        fwrite(bitmap, sizeof(bitmap), 1, fp);
+    }
+    return fclose(fp) == 0;
+}
+
+uint32_t counterValue(const char* name) {
+    const auto* m = findMetric(name);
+    return m ? static_cast<const metrics::Counter*>(m)->value() : 0;
+}
+
+/**
+ * @brief 等显示任务完成一次刷新并且 SPI 传输结束
+ * @param latency_ms 从 since_us（发起更新）到最后一个字节推送到屏幕的耗时
+ * @return 本次的总线字节数，超时返回 -1
+ */
+double waitDisplayFlush(uint32_t flushes_before, uint64_t sim_bytes_before, int64_t since_us, double* latency_ms) {
+    while (counterValue("chunfeng_display_flushes_total") == flushes_before) {
+        if (elapsedMs(since_us) > 1000) return -1;
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    // 显示任务在排队时计数，替身在传输完成时计数，两者相等即推送完毕
+    uint64_t queued = counterValue("chunfeng_display_bytes_total");
+    while (host_sim::lcdBytesTransferred() < queued) {
+        if (elapsedMs(since_us) > 1000) return -1;
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    *latency_ms = elapsedMs(since_us);
+    return static_cast<double>(host_sim::lcdBytesTransferred() - sim_bytes_before);
+}
+
+/**
+ * @brief 一轮典型的对话过程中各次状态更新推送到屏幕的字节数，与整帧推送对比
+ *
+ * 网络与系统状态经消息总线送达（与 NetworkManager 相同的路径），音频与对话文字直接调用 update 接口。
+ * -v 时把每次更新后的显存写成 /tmp/chunfeng_display_NN.ppm。
+ */
+void displayChild(const Options& opt) {
+    static constexpr int kRounds = 3;
+    std::string font = "/tmp/chunfeng_bench_font_" + std::to_string(getpid()) + ".bin";
+    if (!writeSyntheticFont(font)) {
+        report("errors", 1);
+        return;
+    }
+    DisplayManager& display = DisplayManager::getInstance();
+    uint32_t flushes = counterValue("chunfeng_display_flushes_total");
+    uint64_t sim_bytes = host_sim::lcdBytesTransferred();
+    int64_t t0 = esp_timer_get_time();
+    if (display.start(font.c_str()) != ESP_OK) {
+        report("errors", 1);
+        return;
+    }
+    double latency_ms = 0;
+    double first = waitDisplayFlush(flushes, sim_bytes, t0, &latency_ms);
+    report("first_frame_bytes", first);
+    report("first_frame_ms", latency_ms);
+
+    auto net = [](NetworkState s) { bus::publish<bus::Topic::NETWORK_STATE>(NetworkStateChanged{s, s}); };
+    auto sys = [](SystemState s) { bus::publish<bus::Topic::SYSTEM_STATE>(s); };
+    const std::vector<std::function<void()>> steps = {
+        [&] { net(NetworkState::CONNECTING); },
+        [&] { net(NetworkState::WIFI_CONNECTED); },
+        [&] { sys(SystemState::IDLE); },
+        [&] { display.updateAudioState("等待唤醒"); },
+        [&] { sys(SystemState::LISTENING); },
+        [&] { display.updateAudioState("正在聆听"); },
+        [&] { display.updateCozeState("思考中…"); },
+        [&] { display.updateCozeState("今天北京晴，气温二十五度"); },
+        [&] { display.updateAudioState("正在播放"); },
+        [&] { display.updateCozeState("今天北京晴，气温二十六度"); },
+        [&] { sys(SystemState::IDLE); },
+        [&] { display.updateAudioState("等待唤醒"); },
+        [&] { net(NetworkState::LTE_CONNECTED); },
+    };
+
+    std::vector<double> bytes, latency;
+    int frame = 0;
+    bool ok = first > 0;
+    for (int round = 0; round < kRounds; ++round) {
+        for (const auto& step : steps) {
+            flushes = counterValue("chunfeng_display_flushes_total");
+            sim_bytes = host_sim::lcdBytesTransferred();
+            t0 = esp_timer_get_time();
+            step();
+            double b = waitDisplayFlush(flushes, sim_bytes, t0, &latency_ms);
+            if (b < 0) {
+                ok = false;
+                continue;
+            }
+            bytes.push_back(b);
+            latency.push_back(latency_ms);
+            if (opt.verbose) {
+                char path[64];
+                snprintf(path, sizeof(path), "/tmp/chunfeng_display_%02d.ppm", frame);
+                host_sim::lcdWritePpm(path, 320, 240);
+            }
+            ++frame;
+        }
+        // 每轮结束回到初始状态，下一轮的每一步都有变化；经总线的消息最后发，立即唤醒显示任务一并绘制
+        flushes = counterValue("chunfeng_display_flushes_total");
+        sim_bytes = host_sim::lcdBytesTransferred();
+        t0 = esp_timer_get_time();
+        display.updateAudioState("");
+        display.updateCozeState("");
+        sys(SystemState::BOOTING);
+        net(NetworkState::INIT);
+        ok = waitDisplayFlush(flushes, sim_bytes, t0, &latency_ms) >= 0 && ok;
+    }
+    unlink(font.c_str());
+
+    const double full = 320.0 * 240 * 2;
+    double sum = 0;
+    for (double b : bytes) sum += b;
+    double mean = bytes.empty() ? 0 : sum / bytes.size();
+    report("updates", static_cast<double>(bytes.size()));
+    report("update_bytes.p50", percentile(bytes, 0.50));
+    report("update_bytes.max", percentile(bytes, 1.0));
+    report("update_bytes.mean", mean);
+    report("full_frame_bytes", full);
+    report("bytes_vs_full_frame", mean / full);
+    report("update_latency_ms.p50", percentile(latency, 0.50));
+    report("update_latency_ms.max", percentile(latency, 1.0));
+    uint32_t hits = counterValue("chunfeng_glyph_cache_hits_total");
+    uint32_t misses = counterValue("chunfeng_glyph_cache_misses_total");
+    report("glyph_hit_ratio", hits + misses ? static_cast<double>(hits) / (hits + misses) : 0);
+    report("glyph_misses", misses);
+    if (!ok) report("errors", 1);
+}
+
+/* ---------- 场景：播放音频与口型同步 ---------- */
+
+/** 音画事件：口型张开/闭合或声音开始/结束的时间 */
+struct AvEdges {
+    std::mutex mutex;
+    std::vector<int64_t> audio_on, audio_off, video_on, video_off;
+    bool audio{false};
+    bool video{false};
+};
+
+/**
+ * @brief 播放若干段 1kHz 音调（-6dBFS，200ms，间隔 300ms），测量声音从 DAC 输出与口型在屏幕上张开/闭合的时间差
+ *
+ * 声音时间取自 I2S 替身推算的样本输出时间，画面时间取自 LCD 替身写入显存的时间，
+ * 探测点在口型椭圆中心上方，响度约 -40dBFS 以上才会被覆盖。正值表示画面晚于声音。
+ */
+void lipsyncChild(const Options&) {
+    static constexpr int kBursts = 8;
+    static constexpr int kSilenceFrames = 15;
+    static constexpr int kToneFrames = 10;
+    static constexpr int kProbeX = 40;
+    static constexpr int kProbeY = 176 + 28 - 8;
+    static constexpr uint16_t kMouthColor = rgb565(240, 110, 90);
+
+    std::string font = "/tmp/chunfeng_bench_font_" + std::to_string(getpid()) + ".bin";
+    if (!writeSyntheticFont(font)) {
+        report("errors", 1);
+        return;
+    }
+    DisplayManager& display = DisplayManager::getInstance();
+    uint32_t flushes = counterValue("chunfeng_display_flushes_total");
+    uint64_t sim_bytes = host_sim::lcdBytesTransferred();
+    int64_t t0 = esp_timer_get_time();
+    double latency_ms = 0;
+    if (display.start(font.c_str()) != ESP_OK || waitDisplayFlush(flushes, sim_bytes, t0, &latency_ms) < 0) {
+        report("errors", 1);
+        return;
+    }
+
+    static AvEdges edges;
+    host_sim::i2sSetOutputHook([](const int16_t* pcm, size_t samples, int64_t start_us) {
+        int peak = 0;
+        for (size_t i = 0; i < samples; ++i) peak = std::max(peak, std::abs(static_cast<int>(pcm[i])));
+        std::lock_guard<std::mutex> lock(edges.mutex);
+        bool on = peak > 1000;
+        if (on != edges.audio) (on ? edges.audio_on : edges.audio_off).push_back(start_us);
+        edges.audio = on;
+    });
+    host_sim::lcdSetUpdateHook([](int x0, int y0, int x1, int y1, int64_t time_us) {
+        if (kProbeX < x0 || kProbeX >= x1 || kProbeY < y0 || kProbeY >= y1) return;
+        bool on = host_sim::lcdPixel(kProbeX, kProbeY) == kMouthColor;
+        std::lock_guard<std::mutex> lock(edges.mutex);
+        if (on != edges.video) (on ? edges.video_on : edges.video_off).push_back(time_us);
+        edges.video = on;
+    });
+
+    AudioPlayback& playback = AudioPlayback::getInstance();
+    PlaybackConfig config;
+    if (playback.start(config) != ESP_OK) {
+        report("errors", 1);
+        return;
+    }
+    // 按 10ms 一块写入（不与 20ms 的帧对齐），模拟解码器输出
+    const size_t frame = playback.frameSamples();
+    std::vector<int16_t> chunk(frame / 2);
+    size_t phase = 0;
+    auto play = [&](int frames, bool tone) {
+        for (int i = 0; i < frames * 2; ++i) {
+            for (int16_t& v : chunk) {
+                v = tone ? static_cast<int16_t>(16384 * std::sin(2 * M_PI * 1000 * phase / config.sample_rate)) : 0;
+                ++phase;
+            }
+            playback.write(chunk.data(), chunk.size());
+        }
+    };
+    for (int b = 0; b < kBursts; ++b) {
+        play(kSilenceFrames, false);
+        play(kToneFrames, true);
+    }
+    play(kSilenceFrames, false);
+    playback.flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    unlink(font.c_str());
+
+    std::lock_guard<std::mutex> lock(edges.mutex);
+    auto offsets = [](const std::vector<int64_t>& audio, const std::vector<int64_t>& video) {
+        std::vector<double> ms;
+        for (size_t i = 0; i < audio.size() && i < video.size(); ++i) ms.push_back((video[i] - audio[i]) / 1000.0);
+        return ms;
+    };
+    std::vector<double> onset = offsets(edges.audio_on, edges.video_on);
+    std::vector<double> release = offsets(edges.audio_off, edges.video_off);
+    auto maxAbs = [](const std::vector<double>& v) {
+        double m = 0;
+        for (double x : v) m = std::max(m, std::fabs(x));
+        return m;
+    };
+    report("bursts", static_cast<double>(edges.audio_on.size()));
+    report("onset_offset_ms.p50", percentile(onset, 0.50));
+    report("onset_offset_ms.max_abs", maxAbs(onset));
+    report("release_offset_ms.p50", percentile(release, 0.50));
+    report("release_offset_ms.max_abs", maxAbs(release));
+    const auto* tap = static_cast<const metrics::Histogram*>(findMetric("chunfeng_audio_tap_us"));
+    if (tap && tap->count() > 0) report("tap_us.mean", static_cast<double>(tap->sum()) / tap->count());
+    report("tap_skipped", counterValue("chunfeng_audio_tap_skipped_total"));
+    report("play_underruns", counterValue("chunfeng_audio_play_underruns_total"));
+    report("i2s_underruns", host_sim::i2sUnderruns());
+    if (edges.audio_on.size() != kBursts || edges.video_on.size() != kBursts || edges.video_off.size() != kBursts) {
+        report("errors", 1);
+    }
+}
+
+/* ---------- 场景：状态快照 ---------- */
+
+/** 每个字都等于写入序号，读到不一致就是撕裂 */
+struct TornProbe {
+    uint32_t words[14];
+};
+
+/**
+ * @brief 一个写入方不停写、三个读取方不停读，统计撕裂的副本数（应为 0）
+ */
+void seqlockStress(int64_t duration_ms) {
+    static SeqLock<TornProbe> lock;
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> reads{0}, torn{0}, retries{0};
+    uint32_t writes = 0;
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; ++r) {
+        readers.emplace_back([&] {
+            TornProbe probe;
+            while (!stop.load(std::memory_order_relaxed)) {
+                retries += lock.read(probe);
+                ++reads;
+                for (uint32_t w : probe.words) {
+                    if (w != probe.words[0]) {
+                        ++torn;
+                        break;
+                    }
+                }
+            }
+        });
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(duration_ms);
+    TornProbe probe;
+    while (std::chrono::steady_clock::now() < deadline) {
+        ++writes;
+        for (uint32_t& w : probe.words) w = writes;
+        lock.write(probe);
+    }
+    stop = true;
+    for (auto& t : readers) t.join();
+    report("seqlock.writes", writes);
+    report("seqlock.reads", static_cast<double>(reads));
+    report("seqlock.retries", static_cast<double>(retries));
+    report("seqlock.torn", static_cast<double>(torn));
+}
+
+/**
+ * @brief 连续播放音调，比较无人读取与 4 个客户端不停轮询 /status 时播放任务的 DMA 余量与欠载
+ *
+ * 余量 = 写入的一帧开始输出的时间 - 写入完成的时间；播放任务按时被唤醒时约为 (dma_desc_num - 1) 帧。
+ */
+void statusChild(const Options& opt) {
+    static constexpr int kPhaseMs = 1500;
+
+    seqlockStress(500);
+
+    host_sim::httpdSetPortOverride(0);
+    nvs_flash_init();
+    ConfigManager::getInstance().startConfig();
+    uint16_t port = host_sim::httpdBoundPort();
+    if (port == 0) {
+        report("server_start_failed", 1);
+        report("errors", 1);
+        return;
+    }
+
+    static std::mutex slack_mutex;
+    static std::vector<double> slack_ms;
+    host_sim::i2sSetOutputHook([](const int16_t*, size_t, int64_t start_us) {
+        std::lock_guard<std::mutex> lock(slack_mutex);
+        slack_ms.push_back((start_us - esp_timer_get_time()) / 1000.0);
+    });
+
+    AudioPlayback& playback = AudioPlayback::getInstance();
+    PlaybackConfig config;
+    if (playback.start(config) != ESP_OK) {
+        report("errors", 1);
+        return;
+    }
+    std::atomic<bool> stop{false};
+    std::thread writer([&] {
+        std::vector<int16_t> chunk(playback.frameSamples() / 2);
+        size_t phase = 0;
+        while (!stop) {
+            for (int16_t& v : chunk) {
+                v = static_cast<int16_t>(8192 * std::sin(2 * M_PI * 440 * phase++ / config.sample_rate));
+            }
+            playback.write(chunk.data(), chunk.size());
+        }
+        playback.flush();
+    });
+
+    auto phase = [&](const char* name, int clients) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        {
+            std::lock_guard<std::mutex> lock(slack_mutex);
+            slack_ms.clear();
+        }
+        uint32_t underruns = counterValue("chunfeng_audio_play_underruns_total");
+        uint32_t reads = counterValue("chunfeng_status_reads_total");
+        std::vector<ClientResult> results(clients);
+        std::vector<std::thread> threads;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int c = 0; c < clients; ++c) {
+            threads.emplace_back([&, c] {
+                while (std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(kPhaseMs)) {
+                    httpClient(port, "/status", 50, results[c]);
+                    if (!results[c].ok) break;
+                }
+            });
+        }
+        if (clients == 0) std::this_thread::sleep_for(std::chrono::milliseconds(kPhaseMs));
+        for (auto& t : threads) t.join();
+
+        std::vector<double> slack;
+        {
+            std::lock_guard<std::mutex> lock(slack_mutex);
+            slack = slack_ms;
+        }
+        char key[96];
+        snprintf(key, sizeof(key), "%s.frames", name);
+        report(key, static_cast<double>(slack.size()));
+        snprintf(key, sizeof(key), "%s.slack_ms.p50", name);
+        report(key, percentile(slack, 0.50));
+        snprintf(key, sizeof(key), "%s.slack_ms.min", name);
+        report(key, slack.empty() ? 0 : *std::min_element(slack.begin(), slack.end()));
+        snprintf(key, sizeof(key), "%s.underruns", name);
+        report(key, counterValue("chunfeng_audio_play_underruns_total") - underruns);
+        if (clients > 0) {
+            std::vector<double> all;
+            bool ok = true;
+            for (const auto& r : results) {
+                all.insert(all.end(), r.latency_us.begin(), r.latency_us.end());
+                ok = ok && r.ok;
+            }
+            snprintf(key, sizeof(key), "%s.polls_per_s", name);
+            report(key, (counterValue("chunfeng_status_reads_total") - reads) * 1000.0 / kPhaseMs);
+            snprintf(key, sizeof(key), "%s.p99_us", name);
+            report(key, percentile(all, 0.99));
+            if (!ok) report("errors", 1);
+        }
+    };
+    phase("idle", 0);
+    phase("poll4", 4);
+    stop = true;
+    writer.join();
+
+    // 快照内容：音频分区应由播放任务写入
+    status::Snapshot snapshot;
+    status::read(snapshot);
+    char json[status::kMaxJsonSize];
+    report("json_bytes", static_cast<double>(status::formatJson(snapshot, json, sizeof(json))));
+    report("audio.frames", snapshot.audio.frames);
+    report("read_retries", counterValue("chunfeng_status_read_retries_total"));
+    if (opt.verbose) printf("%s\n", json);
+    host_sim::i2sSetOutputHook(nullptr);
+
+    // 直方图 _sum 由两个 32 位字组成：低位回绕时进位，四个线程并发累计后总和不丢
+    static const uint32_t kBounds[] = {1000};
+    static metrics::Histogram wide("chunfeng_bench_wide_sum", "bench", kBounds, 1);
+    constexpr uint32_t kLarge = 3000000000u;
+    constexpr int kPerThread = 10000;
+    std::vector<std::thread> adders;
+    for (int t = 0; t < 4; ++t) {
+        adders.emplace_back([] {
+            for (int i = 0; i < kPerThread; ++i) wide.observe(i % 2 ? kLarge : 7);
+        });
+    }
+    for (auto& t : adders) t.join();
+    const uint64_t expect = 4ull * (kPerThread / 2) * (static_cast<uint64_t>(kLarge) + 7);
+    report("histogram.sum_ok", wide.sum() == expect ? 1 : 0);
+    if (wide.sum() != expect || wide.count() != 4 * kPerThread) report("errors", 1);
+}
+
+/* ---------- 场景：设置推送 ---------- */
+
+/**
+ * @brief 单次请求（短连接），返回状态码，正文写入 body
+ */
+int httpRequest(uint16_t port, const char* method, const char* path, const std::string& payload, std::string& body) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    std::string request = std::string(method) + " " + path + " HTTP/1.1\r\nHost: 192.168.4.1\r\n" +
+                          "Content-Type: application/json\r\nContent-Length: " + std::to_string(payload.size()) +
+                          "\r\n\r\n" + payload;
+    send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+    std::string buf;
+    char tmp[4096];
+    size_t header_end;
+    size_t length = 0;
+    int status = -1;
+    while (true) {
+        ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+        if (n <= 0) break;
+        buf.append(tmp, static_cast<size_t>(n));
+        if ((header_end = buf.find("\r\n\r\n")) == std::string::npos) continue;
+        if (status < 0) {
+            status = atoi(buf.c_str() + 9);
+            size_t cl = buf.find("Content-Length: ");
+            length = cl < header_end ? strtoul(buf.c_str() + cl + 16, nullptr, 10) : 0;
+        }
+        if (buf.size() >= header_end + 4 + length) {
+            body = buf.substr(header_end + 4, length);
+            break;
+        }
+    }
+    close(fd);
+    return status;
+}
+
+/**
+ * @brief 联网并持续播放时推送设置：音频、对话、网络各改一次，另有过旧版本、越界值与未知字段，
+ *        统计每次推送触发的 WiFi 连接次数与播放欠载，最后核对 NVS 中的文档
+ */
+void settingsChild(const Options& opt) {
+    static const char* kOfficeSsid = "ChunFeng-Office";
+    host_sim::httpdSetPortOverride(0);
+    host_sim::wifiSetAccessPoints({{kHomeSsid, kHomePassword, -48, 6, 80, 40},
+                                   {kOfficeSsid, "office-pass", -55, 11, 80, 40}});
+    provisionHomeNetwork();
+    startNetworkManager();
+    int64_t t0 = esp_timer_get_time();
+    while (networkState() != static_cast<int32_t>(NetworkState::WIFI_CONNECTED) || host_sim::httpdBoundPort() == 0) {
+        if (elapsedMs(t0) > 10000) {
+            report("errors", 1);
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    const uint16_t port = host_sim::httpdBoundPort();
+    BackendManager& backend = BackendManager::getInstance();
+    backend.initialize();
+
+    static std::atomic<size_t> last_frame_samples{0};
+    host_sim::i2sSetOutputHook([](const int16_t*, size_t samples, int64_t) { last_frame_samples = samples; });
+    AudioPlayback& playback = AudioPlayback::getInstance();
+    if (playback.start(PlaybackConfig()) != ESP_OK) {
+        report("errors", 1);
+        return;
+    }
+    std::atomic<bool> stop{false};
+    std::thread writer([&] {
+        size_t phase = 0;
+        while (!stop) {
+            // 按当前帧长写入，采样率切换后跟着变
+            std::vector<int16_t> chunk(playback.frameSamples() / 2);
+            for (int16_t& v : chunk) {
+                v = static_cast<int16_t>(8192 * std::sin(2 * M_PI * 440 * phase++ / playback.sampleRate()));
+            }
+            playback.write(chunk.data(), chunk.size());
+        }
+        playback.flush();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    bool ok = true;
+    auto push = [&](const char* name, const std::string& doc, int expect) {
+        uint32_t connects = host_sim::wifiConnectCount();
+        uint32_t underruns = counterValue("chunfeng_audio_play_underruns_total");
+        std::string body;
+        int64_t start = esp_timer_get_time();
+        int status = httpRequest(port, "POST", "/settings", doc, body);
+        double ms = elapsedMs(start);
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        char key[64];
+        snprintf(key, sizeof(key), "%s.status", name);
+        report(key, status);
+        snprintf(key, sizeof(key), "%s.apply_ms", name);
+        report(key, ms);
+        snprintf(key, sizeof(key), "%s.wifi_connects", name);
+        report(key, host_sim::wifiConnectCount() - connects);
+        snprintf(key, sizeof(key), "%s.underruns", name);
+        report(key, counterValue("chunfeng_audio_play_underruns_total") - underruns);
+        if (opt.verbose) printf("%s -> %d %s\n", name, status, body.c_str());
+        if (status != expect) ok = false;
+    };
+    push("audio", R"({"version":1,"audio.sample_rate":24000,"audio.volume":50})", 200);
+    report("audio.frame_samples", static_cast<double>(last_frame_samples.load()));
+    if (last_frame_samples.load() != 480) ok = false;
+    push("coze", R"({"version":2,"coze.api_key":"sk-rotated","coze.bot_id":"bot-7"})", 200);
+    push("same", R"({"version":3,"audio.volume":50})", 200);
+    push("stale", R"({"version":3,"audio.volume":10})", 409);
+    push("range", R"({"version":4,"audio.sample_rate":12345})", 400);
+    push("unknown", R"({"version":4,"audio.rate":16000})", 400);
+    // 网络推送先回复 202，回复发出后才切换；结果经 /status 的 settings 分区给出
+    auto settle = [&](const char* name, uint32_t version, int expect_err) {
+        unsigned pending = 1, last = 0;
+        int err = 0;
+        int64_t start = esp_timer_get_time();
+        while (elapsedMs(start) < 15000) {
+            std::string body;
+            size_t at;
+            if (httpRequest(port, "GET", "/status", "", body) == 200 &&
+                (at = body.find("\"settings\":")) != std::string::npos &&
+                sscanf(body.c_str() + at, "\"settings\":{\"version\":%*u,\"pending\":%u,\"last\":%u,\"err\":%d",
+                       &pending, &last, &err) == 3 &&
+                pending == 0) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        char key[64];
+        snprintf(key, sizeof(key), "%s.settle_ms", name);
+        report(key, elapsedMs(start));
+        snprintf(key, sizeof(key), "%s.result", name);
+        report(key, err);
+        if (pending != 0 || last != version || err != expect_err) ok = false;
+    };
+    auto linkedTo = [&](const char* ssid) {
+        int64_t start = esp_timer_get_time();
+        while (networkState() != static_cast<int32_t>(NetworkState::WIFI_CONNECTED) || !host_sim::wifiHasIp() ||
+               WiFiConnector::getInstance().currentSsid() != ssid) {
+            if (elapsedMs(start) > 15000) return -1.0;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return elapsedMs(start);
+    };
+    // 密码错误（通过配网页面连上 Home、文档里还没有 WiFi）：其余子系统先应用，切换期间的推送被拒绝；
+    // 认证失败后整份撤销（音量、待机时间恢复），错误的网络不保存，连回 Home
+    {
+        std::string body;
+        int status = httpRequest(port, "POST", "/settings",
+                                 std::string(R"({"version":4,"audio.volume":20,"network.lte_linger_s":9,"wifi.ssid":")") +
+                                     kHomeSsid + R"(","wifi.password":"wrong-pass"})",
+                                 body);
+        report("wifi_bad.status", status);
+        if (status != 202 || playback.volume() != 20 || backend.getSettings().version != 3) ok = false;
+        status = httpRequest(port, "POST", "/settings", R"({"version":5,"audio.volume":30})", body);
+        report("wifi_bad.busy_status", status);
+        if (status != 409) ok = false;
+    }
+    settle("wifi_bad", 4, ESP_ERR_INVALID_ARG);
+    if (playback.volume() != 50 || backend.getSettings().version != 3 || LTEManager::getInstance().linger() == 9000) {
+        ok = false;
+    }
+    for (const SavedNetwork& n : WiFiManager::getInstance().getNetworks()) {
+        if (n.password == "wrong-pass") ok = false;
+    }
+    double recover_ms = linkedTo(kHomeSsid);
+    report("wifi_bad.recover_ms", recover_ms);
+    if (recover_ms < 0) ok = false;
+    // 换到 Office：获取 IP 后加入已保存列表、文档同时保存
+    push("wifi", std::string(R"({"version":4,"wifi.ssid":")") + kOfficeSsid + R"(","wifi.password":"office-pass"})",
+         202);
+    settle("wifi", 4, ESP_OK);
+    bool office_saved = false;
+    for (const SavedNetwork& n : WiFiManager::getInstance().getNetworks()) {
+        if (n.ssid == kOfficeSsid) office_saved = true;
+    }
+    if (!office_saved || backend.getSettings().version != 4 || linkedTo(kOfficeSsid) < 0) ok = false;
+    // 只改 4G 待机时间：不重连 WiFi
+    push("lte", R"({"version":5,"network.lte_linger_s":5})", 200);
+    if (LTEManager::getInstance().linger() != 5000) ok = false;
+    // 播放响度与上限：目标高于上限时整份推送被拒绝
+    push("levels", R"({"version":6,"audio.loudness":24,"audio.ceiling":6})", 200);
+    push("levels_bad", R"({"version":7,"audio.loudness":8,"audio.ceiling":10})", 400);
+    stop = true;
+    writer.join();
+    host_sim::i2sSetOutputHook(nullptr);
+
+    // NVS 中的文档与当前设置一致；解析 + 比较的开销
+    settings::Document stored, current = backend.getSettings();
+    settings::load(stored);
+    report("persisted_diff_fields", settings::diff(stored, current));
+    report("version", current.version);
+    const std::string full = R"({"version":9,"wifi.ssid":"a","wifi.password":"b","audio.sample_rate":16000,)"
+                             R"("audio.volume":70,"coze.api_key":"k","coze.bot_id":"c","system.device_name":"d"})";
+    constexpr int kRounds = 20000;
+    char error[64];
+    uint32_t sink = 0;
+    auto tp = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRounds; ++i) {
+        settings::Document next;
+        settings::parse(full.data(), full.size(), current, next, error, sizeof(error));
+        sink += settings::affected(settings::diff(current, next));
+    }
+    report("parse_diff_us", std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - tp).count() /
+                                kRounds);
+
+    // 布局 1 的文档（没有末尾的 lte_linger_s）：沿用旧字段，新字段取默认值
+    struct {
+        uint16_t layout;
+        uint16_t size;
+        settings::Document doc;
+    } old_layout = {1, static_cast<uint16_t>(offsetof(settings::Document, lte_linger_s)), current};
+    nvs_handle_t handle;
+    nvs_open("settings", NVS_READWRITE, &handle);
+    nvs_set_blob(handle, "doc", &old_layout, offsetof(decltype(old_layout), doc) + old_layout.size);
+    nvs_close(handle);
+    settings::Document migrated;
+    settings::load(migrated);
+    bool migrate_ok = migrated.version == current.version && strcmp(migrated.wifi_ssid, current.wifi_ssid) == 0 &&
+                      migrated.lte_linger_s == 60 && migrated.audio_loudness == 20 && migrated.audio_ceiling == 3;
+    report("migrate_layout1", migrate_ok ? 1 : 0);
+    if (sink == 0 || settings::diff(stored, current) != 0 || current.version != 6 || !migrate_ok || !ok) {
+        report("errors", 1);
+    }
+}
+
+/* ---------- 场景：增量固件升级 ---------- */
+
+/**
+ * @brief 合成的固件镜像：镜像头魔数 0xE9，之后是从 512 个“指令字”中按几何分布抽取的序列，
+ *        压缩率与真实固件的代码段相近
+ */
+std::vector<uint8_t> syntheticFirmware(size_t size, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint32_t> words(512);
+    for (uint32_t& w : words) w = rng();
+    std::geometric_distribution<int> pick(0.02);
+    std::vector<uint8_t> image(32, 0);
+    image[0] = 0xE9;
+    while (image.size() < size) {
+        uint32_t w = words[pick(rng) % words.size()];
+        image.insert(image.end(), reinterpret_cast<uint8_t*>(&w), reinterpret_cast<uint8_t*>(&w) + 4);
+    }
+    image.resize(size);
+    return image;
+}
+
+/** 新版本：中间插入一段新代码，散布的指令改动（地址重定位），末尾追加新功能 */
+std::vector<uint8_t> nextFirmware(const std::vector<uint8_t>& old_image, uint32_t seed) {
+    std::mt19937 rng(seed);
+    auto randomBytes = [&](size_t n) {
+        std::vector<uint8_t> v(n);
+        for (uint8_t& b : v) b = static_cast<uint8_t>(rng());
+        return v;
+    };
+    std::vector<uint8_t> image(old_image.begin(), old_image.begin() + old_image.size() / 4);
+    std::vector<uint8_t> inserted = randomBytes(3000);
+    image.insert(image.end(), inserted.begin(), inserted.end());
+    image.insert(image.end(), old_image.begin() + old_image.size() / 4, old_image.end());
+    for (int i = 0; i < 300; ++i) {
+        size_t pos = 32 + rng() % (image.size() - 36);
+        uint32_t w = rng();
+        memcpy(&image[pos], &w, sizeof(w));
+    }
+    std::vector<uint8_t> appended = randomBytes(20000);
+    image.insert(image.end(), appended.begin(), appended.end());
+    return image;
+}
+
+/**
+ * @brief 从旧固件生成增量包，经模拟的 4G 链路（往返 30ms）用 HTTPS Range 下载并写入 ota_1：
+ *        中途断线后续传、重试用完后下次续传、后端异常时自检回滚、往返成功并稳定运行后确认、
+ *        损坏的升级包、基于其他版本的升级包
+ */
+void otaChild(const Options& opt) {
+    host_sim::tlsSetLinkProfile(30, 250, 5);
+    nvs_flash_init();
+    static FakeTlsServer server(0, 1000);
+    const std::vector<uint8_t> v1 = syntheticFirmware(1536 * 1024, 1);
+    const std::vector<uint8_t> v2 = nextFirmware(v1, 2);
+    host_sim::flashProgram("ota_0", v1);
+
+    ota::EncodeStats stats;
+    auto tp = std::chrono::steady_clock::now();
+    const std::vector<uint8_t> patch = ota::encodePatch(v1, v2, 64, &stats);
+    report("encode_ms", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tp).count());
+    report("image_bytes", static_cast<double>(v2.size()));
+    report("patch_bytes", static_cast<double>(patch.size()));
+    report("patch_ratio_pct", 100.0 * patch.size() / v2.size());
+    report("patch_blocks", static_cast<double>(stats.blocks));
+
+    std::mutex served_mutex;
+    std::string served(patch.begin(), patch.end());
+    static std::atomic<int> health_status{200};    // 新固件自检时后端的状态码
+    static std::atomic<int> health_requests{0};
+    server.setResponder([&](const std::string& head) {
+        if (head.compare(0, 12, "GET /health ") == 0) {
+            ++health_requests;
+            return "HTTP/1.1 " + std::to_string(health_status.load()) + " Status\r\nContent-Length: 2\r\n\r\n{}";
+        }
+        std::lock_guard<std::mutex> lock(served_mutex);
+        size_t offset = 0;
+        const char* range = strcasestr(head.c_str(), "Range: bytes=");
+        if (range) offset = strtoul(range + 13, nullptr, 10);
+        if (offset >= served.size()) return std::string("HTTP/1.1 416 Range Not Satisfiable\r\nContent-Length: 0\r\n\r\n");
+        char line[160];
+        snprintf(line, sizeof(line), "Content-Range: bytes %zu-%zu/%zu\r\n", offset, served.size() - 1,
+                 served.size());
+        return std::string(range ? "HTTP/1.1 206 Partial Content\r\n" + std::string(line) : "HTTP/1.1 200 OK\r\n") +
+               "Content-Type: application/octet-stream\r\nContent-Length: " + std::to_string(served.size() - offset) +
+               "\r\n\r\n" + served.substr(offset);
+    });
+
+    ota::OtaUpdater& updater = ota::OtaUpdater::getInstance();
+    bool ok = true;
+    auto check = [&](const char* what, bool cond) {
+        if (!cond) {
+            ok = false;
+            if (opt.verbose) printf("失败: %s\n", what);
+        }
+    };
+
+    // 1. 纯解包吞吐（数据在内存中，不经网络）
+    {
+        ota::PatchHeader header;
+        ota::parseHeader(patch.data(), patch.size(), header);
+        const esp_partition_t* src = esp_ota_get_running_partition();
+        const esp_partition_t* dst = esp_ota_get_next_update_partition(nullptr);
+        std::unique_ptr<ota::DeltaPatcher> patcher(new ota::DeltaPatcher());
+        tp = std::chrono::steady_clock::now();
+        esp_err_t err = patcher->begin(header, src, dst, ota::PatchPosition());
+        for (size_t pos = sizeof(header); err == ESP_OK && pos < patch.size(); pos += 1024) {
+            err = patcher->feed(patch.data() + pos, std::min<size_t>(1024, patch.size() - pos));
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tp).count();
+        report("patch.throughput_MBps", v2.size() / 1048576.0 / (ms / 1000.0));
+        check("patch", err == ESP_OK && patcher->done() && patcher->verify() == ESP_OK);
+        check("patch.image", host_sim::flashRead("ota_1", v2.size()) == v2);
+        // 解包器本身加一个接收缓冲就是升级期间的全部堆内存
+        report("working_set_bytes", static_cast<double>(sizeof(ota::DeltaPatcher) + 1024));
+    }
+
+    // 2. 在 OTA 任务中下载，传到 40% 时断线一次，从最近的块续传
+    host_sim::FlashStats flash0 = host_sim::flashStats();
+    server.dropNextResponseAfter(patch.size() * 2 / 5);
+    struct Done {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool done{false};
+        esp_err_t err{ESP_FAIL};
+    } done;
+    tp = std::chrono::steady_clock::now();
+    updater.startUpdate(std::make_unique<ota::HttpsPatchSource>("localhost", "/fw/v2.cfdp", server.port()),
+                        [](esp_err_t err, void* arg) {
+                            Done* d = static_cast<Done*>(arg);
+                            std::lock_guard<std::mutex> lock(d->mutex);
+                            d->err = err;
+                            d->done = true;
+                            d->cv.notify_all();
+                        },
+                        &done);
+    {
+        std::unique_lock<std::mutex> lock(done.mutex);
+        done.cv.wait_for(lock, std::chrono::seconds(30), [&] { return done.done; });
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tp).count();
+    ota::UpdateProgress progress = updater.progress();
+    host_sim::FlashStats flash1 = host_sim::flashStats();
+    report("download.ms", ms);
+    report("download.reconnects", progress.reconnects);
+    report("download.patch_received_bytes", progress.patch_received);
+    report("download.flash_written_bytes", static_cast<double>(flash1.bytes_written - flash0.bytes_written));
+    report("download.sectors_erased", flash1.sectors_erased - flash0.sectors_erased);
+    report("flash_dirty_writes", flash1.dirty_writes);
+    check("download", done.err == ESP_OK && progress.state == ota::UpdateState::READY && progress.reconnects == 1);
+    check("download.image", host_sim::flashRead("ota_1", v2.size()) == v2);
+
+    // 3. 新固件自检：链路已通但后端只回 503，不确认，超时后回滚到旧固件
+    ota::HealthCheck health;
+    health.host = "localhost";
+    health.path = "/health";
+    health.port = server.port();
+    health.stable_ms = 300;
+    health.timeout_ms = 1500;
+    health.retry_ms = 100;
+    status::NetworkStatus link{};
+    link.link = 1;
+    status::updateNetwork(link);
+    health_status = 503;
+    check("boot.new", host_sim::otaReboot() == "ota_1" && updater.pendingVerify());
+    check("verify.backend_down", !updater.verify(health) && health_requests > 0 &&
+                                     strcmp(esp_ota_get_running_partition()->label, "ota_0") == 0);
+    check("boot.rollback", host_sim::otaReboot() == "ota_0" && !updater.pendingVerify());
+
+    // 4. 不重试：断线后保留断点，下一次 apply() 从断点续传，只下载剩余部分
+    updater.setMaxRetries(0);
+    server.dropNextResponseAfter(patch.size() / 2);
+    ota::HttpsPatchSource source("localhost", "/fw/v2.cfdp", server.port());
+    esp_err_t err = updater.apply(source);
+    uint32_t first = updater.progress().patch_received;
+    check("resume.interrupted", err == ESP_ERR_TIMEOUT);
+    err = updater.apply(source);
+    progress = updater.progress();
+    report("resume.first_attempt_bytes", first);
+    report("resume.second_attempt_bytes", progress.patch_received);
+    report("resume.redownloaded_bytes", static_cast<double>(first + progress.patch_received) - patch.size());
+    check("resume", err == ESP_OK && progress.resumed && progress.patch_received < patch.size());
+    updater.setMaxRetries(5);
+
+    // 5. 后端往返成功、再稳定运行 stable_ms 后确认，重启后保留新固件
+    //    链路 400ms 后才通，这之前不向后端发请求
+    constexpr uint32_t kLinkDelayMs = 400;
+    health_status = 200;
+    health_requests = 0;
+    link.link = 0;
+    status::updateNetwork(link);
+    check("boot.update", host_sim::otaReboot() == "ota_1" && updater.pendingVerify());
+    std::thread link_up([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(kLinkDelayMs));
+        check("verify.no_link", health_requests == 0 && updater.pendingVerify());
+        link.link = 1;
+        status::updateNetwork(link);
+    });
+    tp = std::chrono::steady_clock::now();
+    bool verified = updater.verify(health);
+    double verify_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tp).count();
+    link_up.join();
+    report("verify.confirm_ms", verify_ms);
+    check("confirm", verified && verify_ms >= kLinkDelayMs + health.stable_ms && health_requests == 1 &&
+                         !updater.pendingVerify() && host_sim::otaReboot() == "ota_1");
+
+    // 6. 升级包基于 v1，而运行的已是 v2
+    err = updater.apply(source);
+    report("wrong_base.err", err);
+    check("wrong_base", err == ESP_ERR_INVALID_VERSION);
+
+    // 7. 从 v2 升级到 v3（写入 ota_0），升级包损坏：块哈希或解码检查发现，不切换启动分区
+    const std::vector<uint8_t> v3 = nextFirmware(v2, 3);
+    std::vector<uint8_t> patch3 = ota::encodePatch(v2, v3, 64);
+    patch3[patch3.size() * 2 / 3] ^= 0x10;
+    {
+        std::lock_guard<std::mutex> lock(served_mutex);
+        served.assign(patch3.begin(), patch3.end());
+    }
+    const esp_partition_t* boot_before = esp_ota_get_boot_partition();
+    err = updater.apply(source);
+    report("corrupt.err", err);
+    check("corrupt", (err == ESP_ERR_INVALID_CRC || err == ESP_ERR_INVALID_SIZE) &&
+                         esp_ota_get_boot_partition() == boot_before);
+
+    report("errors", ok ? 0 : 1);
+}
+
+/* ---------- 场景：离线语音队列 ---------- */
+
+constexpr uint32_t kSpoolUtterances = 40;
+
+/** 第 k 段语音：2~6 秒、每 20ms 一帧 40 字节（16kbps Opus） */
+std::vector<uint8_t> spoolUtterance(uint32_t k, UtteranceInfo& info) {
+    std::mt19937 rng(1000 + k);
+    uint32_t frames = 100 + rng() % 201;
+    std::vector<uint8_t> data(frames * 40);
+    for (auto& b : data) b = static_cast<uint8_t>(rng());
+    info = UtteranceInfo{frames * 20, 16000, 0, 20};
+    return data;
+}
+
+/** 模拟的上传链路：256KB/s，记录每次调用的时间，按顺序拼出收到的语音 */
+struct SpoolSink {
+    std::mutex mutex;
+    std::vector<uint8_t> current;
+    std::vector<std::vector<uint8_t>> completed;
+    std::vector<uint32_t> ids;
+    std::vector<std::pair<int64_t, int64_t>> calls;     ///< 每次调用的开始与结束时间
+    uint32_t info_mismatches{0};
+    uint32_t fail_index{2};         ///< 第 3 段语音的第二个片段失败一次
+    bool failed{false};
+};
+
+esp_err_t spoolUpload(uint32_t id, const UtteranceInfo& info, uint32_t offset, const uint8_t* data, size_t len,
+                      bool last, void* arg) {
+    SpoolSink* sink = static_cast<SpoolSink*>(arg);
+    int64_t start = esp_timer_get_time();
+    std::this_thread::sleep_for(std::chrono::microseconds(len * 1000000 / (256 * 1024)));
+    std::lock_guard<std::mutex> lock(sink->mutex);
+    sink->calls.emplace_back(start, esp_timer_get_time());
+    if (offset > 0 && sink->completed.size() == sink->fail_index && !sink->failed) {
+        sink->failed = true;
+        return ESP_FAIL;
+    }
+    if (offset == 0) sink->current.clear();
+    sink->current.insert(sink->current.end(), data, data + len);
+    if (last) {
+        UtteranceInfo expected;
+        spoolUtterance(static_cast<uint32_t>(sink->completed.size()), expected);
+        if (memcmp(&info, &expected, sizeof(info)) != 0) sink->info_mismatches++;
+        sink->completed.push_back(sink->current);
+        sink->ids.push_back(id);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief 第一次启动：裸队列的写放大与磨损、队列满时丢弃最早的条目；
+ *        断网时录下 kSpoolUtterances 段语音（夹杂 VAD 误触发），最后一段写到一半掉电
+ */
+void spoolOffline(const esp_partition_t* partition, const std::function<void(const char*, bool)>& check) {
+    std::vector<uint8_t> record(UtteranceSpool::kFragmentBytes);
+    for (size_t i = 0; i < record.size(); ++i) record[i] = static_cast<uint8_t>(i * 7);
+
+    // 1. 每段 8 条记录（与语音片段同样大小），补传落后 32 段，写满三轮分区
+    {
+        spool::FlashQueue queue;
+        check("queue.open", queue.open(partition) == ESP_OK);
+        uint32_t id = queue.nextEntryId();
+        uint64_t total = 0;
+        auto tp = std::chrono::steady_clock::now();
+        while (total < 3ull * partition->size) {
+            for (int r = 0; r < 8; ++r) {
+                uint8_t flags = (r == 0 ? spool::kFirst : 0) | (r == 7 ? spool::kLast : 0);
+                check("queue.append", queue.append(id, flags, record.data(), record.size()) == ESP_OK);
+            }
+            id++;
+            total += 8 * record.size();
+            spool::Entry entry;
+            while (queue.stats().pending > 32 && queue.front(entry)) queue.ack(entry);
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tp).count();
+        spool::QueueStats stats = queue.stats();
+        std::vector<uint32_t> erases = host_sim::flashEraseCounts("spool");
+        uint32_t most = *std::max_element(erases.begin(), erases.end());
+        uint32_t least = *std::min_element(erases.begin(), erases.end());
+        report("queue.append_MBps", total / 1048576.0 / (ms / 1000.0));
+        report("queue.write_amplification", static_cast<double>(stats.bytes_programmed) / stats.bytes_appended);
+        report("queue.erases", stats.erases);
+        report("queue.sector_erases_max", most);
+        report("queue.sector_erases_min", least);
+        check("queue.wear", most - least <= 1 && stats.dropped == 0);
+    }
+
+    // 2. 一直不补传：写入 1.5 倍分区容量，最早的整段被丢弃，剩下的仍按顺序可读
+    host_sim::flashProgram("spool", {});
+    {
+        spool::FlashQueue queue;
+        queue.open(partition);
+        uint32_t entries = static_cast<uint32_t>(partition->size * 3 / 2 / (8 * record.size()));
+        for (uint32_t id = 1; id <= entries; ++id) {
+            for (int r = 0; r < 8; ++r) {
+                uint8_t flags = (r == 0 ? spool::kFirst : 0) | (r == 7 ? spool::kLast : 0);
+                queue.append(id, flags, record.data(), record.size());
+            }
+        }
+        spool::QueueStats stats = queue.stats();
+        spool::Entry entry{};
+        bool has_front = queue.front(entry);
+        report("full.pending", stats.pending);
+        report("full.dropped", stats.dropped);
+        report("full.fill_pct", 100.0 * stats.pending * 8 * record.size() / partition->size);
+        check("full", has_front && entry.id == stats.dropped + 1 && stats.pending + stats.dropped == entries &&
+                          entry.records == 8);
+    }
+
+    // 3. 断网录音：按 200 倍实时速度交给队列
+    host_sim::flashProgram("spool", {});
+    UtteranceSpool& spool = UtteranceSpool::getInstance();
+    check("capture.start", spool.start() == ESP_OK);
+    const uint8_t noise[40] = {};
+    uint64_t bytes = 0;
+    auto tp = std::chrono::steady_clock::now();
+    for (uint32_t k = 0; k < kSpoolUtterances; ++k) {
+        if (k % 5 == 4) {
+            // VAD 误触发：录了半秒后放弃
+            spool.begin(UtteranceInfo{500, 16000, 0, 20});
+            for (int i = 0; i < 25; ++i) spool.append(noise, sizeof(noise));
+            spool.end(false);
+        }
+        UtteranceInfo info;
+        std::vector<uint8_t> data = spoolUtterance(k, info);
+        check("capture.begin", spool.begin(info) == ESP_OK);
+        for (size_t pos = 0; pos < data.size(); pos += 40) {
+            spool.append(data.data() + pos, 40);
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        check("capture.end", spool.end() == ESP_OK);
+        bytes += data.size();
+    }
+    int64_t t0 = esp_timer_get_time();
+    while (spool.stats().queued < kSpoolUtterances && elapsedMs(t0) < 5000) vTaskDelay(1);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tp).count();
+    SpoolStats stats = spool.stats();
+    report("capture.utterances", stats.queued);
+    report("capture.KB", bytes / 1024.0);
+    report("capture.pool_drops", stats.dropped);
+    report("capture.ms", ms);
+    check("capture", stats.queued == kSpoolUtterances && stats.dropped == 0 && stats.flash.pending == kSpoolUtterances);
+
+    // 4. 下一段语音写到第二条记录中间时掉电，子进程退出即断电
+    host_sim::flashCutPowerAfter(1500);
+    UtteranceInfo info;
+    std::vector<uint8_t> data = spoolUtterance(kSpoolUtterances, info);
+    spool.begin(info);
+    for (size_t pos = 0; pos < data.size(); pos += 40) spool.append(data.data() + pos, 40);
+    vTaskDelay(pdMS_TO_TICKS(50));
+}
+
+/**
+ * @brief 第二次启动：从分区镜像恢复；断网中 NetworkManager 停在 FAILED 并退避重试，经配网页面连上 WiFi 后
+ *        按顺序补传，中途进入实时对话时让路
+ */
+void spoolReplay(const std::function<void(const char*, bool)>& check) {
+    UtteranceSpool& spool = UtteranceSpool::getInstance();
+    int64_t t0 = esp_timer_get_time();
+    check("recover.start", spool.start() == ESP_OK);
+    report("recover.ms", elapsedMs(t0));
+    SpoolStats stats = spool.stats();
+    report("recover.pending", stats.flash.pending);
+    report("recover.torn_records", stats.flash.discarded);
+    check("recover", stats.flash.pending == kSpoolUtterances && stats.flash.discarded == 1);
+
+    static SpoolSink sink;
+    spool.setUploader(spoolUpload, &sink);
+    auto completed = [&] {
+        std::lock_guard<std::mutex> lock(sink.mutex);
+        return sink.completed.size();
+    };
+    auto callsSince = [&](int64_t t) {
+        std::lock_guard<std::mutex> lock(sink.mutex);
+        std::vector<std::pair<int64_t, int64_t>> out;
+        for (const auto& c : sink.calls) {
+            if (c.second > t) out.push_back(c);
+        }
+        return out;
+    };
+
+    // 1. 断网仍在继续：WiFi 与 4G 都连不上，状态机停在 FAILED，退避后自己重试，期间不补传
+    auto waitState = [](NetworkState state, int64_t timeout_ms) {
+        int64_t t = esp_timer_get_time();
+        while (networkState() != static_cast<int32_t>(state)) {
+            if (elapsedMs(t) > timeout_ms) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    };
+    auto failedRetries = [] {
+        const auto* m = findMetric("chunfeng_network_failed_retries_total");
+        return m ? static_cast<const metrics::Counter*>(m)->value() : 0;
+    };
+    host_sim::httpdSetPortOverride(0);
+    host_sim::wifiSetAccessPoints({});
+    host_sim::wifiSetNoApTimeout(200);
+    host_sim::lteSetBehaviour(200, false);
+    provisionHomeNetwork();
+    int64_t t_boot = esp_timer_get_time();
+    startNetworkManager();
+    check("outage.failed", waitState(NetworkState::FAILED, 10000));
+    int64_t t_failed = esp_timer_get_time();
+    check("outage.retry", waitState(NetworkState::CONNECTING, 10000) && waitState(NetworkState::FAILED, 10000));
+    report("outage.failed_retry_ms", (esp_timer_get_time() - t_failed) / 1000.0);
+    check("outage.retries", failedRetries() == 1);
+    check("outage.no_uploads", callsSince(t_boot).empty());
+
+    // 2. 路由器恢复，经配网页面连上：WiFi 链路消息让状态机立即离开 FAILED，不等下一次退避（10 秒）
+    host_sim::wifiSetAccessPoints({{kHomeSsid, kHomePassword, -48, 6, 80, 40}});
+    int64_t t_link = esp_timer_get_time();
+    BspConfigNetwork portal;
+    check("link.request", portal.connectWiFi(kHomeSsid, kHomePassword));
+    check("link.online", waitState(NetworkState::WIFI_CONNECTED, 3000));
+    report("link.to_online_ms", elapsedMs(t_link));
+    check("link.no_retry", failedRetries() == 1);
+
+    // 3. 联网：从状态机进入 WIFI_CONNECTED 到第一个片段的延迟
+    status::Snapshot snapshot;
+    status::read(snapshot);
+    int64_t t_online = snapshot.network.state_since_ms * 1000LL;
+    while (callsSince(t_online).empty() && elapsedMs(t_online) < 1000) vTaskDelay(1);
+    auto first = callsSince(t_online);
+    report("replay.first_upload_ms", first.empty() ? -1 : (first.front().first - t_online) / 1000.0);
+
+    // 4. 补传 10 段后进入录音：当前片段结束后暂停，300ms 后回到空闲继续
+    while (completed() < 10 && elapsedMs(t_online) < 10000) std::this_thread::sleep_for(std::chrono::microseconds(200));
+    int64_t t_live = esp_timer_get_time();
+    bus::publish<bus::Topic::SYSTEM_STATE>(SystemState::LISTENING);
+    vTaskDelay(pdMS_TO_TICKS(300));
+    auto during = callsSince(t_live);
+    size_t started = std::count_if(during.begin(), during.end(), [&](const auto& c) { return c.first > t_live; });
+    int64_t paused_at = t_live;
+    for (const auto& c : during) paused_at = std::max(paused_at, c.second);
+    report("live.pause_ms", (paused_at - t_live) / 1000.0);
+    report("live.uploads_started", static_cast<double>(started));
+    check("live.pause", started <= 1 && paused_at - t_live < 100000);
+    int64_t t_idle = esp_timer_get_time();
+    bus::publish<bus::Topic::SYSTEM_STATE>(SystemState::IDLE);
+    while (callsSince(t_idle).empty() && elapsedMs(t_idle) < 1000) vTaskDelay(1);
+    auto resumed = callsSince(t_idle);
+    report("live.resume_ms", resumed.empty() ? -1 : (resumed.front().first - t_idle) / 1000.0);
+
+    // 5. 全部补传完成（第 3 段中途失败一次，退避 1 秒后整段重传）
+    while (spool.stats().flash.pending > 0 && elapsedMs(t_online) < 20000) vTaskDelay(pdMS_TO_TICKS(5));
+    double drain_ms = elapsedMs(t_online);
+    stats = spool.stats();
+    uint64_t bytes = 0;
+    bool content_ok = true;
+    bool order_ok = true;
+    {
+        std::lock_guard<std::mutex> lock(sink.mutex);
+        for (size_t i = 0; i < sink.completed.size(); ++i) {
+            UtteranceInfo info;
+            content_ok = content_ok && sink.completed[i] == spoolUtterance(static_cast<uint32_t>(i), info);
+            order_ok = order_ok && (i == 0 || sink.ids[i] > sink.ids[i - 1]);
+            bytes += sink.completed[i].size();
+        }
+        report("replay.info_mismatches", sink.info_mismatches);
+        check("replay.content", content_ok && order_ok && sink.info_mismatches == 0 &&
+                                    sink.completed.size() == kSpoolUtterances);
+    }
+    report("replay.drain_ms", drain_ms);
+    report("replay.KBps", bytes / 1024.0 / (drain_ms / 1000.0));
+    report("replay.uploaded", stats.uploaded);
+    report("replay.upload_failures", stats.upload_failures);
+    report("flash_dirty_writes", host_sim::flashStats().dirty_writes);
+    check("replay", stats.uploaded == kSpoolUtterances && stats.upload_failures == 1 && stats.flash.pending == 0 &&
+                        host_sim::flashStats().dirty_writes == 0);
+}
+
+/**
+ * @brief 离线语音队列：分区镜像保存在文件中，两次启动之间保留（掉电即子进程退出）
+ */
+void spoolChild(const Options& opt) {
+    host_sim::flashAttachFile("spool", s_spool_image);
+    const esp_partition_t* partition =
+        esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "spool");
+    bool ok = partition != nullptr;
+    auto check = [&](const char* what, bool cond) {
+        if (!cond) {
+            ok = false;
+            if (opt.verbose) printf("失败: %s\n", what);
+        }
+    };
+    if (ok) {
+        if (s_boot_index == 0) {
+            spoolOffline(partition, check);
+        } else {
+            spoolReplay(check);
+        }
+    }
+    report(s_boot_index == 0 ? "errors.offline" : "errors.replay", ok ? 0 : 1);
+}
+
+/* ---------- 场景：合成语音缓存 ---------- */
+
+/** 固定提示音与回复，前 kCachePrompts 条是提示音 */
+constexpr size_t kCachePrompts = 6;
+constexpr size_t kCacheReplies = 24;
+constexpr int kCacheRequests = 40;
+constexpr size_t kCacheBudget = 512 * 1024;
+
+std::string cacheText(size_t i) {
+    static const char* const kPrompts[kCachePrompts] = {
+        "网络已连接", "请先配置 WiFi", "网络连接失败，请稍后再试", "已切换到 4G 网络", "我没有听清，请再说一遍",
+        "固件升级完成",
+    };
+    return i < kCachePrompts ? kPrompts[i] : "回复 " + std::to_string(i - kCachePrompts);
+}
+
+/** 合成结果：提示音 0.8~1.5 秒，回复 1.5~2.5 秒（16kHz），内容由文本决定 */
+std::vector<int16_t> cacheSynth(size_t i) {
+    std::mt19937 rng(static_cast<uint32_t>(7000 + i));
+    uint32_t ms = i < kCachePrompts ? 800 + rng() % 700 : 1500 + rng() % 1000;
+    std::vector<int16_t> pcm(16 * ms);
+    for (auto& s : pcm) s = static_cast<int16_t>(rng());
+    return pcm;
+}
+
+/**
+ * @brief 一轮请求：60% 是提示音，其余是几乎不重复的回复；未命中时经模拟的 4G 合成服务
+ *        （首包 120ms、256KB/s）边下载边写入缓存，命中时从缓存流式读出并核对内容
+ */
+std::vector<bool> cacheRequests(uint32_t seed, const std::function<void(const char*, bool)>& check,
+                                const char* prefix) {
+    ResponseCache& cache = ResponseCache::getInstance();
+    std::mt19937 rng(seed);
+    std::vector<double> hit_ms;
+    std::vector<double> miss_ms;
+    std::vector<bool> hit(kCachePrompts + kCacheReplies);
+    bool content_ok = true;
+    for (int r = 0; r < kCacheRequests; ++r) {
+        size_t i = rng() % 10 < 6 ? rng() % kCachePrompts : kCachePrompts + rng() % kCacheReplies;
+        const std::vector<int16_t> expected = cacheSynth(i);
+        CacheKey key = makeCacheKey(cacheText(i).c_str(), "xiaoyan", 16000);
+        int64_t t0 = esp_timer_get_time();
+        ResponseCache::Reader reader;
+        if (cache.lookup(key, reader)) {
+            std::vector<int16_t> got;
+            int16_t frame[320];
+            while (size_t n = reader.read(frame, 320)) {
+                if (got.empty()) hit_ms.push_back(elapsedMs(t0));
+                got.insert(got.end(), frame, frame + n);
+            }
+            content_ok = content_ok && got == expected;
+            hit[i] = true;
+            continue;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(120));
+        cache.beginInsert(key, 16000, expected.size() * sizeof(int16_t));
+        for (size_t pos = 0; pos < expected.size(); pos += 2048) {
+            size_t n = std::min<size_t>(2048, expected.size() - pos);
+            if (pos == 0) miss_ms.push_back(elapsedMs(t0));
+            cache.write(expected.data() + pos, n);
+            std::this_thread::sleep_for(std::chrono::microseconds(n * 2 * 1000000 / (256 * 1024)));
+        }
+        check("insert", cache.commit() == ESP_OK);
+        check("budget", cache.stats().bytes <= kCacheBudget);
+    }
+    std::string p(prefix);
+    report((p + ".hit_first_audio_ms_p50").c_str(), percentile(hit_ms, 0.5));
+    report((p + ".miss_first_audio_ms_p50").c_str(), percentile(miss_ms, 0.5));
+    report((p + ".hits").c_str(), static_cast<double>(hit_ms.size()));
+    report((p + ".misses").c_str(), static_cast<double>(miss_ms.size()));
+    check("content", content_ok);
+    return hit;
+}
+
+/**
+ * @brief 合成语音缓存：缓存目录在两次启动之间保留。第一次启动从空缓存开始，超出预算时淘汰，
+ *        最后一条写到一半时掉电；第二次启动恢复索引，上次命中过的提示音第一次请求就命中
+ */
+void cacheChild(const Options& opt) {
+    bool ok = true;
+    auto check = [&](const char* what, bool cond) {
+        if (!cond) {
+            ok = false;
+            if (opt.verbose) printf("失败: %s\n", what);
+        }
+    };
+    std::string dir = "/tmp/chunfeng_bench_cache_" + std::to_string(getppid());
+    ResponseCache& cache = ResponseCache::getInstance();
+    auto clearDir = [&] {
+        if (DIR* d = opendir(dir.c_str())) {
+            while (struct dirent* ent = readdir(d)) {
+                if (ent->d_name[0] != '.') unlink((dir + "/" + ent->d_name).c_str());
+            }
+            closedir(d);
+        }
+        rmdir(dir.c_str());
+    };
+
+    if (s_boot_index == 0) {
+        clearDir();
+        mkdir(dir.c_str(), 0755);
+        check("open", cache.open(dir.c_str(), kCacheBudget) == ESP_OK);
+        std::vector<bool> hit = cacheRequests(1, check, "cold");
+        // 命中过的提示音不会被只用过一次的回复挤出缓存；缓存中的提示音数留给第二次启动核对
+        uint32_t cached_prompts = 0;
+        for (size_t i = 0; i < kCachePrompts; ++i) {
+            ResponseCache::Reader reader;
+            bool cached = cache.lookup(makeCacheKey(cacheText(i).c_str(), "xiaoyan", 16000), reader);
+            cached_prompts += cached;
+            check("cold.protected", cached || !hit[i]);
+        }
+        report("cold.cached_prompts", cached_prompts);
+        FILE* fp = fopen((dir + "/bench_prompts").c_str(), "w");
+        if (fp) {
+            fprintf(fp, "%u\n", cached_prompts);
+            fclose(fp);
+        }
+        CacheStats stats = cache.stats();
+        report("cold.evictions", stats.evictions);
+        report("cold.entries", stats.entries);
+        report("cold.cache_KB", stats.bytes / 1024.0);
+        check("evict", stats.evictions > 0 && stats.bytes <= kCacheBudget);
+
+        // 合成到一半掉电（子进程退出），只留下临时文件
+        std::vector<int16_t> pcm = cacheSynth(kCachePrompts + kCacheReplies);
+        cache.beginInsert(makeCacheKey("掉电", "xiaoyan", 16000), 16000);
+        cache.write(pcm.data(), pcm.size() / 2);
+        report("errors.cold", ok ? 0 : 1);
+        _exit(0);
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    check("reopen", cache.open(dir.c_str(), kCacheBudget) == ESP_OK);
+    report("warm.open_ms", elapsedMs(t0));
+    CacheStats stats = cache.stats();
+    report("warm.entries", stats.entries);
+    struct stat st;
+    check("warm.tmp_removed", stat((dir + "/rc_tmp.pcm").c_str(), &st) != 0);
+
+    // 索引（含命中次数）重启后仍在，提示音第一次请求就命中
+    uint32_t prompt_hits = 0;
+    for (size_t i = 0; i < kCachePrompts; ++i) {
+        ResponseCache::Reader reader;
+        if (cache.lookup(makeCacheKey(cacheText(i).c_str(), "xiaoyan", 16000), reader)) prompt_hits++;
+    }
+    unsigned cached_prompts = 0;
+    if (FILE* fp = fopen((dir + "/bench_prompts").c_str(), "r")) {
+        if (fscanf(fp, "%u", &cached_prompts) != 1) cached_prompts = 0;
+        fclose(fp);
+    }
+    report("warm.prompt_hits", prompt_hits);
+    check("warm.prompts", prompt_hits == cached_prompts && prompt_hits > 0);
+    // 换了音色或采样率是不同的条目
+    ResponseCache::Reader reader;
+    check("warm.key", !cache.lookup(makeCacheKey(cacheText(0).c_str(), "xiaofeng", 16000), reader) &&
+                          !cache.lookup(makeCacheKey(cacheText(0).c_str(), "xiaoyan", 24000), reader));
+
+    cacheRequests(2, check, "warm");
+
+    // 经播放任务播放一条提示音：首个音频耗时包含放入播放缓冲
+    AudioPlayback& playback = AudioPlayback::getInstance();
+    check("play.start", playback.start(PlaybackConfig()) == ESP_OK);
+    t0 = esp_timer_get_time();
+    check("play", cache.play(makeCacheKey(cacheText(0).c_str(), "xiaoyan", 16000), playback) == ESP_OK);
+    report("play.ms", elapsedMs(t0));
+
+    const auto* hit_pct = findMetric("chunfeng_response_cache_hit_pct");
+    report("warm.hit_pct", hit_pct ? static_cast<const metrics::Gauge*>(hit_pct)->value() : -1);
+    const auto* first_audio = findMetric("chunfeng_response_first_audio_ms", "source=\"cache\"");
+    check("metrics", first_audio && static_cast<const metrics::Histogram*>(first_audio)->count() > 0);
+    cache.close();
+    clearDir();
+    report("errors.warm", ok ? 0 : 1);
+}
+
+/* ---------- 场景：开机编排 ---------- */
+
+/** 与 main.cpp 的阶段表一致，耗时为模拟值（毫秒） */
+struct BootStageSim {
+    uint32_t ms;
+    esp_err_t result;
+    std::atomic<int> runs{0};
+};
+
+esp_err_t bootStageSim(void* arg) {
+    BootStageSim* sim = static_cast<BootStageSim*>(arg);
+    sim->runs++;
+    vTaskDelay(pdMS_TO_TICKS(sim->ms));
+    return sim->result;
+}
+
+/**
+ * @brief 第一次启动没有耗时记录，第二次沿用第一次保存在 NVS 中的各阶段耗时
+ *
+ * 核对依赖先后、核心绑定、每个阶段只运行一次；某阶段失败时依赖它的阶段照常运行；依赖有环时不运行任何阶段。
+ */
+void bootseqChild(const Options& opt) {
+    bool ok = true;
+    auto check = [&](const char* what, bool cond) {
+        if (!cond) {
+            ok = false;
+            if (opt.verbose) printf("失败: %s\n", what);
+        }
+    };
+    bool warm = s_boot_index > 0;
+    if (warm) host_sim::nvsLoad(s_nvs_image);
+    nvs_flash_init();
+
+    // 挂载与建索引、设置、屏幕与字库、离线队列、WiFi 驱动与配网服务、创建网络任务；冷启动时离线队列失败
+    enum : uint8_t { STORAGE, SETTINGS, DISPLAY, SPOOL, WIFI, NETWORK };
+    BootStageSim sims[] = {{180, ESP_OK}, {10, ESP_OK}, {150, ESP_OK},
+                           {60, warm ? ESP_OK : ESP_FAIL}, {220, ESP_OK}, {5, ESP_OK}};
+    const boot::Stage stages[] = {
+        {"storage", bootStageSim, &sims[STORAGE], 0, boot::kAnyCore, 0},
+        {"settings", bootStageSim, &sims[SETTINGS], 0, boot::kAnyCore, boot::kInteractive},
+        {"display", bootStageSim, &sims[DISPLAY], boot::after(STORAGE), 1, boot::kInteractive},
+        {"spool", bootStageSim, &sims[SPOOL], 0, boot::kAnyCore, 0},
+        {"wifi", bootStageSim, &sims[WIFI], 0, 0, 0},
+        {"network", bootStageSim, &sims[NETWORK], boot::after(WIFI) | boot::after(SETTINGS) | boot::after(SPOOL),
+         boot::kAnyCore, 0},
+    };
+    constexpr size_t kStages = sizeof(stages) / sizeof(stages[0]);
+
+    boot::Sequencer seq(stages, kStages);
+    check("run", seq.run() == ESP_OK);
+    if (opt.verbose) seq.logTimeline();
+    check("profile", seq.hasProfile() == warm);
+    for (size_t i = 0; i < kStages; ++i) {
+        const boot::StageRecord& rec = seq.record(i);
+        check("once", sims[i].runs == 1);
+        check("core", stages[i].core == boot::kAnyCore || rec.core == stages[i].core);
+        check("result", rec.err == sims[i].result);
+        for (size_t d = 0; d < kStages; ++d) {
+            if ((stages[i].depends >> d) & 1) check("order", rec.start_us >= seq.record(d).end_us);
+        }
+    }
+    const char* prefix = warm ? "warm." : "cold.";
+    std::string key;
+    report((key = std::string(prefix) + "sequential_ms").c_str(), seq.sequentialUs() / 1000.0);
+    report((key = std::string(prefix) + "total_ms").c_str(), seq.totalUs() / 1000.0);
+    report((key = std::string(prefix) + "interactive_ms").c_str(), seq.interactiveUs() / 1000.0);
+    report((key = std::string(prefix) + "speedup").c_str(),
+           static_cast<double>(seq.sequentialUs()) / std::max<uint32_t>(seq.totalUs(), 1));
+    check("parallel", seq.totalUs() < seq.sequentialUs() && seq.interactiveUs() <= seq.totalUs());
+    const auto* interactive = findMetric("chunfeng_boot_interactive_ms");
+    check("metrics", interactive && static_cast<const metrics::Gauge*>(interactive)->value() ==
+                                        static_cast<int32_t>(seq.interactiveUs() / 1000));
+
+    // 依赖有环：一个阶段都不运行
+    BootStageSim cyc_sim[2] = {{1, ESP_OK}, {1, ESP_OK}};
+    const boot::Stage cycle[] = {
+        {"a", bootStageSim, &cyc_sim[0], boot::after(1), boot::kAnyCore, 0},
+        {"b", bootStageSim, &cyc_sim[1], boot::after(0), boot::kAnyCore, 0},
+    };
+    boot::Sequencer bad(cycle, 2, nullptr);
+    check("cycle", bad.run() == ESP_ERR_INVALID_ARG && cyc_sim[0].runs == 0 && cyc_sim[1].runs == 0);
+
+    host_sim::nvsSave(s_nvs_image);
+    report((key = std::string("errors.") + (warm ? "warm" : "cold")).c_str(), ok ? 0 : 1);
+}
+
+/* ---------- 场景：电源模式 ---------- */
+
+/** 模拟时间线上的一个事件 */
+struct PowerEvent {
+    int64_t at_s;
+    int kind;               ///< 0 系统状态，1 按键唤醒，2 唤醒词开关
+    SystemState state;
+    bool armed;
+};
+
+/**
+ * @brief 按模拟时间线驱动策略，与电源任务一样只在事件与 nextChangeUs() 时计算
+ * @param wakeups [out] 计算次数（事件加上定时醒来）
+ * @param cold_starts [out] 开口录音时不在全速、需要升频的次数
+ */
+power::Policy replayPowerTimeline(const std::vector<PowerEvent>& events, int64_t end_s, bool armed,
+                                  const std::function<void(const power::Policy&, int64_t)>& probe,
+                                  uint32_t* wakeups, uint32_t* cold_starts) {
+    power::Policy policy(power::PolicyConfig(), 0);
+    policy.setWakeWordArmed(armed, 0);
+    uint32_t n = 0;
+    uint32_t cold = 0;
+    auto advance = [&](int64_t until_us) {
+        for (int64_t next = policy.nextChangeUs(); next <= until_us; next = policy.nextChangeUs()) {
+            policy.evaluate(next);
+            probe(policy, next);
+            n++;
+        }
+    };
+    for (const PowerEvent& e : events) {
+        int64_t t = e.at_s * 1000000;
+        advance(t);
+        if (e.kind == 0 && e.state == SystemState::LISTENING && policy.evaluate(t) != power::Mode::ACTIVE) cold++;
+        if (e.kind == 0) policy.onSystemState(e.state, t);
+        else if (e.kind == 1) policy.onWake(t);
+        else policy.setWakeWordArmed(armed && e.armed, t);
+        probe(policy, t);
+        n++;
+    }
+    advance(end_s * 1000000);
+    policy.evaluate(end_s * 1000000);
+    if (wakeups) *wakeups = n;
+    if (cold_starts) *cold_starts = cold;
+    return policy;
+}
+
+/**
+ * @brief 策略按一天的模拟时间线计算，比较唤醒词常开、只用按键唤醒与始终全速的平均电流；
+ *        再启动 PowerManager 检查电源锁、WiFi 省电模式与唤醒耗时
+ *
+ * 时间线：白天每 20 分钟一次对话（其中一半 3 秒内追问），午间一次 90 秒的固件升级，
+ * 夜里唤醒词关闭并进入 SLEEPING，早上按键唤醒。电流为 PolicyConfig 中的估计值。
+ */
+void powerChild(const Options& opt) {
+    bool ok = true;
+    auto check = [&](const char* what, bool cond) {
+        if (!cond) {
+            ok = false;
+            if (opt.verbose) printf("失败: %s\n", what);
+        }
+    };
+    std::vector<PowerEvent> events;
+    auto sys = [&](int64_t at_s, SystemState s) { events.push_back({at_s, 0, s, false}); };
+    sys(0, SystemState::BOOTING);
+    sys(8, SystemState::IDLE);
+    const int64_t kDay = 24 * 3600;
+    const int64_t kNight = 22 * 3600;
+    int64_t t = 600;
+    uint32_t conversations = 0;
+    for (int i = 0; t < kNight - 600; ++i, t += 1200) {
+        conversations++;
+        sys(t, SystemState::LISTENING);
+        sys(t + 4, SystemState::THINKING);
+        sys(t + 6, SystemState::SPEAKING);
+        sys(t + 12, SystemState::IDLE);
+        if (i % 2 == 0) {
+            // 追问：上一句播完 3 秒内再次开口
+            sys(t + 15, SystemState::LISTENING);
+            sys(t + 18, SystemState::THINKING);
+            sys(t + 19, SystemState::SPEAKING);
+            sys(t + 24, SystemState::IDLE);
+        }
+        if (i == 18) {
+            sys(t + 300, SystemState::UPGRADING);
+            sys(t + 390, SystemState::IDLE);
+        }
+    }
+    events.push_back({kNight, 2, SystemState::IDLE, false});
+    sys(kNight, SystemState::SLEEPING);
+    events.push_back({kDay - 60, 1, SystemState::IDLE, false});
+    sys(kDay - 60, SystemState::IDLE);
+    events.push_back({kDay - 59, 2, SystemState::IDLE, true});
+    std::stable_sort(events.begin(), events.end(),
+              [](const PowerEvent& a, const PowerEvent& b) { return a.at_s < b.at_s; });
+
+    int busy_violations = 0;
+    int armed_sleeps = 0;
+    auto probe = [&](bool armed) {
+        return [&, armed](const power::Policy& p, int64_t now_us) {
+            // 找到 now 时刻的系统状态与唤醒词开关
+            SystemState state = SystemState::BOOTING;
+            bool armed_now = armed;
+            for (const PowerEvent& e : events) {
+                if (e.at_s * 1000000 > now_us) break;
+                if (e.kind == 0) state = e.state;
+                if (e.kind == 2) armed_now = armed && e.armed;
+            }
+            bool busy = state == SystemState::LISTENING || state == SystemState::THINKING ||
+                        state == SystemState::SPEAKING || state == SystemState::UPGRADING ||
+                        state == SystemState::BOOTING;
+            if (busy && p.mode() != power::Mode::ACTIVE) busy_violations++;
+            if (armed_now && p.mode() == power::Mode::LIGHT_SLEEP) armed_sleeps++;
+        };
+    };
+    uint32_t armed_wakeups = 0;
+    uint32_t button_wakeups = 0;
+    uint32_t cold_starts = 0;
+    power::Policy armed = replayPowerTimeline(events, kDay, true, probe(true), &armed_wakeups, nullptr);
+    power::Policy button = replayPowerTimeline(events, kDay, false, probe(false), &button_wakeups, &cold_starts);
+    check("busy_active", busy_violations == 0);
+    check("armed_no_light_sleep", armed_sleeps == 0);
+    // 每次对话的第一句需要从低功耗升频，追问时仍在全速保持时间内
+    check("followup_active", cold_starts == conversations);
+    report("timeline.cold_starts", cold_starts);
+
+    const uint32_t always_ua = power::PolicyConfig().current_ma[static_cast<int>(power::Mode::ACTIVE)] * 1000;
+    report("timeline.always_active_ua", always_ua);
+    report("timeline.wake_word.avg_ua", armed.averageCurrentUa());
+    report("timeline.wake_word.idle_ua", armed.averageIdleCurrentUa());
+    report("timeline.button.avg_ua", button.averageCurrentUa());
+    report("timeline.button.idle_ua", button.averageIdleCurrentUa());
+    for (int m = 0; m < static_cast<int>(power::Mode::COUNT); ++m) {
+        std::string key = std::string("timeline.button.") + power::modeName(static_cast<power::Mode>(m)) + "_pct";
+        report(key.c_str(), 100.0 * button.residencyUs(static_cast<power::Mode>(m)) / (kDay * 1000000.0));
+    }
+    report("timeline.evaluations", button_wakeups);
+    report("timeline.transitions", button.transitions());
+    check("saves", button.averageCurrentUa() < armed.averageCurrentUa() && armed.averageCurrentUa() < always_ua);
+    // 一天中电源任务只在事件与模式到期时醒来（按秒轮询需要 86400 次）
+    check("event_driven", armed_wakeups < 1000 && button_wakeups < 1000);
+
+    // 实际运行：短参数下从待机到 light sleep，按键与录音唤醒
+    power::PolicyConfig config;
+    config.active_hold_ms = 100;
+    config.light_sleep_after_ms = 300;
+    PowerManager& pm = PowerManager::getInstance();
+    check("start", pm.start(config) == ESP_OK);
+    check("boot_active", pm.mode() == power::Mode::ACTIVE && host_sim::pmCpuFreqMhz() == 240);
+    check("wake_sources", host_sim::pmWakeSources() == (host_sim::kWakeWifi | host_sim::kWakeGpio));
+    auto waitMode = [&](power::Mode mode, int64_t timeout_ms) {
+        int64_t t0 = esp_timer_get_time();
+        while (pm.mode() != mode) {
+            if (elapsedMs(t0) > timeout_ms) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    };
+    int64_t t0 = esp_timer_get_time();
+    bus::publish<bus::Topic::SYSTEM_STATE>(SystemState::IDLE);
+    check("idle", waitMode(power::Mode::IDLE, 1000));
+    report("live.idle_after_ms", elapsedMs(t0));
+    check("idle.clock", host_sim::pmCpuFreqMhz() == 80 && !host_sim::pmLightSleepAllowed());
+    check("light_sleep", waitMode(power::Mode::LIGHT_SLEEP, 1000));
+    report("live.light_sleep_after_ms", elapsedMs(t0));
+    wifi_ps_type_t ps = WIFI_PS_NONE;
+    esp_wifi_get_ps(&ps);
+    check("light_sleep.locks", host_sim::pmLightSleepAllowed() && ps == WIFI_PS_MAX_MODEM);
+
+    pm.wake(WakeSource::BUTTON);
+    esp_wifi_get_ps(&ps);
+    check("wake", pm.mode() == power::Mode::ACTIVE && host_sim::pmCpuFreqMhz() == 240 &&
+                      !host_sim::pmLightSleepAllowed() && ps == WIFI_PS_NONE);
+    pm.setWakeWordArmed(true);
+    check("armed.idle", waitMode(power::Mode::IDLE, 1000));
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    check("armed.no_light_sleep", pm.mode() == power::Mode::IDLE && !host_sim::pmLightSleepAllowed());
+
+    t0 = esp_timer_get_time();
+    bus::publish<bus::Topic::SYSTEM_STATE>(SystemState::LISTENING);
+    check("listening", waitMode(power::Mode::ACTIVE, 1000));
+    report("live.listening_to_active_ms", elapsedMs(t0));
+    const auto* latency = findMetric("chunfeng_power_wake_latency_us");
+    const auto* h = static_cast<const metrics::Histogram*>(latency);
+    check("metrics", h && h->count() >= 2);
+    if (h && h->count()) report("live.wake_latency_avg_us", static_cast<double>(h->sum()) / h->count());
+    PowerManager::Stats stats = pm.stats();
+    report("live.idle_current_ua", stats.idle_average_ua);
+    report("live.wakes", stats.wakes);
+
+    // 网络任务已连接时不再每秒轮询，WiFi 断开由链路消息立即唤醒
+    host_sim::httpdSetPortOverride(0);
+    host_sim::wifiSetAccessPoints({{kHomeSsid, kHomePassword, -48, 6, 80, 40}});
+    provisionHomeNetwork();
+    startNetworkManager();
+    auto waitState = [](bool connected, int64_t timeout_ms) {
+        int64_t t0 = esp_timer_get_time();
+        while ((networkState() == static_cast<int32_t>(NetworkState::WIFI_CONNECTED)) != connected) {
+            if (elapsedMs(t0) > timeout_ms) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    };
+    check("wifi", waitState(true, 10000));
+
+    // 已配网只开 STA，WiFi 随 light sleep 休眠；配网 AP 开启时设置省电模式失败并记入状态快照，
+    // AP 关闭后电源任务重试恢复
+    ConfigManager& config_mgr = ConfigManager::getInstance();
+    wifi_mode_t wifi_mode = WIFI_MODE_NULL;
+    esp_wifi_get_mode(&wifi_mode);
+    check("portal.closed", wifi_mode == WIFI_MODE_STA && !config_mgr.portalOpen());
+    pm.setWakeWordArmed(false);
+    bus::publish<bus::Topic::SYSTEM_STATE>(SystemState::IDLE);
+    check("sta.light_sleep", waitMode(power::Mode::LIGHT_SLEEP, 1000));
+    status::Snapshot snapshot;
+    status::read(snapshot);
+    esp_wifi_get_ps(&ps);
+    check("sta.wifi_ps", ps == WIFI_PS_MAX_MODEM && snapshot.power.wifi_ps_error == ESP_OK &&
+                             snapshot.power.wifi_ps == WIFI_PS_MAX_MODEM &&
+                             snapshot.power.mode == static_cast<uint8_t>(power::Mode::LIGHT_SLEEP));
+    check("portal.open", config_mgr.openPortal());
+    pm.wake(WakeSource::BUTTON);
+    check("portal.light_sleep", waitMode(power::Mode::LIGHT_SLEEP, 1000));
+    status::read(snapshot);
+    esp_wifi_get_ps(&ps);
+    check("portal.wifi_ps_error", snapshot.power.wifi_ps_error == ESP_ERR_WIFI_MODE &&
+                                      snapshot.power.wifi_ps_failures >= 1 && ps == WIFI_PS_NONE);
+    char json[status::kMaxJsonSize];
+    check("portal.json", status::formatJson(snapshot, json, sizeof(json)) > 0 &&
+                             strstr(json, "\"wifi_ps_err\":12293") != nullptr);
+    report("portal.wifi_ps_failures", snapshot.power.wifi_ps_failures);
+    t0 = esp_timer_get_time();
+    config_mgr.closePortal();
+    while (elapsedMs(t0) < 8000) {
+        status::read(snapshot);
+        if (snapshot.power.wifi_ps_error == ESP_OK) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    report("portal.wifi_ps_recovered_ms", elapsedMs(t0));
+    esp_wifi_get_ps(&ps);
+    check("portal.recovered", snapshot.power.wifi_ps_error == ESP_OK && ps == WIFI_PS_MAX_MODEM);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    t0 = esp_timer_get_time();
+    host_sim::wifiDropConnection();
+    check("link_loss", waitState(false, 5000));
+    report("net.link_loss_detect_ms", elapsedMs(t0));
+    report("errors", ok ? 0 : 1);
+}
+
+/* ---------- 场景：采集增强 ---------- */
+
+/**
+ * 合成两段双麦克风录音（风扇稳态噪声、电视人声加音乐），写成 WAV 再读回，
+ * 分别只做波束形成、只做降噪、两者都做，按标注比较处理前后的信噪比与每帧耗时
+ */
+void enhanceChild(const Options& opt) {
+    bool ok = true;
+    auto check = [&](const char* what, bool cond) {
+        if (!cond) {
+            ok = false;
+            if (opt.verbose) printf("失败: %s\n", what);
+        }
+    };
+    struct Mode {
+        const char* name;
+        bool ns;
+        BeamMode beam;
+        int8_t steer_deg;
+    };
+    const Mode kModes[] = {
+        {"beam", false, BeamMode::DELAY_AND_SUM, 0},
+        {"ns", true, BeamMode::OFF, 0},
+        {"both", true, BeamMode::DELAY_AND_SUM, 0},
+        {"beam_at_noise", false, BeamMode::DELAY_AND_SUM, 65},
+    };
+    const std::pair<const char*, fixtures::Noise> kFixtures[] = {
+        {"fan", fixtures::Noise::FAN},
+        {"tv", fixtures::Noise::TV},
+    };
+    double worst_us = 0;
+    for (const auto& [kind, noise] : kFixtures) {
+        fixtures::FixtureSpec spec;
+        spec.noise = noise;
+        std::string path = "/tmp/chunfeng_bench_" + std::string(kind) + "_" + std::to_string(getpid()) + ".wav";
+        fixtures::Wav made = fixtures::makeFixture(spec);
+        fixtures::Wav wav;
+        check("wav", fixtures::writeWav(path, made) && fixtures::readWav(path, wav) && wav.samples == made.samples &&
+                         wav.active == made.active && wav.channels == 2);
+        unlink(path.c_str());
+        double before = fixtures::snrDb(wav);
+        report((std::string(kind) + ".snr_in_db").c_str(), before);
+        std::map<std::string, double> gain;
+        for (const Mode& m : kModes) {
+            AudioConfig config;
+            config.channels = static_cast<uint8_t>(wav.channels);
+            config.noise_suppression = m.ns;
+            config.beam_mode = m.beam;
+            config.steer_deg = m.steer_deg;
+            config.agc = false;     // 自动增益在说话与静音间改变电平，信噪比只比较波束形成与降噪
+            CaptureEnhancer enhancer;
+            check("configure", enhancer.configure(config) == ESP_OK);
+            fixtures::EnhanceStats stats;
+            fixtures::Wav out = fixtures::enhance(enhancer, wav, &stats);
+            gain[m.name] = fixtures::snrDb(out, enhancer.latencySamples()) - before;
+            std::string key = std::string(kind) + "." + m.name;
+            report((key + "_gain_db").c_str(), gain[m.name]);
+            if (strcmp(m.name, "both") == 0) {
+                report((key + "_frame_us").c_str(), stats.mean_us);
+                report((key + "_frame_cycles").c_str(), static_cast<double>(stats.mean_cycles));
+                worst_us = std::max(worst_us, stats.mean_us);
+                if (noise == fixtures::Noise::FAN) {
+                    // 噪声电平 = 语音电平 - 信噪比
+                    report("fan.noise_floor_dbfs", enhancer.noiseSuppressor().noiseFloorDb());
+                    report("fan.noise_floor_truth_dbfs", spec.speech_dbfs - spec.snr_db);
+                }
+            }
+        }
+        check("beam_gain", gain["beam"] > 0);
+        check("ns_gain", gain["ns"] > 0);
+        check("both_gain", gain["both"] > gain["ns"]);
+        check("steering", gain["beam_at_noise"] < gain["beam"]);
+    }
+    // 主机比 ESP32-S3 快一个数量级以上，按 1/20 的 AUDIO_DSP 预算检查
+    check("budget", worst_us < 6000 / 20);
+    report("errors", ok ? 0 : 1);
+}
+
+/* ---------- 场景：自动增益与播放限幅 ---------- */
+
+/**
+ * 采集：说话人由远到近（-50~-10dBFS 各 4 秒）经降噪与自动增益，比较各级输出电平的差距；
+ * 播放：响度不同的回复（-32~-10dBFS）按 20ms 一帧经响度归一与限幅，检查响度差距与峰值不超过上限
+ */
+void agcChild(const Options& opt) {
+    bool ok = true;
+    auto check = [&](const char* what, bool cond) {
+        if (!cond) {
+            ok = false;
+            if (opt.verbose) printf("失败: %s\n", what);
+        }
+    };
+    auto spread = [](const std::vector<double>& v) {
+        return *std::max_element(v.begin(), v.end()) - *std::min_element(v.begin(), v.end());
+    };
+
+    const std::vector<double> kCapture = {-50, -40, -30, -20, -10};
+    fixtures::Wav sweep = fixtures::makeLevelSweep(kCapture);
+    report("capture.in_spread_db", spread(fixtures::stepLevels(sweep, kCapture.size())));
+    for (bool agc : {false, true}) {
+        AudioConfig config;
+        config.agc = agc;
+        CaptureEnhancer enhancer;
+        check("configure", enhancer.configure(config) == ESP_OK);
+        fixtures::EnhanceStats stats;
+        fixtures::Wav out = fixtures::enhance(enhancer, sweep, &stats);
+        std::vector<double> levels = fixtures::stepLevels(out, kCapture.size(), 4, enhancer.latencySamples());
+        std::string key = agc ? "capture.agc" : "capture.ns_only";
+        report((key + ".out_spread_db").c_str(), spread(levels));
+        report((key + ".peak").c_str(), fixtures::peakOf(out));
+        report((key + ".frame_us").c_str(), stats.mean_us);
+        if (agc) {
+            for (size_t k = 0; k < levels.size(); ++k) {
+                std::string level = "capture.agc.out_dbfs_at_" + std::to_string(static_cast<int>(-kCapture[k]));
+                report(level.c_str(), levels[k]);
+            }
+            check("capture.spread", spread(levels) < 6);
+            check("capture.target", std::fabs(levels[2] - config.agc_target_dbfs) < 4);
+            check("capture.no_clip", fixtures::peakOf(out) <= 29204);
+            const auto* gain = findMetric("chunfeng_audio_agc_gain_db");
+            check("capture.metric", gain && static_cast<const metrics::Gauge*>(gain)->value() == enhancer.autoGain().gainDb());
+        }
+    }
+
+    const std::vector<double> kPlay = {-32, -26, -20, -14, -10};
+    fixtures::Wav replies = fixtures::makeLevelSweep(kPlay, 4, -90, 16000, 5);
+    report("play.in_spread_db", spread(fixtures::stepLevels(replies, kPlay.size())));
+    report("play.in_peak", fixtures::peakOf(replies));
+    for (bool normalize : {false, true}) {
+        AudioConfig config;
+        config.play_normalize = normalize;
+        SoftLimiter limiter;
+        check("configure", limiter.configure(config.play_normalize, config.play_loudness_dbfs,
+                                              config.play_ceiling_dbfs) == ESP_OK);
+        fixtures::Wav out = replies;
+        const size_t frame = out.sample_rate / 50;
+        int limited = 0;
+        int64_t t0 = esp_timer_get_time();
+        for (size_t pos = 0; pos + frame <= out.samples.size(); pos += frame) {
+            limiter.process(out.samples.data() + pos, frame, 32767);
+            if (limiter.reductionDb() > 1) limited++;
+        }
+        double frame_us = static_cast<double>(esp_timer_get_time() - t0) / (out.samples.size() / frame);
+        std::vector<double> levels = fixtures::stepLevels(out, kPlay.size(), 4, 0, 1000);
+        const int32_t ceiling = static_cast<int32_t>(std::lround(32767 * std::pow(10.0, config.play_ceiling_dbfs / 20.0)));
+        std::string key = normalize ? "play.normalize" : "play.limit_only";
+        report((key + ".out_spread_db").c_str(), spread(levels));
+        report((key + ".peak").c_str(), fixtures::peakOf(out));
+        report((key + ".limited_frames").c_str(), limited);
+        report((key + ".frame_us").c_str(), frame_us);
+        check("play.ceiling", fixtures::peakOf(out) <= ceiling);
+        if (normalize) {
+            for (size_t k = 0; k < levels.size(); ++k) {
+                std::string level = "play.normalize.out_dbfs_at_" + std::to_string(static_cast<int>(-kPlay[k]));
+                report(level.c_str(), levels[k]);
+            }
+            check("play.spread", spread(levels) < 6);
+            check("play.target", std::fabs(levels[2] - config.play_loudness_dbfs) < 3);
+        }
+    }
+    report("errors", ok ? 0 : 1);
+}
+
+/* ---------- 场景：处理链融合 ---------- */
+
+constexpr size_t kDspFrames = 320;      // 16kHz 下 20ms
+
+// 只有逐样本阶段的链：融合后一趟完成，不融合时每个阶段一趟
+using PointFused = dsp::Pipeline<kDspFrames, int32_t, true, dsp::I2sUnpack<2>, dsp::DcBlock<2>, dsp::Gain<2>,
+                                 dsp::Downmix<2>>;
+using PointSplit = dsp::Pipeline<kDspFrames, int32_t, false, dsp::I2sUnpack<2>, dsp::DcBlock<2>, dsp::Gain<2>,
+                                 dsp::Downmix<2>>;
+// 完整的采集链：I2S 槽解包、去直流、校准增益、波束形成、降噪、自动增益
+using CaptureFused = dsp::Pipeline<kDspFrames, int32_t, true, dsp::I2sUnpack<2>, dsp::DcBlock<2>, dsp::Gain<2>,
+                                   dsp::Beamform, dsp::Denoise, dsp::Agc>;
+using CaptureSplit = dsp::Pipeline<kDspFrames, int32_t, false, dsp::I2sUnpack<2>, dsp::DcBlock<2>, dsp::Gain<2>,
+                                   dsp::Beamform, dsp::Denoise, dsp::Agc>;
+
+/** 对照组：每个阶段读一个 std::vector<uint8_t>、返回新的 std::vector<uint8_t>（AudioManager 草案中的接口形式） */
+template <typename Src, typename Stage>
+std::vector<uint8_t> vectorStage(Stage& stage, const std::vector<uint8_t>& in) {
+    const size_t frames = in.size() / sizeof(Src) / Stage::kIn;
+    std::vector<uint8_t> out(frames * Stage::kOut * sizeof(int16_t));
+    const Src* src = reinterpret_cast<const Src*>(in.data());
+    int16_t* dst = reinterpret_cast<int16_t*>(out.data());
+    if constexpr (Stage::kPoint) {
+        for (size_t n = 0; n < frames; ++n) {
+            int32_t v[Stage::kIn];
+            for (size_t c = 0; c < Stage::kIn; ++c) v[c] = src[n * Stage::kIn + c];
+            stage.apply(v);
+            for (size_t c = 0; c < Stage::kOut; ++c) dst[n * Stage::kOut + c] = static_cast<int16_t>(std::clamp(v[c], -32768, 32767));
+        }
+    } else {
+        stage.process(src, dst, frames);
+    }
+    return out;
+}
+
+/** 对照组的阶段对象，每条链一份（去直流等阶段有状态） */
+struct VectorChain {
+    dsp::I2sUnpack<2> unpack;
+    dsp::DcBlock<2> dc;
+    dsp::Gain<2> gain;
+    dsp::Downmix<2> downmix;
+    dsp::Beamform beam;
+    dsp::Denoise denoise;
+    dsp::Agc agc;
+};
+
+void dspChild(const Options& opt) {
+    bool ok = true;
+    auto check = [&](const char* what, bool cond) {
+        if (!cond) {
+            ok = false;
+            if (opt.verbose) printf("失败: %s\n", what);
+        }
+    };
+    // 输入：双麦克风录音放进 I2S 的 32 位槽（左对齐），另加直流偏置
+    fixtures::FixtureSpec spec;
+    fixtures::Wav wav = fixtures::makeFixture(spec);
+    const size_t frames = wav.frames() / kDspFrames;
+    std::vector<int32_t> slots(frames * kDspFrames * 2);
+    for (size_t i = 0; i < slots.size(); ++i) slots[i] = (static_cast<int32_t>(wav.samples[i]) + 600) * 65536;
+    constexpr int kRounds = 5;
+
+    // 各变体处理整段录音，取 kRounds 轮中最快的一轮
+    auto timeRun = [&](auto&& run) {
+        double best = 1e18;
+        for (int r = 0; r < kRounds; ++r) {
+            auto t0 = std::chrono::steady_clock::now();
+            run();
+            best = std::min(best, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+        }
+        return best / frames;
+    };
+    // 融合与不融合的输出应逐样本一致；处理链对象是静态的（固件中放在内部 SRAM）
+    static PointFused point_fused;
+    static PointSplit point_split;
+    static CaptureFused capture_fused;
+    static CaptureSplit capture_split;
+    static VectorChain point_vector;
+    static VectorChain capture_vector;
+
+    auto runPipeline = [&](auto& pipeline, std::vector<int16_t>& out) {
+        using P = std::remove_reference_t<decltype(pipeline)>;
+        out.resize(frames * kDspFrames * P::kOutChannels);
+        for (size_t f = 0; f < frames; ++f) {
+            pipeline.process(slots.data() + f * kDspFrames * 2, out.data() + f * kDspFrames * P::kOutChannels);
+        }
+    };
+    auto runVector = [&](VectorChain& v, bool capture, std::vector<int16_t>& out) {
+        out.clear();
+        for (size_t f = 0; f < frames; ++f) {
+            std::vector<uint8_t> in(reinterpret_cast<const uint8_t*>(slots.data() + f * kDspFrames * 2),
+                                    reinterpret_cast<const uint8_t*>(slots.data() + (f + 1) * kDspFrames * 2));
+            std::vector<uint8_t> a = vectorStage<int32_t>(v.unpack, in);
+            std::vector<uint8_t> b = vectorStage<int16_t>(v.dc, a);
+            std::vector<uint8_t> c = vectorStage<int16_t>(v.gain, b);
+            std::vector<uint8_t> d = capture ? vectorStage<int16_t>(v.beam, c) : vectorStage<int16_t>(v.downmix, c);
+            if (capture) d = vectorStage<int16_t>(v.agc, vectorStage<int16_t>(v.denoise, d));
+            const int16_t* pcm = reinterpret_cast<const int16_t*>(d.data());
+            out.insert(out.end(), pcm, pcm + d.size() / 2);
+        }
+    };
+
+    std::vector<int16_t> fused, split, vec;
+    const double point_fused_us = timeRun([&] { runPipeline(point_fused, fused); });
+    const double point_split_us = timeRun([&] { runPipeline(point_split, split); });
+    report("point.fused_us", point_fused_us);
+    report("point.split_us", point_split_us);
+    report("point.vector_us", timeRun([&] { runVector(point_vector, false, vec); }));
+    check("point.same_output", fused == split && fused == vec);
+    report("point.fused_passes", PointFused::kPasses);
+    report("point.split_passes", PointSplit::kPasses);
+    report("point.fused_traffic_bytes", PointFused::trafficBytes());
+    report("point.split_traffic_bytes", PointSplit::trafficBytes());
+    check("point.passes", PointFused::kPasses == 1 && PointSplit::kPasses == 4);
+    check("point.fused_faster", point_fused_us <= point_split_us);
+
+    // 降噪与自动增益有状态，但各变体都按同样的顺序处理同样的输入，输出仍应一致
+    report("capture.fused_us", timeRun([&] { runPipeline(capture_fused, fused); }));
+    report("capture.split_us", timeRun([&] { runPipeline(capture_split, split); }));
+    report("capture.vector_us", timeRun([&] { runVector(capture_vector, true, vec); }));
+    check("capture.same_output", fused == split && fused == vec);
+    report("capture.fused_passes", CaptureFused::kPasses);
+    report("capture.fused_traffic_bytes", CaptureFused::trafficBytes());
+    report("capture.split_traffic_bytes", CaptureSplit::trafficBytes());
+    report("capture.static_bytes", sizeof(CaptureFused));
+    check("capture.passes", CaptureFused::kPasses == 4 && CaptureSplit::kPasses == 6);
+    for (size_t i = 0; i < CaptureFused::kPasses; ++i) {
+        const dsp::PassCounter& c = capture_fused.counter(i);
+        std::string key = std::string("capture.fused.") + c.first + (c.stages > 1 ? std::string("..") + c.last : "") +
+                          "_cycles";
+        report(key.c_str(), c.calls ? static_cast<double>(c.cycles) / c.calls : 0);
+        check("capture.counters", c.calls == frames * kRounds);
+    }
+    report("errors", ok ? 0 : 1);
+}
+
+/* ---------- 场景：多路混音 ---------- */
+
+/** 最小二乘拟合频率为 freq 的正弦（窗口应含整数个周期），返回幅度；residual_db 为其余成分相对该正弦的电平 */
+double toneAmplitude(const int16_t* pcm, size_t n, double freq, double rate, double* residual_db = nullptr) {
+    double c = 0, s = 0;
+    for (size_t i = 0; i < n; ++i) {
+        double w = 2 * M_PI * freq * i / rate;
+        c += pcm[i] * std::cos(w);
+        s += pcm[i] * std::sin(w);
+    }
+    c *= 2.0 / n;
+    s *= 2.0 / n;
+    if (residual_db) {
+        double err = 0, sig = 0;
+        for (size_t i = 0; i < n; ++i) {
+            double w = 2 * M_PI * freq * i / rate;
+            double fit = c * std::cos(w) + s * std::sin(w);
+            err += (pcm[i] - fit) * (pcm[i] - fit);
+            sig += fit * fit;
+        }
+        *residual_db = 10 * std::log10(std::max(err, 1e-9) / sig);
+    }
+    return std::hypot(c, s);
+}
+
+/** 连续正弦：每次调用接着上次的相位生成 n 个样本 */
+struct ToneSource {
+    double freq;
+    double rate;
+    double amp;
+    size_t phase{0};
+    std::vector<int16_t> next(size_t n) {
+        std::vector<int16_t> out(n);
+        for (int16_t& v : out) v = static_cast<int16_t>(std::lround(amp * std::sin(2 * M_PI * freq * phase++ / rate)));
+        return out;
+    }
+};
+
+void mixChild(const Options& opt) {
+    bool ok = true;
+    auto check = [&](const char* what, bool cond) {
+        if (!cond) {
+            ok = false;
+            if (opt.verbose) printf("失败: %s\n", what);
+        }
+    };
+    constexpr uint32_t kRate = 16000;
+    constexpr size_t kFrame = kRate * AudioPlayback::kFrameMs / 1000;
+    auto db = [](double ratio) { return 20 * std::log10(std::max(ratio, 1e-9)); };
+    ToneSource speech{500, kRate, 8000};
+    const std::vector<int16_t> speech_frame = speech.next(kFrame);    // 500Hz 每帧正好 10 个周期
+    std::vector<int16_t> frame(kFrame);
+    report("static_bytes", sizeof(AudioMixer));
+
+    // 每帧耗时与流数：流与播放同采样率（直接拷贝）或 44.1kHz（多相重采样）
+    static AudioMixer mixer;
+    check("rate", mixer.setOutputRate(kRate) == ESP_OK);
+    frame = speech_frame;
+    check("passthrough", !mixer.mix(frame.data(), kFrame, true) && frame == speech_frame);
+    for (uint32_t src_rate : {kRate, 44100u}) {
+        for (size_t streams = 0; streams <= AudioMixer::kMaxStreams; ++streams) {
+            int ids[AudioMixer::kMaxStreams];
+            MixStreamConfig config;
+            config.sample_rate = src_rate;
+            config.gain_db = -12;
+            for (size_t i = 0; i < streams; ++i) check("cost.open", mixer.open(config, &ids[i]) == ESP_OK);
+            ToneSource earcon{1000, static_cast<double>(src_rate), 4000};
+            const std::vector<int16_t> chunk = earcon.next(src_rate * AudioPlayback::kFrameMs / 1000);
+            constexpr int kFrames = 300;
+            double total_us = 0;
+            for (int f = 0; f < kFrames; ++f) {
+                for (size_t i = 0; i < streams; ++i) mixer.write(ids[i], chunk.data(), chunk.size());
+                frame = speech_frame;
+                auto t0 = std::chrono::steady_clock::now();
+                mixer.mix(frame.data(), kFrame, true);
+                total_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+            }
+            for (size_t i = 0; i < streams; ++i) mixer.stop(ids[i]);
+            for (int f = 0; f < 50 && mixer.activeStreams(); ++f) mixer.mix(frame.data(), kFrame, true);
+            check("cost.released", mixer.activeStreams() == 0);
+            std::string key = std::string("cost.") + (src_rate == kRate ? "same_rate" : "resample_44k") + ".streams_" +
+                              std::to_string(streams) + "_us";
+            report(key.c_str(), total_us / kFrames);
+        }
+    }
+
+    // 闹钟压低语音 20dB：淡入一帧内压到位，结束后保持 kDuckHoldMs 再恢复
+    {
+        static AudioMixer duck;
+        duck.setOutputRate(kRate);
+        MixStreamConfig alarm_cfg;
+        alarm_cfg.priority = mix_priority::kAlarm;
+        alarm_cfg.duck_db = 20;
+        ToneSource alarm{2000, kRate, 8000};
+        int id = -1;
+        std::vector<double> speech_amp, alarm_amp;
+        for (int f = 0; f < 60; ++f) {
+            if (f == 10) check("duck.open", duck.open(alarm_cfg, &id) == ESP_OK);
+            if (f >= 10 && f < 30) duck.write(id, alarm.next(kFrame).data(), kFrame);
+            if (f == 30) duck.finish(id);
+            frame = speech_frame;
+            duck.mix(frame.data(), kFrame, true);
+            speech_amp.push_back(toneAmplitude(frame.data(), kFrame, 500, kRate));
+            alarm_amp.push_back(toneAmplitude(frame.data(), kFrame, 2000, kRate));
+        }
+        const double full = speech_amp[5];
+        int restore_frame = -1;
+        for (int f = 30; f < 60 && restore_frame < 0; ++f) {
+            if (speech_amp[f] >= 0.99 * full) restore_frame = f;
+        }
+        report("duck.speech_db", db(speech_amp[20] / full));
+        report("duck.alarm_db", db(alarm_amp[20] / 8000));
+        report("duck.first_frame_db", db(speech_amp[10] / full));
+        report("duck.restore_ms", restore_frame < 0 ? -1 : (restore_frame - 30) * AudioPlayback::kFrameMs);
+        check("duck.passthrough", std::fabs(full - 8000) < 8);
+        check("duck.depth", std::fabs(db(speech_amp[20] / full) + 20) < 0.5);
+        check("duck.alarm_level", std::fabs(db(alarm_amp[20] / 8000)) < 0.2);
+        check("duck.ramp", speech_amp[10] < full && speech_amp[10] > 1.5 * speech_amp[20]);
+        check("duck.restore", restore_frame >= 30 + static_cast<int>(AudioMixer::kDuckHoldMs / AudioPlayback::kFrameMs) &&
+                                  restore_frame <= 30 + static_cast<int>(AudioMixer::kDuckHoldMs / AudioPlayback::kFrameMs) + 4);
+        check("duck.released", duck.activeStreams() == 0);
+    }
+
+    // 提示音叠加在语音上（不压低语音）；背景音（-6dB）在有语音时被压低 kSpeechDuckDb
+    {
+        static AudioMixer layer;
+        layer.setOutputRate(kRate);
+        MixStreamConfig ambient_cfg;
+        ambient_cfg.priority = mix_priority::kAmbient;
+        ambient_cfg.gain_db = -6;
+        ambient_cfg.fade_ms = 100;
+        MixStreamConfig notify_cfg;
+        notify_cfg.priority = mix_priority::kNotify;
+        ToneSource ambient{1000, kRate, 8000};
+        ToneSource notify{3000, kRate, 6000};
+        int ambient_id = -1, notify_id = -1;
+        check("layer.open", layer.open(ambient_cfg, &ambient_id) == ESP_OK);
+        std::vector<double> ambient_amp, speech_amp, notify_amp;
+        for (int f = 0; f < 100; ++f) {
+            const bool voice = f >= 20 && f < 60;
+            layer.write(ambient_id, ambient.next(kFrame).data(), kFrame);
+            if (f == 30) check("layer.notify_open", layer.open(notify_cfg, &notify_id) == ESP_OK);
+            if (f >= 30 && f < 40) layer.write(notify_id, notify.next(kFrame).data(), kFrame);
+            if (f == 40) layer.finish(notify_id);
+            if (voice) {
+                frame = speech_frame;
+            } else {
+                std::fill(frame.begin(), frame.end(), 0);
+            }
+            layer.mix(frame.data(), kFrame, voice);
+            ambient_amp.push_back(toneAmplitude(frame.data(), kFrame, 1000, kRate));
+            speech_amp.push_back(toneAmplitude(frame.data(), kFrame, 500, kRate));
+            notify_amp.push_back(toneAmplitude(frame.data(), kFrame, 3000, kRate));
+        }
+        report("layer.ambient_db", db(ambient_amp[15] / 8000));
+        report("layer.ambient_under_speech_db", db(ambient_amp[50] / ambient_amp[15]));
+        report("layer.speech_with_notify_db", db(speech_amp[35] / 8000));
+        report("layer.notify_db", db(notify_amp[35] / 6000));
+        check("layer.ambient_gain", std::fabs(db(ambient_amp[15] / 8000) + 6) < 0.2);
+        check("layer.ambient_ducked", std::fabs(db(ambient_amp[50] / ambient_amp[15]) + AudioMixer::kSpeechDuckDb) < 0.5);
+        check("layer.speech_kept", std::fabs(db(speech_amp[35] / 8000)) < 0.1);
+        check("layer.notify_level", std::fabs(db(notify_amp[35] / 6000)) < 0.1);
+        check("layer.ambient_restored", std::fabs(db(ambient_amp[99] / ambient_amp[15])) < 0.2);
+        layer.stop(ambient_id);
+    }
+
+    // 重采样：各采样率的 1kHz 正弦混到 16kHz 后的电平与残差（混叠、镜像与相位量化）
+    for (uint32_t src_rate : {8000u, 22050u, 44100u, 48000u}) {
+        static AudioMixer resample;
+        resample.setOutputRate(kRate);
+        MixStreamConfig config;
+        config.sample_rate = src_rate;
+        ToneSource tone{1000, static_cast<double>(src_rate), 10000};
+        int id = -1;
+        check("resample.open", resample.open(config, &id) == ESP_OK);
+        std::vector<int16_t> out;
+        for (int f = 0; f < 50; ++f) {
+            resample.write(id, tone.next(src_rate * AudioPlayback::kFrameMs / 1000).data(),
+                           src_rate * AudioPlayback::kFrameMs / 1000);
+            std::fill(frame.begin(), frame.end(), 0);
+            resample.mix(frame.data(), kFrame, false);
+            if (f >= 10) out.insert(out.end(), frame.begin(), frame.end());
+        }
+        resample.stop(id);
+        for (int f = 0; f < 5; ++f) resample.mix(frame.data(), kFrame, false);
+        double residual = 0;
+        double level = db(toneAmplitude(out.data(), out.size(), 1000, kRate, &residual) / 10000);
+        std::string key = "resample." + std::to_string(src_rate);
+        report((key + ".level_db").c_str(), level);
+        report((key + ".residual_db").c_str(), residual);
+        check("resample.level", std::fabs(level) < 0.5);
+        check("resample.residual", residual < -30);
+    }
+
+    // 经 AudioPlayback 播放：语音中途插入 44.1kHz 提示音
+    {
+        static std::mutex out_mutex;
+        static std::vector<std::vector<int16_t>> played;
+        host_sim::i2sSetOutputHook([](const int16_t* pcm, size_t samples, int64_t) {
+            std::lock_guard<std::mutex> lock(out_mutex);
+            played.emplace_back(pcm, pcm + samples);
+        });
+        AudioPlayback& playback = AudioPlayback::getInstance();
+        PlaybackConfig config;
+        check("play.start", playback.start(config) == ESP_OK);
+        MixStreamConfig bad;
+        bad.gain_db = 6;
+        int id = -1;
+        check("play.invalid", playback.openStream(bad, &id) == ESP_ERR_INVALID_ARG);
+        int ids[AudioMixer::kMaxStreams];
+        MixStreamConfig quiet;
+        for (size_t i = 0; i < AudioMixer::kMaxStreams; ++i) check("play.open", playback.openStream(quiet, &ids[i]) == ESP_OK);
+        check("play.full", playback.openStream(quiet, &id) == ESP_ERR_NO_MEM);
+        for (int sid : ids) playback.stopStream(sid);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        std::thread tts([&] {
+            for (int f = 0; f < 50; ++f) playback.write(speech_frame.data(), kFrame);
+            playback.flush();
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        MixStreamConfig earcon_cfg;
+        earcon_cfg.sample_rate = 44100;
+        ToneSource earcon{3000, 44100, 8000};
+        check("play.earcon_open", playback.openStream(earcon_cfg, &id) == ESP_OK);
+        const std::vector<int16_t> pcm = earcon.next(44100 * 300 / 1000);
+        check("play.earcon_write", playback.writeStream(id, pcm.data(), pcm.size(), 1000) == pcm.size());
+        playback.finishStream(id);
+        tts.join();
+        std::this_thread::sleep_for(std::chrono::milliseconds(400));
+
+        std::lock_guard<std::mutex> lock(out_mutex);
+        int earcon_frames = 0, speech_frames = 0;
+        for (const auto& f : played) {
+            if (f.size() != kFrame) continue;
+            earcon_frames += toneAmplitude(f.data(), f.size(), 3000, kRate) > 1000;
+            speech_frames += toneAmplitude(f.data(), f.size(), 500, kRate) > 1000;
+        }
+        report("play.earcon_frames", earcon_frames);
+        report("play.speech_frames", speech_frames);
+        const auto* streams = findMetric("chunfeng_audio_mix_streams");
+        check("play.earcon_heard", earcon_frames >= 13 && earcon_frames <= 17);
+        check("play.speech_heard", speech_frames >= 45);
+        check("play.released", streams && static_cast<const metrics::Gauge*>(streams)->value() == 0);
+    }
+    report("errors", ok ? 0 : 1);
+}
+
+/* ---------- 场景：设备端指令词 ---------- */
+
+// 合成短语经降噪、端点检测截出一句话，再交给识别器：前 fixtures::kCommandPhrases 条是指令，其余应拒识交给云端。
+// 主人（0 号说话人）录入模板，主人与其他说话人在 20dB、10dB 信噪比下各说若干遍
+
+/** 降噪后按端点检测截出第一句话（含开始前 kPreRollSegments 段），没检测到时为空 */
+std::vector<int16_t> cutUtterance(const fixtures::Wav& wav) {
+    constexpr size_t kPreRollSegments = 10;
+    static NoiseSuppressor ns;
+    ns.reset();
+    VoiceDetector vad(wav.sample_rate);
+    const size_t seg = vad.segmentSamples();
+    std::vector<int16_t> clean(wav.samples.size());
+    ns.process(wav.samples.data(), clean.data(), clean.size());
+    size_t begin = 0;
+    for (size_t at = 0; at + seg <= clean.size(); at += seg) {
+        VoiceDetector::Event e = vad.feed(clean.data() + at);
+        size_t index = at / seg;
+        if (e == VoiceDetector::Event::START) {
+            size_t back = VoiceDetector::kStartSegments + kPreRollSegments;
+            begin = (index + 1 > back ? index + 1 - back : 0) * seg;
+        } else if (e == VoiceDetector::Event::END) {
+            return std::vector<int16_t>(clean.begin() + begin, clean.begin() + at + seg);
+        }
+    }
+    return {};
+}
+
+void kwsChild(const Options& opt) {
+    bool ok = true;
+    auto check = [&](const char* what, bool cond) {
+        if (!cond) {
+            ok = false;
+            if (opt.verbose) printf("失败: %s\n", what);
+        }
+    };
+    constexpr int kEnrollTakes = 4;
+    constexpr int kTestTakes = 5;
+    constexpr uint32_t kOtherTalkers = 5;
+    report("static_bytes", sizeof(CommandRecognizer));
+
+    static CommandRecognizer recognizer;
+    for (size_t c = 0; c < fixtures::kCommandPhrases; ++c) {
+        for (int take = 0; take < kEnrollTakes; ++take) {
+            fixtures::UtteranceSpec spec;
+            spec.seed = 100 + take;
+            std::vector<int16_t> pcm = cutUtterance(fixtures::makeUtterance(c, fixtures::makeTalker(0), spec));
+            check("enroll.cut", !pcm.empty());
+            check("enroll", recognizer.enroll(static_cast<int>(c), pcm.data(), pcm.size()) == ESP_OK);
+        }
+    }
+    report("templates", recognizer.templates());
+
+    struct Tally {
+        int commands = 0, correct = 0, rejected = 0, substituted = 0;
+        int oov = 0, accepted = 0;
+        int missed = 0;     // 端点检测没有截出
+    };
+    std::vector<double> decode_us;
+    auto run = [&](uint32_t talker_id, double snr_db, Tally& tally) {
+        const fixtures::Talker talker = fixtures::makeTalker(talker_id);
+        for (size_t p = 0; p < fixtures::kPhrases; ++p) {
+            for (int take = 0; take < kTestTakes; ++take) {
+                fixtures::UtteranceSpec spec;
+                spec.snr_db = snr_db;
+                spec.seed = 1000 + talker_id * 100 + take;
+                std::vector<int16_t> pcm = cutUtterance(fixtures::makeUtterance(p, talker, spec));
+                const bool command = p < fixtures::kCommandPhrases;
+                (command ? tally.commands : tally.oov)++;
+                if (pcm.empty()) {
+                    tally.missed++;
+                    if (command) tally.rejected++;
+                    continue;
+                }
+                recognizer.begin();
+                recognizer.feed(pcm.data(), pcm.size());
+                CommandMatch m = recognizer.finish();
+                decode_us.push_back(m.decode_us);
+                if (opt.verbose) {
+                    printf("talker %u snr %.0f %-24s -> %2d d=%u r=%u w=%u frames=%u\n", talker_id, snr_db,
+                           fixtures::phraseName(p), m.command, m.distance, m.runner_up, m.worst, m.frames);
+                }
+                if (!command) {
+                    tally.accepted += m.command >= 0;
+                } else if (m.command == static_cast<int>(p)) {
+                    tally.correct++;
+                } else if (m.command < 0) {
+                    tally.rejected++;
+                } else {
+                    tally.substituted++;
+                }
+            }
+        }
+    };
+    auto pct = [](int part, int whole) { return whole ? 100.0 * part / whole : 0.0; };
+    for (double snr : {20.0, 10.0}) {
+        Tally owner, others;
+        run(0, snr, owner);
+        for (uint32_t t = 1; t <= kOtherTalkers; ++t) run(t, snr, others);
+        const std::string key = "snr_" + std::to_string(static_cast<int>(snr));
+        report((key + ".owner.accuracy_pct").c_str(), pct(owner.correct, owner.commands));
+        report((key + ".owner.false_reject_pct").c_str(), pct(owner.rejected, owner.commands));
+        report((key + ".owner.substitution_pct").c_str(), pct(owner.substituted, owner.commands));
+        report((key + ".owner.oov_accept_pct").c_str(), pct(owner.accepted, owner.oov));
+        report((key + ".others.accuracy_pct").c_str(), pct(others.correct, others.commands));
+        report((key + ".others.false_reject_pct").c_str(), pct(others.rejected, others.commands));
+        report((key + ".others.substitution_pct").c_str(), pct(others.substituted, others.commands));
+        report((key + ".others.oov_accept_pct").c_str(), pct(others.accepted, others.oov));
+        report((key + ".vad_missed").c_str(), owner.missed + others.missed);
+        // 模板只代表主人的嗓音：其他人的指令可以拒识（交给云端），但不能识别成别的指令
+        check("owner.accuracy", pct(owner.correct, owner.commands) >= (snr >= 20 ? 90 : 80));
+        check("owner.substitution", pct(owner.substituted, owner.commands) <= 5);
+        check("others.substitution", pct(others.substituted, others.commands) <= 5);
+        check("owner.oov", pct(owner.accepted, owner.oov) <= 10);
+        check("others.oov", pct(others.accepted, others.oov) <= 10);
+        check("vad", owner.missed + others.missed == 0);
+    }
+    double mean = 0, worst = 0;
+    for (double us : decode_us) {
+        mean += us / decode_us.size();
+        worst = std::max(worst, us);
+    }
+    report("decode_mean_us", mean);
+    report("decode_max_us", worst);
+    check("decode", mean < 20000);
+
+    // 模板文件读回后识别结果不变
+    const char* kTemplates = "/tmp/chunfeng_bench_kws.bin";
+    check("save", recognizer.save(kTemplates) == ESP_OK);
+    {
+        static CommandRecognizer reloaded;
+        check("load", reloaded.load(kTemplates) == ESP_OK && reloaded.templates() == recognizer.templates());
+        for (size_t p = 0; p < fixtures::kPhrases; ++p) {
+            fixtures::UtteranceSpec spec;
+            spec.seed = 7000 + p;
+            std::vector<int16_t> pcm = cutUtterance(fixtures::makeUtterance(p, fixtures::makeTalker(0), spec));
+            recognizer.begin();
+            recognizer.feed(pcm.data(), pcm.size());
+            reloaded.begin();
+            reloaded.feed(pcm.data(), pcm.size());
+            CommandMatch a = recognizer.finish(), b = reloaded.finish();
+            check("load.match", a.command == b.command && a.distance == b.distance);
+        }
+    }
+
+    // 端到端：连续的采集流（降噪后每 20ms 一块）交给 CommandRouter，指令在本地执行，其余交给云端
+    static std::atomic<int> out_peak{0};
+    host_sim::i2sSetOutputHook([](const int16_t* pcm, size_t samples, int64_t) {
+        int peak = 0;
+        for (size_t i = 0; i < samples; ++i) peak = std::max(peak, std::abs(static_cast<int>(pcm[i])));
+        int seen = out_peak.load();
+        while (peak > seen && !out_peak.compare_exchange_weak(seen, peak)) {
+        }
+    });
+    AudioPlayback& playback = AudioPlayback::getInstance();
+    CommandRouter& router = CommandRouter::getInstance();
+    if (playback.start(PlaybackConfig()) != ESP_OK || router.start(kTemplates) != ESP_OK) {
+        report("errors", 1);
+        return;
+    }
+    playback.setVolume(80);
+    static NoiseSuppressor ns;
+    ns.reset();
+    const size_t chunk = CommandRouter::kSampleRate * AudioPlayback::kFrameMs / 1000;
+    std::vector<int16_t> clean(chunk);
+    std::vector<CommandRouter::Route> routes;
+    size_t cloud_samples = 0;
+    bool cloud_speaking = false;
+    // realtime：按 20ms 一块的节奏送入，提示音在之后的 process() 中续写
+    auto feed = [&](const std::vector<int16_t>& pcm, bool realtime) {
+        routes.clear();
+        for (size_t at = 0; at + chunk <= pcm.size(); at += chunk) {
+            ns.process(pcm.data() + at, clean.data(), chunk);
+            CommandRouter::Route route = router.process(clean.data(), chunk);
+            if (route == CommandRouter::Route::CLOUD) {
+                router.buffered(&cloud_samples);
+                cloud_speaking = router.speaking();
+            }
+            if (route != CommandRouter::Route::IDLE && route != CommandRouter::Route::LISTENING) routes.push_back(route);
+            if (realtime) std::this_thread::sleep_for(std::chrono::milliseconds(AudioPlayback::kFrameMs));
+        }
+    };
+    auto say = [&](size_t phrase, uint32_t seed) {
+        fixtures::UtteranceSpec spec;
+        spec.snr_db = 20;
+        spec.seed = seed;
+        feed(fixtures::makeUtterance(phrase, fixtures::makeTalker(0), spec).samples, false);
+    };
+    auto single = [&](CommandRouter::Route route) {
+        if (opt.verbose) {
+            printf("routes:");
+            for (CommandRouter::Route r : routes) printf(" %d", static_cast<int>(r));
+            printf("  command %d d=%u frames=%u\n", router.lastMatch().command, router.lastMatch().distance,
+                   router.lastMatch().frames);
+        }
+        return routes.size() == 1 && routes[0] == route;
+    };
+
+    say(0, 8001);   // 大声点
+    check("router.volume_up", single(CommandRouter::Route::LOCAL) && playback.volume() == 90);
+    say(1, 8002);   // 小声点
+    check("router.volume_down", single(CommandRouter::Route::LOCAL) && playback.volume() == 80);
+    say(7, 8003);   // 讲个故事
+    check("router.cloud", single(CommandRouter::Route::CLOUD) && !cloud_speaking &&
+                              cloud_samples > CommandRouter::kSampleRate / 2);
+    report("router.cloud_ms", cloud_samples * 1000.0 / CommandRouter::kSampleRate);
+
+    // 超过指令最大长度的一句话不等说完就交给云端，之后的输入逐块转发
+    {
+        std::vector<int16_t> story;
+        for (size_t i = 0; i < 3; ++i) {
+            fixtures::UtteranceSpec spec;
+            spec.snr_db = 20;
+            spec.seed = 8010 + i;
+            spec.lead_ms = i == 0 ? 400 : 60;
+            spec.tail_ms = i == 2 ? 600 : 60;
+            const fixtures::Wav part = fixtures::makeUtterance(6 + i % 2, fixtures::makeTalker(0), spec);
+            story.insert(story.end(), part.samples.begin(), part.samples.end());
+        }
+        feed(story, false);
+        check("router.long", routes.size() > 1 && routes[0] == CommandRouter::Route::CLOUD && cloud_speaking &&
+                                 routes.back() == CommandRouter::Route::FORWARD && !router.speaking());
+        report("router.long_cloud_ms", cloud_samples * 1000.0 / CommandRouter::kSampleRate);
+    }
+
+    // 停止：回复播放中说“停止”，排队的语音被丢弃
+    {
+        std::atomic<bool> replying{true};
+        std::thread reply([&] {
+            ToneSource tone{500, CommandRouter::kSampleRate, 8000};
+            while (replying) playback.write(tone.next(chunk).data(), chunk, 50);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        out_peak = 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        const int before = out_peak;
+        say(2, 8004);   // 停止
+        const bool stopped = single(CommandRouter::Route::LOCAL) && router.lastMatch().command == 2;
+        replying = false;       // 对话会话收到 LOCAL 后停止生成回复
+        reply.join();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        out_peak = 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        report("router.stop_peak_before", before);
+        report("router.stop_peak_after", out_peak.load());
+        check("router.stop", stopped && before > 300 && out_peak < 50);
+    }
+
+    // 网络状态：没有联网、合成语音缓存没有打开，以提示音播报“正在连接网络”
+    say(3, 8005);
+    check("router.network", single(CommandRouter::Route::LOCAL) && router.lastMatch().command == 3);
+    out_peak = 0;
+    feed(std::vector<int16_t>(CommandRouter::kSampleRate * 6 / 10), true);
+    report("router.network_peak", out_peak.load());
+    check("router.network_prompt", out_peak > 1000);
+    for (const char* route : {"local", "cloud"}) {
+        const std::string labels = std::string("route=\"") + route + "\"";
+        const auto* m = findMetric("chunfeng_kws_utterances_total", labels.c_str());
+        report((std::string("router.utterances.") + route).c_str(), m ? static_cast<const metrics::Counter*>(m)->value() : 0);
+    }
+
+    // 经配网页面录入：删除全部模板后逐条 POST /commands，模板文件随之保存，重新读入后仍能识别
+    host_sim::httpdSetPortOverride(0);
+    host_sim::wifiSetAccessPoints({{kHomeSsid, kHomePassword, -48, 6, 80, 40}});
+    provisionHomeNetwork();
+    startNetworkManager();
+    int64_t t0 = esp_timer_get_time();
+    while (host_sim::httpdBoundPort() == 0 && elapsedMs(t0) < 10000) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    const uint16_t port = host_sim::httpdBoundPort();
+    std::string body;
+    check("http.clear", httpRequest(port, "DELETE", "/commands", "", body) == 200 &&
+                            body.find("\"templates\":0") != std::string::npos && router.templates() == 0);
+    check("http.unknown", httpRequest(port, "POST", "/commands?command=louder", std::string(3200, '\0'), body) == 400);
+    check("http.silence", httpRequest(port, "POST", "/commands?command=stop", std::string(3200, '\0'), body) == 400);
+    static const char* const kNames[] = {"volume_up", "volume_down", "stop", "network_status"};
+    int64_t enroll_start = esp_timer_get_time();
+    for (size_t c = 0; c < fixtures::kCommandPhrases; ++c) {
+        for (int take = 0; take < kEnrollTakes; ++take) {
+            fixtures::UtteranceSpec spec;
+            spec.seed = 100 + take;
+            std::vector<int16_t> pcm = cutUtterance(fixtures::makeUtterance(c, fixtures::makeTalker(0), spec));
+            const std::string path = std::string("/commands?command=") + kNames[c];
+            const std::string payload(reinterpret_cast<const char*>(pcm.data()), pcm.size() * sizeof(int16_t));
+            check("http.enroll", httpRequest(port, "POST", path.c_str(), payload, body) == 200);
+        }
+    }
+    report("http.enroll_ms", elapsedMs(enroll_start) / (fixtures::kCommandPhrases * kEnrollTakes));
+    const std::string expect = "\"templates\":" + std::to_string(fixtures::kCommandPhrases * kEnrollTakes);
+    check("http.list", httpRequest(port, "GET", "/commands", "", body) == 200 && body.find(expect) != std::string::npos);
+    check("http.reload", router.start(kTemplates) == ESP_OK &&
+                             router.templates() == fixtures::kCommandPhrases * kEnrollTakes);
+    say(0, 8101);   // 大声点
+    check("http.volume_up", single(CommandRouter::Route::LOCAL) && router.lastMatch().command == 0);
+    host_sim::i2sSetOutputHook(nullptr);
+    unlink(kTemplates);
+    report("errors", ok ? 0 : 1);
+}
+
+/* ---------- 入口 ---------- */
+
+struct Scenario {
+    const char* name;
+    ChildFn fn;
+    bool repeat;    ///< 按 iterations 重复
+    int boots;      ///< 每轮连续启动的次数，之间保留 NVS
+};
+
+const Scenario kScenarios[] = {
+    {"boot", bootChild, true, 1},
+    {"failover", failoverChild, true, 1},
+    {"lte", lteChild, false, 1},
+    {"wifi", wifiChild, false, 1},
+    {"wake", wakeChild, true, 2},
+    {"https", httpsChild, false, 1},
+    {"http", httpChild, false, 1},
+    {"bus", busChild, false, 1},
+    {"log", logChild, false, 1},
+    {"display", displayChild, false, 1},
+    {"lipsync", lipsyncChild, false, 1},
+    {"status", statusChild, false, 1},
+    {"settings", settingsChild, false, 1},
+    {"ota", otaChild, false, 1},
+    {"spool", spoolChild, false, 2},
+    {"cache", cacheChild, false, 2},
+    {"bootseq", bootseqChild, false, 2},
+    {"power", powerChild, false, 1},
+    {"enhance", enhanceChild, false, 1},
+    {"agc", agcChild, false, 1},
+    {"dsp", dspChild, false, 1},
+    {"mix", mixChild, false, 1},
+    {"kws", kwsChild, false, 1},
+};
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "用法: %s [-n 次数] [-r 请求数] [-v] [boot|failover|lte|wifi|wake|https|http|bus|log|display|lipsync|status|settings|ota|spool|cache|bootseq|power|enhance|agc|dsp|mix|kws ...]\n"
+            "  -n  boot/failover/wake 重复次数（默认 5）\n"
+            "  -r  每个 HTTP 用例的请求总数（默认 2000）\n"
+            "  -v  显示被测代码的日志输出\n",
+            argv0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) {
+            opt.iterations = atoi(argv[++i]);
+        } else if (arg == "-r" && i + 1 < argc) {
+            opt.requests = atoi(argv[++i]);
+        } else if (arg == "-v") {
+            opt.verbose = true;
+        } else if (arg == "-h" || arg == "--help") {
+            usage(argv[0]);
+            return 0;
+        } else {
+            opt.scenarios.push_back(arg);
+        }
+    }
+
+    bool all_ok = true;
+    for (const Scenario& s : kScenarios) {
+        if (!opt.scenarios.empty() &&
+            std::find(opt.scenarios.begin(), opt.scenarios.end(), s.name) == opt.scenarios.end()) {
+            continue;
+        }
+        std::map<std::string, std::vector<double>> results;
+        int runs = s.repeat ? opt.iterations : 1;
+        s_nvs_image = "/tmp/chunfeng_bench_nvs_" + std::to_string(getpid()) + ".bin";
+        s_spool_image = "/tmp/chunfeng_bench_spool_" + std::to_string(getpid()) + ".bin";
+        for (int i = 0; i < runs; ++i) {
+            unlink(s_nvs_image.c_str());
+            unlink(s_spool_image.c_str());
+            for (s_boot_index = 0; s_boot_index < s.boots; ++s_boot_index) {
+                if (!runChild(s.fn, opt, results)) {
+                    fprintf(stderr, "[%s] 第 %d 次运行异常退出\n", s.name, i + 1);
+                    all_ok = false;
+                }
+            }
+        }
+        unlink(s_nvs_image.c_str());
+        unlink(s_spool_image.c_str());
+        printResults(s.name, results);
+        for (const auto& kv : results) {
+            if (!failed(kv.first, kv.second)) continue;
+            fprintf(stderr, "[%s] 检查未通过: %s\n", s.name, kv.first.c_str());
+            all_ok = false;
+        }
+    }
+    return all_ok ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-17 09:06:21
+ * @LastEditTime: 2025-06-17 17:20:48
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：driver/i2s_std.h（只有 TX 方向，DMA 描述符按采样率折算播放时间）
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\driver\i2s_std.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "driver/gpio.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef struct i2s_channel_obj_t* i2s_chan_handle_t;
+
+typedef enum {
+    I2S_NUM_0 = 0,
+    I2S_NUM_1 = 1,
+    I2S_NUM_AUTO,
+} i2s_port_t;
+
+typedef enum {
+    I2S_ROLE_MASTER,
+    I2S_ROLE_SLAVE,
+} i2s_role_t;
+
+typedef enum {
+    I2S_DATA_BIT_WIDTH_8BIT = 8,
+    I2S_DATA_BIT_WIDTH_16BIT = 16,
+    I2S_DATA_BIT_WIDTH_24BIT = 24,
+    I2S_DATA_BIT_WIDTH_32BIT = 32,
+} i2s_data_bit_width_t;
+
+typedef enum {
+    I2S_SLOT_MODE_MONO = 1,
+    I2S_SLOT_MODE_STEREO = 2,
+} i2s_slot_mode_t;
+
+typedef enum {
+    I2S_STD_SLOT_LEFT = 1,
+    I2S_STD_SLOT_RIGHT = 2,
+    I2S_STD_SLOT_BOTH = 3,
+} i2s_std_slot_mask_t;
+
+typedef struct {
+    i2s_port_t id;
+    i2s_role_t role;
+    uint32_t dma_desc_num;
+    uint32_t dma_frame_num;
+    bool auto_clear;
+    int intr_priority;
+} i2s_chan_config_t;
+
+typedef struct {
+    uint32_t sample_rate_hz;
+    int clk_src;
+    int mclk_multiple;
+} i2s_std_clk_config_t;
+
+typedef struct {
+    i2s_data_bit_width_t data_bit_width;
+    int slot_bit_width;
+    i2s_slot_mode_t slot_mode;
+    i2s_std_slot_mask_t slot_mask;
+    uint32_t ws_width;
+    bool ws_pol;
+    bool bit_shift;
+} i2s_std_slot_config_t;
+
+typedef struct {
+    gpio_num_t mclk;
+    gpio_num_t bclk;
+    gpio_num_t ws;
+    gpio_num_t dout;
+    gpio_num_t din;
+    struct {
+        uint32_t mclk_inv : 1;
+        uint32_t bclk_inv : 1;
+        uint32_t ws_inv : 1;
+    } invert_flags;
+} i2s_std_gpio_config_t;
+
+typedef struct {
+    i2s_std_clk_config_t clk_cfg;
+    i2s_std_slot_config_t slot_cfg;
+    i2s_std_gpio_config_t gpio_cfg;
+} i2s_std_config_t;
+
+#define I2S_GPIO_UNUSED GPIO_NUM_NC
+
+#define I2S_CHANNEL_DEFAULT_CONFIG(i2s_num, i2s_role) \
+    { i2s_num, i2s_role, 6, 240, false, 0 }
+
+#define I2S_STD_CLK_DEFAULT_CONFIG(rate) \
+    { rate, 0, 256 }
+
+#define I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(bits_per_sample, mono_or_stereo)                     \
+    { bits_per_sample, 0, mono_or_stereo,                                                        \
+      (mono_or_stereo) == I2S_SLOT_MODE_MONO ? I2S_STD_SLOT_LEFT : I2S_STD_SLOT_BOTH, bits_per_sample, \
+      false, true }
+
+esp_err_t i2s_new_channel(const i2s_chan_config_t* chan_cfg, i2s_chan_handle_t* ret_tx_handle,
+                          i2s_chan_handle_t* ret_rx_handle);
+esp_err_t i2s_del_channel(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle, const i2s_std_config_t* std_cfg);
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle);
+/** DMA 描述符全部排满时阻塞，直到最早的一块播放完 */
+esp_err_t i2s_channel_write(i2s_chan_handle_t handle, const void* src, size_t size, size_t* bytes_written,
+                            uint32_t timeout_ms);
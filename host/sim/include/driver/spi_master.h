@@ -0,0 +1,37 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-16 09:12:40
+ * @LastEditTime: 2025-06-16 16:31:08
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：driver/spi_master.h（只有总线初始化，传输由 esp_lcd 替身模拟）
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\driver\spi_master.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include "esp_err.h"
+
+typedef enum {
+    SPI1_HOST = 0,
+    SPI2_HOST = 1,
+    SPI3_HOST = 2,
+} spi_host_device_t;
+
+typedef enum {
+    SPI_DMA_DISABLED = 0,
+    SPI_DMA_CH_AUTO = 3,
+} spi_dma_chan_t;
+
+typedef struct {
+    int mosi_io_num;
+    int miso_io_num;
+    int sclk_io_num;
+    int quadwp_io_num;
+    int quadhd_io_num;
+    int max_transfer_sz;
+    unsigned int flags;
+    int intr_flags;
+} spi_bus_config_t;
+
+esp_err_t spi_bus_initialize(spi_host_device_t host_id, const spi_bus_config_t* bus_config, spi_dma_chan_t dma_chan);
+esp_err_t spi_bus_free(spi_host_device_t host_id);
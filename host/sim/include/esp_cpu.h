@@ -0,0 +1,14 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 09:14:26
+ * @LastEditTime: 2025-06-09 17:48:26
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：esp_cpu.h，周期计数器以纳秒模拟（1000 ticks/us）
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\esp_cpu.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstdint>
+
+uint32_t esp_cpu_get_cycle_count(void);
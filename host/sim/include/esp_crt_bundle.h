@@ -0,0 +1,14 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-12 09:33:02
+ * @LastEditTime: 2025-06-12 09:33:02
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：esp_crt_bundle.h（主机上不校验证书，本地测试服务器使用自签名证书）
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\esp_crt_bundle.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include "esp_err.h"
+
+esp_err_t esp_crt_bundle_attach(void* conf);
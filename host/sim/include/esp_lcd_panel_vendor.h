@@ -0,0 +1,27 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-16 09:12:40
+ * @LastEditTime: 2025-06-16 16:31:08
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：esp_lcd_panel_vendor.h（ST7789）
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\esp_lcd_panel_vendor.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstdint>
+#include "esp_err.h"
+#include "esp_lcd_types.h"
+
+typedef struct {
+    int reset_gpio_num;
+    lcd_rgb_element_order_t rgb_ele_order;
+    uint32_t bits_per_pixel;
+    struct {
+        unsigned int reset_active_high : 1;
+    } flags;
+    void* vendor_config;
+} esp_lcd_panel_dev_config_t;
+
+esp_err_t esp_lcd_new_panel_st7789(const esp_lcd_panel_io_handle_t io, const esp_lcd_panel_dev_config_t* panel_dev_config,
+                                   esp_lcd_panel_handle_t* ret_panel);
@@ -0,0 +1,21 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-16 09:12:40
+ * @LastEditTime: 2025-06-16 16:31:08
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：esp_lcd_types.h
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\esp_lcd_types.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstdint>
+
+typedef struct esp_lcd_panel_io_t* esp_lcd_panel_io_handle_t;
+typedef struct esp_lcd_panel_t* esp_lcd_panel_handle_t;
+typedef int esp_lcd_spi_bus_handle_t;
+
+typedef enum {
+    LCD_RGB_ELEMENT_ORDER_RGB,
+    LCD_RGB_ELEMENT_ORDER_BGR,
+} lcd_rgb_element_order_t;
@@ -0,0 +1,24 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 09:49:31
+ * @LastEditTime: 2025-06-09 17:48:26
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：esp_log.h，直接输出到 stdout
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\esp_log.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+uint32_t esp_log_timestamp(void);
+
+#define ESP_LOG_SIM_(letter, tag, fmt, ...) \
+    printf(letter " (%u) %s: " fmt "\n", static_cast<unsigned>(esp_log_timestamp()), tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, fmt, ...) ESP_LOG_SIM_("E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) ESP_LOG_SIM_("W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) ESP_LOG_SIM_("I", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) do {} while (0)
+#define ESP_LOGV(tag, fmt, ...) do {} while (0)
@@ -0,0 +1,48 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-20 09:20:14
+ * @LastEditTime: 2025-06-20 09:20:14
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：esp_ota_ops.h，只包含 A/B 槽位切换与回滚相关的接口，
+ *               启动选择按开启 CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE 的二级引导程序模拟（见 host_sim::otaReboot）
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\esp_ota_ops.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#define ESP_ERR_OTA_BASE                    0x1500
+#define ESP_ERR_OTA_PARTITION_CONFLICT      (ESP_ERR_OTA_BASE + 0x01)
+#define ESP_ERR_OTA_SELECT_INFO_INVALID     (ESP_ERR_OTA_BASE + 0x02)
+#define ESP_ERR_OTA_VALIDATE_FAILED         (ESP_ERR_OTA_BASE + 0x03)
+#define ESP_ERR_OTA_ROLLBACK_FAILED         (ESP_ERR_OTA_BASE + 0x05)
+#define ESP_ERR_OTA_ROLLBACK_INVALID_STATE  (ESP_ERR_OTA_BASE + 0x06)
+
+typedef enum {
+    ESP_OTA_IMG_NEW = 0x0U,
+    ESP_OTA_IMG_PENDING_VERIFY = 0x1U,
+    ESP_OTA_IMG_VALID = 0x2U,
+    ESP_OTA_IMG_INVALID = 0x3U,
+    ESP_OTA_IMG_ABORTED = 0x4U,
+    ESP_OTA_IMG_UNDEFINED = 0xFFFFFFFFU,
+} esp_ota_img_states_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const esp_partition_t* esp_ota_get_running_partition(void);
+const esp_partition_t* esp_ota_get_boot_partition(void);
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from);
+/** 与真实实现一样先校验镜像（替身只检查镜像头的 0xE9） */
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition);
+esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition, esp_ota_img_states_t* ota_state);
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void);
+/** 替身不会真的重启：标记无效后按引导程序规则切换运行分区并返回 */
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,33 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-25 09:12:06
+ * @LastEditTime: 2025-06-25 10:41:37
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：esp_pm.h（动态调频与自动 light sleep 的配置与电源锁），锁的持有情况由 host_sim 查询
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\esp_pm.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include "esp_err.h"
+
+typedef struct {
+    int max_freq_mhz;
+    int min_freq_mhz;
+    bool light_sleep_enable;
+} esp_pm_config_t;
+
+typedef enum {
+    ESP_PM_CPU_FREQ_MAX,
+    ESP_PM_APB_FREQ_MAX,
+    ESP_PM_NO_LIGHT_SLEEP,
+} esp_pm_lock_type_t;
+
+typedef struct esp_pm_lock* esp_pm_lock_handle_t;
+
+esp_err_t esp_pm_configure(const void* config);
+esp_err_t esp_pm_get_configuration(void* config);
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char* name, esp_pm_lock_handle_t* out_handle);
+esp_err_t esp_pm_lock_delete(esp_pm_lock_handle_t handle);
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle);
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle);
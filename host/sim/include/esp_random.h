@@ -0,0 +1,14 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-11 09:12:40
+ * @LastEditTime: 2025-06-11 09:12:40
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：esp_random.h
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\esp_random.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstdint>
+
+uint32_t esp_random(void);
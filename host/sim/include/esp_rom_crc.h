@@ -0,0 +1,14 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-21 09:12:40
+ * @LastEditTime: 2025-06-21 09:12:40
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：esp_rom_crc.h，与 ROM 中的实现一样，crc 传入上一段的结果即可分段计算
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\esp_rom_crc.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstdint>
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const* buf, uint32_t len);
@@ -0,0 +1,15 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 09:03:57
+ * @LastEditTime: 2025-06-09 17:48:26
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：esp_rom_sys.h
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\esp_rom_sys.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstdint>
+
+uint32_t esp_rom_get_cpu_ticks_per_us(void);
+void esp_rom_delay_us(uint32_t us);
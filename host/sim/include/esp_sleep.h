@@ -0,0 +1,15 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-25 09:12:06
+ * @LastEditTime: 2025-06-25 10:41:37
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：esp_sleep.h，只包含工程代码用到的唤醒源
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\esp_sleep.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include "esp_err.h"
+
+esp_err_t esp_sleep_enable_wifi_wakeup(void);
+esp_err_t esp_sleep_enable_gpio_wakeup(void);
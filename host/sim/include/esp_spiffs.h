@@ -0,0 +1,24 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-10 09:58:21
+ * @LastEditTime: 2025-06-10 10:12:45
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：esp_spiffs.h，挂载只做记录，文件直接落在主机文件系统
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\esp_spiffs.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include "esp_err.h"
+
+typedef struct {
+    const char* base_path;
+    const char* partition_label;
+    size_t max_files;
+    bool format_if_mount_failed;
+} esp_vfs_spiffs_conf_t;
+
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t* conf);
+esp_err_t esp_vfs_spiffs_unregister(const char* partition_label);
+esp_err_t esp_spiffs_info(const char* partition_label, size_t* total_bytes, size_t* used_bytes);
@@ -0,0 +1,39 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 09:10:10
+ * @LastEditTime: 2025-06-10 10:12:45
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：esp_timer.h，基于 steady_clock，回调在单独的定时器线程中串行执行
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\esp_timer.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstdint>
+#include "esp_err.h"
+
+typedef struct esp_timer* esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void* arg);
+
+typedef enum {
+    ESP_TIMER_TASK,
+    ESP_TIMER_ISR,
+} esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void* arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char* name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+/** 自进程启动以来的微秒数 */
+int64_t esp_timer_get_time(void);
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+bool esp_timer_is_active(esp_timer_handle_t timer);
@@ -0,0 +1,57 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-12 09:31:18
+ * @LastEditTime: 2025-06-12 16:05:44
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：esp_tls.h，用 OpenSSL 实现（TLS 1.2，与固件 mbedTLS 配置一致）
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\esp_tls.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#define ESP_ERR_ESP_TLS_BASE                    0x8000
+#define ESP_ERR_ESP_TLS_CANNOT_RESOLVE_HOSTNAME (ESP_ERR_ESP_TLS_BASE + 0x01)
+#define ESP_ERR_ESP_TLS_CANNOT_CREATE_SOCKET    (ESP_ERR_ESP_TLS_BASE + 0x02)
+#define ESP_ERR_ESP_TLS_FAILED_CONNECT_TO_HOST  (ESP_ERR_ESP_TLS_BASE + 0x04)
+#define ESP_ERR_ESP_TLS_CONNECTION_TIMEOUT      (ESP_ERR_ESP_TLS_BASE + 0x06)
+
+#define ESP_TLS_ERR_SSL_WANT_READ   -0x6900
+#define ESP_TLS_ERR_SSL_WANT_WRITE  -0x6880
+#define ESP_TLS_ERR_SSL_TIMEOUT     -0x6800
+
+typedef struct esp_tls esp_tls_t;
+typedef struct esp_tls_client_session esp_tls_client_session_t;
+
+typedef struct esp_tls_cfg {
+    const char** alpn_protos;
+    const unsigned char* cacert_buf;
+    unsigned int cacert_bytes;
+    bool non_block;
+    int timeout_ms;
+    bool use_global_ca_store;
+    const char* common_name;
+    bool skip_common_name;
+    esp_err_t (*crt_bundle_attach)(void* conf);
+    bool is_plain_tcp;
+    esp_tls_client_session_t* client_session;
+} esp_tls_cfg_t;
+
+esp_tls_t* esp_tls_init(void);
+/** @return 1 成功，-1 失败 */
+int esp_tls_conn_new_sync(const char* hostname, int hostlen, int port, const esp_tls_cfg_t* cfg, esp_tls_t* tls);
+ssize_t esp_tls_conn_write(esp_tls_t* tls, const void* data, size_t datalen);
+/** @return >0 读到的字节数，0 对端关闭，<0 错误（ESP_TLS_ERR_SSL_*） */
+ssize_t esp_tls_conn_read(esp_tls_t* tls, void* data, size_t datalen);
+int esp_tls_conn_destroy(esp_tls_t* tls);
+ssize_t esp_tls_get_bytes_avail(esp_tls_t* tls);
+esp_err_t esp_tls_get_conn_sockfd(esp_tls_t* tls, int* sockfd);
+/** 返回 mbedtls_ssl_context*（替身中为 mbedtls/ssl.h 的同名不透明类型） */
+void* esp_tls_get_ssl_context(esp_tls_t* tls);
+esp_tls_client_session_t* esp_tls_get_client_session(esp_tls_t* tls);
+void esp_tls_free_client_session(esp_tls_client_session_t* client_session);
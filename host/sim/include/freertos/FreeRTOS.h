@@ -0,0 +1,55 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 09:24:36
+ * @LastEditTime: 2025-06-09 17:48:26
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：FreeRTOS.h，任务映射为 std::thread，1 tick = 1 ms
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\freertos\FreeRTOS.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t StackType_t;
+
+#define configTICK_RATE_HZ      1000
+#define portTICK_PERIOD_MS      1
+#define portMAX_DELAY           ((TickType_t)0xffffffffUL)
+#define portNUM_PROCESSORS      2
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms))
+#define pdTICKS_TO_MS(ticks)    ((uint32_t)(ticks))
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+#define tskNO_AFFINITY          ((BaseType_t)0x7fffffff)
+#define configMAX_PRIORITIES    25
+
+/** 临界区：主机上用自旋锁模拟 */
+typedef struct {
+    std::atomic_flag flag = ATOMIC_FLAG_INIT;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {}
+
+void vPortEnterCritical(portMUX_TYPE* mux);
+void vPortExitCritical(portMUX_TYPE* mux);
+
+#define portENTER_CRITICAL(mux)         vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)          vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux)     vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux)      vPortExitCritical(mux)
+#define portYIELD_FROM_ISR(...)         do {} while (0)
+/** 屏蔽本核中断（设备上同时禁止了任务切换与迁移）；主机上线程随时可能换核，不做模拟 */
+#define portSET_INTERRUPT_MASK_FROM_ISR()       ((UBaseType_t)0)
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR(s)    ((void)(s))
+
+BaseType_t xPortGetCoreID(void);
+
+#include "freertos/task.h"
@@ -0,0 +1,23 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 09:31:49
+ * @LastEditTime: 2025-06-09 17:48:26
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：freertos/event_groups.h
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\freertos\event_groups.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct SimEventGroup* EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+EventGroupHandle_t xEventGroupCreate(void);
+void vEventGroupDelete(EventGroupHandle_t group);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks);
@@ -0,0 +1,21 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-13 09:40:12
+ * @LastEditTime: 2025-06-13 09:40:12
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：freertos/idf_additions.h（指定栈内存类型创建任务）
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\freertos\idf_additions.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/** 主机上没有内存类型之分，等同于 xTaskCreatePinnedToCore */
+static inline BaseType_t xTaskCreatePinnedToCoreWithCaps(TaskFunction_t fn, const char* name, uint32_t stack_depth,
+                                                         void* arg, UBaseType_t priority, TaskHandle_t* created,
+                                                         BaseType_t core_id, UBaseType_t caps) {
+    (void)caps;
+    return xTaskCreatePinnedToCore(fn, name, stack_depth, arg, priority, created, core_id);
+}
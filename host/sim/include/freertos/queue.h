@@ -0,0 +1,21 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 09:38:02
+ * @LastEditTime: 2025-06-09 17:48:26
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：freertos/queue.h
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\freertos\queue.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct SimQueue* QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks);
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* higher_woken);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
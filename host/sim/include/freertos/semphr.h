@@ -0,0 +1,22 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 09:45:15
+ * @LastEditTime: 2025-06-09 17:48:26
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：freertos/semphr.h（互斥量与计数信号量）
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\freertos\semphr.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct SimSemaphore* SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t* higher_woken);
@@ -0,0 +1,146 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 09:59:41
+ * @LastEditTime: 2025-06-25 10:41:37
+ * @LastEditors: 星年
+ * @Description: 主机构建替身的控制接口：脚本化 AP 列表、连接结果、TLS 链路、4G 附着、LCD 显存、I2S 输出时间、Flash 分区与 OTA 启动、电源管理，以及测试辅助
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\host_sim.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace host_sim {
+
+/**
+ * @brief 模拟的 AP
+ *
+ * 在列表中即视为在覆盖范围内：扫描可见、可连接。
+ * 密码不一致时连接以 WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT 失败。
+ */
+struct AccessPoint {
+    std::string ssid;
+    std::string password;
+    int8_t rssi{-50};
+    uint8_t channel{1};
+    uint32_t assoc_ms{80};     ///< esp_wifi_connect() 到 WIFI_EVENT_STA_CONNECTED 的耗时
+    uint32_t dhcp_ms{40};      ///< STA_CONNECTED 到 IP_EVENT_STA_GOT_IP 的耗时
+};
+
+/* ---------- WiFi ---------- */
+
+/** 替换当前覆盖范围内的 AP；已连接的 AP 被移除时上报 BEACON_TIMEOUT 断开 */
+void wifiSetAccessPoints(const std::vector<AccessPoint>& aps);
+/** 阻塞扫描耗时（默认 1200ms，与 S3 全信道主动扫描相当） */
+void wifiSetScanDuration(uint32_t ms);
+/** 找不到目标 AP 时，esp_wifi_connect() 到 NO_AP_FOUND 断开事件的耗时（默认 1500ms） */
+void wifiSetNoApTimeout(uint32_t ms);
+/** 模拟链路丢失，上报 WIFI_EVENT_STA_DISCONNECTED */
+void wifiDropConnection(uint8_t reason = 200);
+/** esp_wifi_connect() 被调用的次数 */
+uint32_t wifiConnectCount();
+/** 当前是否已获取 IP */
+bool wifiHasIp();
+
+/* ---------- NVS ---------- */
+
+/** 清空内存中的 NVS 内容 */
+void nvsReset();
+/** 把 NVS 内容写到文件，配合 nvsLoad() 模拟重启后 NVS 保留 */
+bool nvsSave(const std::string& path);
+/** 用文件内容替换内存中的 NVS 内容 */
+bool nvsLoad(const std::string& path);
+
+/* ---------- Flash 分区与 OTA ---------- */
+
+struct FlashStats {
+    uint64_t bytes_read{0};
+    uint64_t bytes_written{0};
+    uint32_t sectors_erased{0};
+    uint32_t dirty_writes{0};   ///< 写入了未擦除位置的 esp_partition_write() 次数，正常流程应为 0
+};
+
+/** 模拟串口烧录：分区整体擦除后把 data 写到开头 */
+bool flashProgram(const std::string& label, const std::vector<uint8_t>& data);
+/** 读取分区开头 size 字节 */
+std::vector<uint8_t> flashRead(const std::string& label, size_t size);
+/** 分区内容保存在主机文件中：文件大小与分区一致时载入，否则初始化为擦除状态；之后每次擦写同步到文件 */
+bool flashAttachFile(const std::string& label, const std::string& path);
+/** 模拟掉电：再写入 bytes 字节后，进行中的写入只完成一部分，之后的擦写全部返回 ESP_FAIL */
+void flashCutPowerAfter(uint64_t bytes);
+/** 重新上电，取消 flashCutPowerAfter() */
+void flashPowerOn();
+/** 分区内每个扇区被擦除的次数 */
+std::vector<uint32_t> flashEraseCounts(const std::string& label);
+FlashStats flashStats();
+/** 模拟重启：按 otadata 与回滚规则选择应用分区（上次启动后未确认的新固件被中止），返回其标签 */
+std::string otaReboot();
+
+/* ---------- HTTP 服务器 ---------- */
+
+/** 覆盖 httpd_start() 使用的端口（0 表示由系统分配），在 httpd_start() 前调用 */
+void httpdSetPortOverride(uint16_t port);
+/** 最近一次 httpd_start() 实际监听的端口，未启动时为 0 */
+uint16_t httpdBoundPort();
+
+/* ---------- TLS ---------- */
+
+/**
+ * @brief esp_tls 建连时叠加的模拟耗时（默认全为 0，只有真实的本机握手开销）
+ * @param rtt_ms 到服务器的往返时间：TCP 建连 1 个往返，完整握手 2 个，恢复会话 1 个
+ * @param full_handshake_ms 完整握手的计算耗时（证书校验、ECDHE）
+ * @param resumed_handshake_ms 会话恢复的计算耗时
+ */
+void tlsSetLinkProfile(uint32_t rtt_ms, uint32_t full_handshake_ms, uint32_t resumed_handshake_ms);
+/** 已完成的握手次数 */
+uint32_t tlsHandshakeCount(bool resumed);
+
+/* ---------- 4G 模组 ---------- */
+
+/** WaitForNetworkReady() 的耗时与结果 */
+void lteSetBehaviour(uint32_t attach_ms, bool success);
+
+/* ---------- LCD ---------- */
+
+/** SPI 总线上发送的字节数（窗口命令与颜色数据） */
+uint64_t lcdBytesTransferred();
+/** esp_lcd_panel_draw_bitmap() 调用次数 */
+uint32_t lcdDrawCount();
+/** 把模拟显存左上角 width x height 的内容写成 PPM 图片 */
+bool lcdWritePpm(const std::string& path, int width, int height);
+/** 读取模拟显存中的一个像素（RGB565） */
+uint16_t lcdPixel(int x, int y);
+/**
+ * @brief 每块颜色数据写入显存后调用（在替身的传输线程中）
+ * @param x0,y0,x1,y1 写入的窗口，右下角不含
+ * @param time_us 写入完成时间（esp_timer_get_time）
+ */
+void lcdSetUpdateHook(std::function<void(int x0, int y0, int x1, int y1, int64_t time_us)> hook);
+
+/* ---------- I2S ---------- */
+
+/**
+ * @brief 每次 i2s_channel_write() 接收数据后调用（在写入方任务中）
+ * @param start_us 这批样本中第一个从 DAC 输出的时间（esp_timer_get_time）
+ */
+void i2sSetOutputHook(std::function<void(const int16_t* pcm, size_t samples, int64_t start_us)> hook);
+/** 播放数据没跟上、DMA 输出静音的次数 */
+uint32_t i2sUnderruns();
+
+/* ---------- 电源管理 ---------- */
+
+constexpr uint32_t kWakeWifi = 1 << 0;
+constexpr uint32_t kWakeGpio = 1 << 1;
+
+/** 已开启自动 light sleep 且没有任务持有 ESP_PM_NO_LIGHT_SLEEP 锁 */
+bool pmLightSleepAllowed();
+/** 按 esp_pm_configure() 的配置与 ESP_PM_CPU_FREQ_MAX 锁推算的 CPU 频率 */
+int pmCpuFreqMhz();
+/** 已开启的唤醒源（kWake* 的按位或） */
+uint32_t pmWakeSources();
+
+} // namespace host_sim
@@ -0,0 +1,30 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-20 09:20:14
+ * @LastEditTime: 2025-06-20 09:20:14
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：mbedtls/sha256.h（mbedTLS 3.x 接口），由 OpenSSL 实现
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\mbedtls\sha256.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <stddef.h>
+
+typedef struct mbedtls_sha256_context {
+    void* evp;
+} mbedtls_sha256_context;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx);
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx);
+int mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int is224);
+int mbedtls_sha256_update(mbedtls_sha256_context* ctx, const unsigned char* input, size_t ilen);
+int mbedtls_sha256_finish(mbedtls_sha256_context* ctx, unsigned char output[32]);
+
+#ifdef __cplusplus
+}
+#endif
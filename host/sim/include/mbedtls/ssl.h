@@ -0,0 +1,21 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-12 10:12:37
+ * @LastEditTime: 2025-06-12 10:12:37
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：mbedtls/ssl.h，只包含工程代码用到的会话接口，由 OpenSSL 实现
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\mbedtls\ssl.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#define MBEDTLS_PRIVATE(member) private_##member
+
+typedef struct mbedtls_ssl_context mbedtls_ssl_context;
+
+typedef struct mbedtls_ssl_session {
+    unsigned char MBEDTLS_PRIVATE(master)[48];
+} mbedtls_ssl_session;
+
+/** 替身：返回调用线程私有的快照，下次调用前有效 */
+const mbedtls_ssl_session* mbedtls_ssl_get_session_pointer(const mbedtls_ssl_context* ssl);
@@ -0,0 +1,38 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 09:06:54
+ * @LastEditTime: 2025-06-24 15:02:18
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：ML307 4G 模组（78/esp-ml307），附着耗时与结果由 host_sim 脚本化
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\ml307_at_modem.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+class Ml307AtModem {
+public:
+    Ml307AtModem(gpio_num_t tx_pin, gpio_num_t rx_pin, size_t rx_buffer_size = 2048);
+    ~Ml307AtModem();
+
+    void SetDebug(bool debug);
+    bool SetBaudRate(int new_baud_rate, int timeout_ms = -1);
+    int WaitForNetworkReady();
+
+    std::string ip_address() const;
+    std::string GetImei();
+    std::string GetIccid();
+    std::string GetModuleName();
+    std::string GetCarrierName();
+    int GetCsq();
+
+private:
+    bool ready_{false};
+    std::vector<uint8_t> driver_memory_;    ///< 与真实驱动相当的 UART 缓冲与事件任务栈，用于统计驻留内存
+};
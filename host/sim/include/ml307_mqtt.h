@@ -0,0 +1,12 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 10:20:20
+ * @LastEditTime: 2025-06-09 17:48:26
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：ml307_mqtt.h（工程代码当前只包含该头文件，未使用其中的类）
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\ml307_mqtt.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include "ml307_at_modem.h"
@@ -0,0 +1,16 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 10:41:59
+ * @LastEditTime: 2025-06-09 17:48:26
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：nvs_flash.h
+ * @FilePath: \ESP32-ChunFeng\host\sim\include\nvs_flash.h
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include "nvs.h"
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_deinit(void);
+esp_err_t nvs_flash_erase(void);
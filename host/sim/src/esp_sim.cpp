@@ -0,0 +1,150 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 10:55:25
+ * @LastEditTime: 2025-06-21 09:12:40
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：esp_timer、周期计数器、随机数、堆内存统计、日志时间戳、错误码名、ROM CRC32
+ * @FilePath: \ESP32-ChunFeng\host\sim\src\esp_sim.cpp
+ * @遇事不决，可问春风
+ */
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "esp_rom_crc.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_spiffs.h"
+#include "esp_random.h"
+#include <malloc.h>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+namespace {
+
+const auto s_boot = std::chrono::steady_clock::now();
+
+// 模拟 S3 的内存规模：512KB 内部 RAM、8MB PSRAM，已用量按进程实际分配量计入内部 RAM
+constexpr size_t kInternalBytes = 512 * 1024;
+constexpr size_t kSpiramBytes = 8 * 1024 * 1024;
+
+size_t usedBytes() {
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks;
+}
+
+} // namespace
+
+int64_t esp_timer_get_time(void) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - s_boot).count();
+}
+
+uint32_t esp_cpu_get_cycle_count(void) {
+    return static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_boot).count());
+}
+
+uint32_t esp_random(void) {
+    static thread_local std::mt19937 rng(std::random_device{}());
+    return rng();
+}
+
+uint32_t esp_rom_get_cpu_ticks_per_us(void) {
+    return 1000;
+}
+
+void esp_rom_delay_us(uint32_t us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const* buf, uint32_t len) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; ++i) crc = table[(crc ^ buf[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t esp_log_timestamp(void) {
+    return static_cast<uint32_t>(esp_timer_get_time() / 1000);
+}
+
+void* heap_caps_malloc(size_t size, uint32_t) {
+    return malloc(size);
+}
+
+void* heap_caps_calloc(size_t n, size_t size, uint32_t) {
+    return calloc(n, size);
+}
+
+void* heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t) {
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+void heap_caps_free(void* ptr) {
+    free(ptr);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    if (caps & MALLOC_CAP_SPIRAM) return kSpiramBytes;
+    size_t used = usedBytes();
+    return used < kInternalBytes ? kInternalBytes - used : 0;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    return heap_caps_get_free_size(caps);
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return heap_caps_get_free_size(caps);
+}
+
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t* conf) {
+    return conf && conf->base_path ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_vfs_spiffs_unregister(const char*) {
+    return ESP_OK;
+}
+
+esp_err_t esp_spiffs_info(const char*, size_t* total_bytes, size_t* used_bytes) {
+    // 与 partitions.csv 中 storage 分区大小一致
+    *total_bytes = 0x200000;
+    *used_bytes = 0;
+    return ESP_OK;
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+        case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_INVALID_LENGTH: return "ESP_ERR_NVS_INVALID_LENGTH";
+        case ESP_ERR_WIFI_NOT_INIT: return "ESP_ERR_WIFI_NOT_INIT";
+        case ESP_ERR_WIFI_NOT_STARTED: return "ESP_ERR_WIFI_NOT_STARTED";
+        case ESP_ERR_WIFI_MODE: return "ESP_ERR_WIFI_MODE";
+        case ESP_ERR_WIFI_CONN: return "ESP_ERR_WIFI_CONN";
+        case ESP_ERR_WIFI_NOT_CONNECT: return "ESP_ERR_WIFI_NOT_CONNECT";
+        case ESP_ERR_HTTPD_HANDLERS_FULL: return "ESP_ERR_HTTPD_HANDLERS_FULL";
+        default: return "UNKNOWN ERROR";
+    }
+}
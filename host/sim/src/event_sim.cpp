@@ -0,0 +1,137 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 10:02:38
+ * @LastEditTime: 2025-06-09 17:48:26
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：默认事件循环，独立线程按投递顺序分发
+ * @FilePath: \ESP32-ChunFeng\host\sim\src\event_sim.cpp
+ * @遇事不决，可问春风
+ */
+#include "esp_event.h"
+#include <pthread.h>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Handler {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t fn;
+    void* arg;
+    bool removed;
+};
+
+struct Posted {
+    esp_event_base_t base;
+    int32_t id;
+    std::vector<uint8_t> data;
+};
+
+std::mutex s_mutex;
+std::condition_variable s_cv;
+std::deque<Posted> s_queue;
+std::vector<Handler*> s_handlers;
+bool s_created = false;
+
+bool matches(const Handler* h, esp_event_base_t base, int32_t id) {
+    if (h->removed) return false;
+    if (h->base != ESP_EVENT_ANY_BASE && h->base != base) return false;
+    return h->id == ESP_EVENT_ANY_ID || h->id == id;
+}
+
+void loopTask() {
+    pthread_setname_np(pthread_self(), "sys_evt");
+    while (true) {
+        Posted ev;
+        std::vector<Handler> targets;
+        {
+            std::unique_lock<std::mutex> lock(s_mutex);
+            s_cv.wait(lock, [] { return !s_queue.empty(); });
+            ev = std::move(s_queue.front());
+            s_queue.pop_front();
+            for (Handler* h : s_handlers) {
+                if (matches(h, ev.base, ev.id)) targets.push_back(*h);
+            }
+        }
+        // 回调在锁外执行，允许回调中再投递事件或注册处理函数
+        for (const Handler& h : targets) {
+            h.fn(h.arg, ev.base, ev.id, ev.data.empty() ? nullptr : ev.data.data());
+        }
+    }
+}
+
+esp_err_t addHandler(esp_event_base_t base, int32_t id, esp_event_handler_t fn, void* arg, Handler** out) {
+    if (!fn) return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto* h = new Handler{base, id, fn, arg, false};
+    s_handlers.push_back(h);
+    if (out) *out = h;
+    return ESP_OK;
+}
+
+} // namespace
+
+esp_err_t esp_event_loop_create_default(void) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (s_created) return ESP_ERR_INVALID_STATE;
+    s_created = true;
+    std::thread(loopTask).detach();
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_delete_default(void) {
+    // 分发线程常驻，删除仅清空处理函数
+    std::lock_guard<std::mutex> lock(s_mutex);
+    for (Handler* h : s_handlers) h->removed = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler, void* arg) {
+    return addHandler(base, id, handler, arg, nullptr);
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t base, int32_t id, esp_event_handler_t handler) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    for (Handler* h : s_handlers) {
+        if (!h->removed && h->base == base && h->id == id && h->fn == handler) {
+            h->removed = true;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler,
+                                              void* arg, esp_event_handler_instance_t* instance) {
+    Handler* h = nullptr;
+    esp_err_t err = addHandler(base, id, handler, arg, &h);
+    if (err == ESP_OK && instance) *instance = h;
+    return err;
+}
+
+esp_err_t esp_event_handler_instance_unregister(esp_event_base_t, int32_t, esp_event_handler_instance_t instance) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    for (Handler* h : s_handlers) {
+        if (h == instance && !h->removed) {
+            h->removed = true;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t esp_event_post(esp_event_base_t base, int32_t id, const void* data, size_t size, TickType_t) {
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        if (!s_created) return ESP_ERR_INVALID_STATE;
+        const auto* p = static_cast<const uint8_t*>(data);
+        s_queue.push_back(Posted{base, id, p ? std::vector<uint8_t>(p, p + size) : std::vector<uint8_t>()});
+    }
+    s_cv.notify_one();
+    return ESP_OK;
+}
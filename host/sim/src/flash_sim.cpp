@@ -0,0 +1,346 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-20 09:20:14
+ * @LastEditTime: 2025-06-21 09:40:17
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：内存中的 Flash 分区（NOR 擦写语义，可保存到主机文件、模拟掉电）、otadata 与带回滚的启动选择、SHA-256
+ * @FilePath: \ESP32-ChunFeng\host\sim\src\flash_sim.cpp
+ * @遇事不决，可问春风
+ */
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "mbedtls/sha256.h"
+#include "host_sim.hpp"
+#include <openssl/evp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// 与 partitions.csv 一致
+esp_partition_t s_partitions[] = {
+    {nullptr, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, 0x9000, 0x10000, SPI_FLASH_SEC_SIZE, "nvs", false,
+     false},
+    {nullptr, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_OTA, 0x19000, 0x2000, SPI_FLASH_SEC_SIZE, "otadata",
+     false, false},
+    {nullptr, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_PHY, 0x1B000, 0x1000, SPI_FLASH_SEC_SIZE, "phy_init",
+     false, false},
+    {nullptr, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x20000, 0x400000, SPI_FLASH_SEC_SIZE, "ota_0",
+     false, false},
+    {nullptr, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0x420000, 0x400000, SPI_FLASH_SEC_SIZE, "ota_1",
+     false, false},
+    {nullptr, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, 0x820000, 0x200000, SPI_FLASH_SEC_SIZE,
+     "storage", false, false},
+    {nullptr, ESP_PARTITION_TYPE_DATA, static_cast<esp_partition_subtype_t>(0x40), 0xA20000, 0x200000,
+     SPI_FLASH_SEC_SIZE, "spool", false, false},
+};
+constexpr size_t kPartitionCount = sizeof(s_partitions) / sizeof(s_partitions[0]);
+constexpr size_t kOta0 = 3;     ///< s_partitions 中 ota_0 的下标，ota_1 紧随其后
+
+struct OtaSlot {
+    uint32_t seq{0};            ///< 0 表示 otadata 中没有该槽位的记录
+    esp_ota_img_states_t state{ESP_OTA_IMG_UNDEFINED};
+};
+
+std::mutex s_mutex;
+std::vector<uint8_t> s_contents[kPartitionCount];   ///< 首次访问时分配，初始为擦除状态
+std::vector<uint32_t> s_erase_counts[kPartitionCount];
+struct BackingFile {
+    int fd{-1};
+};
+BackingFile s_files[kPartitionCount];   ///< flashAttachFile() 打开的文件，擦写时同步
+uint64_t s_power_budget = UINT64_MAX;   ///< 掉电前还能写入的字节数
+bool s_power_off = false;
+host_sim::FlashStats s_stats;
+OtaSlot s_slots[2];
+int s_running = 0;              ///< 正在运行的槽位
+int s_boot = -1;                ///< esp_ota_set_boot_partition 选择的槽位，-1 表示未选择
+
+int indexOf(const esp_partition_t* p) {
+    for (size_t i = 0; i < kPartitionCount; ++i) {
+        if (p == &s_partitions[i]) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+std::vector<uint8_t>& contentsLocked(int index) {
+    std::vector<uint8_t>& c = s_contents[index];
+    if (c.empty()) c.assign(s_partitions[index].size, 0xFF);
+    return c;
+}
+
+int indexOf(const std::string& label) {
+    for (size_t i = 0; i < kPartitionCount; ++i) {
+        if (label == s_partitions[i].label) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+void syncLocked(int index, size_t offset, size_t size) {
+    if (s_files[index].fd < 0) return;
+    ssize_t n = pwrite(s_files[index].fd, s_contents[index].data() + offset, size, static_cast<off_t>(offset));
+    (void)n;
+}
+
+int slotOf(const esp_partition_t* p) {
+    int index = indexOf(p);
+    if (index == static_cast<int>(kOta0)) return 0;
+    if (index == static_cast<int>(kOta0) + 1) return 1;
+    return -1;
+}
+
+// 二级引导程序：选 seq 最大、未被标记为无效或中止的槽位；上次启动后没有确认的新固件视为启动失败
+void bootLocked() {
+    while (true) {
+        int best = -1;
+        for (int i = 0; i < 2; ++i) {
+            const OtaSlot& s = s_slots[i];
+            if (s.seq == 0 || s.state == ESP_OTA_IMG_INVALID || s.state == ESP_OTA_IMG_ABORTED) continue;
+            if (best < 0 || s.seq > s_slots[best].seq) best = i;
+        }
+        if (best < 0) {
+            s_running = 0;      // otadata 为空：从第一个应用分区启动
+            break;
+        }
+        OtaSlot& slot = s_slots[best];
+        if (slot.state == ESP_OTA_IMG_PENDING_VERIFY) {
+            slot.state = ESP_OTA_IMG_ABORTED;
+            continue;
+        }
+        if (slot.state == ESP_OTA_IMG_NEW) slot.state = ESP_OTA_IMG_PENDING_VERIFY;
+        s_running = best;
+        break;
+    }
+    s_boot = -1;
+}
+
+} // namespace
+
+namespace host_sim {
+
+bool flashProgram(const std::string& label, const std::vector<uint8_t>& data) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    int index = indexOf(label);
+    if (index < 0 || data.size() > s_partitions[index].size) return false;
+    std::vector<uint8_t>& c = contentsLocked(index);
+    std::fill(c.begin(), c.end(), 0xFF);
+    std::copy(data.begin(), data.end(), c.begin());
+    syncLocked(index, 0, c.size());
+    return true;
+}
+
+std::vector<uint8_t> flashRead(const std::string& label, size_t size) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    for (size_t i = 0; i < kPartitionCount; ++i) {
+        if (label != s_partitions[i].label) continue;
+        std::vector<uint8_t>& c = contentsLocked(static_cast<int>(i));
+        return std::vector<uint8_t>(c.begin(), c.begin() + std::min(size, c.size()));
+    }
+    return {};
+}
+
+bool flashAttachFile(const std::string& label, const std::string& path) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    int index = indexOf(label);
+    if (index < 0) return false;
+    if (s_files[index].fd >= 0) close(s_files[index].fd);
+    s_files[index].fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (s_files[index].fd < 0) return false;
+    std::vector<uint8_t>& c = s_contents[index];
+    c.assign(s_partitions[index].size, 0xFF);
+    ssize_t n = pread(s_files[index].fd, c.data(), c.size(), 0);
+    if (n != static_cast<ssize_t>(c.size())) {
+        std::fill(c.begin(), c.end(), 0xFF);
+        syncLocked(index, 0, c.size());
+    }
+    return true;
+}
+
+void flashCutPowerAfter(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_power_budget = bytes;
+}
+
+void flashPowerOn() {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_power_budget = UINT64_MAX;
+    s_power_off = false;
+}
+
+std::vector<uint32_t> flashEraseCounts(const std::string& label) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    int index = indexOf(label);
+    if (index < 0) return {};
+    std::vector<uint32_t> counts = s_erase_counts[index];
+    counts.resize(s_partitions[index].size / SPI_FLASH_SEC_SIZE);
+    return counts;
+}
+
+FlashStats flashStats() {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return s_stats;
+}
+
+std::string otaReboot() {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    bootLocked();
+    return s_partitions[kOta0 + s_running].label;
+}
+
+} // namespace host_sim
+
+/* ---------- esp_partition ---------- */
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char* label) {
+    for (const esp_partition_t& p : s_partitions) {
+        if (type != ESP_PARTITION_TYPE_ANY && p.type != type) continue;
+        if (subtype != ESP_PARTITION_SUBTYPE_ANY && p.subtype != subtype) continue;
+        if (label && strcmp(label, p.label) != 0) continue;
+        return &p;
+    }
+    return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    int index = indexOf(partition);
+    if (index < 0 || !dst) return ESP_ERR_INVALID_ARG;
+    if (src_offset > partition->size || size > partition->size - src_offset) return ESP_ERR_INVALID_SIZE;
+    memcpy(dst, contentsLocked(index).data() + src_offset, size);
+    s_stats.bytes_read += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src, size_t size) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    int index = indexOf(partition);
+    if (index < 0 || !src) return ESP_ERR_INVALID_ARG;
+    if (dst_offset > partition->size || size > partition->size - dst_offset) return ESP_ERR_INVALID_SIZE;
+    if (s_power_off) return ESP_FAIL;
+    // 掉电：只完成一部分写入
+    esp_err_t err = ESP_OK;
+    if (size > s_power_budget) {
+        size = static_cast<size_t>(s_power_budget);
+        s_power_off = true;
+        err = ESP_FAIL;
+    }
+    if (s_power_budget != UINT64_MAX) s_power_budget -= size;
+    uint8_t* dst = contentsLocked(index).data() + dst_offset;
+    const uint8_t* in = static_cast<const uint8_t*>(src);
+    bool dirty = false;
+    for (size_t i = 0; i < size; ++i) {
+        if ((dst[i] & in[i]) != in[i]) dirty = true;
+        dst[i] &= in[i];
+    }
+    if (dirty) ++s_stats.dirty_writes;
+    s_stats.bytes_written += size;
+    syncLocked(index, dst_offset, size);
+    return err;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    int index = indexOf(partition);
+    if (index < 0) return ESP_ERR_INVALID_ARG;
+    if (offset % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE) return ESP_ERR_INVALID_SIZE;
+    if (offset > partition->size || size > partition->size - offset) return ESP_ERR_INVALID_SIZE;
+    if (s_power_off) return ESP_FAIL;
+    std::vector<uint8_t>& c = contentsLocked(index);
+    std::fill(c.begin() + offset, c.begin() + offset + size, 0xFF);
+    s_stats.sectors_erased += size / SPI_FLASH_SEC_SIZE;
+    std::vector<uint32_t>& counts = s_erase_counts[index];
+    counts.resize(partition->size / SPI_FLASH_SEC_SIZE);
+    for (size_t sector = offset / SPI_FLASH_SEC_SIZE; sector < (offset + size) / SPI_FLASH_SEC_SIZE; ++sector) {
+        ++counts[sector];
+    }
+    syncLocked(index, offset, size);
+    return ESP_OK;
+}
+
+/* ---------- esp_ota_ops ---------- */
+
+const esp_partition_t* esp_ota_get_running_partition(void) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return &s_partitions[kOta0 + s_running];
+}
+
+const esp_partition_t* esp_ota_get_boot_partition(void) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return &s_partitions[kOta0 + (s_boot >= 0 ? s_boot : s_running)];
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    int from = start_from ? slotOf(start_from) : s_running;
+    if (from < 0) return nullptr;
+    return &s_partitions[kOta0 + (from ^ 1)];
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    int slot = slotOf(partition);
+    if (slot < 0) return ESP_ERR_INVALID_ARG;
+    if (contentsLocked(indexOf(partition))[0] != 0xE9) return ESP_ERR_OTA_VALIDATE_FAILED;
+    uint32_t seq = std::max(s_slots[0].seq, s_slots[1].seq) + 1;
+    s_slots[slot] = OtaSlot{seq, ESP_OTA_IMG_NEW};
+    s_boot = slot;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition, esp_ota_img_states_t* ota_state) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    int slot = slotOf(partition);
+    if (slot < 0 || !ota_state) return ESP_ERR_INVALID_ARG;
+    if (s_slots[slot].seq == 0) return ESP_ERR_NOT_FOUND;
+    *ota_state = s_slots[slot].state;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    OtaSlot& slot = s_slots[s_running];
+    if (slot.seq != 0) slot.state = ESP_OTA_IMG_VALID;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot(void) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    const OtaSlot& other = s_slots[s_running ^ 1];
+    bool other_bootable = other.seq == 0 ? s_running != 0
+                                         : other.state != ESP_OTA_IMG_INVALID && other.state != ESP_OTA_IMG_ABORTED;
+    if (!other_bootable) return ESP_ERR_OTA_ROLLBACK_FAILED;
+    s_slots[s_running].state = ESP_OTA_IMG_INVALID;
+    bootLocked();
+    return ESP_OK;
+}
+
+/* ---------- mbedtls/sha256 ---------- */
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx) {
+    ctx->evp = nullptr;
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx) {
+    EVP_MD_CTX_free(static_cast<EVP_MD_CTX*>(ctx->evp));
+    ctx->evp = nullptr;
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int is224) {
+    if (!ctx->evp) ctx->evp = EVP_MD_CTX_new();
+    return EVP_DigestInit_ex(static_cast<EVP_MD_CTX*>(ctx->evp), is224 ? EVP_sha224() : EVP_sha256(), nullptr) == 1
+               ? 0
+               : -1;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context* ctx, const unsigned char* input, size_t ilen) {
+    return EVP_DigestUpdate(static_cast<EVP_MD_CTX*>(ctx->evp), input, ilen) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context* ctx, unsigned char output[32]) {
+    return EVP_DigestFinal_ex(static_cast<EVP_MD_CTX*>(ctx->evp), output, nullptr) == 1 ? 0 : -1;
+}
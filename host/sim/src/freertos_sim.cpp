@@ -0,0 +1,452 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 10:09:51
+ * @LastEditTime: 2025-06-09 17:48:26
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：FreeRTOS 任务、事件组、信号量、队列，基于 pthread 与条件变量
+ * @FilePath: \ESP32-ChunFeng\host\sim\src\freertos_sim.cpp
+ * @遇事不决，可问春风
+ */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct SimTask {
+    char name[16];
+    UBaseType_t number;             ///< 创建序号（uxTCBNumber）
+    UBaseType_t tag{0};             ///< 应用设置的编号（uxTaskNumber），与设备上一样默认为 0
+    UBaseType_t priority;
+    BaseType_t core;
+    TaskFunction_t fn;
+    void* arg;
+    pthread_t thread;
+    uint32_t stack_depth{0};        ///< 设备上的栈大小（字节）
+    uint8_t* stack_low{nullptr};    ///< 已填充区域的起点（栈底）
+    uintptr_t entry_sp{0};          ///< 任务函数开始时的栈位置
+    std::mutex notify_mutex;
+    std::condition_variable notify_cv;
+    uint32_t notify_count{0};
+};
+
+namespace {
+
+std::mutex s_tasks_mutex;
+std::vector<SimTask*> s_tasks;
+UBaseType_t s_next_number = 1;
+thread_local SimTask* t_current = nullptr;
+
+constexpr uint8_t kStackFill = 0xa5;
+
+/** 等待时长换算，portMAX_DELAY 表示永久等待 */
+template <typename Lock, typename Pred>
+bool waitFor(std::condition_variable& cv, Lock& lock, TickType_t ticks, Pred pred) {
+    if (ticks == portMAX_DELAY) {
+        cv.wait(lock, pred);
+        return true;
+    }
+    return cv.wait_for(lock, std::chrono::milliseconds(ticks), pred);
+}
+
+SimTask* registerTask(const char* name, UBaseType_t priority, BaseType_t core) {
+    auto* task = new SimTask();
+    snprintf(task->name, sizeof(task->name), "%s", name ? name : "");
+    task->priority = priority;
+    task->core = core;
+    std::lock_guard<std::mutex> lock(s_tasks_mutex);
+    task->number = s_next_number++;
+    s_tasks.push_back(task);
+    return task;
+}
+
+void unregisterTask(SimTask* task) {
+    std::lock_guard<std::mutex> lock(s_tasks_mutex);
+    s_tasks.erase(std::remove(s_tasks.begin(), s_tasks.end(), task), s_tasks.end());
+}
+
+/** 非 xTaskCreate 创建的线程（如主线程、std::thread）退出时从任务表移除 */
+struct ForeignTask {
+    SimTask* task{nullptr};
+    ~ForeignTask() {
+        if (task) {
+            unregisterTask(task);
+            delete task;
+        }
+    }
+};
+thread_local ForeignTask t_foreign;
+
+/** 非 xTaskCreate 创建的线程首次调用任务 API 时登记 */
+SimTask* currentTask() {
+    if (!t_current) {
+        char name[16];
+        if (pthread_getname_np(pthread_self(), name, sizeof(name)) != 0) name[0] = '\0';
+        t_current = registerTask(name[0] ? name : "main", 1, tskNO_AFFINITY);
+        t_current->thread = pthread_self();
+        t_foreign.task = t_current;
+    }
+    return t_current;
+}
+
+/**
+ * 与 FreeRTOS 一样用固定值填充尚未使用的栈，之后从栈底扫描到第一个被改写的字节即得历史最深处
+ */
+void __attribute__((noinline)) paintStack(SimTask* task) {
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) != 0) return;
+    void* addr = nullptr;
+    size_t size = 0, guard = 0;
+    pthread_attr_getstack(&attr, &addr, &size);
+    pthread_attr_getguardsize(&attr, &guard);
+    pthread_attr_destroy(&attr);
+    // 当前栈帧的地址按整数比较与偏移，不对局部变量做越界的指针运算
+    const uintptr_t sp = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+    const uintptr_t low = reinterpret_cast<uintptr_t>(addr) + guard;
+    const uintptr_t limit = sp - 1024;  // 留出 memset 自身的栈帧
+    if (sp < 1024 || limit <= low) return;
+    memset(reinterpret_cast<void*>(low), kStackFill, limit - low);
+    task->stack_low = reinterpret_cast<uint8_t*>(low);
+    task->entry_sp = sp;
+}
+
+/** 主机栈上的实际占用对照设备上的栈大小换算成剩余字节数；主机的栈帧通常比 Xtensa 大，结果偏保守 */
+UBaseType_t stackHighWater(const SimTask* task) {
+    if (!task->stack_low) return 0;
+    const uint8_t* p = task->stack_low;
+    const uint8_t* end = reinterpret_cast<const uint8_t*>(task->entry_sp);
+    while (p < end && *p == kStackFill) ++p;
+    size_t used = static_cast<size_t>(end - p);
+    return used < task->stack_depth ? static_cast<UBaseType_t>(task->stack_depth - used) : 0;
+}
+
+void* taskEntry(void* arg) {
+    auto* task = static_cast<SimTask*>(arg);
+    t_current = task;
+    paintStack(task);
+    pthread_setname_np(pthread_self(), task->name);
+    task->fn(task->arg);
+    // FreeRTOS 任务函数不允许返回，这里与 vTaskDelete(NULL) 等价处理
+    vTaskDelete(nullptr);
+    return nullptr;
+}
+
+uint32_t threadCpuUs(pthread_t thread) {
+    clockid_t cid;
+    timespec ts{};
+    if (pthread_getcpuclockid(thread, &cid) != 0 || clock_gettime(cid, &ts) != 0) return 0;
+    return static_cast<uint32_t>(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+} // namespace
+
+/* ---------- 临界区与核 ---------- */
+
+void vPortEnterCritical(portMUX_TYPE* mux) {
+    while (mux->flag.test_and_set(std::memory_order_acquire)) {
+        sched_yield();
+    }
+}
+
+void vPortExitCritical(portMUX_TYPE* mux) {
+    mux->flag.clear(std::memory_order_release);
+}
+
+BaseType_t xPortGetCoreID(void) {
+    int cpu = sched_getcpu();
+    return cpu < 0 ? 0 : cpu % portNUM_PROCESSORS;
+}
+
+/* ---------- 任务 ---------- */
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack_depth, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* created, BaseType_t core_id) {
+    SimTask* task = registerTask(name, priority, core_id);
+    task->fn = fn;
+    task->arg = arg;
+    task->stack_depth = stack_depth;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    // 主机上 C++ 运行库栈开销更大，栈深度放大后再设置，仍然保留设置过小的失败路径；
+    // 另加固定余量：glibc 从线程栈中划出 TLS，首次调用动态库函数的延迟绑定也要占用数 KB
+    size_t stack = std::max<size_t>(stack_depth * 4 + 32 * 1024, PTHREAD_STACK_MIN);
+    pthread_attr_setstacksize(&attr, stack);
+    int rc = pthread_create(&task->thread, &attr, taskEntry, task);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        unregisterTask(task);
+        delete task;
+        return pdFAIL;
+    }
+    if (created) *created = task;
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == nullptr || task == t_current) {
+        SimTask* self = currentTask();
+        unregisterTask(self);
+        t_current = nullptr;
+        if (t_foreign.task == self) t_foreign.task = nullptr;
+        delete self;
+        pthread_exit(nullptr);
+    }
+    // 删除其他任务：主机上无法安全终止线程，只从任务表移除
+    unregisterTask(task);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return static_cast<TickType_t>(esp_timer_get_time() / 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return currentTask();
+}
+
+char* pcTaskGetName(TaskHandle_t task) {
+    return (task ? task : currentTask())->name;
+}
+
+UBaseType_t uxTaskGetTaskNumber(TaskHandle_t task) {
+    return task ? task->tag : 0;
+}
+
+void vTaskSetTaskNumber(TaskHandle_t task, UBaseType_t number) {
+    if (task) task->tag = number;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    return (task ? task : currentTask())->priority;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return stackHighWater(task ? task : currentTask());
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void) {
+    std::lock_guard<std::mutex> lock(s_tasks_mutex);
+    return static_cast<UBaseType_t>(s_tasks.size());
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* status, UBaseType_t max, uint32_t* total_runtime) {
+    std::lock_guard<std::mutex> lock(s_tasks_mutex);
+    UBaseType_t n = 0;
+    for (SimTask* task : s_tasks) {
+        if (n >= max) break;
+        TaskStatus_t& s = status[n++];
+        s = {};
+        s.xHandle = task;
+        s.pcTaskName = task->name;
+        s.xTaskNumber = task->number;
+        s.eCurrentState = eReady;
+        s.uxCurrentPriority = task->priority;
+        s.uxBasePriority = task->priority;
+        s.ulRunTimeCounter = threadCpuUs(task->thread);
+        s.usStackHighWaterMark = stackHighWater(task);
+        s.xCoreID = task->core;
+    }
+    if (total_runtime) *total_runtime = static_cast<uint32_t>(esp_timer_get_time());
+    return n;
+}
+
+/* ---------- 任务通知 ---------- */
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    {
+        std::lock_guard<std::mutex> lock(task->notify_mutex);
+        ++task->notify_count;
+    }
+    task->notify_cv.notify_one();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higher_woken) {
+    xTaskNotifyGive(task);
+    if (higher_woken) *higher_woken = pdFALSE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    SimTask* self = currentTask();
+    std::unique_lock<std::mutex> lock(self->notify_mutex);
+    waitFor(self->notify_cv, lock, ticks, [self] { return self->notify_count != 0; });
+    uint32_t value = self->notify_count;
+    if (value != 0) {
+        self->notify_count = clear_on_exit ? 0 : value - 1;
+    }
+    return value;
+}
+
+/* ---------- 事件组 ---------- */
+
+struct SimEventGroup {
+    std::mutex mutex;
+    std::condition_variable cv;
+    EventBits_t bits{0};
+};
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    return new SimEventGroup();
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    delete group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    EventBits_t now;
+    {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        group->bits |= bits;
+        now = group->bits;
+    }
+    group->cv.notify_all();
+    return now;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    EventBits_t before = group->bits;
+    group->bits &= ~bits;
+    return before;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(group->mutex);
+    auto satisfied = [&] {
+        return wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+    };
+    bool ok = waitFor(group->cv, lock, ticks, satisfied);
+    EventBits_t result = group->bits;
+    if (ok && clear_on_exit) group->bits &= ~bits;
+    return result;
+}
+
+/* ---------- 信号量 ---------- */
+
+struct SimSemaphore {
+    std::mutex mutex;
+    std::condition_variable cv;
+    UBaseType_t count;
+    UBaseType_t max;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return new SimSemaphore{{}, {}, 1, 1};
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return new SimSemaphore{{}, {}, 0, 1};
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial) {
+    return new SimSemaphore{{}, {}, initial, max};
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    delete sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(sem->mutex);
+    if (!waitFor(sem->cv, lock, ticks, [sem] { return sem->count > 0; })) return pdFALSE;
+    --sem->count;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    {
+        std::lock_guard<std::mutex> lock(sem->mutex);
+        if (sem->count >= sem->max) return pdFALSE;
+        ++sem->count;
+    }
+    sem->cv.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t* higher_woken) {
+    if (higher_woken) *higher_woken = pdFALSE;
+    return xSemaphoreGive(sem);
+}
+
+/* ---------- 队列 ---------- */
+
+struct SimQueue {
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<std::vector<uint8_t>> items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    auto* q = new SimQueue();
+    q->length = length;
+    q->item_size = item_size;
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) {
+    {
+        std::unique_lock<std::mutex> lock(queue->mutex);
+        if (!waitFor(queue->not_full, lock, ticks, [queue] { return queue->items.size() < queue->length; })) {
+            return pdFALSE;
+        }
+        const auto* p = static_cast<const uint8_t*>(item);
+        queue->items.emplace_back(p, p + queue->item_size);
+    }
+    queue->not_empty.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* higher_woken) {
+    if (higher_woken) *higher_woken = pdFALSE;
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+    {
+        std::unique_lock<std::mutex> lock(queue->mutex);
+        if (!waitFor(queue->not_empty, lock, ticks, [queue] { return !queue->items.empty(); })) {
+            return pdFALSE;
+        }
+        memcpy(item, queue->items.front().data(), queue->item_size);
+        queue->items.pop_front();
+    }
+    queue->not_full.notify_one();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return static_cast<UBaseType_t>(queue->items.size());
+}
@@ -0,0 +1,487 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 10:16:04
+ * @LastEditTime: 2025-06-09 17:48:26
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：esp_http_server。单线程 poll 循环、keep-alive、URI 精确匹配，
+ *               与 ESP-IDF 的 httpd 一样所有处理函数串行执行
+ * @FilePath: \ESP32-ChunFeng\host\sim\src\httpd_sim.cpp
+ * @遇事不决，可问春风
+ */
+#include "esp_http_server.h"
+#include "host_sim.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Session {
+    int fd;
+    std::string inbuf;
+    uint64_t last_used;
+};
+
+struct UriHandler {
+    std::string uri;
+    httpd_uri_t def;
+};
+
+struct Server {
+    httpd_config_t config;
+    int listen_fd{-1};
+    int wake[2]{-1, -1};
+    std::thread thread;
+    std::atomic<bool> stop{false};
+    std::vector<UriHandler> handlers;
+    std::vector<Session> sessions;
+    uint64_t use_counter{0};
+};
+
+/** 每个请求的响应状态，挂在 httpd_req_t::aux 上 */
+struct ReqAux {
+    Session* sess;
+    std::string headers;        ///< 请求头原文（不含请求行）
+    size_t body_remaining;
+    std::string status{HTTPD_200};
+    std::string type{"text/html"};
+    std::vector<std::pair<std::string, std::string>> resp_hdrs;
+    bool chunked{false};
+    bool complete{false};
+    bool failed{false};
+    bool close_after{false};
+};
+
+int s_port_override = -1;
+std::atomic<uint16_t> s_bound_port{0};
+
+bool writeAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+ReqAux* auxOf(httpd_req_t* r) {
+    return static_cast<ReqAux*>(r->aux);
+}
+
+std::string statusLineAndHeaders(ReqAux* aux) {
+    std::string out = "HTTP/1.1 " + aux->status + "\r\nContent-Type: " + aux->type + "\r\n";
+    for (const auto& h : aux->resp_hdrs) {
+        out += h.first + ": " + h.second + "\r\n";
+    }
+    if (aux->close_after) out += "Connection: close\r\n";
+    return out;
+}
+
+int methodFromString(const std::string& m) {
+    if (m == "GET") return HTTP_GET;
+    if (m == "POST") return HTTP_POST;
+    if (m == "PUT") return HTTP_PUT;
+    if (m == "DELETE") return HTTP_DELETE;
+    if (m == "HEAD") return HTTP_HEAD;
+    return -1;
+}
+
+/** 在请求头原文中查找字段（不区分大小写） */
+bool findHeader(const std::string& headers, const char* field, std::string& value) {
+    size_t flen = strlen(field);
+    size_t pos = 0;
+    while (pos < headers.size()) {
+        size_t eol = headers.find("\r\n", pos);
+        if (eol == std::string::npos) eol = headers.size();
+        if (eol - pos > flen && headers[pos + flen] == ':' && strncasecmp(headers.c_str() + pos, field, flen) == 0) {
+            size_t v = pos + flen + 1;
+            while (v < eol && headers[v] == ' ') ++v;
+            value.assign(headers, v, eol - v);
+            return true;
+        }
+        pos = eol + 2;
+    }
+    return false;
+}
+
+void sendSimple(Session& s, const char* status, const char* body) {
+    char buf[256];
+    int n = snprintf(buf, sizeof(buf), "HTTP/1.1 %s\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n\r\n%s",
+                     status, strlen(body), body);
+    writeAll(s.fd, buf, static_cast<size_t>(n));
+}
+
+/**
+ * @brief 处理会话缓冲区中的一个完整请求
+ * @return false 需要关闭会话
+ */
+bool handleRequest(Server* srv, Session& s, size_t header_end) {
+    std::string head = s.inbuf.substr(0, header_end);
+    s.inbuf.erase(0, header_end + 4);
+
+    size_t line_end = head.find("\r\n");
+    std::string request_line = head.substr(0, line_end);
+    std::string headers = line_end == std::string::npos ? std::string() : head.substr(line_end + 2);
+    size_t sp1 = request_line.find(' ');
+    size_t sp2 = request_line.find(' ', sp1 + 1);
+    if (sp1 == std::string::npos || sp2 == std::string::npos) {
+        sendSimple(s, HTTPD_400, "Bad Request");
+        return false;
+    }
+    int method = methodFromString(request_line.substr(0, sp1));
+    std::string uri = request_line.substr(sp1 + 1, sp2 - sp1 - 1);
+    if (uri.size() > HTTPD_MAX_URI_LEN) {
+        sendSimple(s, "414 URI Too Long", "URI is too long");
+        return false;
+    }
+
+    std::string value;
+    size_t content_len = findHeader(headers, "Content-Length", value) ? strtoul(value.c_str(), nullptr, 10) : 0;
+    bool close_after = findHeader(headers, "Connection", value) && strcasecmp(value.c_str(), "close") == 0;
+
+    std::string path = uri.substr(0, uri.find('?'));
+    const UriHandler* match = nullptr;
+    bool path_matched = false;
+    for (const auto& h : srv->handlers) {
+        if (h.uri != path) continue;
+        path_matched = true;
+        if (static_cast<int>(h.def.method) == method) {
+            match = &h;
+            break;
+        }
+    }
+
+    ReqAux aux{&s, headers, content_len, HTTPD_200, "text/html", {}, false, false, false, close_after};
+    httpd_req_t req{};
+    req.handle = srv;
+    req.method = method;
+    snprintf(req.uri, sizeof(req.uri), "%s", uri.c_str());
+    req.content_len = content_len;
+    req.aux = &aux;
+
+    esp_err_t ret = ESP_OK;
+    if (match) {
+        req.user_ctx = match->def.user_ctx;
+        ret = match->def.handler(&req);
+    } else if (path_matched) {
+        httpd_resp_send_err(&req, 405, "Request method for this URI is not handled by server");
+    } else {
+        httpd_resp_send_err(&req, 404, "This URI does not exist");
+    }
+
+    // 丢弃处理函数未读取的请求体
+    while (aux.body_remaining > 0 && !aux.failed) {
+        char sink[512];
+        int n = httpd_req_recv(&req, sink, sizeof(sink));
+        if (n <= 0) break;
+    }
+    if (ret != ESP_OK || aux.failed || !aux.complete) return false;
+    return !close_after;
+}
+
+void closeSession(Session& s) {
+    close(s.fd);
+    s.fd = -1;
+}
+
+void acceptClient(Server* srv) {
+    int fd = accept(srv->listen_fd, nullptr, nullptr);
+    if (fd < 0) return;
+    if (srv->sessions.size() >= srv->config.max_open_sockets) {
+        if (!srv->config.lru_purge_enable) {
+            close(fd);
+            return;
+        }
+        // 关闭最久未使用的会话
+        size_t oldest = 0;
+        for (size_t i = 1; i < srv->sessions.size(); ++i) {
+            if (srv->sessions[i].last_used < srv->sessions[oldest].last_used) oldest = i;
+        }
+        closeSession(srv->sessions[oldest]);
+        srv->sessions.erase(srv->sessions.begin() + oldest);
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    timeval tv{srv->config.recv_wait_timeout, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    tv.tv_sec = srv->config.send_wait_timeout;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    srv->sessions.push_back(Session{fd, std::string(), ++srv->use_counter});
+}
+
+/** 读取会话数据并处理其中所有完整请求 */
+bool serviceSession(Server* srv, Session& s) {
+    char buf[2048];
+    ssize_t n = recv(s.fd, buf, sizeof(buf), 0);
+    if (n <= 0) return false;
+    s.inbuf.append(buf, static_cast<size_t>(n));
+    s.last_used = ++srv->use_counter;
+    size_t header_end;
+    while ((header_end = s.inbuf.find("\r\n\r\n")) != std::string::npos) {
+        if (!handleRequest(srv, s, header_end)) return false;
+    }
+    // 请求头过大
+    return s.inbuf.size() <= 8192;
+}
+
+void serverLoop(Server* srv) {
+    pthread_setname_np(pthread_self(), "httpd");
+    std::vector<pollfd> fds;
+    while (!srv->stop.load()) {
+        fds.clear();
+        fds.push_back({srv->wake[0], POLLIN, 0});
+        fds.push_back({srv->listen_fd, POLLIN, 0});
+        for (const auto& s : srv->sessions) {
+            fds.push_back({s.fd, POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), -1) <= 0) continue;
+        if (fds[0].revents) break;
+        // 先处理已有会话，再接受新连接（新会话可能导致 sessions 重新分配）
+        for (size_t i = 2; i < fds.size(); ++i) {
+            if (!fds[i].revents) continue;
+            Session& s = srv->sessions[i - 2];
+            if (!serviceSession(srv, s)) closeSession(s);
+        }
+        for (size_t i = srv->sessions.size(); i-- > 0;) {
+            if (srv->sessions[i].fd < 0) srv->sessions.erase(srv->sessions.begin() + i);
+        }
+        if (fds[1].revents & POLLIN) acceptClient(srv);
+    }
+}
+
+} // namespace
+
+namespace host_sim {
+
+void httpdSetPortOverride(uint16_t port) {
+    s_port_override = port;
+}
+
+uint16_t httpdBoundPort() {
+    return s_bound_port.load();
+}
+
+} // namespace host_sim
+
+httpd_config_t httpd_sim_default_config(void) {
+    httpd_config_t c{};
+    c.task_priority = 5;
+    c.stack_size = 4096;
+    c.core_id = 0x7fffffff;
+    c.server_port = 80;
+    c.ctrl_port = 32768;
+    c.max_open_sockets = 7;
+    c.max_uri_handlers = 8;
+    c.max_resp_headers = 8;
+    c.backlog_conn = 5;
+    c.lru_purge_enable = false;
+    c.recv_wait_timeout = 5;
+    c.send_wait_timeout = 5;
+    return c;
+}
+
+esp_err_t httpd_start(httpd_handle_t* handle, const httpd_config_t* config) {
+    auto* srv = new Server();
+    srv->config = *config;
+    uint16_t port = s_port_override >= 0 ? static_cast<uint16_t>(s_port_override) : config->server_port;
+
+    srv->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(srv->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (srv->listen_fd < 0 || bind(srv->listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(srv->listen_fd, config->backlog_conn) != 0 || pipe(srv->wake) != 0) {
+        if (srv->listen_fd >= 0) close(srv->listen_fd);
+        delete srv;
+        return ESP_ERR_HTTPD_TASK;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(srv->listen_fd, reinterpret_cast<sockaddr*>(&addr), &len);
+    s_bound_port.store(ntohs(addr.sin_port));
+
+    srv->thread = std::thread(serverLoop, srv);
+    *handle = srv;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+    auto* srv = static_cast<Server*>(handle);
+    if (!srv) return ESP_ERR_INVALID_ARG;
+    srv->stop.store(true);
+    char c = 0;
+    (void)!write(srv->wake[1], &c, 1);
+    srv->thread.join();
+    for (auto& s : srv->sessions) closeSession(s);
+    close(srv->listen_fd);
+    close(srv->wake[0]);
+    close(srv->wake[1]);
+    delete srv;
+    s_bound_port.store(0);
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t* uri_handler) {
+    auto* srv = static_cast<Server*>(handle);
+    if (!srv || !uri_handler || !uri_handler->uri || !uri_handler->handler) return ESP_ERR_INVALID_ARG;
+    for (const auto& h : srv->handlers) {
+        if (h.uri == uri_handler->uri && h.def.method == uri_handler->method) return ESP_ERR_HTTPD_HANDLER_EXISTS;
+    }
+    if (srv->handlers.size() >= srv->config.max_uri_handlers) return ESP_ERR_HTTPD_HANDLERS_FULL;
+    srv->handlers.push_back(UriHandler{uri_handler->uri, *uri_handler});
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t* r, const char* type) {
+    auxOf(r)->type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t* r, const char* status) {
+    auxOf(r)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t* r, const char* field, const char* value) {
+    auto* aux = auxOf(r);
+    auto* srv = static_cast<Server*>(r->handle);
+    if (aux->resp_hdrs.size() >= srv->config.max_resp_headers) return ESP_ERR_HTTPD_RESP_HDR;
+    aux->resp_hdrs.emplace_back(field, value);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t* r, const char* buf, ssize_t buf_len) {
+    auto* aux = auxOf(r);
+    if (aux->complete || aux->chunked) return ESP_ERR_INVALID_STATE;
+    size_t len = buf_len == HTTPD_RESP_USE_STRLEN ? (buf ? strlen(buf) : 0) : static_cast<size_t>(buf_len);
+    std::string out = statusLineAndHeaders(aux);
+    out += "Content-Length: " + std::to_string(len) + "\r\n\r\n";
+    if (len) out.append(buf, len);
+    aux->complete = true;
+    if (!writeAll(aux->sess->fd, out.data(), out.size())) {
+        aux->failed = true;
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t* r, const char* buf, ssize_t buf_len) {
+    auto* aux = auxOf(r);
+    if (aux->complete) return ESP_ERR_INVALID_STATE;
+    size_t len = buf_len == HTTPD_RESP_USE_STRLEN ? (buf ? strlen(buf) : 0) : static_cast<size_t>(buf_len);
+    std::string out;
+    if (!aux->chunked) {
+        out = statusLineAndHeaders(aux) + "Transfer-Encoding: chunked\r\n\r\n";
+        aux->chunked = true;
+    }
+    char size_line[24];
+    if (buf && len) {
+        snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+        out += size_line;
+        out.append(buf, len);
+        out += "\r\n";
+    } else {
+        out += "0\r\n\r\n";
+        aux->complete = true;
+    }
+    if (!writeAll(aux->sess->fd, out.data(), out.size())) {
+        aux->failed = true;
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t* r, int error, const char* msg) {
+    const char* status;
+    switch (error) {
+        case 400: status = HTTPD_400; break;
+        case 404: status = HTTPD_404; break;
+        case 405: status = "405 Method Not Allowed"; break;
+        case 408: status = "408 Request Timeout"; break;
+        default: status = HTTPD_500; break;
+    }
+    httpd_resp_set_status(r, status);
+    httpd_resp_set_type(r, "text/html");
+    return httpd_resp_send(r, msg, HTTPD_RESP_USE_STRLEN);
+}
+
+int httpd_req_recv(httpd_req_t* r, char* buf, size_t buf_len) {
+    auto* aux = auxOf(r);
+    if (aux->body_remaining == 0 || buf_len == 0) return 0;
+    size_t want = buf_len < aux->body_remaining ? buf_len : aux->body_remaining;
+    Session* s = aux->sess;
+    size_t got;
+    if (!s->inbuf.empty()) {
+        got = want < s->inbuf.size() ? want : s->inbuf.size();
+        memcpy(buf, s->inbuf.data(), got);
+        s->inbuf.erase(0, got);
+    } else {
+        ssize_t n = recv(s->fd, buf, want, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return HTTPD_SOCK_ERR_TIMEOUT;
+        if (n <= 0) {
+            aux->failed = true;
+            return HTTPD_SOCK_ERR_FAIL;
+        }
+        got = static_cast<size_t>(n);
+    }
+    aux->body_remaining -= got;
+    return static_cast<int>(got);
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t* r, char* buf, size_t buf_len) {
+    const char* q = strchr(r->uri, '?');
+    if (!q) return ESP_ERR_NOT_FOUND;
+    ++q;
+    size_t len = strlen(q);
+    if (buf_len == 0) return ESP_ERR_INVALID_ARG;
+    size_t n = len < buf_len - 1 ? len : buf_len - 1;
+    memcpy(buf, q, n);
+    buf[n] = '\0';
+    return n < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char* qry, const char* key, char* val, size_t val_size) {
+    size_t klen = strlen(key);
+    const char* p = qry;
+    while (p && *p) {
+        const char* end = strchr(p, '&');
+        if (!end) end = p + strlen(p);
+        if (static_cast<size_t>(end - p) > klen && strncmp(p, key, klen) == 0 && p[klen] == '=') {
+            const char* v = p + klen + 1;
+            size_t len = static_cast<size_t>(end - v);
+            if (val_size == 0) return ESP_ERR_INVALID_ARG;
+            size_t n = len < val_size - 1 ? len : val_size - 1;
+            memcpy(val, v, n);
+            val[n] = '\0';
+            return n < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+        }
+        p = *end ? end + 1 : end;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t* r, const char* field, char* val, size_t val_size) {
+    std::string value;
+    if (!findHeader(auxOf(r)->headers, field, value)) return ESP_ERR_NOT_FOUND;
+    if (val_size == 0) return ESP_ERR_INVALID_ARG;
+    size_t n = value.size() < val_size - 1 ? value.size() : val_size - 1;
+    memcpy(val, value.data(), n);
+    val[n] = '\0';
+    return n < value.size() ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
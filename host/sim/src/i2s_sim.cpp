@@ -0,0 +1,124 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-17 09:06:21
+ * @LastEditTime: 2025-06-17 17:20:48
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：I2S 标准模式 TX。按采样率推算每个样本从 DAC 输出的时间，
+ *               DMA 描述符排满时写入阻塞，输出时间通过 host_sim::i2sSetOutputHook 交给测试
+ * @FilePath: \ESP32-ChunFeng\host\sim\src\i2s_sim.cpp
+ * @遇事不决，可问春风
+ */
+#include "driver/i2s_std.h"
+#include "esp_timer.h"
+#include "host_sim.hpp"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+struct i2s_channel_obj_t {
+    i2s_chan_config_t chan;
+    i2s_std_config_t std;
+    bool configured{false};
+    bool enabled{false};
+    int64_t end_us{0};      ///< 已写入数据播放完的时间，0 表示启用后还没有写入
+};
+
+namespace {
+
+std::mutex s_hook_mutex;
+std::function<void(const int16_t*, size_t, int64_t)> s_hook;
+std::atomic<uint32_t> s_underruns{0};
+
+int64_t framesToUs(const i2s_channel_obj_t* ch, uint64_t frames) {
+    return static_cast<int64_t>(frames * 1000000ULL / ch->std.clk_cfg.sample_rate_hz);
+}
+
+} // namespace
+
+namespace host_sim {
+
+void i2sSetOutputHook(std::function<void(const int16_t* pcm, size_t samples, int64_t start_us)> hook) {
+    std::lock_guard<std::mutex> lock(s_hook_mutex);
+    s_hook = std::move(hook);
+}
+
+uint32_t i2sUnderruns() {
+    return s_underruns.load();
+}
+
+} // namespace host_sim
+
+esp_err_t i2s_new_channel(const i2s_chan_config_t* chan_cfg, i2s_chan_handle_t* ret_tx_handle,
+                          i2s_chan_handle_t* ret_rx_handle) {
+    if (!chan_cfg || !ret_tx_handle || ret_rx_handle) return ESP_ERR_NOT_SUPPORTED;   // 只模拟 TX
+    auto* ch = new i2s_channel_obj_t();
+    ch->chan = *chan_cfg;
+    *ret_tx_handle = ch;
+    return ESP_OK;
+}
+
+esp_err_t i2s_del_channel(i2s_chan_handle_t handle) {
+    if (!handle || handle->enabled) return ESP_ERR_INVALID_STATE;
+    delete handle;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle, const i2s_std_config_t* std_cfg) {
+    if (!handle || !std_cfg || std_cfg->clk_cfg.sample_rate_hz == 0) return ESP_ERR_INVALID_ARG;
+    if (std_cfg->slot_cfg.data_bit_width != I2S_DATA_BIT_WIDTH_16BIT ||
+        std_cfg->slot_cfg.slot_mode != I2S_SLOT_MODE_MONO) {
+        return ESP_ERR_NOT_SUPPORTED;   // 替身只支持 16 位单声道
+    }
+    handle->std = *std_cfg;
+    handle->configured = true;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle) {
+    if (!handle || !handle->configured || handle->enabled) return ESP_ERR_INVALID_STATE;
+    handle->enabled = true;
+    handle->end_us = 0;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle) {
+    if (!handle || !handle->enabled) return ESP_ERR_INVALID_STATE;
+    handle->enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_write(i2s_chan_handle_t handle, const void* src, size_t size, size_t* bytes_written,
+                            uint32_t timeout_ms) {
+    if (bytes_written) *bytes_written = 0;
+    if (!handle || !handle->enabled) return ESP_ERR_INVALID_STATE;
+    size_t samples = size / sizeof(int16_t);
+    if (samples == 0) return ESP_OK;
+    const int64_t capacity_us = framesToUs(handle, static_cast<uint64_t>(handle->chan.dma_desc_num) *
+                                                       handle->chan.dma_frame_num);
+    const int64_t duration_us = framesToUs(handle, samples);
+    int64_t now = esp_timer_get_time();
+    // DMA 缓冲放不下这次的数据时，等到足够多的描述符播放完
+    int64_t ready_us = handle->end_us + duration_us - capacity_us;
+    if (ready_us > now) {
+        if (timeout_ms != portMAX_DELAY && ready_us - now > static_cast<int64_t>(timeout_ms) * 1000) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+            return ESP_ERR_TIMEOUT;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(ready_us - now));
+        now = esp_timer_get_time();
+    }
+    int64_t start_us = handle->end_us;
+    if (start_us < now) {
+        // 数据没跟上，DMA 已经在输出静音
+        if (handle->end_us != 0 && handle->end_us + 1000 < now) ++s_underruns;
+        start_us = now;
+    }
+    handle->end_us = start_us + duration_us;
+    {
+        std::lock_guard<std::mutex> lock(s_hook_mutex);
+        if (s_hook) s_hook(static_cast<const int16_t*>(src), samples, start_us);
+    }
+    if (bytes_written) *bytes_written = samples * sizeof(int16_t);
+    return ESP_OK;
+}
@@ -0,0 +1,245 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-16 09:12:40
+ * @LastEditTime: 2025-06-16 16:31:08
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：SPI 总线、GPIO 输出与 esp_lcd（ST7789）。颜色数据按 pclk 折算传输时间后写入模拟显存，
+ *               统计总线字节数，显存可导出为 PPM 图片，写入显存时可回调测试代码
+ * @FilePath: \ESP32-ChunFeng\host\sim\src\lcd_sim.cpp
+ * @遇事不决，可问春风
+ */
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+#include "esp_lcd_panel_io.h"
+#include "esp_lcd_panel_ops.h"
+#include "esp_lcd_panel_vendor.h"
+#include "esp_timer.h"
+#include "host_sim.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct esp_lcd_panel_io_t {
+    esp_lcd_panel_io_spi_config_t config;
+};
+
+struct esp_lcd_panel_t {
+    esp_lcd_panel_io_t* io;
+};
+
+namespace {
+
+// ST7789 显存 240x320，交换 XY 后最大 320x240，这里按 320x320 留足
+constexpr int kGramSize = 320;
+// 每次 draw_bitmap 的命令与参数：CASET(1+4)、RASET(1+4)、RAMWR(1)
+constexpr uint32_t kWindowBytes = 11;
+
+struct Transfer {
+    esp_lcd_panel_io_t* io;
+    int x0, y0, x1, y1;
+    const uint8_t* data;
+};
+
+struct LcdSim {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Transfer> queue;
+    bool worker_started{false};
+    std::vector<uint16_t> gram = std::vector<uint16_t>(kGramSize * kGramSize);
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint32_t> draws{0};
+    std::mutex hook_mutex;
+    std::function<void(int, int, int, int, int64_t)> hook;
+};
+
+LcdSim& sim() {
+    static LcdSim* s = new LcdSim();   // 不析构：工作线程可能在进程退出时仍在等待
+    return *s;
+}
+
+void sleepForBytes(const esp_lcd_panel_io_t* io, uint64_t bytes) {
+    unsigned int hz = io->config.pclk_hz ? io->config.pclk_hz : 10 * 1000 * 1000;
+    std::this_thread::sleep_for(std::chrono::nanoseconds(bytes * 8 * 1000000000ULL / hz));
+}
+
+void worker() {
+    LcdSim& s = sim();
+    while (true) {
+        Transfer t;
+        {
+            std::unique_lock<std::mutex> lock(s.mutex);
+            s.cv.wait(lock, [&] { return !s.queue.empty(); });
+            t = s.queue.front();
+        }
+        int w = t.x1 - t.x0;
+        int h = t.y1 - t.y0;
+        uint64_t color_bytes = static_cast<uint64_t>(w) * h * 2;
+        sleepForBytes(t.io, color_bytes);
+        // 在传输完成时才读取颜色数据：调用方提前改写缓冲会在画面上体现出来
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                const uint8_t* p = t.data + (static_cast<size_t>(y) * w + x) * 2;
+                int gx = t.x0 + x, gy = t.y0 + y;
+                if (gx < kGramSize && gy < kGramSize) {
+                    s.gram[gy * kGramSize + gx] = static_cast<uint16_t>(p[0] << 8 | p[1]);  // 总线上为大端
+                }
+            }
+        }
+        s.bytes += color_bytes;
+        {
+            std::lock_guard<std::mutex> lock(s.hook_mutex);
+            if (s.hook) s.hook(t.x0, t.y0, t.x1, t.y1, esp_timer_get_time());
+        }
+        esp_lcd_panel_io_event_data_t edata = {};
+        if (t.io->config.on_color_trans_done) {
+            t.io->config.on_color_trans_done(t.io, &edata, t.io->config.user_ctx);
+        }
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.queue.pop_front();
+        }
+        s.cv.notify_all();
+    }
+}
+
+} // namespace
+
+namespace host_sim {
+
+uint64_t lcdBytesTransferred() {
+    return sim().bytes.load();
+}
+
+uint32_t lcdDrawCount() {
+    return sim().draws.load();
+}
+
+bool lcdWritePpm(const std::string& path, int width, int height) {
+    LcdSim& s = sim();
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp) return false;
+    fprintf(fp, "P6\n%d %d\n255\n", width, height);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    for (int y = 0; y < height && y < kGramSize; ++y) {
+        for (int x = 0; x < width && x < kGramSize; ++x) {
+            uint16_t c = s.gram[y * kGramSize + x];
+            uint8_t rgb[3] = {static_cast<uint8_t>((c >> 11) << 3), static_cast<uint8_t>(((c >> 5) & 0x3f) << 2),
+                              static_cast<uint8_t>((c & 0x1f) << 3)};
+            fwrite(rgb, 1, 3, fp);
+        }
+    }
+    return fclose(fp) == 0;
+}
+
+uint16_t lcdPixel(int x, int y) {
+    LcdSim& s = sim();
+    if (x < 0 || y < 0 || x >= kGramSize || y >= kGramSize) return 0;
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.gram[y * kGramSize + x];
+}
+
+void lcdSetUpdateHook(std::function<void(int x0, int y0, int x1, int y1, int64_t time_us)> hook) {
+    LcdSim& s = sim();
+    std::lock_guard<std::mutex> lock(s.hook_mutex);
+    s.hook = std::move(hook);
+}
+
+} // namespace host_sim
+
+esp_err_t gpio_config(const gpio_config_t*) {
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t, uint32_t) {
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_initialize(spi_host_device_t, const spi_bus_config_t*, spi_dma_chan_t) {
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_free(spi_host_device_t) {
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_new_panel_io_spi(esp_lcd_spi_bus_handle_t, const esp_lcd_panel_io_spi_config_t* io_config,
+                                   esp_lcd_panel_io_handle_t* ret_io) {
+    if (!io_config || !ret_io) return ESP_ERR_INVALID_ARG;
+    LcdSim& s = sim();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!s.worker_started) {
+            std::thread(worker).detach();
+            s.worker_started = true;
+        }
+    }
+    *ret_io = new esp_lcd_panel_io_t{*io_config};
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_panel_io_del(esp_lcd_panel_io_handle_t io) {
+    delete io;
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_new_panel_st7789(const esp_lcd_panel_io_handle_t io, const esp_lcd_panel_dev_config_t*,
+                                   esp_lcd_panel_handle_t* ret_panel) {
+    if (!io || !ret_panel) return ESP_ERR_INVALID_ARG;
+    *ret_panel = new esp_lcd_panel_t{io};
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_panel_reset(esp_lcd_panel_handle_t) {
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_panel_init(esp_lcd_panel_handle_t) {
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_panel_del(esp_lcd_panel_handle_t panel) {
+    delete panel;
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_panel_draw_bitmap(esp_lcd_panel_handle_t panel, int x_start, int y_start, int x_end, int y_end,
+                                    const void* color_data) {
+    if (!panel || x_end <= x_start || y_end <= y_start) return ESP_ERR_INVALID_ARG;
+    LcdSim& s = sim();
+    esp_lcd_panel_io_t* io = panel->io;
+    {
+        // 与 esp_lcd 的 SPI 实现一致：窗口命令以轮询方式发送，发送前要等已排队的颜色传输全部完成
+        std::unique_lock<std::mutex> lock(s.mutex);
+        s.cv.wait(lock, [&] { return s.queue.empty(); });
+    }
+    sleepForBytes(io, kWindowBytes);
+    s.bytes += kWindowBytes;
+    ++s.draws;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.queue.push_back(Transfer{io, x_start, y_start, x_end, y_end, static_cast<const uint8_t*>(color_data)});
+    }
+    s.cv.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_panel_mirror(esp_lcd_panel_handle_t, bool, bool) {
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_panel_swap_xy(esp_lcd_panel_handle_t, bool) {
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_panel_invert_color(esp_lcd_panel_handle_t, bool) {
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_panel_disp_on_off(esp_lcd_panel_handle_t, bool) {
+    return ESP_OK;
+}
@@ -0,0 +1,72 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 10:23:17
+ * @LastEditTime: 2025-06-24 15:02:18
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：ML307 4G 模组，附着耗时与结果由 host_sim::lteSetBehaviour 控制
+ * @FilePath: \ESP32-ChunFeng\host\sim\src\ml307_sim.cpp
+ * @遇事不决，可问春风
+ */
+#include "ml307_at_modem.h"
+#include "host_sim.hpp"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace {
+
+std::atomic<uint32_t> s_attach_ms{2500};
+std::atomic<bool> s_attach_ok{true};
+
+} // namespace
+
+namespace host_sim {
+
+void lteSetBehaviour(uint32_t attach_ms, bool success) {
+    s_attach_ms.store(attach_ms);
+    s_attach_ok.store(success);
+}
+
+} // namespace host_sim
+
+// esp-ml307 上电时安装 UART 驱动（接收环形缓冲 2 倍 rx_buffer_size）、AT 行缓冲，并创建 4KB 栈的事件任务
+Ml307AtModem::Ml307AtModem(gpio_num_t, gpio_num_t, size_t rx_buffer_size)
+    : driver_memory_(rx_buffer_size * 3 + 4096, 0) {}
+
+Ml307AtModem::~Ml307AtModem() = default;
+
+void Ml307AtModem::SetDebug(bool) {}
+
+bool Ml307AtModem::SetBaudRate(int, int) {
+    return true;
+}
+
+int Ml307AtModem::WaitForNetworkReady() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(s_attach_ms.load()));
+    ready_ = s_attach_ok.load();
+    return ready_ ? 0 : -1;
+}
+
+std::string Ml307AtModem::ip_address() const {
+    return ready_ ? "10.64.0.2" : "";
+}
+
+std::string Ml307AtModem::GetImei() {
+    return "860000000000000";
+}
+
+std::string Ml307AtModem::GetIccid() {
+    return "89860000000000000000";
+}
+
+std::string Ml307AtModem::GetModuleName() {
+    return "ML307R-SIM";
+}
+
+std::string Ml307AtModem::GetCarrierName() {
+    return ready_ ? "SIM" : "";
+}
+
+int Ml307AtModem::GetCsq() {
+    return ready_ ? 24 : 99;
+}
@@ -0,0 +1,262 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 10:30:30
+ * @LastEditTime: 2025-06-09 17:48:26
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：内存中的 NVS，按命名空间与键保存带类型的值
+ * @FilePath: \ESP32-ChunFeng\host\sim\src\nvs_sim.cpp
+ * @遇事不决，可问春风
+ */
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "host_sim.hpp"
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+enum class Type : uint8_t { U8, I32, U32, U64, STR, BLOB };
+
+struct Entry {
+    Type type;
+    std::vector<uint8_t> data;
+};
+
+struct Handle {
+    std::string name_space;
+    bool writable;
+};
+
+std::mutex s_mutex;
+bool s_initialized = false;
+std::map<std::string, std::map<std::string, Entry>> s_store;
+std::map<nvs_handle_t, Handle> s_handles;
+nvs_handle_t s_next_handle = 1;
+
+// NVS 键名最长 15 字符
+constexpr size_t kMaxKeyLen = 15;
+
+Handle* findHandle(nvs_handle_t h) {
+    auto it = s_handles.find(h);
+    return it == s_handles.end() ? nullptr : &it->second;
+}
+
+esp_err_t setValue(nvs_handle_t h, const char* key, Type type, const void* data, size_t len) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    Handle* handle = findHandle(h);
+    if (!handle) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (!handle->writable) return ESP_ERR_NVS_READ_ONLY;
+    if (!key || strlen(key) > kMaxKeyLen) return ESP_ERR_INVALID_ARG;
+    const auto* p = static_cast<const uint8_t*>(data);
+    s_store[handle->name_space][key] = Entry{type, std::vector<uint8_t>(p, p + len)};
+    return ESP_OK;
+}
+
+/** 读取定长值；类型不一致时与真实 NVS 一样返回 NOT_FOUND */
+esp_err_t getValue(nvs_handle_t h, const char* key, Type type, void* out, size_t len) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    Handle* handle = findHandle(h);
+    if (!handle) return ESP_ERR_NVS_INVALID_HANDLE;
+    auto& ns = s_store[handle->name_space];
+    auto it = ns.find(key);
+    if (it == ns.end() || it->second.type != type) return ESP_ERR_NVS_NOT_FOUND;
+    memcpy(out, it->second.data.data(), len);
+    return ESP_OK;
+}
+
+/** 读取变长值：out 为空时只返回长度 */
+esp_err_t getVariable(nvs_handle_t h, const char* key, Type type, void* out, size_t* length) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    Handle* handle = findHandle(h);
+    if (!handle) return ESP_ERR_NVS_INVALID_HANDLE;
+    auto& ns = s_store[handle->name_space];
+    auto it = ns.find(key);
+    if (it == ns.end() || it->second.type != type) return ESP_ERR_NVS_NOT_FOUND;
+    size_t need = it->second.data.size();
+    if (!out) {
+        *length = need;
+        return ESP_OK;
+    }
+    if (*length < need) return ESP_ERR_NVS_INVALID_LENGTH;
+    memcpy(out, it->second.data.data(), need);
+    *length = need;
+    return ESP_OK;
+}
+
+} // namespace
+
+namespace host_sim {
+
+void nvsReset() {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_store.clear();
+}
+
+/*
+ * 镜像格式（按顺序重复）：
+ *   u16 命名空间长度 | 命名空间 | u16 键长度 | 键 | u8 类型 | u32 数据长度 | 数据
+ */
+bool nvsSave(const std::string& path) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    auto putStr = [f](const std::string& str) {
+        uint16_t len = static_cast<uint16_t>(str.size());
+        fwrite(&len, sizeof(len), 1, f);
+        fwrite(str.data(), 1, len, f);
+    };
+    for (const auto& ns : s_store) {
+        for (const auto& kv : ns.second) {
+            putStr(ns.first);
+            putStr(kv.first);
+            uint8_t type = static_cast<uint8_t>(kv.second.type);
+            uint32_t len = static_cast<uint32_t>(kv.second.data.size());
+            fwrite(&type, sizeof(type), 1, f);
+            fwrite(&len, sizeof(len), 1, f);
+            fwrite(kv.second.data.data(), 1, len, f);
+        }
+    }
+    return fclose(f) == 0;
+}
+
+bool nvsLoad(const std::string& path) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    auto getStr = [f](std::string& str) {
+        uint16_t len;
+        if (fread(&len, sizeof(len), 1, f) != 1) return false;
+        str.resize(len);
+        return fread(&str[0], 1, len, f) == len;
+    };
+    s_store.clear();
+    std::string ns, key;
+    bool ok = true;
+    while (getStr(ns)) {
+        uint8_t type;
+        uint32_t len;
+        if (!getStr(key) || fread(&type, sizeof(type), 1, f) != 1 || fread(&len, sizeof(len), 1, f) != 1) {
+            ok = false;
+            break;
+        }
+        Entry e{static_cast<Type>(type), std::vector<uint8_t>(len)};
+        if (fread(e.data.data(), 1, len, f) != len) {
+            ok = false;
+            break;
+        }
+        s_store[ns][key] = std::move(e);
+    }
+    fclose(f);
+    return ok;
+}
+
+} // namespace host_sim
+
+esp_err_t nvs_flash_init(void) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_deinit(void) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_initialized = false;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_store.clear();
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char* name_space, nvs_open_mode_t mode, nvs_handle_t* out_handle) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!s_initialized) return ESP_ERR_NVS_NOT_INITIALIZED;
+    // 只读打开不存在的命名空间时返回 NOT_FOUND，与真实 NVS 一致
+    if (mode == NVS_READONLY && s_store.find(name_space) == s_store.end()) return ESP_ERR_NVS_NOT_FOUND;
+    s_store[name_space];
+    nvs_handle_t h = s_next_handle++;
+    s_handles[h] = Handle{name_space, mode == NVS_READWRITE};
+    *out_handle = h;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_handles.erase(handle);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return findHandle(handle) ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    Handle* h = findHandle(handle);
+    if (!h) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (!h->writable) return ESP_ERR_NVS_READ_ONLY;
+    return s_store[h->name_space].erase(key) ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    Handle* h = findHandle(handle);
+    if (!h) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (!h->writable) return ESP_ERR_NVS_READ_ONLY;
+    s_store[h->name_space].clear();
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value) {
+    return setValue(handle, key, Type::STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* out_value, size_t* length) {
+    return getVariable(handle, key, Type::STR, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length) {
+    return setValue(handle, key, Type::BLOB, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length) {
+    return getVariable(handle, key, Type::BLOB, out_value, length);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char* key, uint8_t value) {
+    return setValue(handle, key, Type::U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char* key, uint8_t* out_value) {
+    return getValue(handle, key, Type::U8, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_set_i32(nvs_handle_t handle, const char* key, int32_t value) {
+    return setValue(handle, key, Type::I32, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char* key, int32_t* out_value) {
+    return getValue(handle, key, Type::I32, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char* key, uint32_t value) {
+    return setValue(handle, key, Type::U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char* key, uint32_t* out_value) {
+    return getValue(handle, key, Type::U32, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_set_u64(nvs_handle_t handle, const char* key, uint64_t value) {
+    return setValue(handle, key, Type::U64, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u64(nvs_handle_t handle, const char* key, uint64_t* out_value) {
+    return getValue(handle, key, Type::U64, out_value, sizeof(*out_value));
+}
@@ -0,0 +1,113 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-25 09:12:06
+ * @LastEditTime: 2025-06-25 10:41:37
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：电源管理配置、电源锁计数与唤醒源，只记录状态，不改变主机的运行速度
+ * @FilePath: \ESP32-ChunFeng\host\sim\src\pm_sim.cpp
+ * @遇事不决，可问春风
+ */
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "driver/gpio.h"
+#include "host_sim.hpp"
+#include <mutex>
+#include <string>
+
+struct esp_pm_lock {
+    esp_pm_lock_type_t type;
+    std::string name;
+    int count{0};
+};
+
+namespace {
+
+std::mutex s_mutex;
+esp_pm_config_t s_config{160, 160, false};
+int s_held[3] = {};     ///< 按锁类型统计被持有的次数
+uint32_t s_wake_sources = 0;
+
+} // namespace
+
+esp_err_t esp_pm_configure(const void* config) {
+    if (!config) return ESP_ERR_INVALID_ARG;
+    const esp_pm_config_t* c = static_cast<const esp_pm_config_t*>(config);
+    if (c->min_freq_mhz > c->max_freq_mhz) return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_config = *c;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_get_configuration(void* config) {
+    if (!config) return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    *static_cast<esp_pm_config_t*>(config) = s_config;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int, const char* name, esp_pm_lock_handle_t* out_handle) {
+    if (!out_handle || lock_type > ESP_PM_NO_LIGHT_SLEEP) return ESP_ERR_INVALID_ARG;
+    *out_handle = new esp_pm_lock{lock_type, name ? name : "", 0};
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_delete(esp_pm_lock_handle_t handle) {
+    if (!handle) return ESP_ERR_INVALID_ARG;
+    if (handle->count != 0) return ESP_ERR_INVALID_STATE;
+    delete handle;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle) {
+    if (!handle) return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    handle->count++;
+    s_held[handle->type]++;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle) {
+    if (!handle) return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (handle->count == 0) return ESP_ERR_INVALID_STATE;
+    handle->count--;
+    s_held[handle->type]--;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_wifi_wakeup(void) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_wake_sources |= host_sim::kWakeWifi;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup(void) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_wake_sources |= host_sim::kWakeGpio;
+    return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+    if (gpio_num < GPIO_NUM_0 || gpio_num >= GPIO_NUM_MAX) return ESP_ERR_INVALID_ARG;
+    if (intr_type != GPIO_INTR_LOW_LEVEL && intr_type != GPIO_INTR_HIGH_LEVEL) return ESP_ERR_INVALID_ARG;
+    return ESP_OK;
+}
+
+namespace host_sim {
+
+bool pmLightSleepAllowed() {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return s_config.light_sleep_enable && s_held[ESP_PM_NO_LIGHT_SLEEP] == 0;
+}
+
+int pmCpuFreqMhz() {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return s_held[ESP_PM_CPU_FREQ_MAX] > 0 ? s_config.max_freq_mhz : s_config.min_freq_mhz;
+}
+
+uint32_t pmWakeSources() {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return s_wake_sources;
+}
+
+} // namespace host_sim
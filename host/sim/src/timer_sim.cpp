@@ -0,0 +1,127 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-10 10:03:52
+ * @LastEditTime: 2025-06-10 10:12:45
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：esp_timer 定时器，与 ESP-IDF 一样所有回调在同一个 "esp_timer" 线程中串行执行
+ * @FilePath: \ESP32-ChunFeng\host\sim\src\timer_sim.cpp
+ * @遇事不决，可问春风
+ */
+#include "esp_timer.h"
+#include <pthread.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    uint64_t period_us;
+    int64_t due_us;         ///< 未启动时为 -1
+    bool deleted;
+};
+
+namespace {
+
+std::mutex s_mutex;
+std::condition_variable s_cv;
+std::multimap<int64_t, esp_timer*> s_queue;    // 到期时间 -> 定时器
+bool s_thread_started = false;
+
+void unschedule(esp_timer* t) {
+    if (t->due_us < 0) return;
+    auto range = s_queue.equal_range(t->due_us);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == t) {
+            s_queue.erase(it);
+            break;
+        }
+    }
+    t->due_us = -1;
+}
+
+void schedule(esp_timer* t, int64_t due_us) {
+    t->due_us = due_us;
+    s_queue.emplace(due_us, t);
+    s_cv.notify_one();
+}
+
+void timerTask() {
+    pthread_setname_np(pthread_self(), "esp_timer");
+    std::unique_lock<std::mutex> lock(s_mutex);
+    while (true) {
+        if (s_queue.empty()) {
+            s_cv.wait(lock);
+            continue;
+        }
+        int64_t now = esp_timer_get_time();
+        auto it = s_queue.begin();
+        if (it->first > now) {
+            s_cv.wait_for(lock, std::chrono::microseconds(it->first - now));
+            continue;
+        }
+        esp_timer* t = it->second;
+        s_queue.erase(it);
+        t->due_us = -1;
+        if (t->period_us) schedule(t, now + static_cast<int64_t>(t->period_us));
+        esp_timer_cb_t cb = t->callback;
+        void* arg = t->arg;
+        lock.unlock();
+        cb(arg);
+        lock.lock();
+    }
+}
+
+void ensureThread() {
+    if (s_thread_started) return;
+    s_thread_started = true;
+    std::thread(timerTask).detach();
+}
+
+} // namespace
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out_handle) {
+    if (!args || !args->callback || !out_handle) return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    ensureThread();
+    *out_handle = new esp_timer{args->callback, args->arg, 0, -1, false};
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (timer->due_us >= 0) return ESP_ERR_INVALID_STATE;
+    timer->period_us = 0;
+    schedule(timer, esp_timer_get_time() + static_cast<int64_t>(timeout_us));
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (timer->due_us >= 0) return ESP_ERR_INVALID_STATE;
+    timer->period_us = period_us;
+    schedule(timer, esp_timer_get_time() + static_cast<int64_t>(period_us));
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (timer->due_us < 0) return ESP_ERR_INVALID_STATE;
+    timer->period_us = 0;
+    unschedule(timer);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (timer->due_us >= 0) return ESP_ERR_INVALID_STATE;
+    delete timer;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return timer->due_us >= 0;
+}
@@ -0,0 +1,441 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-09 10:37:43
+ * @LastEditTime: 2025-07-01 16:22:10
+ * @LastEditors: 星年
+ * @Description: 主机构建替身：WiFi 驱动与 esp_netif。连接过程按 AP 脚本异步上报事件
+ * @FilePath: \ESP32-ChunFeng\host\sim\src\wifi_sim.cpp
+ * @遇事不决，可问春风
+ */
+#include "esp_wifi.h"
+#include "esp_netif.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#include "host_sim.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+
+struct esp_netif_obj {
+    bool sta;
+};
+
+namespace {
+
+std::mutex s_mutex;
+std::vector<host_sim::AccessPoint> s_aps;
+uint32_t s_scan_ms = 1200;
+uint32_t s_no_ap_ms = 1500;
+
+bool s_inited = false;
+bool s_started = false;
+wifi_mode_t s_mode = WIFI_MODE_NULL;
+wifi_config_t s_sta_config{};
+wifi_config_t s_ap_config{};
+wifi_ps_type_t s_ps = WIFI_PS_MIN_MODEM;
+std::vector<wifi_ap_record_t> s_scan_results;
+
+// 连接状态：每次 connect/disconnect 递增代号，过期的异步连接过程不再上报
+std::atomic<uint32_t> s_generation{0};
+std::atomic<uint32_t> s_connect_count{0};
+bool s_associated = false;
+bool s_has_ip = false;
+host_sim::AccessPoint s_current;
+
+esp_netif_obj s_sta_netif{true};
+esp_netif_obj s_ap_netif{false};
+
+bool hasSta() {
+    return s_mode == WIFI_MODE_STA || s_mode == WIFI_MODE_APSTA;
+}
+
+bool hasAp() {
+    return s_mode == WIFI_MODE_AP || s_mode == WIFI_MODE_APSTA;
+}
+
+void fillSsid(uint8_t* dst, uint8_t& len, const std::string& ssid) {
+    len = static_cast<uint8_t>(ssid.size() < 32 ? ssid.size() : 32);
+    memcpy(dst, ssid.data(), len);
+}
+
+void postDisconnected(const std::string& ssid, uint8_t reason, int8_t rssi) {
+    wifi_event_sta_disconnected_t ev{};
+    fillSsid(ev.ssid, ev.ssid_len, ssid);
+    ev.reason = reason;
+    ev.rssi = rssi;
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &ev, sizeof(ev), 0);
+}
+
+/** 链路断开（调用方持锁） */
+void dropLocked(uint8_t reason) {
+    if (!s_associated) return;
+    s_associated = false;
+    s_has_ip = false;
+    ++s_generation;
+    postDisconnected(s_current.ssid, reason, s_current.rssi);
+}
+
+void sleepMs(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// 与 lwIP 一致：上次租约保存在 NVS 的 dhcp_state 命名空间
+constexpr const char* kDhcpNamespace = "dhcp_state";
+constexpr const char* kDhcpKey = "sta";
+constexpr uint32_t kSimIp = 0x6401a8c0;         // 192.168.1.100
+constexpr uint32_t kArpCheckMs = 500;           // lwIP dhcp_check() 的 ARP 探测等待
+
+bool loadLastLease(uint32_t& ip) {
+    nvs_handle_t h;
+    if (nvs_open(kDhcpNamespace, NVS_READONLY, &h) != ESP_OK) return false;
+    bool ok = nvs_get_u32(h, kDhcpKey, &ip) == ESP_OK;
+    nvs_close(h);
+    return ok;
+}
+
+void storeLease(uint32_t ip) {
+    nvs_handle_t h;
+    if (nvs_open(kDhcpNamespace, NVS_READWRITE, &h) != ESP_OK) return;
+    nvs_set_u32(h, kDhcpKey, ip);
+    nvs_commit(h);
+    nvs_close(h);
+}
+
+/**
+ * @brief DHCP 耗时模型
+ *
+ * 首次获取：DISCOVER/OFFER/REQUEST/ACK 两个往返（ap.dhcp_ms），开启 ARP 检查时绑定前还要等一次 ARP 探测。
+ * 开启 CONFIG_LWIP_DHCP_RESTORE_LAST_IP 且有上次租约：INIT-REBOOT 直接 REQUEST/ACK，一个往返，不做 ARP 检查。
+ */
+uint32_t dhcpDuration(const host_sim::AccessPoint& ap) {
+#ifdef CONFIG_LWIP_DHCP_RESTORE_LAST_IP
+    uint32_t ip;
+    if (loadLastLease(ip) && ip == kSimIp) return ap.dhcp_ms / 2;
+#endif
+#ifdef CONFIG_LWIP_DHCP_DOES_ARP_CHECK
+    return ap.dhcp_ms + kArpCheckMs;
+#else
+    return ap.dhcp_ms;
+#endif
+}
+
+/** 异步连接过程：关联 -> STA_CONNECTED -> DHCP -> GOT_IP，或以断开事件结束 */
+void connectProcess(uint32_t generation, std::string ssid, std::string password) {
+    host_sim::AccessPoint ap;
+    bool found = false;
+    uint32_t no_ap_ms;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        for (const auto& a : s_aps) {
+            if (a.ssid == ssid) {
+                ap = a;
+                found = true;
+                break;
+            }
+        }
+        no_ap_ms = s_no_ap_ms;
+    }
+    if (!found) {
+        sleepMs(no_ap_ms);
+        if (s_generation.load() == generation) postDisconnected(ssid, WIFI_REASON_NO_AP_FOUND, 0);
+        return;
+    }
+    sleepMs(ap.assoc_ms);
+    if (ap.password != password) {
+        if (s_generation.load() == generation) postDisconnected(ssid, WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT, ap.rssi);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        if (s_generation.load() != generation) return;
+        s_associated = true;
+        s_current = ap;
+        wifi_event_sta_connected_t ev{};
+        fillSsid(ev.ssid, ev.ssid_len, ap.ssid);
+        ev.channel = ap.channel;
+        ev.authmode = ap.password.empty() ? WIFI_AUTH_OPEN : WIFI_AUTH_WPA2_PSK;
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &ev, sizeof(ev), 0);
+    }
+    sleepMs(dhcpDuration(ap));
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        if (s_generation.load() != generation || !s_associated) return;
+        s_has_ip = true;
+        ip_event_got_ip_t ev{};
+        ev.esp_netif = &s_sta_netif;
+        ev.ip_info.ip.addr = kSimIp;
+        ev.ip_info.netmask.addr = 0x00ffffff;  // 255.255.255.0
+        ev.ip_info.gw.addr = 0x0101a8c0;       // 192.168.1.1
+        ev.ip_changed = true;
+        esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &ev, sizeof(ev), 0);
+    }
+#ifdef CONFIG_LWIP_DHCP_RESTORE_LAST_IP
+    storeLease(kSimIp);
+#endif
+}
+
+} // namespace
+
+namespace host_sim {
+
+void wifiSetAccessPoints(const std::vector<AccessPoint>& aps) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_aps = aps;
+    if (s_associated) {
+        bool still_there = false;
+        for (const auto& a : s_aps) {
+            if (a.ssid == s_current.ssid) still_there = true;
+        }
+        if (!still_there) dropLocked(WIFI_REASON_BEACON_TIMEOUT);
+    }
+}
+
+void wifiSetScanDuration(uint32_t ms) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_scan_ms = ms;
+}
+
+void wifiSetNoApTimeout(uint32_t ms) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_no_ap_ms = ms;
+}
+
+void wifiDropConnection(uint8_t reason) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    dropLocked(reason);
+}
+
+uint32_t wifiConnectCount() {
+    return s_connect_count.load();
+}
+
+bool wifiHasIp() {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return s_has_ip;
+}
+
+} // namespace host_sim
+
+/* ---------- esp_netif ---------- */
+
+esp_err_t esp_netif_init(void) {
+    return ESP_OK;
+}
+
+esp_netif_t* esp_netif_create_default_wifi_ap(void) {
+    return &s_ap_netif;
+}
+
+esp_netif_t* esp_netif_create_default_wifi_sta(void) {
+    return &s_sta_netif;
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t* netif, esp_netif_ip_info_t* ip_info) {
+    *ip_info = {};
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (netif == &s_ap_netif) {
+        ip_info->ip.addr = 0x0104a8c0;  // 192.168.4.1
+    } else if (s_has_ip) {
+        ip_info->ip.addr = kSimIp;
+    }
+    return ESP_OK;
+}
+
+esp_netif_t* esp_netif_get_handle_from_ifkey(const char* if_key) {
+    if (strcmp(if_key, "WIFI_STA_DEF") == 0) return &s_sta_netif;
+    if (strcmp(if_key, "WIFI_AP_DEF") == 0) return &s_ap_netif;
+    return nullptr;
+}
+
+esp_err_t esp_netif_get_dns_info(esp_netif_t* netif, esp_netif_dns_type_t type, esp_netif_dns_info_t* dns) {
+    *dns = {};
+    std::lock_guard<std::mutex> lock(s_mutex);
+    // DHCP 下发的 DNS 即网关
+    if (netif == &s_sta_netif && type == ESP_NETIF_DNS_MAIN && s_has_ip) {
+        dns->ip.u_addr.ip4.addr = 0x0101a8c0;
+    }
+    dns->ip.type = ESP_IPADDR_TYPE_V4;
+    return ESP_OK;
+}
+
+/* ---------- esp_wifi ---------- */
+
+esp_err_t esp_wifi_init(const wifi_init_config_t*) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_inited = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_deinit(void) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_inited = false;
+    s_started = false;
+    s_associated = false;
+    s_has_ip = false;
+    ++s_generation;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!s_inited) return ESP_ERR_WIFI_NOT_INIT;
+    s_mode = mode;
+    if (hasAp()) s_ps = WIFI_PS_NONE;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mode(wifi_mode_t* mode) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!s_inited) return ESP_ERR_WIFI_NOT_INIT;
+    *mode = s_mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t* conf) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!s_inited) return ESP_ERR_WIFI_NOT_INIT;
+    (interface == WIFI_IF_STA ? s_sta_config : s_ap_config) = *conf;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t* conf) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!s_inited) return ESP_ERR_WIFI_NOT_INIT;
+    *conf = interface == WIFI_IF_STA ? s_sta_config : s_ap_config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!s_inited) return ESP_ERR_WIFI_NOT_INIT;
+    if (!s_started) {
+        s_started = true;
+        if (hasSta()) esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_START, nullptr, 0, 0);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_stop(void) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!s_inited) return ESP_ERR_WIFI_NOT_INIT;
+    dropLocked(WIFI_REASON_ASSOC_LEAVE);
+    if (s_started && hasSta()) esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_STOP, nullptr, 0, 0);
+    s_started = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void) {
+    std::string ssid, password;
+    uint32_t generation;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        if (!s_inited) return ESP_ERR_WIFI_NOT_INIT;
+        if (!s_started) return ESP_ERR_WIFI_NOT_STARTED;
+        if (!hasSta()) return ESP_ERR_WIFI_CONN;
+        // 重新连接前先断开当前 AP
+        dropLocked(WIFI_REASON_ASSOC_LEAVE);
+        generation = ++s_generation;
+        ssid.assign(reinterpret_cast<const char*>(s_sta_config.sta.ssid),
+                    strnlen(reinterpret_cast<const char*>(s_sta_config.sta.ssid), sizeof(s_sta_config.sta.ssid)));
+        password.assign(reinterpret_cast<const char*>(s_sta_config.sta.password),
+                        strnlen(reinterpret_cast<const char*>(s_sta_config.sta.password),
+                                sizeof(s_sta_config.sta.password)));
+    }
+    ++s_connect_count;
+    std::thread(connectProcess, generation, ssid, password).detach();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_disconnect(void) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!s_inited) return ESP_ERR_WIFI_NOT_INIT;
+    if (!s_started) return ESP_ERR_WIFI_NOT_STARTED;
+    ++s_generation;
+    dropLocked(WIFI_REASON_ASSOC_LEAVE);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t*, bool block) {
+    uint32_t scan_ms;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        if (!s_inited) return ESP_ERR_WIFI_NOT_INIT;
+        if (!s_started) return ESP_ERR_WIFI_NOT_STARTED;
+        scan_ms = s_scan_ms;
+    }
+    auto finish = [] {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        s_scan_results.clear();
+        for (const auto& a : s_aps) {
+            wifi_ap_record_t rec{};
+            uint8_t len;
+            fillSsid(rec.ssid, len, a.ssid);
+            rec.primary = a.channel;
+            rec.rssi = a.rssi;
+            rec.authmode = a.password.empty() ? WIFI_AUTH_OPEN : WIFI_AUTH_WPA2_PSK;
+            s_scan_results.push_back(rec);
+        }
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, nullptr, 0, 0);
+    };
+    if (block) {
+        sleepMs(scan_ms);
+        finish();
+    } else {
+        std::thread([scan_ms, finish] {
+            sleepMs(scan_ms);
+            finish();
+        }).detach();
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_num(uint16_t* number) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    *number = static_cast<uint16_t>(s_scan_results.size());
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t* number, wifi_ap_record_t* ap_records) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    uint16_t n = *number < s_scan_results.size() ? *number : static_cast<uint16_t>(s_scan_results.size());
+    for (uint16_t i = 0; i < n; ++i) {
+        ap_records[i] = s_scan_results[i];
+    }
+    *number = n;
+    // 与真实驱动一致：读取后释放扫描结果
+    s_scan_results.clear();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t* ap_info) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!s_associated) return ESP_ERR_WIFI_NOT_CONNECT;
+    *ap_info = {};
+    uint8_t len;
+    fillSsid(ap_info->ssid, len, s_current.ssid);
+    ap_info->primary = s_current.channel;
+    ap_info->rssi = s_current.rssi;
+    ap_info->authmode = s_current.password.empty() ? WIFI_AUTH_OPEN : WIFI_AUTH_WPA2_PSK;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    // 与驱动一致：softAP 开启时射频不能休眠
+    if (hasAp() && type != WIFI_PS_NONE) return ESP_ERR_WIFI_MODE;
+    s_ps = type;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_ps(wifi_ps_type_t* type) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    *type = s_ps;
+    return ESP_OK;
+}
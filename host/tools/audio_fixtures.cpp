@@ -0,0 +1,668 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-26 09:20:41
+ * @LastEditTime: 2025-06-30 17:46:09
+ * @LastEditors: 星年
+ * @Description: 音频测试素材（主机端）：WAV 分块读写、声源合成与阵列传播、电平扫描、指令短语合成、按标注的信噪比与电平、逐帧处理计时
+ * @FilePath: \ESP32-ChunFeng\host\tools\audio_fixtures.cpp
+ * @遇事不决，可问春风
+ */
+#include "audio_fixtures.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+namespace chunfeng {
+namespace fixtures {
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kSpeedOfSound = 343.0;
+constexpr double kFullScaleRms = 32767.0 / 1.4142135623730951;     // 满量程正弦为 0dBFS
+constexpr double kSelfNoiseDbfs = -75;
+
+void put16(std::vector<uint8_t>& out, uint16_t v) {
+    out.push_back(static_cast<uint8_t>(v));
+    out.push_back(static_cast<uint8_t>(v >> 8));
+}
+
+void put32(std::vector<uint8_t>& out, uint32_t v) {
+    put16(out, static_cast<uint16_t>(v));
+    put16(out, static_cast<uint16_t>(v >> 16));
+}
+
+uint16_t get16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+uint32_t get32(const uint8_t* p) { return get16(p) | (static_cast<uint32_t>(get16(p + 2)) << 16); }
+
+double dbToPower(double db) { return std::pow(10.0, db / 10); }
+
+/** 一个音节：基频从 f0_begin 滑到 f0_end，三个共振峰决定元音 */
+struct Syllable {
+    double begin;
+    double length;
+    double f0_begin;
+    double f0_end;
+    double formants[3];
+};
+
+/** 单个说话人：说 2~5 个音节的词，词间停顿 0.3~1.2s */
+std::vector<Syllable> makeTalk(std::mt19937& rng, double seconds, double f0, double start) {
+    static const double kVowels[][3] = {
+        {800, 1200, 2500}, {300, 2300, 3000}, {350, 800, 2300}, {500, 1800, 2500}, {500, 900, 2400},
+    };
+    std::uniform_real_distribution<double> unit(0, 1);
+    std::vector<Syllable> talk;
+    double t = start;
+    while (t < seconds) {
+        int syllables = 2 + static_cast<int>(unit(rng) * 4);
+        for (int i = 0; i < syllables && t < seconds; ++i) {
+            Syllable s;
+            s.begin = t;
+            s.length = 0.15 + unit(rng) * 0.15;
+            s.f0_begin = f0 * (0.9 + unit(rng) * 0.25);
+            s.f0_end = s.f0_begin * (0.85 + unit(rng) * 0.2);
+            const double* v = kVowels[static_cast<size_t>(unit(rng) * 5) % 5];
+            for (int k = 0; k < 3; ++k) s.formants[k] = v[k] * (0.92 + unit(rng) * 0.16);
+            talk.push_back(s);
+            t += s.length + 0.03;
+        }
+        t += 0.3 + unit(rng) * 0.9;
+    }
+    return talk;
+}
+
+/** 谐波合成：音节内正弦包络，谐波幅度取共振峰响应加 -6dB/倍频程的声门倾斜 */
+std::vector<double> renderTalk(const std::vector<Syllable>& talk, uint32_t rate, size_t frames) {
+    std::vector<double> out(frames, 0.0);
+    const double top = std::min(4000.0, rate / 2.0 - 200);
+    for (const Syllable& s : talk) {
+        size_t first = static_cast<size_t>(s.begin * rate);
+        size_t count = static_cast<size_t>(s.length * rate);
+        double phase = 0;
+        for (size_t i = 0; i < count && first + i < frames; ++i) {
+            double x = static_cast<double>(i) / count;
+            double f0 = s.f0_begin + (s.f0_end - s.f0_begin) * x;
+            double env = std::sin(kPi * x);
+            phase += 2 * kPi * f0 / rate;
+            double v = 0;
+            for (int h = 1; h * f0 < top; ++h) {
+                double f = h * f0;
+                double a = 0;
+                for (int k = 0; k < 3; ++k) {
+                    double d = (f - s.formants[k]) / (60 + 0.06 * s.formants[k]);
+                    a += 1 / (1 + d * d);
+                }
+                v += a / (1 + f / 300) * std::sin(h * phase);
+            }
+            out[first + i] += env * v;
+        }
+    }
+    return out;
+}
+
+/** 宽带“音乐”：粉红化的噪声，按节拍调幅 */
+std::vector<double> renderMusic(std::mt19937& rng, uint32_t rate, size_t frames) {
+    std::normal_distribution<double> white(0, 1);
+    std::vector<double> out(frames);
+    double b0 = 0, b1 = 0, b2 = 0;
+    for (size_t n = 0; n < frames; ++n) {
+        double w = white(rng);
+        b0 = 0.99765 * b0 + w * 0.0990460;
+        b1 = 0.96300 * b1 + w * 0.2965164;
+        b2 = 0.57000 * b2 + w * 1.0526913;
+        double beat = 0.6 + 0.4 * std::sin(2 * kPi * 2.0 * n / rate);
+        out[n] = (b0 + b1 + b2 + w * 0.1848) * beat;
+    }
+    return out;
+}
+
+/** 分数延迟（加窗 sinc，离线处理可以用未来样本） */
+std::vector<double> delayed(const std::vector<double>& in, double delay) {
+    constexpr int kHalf = 16;
+    double taps[2 * kHalf + 1];
+    for (int k = -kHalf; k <= kHalf; ++k) {
+        double x = k - delay;
+        double sinc = std::fabs(x) < 1e-9 ? 1.0 : std::sin(kPi * x) / (kPi * x);
+        double window = std::fabs(x) >= kHalf + 1 ? 0 : 0.5 + 0.5 * std::cos(kPi * x / (kHalf + 1));
+        taps[k + kHalf] = sinc * window;
+    }
+    std::vector<double> out(in.size(), 0.0);
+    const long size = static_cast<long>(in.size());
+    for (long n = 0; n < size; ++n) {
+        double acc = 0;
+        for (int k = -kHalf; k <= kHalf; ++k) {
+            long m = n - k;
+            if (m >= 0 && m < size) acc += in[m] * taps[k + kHalf];
+        }
+        out[n] = acc;
+    }
+    return out;
+}
+
+/** 第 c 个麦克风相对阵列中心的到达延迟（样本）：正角度偏向序号大的麦克风，它先收到 */
+double arrivalDelay(const FixtureSpec& spec, uint16_t c, int deg) {
+    double x = (c - (spec.channels - 1) / 2.0) * spec.mic_spacing_mm / 1000.0;
+    return -x * std::sin(deg * kPi / 180) / kSpeedOfSound * spec.sample_rate;
+}
+
+double meanPower(const std::vector<double>& v) {
+    double sum = 0;
+    for (double x : v) sum += x * x;
+    return v.empty() ? 0 : sum / v.size();
+}
+
+/** 第一路在 [begin_ms, end_ms) 内按标注分成说话段 [1] 与静音段 [0] 的功率和与样本数 */
+void segmentPowers(const Wav& wav, size_t latency, uint32_t begin_ms, uint32_t end_ms, double power[2],
+                   size_t count[2]) {
+    const size_t segment = wav.sample_rate * kSegmentMs / 1000;
+    const size_t frames = wav.frames();
+    power[0] = power[1] = 0;
+    count[0] = count[1] = 0;
+    for (size_t i = begin_ms / kSegmentMs; i < end_ms / kSegmentMs && (i + 1) * segment <= frames; ++i) {
+        // 输出第 i 段对应输入的第 j 段；标注变化前后的段不计
+        long j = (static_cast<long>(i * segment) - static_cast<long>(latency) + static_cast<long>(segment / 2)) /
+                 static_cast<long>(segment);
+        if (j < 1 || static_cast<size_t>(j + 1) >= wav.active.size()) continue;
+        uint8_t a = wav.active[j];
+        if (wav.active[j - 1] != a || wav.active[j + 1] != a) continue;
+        for (size_t n = i * segment; n < (i + 1) * segment; ++n) {
+            double v = wav.samples[n * wav.channels];
+            power[a] += v * v;
+        }
+        count[a] += segment;
+    }
+}
+
+/** 声母 */
+enum Onset : uint8_t {
+    NONE,
+    SIBILANT,       ///< s、x、j、q：高频噪声
+    RETROFLEX,      ///< sh、zh：中高频噪声
+    STOP,           ///< d、t、g：闭塞后短促的爆破
+    SONORANT,       ///< w、l：低沉的浊音过渡
+    ASPIRATE,       ///< h：宽带气流声
+};
+
+/** 短语中的一个音节：韵母的共振峰从 begin 滑到 end，声调 1~4，length 为韵母秒数 */
+struct PhraseSyllable {
+    Onset onset;
+    uint8_t tone;
+    double begin[3];
+    double end[3];
+    double length;
+};
+
+struct Phrase {
+    const char* name;
+    PhraseSyllable syllables[4];
+    size_t count;
+};
+
+// 韵母的共振峰（Hz，成年男声）
+#define CF_A {800, 1200, 2500}
+#define CF_I {300, 2300, 3000}
+#define CF_U {350, 800, 2300}
+#define CF_E {500, 1500, 2500}
+#define CF_O {500, 900, 2400}
+#define CF_V {300, 1800, 2400}
+#define CF_EH {550, 1800, 2500}
+#define CF_NG {320, 1100, 2400}
+#define CF_N {300, 1900, 2700}
+#define CF_R {350, 1400, 1700}
+
+const Phrase kPhraseTable[kPhrases] = {
+    {"da4 sheng1 dian3", {{STOP, 4, CF_A, CF_A, 0.20}, {RETROFLEX, 1, CF_E, CF_NG, 0.22}, {STOP, 3, CF_I, CF_EH, 0.25}}, 3},
+    {"xiao3 sheng1 dian3",
+     {{SIBILANT, 3, CF_I, CF_U, 0.25}, {RETROFLEX, 1, CF_E, CF_NG, 0.22}, {STOP, 3, CF_I, CF_EH, 0.25}}, 3},
+    {"ting2 zhi3", {{STOP, 2, CF_I, CF_NG, 0.26}, {RETROFLEX, 3, CF_R, CF_R, 0.26}}, 2},
+    {"wang3 luo4 zhuang4 tai4",
+     {{SONORANT, 3, CF_U, CF_NG, 0.22}, {SONORANT, 4, CF_U, CF_O, 0.18}, {RETROFLEX, 4, CF_U, CF_A, 0.22},
+      {STOP, 4, CF_A, CF_I, 0.20}}, 4},
+    // 词表外：前两条与“大声点”“小声点”开头相同，后两条无关
+    {"da3 dian4 hua4", {{STOP, 3, CF_A, CF_A, 0.20}, {STOP, 4, CF_I, CF_EH, 0.22}, {ASPIRATE, 4, CF_U, CF_A, 0.22}}, 3},
+    {"xiao3 sheng1 yin1 yue4",
+     {{SIBILANT, 3, CF_I, CF_U, 0.25}, {RETROFLEX, 1, CF_E, CF_NG, 0.22}, {NONE, 1, CF_I, CF_N, 0.20},
+      {NONE, 4, CF_V, CF_EH, 0.22}}, 4},
+    {"jin1 tian1 tian1 qi4",
+     {{SIBILANT, 1, CF_I, CF_N, 0.20}, {STOP, 1, CF_I, CF_N, 0.20}, {STOP, 1, CF_I, CF_N, 0.20},
+      {SIBILANT, 4, CF_I, CF_I, 0.20}}, 4},
+    {"jiang3 ge4 gu4 shi4",
+     {{SIBILANT, 3, CF_I, CF_NG, 0.24}, {STOP, 4, CF_E, CF_E, 0.16}, {STOP, 4, CF_U, CF_U, 0.18},
+      {RETROFLEX, 4, CF_R, CF_R, 0.20}}, 4},
+};
+
+#undef CF_A
+#undef CF_I
+#undef CF_U
+#undef CF_E
+#undef CF_O
+#undef CF_V
+#undef CF_EH
+#undef CF_NG
+#undef CF_N
+#undef CF_R
+
+/** 声调的基频轮廓（相对说话人基频），x 为韵母内的位置 0~1 */
+double toneContour(uint8_t tone, double x) {
+    switch (tone) {
+    case 1: return 1.3;
+    case 2: return 1.0 + 0.35 * x;
+    case 3: return x < 0.5 ? 0.95 - 0.4 * x : 0.75 + 0.3 * (x - 0.5);
+    default: return 1.4 - 0.55 * x;
+    }
+}
+
+/** 二阶带通（RBJ），中心 center、带宽 bandwidth（Hz） */
+struct Bandpass {
+    double b0, b2, a1, a2;
+    double x1{0}, x2{0}, y1{0}, y2{0};
+    Bandpass(double center, double bandwidth, double rate) {
+        double w = 2 * kPi * center / rate;
+        double q = center / bandwidth;
+        double alpha = std::sin(w) / (2 * q);
+        double a0 = 1 + alpha;
+        b0 = alpha / a0;
+        b2 = -alpha / a0;
+        a1 = -2 * std::cos(w) / a0;
+        a2 = (1 - alpha) / a0;
+    }
+    double operator()(double x) {
+        double y = b0 * x + b2 * x2 - a1 * y1 - a2 * y2;
+        x2 = x1;
+        x1 = x;
+        y2 = y1;
+        y1 = y;
+        return y;
+    }
+};
+
+/**
+ * @brief 谐波合成一段浊音：基频与共振峰随时间线性变化，首尾 fade 秒淡入淡出
+ * @param from/to 开始与结束时的三个共振峰
+ */
+void renderVoiced(std::vector<double>& out, size_t first, size_t count, uint32_t rate, double& phase, double f0_from,
+                  double f0_to, uint8_t tone, const double* from, const double* to, double gain, double fade) {
+    const double top = std::min(4000.0, rate / 2.0 - 200);
+    for (size_t i = 0; i < count && first + i < out.size(); ++i) {
+        double x = static_cast<double>(i) / count;
+        double f0 = tone ? f0_from * toneContour(tone, x) : f0_from + (f0_to - f0_from) * x;
+        phase += 2 * kPi * f0 / rate;
+        double edge = std::min(1.0, std::min(i, count - i) / (fade * rate));
+        double v = 0;
+        for (int h = 1; h * f0 < top; ++h) {
+            double f = h * f0;
+            double a = 0;
+            for (int k = 0; k < 3; ++k) {
+                double formant = from[k] + (to[k] - from[k]) * x;
+                double d = (f - formant) / (60 + 0.06 * formant);
+                a += 1 / (1 + d * d);
+            }
+            v += a / (1 + f / 300) * std::sin(h * phase);
+        }
+        out[first + i] += gain * edge * v;
+    }
+}
+
+} // namespace
+
+bool readWav(const std::string& path, Wav& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) != 0 || memcmp(data.data() + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+    bool have_format = false;
+    bool have_data = false;
+    out.active.clear();
+    for (size_t pos = 12; pos + 8 <= data.size();) {
+        const uint8_t* chunk = data.data() + pos;
+        uint32_t size = get32(chunk + 4);
+        if (pos + 8 + size > data.size()) return false;
+        const uint8_t* body = chunk + 8;
+        if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+            // 只接受 16 位 PCM
+            if (get16(body) != 1 || get16(body + 14) != 16) return false;
+            out.channels = get16(body + 2);
+            out.sample_rate = get32(body + 4);
+            have_format = out.channels > 0;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            out.samples.resize(size / 2);
+            for (size_t i = 0; i < out.samples.size(); ++i) out.samples[i] = static_cast<int16_t>(get16(body + 2 * i));
+            have_data = true;
+        } else if (memcmp(chunk, "actv", 4) == 0) {
+            out.active.assign(body, body + size);
+        }
+        pos += 8 + size + (size & 1);
+    }
+    return have_format && have_data;
+}
+
+bool writeWav(const std::string& path, const Wav& wav) {
+    std::vector<uint8_t> data;
+    data.insert(data.end(), {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+    put32(data, 16);
+    put16(data, 1);
+    put16(data, wav.channels);
+    put32(data, wav.sample_rate);
+    put32(data, wav.sample_rate * wav.channels * 2);
+    put16(data, static_cast<uint16_t>(wav.channels * 2));
+    put16(data, 16);
+    if (!wav.active.empty()) {
+        data.insert(data.end(), {'a', 'c', 't', 'v'});
+        put32(data, static_cast<uint32_t>(wav.active.size()));
+        data.insert(data.end(), wav.active.begin(), wav.active.end());
+        if (wav.active.size() & 1) data.push_back(0);
+    }
+    data.insert(data.end(), {'d', 'a', 't', 'a'});
+    put32(data, static_cast<uint32_t>(wav.samples.size() * 2));
+    for (int16_t s : wav.samples) put16(data, static_cast<uint16_t>(s));
+    uint32_t riff = static_cast<uint32_t>(data.size() - 8);
+    memcpy(data.data() + 4, &riff, 4);
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(out);
+}
+
+Wav makeFixture(const FixtureSpec& spec) {
+    std::mt19937 rng(spec.seed);
+    const size_t frames = static_cast<size_t>(spec.seconds) * spec.sample_rate;
+    const uint16_t channels = std::max<uint16_t>(spec.channels, 1);
+
+    // 说话人：开头留 1.5s 只有噪声，让降噪先收敛
+    std::vector<Syllable> talk = makeTalk(rng, spec.seconds - 0.3, 150, 1.5);
+    std::vector<double> speech = renderTalk(talk, spec.sample_rate, frames);
+
+    Wav wav;
+    wav.sample_rate = spec.sample_rate;
+    wav.channels = channels;
+    const size_t segment = spec.sample_rate * kSegmentMs / 1000;
+    wav.active.assign(frames / segment, 0);
+    for (const Syllable& s : talk) {
+        size_t first = static_cast<size_t>(s.begin * 1000 / kSegmentMs + 0.5);
+        size_t last = static_cast<size_t>((s.begin + s.length) * 1000 / kSegmentMs + 0.5);
+        for (size_t i = first; i < last && i < wav.active.size(); ++i) wav.active[i] = 1;
+    }
+    double speech_power = 0;
+    size_t speech_count = 0;
+    for (size_t i = 0; i < wav.active.size(); ++i) {
+        if (!wav.active[i]) continue;
+        for (size_t n = i * segment; n < (i + 1) * segment; ++n) speech_power += speech[n] * speech[n];
+        speech_count += segment;
+    }
+    speech_power /= std::max<size_t>(speech_count, 1);
+    const double speech_gain = kFullScaleRms * std::sqrt(dbToPower(spec.speech_dbfs) / speech_power);
+
+    // 方向性声源：阵列中心的信号按各麦克风的到达时间差延迟
+    std::vector<std::vector<double>> mics(channels);
+    for (uint16_t c = 0; c < channels; ++c) {
+        mics[c] = delayed(speech, arrivalDelay(spec, c, spec.talker_deg));
+        for (double& v : mics[c]) v *= speech_gain;
+    }
+
+    std::vector<std::vector<double>> noise(channels, std::vector<double>(frames, 0.0));
+    std::normal_distribution<double> white(0, 1);
+    if (spec.noise == Noise::FAN) {
+        // 一半功率各麦克风共有，一半各自独立（低频为主的扩散声场在 45mm 间距下部分相关），加 100Hz 哼声
+        std::vector<double> common(frames);
+        double state = 0;
+        for (double& v : common) v = state = 0.95 * state + white(rng);
+        for (uint16_t c = 0; c < channels; ++c) {
+            double own = 0;
+            for (size_t n = 0; n < frames; ++n) {
+                own = 0.95 * own + white(rng);
+                double hum = 1.5 * std::sin(2 * kPi * 100 * n / spec.sample_rate) +
+                             0.7 * std::sin(2 * kPi * 200 * n / spec.sample_rate);
+                noise[c][n] = 0.7071 * (common[n] + own) + hum;
+            }
+        }
+    } else {
+        // 电视：三个人声（语速、音高各不相同）加音乐，都从 noise_deg 方向传来
+        std::vector<double> tv = renderMusic(rng, spec.sample_rate, frames);
+        double music_power = meanPower(tv);
+        const double f0s[] = {110, 210, 170};
+        for (double f0 : f0s) {
+            std::vector<double> voice = renderTalk(makeTalk(rng, spec.seconds, f0, 0), spec.sample_rate, frames);
+            double gain = std::sqrt(music_power / std::max(meanPower(voice), 1e-12));
+            for (size_t n = 0; n < frames; ++n) tv[n] += gain * voice[n];
+        }
+        for (uint16_t c = 0; c < channels; ++c) noise[c] = delayed(tv, arrivalDelay(spec, c, spec.noise_deg));
+    }
+    const double noise_gain = std::sqrt(dbToPower(spec.speech_dbfs - spec.snr_db) * kFullScaleRms * kFullScaleRms /
+                                        std::max(meanPower(noise[0]), 1e-12));
+    const double self_noise = kFullScaleRms * std::sqrt(dbToPower(kSelfNoiseDbfs));
+
+    wav.samples.resize(frames * channels);
+    for (size_t n = 0; n < frames; ++n) {
+        for (uint16_t c = 0; c < channels; ++c) {
+            double v = mics[c][n] + noise_gain * noise[c][n] + self_noise * white(rng);
+            v = std::round(v);
+            wav.samples[n * channels + c] = static_cast<int16_t>(std::clamp(v, -32768.0, 32767.0));
+        }
+    }
+    return wav;
+}
+
+double snrDb(const Wav& wav, size_t latency, uint32_t skip_ms) {
+    double power[2];
+    size_t count[2];
+    segmentPowers(wav, latency, skip_ms, UINT32_MAX, power, count);
+    if (!count[0] || !count[1]) return 0;
+    double noise = power[0] / count[0];
+    double speech = power[1] / count[1] - noise;
+    return 10 * std::log10(std::max(speech, noise * 1e-3) / std::max(noise, 1e-9));
+}
+
+const char* phraseName(size_t phrase) {
+    return phrase < kPhrases ? kPhraseTable[phrase].name : "?";
+}
+
+Talker makeTalker(uint32_t id) {
+    if (id == 0) return Talker{};
+    std::mt19937 rng(1000 + id);
+    std::uniform_real_distribution<double> unit(0, 1);
+    Talker t;
+    // 基频高的说话人声道通常也短，共振峰整体偏高
+    double voice = unit(rng);
+    t.f0 = 100 + voice * 140;
+    t.formant_scale = 0.92 + voice * 0.2 + (unit(rng) - 0.5) * 0.06;
+    t.tempo = 0.8 + unit(rng) * 0.45;
+    return t;
+}
+
+Wav makeUtterance(size_t phrase, const Talker& talker, const UtteranceSpec& spec) {
+    std::mt19937 rng(spec.seed * 7919 + static_cast<uint32_t>(phrase));
+    std::uniform_real_distribution<double> unit(0, 1);
+    std::normal_distribution<double> white(0, 1);
+    auto jitter = [&](double amount) { return 1 + (unit(rng) - 0.5) * 2 * amount; };
+    const uint32_t rate = spec.sample_rate;
+    const Phrase& p = kPhraseTable[phrase % kPhrases];
+    const size_t gap = rate / 50;   // 音节之间 20ms
+
+    // 先按说话人与这一遍的随机量排好各音节，再确定总长度
+    struct Timed {
+        const PhraseSyllable* s;
+        size_t onset;
+        size_t vowel;
+        double f0;
+        double formants[2][3];
+    };
+    std::vector<Timed> timed;
+    size_t speech = 0;
+    for (size_t i = 0; i < p.count; ++i) {
+        Timed t;
+        t.s = &p.syllables[i];
+        double onset = t.s->onset == NONE ? 0 : (t.s->onset == STOP ? 0.04 : 0.08) * talker.tempo * jitter(0.2);
+        t.onset = static_cast<size_t>(onset * rate);
+        t.vowel = static_cast<size_t>(t.s->length * talker.tempo * jitter(0.12) * rate);
+        t.f0 = talker.f0 * jitter(0.06);
+        for (int k = 0; k < 3; ++k) {
+            t.formants[0][k] = t.s->begin[k] * talker.formant_scale * jitter(0.04);
+            t.formants[1][k] = t.s->end[k] * talker.formant_scale * jitter(0.04);
+        }
+        speech += t.onset + t.vowel + (i + 1 < p.count ? gap : 0);
+        timed.push_back(t);
+    }
+    const size_t lead = spec.lead_ms * rate / 1000;
+    const size_t frames = lead + speech + spec.tail_ms * rate / 1000;
+    std::vector<double> voice(frames, 0.0);
+
+    size_t pos = lead;
+    double phase = 0;
+    for (const Timed& t : timed) {
+        constexpr double kOnsetGain = 0.35;     // 声母相对韵母的幅度
+        switch (t.s->onset) {
+        case SIBILANT:
+        case RETROFLEX:
+        case ASPIRATE: {
+            double center = t.s->onset == SIBILANT ? 5000 : t.s->onset == RETROFLEX ? 3000 : 1500;
+            Bandpass bp(std::min(center * talker.formant_scale, rate / 2.0 - 1000),
+                        t.s->onset == ASPIRATE ? 2500 : 2000, rate);
+            for (size_t i = 0; i < t.onset; ++i) {
+                voice[pos + i] += kOnsetGain * 3 * std::sin(kPi * i / t.onset) * bp(white(rng));
+            }
+            break;
+        }
+        case STOP: {
+            // 前面闭塞（无声），最后 10ms 宽带爆破
+            size_t burst = std::min<size_t>(t.onset / 3, rate / 100);
+            for (size_t i = 0; i < burst; ++i) {
+                voice[pos + t.onset - burst + i] += kOnsetGain * 2 * white(rng) * (1.0 - static_cast<double>(i) / burst);
+            }
+            break;
+        }
+        case SONORANT: {
+            const double nasal[3] = {250 * talker.formant_scale, 1000 * talker.formant_scale,
+                                     2300 * talker.formant_scale};
+            const double f0 = t.f0 * toneContour(t.s->tone, 0);
+            renderVoiced(voice, pos, t.onset, rate, phase, f0, f0, 0, nasal, t.formants[0], kOnsetGain, 0.01);
+            break;
+        }
+        case NONE:
+            break;
+        }
+        pos += t.onset;
+        renderVoiced(voice, pos, t.vowel, rate, phase, t.f0, t.f0, t.s->tone, t.formants[0], t.formants[1], 1.0, 0.02);
+        pos += t.vowel + gap;
+    }
+
+    Wav wav;
+    wav.sample_rate = rate;
+    const size_t segment = rate * kSegmentMs / 1000;
+    wav.active.assign(frames / segment, 0);
+    for (size_t i = lead / segment; i < (lead + speech) / segment && i < wav.active.size(); ++i) wav.active[i] = 1;
+    double power = 0;
+    for (size_t n = lead; n < lead + speech; ++n) power += voice[n] * voice[n];
+    const double gain = kFullScaleRms * std::sqrt(dbToPower(spec.speech_dbfs) / std::max(power / speech, 1e-12));
+
+    // 风扇式的低频噪声，另加麦克风自噪声
+    std::vector<double> noise(frames);
+    double state = 0;
+    for (double& v : noise) v = state = 0.95 * state + white(rng);
+    const double noise_gain =
+        kFullScaleRms * std::sqrt(dbToPower(spec.speech_dbfs - spec.snr_db) / std::max(meanPower(noise), 1e-12));
+    const double self_noise = kFullScaleRms * std::sqrt(dbToPower(kSelfNoiseDbfs));
+    wav.samples.resize(frames);
+    for (size_t n = 0; n < frames; ++n) {
+        double v = std::round(gain * voice[n] + noise_gain * noise[n] + self_noise * white(rng));
+        wav.samples[n] = static_cast<int16_t>(std::clamp(v, -32768.0, 32767.0));
+    }
+    return wav;
+}
+
+Wav makeLevelSweep(const std::vector<double>& levels_dbfs, uint32_t step_seconds, double noise_dbfs,
+                   uint32_t sample_rate, uint32_t seed) {
+    std::mt19937 rng(seed);
+    const double seconds = static_cast<double>(levels_dbfs.size() * step_seconds);
+    const size_t frames = levels_dbfs.size() * step_seconds * sample_rate;
+    std::vector<Syllable> talk = makeTalk(rng, seconds - 0.3, 150, 0.5);
+    std::vector<double> speech = renderTalk(talk, sample_rate, frames);
+
+    Wav wav;
+    wav.sample_rate = sample_rate;
+    const size_t segment = sample_rate * kSegmentMs / 1000;
+    wav.active.assign(frames / segment, 0);
+    for (const Syllable& s : talk) {
+        size_t first = static_cast<size_t>(s.begin * 1000 / kSegmentMs + 0.5);
+        size_t last = static_cast<size_t>((s.begin + s.length) * 1000 / kSegmentMs + 0.5);
+        for (size_t i = first; i < last && i < wav.active.size(); ++i) wav.active[i] = 1;
+    }
+    // 每一级按该级说话段的功率单独定标
+    const size_t step_frames = step_seconds * sample_rate;
+    std::vector<double> gains(levels_dbfs.size(), 0.0);
+    for (size_t k = 0; k < levels_dbfs.size(); ++k) {
+        double power = 0;
+        size_t count = 0;
+        for (size_t i = k * step_frames / segment; i < (k + 1) * step_frames / segment; ++i) {
+            if (!wav.active[i]) continue;
+            for (size_t n = i * segment; n < (i + 1) * segment; ++n) power += speech[n] * speech[n];
+            count += segment;
+        }
+        if (count) gains[k] = kFullScaleRms * std::sqrt(dbToPower(levels_dbfs[k]) / (power / count));
+    }
+    std::normal_distribution<double> white(0, kFullScaleRms * std::sqrt(dbToPower(noise_dbfs)));
+    wav.samples.resize(frames);
+    for (size_t n = 0; n < frames; ++n) {
+        double v = std::round(gains[n / step_frames] * speech[n] + white(rng));
+        wav.samples[n] = static_cast<int16_t>(std::clamp(v, -32768.0, 32767.0));
+    }
+    return wav;
+}
+
+std::vector<double> stepLevels(const Wav& wav, size_t steps, uint32_t step_seconds, size_t latency,
+                               uint32_t settle_ms) {
+    std::vector<double> levels;
+    for (size_t k = 0; k < steps; ++k) {
+        uint32_t begin = static_cast<uint32_t>(k * step_seconds * 1000);
+        double power[2];
+        size_t count[2];
+        segmentPowers(wav, latency, begin + settle_ms, begin + step_seconds * 1000, power, count);
+        double speech = count[1] ? power[1] / count[1] : 0;
+        levels.push_back(10 * std::log10(std::max(speech, 1e-3) / (kFullScaleRms * kFullScaleRms)));
+    }
+    return levels;
+}
+
+int32_t peakOf(const Wav& wav) {
+    int32_t peak = 0;
+    for (size_t n = 0; n < wav.frames(); ++n) {
+        peak = std::max(peak, std::abs(static_cast<int32_t>(wav.samples[n * wav.channels])));
+    }
+    return peak;
+}
+
+Wav enhance(CaptureEnhancer& enhancer, const Wav& in, EnhanceStats* stats) {
+    Wav out;
+    out.sample_rate = in.sample_rate;
+    out.channels = 1;
+    out.active = in.active;
+    out.samples.resize(in.frames());
+    const size_t frame = in.sample_rate / 50;
+    EnhanceStats local;
+    double total_us = 0;
+    uint64_t total_cycles = 0;
+    for (size_t pos = 0; pos < in.frames(); pos += frame) {
+        size_t n = std::min(frame, in.frames() - pos);
+        auto t0 = std::chrono::steady_clock::now();
+        enhancer.process(in.samples.data() + pos * in.channels, n, out.samples.data() + pos);
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+        total_us += us;
+        total_cycles += enhancer.lastCycles();
+        local.max_us = std::max(local.max_us, us);
+        local.frames++;
+    }
+    if (local.frames) {
+        local.mean_us = total_us / local.frames;
+        local.mean_cycles = total_cycles / local.frames;
+    }
+    if (stats) *stats = local;
+    return out;
+}
+
+} // namespace fixtures
+} // namespace chunfeng
@@ -0,0 +1,143 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-26 09:20:41
+ * @LastEditTime: 2025-06-30 17:46:09
+ * @LastEditors: 星年
+ * @Description: 音频测试素材（主机端）：多声道 WAV 读写、带语音标注的合成录音与电平扫描、合成的指令短语、按标注计算信噪比与电平
+ * @FilePath: \ESP32-ChunFeng\host\tools\audio_fixtures.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "capture_enhancer.hpp"
+
+namespace chunfeng {
+namespace fixtures {
+
+/** 标注粒度：每段 10ms 记一个“有语音”标志 */
+constexpr uint32_t kSegmentMs = 10;
+
+/**
+ * @brief 16 位 PCM WAV
+ *
+ * active 非空时写入自定义的 "actv" 块（每 10ms 一个字节），其他播放器会忽略它。
+ */
+struct Wav {
+    uint32_t sample_rate{16000};
+    uint16_t channels{1};
+    std::vector<int16_t> samples;   ///< 按通道交织
+    std::vector<uint8_t> active;    ///< 语音标注，可为空
+
+    size_t frames() const { return channels ? samples.size() / channels : 0; }
+};
+
+bool readWav(const std::string& path, Wav& out);
+bool writeWav(const std::string& path, const Wav& wav);
+
+/**
+ * @brief 噪声场景
+ */
+enum class Noise : uint8_t {
+    FAN,    ///< 风扇/空调：低频为主的稳态扩散噪声（各麦克风间部分相关），叠加电源哼声
+    TV,     ///< 电视：几路人声与音乐式的宽带噪声，从 noise_deg 方向传来
+};
+
+struct FixtureSpec {
+    Noise noise{Noise::FAN};
+    uint32_t sample_rate{16000};
+    uint16_t channels{2};
+    uint32_t seconds{8};
+    double snr_db{5};               ///< 第一个麦克风上说话段的语音与噪声功率比
+    double speech_dbfs{-26};        ///< 说话段的语音电平
+    uint16_t mic_spacing_mm{45};
+    int talker_deg{0};
+    int noise_deg{65};
+    uint32_t seed{1};
+};
+
+/**
+ * @brief 合成一段录音：音节式浊音（基频滑动的谐波加共振峰包络）穿插停顿，加指定噪声与麦克风自噪声，
+ * 各麦克风按声源方向计算到达时间差；active 标注说话段
+ */
+Wav makeFixture(const FixtureSpec& spec);
+
+/**
+ * @brief 电平扫描：同一个说话人依次按 levels_dbfs 中的电平说 step_seconds 秒（模拟走近走远、不同回复的响度），
+ * 每级说话段的电平正好是设定值，另加 noise_dbfs 的白噪声底；单声道
+ */
+Wav makeLevelSweep(const std::vector<double>& levels_dbfs, uint32_t step_seconds = 4, double noise_dbfs = -65,
+                   uint32_t sample_rate = 16000, uint32_t seed = 3);
+
+/**
+ * @brief 电平扫描每一级说话段的电平（dBFS），跳过每级开头 settle_ms（留给增益调整）
+ */
+std::vector<double> stepLevels(const Wav& wav, size_t steps, uint32_t step_seconds = 4, size_t latency = 0,
+                               uint32_t settle_ms = 2000);
+
+/** 第一路的最大绝对值 */
+int32_t peakOf(const Wav& wav);
+
+/**
+ * @brief 合成短语：前 kCommandPhrases 个是设备端指令，其余是词表外的话（其中几条与指令开头相同，用于检验拒识）
+ */
+constexpr size_t kCommandPhrases = 4;
+constexpr size_t kPhrases = 8;
+
+/** 短语的拼音（带声调），如 "da4 sheng1 dian3" */
+const char* phraseName(size_t phrase);
+
+/**
+ * @brief 说话人：基频、声道长度（共振峰整体缩放）与语速
+ */
+struct Talker {
+    double f0{130};
+    double formant_scale{1.0};
+    double tempo{1.0};              ///< 大于 1 说得慢
+};
+
+/** 第 id 个说话人：0 固定为 {130Hz, 1.0, 1.0}，其余在成年男女的范围内随机 */
+Talker makeTalker(uint32_t id);
+
+struct UtteranceSpec {
+    uint32_t sample_rate{16000};
+    double speech_dbfs{-26};
+    double snr_db{30};              ///< 语音与风扇式噪声的功率比
+    uint32_t lead_ms{400};          ///< 语音前后的纯噪声
+    uint32_t tail_ms{600};
+    uint32_t seed{1};               ///< 每次说法的细微差别（音节长短、共振峰、音高）与噪声
+};
+
+/**
+ * @brief 合成一句短语：每个音节是声母（擦音、塞音、鼻音等）加上共振峰随时间滑动、按声调变化基频的韵母；单声道，
+ * active 标注说话段
+ */
+Wav makeUtterance(size_t phrase, const Talker& talker, const UtteranceSpec& spec);
+
+/**
+ * @brief 按标注估计信噪比（dB）：(说话段功率 - 静音段功率) / 静音段功率
+ *
+ * 只用第一路；标注按 latency 个样本后移以对齐处理延迟，跳过开头 skip_ms 与标注变化前后各一段。
+ */
+double snrDb(const Wav& wav, size_t latency = 0, uint32_t skip_ms = 2000);
+
+/**
+ * @brief 处理统计
+ */
+struct EnhanceStats {
+    size_t frames{0};           ///< 处理的 20ms 帧数
+    double mean_us{0};          ///< 每帧平均耗时
+    double max_us{0};
+    uint64_t mean_cycles{0};    ///< 每帧平均 CPU 周期（主机上为纳秒）
+};
+
+/**
+ * @brief 按 20ms 一帧把 in 送入 enhancer，输出单声道（保留 in 的标注）
+ */
+Wav enhance(CaptureEnhancer& enhancer, const Wav& in, EnhanceStats* stats = nullptr);
+
+} // namespace fixtures
+} // namespace chunfeng
@@ -0,0 +1,179 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-26 09:20:41
+ * @LastEditTime: 2025-06-27 16:48:03
+ * @LastEditors: 星年
+ * @Description: 音频命令行工具：生成带语音标注的测试录音，用设备端的采集增强、播放限幅代码处理 WAV 并报告信噪比、电平与耗时
+ * @FilePath: \ESP32-ChunFeng\host\tools\audio_tool.cpp
+ * @遇事不决，可问春风
+ */
+#include "audio_fixtures.hpp"
+#include "soft_limiter.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace chunfeng;
+
+namespace {
+
+// 电平扫描的各级电平：说话人由远到近
+const std::vector<double> kSweepLevels = {-50, -40, -30, -20, -10};
+
+void printLevels(const char* what, const std::vector<double>& levels) {
+    printf("%s", what);
+    for (double l : levels) printf(" %.1f", l);
+    printf(" dBFS\n");
+}
+
+int fixture(const char* kind, const char* path, int argc, char** argv) {
+    if (strcmp(kind, "sweep") == 0) {
+        fixtures::Wav wav = fixtures::makeLevelSweep(kSweepLevels);
+        if (!fixtures::writeWav(path, wav)) {
+            fprintf(stderr, "写入 %s 失败\n", path);
+            return 1;
+        }
+        printLevels(path, fixtures::stepLevels(wav, kSweepLevels.size(), 4, 0, 0));
+        return 0;
+    }
+    fixtures::FixtureSpec spec;
+    if (strcmp(kind, "fan") == 0) {
+        spec.noise = fixtures::Noise::FAN;
+    } else if (strcmp(kind, "tv") == 0) {
+        spec.noise = fixtures::Noise::TV;
+    } else {
+        fprintf(stderr, "未知的噪声场景: %s\n", kind);
+        return 1;
+    }
+    if (argc > 0) spec.snr_db = atof(argv[0]);
+    if (argc > 1) spec.channels = static_cast<uint16_t>(atoi(argv[1]));
+    if (argc > 2) spec.seconds = static_cast<uint32_t>(atoi(argv[2]));
+    fixtures::Wav wav = fixtures::makeFixture(spec);
+    if (!fixtures::writeWav(path, wav)) {
+        fprintf(stderr, "写入 %s 失败\n", path);
+        return 1;
+    }
+    printf("%s: %u 通道 %u Hz %.1f s，信噪比 %.1f dB\n", path, wav.channels, wav.sample_rate,
+           static_cast<double>(wav.frames()) / wav.sample_rate, fixtures::snrDb(wav));
+    return 0;
+}
+
+int enhance(const char* in_path, const char* out_path, int argc, char** argv) {
+    fixtures::Wav in;
+    if (!fixtures::readWav(in_path, in)) {
+        fprintf(stderr, "读取 %s 失败（只支持 16 位 PCM）\n", in_path);
+        return 1;
+    }
+    AudioConfig config;
+    config.sample_rate = in.sample_rate;
+    config.channels = static_cast<uint8_t>(in.channels);
+    for (int i = 0; i < argc; ++i) {
+        std::string opt = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : "0";
+        if (opt == "--no-ns") {
+            config.noise_suppression = false;
+        } else if (opt == "--no-agc") {
+            config.agc = false;
+        } else if (opt == "--no-beam") {
+            config.beam_mode = BeamMode::OFF;
+        } else if (opt == "--atten") {
+            config.ns_max_attenuation_db = static_cast<uint8_t>(atoi(value));
+            i++;
+        } else if (opt == "--steer") {
+            config.steer_deg = static_cast<int8_t>(atoi(value));
+            i++;
+        } else if (opt == "--spacing") {
+            config.mic_spacing_mm = static_cast<uint16_t>(atoi(value));
+            i++;
+        } else {
+            fprintf(stderr, "未知选项: %s\n", opt.c_str());
+            return 1;
+        }
+    }
+    CaptureEnhancer enhancer;
+    if (enhancer.configure(config) != ESP_OK) {
+        fprintf(stderr, "配置无效\n");
+        return 1;
+    }
+    fixtures::EnhanceStats stats;
+    fixtures::Wav out = fixtures::enhance(enhancer, in, &stats);
+    if (!fixtures::writeWav(out_path, out)) {
+        fprintf(stderr, "写入 %s 失败\n", out_path);
+        return 1;
+    }
+    printf("%s: %zu 帧，每帧平均 %.1f us（最长 %.1f us），噪声底 %d dBFS，自动增益 %d dB\n", out_path, stats.frames,
+           stats.mean_us, stats.max_us, enhancer.noiseSuppressor().noiseFloorDb(), enhancer.autoGain().gainDb());
+    if (!in.active.empty()) {
+        double before = fixtures::snrDb(in);
+        double after = fixtures::snrDb(out, enhancer.latencySamples());
+        printf("信噪比 %.1f dB -> %.1f dB（%+.1f dB）\n", before, after, after - before);
+    }
+    return 0;
+}
+
+int limit(const char* in_path, const char* out_path, int argc, char** argv) {
+    fixtures::Wav in;
+    if (!fixtures::readWav(in_path, in) || in.channels != 1) {
+        fprintf(stderr, "读取 %s 失败（只支持 16 位单声道 PCM）\n", in_path);
+        return 1;
+    }
+    AudioConfig config;
+    int volume = 100;
+    for (int i = 0; i < argc; ++i) {
+        std::string opt = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : "0";
+        if (opt == "--no-normalize") {
+            config.play_normalize = false;
+        } else if (opt == "--loudness") {
+            config.play_loudness_dbfs = static_cast<int8_t>(atoi(value));
+            i++;
+        } else if (opt == "--ceiling") {
+            config.play_ceiling_dbfs = static_cast<int8_t>(atoi(value));
+            i++;
+        } else if (opt == "--volume") {
+            volume = atoi(value);
+            i++;
+        } else {
+            fprintf(stderr, "未知选项: %s\n", opt.c_str());
+            return 1;
+        }
+    }
+    SoftLimiter limiter;
+    if (limiter.configure(config.play_normalize, config.play_loudness_dbfs, config.play_ceiling_dbfs) != ESP_OK) {
+        fprintf(stderr, "配置无效\n");
+        return 1;
+    }
+    // 与播放任务一样按 20ms 一帧原位处理
+    fixtures::Wav out = in;
+    const size_t frame = in.sample_rate / 50;
+    for (size_t pos = 0; pos < out.samples.size(); pos += frame) {
+        limiter.process(out.samples.data() + pos, std::min(frame, out.samples.size() - pos), volume * 32767 / 100);
+    }
+    if (!fixtures::writeWav(out_path, out)) {
+        fprintf(stderr, "写入 %s 失败\n", out_path);
+        return 1;
+    }
+    printf("%s: 峰值 %d -> %d\n", out_path, fixtures::peakOf(in), fixtures::peakOf(out));
+    return 0;
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "用法: %s fixture fan|tv 输出.wav [信噪比dB，默认 5] [通道数，默认 2] [秒，默认 8]\n"
+            "      %s fixture sweep 输出.wav   (单声道电平扫描 -50~-10dBFS，每级 4 秒)\n"
+            "      %s enhance 输入.wav 输出.wav [--no-ns] [--no-beam] [--no-agc] [--atten dB] [--steer 度] [--spacing mm]\n"
+            "      %s limit 输入.wav 输出.wav [--no-normalize] [--loudness dBFS] [--ceiling dBFS] [--volume 0~100]\n",
+            argv0, argv0, argv0, argv0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc >= 4 && strcmp(argv[1], "fixture") == 0) return fixture(argv[2], argv[3], argc - 4, argv + 4);
+    if (argc >= 4 && strcmp(argv[1], "enhance") == 0) return enhance(argv[2], argv[3], argc - 4, argv + 4);
+    if (argc >= 4 && strcmp(argv[1], "limit") == 0) return limit(argv[2], argv[3], argc - 4, argv + 4);
+    usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,272 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-20 12:48:51
+ * @LastEditTime: 2025-06-20 14:52:08
+ * @LastEditors: 星年
+ * @Description: 增量升级包生成（主机端）
+ * @FilePath: \ESP32-ChunFeng\host\tools\delta_encoder.cpp
+ * @遇事不决，可问春风
+ */
+#include "delta_encoder.hpp"
+#include "delta_patch.hpp"
+#include "mbedtls/sha256.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace chunfeng {
+namespace ota {
+
+namespace {
+
+constexpr size_t kGram = 16;            ///< 查找匹配起点的最短完全匹配
+constexpr int kGiveUp = 32;             ///< 近似延伸时，得分比最好时低这么多就停下
+constexpr size_t kMinDiffLen = 8;
+constexpr int kChainDepth = 64;
+
+void sha256(const uint8_t* data, size_t len, uint8_t out[32]) {
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    mbedtls_sha256_update(&sha, data, len);
+    mbedtls_sha256_finish(&sha, out);
+    mbedtls_sha256_free(&sha);
+}
+
+uint64_t gramHash(const uint8_t* p) {
+    uint64_t a, b;
+    memcpy(&a, p, 8);
+    memcpy(&b, p + 8, 8);
+    return (a ^ (b * 0x9E3779B97F4A7C15ull)) * 0xC2B2AE3D27D4EB4Full;
+}
+
+void putUvarint(std::vector<uint8_t>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+void putSvarint(std::vector<uint8_t>& out, int64_t v) {
+    putUvarint(out, (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+}
+
+class BitWriter {
+public:
+    void put(uint32_t value, int bits) {
+        for (int i = bits - 1; i >= 0; --i) {
+            acc_ = static_cast<uint8_t>((acc_ << 1) | ((value >> i) & 1));
+            if (++count_ == 8) {
+                out_.push_back(acc_);
+                acc_ = 0;
+                count_ = 0;
+            }
+        }
+    }
+
+    std::vector<uint8_t> finish() {
+        if (count_) out_.push_back(static_cast<uint8_t>(acc_ << (8 - count_)));
+        acc_ = 0;
+        count_ = 0;
+        return std::move(out_);
+    }
+
+private:
+    std::vector<uint8_t> out_;
+    uint8_t acc_{0};
+    int count_{0};
+};
+
+/** 一条 bsdiff 指令：从 src 开始 diff_len 字节差值输出，再原样输出 extra_len 字节 */
+struct Op {
+    uint32_t src;
+    uint32_t target;            ///< 本条指令输出的起点
+    uint32_t diff_len;
+    uint32_t extra_len;
+};
+
+class Matcher {
+public:
+    Matcher(const std::vector<uint8_t>& old_image, const std::vector<uint8_t>& new_image)
+        : old_(old_image), new_(new_image) {
+        if (old_.size() < kGram) return;
+        index_.reserve(old_.size());
+        for (size_t i = 0; i + kGram <= old_.size(); ++i) index_.emplace(gramHash(&old_[i]), static_cast<uint32_t>(i));
+    }
+
+    /** 为新固件的 [t0, t1) 生成指令，cursor 是旧固件的当前读取位置，跨块延续 */
+    std::vector<Op> match(size_t t0, size_t t1, size_t& cursor) {
+        std::vector<Op> ops;
+        size_t extra_start = t0;
+        auto addExtra = [&](size_t end) {
+            if (end == extra_start) return;
+            if (ops.empty()) ops.push_back({static_cast<uint32_t>(cursor), static_cast<uint32_t>(extra_start), 0, 0});
+            ops.back().extra_len += static_cast<uint32_t>(end - extra_start);
+        };
+        size_t t = t0;
+        while (t < t1) {
+            size_t len = 0, src = 0;
+            // 先沿用当前位置（改动之间的未改部分），再查索引（插入或删除之后的偏移）
+            if (similar(cursor, t, t1)) {
+                src = cursor;
+                len = extend(src, t, t1);
+            }
+            if (len < kMinDiffLen && t + kGram <= t1) {
+                auto it = index_.find(gramHash(&new_[t]));
+                if (it != index_.end() && memcmp(&old_[it->second], &new_[t], kGram) == 0) {
+                    src = it->second;
+                    len = extend(src, t, t1);
+                }
+            }
+            if (len < kMinDiffLen) {
+                ++t;
+                continue;
+            }
+            addExtra(t);
+            ops.push_back({static_cast<uint32_t>(src), static_cast<uint32_t>(t), static_cast<uint32_t>(len), 0});
+            t += len;
+            cursor = src + len;
+            extra_start = t;
+        }
+        addExtra(t1);
+        return ops;
+    }
+
+private:
+    bool similar(size_t s, size_t t, size_t t1) const {
+        if (s + kGram > old_.size() || t + kGram > t1) return false;
+        size_t equal = 0;
+        for (size_t i = 0; i < kGram; ++i) equal += old_[s + i] == new_[t + i];
+        return equal >= kGram / 2;
+    }
+
+    /** bsdiff 的近似延伸：取“相同字节数 - 不同字节数”最大处 */
+    size_t extend(size_t s, size_t t, size_t t1) const {
+        int score = 0, best = 0;
+        size_t best_len = 0;
+        for (size_t i = 0; t + i < t1 && s + i < old_.size(); ++i) {
+            score += old_[s + i] == new_[t + i] ? 1 : -1;
+            if (score > best) {
+                best = score;
+                best_len = i + 1;
+            } else if (score < best - kGiveUp) {
+                break;
+            }
+        }
+        return best_len;
+    }
+
+    const std::vector<uint8_t>& old_;
+    const std::vector<uint8_t>& new_;
+    std::unordered_map<uint64_t, uint32_t> index_;  ///< 16 字节片段 -> 首次出现的位置
+};
+
+} // namespace
+
+std::vector<uint8_t> lzssCompress(const std::vector<uint8_t>& in) {
+    constexpr int kHashBits = 14;
+    BitWriter w;
+    std::vector<int32_t> head(1u << kHashBits, -1);
+    std::vector<int32_t> prev(in.size(), -1);
+    auto hash3 = [&](size_t i) {
+        uint32_t v = (static_cast<uint32_t>(in[i]) << 16) | (in[i + 1] << 8) | in[i + 2];
+        return (v * 2654435761u) >> (32 - kHashBits);
+    };
+    auto insert = [&](size_t i) {
+        if (i + kMinMatch > in.size()) return;
+        uint32_t h = hash3(i);
+        prev[i] = head[h];
+        head[h] = static_cast<int32_t>(i);
+    };
+
+    size_t i = 0;
+    while (i < in.size()) {
+        size_t best_len = 0, best_dist = 0;
+        if (i + kMinMatch <= in.size()) {
+            const size_t max = std::min(kMaxMatch, in.size() - i);
+            int32_t c = head[hash3(i)];
+            for (int depth = 0; c >= 0 && i - c <= kWindowSize && depth < kChainDepth; ++depth, c = prev[c]) {
+                size_t l = 0;
+                while (l < max && in[c + l] == in[i + l]) ++l;
+                if (l > best_len) {
+                    best_len = l;
+                    best_dist = i - c;
+                    if (l == max) break;
+                }
+            }
+        }
+        size_t step = 1;
+        if (best_len >= kMinMatch) {
+            w.put(0, 1);
+            w.put(static_cast<uint32_t>(best_dist - 1), kWindowBits);
+            w.put(static_cast<uint32_t>(best_len - kMinMatch), kLengthBits);
+            step = best_len;
+        } else {
+            w.put(1, 1);
+            w.put(in[i], 8);
+        }
+        for (size_t k = 0; k < step; ++k) insert(i + k);
+        i += step;
+    }
+    return w.finish();
+}
+
+std::vector<uint8_t> encodePatch(const std::vector<uint8_t>& old_image, const std::vector<uint8_t>& new_image,
+                                 uint16_t block_kib, EncodeStats* stats) {
+    EncodeStats local;
+    EncodeStats& st = stats ? *stats : local;
+    st = EncodeStats();
+
+    PatchHeader header{};
+    memcpy(header.magic, kPatchMagic, sizeof(header.magic));
+    header.version = kPatchVersion;
+    header.block_kib = block_kib;
+    header.source_size = static_cast<uint32_t>(old_image.size());
+    header.target_size = static_cast<uint32_t>(new_image.size());
+    sha256(old_image.data(), old_image.size(), header.source_sha256);
+    sha256(new_image.data(), new_image.size(), header.target_sha256);
+
+    std::vector<uint8_t> patch(sizeof(header));
+    memcpy(patch.data(), &header, sizeof(header));
+
+    Matcher matcher(old_image, new_image);
+    const size_t block_size = block_kib * 1024u;
+    size_t cursor = 0;
+    for (size_t t0 = 0; t0 < new_image.size(); t0 += block_size) {
+        const size_t t1 = std::min(new_image.size(), t0 + block_size);
+        std::vector<Op> ops = matcher.match(t0, t1, cursor);
+
+        std::vector<uint8_t> plain;
+        for (size_t k = 0; k < ops.size(); ++k) {
+            const Op& op = ops[k];
+            int64_t seek = k + 1 < ops.size() ? static_cast<int64_t>(ops[k + 1].src) - (op.src + op.diff_len) : 0;
+            putUvarint(plain, op.diff_len);
+            putUvarint(plain, op.extra_len);
+            putSvarint(plain, seek);
+            for (uint32_t i = 0; i < op.diff_len; ++i) {
+                plain.push_back(static_cast<uint8_t>(new_image[op.target + i] - old_image[op.src + i]));
+            }
+            plain.insert(plain.end(), new_image.begin() + op.target + op.diff_len,
+                         new_image.begin() + op.target + op.diff_len + op.extra_len);
+            st.diff_bytes += op.diff_len;
+            st.extra_bytes += op.extra_len;
+        }
+        st.plain_bytes += plain.size();
+        std::vector<uint8_t> compressed = lzssCompress(plain);
+
+        BlockHeader block{};
+        block.compressed_size = static_cast<uint32_t>(compressed.size());
+        block.output_size = static_cast<uint32_t>(t1 - t0);
+        block.source_pos = ops.empty() ? 0 : ops.front().src;
+        sha256(new_image.data() + t0, t1 - t0, block.sha256);
+        const uint8_t* raw = reinterpret_cast<const uint8_t*>(&block);
+        patch.insert(patch.end(), raw, raw + sizeof(block));
+        patch.insert(patch.end(), compressed.begin(), compressed.end());
+        st.blocks++;
+    }
+    return patch;
+}
+
+} // namespace ota
+} // namespace chunfeng
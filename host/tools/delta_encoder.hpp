@@ -0,0 +1,39 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-20 12:48:51
+ * @LastEditTime: 2025-06-20 14:52:08
+ * @LastEditors: 星年
+ * @Description: 增量升级包生成（主机端）：bsdiff 式近似匹配、按块切分、LZSS 压缩，格式见 delta_patch.hpp
+ * @FilePath: \ESP32-ChunFeng\host\tools\delta_encoder.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace chunfeng {
+namespace ota {
+
+struct EncodeStats {
+    size_t blocks{0};
+    size_t diff_bytes{0};       ///< 按旧固件加差值输出的字节
+    size_t extra_bytes{0};      ///< 原样输出的新字节
+    size_t plain_bytes{0};      ///< 压缩前的指令流
+};
+
+/**
+ * @brief 生成从 old_image 到 new_image 的增量包
+ * @param block_kib 每块输出的大小（KB），必须是 Flash 扇区的整数倍
+ */
+std::vector<uint8_t> encodePatch(const std::vector<uint8_t>& old_image, const std::vector<uint8_t>& new_image,
+                                 uint16_t block_kib = 64, EncodeStats* stats = nullptr);
+
+/**
+ * @brief 按 delta_patch.hpp 中的 LZSS 参数压缩
+ */
+std::vector<uint8_t> lzssCompress(const std::vector<uint8_t>& in);
+
+} // namespace ota
+} // namespace chunfeng
@@ -0,0 +1,122 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-20 13:30:16
+ * @LastEditTime: 2025-06-20 14:52:08
+ * @LastEditors: 星年
+ * @Description: 增量升级包命令行工具：生成升级包，以及用设备端的解包代码（Flash 替身）把升级包应用到镜像文件
+ * @FilePath: \ESP32-ChunFeng\host\tools\delta_tool.cpp
+ * @遇事不决，可问春风
+ */
+#include "delta_encoder.hpp"
+#include "delta_patch.hpp"
+#include "host_sim.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace chunfeng;
+
+namespace {
+
+bool readFile(const char* path, std::vector<uint8_t>& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool writeFile(const char* path, const std::vector<uint8_t>& data) {
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(out);
+}
+
+int make(const char* old_path, const char* new_path, const char* patch_path, uint16_t block_kib) {
+    std::vector<uint8_t> old_image, new_image;
+    if (!readFile(old_path, old_image) || !readFile(new_path, new_image)) {
+        fprintf(stderr, "读取镜像失败\n");
+        return 1;
+    }
+    if (block_kib == 0 || (block_kib * 1024u) % SPI_FLASH_SEC_SIZE != 0) {
+        fprintf(stderr, "块大小必须是 %d KB 的整数倍\n", SPI_FLASH_SEC_SIZE / 1024);
+        return 1;
+    }
+    ota::EncodeStats stats;
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<uint8_t> patch = ota::encodePatch(old_image, new_image, block_kib, &stats);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    if (!writeFile(patch_path, patch)) {
+        fprintf(stderr, "写入 %s 失败\n", patch_path);
+        return 1;
+    }
+    printf("%s: %zu 字节（新固件的 %.2f%%），%zu 块，差值 %zu 字节，新增 %zu 字节，耗时 %.0f ms\n", patch_path,
+           patch.size(), 100.0 * patch.size() / new_image.size(), stats.blocks, stats.diff_bytes, stats.extra_bytes,
+           ms);
+    return 0;
+}
+
+int apply(const char* old_path, const char* patch_path, const char* out_path) {
+    std::vector<uint8_t> old_image, patch;
+    if (!readFile(old_path, old_image) || !readFile(patch_path, patch)) {
+        fprintf(stderr, "读取文件失败\n");
+        return 1;
+    }
+    ota::PatchHeader header;
+    esp_err_t err = ota::parseHeader(patch.data(), patch.size(), header);
+    if (err != ESP_OK) {
+        fprintf(stderr, "不是有效的升级包: %d\n", err);
+        return 1;
+    }
+    // 与设备上一样：旧固件在 ota_0，流式写入 ota_1
+    const esp_partition_t* source = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0,
+                                                             nullptr);
+    const esp_partition_t* target = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1,
+                                                             nullptr);
+    if (!host_sim::flashProgram(source->label, old_image)) {
+        fprintf(stderr, "旧固件超过分区大小\n");
+        return 1;
+    }
+    ota::DeltaPatcher patcher;
+    auto t0 = std::chrono::steady_clock::now();
+    err = patcher.begin(header, source, target, ota::PatchPosition());
+    constexpr size_t kChunk = 1024;
+    for (size_t pos = sizeof(header); err == ESP_OK && pos < patch.size(); pos += kChunk) {
+        err = patcher.feed(patch.data() + pos, std::min(kChunk, patch.size() - pos));
+    }
+    if (err == ESP_OK) err = patcher.done() ? patcher.verify() : ESP_ERR_INVALID_SIZE;
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    if (err != ESP_OK) {
+        fprintf(stderr, "应用失败: %d\n", err);
+        return 1;
+    }
+    if (!writeFile(out_path, host_sim::flashRead(target->label, header.target_size))) {
+        fprintf(stderr, "写入 %s 失败\n", out_path);
+        return 1;
+    }
+    printf("%s: %u 字节，耗时 %.0f ms，解包工作集 %zu 字节\n", out_path, static_cast<unsigned>(header.target_size), ms,
+           sizeof(patcher));
+    return 0;
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "用法: %s make 旧固件 新固件 升级包 [块大小KB，默认 64]\n"
+            "      %s apply 旧固件 升级包 输出\n",
+            argv0, argv0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc >= 5 && strcmp(argv[1], "make") == 0) {
+        return make(argv[2], argv[3], argv[4], static_cast<uint16_t>(argc > 5 ? atoi(argv[5]) : 64));
+    }
+    if (argc == 5 && strcmp(argv[1], "apply") == 0) return apply(argv[2], argv[3], argv[4]);
+    usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,39 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-13 14:06:31
+ * @LastEditTime: 2025-06-13 17:12:05
+ * @LastEditors: 星年
+ * @Description: 构建时检查任务拓扑表：打印各核心的预算负载与栈内存合计，有问题时返回非 0 让构建失败
+ * @FilePath: \ESP32-ChunFeng\host\tools\topology_check.cpp
+ * @遇事不决，可问春风
+ */
+#include "task_topology.hpp"
+#include <cstdio>
+
+using namespace chunfeng;
+
+int main() {
+    size_t count = 0;
+    const tasks::TaskSpec* table = tasks::table(&count);
+
+    uint32_t load[3] = {0, 0, 0};   // 核心 0、核心 1、不固定
+    size_t internal = 0, spiram = 0;
+    printf("%-12s %4s %4s %7s %-8s %8s\n", "task", "core", "prio", "stack", "mem", "load%");
+    for (size_t i = 0; i < count; ++i) {
+        const tasks::TaskSpec& t = table[i];
+        uint32_t bp = t.period_ms ? t.budget_us * 10 / t.period_ms : 0;
+        load[t.core == tasks::kAnyCore ? 2 : t.core] += bp;
+        bool spiram_stack = t.stack_mem == tasks::StackMem::SPIRAM;
+        if (!(t.flags & tasks::kSystem)) (spiram_stack ? spiram : internal) += t.stack_bytes;
+        printf("%-12s %4d %4u %7u %-8s %5u.%02u%s\n", t.name, t.core, t.priority, static_cast<unsigned>(t.stack_bytes),
+               spiram_stack ? "spiram" : "internal", bp / 100, bp % 100, (t.flags & tasks::kSystem) ? "  (系统)" : "");
+    }
+    printf("核心 0 负载 %u.%02u%%，核心 1 负载 %u.%02u%%，不固定 %u.%02u%%（上限 %u%%）\n", load[0] / 100,
+           load[0] % 100, load[1] / 100, load[1] % 100, load[2] / 100, load[2] % 100,
+           static_cast<unsigned>(tasks::kCoreLoadLimitPercent));
+    printf("任务栈：内部 RAM %zu / %zu 字节，PSRAM %zu / %zu 字节\n", internal, tasks::kInternalStackBudget, spiram,
+           tasks::kSpiramStackBudget);
+
+    size_t issues = tasks::validate([](const char* message) { fprintf(stderr, "任务表错误: %s\n", message); });
+    return issues == 0 ? 0 : 1;
+}
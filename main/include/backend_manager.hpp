@@ -1,65 +1,120 @@
-// /*
-//  * @Author: xingnian j_xingnian@163.com
-//  * @Date: 2025-05-29 20:48:51
-//  * @LastEditors: 星年 && j_xingnian@163.com
-//  * @LastEditTime: 2025-05-29 20:49:12
-//  * @FilePath: \ESP32-ChunFeng\main\include\backend_manager.hpp
-//  * @Description: 后台管理类
-//  * 
-//  * Copyright (c) 2025 by ${git_name_email}, All Rights Reserved. 
-//  */
-// #pragma once
-
-// #include <string>
-// #include "audio_manager.hpp"
-// #include "coze_manager.hpp"
-
-// namespace chunfeng {
-
-// /**
-//  * @brief 系统设置结构体
-//  */
-// struct SystemSettings {
-//     std::string device_name;
-//     std::string firmware_version;
-//     // TODO: 添加其他系统设置项
-// };
-
-// /**
-//  * @brief 后台管理类
-//  */
-// class BackendManager {
-// public:
-//     static BackendManager& getInstance();
-
-//     /**
-//      * @brief 获取当前系统状态
-//      */
-//     std::string getCurrentStatus() const;
-
-//     /**
-//      * @brief 更新网络设置
-//      */
-//     bool updateNetworkSettings(const std::string& settings);
-
-//     /**
-//      * @brief 更新音频设置
-//      */
-//     bool updateAudioSettings(const AudioConfig& config);
-
-//     /**
-//      * @brief 更新对话设置
-//      */
-//     bool updateCozeSettings(const CozeConfig& config);
-
-//     /**
-//      * @brief 更新系统设置
-//      */
-//     bool updateSystemSettings(const SystemSettings& settings);
-
-// private:
-//     BackendManager() = default;
-//     SystemSettings system_settings_{};
-// };
-
-// } // namespace chunfeng
\ No newline at end of file
+/*
+ * @Author: xingnian j_xingnian@163.com
+ * @Date: 2025-05-29 20:48:51
+ * @LastEditors: 星年 && j_xingnian@163.com
+ * @LastEditTime: 2025-07-02 14:26:08
+ * @FilePath: \ESP32-ChunFeng\main\include\backend_manager.hpp
+ * @Description: 后台管理类：设置文档的推送、差异应用与持久化，系统状态查询
+ *
+ * Copyright (c) 2025 by ${git_name_email}, All Rights Reserved.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include "esp_err.h"
+#include "settings.hpp"
+#include "status_board.hpp"
+
+namespace chunfeng {
+
+/**
+ * @brief 一次设置推送的结果
+ */
+struct ApplyResult {
+    esp_err_t err{ESP_OK};          ///< ESP_ERR_INVALID_ARG 文档无效，ESP_ERR_INVALID_VERSION 版本过旧，
+                                    ///< ESP_ERR_INVALID_STATE 上一份推送仍在应用
+    uint32_t version{0};            ///< 推送的版本
+    uint32_t changed{0};            ///< 变化的字段（第 i 位对应字段表第 i 项）
+    uint8_t reconfigured{0};        ///< 重新配置过的子系统
+    uint8_t pending{0};             ///< 仍在后台应用的子系统，非 0 时推送已接受、结果经 /status 给出
+    char message[64]{};
+};
+
+/**
+ * @brief 后台管理类
+ *
+ * 持有当前设置文档。推送的文档与当前设置逐字段比较，只有涉及的子系统重新配置：
+ * 换采样率不会断开网络，换 Coze 密钥不会重连 WiFi。子系统按音频、对话、系统、网络的顺序应用
+ * （网络最慢、也最难撤销，放在最后）；任一子系统失败时，已应用的按相反顺序恢复原设置，文档不保存。
+ * 全部成功后整份文档一次写入 NVS，之后才替换当前设置。
+ *
+ * 推送的 WiFi 在回复发出后才切换（推送可能正是经当前 WiFi 到达的），请求立即以 202 返回；
+ * 获取 IP（最多 10 秒）后网络加入已保存列表、文档写入 NVS，密码错误等连接失败时整份撤销并连回原来的 AP。
+ * 切换期间当前设置不变，其他推送被拒绝；结果经 /status 的 settings 分区给出。
+ *
+ * 没有注册重新配置函数的子系统（对话、系统）在使用时通过 getSettings() 读取，推送后立即生效。
+ */
+class BackendManager {
+public:
+    /**
+     * @brief 子系统的重新配置函数，撤销时以 (prev, next) 再调用一次
+     *
+     * 返回 ESP_ERR_NOT_FINISHED 表示已开始、稍后完成，完成时调用 completeDeferred()；
+     * 之后失败的话由该子系统自己恢复原设置。
+     */
+    using Applier = esp_err_t (*)(const settings::Document& next, const settings::Document& prev);
+
+    static BackendManager& getInstance();
+
+    /**
+     * @brief 从 NVS 读取设置、注册内置子系统与配网服务的 /settings
+     */
+    void initialize();
+
+    /**
+     * @brief 注册（或替换）子系统的重新配置函数
+     */
+    void setApplier(settings::Subsystem subsystem, Applier applier);
+
+    /**
+     * @brief 应用推送的设置文档（JSON，见 settings::parse）
+     */
+    ApplyResult applySettings(const char* json, size_t len);
+
+    /**
+     * @brief 延迟应用的子系统完成：成功时保存文档并替换当前设置，失败时撤销其余已应用的子系统
+     * @param err 子系统的结果
+     * @return 推送的最终结果：err 非 ESP_OK 时原样返回，否则为保存的结果
+     */
+    esp_err_t completeDeferred(settings::Subsystem subsystem, esp_err_t err);
+
+    /**
+     * @brief 当前设置的副本
+     */
+    settings::Document getSettings() const;
+
+    /**
+     * @brief 当前系统状态（紧凑 JSON，见 status_board.hpp）
+     * @return 字符数，缓冲不足时返回 0
+     */
+    size_t getCurrentStatus(char* buf, size_t size) const;
+
+    BackendManager(const BackendManager&) = delete;
+    BackendManager& operator=(const BackendManager&) = delete;
+
+private:
+    BackendManager();
+
+    static constexpr int kSubsystemCount = 4;
+
+    /** 配网服务 /settings 的处理函数 */
+    static const char* handleHttp(const char* body, size_t len, char* out, size_t out_size);
+
+    /** 按相反顺序把已应用的子系统恢复到原设置（调用方持锁） */
+    void revertLocked(uint8_t subsystems, const settings::Document& next, const settings::Document& prev);
+
+    /** 推送结束（生效或撤销）后记录结果并更新状态快照（调用方持锁） */
+    void finishLocked(const settings::Document& next, esp_err_t err);
+
+    mutable std::mutex mutex_;              ///< 保护以下成员，同时串行化推送
+    settings::Document current_{};
+    settings::Document pending_{};          ///< 等待延迟应用完成的文档
+    uint8_t pending_subsystems_{0};         ///< 尚未完成的子系统，0 表示没有进行中的推送
+    uint8_t pending_reconfigured_{0};       ///< 该推送已应用的子系统，失败时恢复
+    status::SettingsStatus status_{};
+    Applier appliers_[kSubsystemCount]{};   ///< 按 Subsystem 的位序
+};
+
+} // namespace chunfeng
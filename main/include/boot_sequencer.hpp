@@ -0,0 +1,135 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-23 09:30:12
+ * @LastEditTime: 2025-06-23 16:12:45
+ * @LastEditors: 星年
+ * @Description: 开机编排：各子系统声明依赖，互不依赖的初始化在两个核心上并行，每次开机记录各阶段的时间线
+ * @FilePath: \ESP32-ChunFeng\main\include\boot_sequencer.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include "esp_err.h"
+
+namespace chunfeng {
+namespace boot {
+
+constexpr size_t kMaxStages = 16;
+
+/** 阶段完成后才算可以交互（屏幕、设置等），全部完成的时刻记为可交互时间 */
+constexpr uint8_t kInteractive = 1 << 0;
+
+constexpr int8_t kAnyCore = -1;
+
+/** 阶段 index 完成后才能开始 */
+constexpr uint32_t after(uint8_t index) {
+    return 1u << index;
+}
+
+/**
+ * @brief 开机阶段
+ *
+ * depends 只约束先后：前一阶段失败时记录错误，依赖它的阶段照常运行，自行处理缺失的前提
+ * （与顺序初始化时一致，如字库所在分区挂载失败时屏幕仍然启动）。
+ */
+struct Stage {
+    const char* name;
+    esp_err_t (*fn)(void* arg);
+    void* arg;
+    uint32_t depends;       ///< after() 的按位或
+    int8_t core;            ///< 0、1 或 kAnyCore
+    uint8_t flags;
+};
+
+/**
+ * @brief 一个阶段在本次开机中的记录（时间相对 run() 开始）
+ */
+struct StageRecord {
+    uint32_t start_us;
+    uint32_t end_us;
+    esp_err_t err;
+    int8_t core;            ///< 实际运行的核心，-1 表示没有运行
+};
+
+/**
+ * @brief 开机编排器
+ *
+ * 每个核心一个开机任务（任务表中的 BOOT_0、BOOT_1），依赖都已完成的阶段中先运行绑定本核心的，
+ * 其次是关键路径最长的：关键路径按上一次开机保存在 NVS 中的各阶段耗时计算，没有记录时每个阶段按 1ms 估计，
+ * 等价于按依赖深度与声明顺序。run() 阻塞到全部阶段完成，之后开机任务退出。
+ *
+ * 每次开机的时间线输出到日志与 trace，各阶段耗时与可交互时间作为指标导出，并保存到 NVS 供下次排序。
+ */
+class Sequencer {
+public:
+    /**
+     * @param profile_key NVS 中保存各阶段耗时的键（命名空间 "boot"），为空时不读写 NVS
+     */
+    Sequencer(const Stage* stages, size_t count, const char* profile_key = "profile");
+    ~Sequencer();
+
+    /**
+     * @brief 运行全部阶段
+     * @return ESP_ERR_INVALID_ARG 依赖有环或引用了不存在的阶段，此时不运行任何阶段
+     */
+    esp_err_t run();
+
+    size_t count() const { return count_; }
+    const Stage& stage(size_t i) const { return stages_[i]; }
+    const StageRecord& record(size_t i) const { return records_[i]; }
+
+    /** 带 kInteractive 的阶段全部完成的时间（相对 run() 开始） */
+    uint32_t interactiveUs() const { return interactive_us_; }
+    uint32_t totalUs() const { return total_us_; }
+    /** 各阶段耗时之和，即顺序初始化需要的时间 */
+    uint32_t sequentialUs() const;
+    /** 是否读到了上一次开机的耗时记录 */
+    bool hasProfile() const { return has_profile_; }
+
+    /** 按开始时间输出时间线 */
+    void logTimeline() const;
+
+    Sequencer(const Sequencer&) = delete;
+    Sequencer& operator=(const Sequencer&) = delete;
+
+private:
+    struct Worker {
+        Sequencer* self;
+        int core;
+    };
+
+    static void workerTask(void* arg);
+    void work(int core);
+    /** 依赖都已完成、可在 core 上运行的阶段中关键路径最长的，没有时返回 -1 */
+    int pickLocked(int core) const;
+    /** 检查依赖并按耗时估计计算各阶段的关键路径长度 */
+    bool plan();
+    uint32_t namesHash() const;
+    void loadProfile(uint32_t* estimate_us);
+    void saveProfile() const;
+
+    const Stage* stages_;
+    size_t count_;
+    const char* profile_key_;
+    bool has_profile_{false};
+    uint32_t rank_us_[kMaxStages]{};     ///< 从该阶段开始到全部完成的关键路径长度
+    StageRecord records_[kMaxStages]{};
+    Worker worker_args_[2]{};
+
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    uint32_t started_{0};                ///< 已开始的阶段（位）
+    uint32_t done_{0};                   ///< 已完成的阶段（位）
+    uint32_t interactive_mask_{0};
+    int workers_{0};                     ///< 仍在运行的开机任务
+    int64_t t0_us_{0};
+    uint32_t interactive_us_{0};
+    uint32_t total_us_{0};
+};
+
+} // namespace boot
+} // namespace chunfeng
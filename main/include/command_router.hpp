@@ -0,0 +1,162 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-30 09:12:40
+ * @LastEditTime: 2025-07-01 18:12:05
+ * @LastEditors: 星年
+ * @Description: 设备端指令：端点检测截出的短句先在本地识别，音量、停止、网络状态立即执行，其余交给云端
+ * @FilePath: \ESP32-ChunFeng\main\include\command_router.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include "command_recognizer.hpp"
+#include "esp_err.h"
+#include "response_cache.hpp"
+#include "voice_detector.hpp"
+
+namespace chunfeng {
+
+/**
+ * @brief 本地执行的指令，取值即识别器中的指令编号
+ */
+enum class LocalCommand : uint8_t {
+    VOLUME_UP,          ///< “大声点”：音量 +kVolumeStep
+    VOLUME_DOWN,        ///< “小声点”：音量 -kVolumeStep
+    STOP,               ///< “停止”：停止正在播放的回复与提示音
+    NETWORK_STATUS,     ///< “网络状态”：播报当前连接
+    COUNT
+};
+
+/**
+ * @brief 设备端指令路由
+ *
+ * 该类采用单例模式。AUDIO_DSP 任务把采集增强后的 16kHz 单声道 PCM 交给 process()：VoiceDetector 截出一句话，
+ * 同时逐帧送入 CommandRecognizer 算特征；一句话结束时与录入的模板匹配，命中就在本地执行，不经过云端，
+ * 从说完（端点检测确认结束）到执行只有解码的几十毫秒。没有命中、或者一句话超过 CommandRecognizer::kMaxFrames
+ * （长句不会是指令）时交给云端：截出的语音（含开始前 kPreRollMs 的预录）暂存在 PSRAM 中，由调用方经 buffered()
+ * 取走后发出；断网时（UtteranceSpool::online() 为 false）由调用方存入离线语音队列。没有录入模板时全部交给云端。
+ *
+ * 音量只改运行时的值，不写入设置文档（设置的版本号由后端分配）。播报网络状态时按状态取固定的提示语，
+ * 命中合成语音缓存就经混音流播放，否则用不同的提示音区分；播放在之后的 process() 中逐帧续写，不阻塞采集。
+ */
+class CommandRouter {
+public:
+    /**
+     * @brief process() 对这段输入的处理结果
+     */
+    enum class Route : uint8_t {
+        IDLE,       ///< 没有语音
+        LISTENING,  ///< 正在说，还不知道是不是指令，语音暂存在路由内
+        LOCAL,      ///< 一句话结束，是指令，已在本地执行
+        CLOUD,      ///< 交给云端：buffered() 是截至这段输入的整句语音，speaking() 表示这句话是否还在继续
+        FORWARD,    ///< 交给云端的长句仍在继续，这段输入接着发出；start() 之前的输入也都直接发出
+    };
+
+    static constexpr uint32_t kSampleRate = CommandRecognizer::kSampleRate;
+    static constexpr uint32_t kPreRollMs = 100;
+    static constexpr uint32_t kVolumeStep = 10;
+    static constexpr const char* kTemplatePath = "/storage/kws.bin";
+    static constexpr const char* kPromptVoice = "default";
+    static constexpr size_t kMaxInputSamples = kSampleRate * 60 / 1000;
+
+    static CommandRouter& getInstance();
+
+    /**
+     * @brief 读入指令模板，分配暂存语音的缓冲，并在配网页面注册 /commands（录入、列出、删除模板）
+     * @param prompt_voice 播报网络状态的提示语在合成语音缓存中的音色
+     * @return ESP_ERR_NO_MEM 缓冲分配失败；模板文件不存在或损坏时仍返回 ESP_OK（全部交给云端）
+     */
+    esp_err_t start(const char* template_path = kTemplatePath, const char* prompt_voice = kPromptVoice);
+
+    /**
+     * @brief 录入一遍指令（含首尾静音的一句话）并保存模板文件，每条指令建议录 3~4 遍；
+     *        配网页面 POST /commands?command=<指令名> 的正文即这句话的 PCM
+     *
+     * 正在截取的一句话被丢弃。
+     */
+    esp_err_t enroll(LocalCommand command, const int16_t* pcm, size_t samples);
+
+    /** 删除全部模板和模板文件 */
+    void clearTemplates();
+
+    size_t templates() const;
+
+    /**
+     * @brief 处理一段采集增强后的语音（AUDIO_DSP 任务调用；采集链路尚未接入，目前只有 kws 场景调用）
+     * @param samples 不超过 kMaxInputSamples，交给云端的那次调用的输入才能完整地进入 buffered()
+     */
+    Route process(const int16_t* pcm, size_t samples);
+
+    /**
+     * @brief 交给云端时暂存的整句语音，只在返回 CLOUD 的那次调用之后有效
+     */
+    const int16_t* buffered(size_t* samples) const;
+
+    /** 这句话是否还在继续 */
+    bool speaking() const { return vad_.speaking(); }
+
+    /** 最近一句话的识别结果 */
+    const CommandMatch& lastMatch() const { return last_match_; }
+
+    /**
+     * @brief 执行一条本地指令（识别命中时由 process() 调用，也可由按键等直接调用）
+     */
+    void execute(LocalCommand command);
+
+    CommandRouter(const CommandRouter&) = delete;
+    CommandRouter& operator=(const CommandRouter&) = delete;
+
+private:
+    CommandRouter() = default;
+
+    /** 提示音：频率（Hz）与时长（毫秒），0Hz 为停顿 */
+    struct Beep {
+        uint16_t hz;
+        uint16_t ms;
+    };
+
+    static constexpr size_t kPreRollSamples =
+        (kPreRollMs / VoiceDetector::kSegmentMs + VoiceDetector::kStartSegments) * kSampleRate / 100;
+    static constexpr size_t kBufferSamples =
+        CommandRecognizer::kMaxFrames * CommandRecognizer::kHop + kPreRollSamples + kMaxInputSamples;
+    static constexpr size_t kMaxBeeps = 6;
+
+    /** 处理 10ms 一段 */
+    Route processSegment(const int16_t* segment);
+    void executeLocked(LocalCommand command);
+    /** 开始播报：命中缓存就播放提示语，否则播放提示音 */
+    void announce(const char* text, const Beep* beeps, size_t count);
+    /** 把提示语或提示音续写到混音流，写不下的留到下一次 */
+    void pumpPrompt();
+
+    mutable std::mutex mutex_;     ///< process() 与 enroll()、execute() 共用识别器与提示音状态
+    VoiceDetector vad_{kSampleRate};
+    CommandRecognizer recognizer_;
+    CommandMatch last_match_{};
+    char template_path_[32]{};
+    char prompt_voice_[16]{};
+
+    int16_t segment_[kSampleRate / 100];
+    size_t segment_fill_{0};
+    int16_t pre_roll_[kPreRollSamples];     ///< 最近的几段，环形
+    size_t pre_roll_pos_{0};
+    int16_t* buffer_{nullptr};              ///< 这句话的语音（PSRAM）
+    size_t buffered_{0};
+    bool forwarding_{false};                ///< 这句话已交给云端
+
+    // 正在播报的提示语或提示音
+    int prompt_stream_{-1};
+    ResponseCache::Reader prompt_reader_;
+    Beep beeps_[kMaxBeeps];
+    size_t beep_count_{0};
+    size_t beep_index_{0};
+    uint32_t beep_done_{0};                 ///< 当前提示音已生成的样本
+    int16_t prompt_chunk_[kSampleRate / 50];
+    size_t chunk_size_{0};
+    size_t chunk_sent_{0};
+};
+
+} // namespace chunfeng
@@ -1,50 +1,134 @@
-// /*
-//  * @Author: xingnian j_xingnian@163.com
-//  * @Date: 2025-05-29 20:48:35
-//  * @LastEditors: 星年 && j_xingnian@163.com
-//  * @LastEditTime: 2025-05-29 20:48:59
-//  * @FilePath: \ESP32-ChunFeng\main\include\display_manager.hpp
-//  * @Description: 显示管理类
-//  * 
-//  * Copyright (c) 2025 by ${git_name_email}, All Rights Reserved. 
-//  */
-// #pragma once
-
-// #include "system_state.hpp"
-// #include "network_manager.hpp"
-// #include <string>
-
-// namespace chunfeng {
-
-// /**
-//  * @brief 显示管理类
-//  */
-// class DisplayManager {
-// public:
-//     static DisplayManager& getInstance();
-
-//     /**
-//      * @brief 更新系统状态显示
-//      */
-//     void updateSystemState(SystemState state);
-
-//     /**
-//      * @brief 更新网络状态显示
-//      */
-//     void updateNetworkState(NetworkState state);
-
-//     /**
-//      * @brief 更新音频状态显示
-//      */
-//     void updateAudioState(const std::string& state);
-
-//     /**
-//      * @brief 更新Coze状态显示
-//      */
-//     void updateCozeState(const std::string& state);
-
-// private:
-//     DisplayManager() = default;
-// };
-
-// } // namespace chunfeng
\ No newline at end of file
+/*
+ * @Author: xingnian j_xingnian@163.com
+ * @Date: 2025-05-29 20:48:35
+ * @LastEditors: 星年 && j_xingnian@163.com
+ * @LastEditTime: 2025-06-16 16:31:08
+ * @FilePath: \ESP32-ChunFeng\main\include\display_manager.hpp
+ * @Description: 显示管理类
+ *
+ * Copyright (c) 2025 by ${git_name_email}, All Rights Reserved.
+ */
+#pragma once
+
+#include "system_state.hpp"
+#include "audio_playback.hpp"
+#include "network_manager.hpp"
+#include "framebuffer.hpp"
+#include "glyph_cache.hpp"
+#include "lcd_display.hpp"
+#include "message_bus.hpp"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <mutex>
+#include <string>
+
+namespace chunfeng {
+
+/**
+ * @brief 显示管理类
+ *
+ * 状态更新只修改显示模型，由显示任务按帧周期绘制变化的控件并只推送变化的区域。
+ * 网络与系统状态通过消息总线订阅，无需其他模块直接调用。
+ *
+ * 播放时的口型与频带电平条来自 AUDIO_LEVEL 主题：每帧分析结果带有 DAC 输出时间，比声音早几十毫秒到达，
+ * 先排队，由定时器在输出时间减去上屏耗时（绘制加推送，滑动平均）时唤醒显示任务绘制，声音与画面同时出现。
+ */
+class DisplayManager {
+public:
+    static constexpr const char* kDefaultFontPath = "/storage/font16.bin";
+    static constexpr size_t kMaxTextBytes = 64;     ///< 状态文字上限（UTF-8），超出部分按字符截断
+
+    static DisplayManager& getInstance();
+
+    /**
+     * @brief 初始化屏幕、打开字库并创建显示任务
+     */
+    esp_err_t start(const char* font_path = kDefaultFontPath);
+
+    /**
+     * @brief 更新系统状态显示
+     */
+    void updateSystemState(SystemState state);
+
+    /**
+     * @brief 更新网络状态显示
+     */
+    void updateNetworkState(NetworkState state);
+
+    /**
+     * @brief 更新音频状态显示
+     */
+    void updateAudioState(const std::string& state);
+
+    /**
+     * @brief 更新Coze状态显示
+     */
+    void updateCozeState(const std::string& state);
+
+    DisplayManager(const DisplayManager&) = delete;
+    DisplayManager& operator=(const DisplayManager&) = delete;
+
+private:
+    DisplayManager();
+    ~DisplayManager() = default;
+
+    /** 控件 */
+    enum Widget : uint8_t {
+        NETWORK,
+        SYSTEM,
+        AUDIO,
+        COZE,
+        VISUALIZER,
+        WIDGET_COUNT
+    };
+
+    struct Model {
+        NetworkState network{NetworkState::INIT};
+        SystemState system{SystemState::BOOTING};
+        char audio[kMaxTextBytes]{};
+        char coze[kMaxTextBytes]{};
+        uint8_t mouth{0};                           ///< 口型张开程度（响度）
+        uint8_t bands[SpectrumAnalyzer::kBands]{};
+    };
+
+    static constexpr size_t kMaxPendingLevels = 8;  ///< 等待输出时间的分析结果，超过 DMA 队列深度即可
+
+    static void displayTask(void* arg);
+    void run();
+    void onMessage(const bus::Message& message);
+    void setText(char (&dst)[kMaxTextBytes], const std::string& text, Widget widget);
+    void markDirty(Widget widget);
+
+    /** 排队一帧分析结果，队列满时丢弃最早的 */
+    void queueLevels(const AudioLevels& levels);
+    /** 取出已到上屏时间的分析结果，把最新一帧写入显示模型 */
+    void presentDueLevels();
+    /** 按队首的上屏时间设置唤醒定时器 */
+    void armPresentTimer();
+    static void presentTimerCallback(void* arg);
+
+    /** 在控件缓冲中绘制文字，返回结束位置 */
+    int drawText(uint16_t* buf, int stride, int height, int x, const char* text, uint16_t fg);
+    void renderWidget(Widget widget, const Model& model);
+
+    std::mutex mutex_;
+    Model model_;
+    uint32_t dirty_{0};                 ///< 需要重绘的控件（1 << Widget）
+
+    bus::Subscriber subscriber_;
+    Framebuffer fb_;
+    GlyphCache glyphs_;
+    LcdDisplay lcd_;
+    uint16_t* widget_buf_{nullptr};     ///< 最大控件大小的绘制缓冲，绘制完整体 blit 到帧缓冲
+    TaskHandle_t task_{nullptr};
+
+    // 以下只在显示任务中访问
+    AudioLevels pending_[kMaxPendingLevels];
+    size_t pending_head_{0};
+    size_t pending_count_{0};
+    esp_timer_handle_t present_timer_{nullptr};
+    int64_t present_lead_us_{2000};    ///< 上屏耗时的滑动平均
+};
+
+} // namespace chunfeng
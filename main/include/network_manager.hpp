@@ -2,7 +2,7 @@
  * @Author: xingnian j_xingnian@163.com
  * @Date: 2025-05-29 20:47:50
  * @LastEditors: 星年 && j_xingnian@163.com
- * @LastEditTime: 2025-05-29 20:47:58
+ * @LastEditTime: 2025-07-01 16:22:10
  * @FilePath: \ESP32-ChunFeng\main\include\network_manager.hpp
  * @Description: 网络管理类
  * 
@@ -10,7 +10,10 @@
  */
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include "message_bus.hpp"
+#include "status_board.hpp"
 
 namespace chunfeng {
 
@@ -25,6 +28,14 @@ enum class NetworkState {
     FAILED          ///< 连接失败
 };
 
+/**
+ * @brief 网络状态变化消息（bus::Topic::NETWORK_STATE）
+ */
+struct NetworkStateChanged {
+    NetworkState state;
+    NetworkState previous;
+};
+
 // 状态机事件枚举
 enum class NetworkEvent {
     WIFI_CONNECTED,
@@ -74,7 +85,32 @@ private:
      */
     void handleEvent(enum class NetworkEvent event);
 
+    /**
+     * @brief 切换状态，状态变化时发布到消息总线
+     */
+    void setState(NetworkState state);
+
+    /**
+     * @brief 刷新状态快照中的 WiFi 信号强度（已连接 WiFi 时每轮调用）
+     */
+    void refreshLinkStatus();
+
+    /**
+     * @brief 到下一轮的等待时间：连接中每秒一轮，已连接时只在链路变化、尝试切回 WiFi 或 4G 待机到期时醒来，
+     *        FAILED 时在链路变化或退避到期时醒来，连上 WiFi 后还在关闭配网 AP 的时刻醒来
+     */
+    uint32_t nextStepMs() const;
+
     NetworkState current_state_{NetworkState::INIT};
+    status::NetworkStatus status_{};    ///< 状态快照的网络分区，只在状态机任务中修改
+    int64_t failover_start_us_{0};  ///< 开始故障切换的时间（微秒），0 表示未在切换
+    int64_t wifi_probe_at_us_{0};   ///< 使用 4G 时下一次尝试切回 WiFi 的时间（微秒）
+    int64_t failed_retry_at_us_{0}; ///< FAILED 时下一次重新连接的时间（微秒）
+    uint32_t failed_retry_ms_{0};   ///< 当前的重连退避（毫秒），连上后清零
+    int64_t portal_close_at_us_{0}; ///< 连上 WiFi 后关闭配网 AP 的时间（微秒），0 表示没有待关闭的 AP
+    bus::Subscriber subscriber_{"net_mgr", bus::topicBit(bus::Topic::WIFI_LINK)};  ///< WiFi 链路变化时提前醒来
 };
 
-} // namespace chunfeng
\ No newline at end of file
+} // namespace chunfeng
+
+CF_BUS_TOPIC(NETWORK_STATE, chunfeng::NetworkStateChanged)
\ No newline at end of file
@@ -0,0 +1,118 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-25 09:12:06
+ * @LastEditTime: 2025-07-01 16:22:10
+ * @LastEditors: 星年
+ * @Description: 电源管理：交互之间降频、WiFi modem sleep 与自动 light sleep，唤醒时立即恢复全速
+ * @FilePath: \ESP32-ChunFeng\main\include\power_manager.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include "driver/gpio.h"
+#include "esp_err.h"
+#include "esp_pm.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "message_bus.hpp"
+#include "power_policy.hpp"
+#include "status_board.hpp"
+
+namespace chunfeng {
+
+/**
+ * @brief 唤醒来源
+ */
+enum class WakeSource : uint8_t {
+    BUTTON,     ///< 按键（GPIO 低电平，light sleep 中也能唤醒）
+    WAKE_WORD,  ///< 唤醒词
+    WIFI,       ///< WiFi 收到发给本机的数据
+    COUNT
+};
+
+/**
+ * @brief 电源管理类
+ *
+ * 该类采用单例模式。按 power::Policy 在三种模式之间切换，模式通过电源锁与 WiFi 省电模式实现：
+ * - ACTIVE：持有 CPU_FREQ_MAX 与 NO_LIGHT_SLEEP 锁，WiFi 不休眠；
+ * - IDLE：只持有 NO_LIGHT_SLEEP 锁，CPU 在空闲时降到最低频率，WiFi 按 DTIM 休眠（WIFI_PS_MIN_MODEM）；
+ * - LIGHT_SLEEP：不持有锁，所有任务都在等待时 FreeRTOS tickless idle 进入 light sleep，
+ *   WiFi 按监听间隔醒来（WIFI_PS_MAX_MODEM），WiFi 数据与按键可唤醒。
+ *
+ * 系统状态来自 SYSTEM_STATE 主题，电源任务只在状态变化或策略给出的下一个时刻醒来。
+ * wake() 在调用方任务中同步恢复全速，返回时 CPU 已锁定最高频率；从事件到恢复全速的耗时
+ * 计入 chunfeng_power_wake_latency_us。
+ *
+ * 配网 AP 开启时 esp_wifi_set_ps() 失败，WiFi 不能休眠、也无法 light sleep：记录错误日志，
+ * 错误码与失败次数写入状态快照的电源分区，电源任务每隔几秒重试直到 AP 关闭。
+ */
+class PowerManager {
+public:
+    static constexpr gpio_num_t kWakeButton = GPIO_NUM_0;   ///< BOOT 键，按下为低电平
+
+    /**
+     * @brief 各模式的驻留时间与平均电流估计
+     */
+    struct Stats {
+        power::Mode mode;
+        uint64_t residency_us[static_cast<int>(power::Mode::COUNT)];
+        uint32_t average_ua;        ///< 全部时间
+        uint32_t idle_average_ua;   ///< 交互之间
+        uint32_t transitions;
+        uint32_t wakes;
+    };
+
+    static PowerManager& getInstance();
+
+    /**
+     * @brief 配置动态调频、自动 light sleep 与唤醒源，创建电源任务
+     *
+     * 固件未开启 CONFIG_PM_ENABLE 时只切换 WiFi 省电模式，CPU 保持全速。
+     */
+    esp_err_t start(const power::PolicyConfig& config = power::PolicyConfig());
+
+    /**
+     * @brief 唤醒：立即恢复全速并重新开始计算空闲时间
+     *
+     * 由按键、唤醒词与收到数据的处理方在自己的任务中调用。
+     */
+    void wake(WakeSource source);
+
+    /**
+     * @brief 唤醒词检测开启时不进入 light sleep，保证 I2S 采集不中断
+     */
+    void setWakeWordArmed(bool armed);
+
+    power::Mode mode() const;
+    Stats stats() const;
+
+    PowerManager(const PowerManager&) = delete;
+    PowerManager& operator=(const PowerManager&) = delete;
+
+private:
+    PowerManager();
+
+    static void powerTask(void* arg);
+    void run();
+    /** 切换到 mode：先加锁再放锁，恢复全速时记录从 event_us 开始的耗时；调用方持有 mutex_ */
+    void applyLocked(power::Mode mode, int64_t event_us);
+    /** 按当前模式设置 WiFi 省电模式，结果写入状态快照；调用方持有 mutex_ */
+    void applyWifiLocked();
+
+    mutable std::mutex mutex_;
+    power::Policy policy_;
+    bus::Subscriber subscriber_;
+    TaskHandle_t task_{nullptr};
+    esp_pm_lock_handle_t cpu_lock_{nullptr};
+    esp_pm_lock_handle_t no_sleep_lock_{nullptr};
+    bool cpu_held_{false};
+    bool no_sleep_held_{false};
+    power::Mode applied_{power::Mode::COUNT};   ///< 尚未应用任何模式
+    uint32_t wakes_{0};
+    esp_err_t wifi_ps_error_{ESP_OK};           ///< 最近一次设置 WiFi 省电模式的结果
+    status::PowerStatus status_{};              ///< 状态快照的电源分区，持有 mutex_ 时修改
+};
+
+} // namespace chunfeng
@@ -0,0 +1,108 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-25 09:12:06
+ * @LastEditTime: 2025-06-25 10:41:37
+ * @LastEditors: 星年
+ * @Description: 功耗策略：按系统状态与空闲时间选择电源模式，统计各模式驻留时间与平均电流；不调用驱动，可在主机上按模拟时间线测试
+ * @FilePath: \ESP32-ChunFeng\main\include\power_policy.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstdint>
+#include "system_state.hpp"
+
+namespace chunfeng {
+namespace power {
+
+/**
+ * @brief 电源模式，由浅到深
+ */
+enum class Mode : uint8_t {
+    ACTIVE,         ///< CPU 锁定最高频率，WiFi 不休眠：交互中与交互结束后等待追问
+    IDLE,           ///< CPU 动态降频，WiFi 按 DTIM 休眠（modem sleep），I2S 采集照常运行
+    LIGHT_SLEEP,    ///< 任务都在等待时自动 light sleep，WiFi 按监听间隔醒来，由 WiFi 数据或按键唤醒
+    COUNT
+};
+
+const char* modeName(Mode mode);
+
+/**
+ * @brief 策略参数
+ *
+ * 各模式电流为整机估计值（ESP32-S3 与 PSRAM、屏幕背光关闭，WiFi 已关联），用于比较策略，
+ * 不是测量结果；实测值可按板子修改。
+ */
+struct PolicyConfig {
+    uint32_t active_hold_ms = 5000;         ///< 交互结束后保持全速的时间，追问时不用等待升频
+    uint32_t light_sleep_after_ms = 60000;  ///< 空闲超过这个时间后允许 light sleep
+    uint16_t current_ma[static_cast<int>(Mode::COUNT)] = {110, 28, 3};
+};
+
+/**
+ * @brief 功耗策略
+ *
+ * 只按输入事件与传入的时间计算，不读时钟、不调用驱动：PowerManager 在电源任务中驱动它，
+ * 基准中按模拟时间线驱动。每次输入或 evaluate() 时把上一段时间计入当前模式。
+ *
+ * - 录音、思考、播放、升级与开机期间为 ACTIVE；
+ * - 交互结束（或被唤醒）后保持 ACTIVE active_hold_ms，之后 IDLE，空闲 light_sleep_after_ms 后 LIGHT_SLEEP；
+ * - 进入 SLEEPING 时直接 LIGHT_SLEEP；
+ * - 唤醒词检测开启时最深只到 IDLE：light sleep 期间 APB 时钟停止，I2S 采集会中断。
+ */
+class Policy {
+public:
+    explicit Policy(const PolicyConfig& config = PolicyConfig(), int64_t now_us = 0);
+
+    /** 系统状态变化（SYSTEM_STATE） */
+    void onSystemState(SystemState state, int64_t now_us);
+    /** 唤醒事件（按键、唤醒词、WiFi 数据），重新开始计算空闲时间 */
+    void onWake(int64_t now_us);
+    /** 唤醒词检测开启或关闭 */
+    void setWakeWordArmed(bool armed, int64_t now_us);
+
+    /**
+     * @brief 计入到 now_us 为止的驻留时间，返回此刻应处的模式
+     */
+    Mode evaluate(int64_t now_us);
+    Mode mode() const { return mode_; }
+
+    /**
+     * @brief 不再有输入时，模式下一次因时间变化的时刻；不会再变化时返回 INT64_MAX
+     *
+     * 电源任务只在这个时刻或下一个事件时醒来，不需要轮询。
+     */
+    int64_t nextChangeUs() const;
+
+    /** 在某模式下累计的时间 */
+    uint64_t residencyUs(Mode mode) const { return residency_us_[static_cast<int>(mode)]; }
+    /** 不在交互中（非忙碌状态）时在某模式下累计的时间 */
+    uint64_t idleResidencyUs(Mode mode) const { return idle_residency_us_[static_cast<int>(mode)]; }
+    /** 全部时间的平均电流估计（微安） */
+    uint32_t averageCurrentUa() const;
+    /** 不在交互中时的平均电流估计（微安） */
+    uint32_t averageIdleCurrentUa() const;
+    /** 模式切换次数 */
+    uint32_t transitions() const { return transitions_; }
+
+    const PolicyConfig& config() const { return config_; }
+
+private:
+    void account(int64_t now_us);
+    Mode target(int64_t now_us) const;
+    static uint32_t weightedUa(const uint64_t* residency_us, const uint16_t* current_ma);
+
+    PolicyConfig config_;
+    SystemState state_{SystemState::BOOTING};
+    bool busy_{true};
+    bool wake_word_armed_{false};
+    int64_t idle_since_us_;         ///< 交互结束或最近一次唤醒的时间
+    int64_t accounted_us_;          ///< 已计入驻留时间的时刻
+    Mode mode_{Mode::ACTIVE};
+    uint32_t transitions_{0};
+    uint64_t residency_us_[static_cast<int>(Mode::COUNT)]{};
+    uint64_t idle_residency_us_[static_cast<int>(Mode::COUNT)]{};
+};
+
+} // namespace power
+} // namespace chunfeng
@@ -0,0 +1,122 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-19 09:12:40
+ * @LastEditTime: 2025-06-27 16:48:03
+ * @LastEditors: 星年
+ * @Description: 设置文档：字段表（名称、类型、取值范围、所属子系统）、JSON 解析、差异比较与 NVS 持久化
+ * @FilePath: \ESP32-ChunFeng\main\include\settings.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+
+namespace chunfeng {
+namespace settings {
+
+/**
+ * @brief 子系统，位掩码；字段变化时只需重新配置所属子系统
+ */
+enum Subsystem : uint8_t {
+    NETWORK = 1 << 0,
+    AUDIO = 1 << 1,
+    COZE = 1 << 2,
+    SYSTEM = 1 << 3,
+};
+
+constexpr uint8_t kAllSubsystems = NETWORK | AUDIO | COZE | SYSTEM;
+
+/**
+ * @brief 设置文档
+ *
+ * 平凡类型，整体作为一个 blob 写入 NVS；改动布局时增加 kLayoutVersion。新字段只追加在末尾时，
+ * 旧布局的数据沿用其前缀，新字段取默认值；其他改动旧数据会被忽略并恢复默认值。
+ */
+struct Document {
+    uint32_t version;               ///< 文档版本，每次推送必须大于当前版本
+    char wifi_ssid[33];
+    char wifi_password[65];
+    uint32_t audio_sample_rate;
+    uint32_t audio_volume;          ///< 0~100
+    char coze_api_key[96];
+    char coze_bot_id[32];
+    char device_name[32];
+    uint32_t lte_linger_s;          ///< 4G 不再使用后保持附着的时间，超过后断电；0 为立即断电（布局 2）
+    uint32_t audio_loudness;        ///< 播放响度目标 -N dBFS（布局 3）
+    uint32_t audio_ceiling;         ///< 播放峰值上限 -N dBFS，须小于 audio_loudness（布局 3）
+};
+
+constexpr uint16_t kLayoutVersion = 3;
+constexpr size_t kMaxDocumentSize = 1024;   ///< 推送的 JSON 文档上限
+
+enum class FieldType : uint8_t {
+    STRING,
+    UINT,
+};
+
+/**
+ * @brief 字段表的一项
+ */
+struct Field {
+    const char* name;               ///< JSON 中的键，如 "audio.sample_rate"
+    FieldType type;
+    uint8_t subsystem;
+    uint16_t offset;                ///< 在 Document 中的偏移
+    uint16_t size;                  ///< 字符串缓冲大小（含结尾 0）
+    uint32_t min;                   ///< UINT 取值范围
+    uint32_t max;
+    bool (*check)(uint32_t value);  ///< UINT 的附加校验，可为空
+    bool secret;                    ///< 导出时隐藏
+};
+
+/**
+ * @brief 字段表
+ */
+const Field* fields(size_t& count);
+
+/**
+ * @brief 默认设置（版本 0）
+ */
+void defaults(Document& doc);
+
+/**
+ * @brief 解析推送的 JSON 文档
+ *
+ * 文档是一层的 JSON 对象，键见字段表，另有必填的 "version"；未出现的字段保持 base 中的值。
+ * 未知的键、类型不符或超出范围时整份文档无效。
+ * @param out [out] 合并后的完整设置
+ * @param error [out] 失败原因
+ */
+esp_err_t parse(const char* json, size_t len, const Document& base, Document& out, char* error, size_t error_size);
+
+/**
+ * @brief 比较两份设置
+ * @return 变化的字段（第 i 位对应字段表第 i 项）
+ */
+uint32_t diff(const Document& a, const Document& b);
+
+/**
+ * @brief 变化的字段涉及的子系统
+ */
+uint8_t affected(uint32_t changed_fields);
+
+/**
+ * @brief 导出为 JSON，secret 字段只标明是否已设置
+ * @return 字符数（不含结尾 0），缓冲不足时返回 0
+ */
+size_t formatJson(const Document& doc, char* buf, size_t size);
+
+/**
+ * @brief 从 NVS 读取，没有或布局不兼容时返回默认设置
+ */
+void load(Document& doc);
+
+/**
+ * @brief 写入 NVS：整份文档一个 blob、一次提交，掉电时要么是旧文档要么是新文档
+ */
+esp_err_t save(const Document& doc);
+
+} // namespace settings
+} // namespace chunfeng
@@ -0,0 +1,33 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-16 13:20:44
+ * @LastEditTime: 2025-06-16 16:31:08
+ * @LastEditors: 星年
+ * @Description: 系统状态
+ * @FilePath: \ESP32-ChunFeng\main\include\system_state.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <cstdint>
+#include "message_bus.hpp"
+
+namespace chunfeng {
+
+/**
+ * @brief 系统状态（bus::Topic::SYSTEM_STATE）
+ */
+enum class SystemState : uint8_t {
+    BOOTING,    ///< 启动中
+    IDLE,       ///< 待机，等待唤醒
+    LISTENING,  ///< 唤醒后录音
+    THINKING,   ///< 等待云端回复
+    SPEAKING,   ///< 播放回复
+    UPGRADING,  ///< 固件升级
+    SLEEPING,   ///< 低功耗
+    ERROR,      ///< 故障
+};
+
+} // namespace chunfeng
+
+CF_BUS_TOPIC(SYSTEM_STATE, chunfeng::SystemState)
@@ -0,0 +1,166 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-21 11:20:06
+ * @LastEditTime: 2025-06-21 15:18:44
+ * @LastEditors: 星年
+ * @Description: 离线语音队列：断网时把编码后的语音存入 Flash，联网后按顺序补传，给实时对话让路
+ * @FilePath: \ESP32-ChunFeng\main\include\utterance_spool.hpp
+ * @遇事不决，可问春风
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "flash_queue.hpp"
+#include "lockfree_ring.hpp"
+#include "message_bus.hpp"
+
+namespace chunfeng {
+
+/**
+ * @brief 一段语音的参数，保存在条目第一条记录的开头
+ */
+struct UtteranceInfo {
+    uint32_t duration_ms;
+    uint16_t sample_rate;
+    uint8_t codec;          ///< 0 Opus
+    uint8_t frame_ms;       ///< 编码帧长
+};
+
+/**
+ * @brief 队列统计
+ */
+struct SpoolStats {
+    uint32_t queued;            ///< 写入 Flash 的语音
+    uint32_t uploaded;          ///< 补传完成的语音
+    uint32_t dropped;           ///< 丢弃的语音（暂存不足、数据损坏；队列满时的丢弃见 flash.dropped）
+    uint32_t upload_failures;   ///< 上传失败（整条重传）
+    spool::QueueStats flash;
+};
+
+/**
+ * @brief 离线语音队列
+ *
+ * 网络处于 FAILED（或尚未连上）时，编码任务把 VAD 截出的整段语音经 begin()/append()/end() 交给本队列：
+ * 数据先进 PSRAM 中的片段池，由队列任务写入 spool 分区（编码任务的栈在 PSRAM，不能访问 Flash）。
+ * 一段语音是一个条目，没有 end(true) 的语音不会被补传。
+ *
+ * NETWORK_STATE 变为 WIFI_CONNECTED 或 LTE_CONNECTED 后，队列任务按录音顺序逐片调用上传函数：
+ * 上传函数阻塞到数据交给链路为止，慢链路自然形成背压；返回错误时按退避时间重传整段。
+ * 整段上传成功后才标记送达，重启后未送达的语音继续补传（编号不变，服务端可据此去重）。
+ * SYSTEM_STATE 进入录音、思考、播放或升级时，补传在当前片段结束后暂停，实时对话结束后继续。
+ */
+class UtteranceSpool {
+public:
+    /**
+     * @brief 上传一个片段
+     * @param offset 该片段在本段语音中的偏移，为 0 时是一段新的上传
+     * @param last 本段语音的最后一个片段
+     * @return ESP_OK 已交给链路，其他值表示稍后整段重传
+     */
+    using Uploader = esp_err_t (*)(uint32_t id, const UtteranceInfo& info, uint32_t offset, const uint8_t* data,
+                                   size_t len, bool last, void* arg);
+
+    static constexpr const char* kPartitionLabel = "spool";
+    /** 每条 Flash 记录的数据量：一个扇区正好放下四条 */
+    static constexpr size_t kFragmentBytes =
+        (spool::kSectorSize - sizeof(spool::SectorHeader)) / 4 - sizeof(spool::RecordHeader);
+    static constexpr size_t kPoolFragments = 8;     ///< 片段池：16kbps 的 Opus 约可缓冲 4 秒
+
+    static UtteranceSpool& getInstance();
+
+    /**
+     * @brief 打开队列分区（恢复掉电前的内容）并创建队列任务
+     */
+    esp_err_t start(const char* partition_label = kPartitionLabel);
+
+    /**
+     * @brief 设置上传函数（由队列任务调用），未设置时只存不传
+     */
+    void setUploader(Uploader uploader, void* arg = nullptr);
+
+    /**
+     * @brief 已连上 WiFi 或 4G，采集方据此决定实时对话还是存入队列
+     */
+    bool online() const { return online_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 开始一段语音（编码任务调用，以下同）
+     */
+    esp_err_t begin(const UtteranceInfo& info);
+
+    /**
+     * @brief 追加编码后的数据
+     * @return ESP_ERR_NO_MEM 片段池耗尽（Flash 写入跟不上），本段语音被丢弃
+     */
+    esp_err_t append(const uint8_t* data, size_t len);
+
+    /**
+     * @brief 结束一段语音
+     * @param keep false 表示放弃（VAD 误触发），已写入的部分不会被补传
+     */
+    esp_err_t end(bool keep = true);
+
+    SpoolStats stats() const;
+
+    UtteranceSpool(const UtteranceSpool&) = delete;
+    UtteranceSpool& operator=(const UtteranceSpool&) = delete;
+
+private:
+    UtteranceSpool();
+
+    /** 片段池中的一块，下标在空闲队列、待写队列与采集方之间传递 */
+    struct Fragment {
+        uint32_t entry;
+        uint8_t flags;
+        uint16_t length;
+        uint8_t data[kFragmentBytes];
+    };
+
+    static void spoolTask(void* arg);
+    void run();
+    void onMessage(const bus::Message& message);
+    /** 把待写队列中的片段写入 Flash */
+    void storeFragments();
+    bool drainable() const;
+    /** 上传当前条目的下一个片段 */
+    void drainOne();
+    bool submit();
+
+    bus::Subscriber subscriber_;
+    spool::FlashQueue queue_;
+    TaskHandle_t task_{nullptr};
+    Fragment* pool_{nullptr};
+    LockFreeRing<uint8_t, kPoolFragments> free_;
+    LockFreeRing<uint8_t, kPoolFragments> ready_;
+
+    // 采集方
+    int current_{-1};               ///< 正在填充的片段，-1 表示没有
+    bool discarding_{false};        ///< 本段语音已被丢弃，直到 end()
+    std::atomic<uint32_t> next_entry_{1};
+
+    // 队列任务
+    std::atomic<bool> online_{false};
+    bool live_{false};              ///< 实时对话或升级中
+    std::atomic<Uploader> uploader_{nullptr};
+    std::atomic<void*> uploader_arg_{nullptr};
+    bool uploading_{false};         ///< entry_ 上传到一半
+    spool::Entry entry_{};
+    spool::Location cursor_{};
+    uint32_t offset_{0};
+    UtteranceInfo info_{};
+    uint32_t backoff_ms_{0};
+    int64_t retry_at_us_{0};
+    uint8_t buf_[kFragmentBytes];
+
+    std::atomic<uint32_t> queued_{0};
+    std::atomic<uint32_t> uploaded_{0};
+    std::atomic<uint32_t> dropped_{0};
+    std::atomic<uint32_t> upload_failures_{0};
+};
+
+} // namespace chunfeng
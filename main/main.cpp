@@ -1,7 +1,7 @@
 /*
  * @Author: jixingnian@gmail.com
  * @Date: 2025-05-24 14:53:16
- * @LastEditTime: 2025-05-29 21:34:24
+ * @LastEditTime: 2025-07-01 19:26:48
  * @LastEditors: 星年 && j_xingnian@163.com
  * @Description: ESP春风
  * @FilePath: \ESP32-ChunFeng\main\main.cpp
@@ -10,21 +10,124 @@
 #include "network_manager.hpp"
 // #include "audio_manager.hpp"
 // #include "coze_manager.hpp"
-// #include "display_manager.hpp"
-// #include "backend_manager.hpp"
+#include "display_manager.hpp"
+#include "backend_manager.hpp"
 #include "freertos/FreeRTOS.h"   /* FreeRTOS核心头文件 */
 // #include "freertos/event_groups.h"/* FreeRTOS事件组头文件 */
 
 #include "esp_log.h"
+#include "esp_spiffs.h"
 #include "nvs_flash.h"
+#include "cf_log.hpp"
+#include "task_topology.hpp"
+#include "ota_updater.hpp"
+#include "utterance_spool.hpp"
+#include "response_cache.hpp"
+#include "boot_sequencer.hpp"
+#include "config_manager.hpp"
+#include "wifi_manager.hpp"
+#include "power_manager.hpp"
+#include "command_router.hpp"
+#include "system_state.hpp"
 
 static const char* TAG = "ChunFeng";
 
+// 新固件启动后自检的时限，超时视为新固件有问题
+static constexpr int OTA_CONFIRM_TIMEOUT_S = 300;
+// 与后端往返成功后，应用任务还要稳定运行这么久才确认新固件
+static constexpr int OTA_CONFIRM_STABLE_S = 60;
+
 using namespace chunfeng;
 
+namespace {
+
+// 开机阶段：互不依赖的阶段由 boot::Sequencer 在两个核心上并行运行，顺序见下方的阶段表
+
+// 挂载 storage 分区后把日志同时写入文件
+esp_err_t initStorage(void*) {
+    esp_vfs_spiffs_conf_t spiffs_conf = {
+        .base_path = "/storage",
+        .partition_label = "storage",
+        .max_files = 8,     // 日志、字库、合成语音缓存的读取与写入
+        .format_if_mount_failed = true
+    };
+    esp_err_t err = esp_vfs_spiffs_register(&spiffs_conf);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "storage 分区挂载失败，日志仅输出到串口");
+        return err;
+    }
+    log::addFileSink("/storage/chunfeng.log", 64 * 1024);
+    // 固定提示音与重复的回复命中缓存时直接从 Flash 播放，不再合成、下载
+    return ResponseCache::getInstance().open();
+}
+
+// 设置文档：从 NVS 读取，并接管配网服务的 /settings 推送
+esp_err_t initSettings(void*) {
+    BackendManager::getInstance().initialize();
+    return ESP_OK;
+}
+
+// 屏幕：字库放在 storage 分区，状态由显示任务差分刷新
+esp_err_t initDisplay(void*) {
+    esp_err_t err = DisplayManager::getInstance().start();
+    if (err != ESP_OK) CF_LOGW(TAG, "屏幕初始化失败，继续无屏运行");
+    return err;
+}
+
+// 离线语音队列：先于网络状态机订阅网络状态，断网时录下的语音存入 spool 分区，联网后补传
+esp_err_t initSpool(void*) {
+    esp_err_t err = UtteranceSpool::getInstance().start();
+    if (err != ESP_OK) CF_LOGW(TAG, "离线语音队列不可用，断网时的语音将被丢弃");
+    return err;
+}
+
+// WiFi 驱动与配网服务（网页），原先由网络状态机在 CONNECTING 中启动，提前后与挂载、屏幕并行；
+// 未配网时同时开启配网 AP，已配网时只开 STA（softAP 开启时 WiFi 不能休眠），连不上 WiFi 时由网络状态机开启
+esp_err_t initWifi(void*) {
+    bool provisioned = !WiFiManager::getInstance().getNetworks().empty();
+    return ConfigManager::getInstance().startConfig(!provisioned) ? ESP_OK : ESP_FAIL;
+}
+
+// 各个管理器在按任务表创建的任务中运行（NetworkManager 的构造函数即状态机，不返回）
+esp_err_t startNetwork(void*) {
+    BaseType_t ok = tasks::spawn(tasks::TaskId::NETWORK, [](void*) { NetworkManager::getInstance(); }, nullptr);
+    return ok == pdPASS ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+// 电源管理：在 WiFi 驱动启动后接管省电模式，交互之间降频、modem sleep，空闲一段时间后 light sleep
+esp_err_t startPower(void*) {
+    return PowerManager::getInstance().start();
+}
+
+// 设备端指令：读入 storage 分区中录好的模板，音量、停止、网络状态在本地执行，断网时同样可用
+esp_err_t initCommands(void*) {
+    esp_err_t err = CommandRouter::getInstance().start();
+    if (err != ESP_OK) CF_LOGW(TAG, "设备端指令不可用，语音全部交给云端");
+    return err;
+}
+
+enum : uint8_t { STORAGE, SETTINGS, DISPLAY, SPOOL, WIFI, NETWORK, POWER, COMMANDS };
+
+// 屏幕与设置就绪即可交互；屏幕刷新任务在核心 1，初始化也放在核心 1
+const boot::Stage kBootStages[] = {
+    {"storage",  initStorage,  nullptr, 0,                                                    boot::kAnyCore, 0},
+    {"settings", initSettings, nullptr, 0,                                                    boot::kAnyCore,
+     boot::kInteractive},
+    {"display",  initDisplay,  nullptr, boot::after(STORAGE),                                 1,
+     boot::kInteractive},
+    {"spool",    initSpool,    nullptr, 0,                                                    boot::kAnyCore, 0},
+    {"wifi",     initWifi,     nullptr, 0,                                                    0,              0},
+    {"network",  startNetwork, nullptr, boot::after(WIFI) | boot::after(SETTINGS) | boot::after(SPOOL),
+     boot::kAnyCore, 0},
+    {"power",    startPower,   nullptr, boot::after(WIFI),                                    boot::kAnyCore, 0},
+    {"commands", initCommands, nullptr, boot::after(STORAGE),                                 boot::kAnyCore, 0},
+};
+
+} // namespace
+
 extern "C" void app_main(void)
 {
-    // 初始化NVS
+    // 初始化NVS（各阶段与开机耗时记录都要用到，先于开机编排）
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_ERROR_CHECK(nvs_flash_erase());
@@ -32,17 +135,33 @@ extern "C" void app_main(void)
     }
     ESP_ERROR_CHECK(ret);
 
-    // 获取各个管理器实例
-    auto& network_mgr = NetworkManager::getInstance();
+    // 启动日志后台任务
+    log::start();
+
+    // 任务拓扑表有问题时只告警，主机构建会在编译阶段拦截
+    tasks::validate([](const char* message) { CF_LOGE(TAG, "任务表: %s", message); });
+    tasks::adopt(tasks::TaskId::MAIN, xTaskGetCurrentTaskHandle());
+
+    // 每次开机输出各阶段的时间线，耗时保存在 NVS 中，下次开机先运行关键路径上的阶段
+    static boot::Sequencer sequencer(kBootStages, sizeof(kBootStages) / sizeof(kBootStages[0]));
+    sequencer.run();
+    sequencer.logTimeline();
+    // 开机完成，进入待机（电源管理据此开始计算空闲时间）
+    bus::publish<bus::Topic::SYSTEM_STATE>(SystemState::IDLE);
     // auto& audio_mgr = AudioManager::getInstance();
     // auto& coze_mgr = CozeManager::getInstance();
-    // auto& display_mgr = DisplayManager::getInstance();
-    // auto& backend_mgr = BackendManager::getInstance();
-    
-    // TODO: 初始化各个模块
-    
-    // 进入主循环
+
+    // 新固件第一次启动：与云端往返成功、之后稳定运行一段时间才确认，
+    // 确认前重启（崩溃、看门狗）或自检超时由引导程序回滚到旧固件
+    ota::HealthCheck health;
+    health.host = "api.coze.cn";
+    health.stable_ms = OTA_CONFIRM_STABLE_S * 1000;
+    health.timeout_ms = OTA_CONFIRM_TIMEOUT_S * 1000;
+    ota::OtaUpdater::getInstance().verify(health);
+
+    // 主任务定期输出各任务的栈余量与 CPU 占用
     while (true) {
-        vTaskDelay(pdMS_TO_TICKS(1000)); // 避免占用过多CPU
+        vTaskDelay(pdMS_TO_TICKS(60 * 1000));
+        tasks::logReport();
     }
 }
\ No newline at end of file
@@ -0,0 +1,391 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-19 10:31:07
+ * @LastEditTime: 2025-07-02 14:26:08
+ * @LastEditors: 星年
+ * @Description: 后台管理：设置推送的差异应用、失败撤销与一次性持久化
+ * @FilePath: \ESP32-ChunFeng\main\src\backend_manager.cpp
+ * @遇事不决，可问春风
+ */
+#include "backend_manager.hpp"
+#include "audio_playback.hpp"
+#include "bsp_config_network.hpp"
+#include "wifi_manager.hpp"
+#include "lte_manager.hpp"
+#include "cf_log.hpp"
+#include "metrics.hpp"
+#include "status_board.hpp"
+#include "esp_timer.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace chunfeng {
+
+namespace {
+
+const char* TAG = "BackendManager";
+
+metrics::Counter s_applied("chunfeng_settings_applied_total", "成功应用的设置推送次数");
+metrics::Counter s_rejected("chunfeng_settings_rejected_total", "被拒绝或应用失败的设置推送次数");
+
+// 应用顺序：网络最慢、也最难撤销，放在最后
+const settings::Subsystem kApplyOrder[] = {settings::AUDIO, settings::COZE, settings::SYSTEM, settings::NETWORK};
+
+const char* subsystemName(settings::Subsystem subsystem) {
+    switch (subsystem) {
+    case settings::NETWORK: return "network";
+    case settings::AUDIO: return "audio";
+    case settings::COZE: return "coze";
+    case settings::SYSTEM: return "system";
+    }
+    return "?";
+}
+
+int subsystemIndex(settings::Subsystem subsystem) {
+    return __builtin_ctz(subsystem);
+}
+
+/* ---------- 内置子系统 ---------- */
+
+// 音频：只改播放参数，播放任务在帧边界切换，不涉及其他模块
+esp_err_t applyAudio(const settings::Document& next, const settings::Document& prev) {
+    AudioPlayback& playback = AudioPlayback::getInstance();
+    if (next.audio_sample_rate != prev.audio_sample_rate) {
+        esp_err_t err = playback.setSampleRate(next.audio_sample_rate);
+        if (err != ESP_OK) return err;
+    }
+    if (next.audio_loudness != prev.audio_loudness || next.audio_ceiling != prev.audio_ceiling) {
+        // 响度目标高于峰值上限时拒绝，整份推送撤销
+        AudioConfig levels;
+        levels.play_loudness_dbfs = static_cast<int8_t>(-static_cast<int>(next.audio_loudness));
+        levels.play_ceiling_dbfs = static_cast<int8_t>(-static_cast<int>(next.audio_ceiling));
+        esp_err_t err = playback.setLevels(levels);
+        if (err != ESP_OK) return err;
+    }
+    playback.setVolume(next.audio_volume);
+    return ESP_OK;
+}
+
+// 推送的 WiFi 等待连接结果的上限：超过即视为失败，整份推送撤销
+constexpr uint32_t kWiFiApplyTimeoutMs = 10000;
+// 回复发出后再切换：STA 单独运行时推送正是经当前链路到达的，立即断开推送方就收不到回复
+constexpr uint32_t kWiFiSwitchDelayMs = 300;
+
+// 进行中的 WiFi 切换。BackendManager 同一时间只有一个延迟应用的推送，applyNetwork 写入后
+// 依次只在切换定时器与连接完成回调中读取
+struct WiFiSwitch {
+    settings::Document next;
+    settings::Document prev;
+    std::string prev_ssid;          ///< 切换前关联的 AP，失败时连回；为空表示切换前没有 WiFi 链路
+    std::string prev_password;
+    bool was_saved{false};          ///< 推送的网络原本就在已保存列表中
+    std::string saved_password;     ///< 原本保存的密码，提交失败时恢复
+};
+
+WiFiSwitch s_switch;
+esp_timer_handle_t s_switch_timer = nullptr;
+
+esp_err_t connectError(ConnectResult result) {
+    switch (result) {
+    case ConnectResult::CONNECTED:
+        return ESP_OK;
+    case ConnectResult::AUTH_FAILED:
+    case ConnectResult::NO_AP_FOUND:
+        return ESP_ERR_INVALID_ARG;
+    case ConnectResult::TIMEOUT:
+    case ConnectResult::DHCP_TIMEOUT:
+        return ESP_ERR_TIMEOUT;
+    default:
+        return ESP_FAIL;
+    }
+}
+
+// 连接完成（事件循环任务）：先把网络写入已保存列表，再由 BackendManager 保存文档；
+// 任一步失败都把列表恢复原样、待机时间改回，并连回切换前的 AP
+void onWiFiSwitched(const ConnectStatus& status, void*) {
+    const WiFiSwitch& sw = s_switch;
+    WiFiManager& wifi = WiFiManager::getInstance();
+    esp_err_t err = connectError(status.result);
+    bool listed = false;
+    if (err != ESP_OK) {
+        CF_LOGW(TAG, "推送的 WiFi %s 连接失败: %s", sw.next.wifi_ssid, connectResultName(status.result));
+    } else if (wifi.saveWiFiInfo(sw.next.wifi_ssid, sw.next.wifi_password)) {
+        listed = true;
+    } else {
+        err = ESP_FAIL;
+    }
+    err = BackendManager::getInstance().completeDeferred(settings::NETWORK, err);
+    if (err == ESP_OK) return;
+
+    if (listed) {
+        if (sw.was_saved) {
+            wifi.saveWiFiInfo(sw.next.wifi_ssid, sw.saved_password);
+        } else {
+            wifi.removeNetwork(sw.next.wifi_ssid);
+        }
+    }
+    LTEManager::getInstance().setLinger(sw.prev.lte_linger_s * 1000);
+    if (!sw.prev_ssid.empty()) {
+        CF_LOGI(TAG, "连回切换前的 WiFi %s", sw.prev_ssid);
+        wifi.connectAsync(sw.prev_ssid, sw.prev_password);
+    } else if (status.result == ConnectResult::CONNECTED) {
+        WiFiConnector::getInstance().disconnect();
+    }
+}
+
+void startWiFiSwitch(void*) {
+    ConnectOptions options;
+    options.timeout_ms = kWiFiApplyTimeoutMs;
+    options.on_complete = onWiFiSwitched;
+    WiFiManager::getInstance().connectAsync(s_switch.next.wifi_ssid, s_switch.next.wifi_password, options);
+}
+
+// 网络：只切换 STA 关联，WiFi 驱动保持运行。切换在回复发出后进行，返回 ESP_ERR_NOT_FINISHED，
+// 获取 IP 后才加入已保存列表并提交文档（见 onWiFiSwitched）。只改了 4G 待机时间时不动 WiFi
+esp_err_t applyNetwork(const settings::Document& next, const settings::Document& prev) {
+    LTEManager::getInstance().setLinger(next.lte_linger_s * 1000);
+    if (next.wifi_ssid[0] == '\0') return ESP_OK;
+    if (strcmp(next.wifi_ssid, prev.wifi_ssid) == 0 && strcmp(next.wifi_password, prev.wifi_password) == 0) {
+        return ESP_OK;
+    }
+    if (!s_switch_timer) {
+        esp_timer_create_args_t args = {};
+        args.callback = startWiFiSwitch;
+        args.name = "wifi_switch";
+        if (esp_timer_create(&args, &s_switch_timer) != ESP_OK) {
+            // 失败的子系统不在撤销范围内，待机时间在这里恢复
+            LTEManager::getInstance().setLinger(prev.lte_linger_s * 1000);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    WiFiSwitch& sw = s_switch;
+    sw.next = next;
+    sw.prev = prev;
+    sw.prev_ssid.clear();
+    sw.prev_password.clear();
+    WiFiConnector::getInstance().currentLink(sw.prev_ssid, sw.prev_password);
+    sw.was_saved = false;
+    for (const SavedNetwork& n : WiFiManager::getInstance().getNetworks()) {
+        if (n.ssid != next.wifi_ssid) continue;
+        sw.was_saved = true;
+        sw.saved_password = n.password;
+    }
+    esp_timer_start_once(s_switch_timer, static_cast<uint64_t>(kWiFiSwitchDelayMs) * 1000);
+    return ESP_ERR_NOT_FINISHED;
+}
+
+} // namespace
+
+BackendManager& BackendManager::getInstance() {
+    static BackendManager instance;
+    return instance;
+}
+
+BackendManager::BackendManager() {
+    settings::defaults(current_);
+    appliers_[subsystemIndex(settings::AUDIO)] = applyAudio;
+    appliers_[subsystemIndex(settings::NETWORK)] = applyNetwork;
+}
+
+void BackendManager::initialize() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        settings::load(current_);
+        CF_LOGI(TAG, "设置版本 %u", static_cast<unsigned>(current_.version));
+        LTEManager::getInstance().setLinger(current_.lte_linger_s * 1000);
+        status_.version = current_.version;
+        status::updateSettings(status_);
+    }
+    BspConfigNetwork::setSettingsHandler(handleHttp);
+}
+
+void BackendManager::setApplier(settings::Subsystem subsystem, Applier applier) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    appliers_[subsystemIndex(subsystem)] = applier;
+}
+
+ApplyResult BackendManager::applySettings(const char* json, size_t len) {
+    ApplyResult result;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_subsystems_) {
+        result.err = ESP_ERR_INVALID_STATE;
+        snprintf(result.message, sizeof(result.message), "版本 %u 仍在应用",
+                 static_cast<unsigned>(pending_.version));
+        s_rejected.inc();
+        return result;
+    }
+    const settings::Document prev = current_;
+    settings::Document next;
+    result.err = settings::parse(json, len, prev, next, result.message, sizeof(result.message));
+    if (result.err != ESP_OK) {
+        s_rejected.inc();
+        return result;
+    }
+    result.version = next.version;
+    if (next.version <= prev.version) {
+        result.err = ESP_ERR_INVALID_VERSION;
+        snprintf(result.message, sizeof(result.message), "版本 %u 不大于当前版本 %u",
+                 static_cast<unsigned>(next.version), static_cast<unsigned>(prev.version));
+        s_rejected.inc();
+        return result;
+    }
+
+    result.changed = settings::diff(prev, next);
+    const uint8_t subsystems = settings::affected(result.changed);
+    for (settings::Subsystem s : kApplyOrder) {
+        if (!(subsystems & s)) continue;
+        Applier applier = appliers_[subsystemIndex(s)];
+        esp_err_t err = applier ? applier(next, prev) : ESP_OK;
+        if (err == ESP_ERR_NOT_FINISHED) {
+            result.pending |= s;
+            continue;
+        }
+        if (err != ESP_OK) {
+            result.err = err;
+            snprintf(result.message, sizeof(result.message), "%s 应用失败: %d", subsystemName(s), err);
+            break;
+        }
+        result.reconfigured |= s;
+    }
+    if (result.err == ESP_OK && result.pending) {
+        // 文档等延迟应用的子系统完成后才保存（completeDeferred），这期间当前设置不变
+        pending_ = next;
+        pending_subsystems_ = result.pending;
+        pending_reconfigured_ = result.reconfigured;
+        status_.pending = next.version;
+        status::updateSettings(status_);
+        CF_LOGI(TAG, "设置版本 %u 已接受，子系统 0x%x 在后台应用", static_cast<unsigned>(next.version),
+                static_cast<unsigned>(result.pending));
+        return result;
+    }
+    if (result.err == ESP_OK) {
+        result.err = settings::save(next);
+        if (result.err != ESP_OK) snprintf(result.message, sizeof(result.message), "保存失败: %d", result.err);
+    }
+    if (result.err != ESP_OK) {
+        revertLocked(result.reconfigured, next, prev);
+        result.reconfigured = 0;
+        s_rejected.inc();
+        finishLocked(next, result.err);
+        CF_LOGW(TAG, "设置版本 %u 未应用: %s", static_cast<unsigned>(next.version),
+                result.message);
+        return result;
+    }
+    current_ = next;
+    s_applied.inc();
+    finishLocked(next, ESP_OK);
+    CF_LOGI(TAG, "设置版本 %u 已应用，变化字段 0x%x，重新配置子系统 0x%x", static_cast<unsigned>(next.version),
+            static_cast<unsigned>(result.changed), static_cast<unsigned>(result.reconfigured));
+    return result;
+}
+
+esp_err_t BackendManager::completeDeferred(settings::Subsystem subsystem, esp_err_t err) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // 推送已因其他子系统失败而撤销：调用方自己恢复
+    if (!(pending_subsystems_ & subsystem)) return ESP_ERR_INVALID_STATE;
+    pending_subsystems_ &= ~subsystem;
+    if (err == ESP_OK) {
+        if (pending_subsystems_) return ESP_OK;
+        err = settings::save(pending_);
+        if (err != ESP_OK) CF_LOGE(TAG, "设置版本 %u 保存失败: %d", static_cast<unsigned>(pending_.version), err);
+    }
+    if (err != ESP_OK) {
+        revertLocked(pending_reconfigured_, pending_, current_);
+        pending_subsystems_ = 0;
+        s_rejected.inc();
+        finishLocked(pending_, err);
+        CF_LOGW(TAG, "设置版本 %u 未应用: %s 失败 %d，已撤销", static_cast<unsigned>(pending_.version),
+                subsystemName(subsystem), err);
+        return err;
+    }
+    current_ = pending_;
+    s_applied.inc();
+    finishLocked(pending_, ESP_OK);
+    CF_LOGI(TAG, "设置版本 %u 已应用（%s 后台完成）", static_cast<unsigned>(current_.version),
+            subsystemName(subsystem));
+    return ESP_OK;
+}
+
+void BackendManager::revertLocked(uint8_t subsystems, const settings::Document& next,
+                                  const settings::Document& prev) {
+    // 按相反顺序把已应用的子系统恢复到原设置
+    for (int i = sizeof(kApplyOrder) / sizeof(kApplyOrder[0]) - 1; i >= 0; --i) {
+        settings::Subsystem s = kApplyOrder[i];
+        if (!(subsystems & s)) continue;
+        Applier applier = appliers_[subsystemIndex(s)];
+        if (applier && applier(prev, next) != ESP_OK) CF_LOGE(TAG, "%s 恢复原设置失败", subsystemName(s));
+    }
+}
+
+void BackendManager::finishLocked(const settings::Document& next, esp_err_t err) {
+    status_.version = current_.version;
+    status_.pending = 0;
+    status_.last = next.version;
+    status_.last_error = err;
+    status::updateSettings(status_);
+}
+
+settings::Document BackendManager::getSettings() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return current_;
+}
+
+size_t BackendManager::getCurrentStatus(char* buf, size_t size) const {
+    status::Snapshot snapshot;
+    status::read(snapshot);
+    return status::formatJson(snapshot, buf, size);
+}
+
+const char* BackendManager::handleHttp(const char* body, size_t len, char* out, size_t out_size) {
+    BackendManager& self = getInstance();
+    if (!body) {
+        settings::Document doc = self.getSettings();
+        return settings::formatJson(doc, out, out_size) ? "200 OK" : "500 Internal Server Error";
+    }
+    ApplyResult result = self.applySettings(body, len);
+    if (result.err != ESP_OK) {
+        // 错误信息里可能带有推送方给出的键名，引号与控制字符替换掉
+        for (char* c = result.message; *c; ++c) {
+            if (*c == '"' || *c == '\\' || static_cast<unsigned char>(*c) < 0x20) *c = '?';
+        }
+        snprintf(out, out_size, "{\"ok\":false,\"error\":\"%s\"}", result.message);
+        if (result.err == ESP_ERR_INVALID_ARG) return "400 Bad Request";
+        if (result.err == ESP_ERR_INVALID_VERSION || result.err == ESP_ERR_INVALID_STATE) return "409 Conflict";
+        return "500 Internal Server Error";
+    }
+    size_t n = 0;
+    auto append = [&](const char* fmt, auto... args) {
+        if (n >= out_size) return;
+        int w = snprintf(out + n, out_size - n, fmt, args...);
+        n = w < 0 ? out_size : n + w;
+    };
+    append("{\"ok\":true,\"version\":%u,\"changed\":[", static_cast<unsigned>(result.version));
+    size_t count;
+    const settings::Field* fields = settings::fields(count);
+    const char* sep = "";
+    for (size_t i = 0; i < count; ++i) {
+        if (!(result.changed & (1u << i))) continue;
+        append("%s\"%s\"", sep, fields[i].name);
+        sep = ",";
+    }
+    append("],\"reconfigured\":[");
+    sep = "";
+    for (settings::Subsystem s : kApplyOrder) {
+        if (!(result.reconfigured & s)) continue;
+        append("%s\"%s\"", sep, subsystemName(s));
+        sep = ",";
+    }
+    append("],\"pending\":[");
+    sep = "";
+    for (settings::Subsystem s : kApplyOrder) {
+        if (!(result.pending & s)) continue;
+        append("%s\"%s\"", sep, subsystemName(s));
+        sep = ",";
+    }
+    append("]}");
+    // 仍在后台应用：结果经 /status 给出
+    return result.pending ? "202 Accepted" : "200 OK";
+}
+
+} // namespace chunfeng
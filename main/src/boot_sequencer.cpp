@@ -0,0 +1,269 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-23 09:30:12
+ * @LastEditTime: 2025-06-23 16:12:45
+ * @LastEditors: 星年
+ * @Description: 开机编排：依赖检查、按关键路径选择阶段、每核一个开机任务、时间线与耗时记录
+ * @FilePath: \ESP32-ChunFeng\main\src\boot_sequencer.cpp
+ * @遇事不决，可问春风
+ */
+#include "boot_sequencer.hpp"
+#include "cf_log.hpp"
+#include "metrics.hpp"
+#include "task_topology.hpp"
+#include "trace.hpp"
+#include "esp_timer.h"
+#include "nvs.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+namespace chunfeng {
+namespace boot {
+
+namespace {
+
+const char* TAG = "Boot";
+const char* NVS_NAMESPACE = "boot";
+
+/** NVS 中保存的各阶段耗时 */
+struct Profile {
+    uint32_t names_hash;    ///< 阶段表变化（增删、改名、换顺序）后旧记录作废
+    uint32_t count;
+    uint32_t stage_us[kMaxStages];
+};
+
+std::atomic<const Sequencer*> s_last{nullptr};
+
+metrics::Gauge s_interactive_ms("chunfeng_boot_interactive_ms", "开机到可交互（屏幕、设置就绪）的耗时（毫秒）");
+metrics::Gauge s_total_ms("chunfeng_boot_total_ms", "开机各阶段全部完成的耗时（毫秒）");
+
+void collectStages(metrics::Renderer& r) {
+    const Sequencer* seq = s_last.load(std::memory_order_acquire);
+    if (!seq) return;
+    char labels[64];
+    for (size_t i = 0; i < seq->count(); ++i) {
+        const StageRecord& rec = seq->record(i);
+        snprintf(labels, sizeof(labels), "stage=\"%s\",core=\"%d\"", seq->stage(i).name, rec.core);
+        r.sample("chunfeng_boot_stage_ms", i == 0 ? "本次开机各阶段的耗时（毫秒）" : nullptr,
+                 metrics::Metric::Type::GAUGE, labels, (rec.end_us - rec.start_us) / 1000);
+    }
+}
+
+metrics::Collector s_stage_collector(collectStages);
+
+} // namespace
+
+Sequencer::Sequencer(const Stage* stages, size_t count, const char* profile_key)
+    : stages_(stages), count_(count), profile_key_(profile_key) {}
+
+Sequencer::~Sequencer() {
+    const Sequencer* self = this;
+    s_last.compare_exchange_strong(self, nullptr);
+}
+
+uint32_t Sequencer::namesHash() const {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < count_; ++i) {
+        for (const char* p = stages_[i].name; ; ++p) {
+            h = (h ^ static_cast<uint8_t>(*p)) * 16777619u;
+            if (!*p) break;
+        }
+    }
+    return h;
+}
+
+void Sequencer::loadProfile(uint32_t* estimate_us) {
+    if (!profile_key_) return;
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return;
+    Profile profile;
+    size_t len = sizeof(profile);
+    esp_err_t err = nvs_get_blob(handle, profile_key_, &profile, &len);
+    nvs_close(handle);
+    if (err != ESP_OK || len != sizeof(profile) || profile.count != count_ || profile.names_hash != namesHash()) {
+        return;
+    }
+    for (size_t i = 0; i < count_; ++i) estimate_us[i] = std::max<uint32_t>(profile.stage_us[i], 1);
+    has_profile_ = true;
+}
+
+void Sequencer::saveProfile() const {
+    if (!profile_key_) return;
+    Profile profile = {};
+    profile.names_hash = namesHash();
+    profile.count = static_cast<uint32_t>(count_);
+    for (size_t i = 0; i < count_; ++i) profile.stage_us[i] = records_[i].end_us - records_[i].start_us;
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, profile_key_, &profile, sizeof(profile));
+        if (err == ESP_OK) err = nvs_commit(handle);
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) CF_LOGW(TAG, "保存开机耗时失败: %d", err);
+}
+
+bool Sequencer::plan() {
+    if (count_ == 0 || count_ > kMaxStages) return false;
+    const uint32_t all = (1u << count_) - 1;
+    uint32_t estimate_us[kMaxStages];
+    std::fill(estimate_us, estimate_us + kMaxStages, 1000);
+    loadProfile(estimate_us);
+
+    // 拓扑排序（Kahn），顺带发现环与越界的依赖
+    size_t order[kMaxStages];
+    size_t sorted = 0;
+    uint32_t placed = 0;
+    while (sorted < count_) {
+        bool progress = false;
+        for (size_t i = 0; i < count_; ++i) {
+            if ((placed >> i) & 1) continue;
+            if (stages_[i].depends & ~all) return false;
+            if ((stages_[i].depends & ~placed) != 0) continue;
+            order[sorted++] = i;
+            placed |= 1u << i;
+            progress = true;
+        }
+        if (!progress) return false;
+    }
+    // 关键路径：自身耗时加上依赖它的阶段中最长的一条，按拓扑逆序计算
+    for (size_t k = count_; k-- > 0;) {
+        size_t i = order[k];
+        uint32_t tail = 0;
+        for (size_t j = 0; j < count_; ++j) {
+            if ((stages_[j].depends >> i) & 1) tail = std::max(tail, rank_us_[j]);
+        }
+        rank_us_[i] = estimate_us[i] + tail;
+    }
+    return true;
+}
+
+esp_err_t Sequencer::run() {
+    if (!plan()) {
+        CF_LOGE(TAG, "开机阶段的依赖有环或越界");
+        return ESP_ERR_INVALID_ARG;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        started_ = done_ = interactive_mask_ = 0;
+        for (size_t i = 0; i < count_; ++i) {
+            records_[i] = StageRecord{0, 0, ESP_OK, -1};
+            if (stages_[i].flags & kInteractive) interactive_mask_ |= 1u << i;
+        }
+        interactive_us_ = total_us_ = 0;
+        t0_us_ = esp_timer_get_time();
+        workers_ = 0;
+    }
+    const tasks::TaskId ids[2] = {tasks::TaskId::BOOT_0, tasks::TaskId::BOOT_1};
+    for (int core = 0; core < 2; ++core) {
+        worker_args_[core] = Worker{this, core};
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tasks::spawn(ids[core], workerTask, &worker_args_[core]) == pdPASS) workers_++;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (workers_ < 2) {
+        // 开机任务没有创建成功（内存不足）时由调用方代替它运行，都失败时不区分核心
+        CF_LOGW(TAG, "开机任务只创建了 %d 个", workers_);
+        int core = workers_ == 0 ? kAnyCore : (tasks::handle(ids[0]) ? 1 : 0);
+        lock.unlock();
+        work(core);
+        lock.lock();
+    }
+    changed_.wait(lock, [this] { return workers_ == 0; });
+    total_us_ = static_cast<uint32_t>(esp_timer_get_time() - t0_us_);
+    if (!interactive_mask_) interactive_us_ = total_us_;
+    lock.unlock();
+
+    s_interactive_ms.set(static_cast<int32_t>(interactive_us_ / 1000));
+    s_total_ms.set(static_cast<int32_t>(total_us_ / 1000));
+    s_last.store(this, std::memory_order_release);
+    saveProfile();
+    return ESP_OK;
+}
+
+void Sequencer::workerTask(void* arg) {
+    Worker* w = static_cast<Worker*>(arg);
+    w->self->work(w->core);
+    {
+        std::lock_guard<std::mutex> lock(w->self->mutex_);
+        w->self->workers_--;
+        w->self->changed_.notify_all();
+    }
+    vTaskDelete(nullptr);
+}
+
+int Sequencer::pickLocked(int core) const {
+    // 绑定本核心的阶段只能在这里运行，先于不限核心的阶段；同类中关键路径长的先运行，相同时按声明顺序
+    int best = -1;
+    bool best_pinned = false;
+    for (size_t i = 0; i < count_; ++i) {
+        const Stage& s = stages_[i];
+        if (((started_ >> i) & 1) || (s.depends & ~done_) != 0) continue;
+        if (core != kAnyCore && s.core != kAnyCore && s.core != core) continue;
+        bool pinned = s.core != kAnyCore;
+        if (best < 0 || pinned > best_pinned || (pinned == best_pinned && rank_us_[i] > rank_us_[best])) {
+            best = static_cast<int>(i);
+            best_pinned = pinned;
+        }
+    }
+    return best;
+}
+
+void Sequencer::work(int core) {
+    const uint32_t all = (1u << count_) - 1;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (done_ != all) {
+        int i = pickLocked(core);
+        if (i < 0) {
+            // 等其他核心上的阶段完成，解除依赖后再选
+            changed_.wait(lock);
+            continue;
+        }
+        const Stage& s = stages_[i];
+        StageRecord& rec = records_[i];
+        started_ |= 1u << i;
+        rec.core = static_cast<int8_t>(core);
+        rec.start_us = static_cast<uint32_t>(esp_timer_get_time() - t0_us_);
+        lock.unlock();
+
+        CF_TRACE_BEGIN(s.name);
+        esp_err_t err = s.fn ? s.fn(s.arg) : ESP_OK;
+        CF_TRACE_END(s.name);
+
+        lock.lock();
+        rec.end_us = static_cast<uint32_t>(esp_timer_get_time() - t0_us_);
+        rec.err = err;
+        done_ |= 1u << i;
+        if (err != ESP_OK) CF_LOGW(TAG, "阶段 %s 失败: %s", s.name, esp_err_to_name(err));
+        if (interactive_mask_ && !interactive_us_ && (done_ & interactive_mask_) == interactive_mask_) {
+            interactive_us_ = rec.end_us;
+        }
+        changed_.notify_all();
+    }
+}
+
+uint32_t Sequencer::sequentialUs() const {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < count_; ++i) sum += records_[i].end_us - records_[i].start_us;
+    return sum;
+}
+
+void Sequencer::logTimeline() const {
+    size_t order[kMaxStages];
+    for (size_t i = 0; i < count_; ++i) order[i] = i;
+    std::sort(order, order + count_,
+              [this](size_t a, size_t b) { return records_[a].start_us < records_[b].start_us; });
+    for (size_t k = 0; k < count_; ++k) {
+        const StageRecord& rec = records_[order[k]];
+        CF_LOGI(TAG, "  核心 %d  %5u ~ %5u ms  %s%s", rec.core, static_cast<unsigned>(rec.start_us / 1000),
+                static_cast<unsigned>(rec.end_us / 1000), stages_[order[k]].name, rec.err == ESP_OK ? "" : "（失败）");
+    }
+    CF_LOGI(TAG, "可交互 %u ms，全部完成 %u ms，顺序初始化需 %u ms", static_cast<unsigned>(interactive_us_ / 1000),
+            static_cast<unsigned>(total_us_ / 1000), static_cast<unsigned>(sequentialUs() / 1000));
+}
+
+} // namespace boot
+} // namespace chunfeng
@@ -0,0 +1,385 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-30 09:12:40
+ * @LastEditTime: 2025-07-01 18:12:05
+ * @LastEditors: 星年
+ * @Description: 设备端指令：分段端点检测、预录与整句暂存、本地指令执行与提示语（提示音）播报
+ * @FilePath: \ESP32-ChunFeng\main\src\command_router.cpp
+ * @遇事不决，可问春风
+ */
+#include "command_router.hpp"
+#include "audio_playback.hpp"
+#include "bsp_config_network.hpp"
+#include "cf_log.hpp"
+#include "metrics.hpp"
+#include "network_manager.hpp"
+#include "status_board.hpp"
+#include "esp_heap_caps.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace chunfeng {
+
+namespace {
+
+const char* TAG = "CommandRouter";
+
+// 提示音幅度约 -12dBFS，首尾各 5ms 渐变，避免咔哒声
+constexpr int32_t kBeepAmplitude = 8192;
+constexpr uint32_t kBeepRampMs = 5;
+
+// 正弦表：相位累加器的高 8 位查表
+constexpr size_t kSineTable = 256;
+
+struct SineTable {
+    int16_t q15[kSineTable];
+    SineTable() {
+        const double pi = 3.14159265358979323846;
+        for (size_t i = 0; i < kSineTable; ++i) {
+            q15[i] = static_cast<int16_t>(std::lround(32767.0 * std::sin(2 * pi * i / kSineTable)));
+        }
+    }
+};
+
+const SineTable s_sine;
+
+metrics::Counter s_local("chunfeng_kws_utterances_total", "端点检测截出的语音句数（按去向）", "route=\"local\"");
+metrics::Counter s_cloud("chunfeng_kws_utterances_total", "端点检测截出的语音句数（按去向）", "route=\"cloud\"");
+metrics::Counter s_commands[] = {
+    {"chunfeng_kws_commands_total", "本地执行的指令次数", "command=\"volume_up\""},
+    {"chunfeng_kws_commands_total", "本地执行的指令次数", "command=\"volume_down\""},
+    {"chunfeng_kws_commands_total", "本地执行的指令次数", "command=\"stop\""},
+    {"chunfeng_kws_commands_total", "本地执行的指令次数", "command=\"network_status\""},
+};
+static_assert(sizeof(s_commands) / sizeof(s_commands[0]) == static_cast<size_t>(LocalCommand::COUNT),
+              "每条指令一个计数器");
+
+// /commands 中的指令名，与计数器标签一致
+const char* const kCommandNames[] = {"volume_up", "volume_down", "stop", "network_status"};
+static_assert(sizeof(kCommandNames) / sizeof(kCommandNames[0]) == static_cast<size_t>(LocalCommand::COUNT),
+              "每条指令一个名字");
+
+// 配网页面的 /commands：录入只在用户主动操作时发生，模板文件由 enroll() 保存
+const char* handleHttp(BspConfigNetwork::TemplateAction action, const char* command, const int16_t* pcm,
+                       size_t samples, char* out, size_t out_size) {
+    CommandRouter& router = CommandRouter::getInstance();
+    if (action == BspConfigNetwork::TemplateAction::ENROLL) {
+        size_t index = 0;
+        while (index < static_cast<size_t>(LocalCommand::COUNT) && strcmp(kCommandNames[index], command) != 0) ++index;
+        if (index == static_cast<size_t>(LocalCommand::COUNT)) {
+            snprintf(out, out_size, "{\"ok\":false,\"error\":\"unknown command\"}");
+            return "400 Bad Request";
+        }
+        esp_err_t err = router.enroll(static_cast<LocalCommand>(index), pcm, samples);
+        if (err != ESP_OK) {
+            CF_LOGW(TAG, "录入指令 %s 失败：%s", command, esp_err_to_name(err));
+            snprintf(out, out_size, "{\"ok\":false,\"error\":\"%s\"}", esp_err_to_name(err));
+            // 没有截出语音为 400，模板已满或保存失败为 500
+            return err == ESP_ERR_INVALID_ARG ? "400 Bad Request" : "500 Internal Server Error";
+        }
+        CF_LOGI(TAG, "已录入指令 %s，共 %u 个模板", command, static_cast<unsigned>(router.templates()));
+    } else if (action == BspConfigNetwork::TemplateAction::CLEAR) {
+        router.clearTemplates();
+        CF_LOGI(TAG, "指令模板已全部删除");
+    }
+    size_t n = snprintf(out, out_size, "{\"templates\":%u,\"commands\":[", static_cast<unsigned>(router.templates()));
+    for (size_t i = 0; i < static_cast<size_t>(LocalCommand::COUNT) && n < out_size; ++i) {
+        n += snprintf(out + n, out_size - n, "%s\"%s\"", i ? "," : "", kCommandNames[i]);
+    }
+    if (n < out_size) snprintf(out + n, out_size - n, "]}");
+    return "200 OK";
+}
+
+} // namespace
+
+CommandRouter& CommandRouter::getInstance() {
+    static CommandRouter instance;
+    return instance;
+}
+
+esp_err_t CommandRouter::start(const char* template_path, const char* prompt_voice) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!buffer_) {
+        buffer_ = static_cast<int16_t*>(heap_caps_malloc(kBufferSamples * sizeof(int16_t), MALLOC_CAP_SPIRAM));
+        if (!buffer_) buffer_ = static_cast<int16_t*>(heap_caps_malloc(kBufferSamples * sizeof(int16_t), MALLOC_CAP_DEFAULT));
+        if (!buffer_) return ESP_ERR_NO_MEM;
+    }
+    snprintf(template_path_, sizeof(template_path_), "%s", template_path);
+    snprintf(prompt_voice_, sizeof(prompt_voice_), "%s", prompt_voice);
+    memset(pre_roll_, 0, sizeof(pre_roll_));
+    pre_roll_pos_ = 0;
+    segment_fill_ = 0;
+    buffered_ = 0;
+    forwarding_ = false;
+    vad_.reset();
+
+    esp_err_t err = recognizer_.load(template_path_);
+    if (err == ESP_OK) {
+        CF_LOGI(TAG, "已读入 %u 个指令模板", static_cast<unsigned>(recognizer_.templates()));
+    } else {
+        CF_LOGW(TAG, "没有可用的指令模板（%s），语音全部交给云端，可经配网页面的 /commands 录入",
+                esp_err_to_name(err));
+    }
+    BspConfigNetwork::setCommandsHandler(handleHttp);
+    return ESP_OK;
+}
+
+esp_err_t CommandRouter::enroll(LocalCommand command, const int16_t* pcm, size_t samples) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (command >= LocalCommand::COUNT) return ESP_ERR_INVALID_ARG;
+    // 录入复用识别器的分析缓冲，正在截取的一句话作废
+    vad_.reset();
+    forwarding_ = false;
+    buffered_ = 0;
+    esp_err_t err = recognizer_.enroll(static_cast<int>(command), pcm, samples);
+    if (err != ESP_OK) return err;
+    return template_path_[0] ? recognizer_.save(template_path_) : ESP_OK;
+}
+
+void CommandRouter::clearTemplates() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    recognizer_.clear();
+    if (template_path_[0]) remove(template_path_);
+}
+
+size_t CommandRouter::templates() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return recognizer_.templates();
+}
+
+const int16_t* CommandRouter::buffered(size_t* samples) const {
+    *samples = buffered_;
+    return buffer_;
+}
+
+CommandRouter::Route CommandRouter::process(const int16_t* pcm, size_t samples) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!buffer_) return Route::FORWARD;
+    pumpPrompt();
+
+    // 同一次调用里的多段按 CLOUD > LOCAL > FORWARD > LISTENING > IDLE 合并
+    static constexpr uint8_t kRank[] = {0, 1, 3, 4, 2};
+    Route result = Route::IDLE;
+    const size_t segment_samples = vad_.segmentSamples();
+    size_t i = 0;
+    while (i < samples) {
+        size_t n = std::min(samples - i, segment_samples - segment_fill_);
+        memcpy(segment_ + segment_fill_, pcm + i, n * sizeof(int16_t));
+        segment_fill_ += n;
+        i += n;
+        if (segment_fill_ < segment_samples) break;
+        segment_fill_ = 0;
+        Route route = processSegment(segment_);
+        if (kRank[static_cast<int>(route)] > kRank[static_cast<int>(result)]) result = route;
+    }
+    return result;
+}
+
+CommandRouter::Route CommandRouter::processSegment(const int16_t* segment) {
+    const size_t n = vad_.segmentSamples();
+    const bool was_speaking = vad_.speaking();
+    VoiceDetector::Event event = vad_.feed(segment);
+
+    if (!was_speaking && event != VoiceDetector::Event::START) {
+        // 没有说话：只记入预录
+        memcpy(pre_roll_ + pre_roll_pos_, segment, n * sizeof(int16_t));
+        pre_roll_pos_ = (pre_roll_pos_ + n) % kPreRollSamples;
+        return Route::IDLE;
+    }
+
+    if (event == VoiceDetector::Event::START) {
+        // 确认开始时已说了 kStartSegments 段，连同之前的预录一起按时间顺序放入整句缓冲
+        memcpy(pre_roll_ + pre_roll_pos_, segment, n * sizeof(int16_t));
+        pre_roll_pos_ = (pre_roll_pos_ + n) % kPreRollSamples;
+        const size_t head = kPreRollSamples - pre_roll_pos_;
+        memcpy(buffer_, pre_roll_ + pre_roll_pos_, head * sizeof(int16_t));
+        memcpy(buffer_ + head, pre_roll_, pre_roll_pos_ * sizeof(int16_t));
+        buffered_ = kPreRollSamples;
+        forwarding_ = false;
+        recognizer_.begin();
+        recognizer_.feed(buffer_, buffered_);
+        return Route::LISTENING;
+    }
+
+    if (buffered_ + n <= kBufferSamples) {
+        memcpy(buffer_ + buffered_, segment, n * sizeof(int16_t));
+        buffered_ += n;
+    }
+
+    if (forwarding_) {
+        if (event == VoiceDetector::Event::END) forwarding_ = false;
+        return Route::FORWARD;
+    }
+
+    if (!recognizer_.feed(segment, n)) {
+        // 超过指令的最大长度，不必等说完
+        forwarding_ = event != VoiceDetector::Event::END;
+        last_match_ = CommandMatch{};
+        s_cloud.inc();
+        return Route::CLOUD;
+    }
+
+    if (event != VoiceDetector::Event::END) return Route::LISTENING;
+
+    last_match_ = recognizer_.finish();
+    if (last_match_.command < 0) {
+        s_cloud.inc();
+        return Route::CLOUD;
+    }
+    CF_LOGI(TAG, "本地指令 %d（距离 %u，次优 %u，%u 帧，解码 %uus）", last_match_.command,
+            static_cast<unsigned>(last_match_.distance), static_cast<unsigned>(last_match_.runner_up),
+            static_cast<unsigned>(last_match_.frames), static_cast<unsigned>(last_match_.decode_us));
+    s_local.inc();
+    executeLocked(static_cast<LocalCommand>(last_match_.command));
+    return Route::LOCAL;
+}
+
+void CommandRouter::execute(LocalCommand command) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    executeLocked(command);
+}
+
+void CommandRouter::executeLocked(LocalCommand command) {
+    if (command >= LocalCommand::COUNT) return;
+    s_commands[static_cast<size_t>(command)].inc();
+    AudioPlayback& playback = AudioPlayback::getInstance();
+    switch (command) {
+    case LocalCommand::VOLUME_UP: {
+        uint32_t volume = playback.volume();
+        playback.setVolume(std::min<uint32_t>(volume + kVolumeStep, 100));
+        static const Beep kUp[] = {{660, 60}, {0, 40}, {880, 60}};
+        announce(nullptr, kUp, sizeof(kUp) / sizeof(kUp[0]));
+        break;
+    }
+    case LocalCommand::VOLUME_DOWN: {
+        uint32_t volume = playback.volume();
+        playback.setVolume(volume > kVolumeStep ? volume - kVolumeStep : 0);
+        static const Beep kDown[] = {{880, 60}, {0, 40}, {660, 60}};
+        announce(nullptr, kDown, sizeof(kDown) / sizeof(kDown[0]));
+        break;
+    }
+    case LocalCommand::STOP:
+        // 停下来本身就是回应，不再播放提示音
+        playback.stop();
+        if (prompt_stream_ >= 0) {
+            prompt_reader_.close();
+            prompt_stream_ = -1;
+        }
+        break;
+    case LocalCommand::NETWORK_STATUS: {
+        status::Snapshot snapshot;
+        status::read(snapshot);
+        if (snapshot.network.link == 1) {
+            static const Beep kWifi[] = {{880, 200}};
+            announce("已连接 WiFi", kWifi, sizeof(kWifi) / sizeof(kWifi[0]));
+        } else if (snapshot.network.link == 2) {
+            static const Beep kLte[] = {{880, 100}, {0, 80}, {880, 100}};
+            announce("已连接 4G", kLte, sizeof(kLte) / sizeof(kLte[0]));
+        } else if (snapshot.network.state == static_cast<uint8_t>(NetworkState::CONNECTING) ||
+                   snapshot.network.state == static_cast<uint8_t>(NetworkState::INIT)) {
+            static const Beep kConnecting[] = {{660, 60}, {0, 60}, {660, 60}, {0, 60}, {660, 60}};
+            announce("正在连接网络", kConnecting, sizeof(kConnecting) / sizeof(kConnecting[0]));
+        } else {
+            static const Beep kOffline[] = {{330, 300}};
+            announce("网络未连接", kOffline, sizeof(kOffline) / sizeof(kOffline[0]));
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void CommandRouter::announce(const char* text, const Beep* beeps, size_t count) {
+    AudioPlayback& playback = AudioPlayback::getInstance();
+    if (prompt_stream_ >= 0) {
+        if (playback.streamWritable(prompt_stream_)) playback.stopStream(prompt_stream_);
+        prompt_reader_.close();
+        prompt_stream_ = -1;
+    }
+
+    // 提示语命中合成语音缓存时播放提示语，否则播放提示音
+    uint32_t rate = kSampleRate;
+    ResponseCache& cache = ResponseCache::getInstance();
+    if (text && cache.isOpen() &&
+        cache.lookup(makeCacheKey(text, prompt_voice_, playback.sampleRate()), prompt_reader_)) {
+        rate = prompt_reader_.sampleRate();
+        beep_count_ = 0;
+    } else {
+        beep_count_ = std::min(count, kMaxBeeps);
+        memcpy(beeps_, beeps, beep_count_ * sizeof(Beep));
+        beep_index_ = 0;
+        beep_done_ = 0;
+    }
+
+    MixStreamConfig config;
+    config.sample_rate = rate;
+    config.priority = mix_priority::kNotify;
+    config.duck_db = 12;
+    config.fade_ms = 10;
+    if (playback.openStream(config, &prompt_stream_) != ESP_OK) {
+        CF_LOGW(TAG, "没有空闲的混音流，跳过提示");
+        prompt_reader_.close();
+        prompt_stream_ = -1;
+        return;
+    }
+    chunk_size_ = 0;
+    chunk_sent_ = 0;
+    pumpPrompt();
+}
+
+void CommandRouter::pumpPrompt() {
+    if (prompt_stream_ < 0) return;
+    AudioPlayback& playback = AudioPlayback::getInstance();
+    const size_t chunk = sizeof(prompt_chunk_) / sizeof(prompt_chunk_[0]);
+    while (true) {
+        if (!playback.streamWritable(prompt_stream_)) {
+            // 被 AudioPlayback::stop() 停止
+            prompt_reader_.close();
+            prompt_stream_ = -1;
+            return;
+        }
+        if (chunk_sent_ < chunk_size_) {
+            chunk_sent_ += playback.writeStream(prompt_stream_, prompt_chunk_ + chunk_sent_, chunk_size_ - chunk_sent_, 0);
+            if (chunk_sent_ < chunk_size_) return;  // 缓冲满，下一次 process() 再写
+        }
+
+        chunk_size_ = 0;
+        chunk_sent_ = 0;
+        if (prompt_reader_.isOpen()) {
+            chunk_size_ = prompt_reader_.read(prompt_chunk_, chunk);
+        } else {
+            while (chunk_size_ < chunk && beep_index_ < beep_count_) {
+                const Beep& beep = beeps_[beep_index_];
+                const uint32_t total = beep.ms * kSampleRate / 1000;
+                const uint32_t ramp = kBeepRampMs * kSampleRate / 1000;
+                const uint32_t step = (static_cast<uint32_t>(beep.hz) << 16) / kSampleRate * kSineTable;
+                while (chunk_size_ < chunk && beep_done_ < total) {
+                    int32_t v = 0;
+                    if (beep.hz) {
+                        uint32_t phase = beep_done_ * step;
+                        uint32_t env = std::min({beep_done_, total - 1 - beep_done_, ramp});
+                        v = s_sine.q15[(phase >> 16) % kSineTable] * kBeepAmplitude / 32768;
+                        v = v * static_cast<int32_t>(env) / static_cast<int32_t>(ramp);
+                    }
+                    prompt_chunk_[chunk_size_++] = static_cast<int16_t>(v);
+                    beep_done_++;
+                }
+                if (beep_done_ >= total) {
+                    beep_index_++;
+                    beep_done_ = 0;
+                }
+            }
+        }
+        if (chunk_size_ == 0) {
+            playback.finishStream(prompt_stream_);
+            prompt_reader_.close();
+            prompt_stream_ = -1;
+            return;
+        }
+    }
+}
+
+} // namespace chunfeng
@@ -0,0 +1,366 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-16 13:20:44
+ * @LastEditTime: 2025-06-25 10:41:37
+ * @LastEditors: 星年
+ * @Description: 显示管理器：状态栏与状态文字的差分绘制
+ * @FilePath: \ESP32-ChunFeng\main\src\display_manager.cpp
+ * @遇事不决，可问春风
+ */
+#include "display_manager.hpp"
+#include "cf_log.hpp"
+#include "task_topology.hpp"
+#include "esp_heap_caps.h"
+#include <cmath>
+#include <cstring>
+
+namespace chunfeng {
+
+static const char* TAG = "DisplayManager";
+
+// 屏幕接线（按实际板子修改）
+static const LcdConfig kBoardLcd = [] {
+    LcdConfig c;
+    c.width = 320;
+    c.height = 240;
+    c.host = SPI2_HOST;
+    c.sclk_gpio = 12;
+    c.mosi_gpio = 11;
+    c.cs_gpio = 10;
+    c.dc_gpio = 9;
+    c.reset_gpio = 8;
+    c.backlight_gpio = 7;
+    return c;
+}();
+
+static constexpr int kWidgetHeight = 24;
+static constexpr uint16_t kBarBg = rgb565(16, 40, 72);
+static constexpr uint16_t kBodyBg = rgb565(0, 0, 0);
+static constexpr uint16_t kTextFg = rgb565(235, 235, 235);
+static constexpr uint16_t kLabelFg = rgb565(120, 160, 200);
+static constexpr uint16_t kMouthFg = rgb565(240, 110, 90);
+static constexpr uint16_t kBarFg = rgb565(90, 170, 230);
+
+struct WidgetSpec {
+    Rect rect;
+    uint16_t bg;
+    const char* label;
+};
+
+// 顶部状态栏：左侧网络、右侧系统状态；下方两行状态文字；底部口型与频带电平条
+static const WidgetSpec kWidgets[] = {
+    {{0, 0, 200, kWidgetHeight}, kBarBg, nullptr},
+    {{200, 0, 120, kWidgetHeight}, kBarBg, nullptr},
+    {{0, 96, 320, kWidgetHeight}, kBodyBg, "音频 "},
+    {{0, 136, 320, kWidgetHeight}, kBodyBg, "对话 "},
+    {{0, 176, 320, 56}, kBodyBg, nullptr},
+};
+
+// 口型：椭圆，中心在控件内 (kMouthX, 高度一半)，张开高度随响度变化
+static constexpr int kMouthX = 40;
+static constexpr int kMouthHalfWidth = 26;
+static constexpr int kMouthMaxHeight = 42;
+// 频带电平条
+static constexpr int kBarsX = 96;
+static constexpr int kBarPitch = 28;
+static constexpr int kBarWidth = 20;
+static constexpr int kBarMaxHeight = 48;
+
+static const char* networkText(NetworkState state, uint16_t* color) {
+    switch (state) {
+        case NetworkState::CONNECTING:
+            *color = rgb565(240, 200, 40);
+            return "正在联网";
+        case NetworkState::WIFI_CONNECTED:
+            *color = rgb565(60, 200, 90);
+            return "WiFi 已连接";
+        case NetworkState::LTE_CONNECTED:
+            *color = rgb565(60, 200, 90);
+            return "4G 已连接";
+        case NetworkState::FAILED:
+            *color = rgb565(230, 60, 50);
+            return "网络连接失败";
+        case NetworkState::INIT:
+        default:
+            *color = rgb565(128, 128, 128);
+            return "网络初始化";
+    }
+}
+
+static const char* systemText(SystemState state) {
+    switch (state) {
+        case SystemState::BOOTING: return "启动中";
+        case SystemState::IDLE: return "待机";
+        case SystemState::LISTENING: return "聆听中";
+        case SystemState::THINKING: return "思考中";
+        case SystemState::SPEAKING: return "回复中";
+        case SystemState::UPGRADING: return "升级中";
+        case SystemState::SLEEPING: return "休眠";
+        case SystemState::ERROR: return "故障";
+        default: return "";
+    }
+}
+
+DisplayManager& DisplayManager::getInstance() {
+    static DisplayManager instance;
+    return instance;
+}
+
+DisplayManager::DisplayManager()
+    : subscriber_("display", bus::topicBit(bus::Topic::NETWORK_STATE) | bus::topicBit(bus::Topic::SYSTEM_STATE) |
+                                 bus::topicBit(bus::Topic::AUDIO_LEVEL)) {}
+
+esp_err_t DisplayManager::start(const char* font_path) {
+    if (task_) return ESP_OK;
+    size_t buf_pixels = 0;
+    for (const WidgetSpec& w : kWidgets) {
+        if (static_cast<size_t>(w.rect.area()) > buf_pixels) buf_pixels = w.rect.area();
+    }
+    size_t buf_bytes = buf_pixels * sizeof(uint16_t);
+    widget_buf_ = static_cast<uint16_t*>(heap_caps_malloc(buf_bytes, MALLOC_CAP_SPIRAM));
+    if (!widget_buf_) widget_buf_ = static_cast<uint16_t*>(heap_caps_malloc(buf_bytes, MALLOC_CAP_DEFAULT));
+    if (!widget_buf_) return ESP_ERR_NO_MEM;
+    esp_err_t err = fb_.init(kBoardLcd.width, kBoardLcd.height);
+    if (err != ESP_OK) return err;
+    err = lcd_.init(kBoardLcd);
+    if (err != ESP_OK) return err;
+    // 字库缺失时仍然运行，文字显示为方框
+    glyphs_.open(font_path);
+    esp_timer_create_args_t timer_args = {};
+    timer_args.callback = presentTimerCallback;
+    timer_args.arg = this;
+    timer_args.name = "display_present";
+    err = esp_timer_create(&timer_args, &present_timer_);
+    if (err != ESP_OK) return err;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        dirty_ = (1u << WIDGET_COUNT) - 1;
+    }
+    if (tasks::spawn(tasks::TaskId::DISPLAY, displayTask, this, &task_) != pdPASS) {
+        CF_LOGE(TAG, "显示任务创建失败");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void DisplayManager::markDirty(Widget widget) {
+    dirty_ |= 1u << widget;
+    subscriber_.interrupt();    // 不等下一个帧周期，立即唤醒显示任务
+}
+
+void DisplayManager::updateSystemState(SystemState state) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (model_.system != state) {
+        model_.system = state;
+        markDirty(SYSTEM);
+    }
+}
+
+void DisplayManager::updateNetworkState(NetworkState state) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (model_.network != state) {
+        model_.network = state;
+        markDirty(NETWORK);
+    }
+}
+
+void DisplayManager::setText(char (&dst)[kMaxTextBytes], const std::string& text, Widget widget) {
+    // 截断在 UTF-8 字符边界上
+    size_t len = text.size() < kMaxTextBytes ? text.size() : kMaxTextBytes - 1;
+    while (len < text.size() && len > 0 && (static_cast<uint8_t>(text[len]) & 0xc0) == 0x80) --len;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (strncmp(dst, text.data(), len) == 0 && dst[len] == '\0') return;
+    memcpy(dst, text.data(), len);
+    dst[len] = '\0';
+    markDirty(widget);
+}
+
+void DisplayManager::updateAudioState(const std::string& state) {
+    setText(model_.audio, state, AUDIO);
+}
+
+void DisplayManager::updateCozeState(const std::string& state) {
+    setText(model_.coze, state, COZE);
+}
+
+void DisplayManager::onMessage(const bus::Message& message) {
+    switch (message.topic) {
+        case bus::Topic::NETWORK_STATE:
+            updateNetworkState(bus::payload<bus::Topic::NETWORK_STATE>(message).state);
+            break;
+        case bus::Topic::SYSTEM_STATE:
+            updateSystemState(bus::payload<bus::Topic::SYSTEM_STATE>(message));
+            break;
+        case bus::Topic::AUDIO_LEVEL:
+            queueLevels(bus::payload<bus::Topic::AUDIO_LEVEL>(message));
+            break;
+        default:
+            break;
+    }
+}
+
+void DisplayManager::queueLevels(const AudioLevels& levels) {
+    if (pending_count_ == kMaxPendingLevels) {
+        pending_head_ = (pending_head_ + 1) % kMaxPendingLevels;
+        --pending_count_;
+    }
+    pending_[(pending_head_ + pending_count_) % kMaxPendingLevels] = levels;
+    ++pending_count_;
+}
+
+void DisplayManager::presentDueLevels() {
+    const int64_t now = esp_timer_get_time();
+    const AudioLevels* latest = nullptr;
+    while (pending_count_ > 0 && pending_[pending_head_].play_us - present_lead_us_ <= now) {
+        latest = &pending_[pending_head_];
+        pending_head_ = (pending_head_ + 1) % kMaxPendingLevels;
+        --pending_count_;
+    }
+    if (!latest) return;
+    // 出队的槽位只会被本任务后续的 queueLevels() 覆盖，此处仍然有效
+    std::lock_guard<std::mutex> lock(mutex_);
+    model_.mouth = latest->level;
+    memcpy(model_.bands, latest->bands, sizeof(model_.bands));
+    dirty_ |= 1u << VISUALIZER;
+}
+
+void DisplayManager::armPresentTimer() {
+    if (pending_count_ == 0) return;
+    int64_t delay = pending_[pending_head_].play_us - present_lead_us_ - esp_timer_get_time();
+    esp_timer_stop(present_timer_);
+    esp_timer_start_once(present_timer_, delay > 0 ? static_cast<uint64_t>(delay) : 0);
+}
+
+void DisplayManager::presentTimerCallback(void* arg) {
+    static_cast<DisplayManager*>(arg)->subscriber_.interrupt();
+}
+
+int DisplayManager::drawText(uint16_t* buf, int stride, int height, int x, const char* text, uint16_t fg) {
+    const int gh = glyphs_.isOpen() ? glyphs_.height() : 16;
+    if (gh > height) return x;
+    const int y0 = (height - gh) / 2;
+    const size_t row_bytes = glyphs_.rowBytes();
+    while (*text) {
+        uint32_t cp = utf8Next(text);
+        int adv = glyphs_.isOpen() ? glyphs_.advance(cp) : (cp < 0x80 ? gh / 2 : gh);
+        if (x + adv > stride) break;
+        const uint8_t* g = glyphs_.glyph(cp);
+        if (g) {
+            for (int r = 0; r < gh; ++r) {
+                uint16_t* dst = buf + (y0 + r) * stride + x;
+                const uint8_t* bits = g + r * row_bytes;
+                for (int c = 0; c < adv; ++c) {
+                    if (bits[c >> 3] & (0x80 >> (c & 7))) dst[c] = fg;
+                }
+            }
+        } else if (cp != ' ') {
+            // 字库中没有的字符画一个方框
+            for (int r = 1; r < gh - 1; ++r) {
+                uint16_t* dst = buf + (y0 + r) * stride + x;
+                dst[1] = dst[adv - 2] = fg;
+                if (r == 1 || r == gh - 2) {
+                    for (int c = 1; c < adv - 1; ++c) dst[c] = fg;
+                }
+            }
+        }
+        x += adv;
+    }
+    return x;
+}
+
+void DisplayManager::renderWidget(Widget widget, const Model& model) {
+    const WidgetSpec& spec = kWidgets[widget];
+    const Rect& r = spec.rect;
+    for (int i = 0; i < r.w * r.h; ++i) widget_buf_[i] = spec.bg;
+    int x = 8;
+    if (spec.label) x = drawText(widget_buf_, r.w, r.h, x, spec.label, kLabelFg);
+    switch (widget) {
+        case NETWORK: {
+            uint16_t dot;
+            const char* text = networkText(model.network, &dot);
+            // 状态指示点
+            for (int y = r.h / 2 - 4; y < r.h / 2 + 4; ++y) {
+                for (int i = 0; i < 8; ++i) widget_buf_[y * r.w + x + i] = dot;
+            }
+            drawText(widget_buf_, r.w, r.h, x + 14, text, kTextFg);
+            break;
+        }
+        case SYSTEM:
+            drawText(widget_buf_, r.w, r.h, x, systemText(model.system), kTextFg);
+            break;
+        case AUDIO:
+            drawText(widget_buf_, r.w, r.h, x, model.audio, kTextFg);
+            break;
+        case COZE:
+            drawText(widget_buf_, r.w, r.h, x, model.coze, kTextFg);
+            break;
+        case VISUALIZER: {
+            const int cy = r.h / 2;
+            const int half = (2 + model.mouth * (kMouthMaxHeight - 2) / 255) / 2;
+            for (int dy = -half; dy < half; ++dy) {
+                float t = (2.0f * dy + 1.0f) / (2.0f * half);
+                int hw = static_cast<int>(kMouthHalfWidth * sqrtf(1.0f - t * t));
+                uint16_t* row = widget_buf_ + (cy + dy) * r.w;
+                for (int i = kMouthX - hw; i < kMouthX + hw; ++i) row[i] = kMouthFg;
+            }
+            const int base = (r.h + kBarMaxHeight) / 2;
+            for (size_t b = 0; b < SpectrumAnalyzer::kBands; ++b) {
+                int h = model.bands[b] * kBarMaxHeight / 255;
+                int x0 = kBarsX + static_cast<int>(b) * kBarPitch;
+                for (int y = base - h; y < base; ++y) {
+                    for (int i = 0; i < kBarWidth; ++i) widget_buf_[y * r.w + x0 + i] = kBarFg;
+                }
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    // 与帧缓冲比较后写入：整块重绘也只有文字变化的图块会被推送
+    fb_.blit(r, widget_buf_, r.w);
+}
+
+void DisplayManager::displayTask(void* arg) {
+    static_cast<DisplayManager*>(arg)->run();
+}
+
+void DisplayManager::run() {
+    const uint32_t frame_ms = tasks::spec(tasks::TaskId::DISPLAY).period_ms;
+    fb_.fill(Rect{0, 0, static_cast<int16_t>(fb_.width()), static_cast<int16_t>(fb_.height())}, kBodyBg);
+    fb_.invalidateAll();    // 上电后面板显存内容未知
+    while (true) {
+        // 没有待推送的内容与待呈现的电平时只等消息与 markDirty()，待机时显示任务不再每帧醒来，不妨碍自动 light sleep
+        uint32_t wait_ms = fb_.dirty() ? 0 : pending_count_ > 0 ? frame_ms : portMAX_DELAY;
+        bus::Message message;
+        if (subscriber_.receive(message, wait_ms)) {
+            do {
+                onMessage(message);
+            } while (subscriber_.tryReceive(message));
+        }
+        presentDueLevels();
+        Model model;
+        uint32_t dirty;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            model = model_;
+            dirty = dirty_;
+            dirty_ = 0;
+        }
+        int64_t render_start = esp_timer_get_time();
+        for (int w = 0; w < WIDGET_COUNT; ++w) {
+            if (dirty & (1u << w)) renderWidget(static_cast<Widget>(w), model);
+        }
+        if (fb_.dirty()) {
+            FlushStats stats = lcd_.flush(fb_);
+            CF_LOGD(TAG, "刷新 %u 个区域，%u 字节，%u us", stats.rects, static_cast<unsigned>(stats.bytes),
+                    static_cast<unsigned>(stats.cpu_us));
+            if (dirty & (1u << VISUALIZER)) {
+                int64_t lead = esp_timer_get_time() - render_start + stats.tail_us;
+                present_lead_us_ = (present_lead_us_ * 7 + lead) / 8;
+            }
+        }
+        armPresentTimer();
+    }
+}
+
+} // namespace chunfeng
@@ -1,7 +1,7 @@
 /*** 
  * @Author: jixingnian@gmail.com
  * @Date: 2025-05-30 12:15:47
- * @LastEditTime: 2025-05-30 16:54:10
+ * @LastEditTime: 2025-07-01 16:22:10
  * @LastEditors: 星年
  * @Description: 网络管理器
  * @FilePath: \ESP32-ChunFeng\main\src\network_manager.cpp
@@ -11,11 +11,52 @@
 #include "wifi_manager.hpp"
 #include "lte_manager.hpp"
 #include "config_manager.hpp"
-#include <iostream>
+#include "wifi_connector.hpp"
+#include "dns_cache.hpp"
+#include "cf_log.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include <algorithm>
 #include <string>
 
 namespace chunfeng {
 
+static const char* TAG = "NetworkManager";
+
+// 故障切换耗时分桶（毫秒）
+static const uint32_t kFailoverBucketsMs[] = {100, 250, 500, 1000, 2000, 5000, 10000, 30000, 60000};
+
+static metrics::Counter s_reconnects("chunfeng_network_reconnects_total", "网络断开后重新初始化的次数");
+static metrics::Counter s_failovers("chunfeng_network_failovers_total", "WiFi 失败后切换到 4G 的次数");
+static metrics::Histogram s_failover_latency("chunfeng_network_failover_latency_ms",
+                                             "WiFi 失败到 4G 连接成功的耗时（毫秒）",
+                                             kFailoverBucketsMs, sizeof(kFailoverBucketsMs) / sizeof(kFailoverBucketsMs[0]));
+static metrics::Gauge s_state("chunfeng_network_state", "当前网络状态（NetworkState 枚举值）");
+static metrics::Counter s_failed_retries("chunfeng_network_failed_retries_total", "WiFi 与 4G 都失败后重新连接的次数");
+
+// 使用 4G 时每隔这么久尝试一次保存的 WiFi，连上后 4G 转入待机
+static constexpr int64_t kWifiProbeIntervalUs = 15 * 1000 * 1000;
+
+// 连接中每轮间隔；已连接时由 WiFi 链路消息唤醒，只以较长间隔刷新信号强度，空闲时不妨碍自动 light sleep
+static constexpr uint32_t kStepIntervalMs = 1000;
+static constexpr uint32_t kConnectedPollMs = 30 * 1000;
+
+// WiFi 与 4G 都失败后重新连接的退避：从 kFailedRetryMinMs 起每次翻倍，最长 kFailedRetryMaxMs；
+// 期间 WiFi 链路连上（如经配网页面）时立即恢复
+static constexpr uint32_t kFailedRetryMinMs = 5 * 1000;
+static constexpr uint32_t kFailedRetryMaxMs = 5 * 60 * 1000;
+
+// 连上 WiFi 后配网 AP 再保留这么久（手机还连着 AP，让配网页面看到结果），之后只保留 STA，WiFi 才能省电
+static constexpr int64_t kPortalCloseDelayUs = 30 * 1000 * 1000;
+
+// 固定的云端服务域名，联网后预先解析并缓存到 NVS
+static const char* const kServiceHosts[] = {
+    "api.coze.cn",
+    "ws.coze.cn",
+};
+
 // 单例获取
 NetworkManager& NetworkManager::getInstance() {
     static NetworkManager instance;
@@ -24,108 +65,218 @@ NetworkManager& NetworkManager::getInstance() {
 
 // 状态机事件处理
 void NetworkManager::handleEvent(NetworkEvent event) {
+    CF_TRACE_INSTANT("network.event");
     switch (event) {
         case NetworkEvent::WIFI_CONNECTED:
-            current_state_ = NetworkState::WIFI_CONNECTED;
-            std::cout << "[NetworkManager] WiFi 已连接" << std::endl;
+            setState(NetworkState::WIFI_CONNECTED);
+            failed_retry_ms_ = 0;
+            portal_close_at_us_ = ConfigManager::getInstance().portalOpen()
+                                      ? esp_timer_get_time() + kPortalCloseDelayUs : 0;
+            CF_LOGI(TAG, "WiFi 已连接");
+            DnsCache::getInstance().onNetworkUp();
+            // 从 4G 切回 WiFi：模组待机一段时间（WiFi 再断时无需重新附着），到期后断电
+            LTEManager::getInstance().disconnect();
             break;
         case NetworkEvent::WIFI_FAILED:
-            current_state_ = NetworkState::CONNECTING;
-            std::cerr << "[NetworkManager] WiFi 连接失败，尝试4G" << std::endl;
+            setState(NetworkState::CONNECTING);
+            failover_start_us_ = esp_timer_get_time();
+            s_failovers.inc();
+            // 保存的 WiFi 都连不上（密码改了、换了路由器）：开启配网 AP，可以重新配网
+            portal_close_at_us_ = 0;
+            ConfigManager::getInstance().openPortal();
+            CF_LOGW(TAG, "WiFi 连接失败，开启配网AP，尝试4G");
             break;
         case NetworkEvent::LTE_CONNECTED:
-            current_state_ = NetworkState::LTE_CONNECTED;
-            std::cout << "[NetworkManager] 4G 已连接" << std::endl;
+            setState(NetworkState::LTE_CONNECTED);
+            if (failover_start_us_ != 0) {
+                s_failover_latency.observe(static_cast<uint32_t>((esp_timer_get_time() - failover_start_us_) / 1000));
+                failover_start_us_ = 0;
+            }
+            wifi_probe_at_us_ = esp_timer_get_time() + kWifiProbeIntervalUs;
+            failed_retry_ms_ = 0;
+            CF_LOGI(TAG, "4G 已连接");
             break;
         case NetworkEvent::LTE_FAILED:
-            current_state_ = NetworkState::FAILED;
-            std::cerr << "[NetworkManager] 4G 连接失败，网络连接失败" << std::endl;
+            setState(NetworkState::FAILED);
+            failover_start_us_ = 0;
+            failed_retry_ms_ = failed_retry_ms_ == 0 ? kFailedRetryMinMs
+                                                     : std::min(failed_retry_ms_ * 2, kFailedRetryMaxMs);
+            failed_retry_at_us_ = esp_timer_get_time() + failed_retry_ms_ * 1000LL;
+            CF_LOGE(TAG, "4G 连接失败，网络连接失败，%u 秒后重试", failed_retry_ms_ / 1000);
             break;
         case NetworkEvent::DISCONNECT:
-            std::cerr << "[NetworkManager] 网络断开，重新初始化" << std::endl;
-            current_state_ = NetworkState::INIT;
+            CF_LOGW(TAG, "网络断开，重新初始化");
+            setState(NetworkState::INIT);
+            s_reconnects.inc();
             break;
         default:
             break;
     }
 }
 
+void NetworkManager::setState(NetworkState state) {
+    NetworkState previous = current_state_;
+    current_state_ = state;
+    s_state.set(static_cast<int32_t>(state));
+    if (state != previous) {
+        bus::publish<bus::Topic::NETWORK_STATE>(NetworkStateChanged{state, previous});
+        status_.state = static_cast<uint8_t>(state);
+        status_.link = state == NetworkState::WIFI_CONNECTED ? 1 : state == NetworkState::LTE_CONNECTED ? 2 : 0;
+        status_.state_since_ms = static_cast<uint32_t>(esp_timer_get_time() / 1000);
+        ++status_.transitions;
+        if (status_.link != 1) {
+            status_.rssi = 0;
+            status_.channel = 0;
+        }
+        status::updateNetwork(status_);
+    }
+}
+
+void NetworkManager::refreshLinkStatus() {
+    wifi_ap_record_t ap = {};
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) return;
+    if (ap.rssi == status_.rssi && ap.primary == status_.channel) return;
+    status_.rssi = ap.rssi;
+    status_.channel = ap.primary;
+    status::updateNetwork(status_);
+}
+
 // 状态机主循环
 void NetworkManager::runStateMachine() {
     while (true) {
+        CF_TRACE_BEGIN("network.step");
         switch (current_state_) {
             case NetworkState::INIT: {
-                std::cout << "[NetworkManager] 状态: INIT" << std::endl;
+                CF_LOGI(TAG, "状态: INIT");
                 // 组件化创建各功能对象
                 // 1. 配置管理器（如有需要可初始化）
                 ConfigManager& config = ConfigManager::getInstance();
 
+                // DNS 缓存：从 NVS 恢复上次的解析结果
+                for (const char* host : kServiceHosts) {
+                    DnsCache::getInstance().addHost(host);
+                }
+
                 // // 2. WiFi 管理器
                 // WiFiManager& wifi = WiFiManager::getInstance();
 
                 // // 3. LTE 管理器
                 // LTEManager& lte = LTEManager::getInstance();
                 
-                current_state_ = NetworkState::CONNECTING;
+                setState(NetworkState::CONNECTING);
                 break;
             }
             case NetworkState::CONNECTING: {
-                std::cout << "[NetworkManager] 状态: CONNECTING" << std::endl;
-                ConfigManager::getInstance().startConfig();
-                handleEvent(NetworkEvent::WIFI_CONNECTED);
-                // // 先尝试从NVS读取WiFi信息
-                // std::string ssid, password;
-                // bool wifiInfoLoaded = WiFiManager::getInstance().loadWiFiInfo(ssid, password);
-                // if (wifiInfoLoaded) {
-                //     // 有WiFi信息，尝试连接
-                //     if (WiFiManager::getInstance().connect(ssid, password)) {
-                //         handleEvent(NetworkEvent::WIFI_CONNECTED);
-                //     } else {
-                //         handleEvent(NetworkEvent::WIFI_FAILED);
-                //         // WiFi连接失败，尝试4G
-                //         if (LTEManager::getInstance().connect()) {
-                //             handleEvent(NetworkEvent::LTE_CONNECTED);
-                //         } else {
-                //             handleEvent(NetworkEvent::LTE_FAILED);
-                //         }
-                //     }
-                // } else {
-                //     // 没有WiFi信息，直接进入4G
-                //     std::cerr << "[NetworkManager] 未找到WiFi信息，直接尝试4G" << std::endl;
-                //     if (LTEManager::getInstance().connect()) {
-                //         handleEvent(NetworkEvent::LTE_CONNECTED);
-                //     } else {
-                //         handleEvent(NetworkEvent::LTE_FAILED);
-                //     }
-                // }
-                // break;
+                CF_LOGI(TAG, "状态: CONNECTING");
+                WiFiManager& wifi = WiFiManager::getInstance();
+                bool provisioned = !wifi.getNetworks().empty();
+                // 配网驱动负责启动 WiFi，STA 连接由 WiFiConnector 完成；未配网时同时开启配网 AP
+                ConfigManager::getInstance().startConfig(!provisioned);
+                if (provisioned) {
+                    // 有已保存的WiFi：扫描后按信号、优先级与连接历史依次尝试（阻塞到获取IP或全部失败）
+                    if (wifi.connectBest()) {
+                        handleEvent(NetworkEvent::WIFI_CONNECTED);
+                    } else {
+                        handleEvent(NetworkEvent::WIFI_FAILED);
+                        // WiFi连接失败，尝试4G
+                        if (LTEManager::getInstance().connect()) {
+                            handleEvent(NetworkEvent::LTE_CONNECTED);
+                        } else {
+                            handleEvent(NetworkEvent::LTE_FAILED);
+                        }
+                    }
+                } else {
+                    // 没有WiFi信息：等待配网，同时直接进入4G
+                    CF_LOGW(TAG, "未找到WiFi信息，直接尝试4G");
+                    ConfigManager::getInstance().openPortal();
+                    if (LTEManager::getInstance().connect()) {
+                        handleEvent(NetworkEvent::LTE_CONNECTED);
+                    } else {
+                        handleEvent(NetworkEvent::LTE_FAILED);
+                    }
+                }
+                break;
             }
             case NetworkState::WIFI_CONNECTED: {
-                // std::cout << "[NetworkManager] 状态: WIFI_CONNECTED" << std::endl;
-                // // 检查WiFi是否掉线
-                // if (!WiFiManager::getInstance().isConnected()) {
-                //     handleEvent(NetworkEvent::DISCONNECT);
-                // }
+                // 检查WiFi是否掉线
+                if (!WiFiManager::getInstance().isConnected()) {
+                    handleEvent(NetworkEvent::DISCONNECT);
+                } else {
+                    refreshLinkStatus();
+                    if (portal_close_at_us_ != 0 && esp_timer_get_time() >= portal_close_at_us_) {
+                        portal_close_at_us_ = 0;
+                        ConfigManager::getInstance().closePortal();
+                    }
+                }
                 break;
             }
             case NetworkState::LTE_CONNECTED: {
-                std::cout << "[NetworkManager] 状态: LTE_CONNECTED" << std::endl;
+                CF_LOGI(TAG, "状态: LTE_CONNECTED");
                 // 检查LTE是否掉线
                 if (!LTEManager::getInstance().isConnected()) {
                     handleEvent(NetworkEvent::DISCONNECT);
+                } else if (esp_timer_get_time() >= wifi_probe_at_us_) {
+                    // 4G 只是后备链路，定期尝试切回保存的 WiFi
+                    wifi_probe_at_us_ = esp_timer_get_time() + kWifiProbeIntervalUs;
+                    if (WiFiManager::getInstance().connectBest()) {
+                        handleEvent(NetworkEvent::WIFI_CONNECTED);
+                    }
                 }
                 break;
             }
             case NetworkState::FAILED: {
-                std::cerr << "[NetworkManager] 状态: FAILED" << std::endl;
+                // 退避到期后从头再试一遍 WiFi 与 4G
+                if (esp_timer_get_time() >= failed_retry_at_us_) {
+                    CF_LOGW(TAG, "状态: FAILED，重新连接");
+                    s_failed_retries.inc();
+                    setState(NetworkState::CONNECTING);
+                }
                 break;
             }
             default:
                 break;
         }
-        // 延时
-        vTaskDelay(pdMS_TO_TICKS(1000)); // 避免占用过多CPU
+        CF_TRACE_END("network.step");
+        // 待机超过保持时间的 4G 模组断电
+        LTEManager::getInstance().poll();
+        // 等到下一轮或 WiFi 链路变化（避免占用过多CPU）
+        bus::Message message;
+        bool link_up = false;
+        if (subscriber_.receive(message, nextStepMs())) {
+            do {
+                link_up |= message.topic == bus::Topic::WIFI_LINK &&
+                           bus::payload<bus::Topic::WIFI_LINK>(message).result == ConnectResult::CONNECTED;
+            } while (subscriber_.tryReceive(message));
+        }
+        // FAILED 期间 WiFi 已连上（如经配网页面），不等退避到期
+        if (link_up && current_state_ == NetworkState::FAILED && WiFiManager::getInstance().isConnected()) {
+            CF_LOGI(TAG, "WiFi 链路已连接，退出 FAILED");
+            handleEvent(NetworkEvent::WIFI_CONNECTED);
+        }
+    }
+}
+
+uint32_t NetworkManager::nextStepMs() const {
+    int64_t now = esp_timer_get_time();
+    int64_t wait_us;
+    switch (current_state_) {
+        case NetworkState::WIFI_CONNECTED:
+            wait_us = kConnectedPollMs * 1000LL;
+            if (portal_close_at_us_ != 0) wait_us = std::min(wait_us, portal_close_at_us_ - now);
+            break;
+        case NetworkState::FAILED:
+            wait_us = std::min<int64_t>(kConnectedPollMs * 1000LL, failed_retry_at_us_ - now);
+            break;
+        case NetworkState::LTE_CONNECTED:
+            wait_us = std::min<int64_t>(kConnectedPollMs * 1000LL, wifi_probe_at_us_ - now);
+            break;
+        default:
+            wait_us = kStepIntervalMs * 1000LL;
+            break;
     }
+    int64_t power_down_at = LTEManager::getInstance().powerDownAtUs();
+    if (power_down_at != 0) wait_us = std::min(wait_us, power_down_at - now);
+    return wait_us > 0 ? static_cast<uint32_t>((wait_us + 999) / 1000) : 0;
 }
 
 // 构造函数，自动完成网络初始化并启动状态机
@@ -141,7 +292,7 @@ NetworkManager::NetworkManager() {
 NetworkManager::~NetworkManager() {
     ConfigManager::getInstance().stopConfig();
     WiFiManager::getInstance().disconnect();
-    LTEManager::getInstance().disconnect();
+    LTEManager::getInstance().powerDown();
     // 其他资源释放可在各自管理器中完成
 }
 
@@ -0,0 +1,216 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-25 09:12:06
+ * @LastEditTime: 2025-07-01 16:22:10
+ * @LastEditors: 星年
+ * @Description: 电源管理：电源锁与 WiFi 省电模式的切换、唤醒源配置、电源任务与功耗指标
+ * @FilePath: \ESP32-ChunFeng\main\src\power_manager.cpp
+ * @遇事不决，可问春风
+ */
+#include "power_manager.hpp"
+#include "cf_log.hpp"
+#include "metrics.hpp"
+#include "sdkconfig.h"
+#include "status_board.hpp"
+#include "task_topology.hpp"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include <climits>
+#include <cstdio>
+
+namespace chunfeng {
+
+namespace {
+
+const char* TAG = "PowerManager";
+
+// 最低频率取 80MHz：APB 时钟保持 80MHz，WiFi 与 I2S 在 IDLE 中照常工作
+constexpr int kMinFreqMhz = 80;
+
+// 恢复全速耗时分桶（微秒）
+const uint32_t kWakeUsBuckets[] = {20, 50, 100, 200, 500, 1000, 2000, 5000};
+
+metrics::Histogram s_wake_latency("chunfeng_power_wake_latency_us", "从唤醒事件到 CPU 恢复最高频率的耗时（微秒）",
+                                  kWakeUsBuckets, sizeof(kWakeUsBuckets) / sizeof(kWakeUsBuckets[0]));
+metrics::Gauge s_mode("chunfeng_power_mode", "电源模式（0 全速，1 降频与 modem sleep，2 light sleep）");
+metrics::Counter s_wifi_ps_failures("chunfeng_power_wifi_ps_failures_total",
+                                    "设置 WiFi 省电模式失败的次数（配网 AP 开启时 WiFi 不能休眠）");
+
+// WiFi 省电模式设置失败后（配网 AP 开启）重试的间隔，AP 关闭后最迟这么久生效
+constexpr uint32_t kWifiPsRetryMs = 5 * 1000;
+
+void collectPower(metrics::Renderer& r) {
+    PowerManager::Stats stats = PowerManager::getInstance().stats();
+    char labels[32];
+    for (int m = 0; m < static_cast<int>(power::Mode::COUNT); ++m) {
+        snprintf(labels, sizeof(labels), "mode=\"%s\"", power::modeName(static_cast<power::Mode>(m)));
+        r.sample("chunfeng_power_residency_ms", m == 0 ? "各电源模式的累计时间（毫秒）" : nullptr,
+                 metrics::Metric::Type::COUNTER, labels, static_cast<int64_t>(stats.residency_us[m] / 1000));
+    }
+    r.sample("chunfeng_power_idle_current_ua", "交互之间的平均电流（按各模式估计电流加权，微安）",
+             metrics::Metric::Type::GAUGE, nullptr, stats.idle_average_ua);
+    r.sample("chunfeng_power_average_current_ua", "开机以来的平均电流（按各模式估计电流加权，微安）",
+             metrics::Metric::Type::GAUGE, nullptr, stats.average_ua);
+}
+
+metrics::Collector s_power_collector(collectPower);
+
+} // namespace
+
+PowerManager& PowerManager::getInstance() {
+    static PowerManager instance;
+    return instance;
+}
+
+PowerManager::PowerManager() : subscriber_("power", bus::topicBit(bus::Topic::SYSTEM_STATE)) {}
+
+esp_err_t PowerManager::start(const power::PolicyConfig& config) {
+    if (task_) return ESP_OK;
+    esp_pm_config_t pm_config = {};
+    pm_config.max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+    pm_config.min_freq_mhz = kMinFreqMhz;
+    pm_config.light_sleep_enable = true;
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err != ESP_OK) CF_LOGW(TAG, "动态调频与自动 light sleep 不可用（%s），只切换 WiFi 省电模式", esp_err_to_name(err));
+
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "power_cpu", &cpu_lock_) != ESP_OK) cpu_lock_ = nullptr;
+    if (esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "power_awake", &no_sleep_lock_) != ESP_OK) no_sleep_lock_ = nullptr;
+
+    // light sleep 中由 WiFi 数据（监听间隔内收到的帧）与按键唤醒
+    if (esp_sleep_enable_wifi_wakeup() != ESP_OK) CF_LOGW(TAG, "无法开启 WiFi 唤醒");
+    if (gpio_wakeup_enable(kWakeButton, GPIO_INTR_LOW_LEVEL) != ESP_OK || esp_sleep_enable_gpio_wakeup() != ESP_OK) {
+        CF_LOGW(TAG, "无法开启按键唤醒");
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t now = esp_timer_get_time();
+        policy_ = power::Policy(config, now);
+        applyLocked(policy_.evaluate(now), now);
+    }
+    if (tasks::spawn(tasks::TaskId::POWER, powerTask, this, &task_) != pdPASS) return ESP_ERR_NO_MEM;
+    return ESP_OK;
+}
+
+void PowerManager::wake(WakeSource source) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t now = esp_timer_get_time();
+        policy_.onWake(now);
+        applyLocked(policy_.mode(), now);
+        wakes_++;
+    }
+    CF_LOGD(TAG, "唤醒: %d", static_cast<int>(source));
+    // 空闲计时重新开始，电源任务需要重新计算下一次醒来的时间
+    subscriber_.interrupt();
+}
+
+void PowerManager::setWakeWordArmed(bool armed) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t now = esp_timer_get_time();
+        policy_.setWakeWordArmed(armed, now);
+        applyLocked(policy_.mode(), now);
+    }
+    subscriber_.interrupt();
+}
+
+power::Mode PowerManager::mode() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return applied_;
+}
+
+PowerManager::Stats PowerManager::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats out;
+    out.mode = applied_;
+    for (int m = 0; m < static_cast<int>(power::Mode::COUNT); ++m) {
+        out.residency_us[m] = policy_.residencyUs(static_cast<power::Mode>(m));
+    }
+    out.average_ua = policy_.averageCurrentUa();
+    out.idle_average_ua = policy_.averageIdleCurrentUa();
+    out.transitions = policy_.transitions();
+    out.wakes = wakes_;
+    return out;
+}
+
+void PowerManager::applyLocked(power::Mode mode, int64_t event_us) {
+    if (mode == applied_) return;
+    const bool want_cpu = mode == power::Mode::ACTIVE;
+    const bool want_awake = mode != power::Mode::LIGHT_SLEEP;
+    // 先加锁后放锁：恢复全速的路径上只有加锁，频率切换在 esp_pm_lock_acquire() 返回前完成
+    if (want_awake && !no_sleep_held_ && no_sleep_lock_) no_sleep_held_ = esp_pm_lock_acquire(no_sleep_lock_) == ESP_OK;
+    if (want_cpu && !cpu_held_ && cpu_lock_) cpu_held_ = esp_pm_lock_acquire(cpu_lock_) == ESP_OK;
+    if (want_cpu && applied_ != power::Mode::COUNT) {
+        int64_t latency = esp_timer_get_time() - event_us;
+        s_wake_latency.observe(latency > 0 ? static_cast<uint32_t>(latency) : 0);
+    }
+    if (!want_cpu && cpu_held_ && esp_pm_lock_release(cpu_lock_) == ESP_OK) cpu_held_ = false;
+    if (!want_awake && no_sleep_held_ && esp_pm_lock_release(no_sleep_lock_) == ESP_OK) no_sleep_held_ = false;
+
+    CF_LOGD(TAG, "电源模式 %s -> %s", applied_ == power::Mode::COUNT ? "-" : power::modeName(applied_),
+            power::modeName(mode));
+    applied_ = mode;
+    s_mode.set(static_cast<int32_t>(mode));
+    status_.mode = static_cast<uint8_t>(mode);
+    applyWifiLocked();
+}
+
+void PowerManager::applyWifiLocked() {
+    wifi_ps_type_t ps = applied_ == power::Mode::ACTIVE ? WIFI_PS_NONE
+                        : applied_ == power::Mode::IDLE ? WIFI_PS_MIN_MODEM
+                                                        : WIFI_PS_MAX_MODEM;
+    esp_err_t err = esp_wifi_set_ps(ps);
+    if (err == ESP_OK) {
+        if (wifi_ps_error_ != ESP_OK) CF_LOGI(TAG, "WiFi 省电模式已恢复");
+        status_.wifi_ps = static_cast<uint8_t>(ps);
+    } else {
+        // 配网 AP 开启时 WiFi 不能休眠，light sleep 也无法进入；CPU 侧的模式照常切换，电源任务定期重试
+        if (err != wifi_ps_error_) CF_LOGE(TAG, "设置 WiFi 省电模式失败: %s", esp_err_to_name(err));
+        s_wifi_ps_failures.inc();
+        status_.wifi_ps_failures++;
+    }
+    wifi_ps_error_ = err;
+    status_.wifi_ps_error = err;
+    status::updatePower(status_);
+}
+
+void PowerManager::powerTask(void* arg) {
+    static_cast<PowerManager*>(arg)->run();
+}
+
+void PowerManager::run() {
+    while (true) {
+        // 只等系统状态消息或策略的下一个时刻，待机时本任务不会周期性醒来
+        uint32_t wait_ms = portMAX_DELAY;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            int64_t next = policy_.nextChangeUs();
+            if (next != INT64_MAX) {
+                int64_t remaining_us = next - esp_timer_get_time();
+                wait_ms = remaining_us > 0 ? static_cast<uint32_t>((remaining_us + 999) / 1000) : 0;
+            }
+            if (wifi_ps_error_ != ESP_OK && wait_ms > kWifiPsRetryMs) wait_ms = kWifiPsRetryMs;
+        }
+        bus::Message message;
+        if (subscriber_.receive(message, wait_ms)) {
+            do {
+                if (message.topic != bus::Topic::SYSTEM_STATE) continue;
+                std::lock_guard<std::mutex> lock(mutex_);
+                policy_.onSystemState(bus::payload<bus::Topic::SYSTEM_STATE>(message), message.time_us);
+                applyLocked(policy_.mode(), message.time_us);
+            } while (subscriber_.tryReceive(message));
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t now = esp_timer_get_time();
+        power::Mode mode = policy_.evaluate(now);
+        if (mode == applied_ && wifi_ps_error_ != ESP_OK) {
+            applyWifiLocked();
+        } else {
+            applyLocked(mode, now);
+        }
+    }
+}
+
+} // namespace chunfeng
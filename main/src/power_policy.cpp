@@ -0,0 +1,123 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-25 09:12:06
+ * @LastEditTime: 2025-06-25 10:41:37
+ * @LastEditors: 星年
+ * @Description: 功耗策略：状态与空闲时间到电源模式的映射、驻留时间与平均电流统计
+ * @FilePath: \ESP32-ChunFeng\main\src\power_policy.cpp
+ * @遇事不决，可问春风
+ */
+#include "power_policy.hpp"
+#include <climits>
+
+namespace chunfeng {
+namespace power {
+
+namespace {
+
+bool isBusy(SystemState state) {
+    switch (state) {
+        case SystemState::BOOTING:
+        case SystemState::LISTENING:
+        case SystemState::THINKING:
+        case SystemState::SPEAKING:
+        case SystemState::UPGRADING:
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+const char* modeName(Mode mode) {
+    switch (mode) {
+        case Mode::ACTIVE: return "active";
+        case Mode::IDLE: return "idle";
+        case Mode::LIGHT_SLEEP: return "light_sleep";
+        default: return "?";
+    }
+}
+
+Policy::Policy(const PolicyConfig& config, int64_t now_us)
+    : config_(config), idle_since_us_(now_us), accounted_us_(now_us) {}
+
+void Policy::account(int64_t now_us) {
+    if (now_us <= accounted_us_) return;
+    uint64_t elapsed = static_cast<uint64_t>(now_us - accounted_us_);
+    residency_us_[static_cast<int>(mode_)] += elapsed;
+    if (!busy_) idle_residency_us_[static_cast<int>(mode_)] += elapsed;
+    accounted_us_ = now_us;
+}
+
+Mode Policy::target(int64_t now_us) const {
+    if (busy_) return Mode::ACTIVE;
+    Mode deepest = wake_word_armed_ ? Mode::IDLE : Mode::LIGHT_SLEEP;
+    if (state_ == SystemState::SLEEPING) return deepest;
+    int64_t idle_us = now_us - idle_since_us_;
+    if (idle_us < static_cast<int64_t>(config_.active_hold_ms) * 1000) return Mode::ACTIVE;
+    if (idle_us < static_cast<int64_t>(config_.light_sleep_after_ms) * 1000) return Mode::IDLE;
+    return deepest;
+}
+
+Mode Policy::evaluate(int64_t now_us) {
+    account(now_us);
+    Mode next = target(now_us);
+    if (next != mode_) {
+        mode_ = next;
+        transitions_++;
+    }
+    return mode_;
+}
+
+void Policy::onSystemState(SystemState state, int64_t now_us) {
+    account(now_us);
+    bool busy = isBusy(state);
+    // 交互结束的时刻开始计算空闲；忙碌期间与空闲状态之间的切换（如 IDLE 与 ERROR）不重新计时
+    if (busy_ && !busy) idle_since_us_ = now_us;
+    state_ = state;
+    busy_ = busy;
+    evaluate(now_us);
+}
+
+void Policy::onWake(int64_t now_us) {
+    account(now_us);
+    idle_since_us_ = now_us;
+    evaluate(now_us);
+}
+
+void Policy::setWakeWordArmed(bool armed, int64_t now_us) {
+    account(now_us);
+    wake_word_armed_ = armed;
+    evaluate(now_us);
+}
+
+int64_t Policy::nextChangeUs() const {
+    if (busy_ || state_ == SystemState::SLEEPING) return INT64_MAX;
+    const int64_t hold_end = idle_since_us_ + static_cast<int64_t>(config_.active_hold_ms) * 1000;
+    const int64_t sleep_at = idle_since_us_ + static_cast<int64_t>(config_.light_sleep_after_ms) * 1000;
+    if (accounted_us_ < hold_end) return hold_end;
+    if (!wake_word_armed_ && accounted_us_ < sleep_at) return sleep_at;
+    return INT64_MAX;
+}
+
+uint32_t Policy::weightedUa(const uint64_t* residency_us, const uint16_t* current_ma) {
+    uint64_t total_us = 0;
+    uint64_t charge = 0;    // 微秒 x 毫安
+    for (int m = 0; m < static_cast<int>(Mode::COUNT); ++m) {
+        total_us += residency_us[m];
+        charge += residency_us[m] * current_ma[m];
+    }
+    return total_us ? static_cast<uint32_t>(charge * 1000 / total_us) : 0;
+}
+
+uint32_t Policy::averageCurrentUa() const {
+    return weightedUa(residency_us_, config_.current_ma);
+}
+
+uint32_t Policy::averageIdleCurrentUa() const {
+    return weightedUa(idle_residency_us_, config_.current_ma);
+}
+
+} // namespace power
+} // namespace chunfeng
@@ -0,0 +1,308 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-19 09:12:40
+ * @LastEditTime: 2025-06-27 16:48:03
+ * @LastEditors: 星年
+ * @Description: 设置文档的字段表、解析、比较与持久化
+ * @FilePath: \ESP32-ChunFeng\main\src\settings.cpp
+ * @遇事不决，可问春风
+ */
+#include "settings.hpp"
+#include "cf_log.hpp"
+#include "nvs.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace chunfeng {
+namespace settings {
+
+namespace {
+
+const char* TAG = "Settings";
+const char* NVS_NAMESPACE = "settings";
+const char* NVS_KEY = "doc";
+
+// 播放按 20ms 一帧、每帧整数个样本，且不超过播放缓冲的帧长
+bool validSampleRate(uint32_t rate) {
+    return rate % 50 == 0;
+}
+
+#define CF_STRING_FIELD(name, member, subsystem, secret)                                              \
+    {name, FieldType::STRING, subsystem, offsetof(Document, member), sizeof(Document::member), 0, 0, nullptr, \
+     secret}
+#define CF_UINT_FIELD(name, member, subsystem, min, max, check) \
+    {name, FieldType::UINT, subsystem, offsetof(Document, member), sizeof(uint32_t), min, max, check, false}
+
+const Field kFields[] = {
+    CF_STRING_FIELD("wifi.ssid", wifi_ssid, NETWORK, false),
+    CF_STRING_FIELD("wifi.password", wifi_password, NETWORK, true),
+    CF_UINT_FIELD("network.lte_linger_s", lte_linger_s, NETWORK, 0, 3600, nullptr),
+    CF_UINT_FIELD("audio.sample_rate", audio_sample_rate, AUDIO, 8000, 24000, validSampleRate),
+    CF_UINT_FIELD("audio.volume", audio_volume, AUDIO, 0, 100, nullptr),
+    CF_UINT_FIELD("audio.loudness", audio_loudness, AUDIO, 6, 40, nullptr),
+    CF_UINT_FIELD("audio.ceiling", audio_ceiling, AUDIO, 0, 20, nullptr),
+    CF_STRING_FIELD("coze.api_key", coze_api_key, COZE, true),
+    CF_STRING_FIELD("coze.bot_id", coze_bot_id, COZE, false),
+    CF_STRING_FIELD("system.device_name", device_name, SYSTEM, false),
+};
+
+#undef CF_STRING_FIELD
+#undef CF_UINT_FIELD
+
+constexpr size_t kFieldCount = sizeof(kFields) / sizeof(kFields[0]);
+static_assert(kFieldCount <= 32, "diff() 用 32 位掩码表示变化的字段");
+
+/** NVS 中的格式：布局版本与大小在前，不兼容时整体丢弃 */
+struct Stored {
+    uint16_t layout;
+    uint16_t size;
+    Document doc;
+};
+
+char* stringField(Document& doc, const Field& f) {
+    return reinterpret_cast<char*>(&doc) + f.offset;
+}
+
+const char* stringField(const Document& doc, const Field& f) {
+    return reinterpret_cast<const char*>(&doc) + f.offset;
+}
+
+uint32_t& uintField(Document& doc, const Field& f) {
+    return *reinterpret_cast<uint32_t*>(reinterpret_cast<char*>(&doc) + f.offset);
+}
+
+uint32_t uintField(const Document& doc, const Field& f) {
+    return *reinterpret_cast<const uint32_t*>(reinterpret_cast<const char*>(&doc) + f.offset);
+}
+
+/**
+ * @brief 一层 JSON 对象的逐项读取器，值只支持字符串与非负整数
+ */
+class FlatJsonReader {
+public:
+    FlatJsonReader(const char* p, size_t len) : p_(p), end_(p + len) {}
+
+    bool begin() {
+        skipSpace();
+        return consume('{');
+    }
+
+    /** @return 1 读到一项，0 对象结束，-1 格式错误 */
+    int next(char* key, size_t key_size) {
+        skipSpace();
+        if (consume('}')) {
+            skipSpace();
+            return p_ == end_ ? 0 : -1;
+        }
+        if (count_ > 0) {
+            if (!consume(',')) return -1;
+            skipSpace();
+        }
+        if (!readString(key, key_size)) return -1;
+        skipSpace();
+        if (!consume(':')) return -1;
+        skipSpace();
+        ++count_;
+        return 1;
+    }
+
+    bool peekString() const { return p_ < end_ && *p_ == '"'; }
+
+    bool readString(char* out, size_t size) {
+        if (!consume('"')) return false;
+        size_t n = 0;
+        while (p_ < end_ && *p_ != '"') {
+            char c = *p_++;
+            if (static_cast<unsigned char>(c) < 0x20) return false;
+            if (c == '\\') {
+                if (p_ == end_) return false;
+                c = *p_++;
+                switch (c) {
+                case '"': case '\\': case '/': break;
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                default: return false;     // \uXXXX 等不支持，设置值用不到
+                }
+            }
+            if (n + 1 >= size) return false;
+            out[n++] = c;
+        }
+        if (!consume('"')) return false;
+        out[n] = '\0';
+        return true;
+    }
+
+    bool readUint(uint32_t& out) {
+        const char* start = p_;
+        uint64_t value = 0;
+        while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+            value = value * 10 + (*p_++ - '0');
+            if (value > UINT32_MAX) return false;
+        }
+        if (p_ == start) return false;
+        out = static_cast<uint32_t>(value);
+        return true;
+    }
+
+private:
+    void skipSpace() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\r' || *p_ == '\n')) ++p_;
+    }
+
+    bool consume(char c) {
+        if (p_ < end_ && *p_ == c) {
+            ++p_;
+            return true;
+        }
+        return false;
+    }
+
+    const char* p_;
+    const char* end_;
+    int count_{0};
+};
+
+} // namespace
+
+const Field* fields(size_t& count) {
+    count = kFieldCount;
+    return kFields;
+}
+
+void defaults(Document& doc) {
+    memset(&doc, 0, sizeof(doc));
+    doc.audio_sample_rate = 16000;
+    doc.audio_volume = 80;
+    strcpy(doc.device_name, "ChunFeng");
+    doc.lte_linger_s = 60;
+    doc.audio_loudness = 20;
+    doc.audio_ceiling = 3;
+}
+
+esp_err_t parse(const char* json, size_t len, const Document& base, Document& out, char* error, size_t error_size) {
+    auto fail = [&](const char* fmt, const char* key) {
+        snprintf(error, error_size, fmt, key);
+        return ESP_ERR_INVALID_ARG;
+    };
+    if (len > kMaxDocumentSize) return fail("文档超过 %s 字节", "1024");
+
+    Document doc = base;
+    bool has_version = false;
+    FlatJsonReader reader(json, len);
+    if (!reader.begin()) return fail("不是 JSON 对象%s", "");
+    char key[32];
+    char text[sizeof(Document::coze_api_key)];
+    while (true) {
+        int r = reader.next(key, sizeof(key));
+        if (r == 0) break;
+        if (r < 0) return fail("JSON 格式错误%s", "");
+        if (strcmp(key, "version") == 0) {
+            if (!reader.readUint(doc.version)) return fail("%s 必须是非负整数", key);
+            has_version = true;
+            continue;
+        }
+        const Field* field = nullptr;
+        for (const Field& f : kFields) {
+            if (strcmp(f.name, key) == 0) field = &f;
+        }
+        if (!field) return fail("未知字段 %s", key);
+        if (field->type == FieldType::STRING) {
+            if (!reader.peekString() || !reader.readString(text, field->size)) return fail("%s 不是字符串或过长", key);
+            strcpy(stringField(doc, *field), text);
+        } else {
+            uint32_t value;
+            if (!reader.readUint(value)) return fail("%s 必须是非负整数", key);
+            if (value < field->min || value > field->max || (field->check && !field->check(value))) {
+                return fail("%s 超出范围", key);
+            }
+            uintField(doc, *field) = value;
+        }
+    }
+    if (!has_version) return fail("缺少 %s", "version");
+    out = doc;
+    return ESP_OK;
+}
+
+uint32_t diff(const Document& a, const Document& b) {
+    uint32_t changed = 0;
+    for (size_t i = 0; i < kFieldCount; ++i) {
+        const Field& f = kFields[i];
+        bool same = f.type == FieldType::STRING ? strcmp(stringField(a, f), stringField(b, f)) == 0
+                                                : uintField(a, f) == uintField(b, f);
+        if (!same) changed |= 1u << i;
+    }
+    return changed;
+}
+
+uint8_t affected(uint32_t changed_fields) {
+    uint8_t subsystems = 0;
+    for (size_t i = 0; i < kFieldCount; ++i) {
+        if (changed_fields & (1u << i)) subsystems |= kFields[i].subsystem;
+    }
+    return subsystems;
+}
+
+size_t formatJson(const Document& doc, char* buf, size_t size) {
+    size_t n = 0;
+    auto append = [&](const char* fmt, auto... args) {
+        if (n >= size) return;
+        int w = snprintf(buf + n, size - n, fmt, args...);
+        n = w < 0 ? size : n + w;
+    };
+    append("{\"version\":%u", static_cast<unsigned>(doc.version));
+    for (const Field& f : kFields) {
+        if (f.type == FieldType::UINT) {
+            append(",\"%s\":%u", f.name, static_cast<unsigned>(uintField(doc, f)));
+        } else if (f.secret) {
+            append(",\"%s\":%s", f.name, stringField(doc, f)[0] ? "\"***\"" : "\"\"");
+        } else {
+            append(",\"%s\":\"", f.name);
+            for (const char* s = stringField(doc, f); *s; ++s) {
+                if (*s == '"' || *s == '\\') append("\\%c", *s);
+                else if (static_cast<unsigned char>(*s) < 0x20) append("\\u%04x", static_cast<unsigned>(*s));
+                else append("%c", *s);
+            }
+            append("\"");
+        }
+    }
+    append("}");
+    return n < size ? n : 0;
+}
+
+void load(Document& doc) {
+    defaults(doc);
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return;
+    Stored stored;
+    size_t len = sizeof(stored);
+    esp_err_t err = nvs_get_blob(handle, NVS_KEY, &stored, &len);
+    nvs_close(handle);
+    if (err != ESP_OK) return;
+    // 旧布局只在末尾少了字段：沿用前缀，新字段保持默认值，下次保存时升级为当前布局
+    const size_t header = offsetof(Stored, doc);
+    if (len < header || stored.layout > kLayoutVersion || stored.size > sizeof(Document) ||
+        len != header + stored.size || (stored.layout == kLayoutVersion && stored.size != sizeof(Document))) {
+        CF_LOGW(TAG, "NVS 中的设置格式不兼容，使用默认值");
+        return;
+    }
+    memcpy(&doc, &stored.doc, stored.size);
+    if (stored.layout != kLayoutVersion) {
+        CF_LOGI(TAG, "设置布局 %u 升级到 %u", stored.layout, kLayoutVersion);
+    }
+}
+
+esp_err_t save(const Document& doc) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) return err;
+    Stored stored = {kLayoutVersion, static_cast<uint16_t>(sizeof(Document)), doc};
+    err = nvs_set_blob(handle, NVS_KEY, &stored, sizeof(stored));
+    if (err == ESP_OK) err = nvs_commit(handle);
+    nvs_close(handle);
+    return err;
+}
+
+} // namespace settings
+} // namespace chunfeng
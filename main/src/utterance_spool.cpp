@@ -0,0 +1,294 @@
+/***
+ * @Author: jixingnian@gmail.com
+ * @Date: 2025-06-21 11:20:06
+ * @LastEditTime: 2025-06-21 15:18:44
+ * @LastEditors: 星年
+ * @Description: 离线语音队列：片段池交接、写入 Flash、联网后按顺序补传与退避重传
+ * @FilePath: \ESP32-ChunFeng\main\src\utterance_spool.cpp
+ * @遇事不决，可问春风
+ */
+#include "utterance_spool.hpp"
+#include "network_manager.hpp"
+#include "system_state.hpp"
+#include "cf_log.hpp"
+#include "metrics.hpp"
+#include "task_topology.hpp"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include <algorithm>
+#include <cstring>
+
+namespace chunfeng {
+
+namespace {
+
+const char* TAG = "UtteranceSpool";
+
+constexpr uint32_t kFirstBackoffMs = 1000;
+constexpr uint32_t kMaxBackoffMs = 30000;
+
+metrics::Counter s_queued("chunfeng_spool_queued_total", "断网时存入 Flash 的语音段数");
+metrics::Counter s_uploaded("chunfeng_spool_uploaded_total", "联网后补传完成的语音段数");
+metrics::Counter s_dropped("chunfeng_spool_dropped_total", "暂存不足或数据损坏而丢弃的语音段数");
+metrics::Counter s_upload_failures("chunfeng_spool_upload_failures_total", "补传失败后整段重传的次数");
+metrics::Gauge s_pending("chunfeng_spool_pending", "等待补传的语音段数");
+
+} // namespace
+
+UtteranceSpool& UtteranceSpool::getInstance() {
+    static UtteranceSpool instance;
+    return instance;
+}
+
+UtteranceSpool::UtteranceSpool()
+    : subscriber_("spool", bus::topicBit(bus::Topic::NETWORK_STATE) | bus::topicBit(bus::Topic::SYSTEM_STATE)) {}
+
+esp_err_t UtteranceSpool::start(const char* partition_label) {
+    if (task_) return ESP_OK;
+    const esp_partition_t* partition =
+        esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partition_label);
+    if (!partition) {
+        CF_LOGE(TAG, "找不到分区 %s", partition_label);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (!pool_) {
+        pool_ = static_cast<Fragment*>(heap_caps_malloc(sizeof(Fragment) * kPoolFragments, MALLOC_CAP_SPIRAM));
+        if (!pool_) pool_ = static_cast<Fragment*>(heap_caps_malloc(sizeof(Fragment) * kPoolFragments,
+                                                                    MALLOC_CAP_DEFAULT));
+        if (!pool_) return ESP_ERR_NO_MEM;
+        for (size_t i = 0; i < kPoolFragments; ++i) free_.tryPush(static_cast<uint8_t>(i));
+    }
+    esp_err_t err = queue_.open(partition);
+    if (err != ESP_OK) {
+        CF_LOGE(TAG, "打开队列失败: %d", err);
+        return err;
+    }
+    next_entry_ = queue_.nextEntryId();
+    s_pending.set(static_cast<int32_t>(queue_.stats().pending));
+    if (tasks::spawn(tasks::TaskId::SPOOL, spoolTask, this, &task_) != pdPASS) return ESP_FAIL;
+    return ESP_OK;
+}
+
+void UtteranceSpool::setUploader(Uploader uploader, void* arg) {
+    uploader_arg_ = arg;
+    uploader_ = uploader;
+    subscriber_.interrupt();
+}
+
+esp_err_t UtteranceSpool::begin(const UtteranceInfo& info) {
+    if (!pool_) return ESP_ERR_INVALID_STATE;
+    if (current_ >= 0) end(false);
+    discarding_ = false;
+    uint8_t index;
+    if (!free_.tryPop(index)) {
+        discarding_ = true;
+        dropped_++;
+        s_dropped.inc();
+        return ESP_ERR_NO_MEM;
+    }
+    current_ = index;
+    Fragment& f = pool_[index];
+    f.entry = next_entry_++;
+    f.flags = spool::kFirst;
+    memcpy(f.data, &info, sizeof(info));
+    f.length = sizeof(info);
+    return ESP_OK;
+}
+
+esp_err_t UtteranceSpool::append(const uint8_t* data, size_t len) {
+    if (discarding_) return ESP_ERR_NO_MEM;
+    if (current_ < 0) return ESP_ERR_INVALID_STATE;
+    while (len > 0) {
+        Fragment& f = pool_[current_];
+        size_t n = std::min(len, kFragmentBytes - f.length);
+        memcpy(f.data + f.length, data, n);
+        f.length = static_cast<uint16_t>(f.length + n);
+        data += n;
+        len -= n;
+        if (f.length == kFragmentBytes && len > 0 && !submit()) return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t UtteranceSpool::end(bool keep) {
+    if (current_ < 0) {
+        bool discarded = discarding_;
+        discarding_ = false;
+        if (!keep) return ESP_OK;
+        return discarded ? ESP_ERR_NO_MEM : ESP_ERR_INVALID_STATE;
+    }
+    if (!keep) {
+        // 已经交出去的片段没有 kLast，不会被补传
+        free_.tryPush(static_cast<uint8_t>(current_));
+        current_ = -1;
+        return ESP_OK;
+    }
+    pool_[current_].flags |= spool::kLast;
+    ready_.tryPush(static_cast<uint8_t>(current_));
+    current_ = -1;
+    subscriber_.interrupt();
+    return ESP_OK;
+}
+
+bool UtteranceSpool::submit() {
+    // 当前片段已满：交给队列任务，换一个空闲片段继续
+    const Fragment& full = pool_[current_];
+    uint32_t entry = full.entry;
+    ready_.tryPush(static_cast<uint8_t>(current_));
+    subscriber_.interrupt();
+    uint8_t index;
+    if (!free_.tryPop(index)) {
+        CF_LOGW(TAG, "片段池耗尽，丢弃第 %u 段语音", static_cast<unsigned>(entry));
+        current_ = -1;
+        discarding_ = true;
+        dropped_++;
+        s_dropped.inc();
+        return false;
+    }
+    current_ = index;
+    Fragment& f = pool_[index];
+    f.entry = entry;
+    f.flags = 0;
+    f.length = 0;
+    return true;
+}
+
+SpoolStats UtteranceSpool::stats() const {
+    SpoolStats out;
+    out.queued = queued_.load();
+    out.uploaded = uploaded_.load();
+    out.dropped = dropped_.load();
+    out.upload_failures = upload_failures_.load();
+    out.flash = queue_.stats();
+    return out;
+}
+
+void UtteranceSpool::spoolTask(void* arg) {
+    static_cast<UtteranceSpool*>(arg)->run();
+}
+
+void UtteranceSpool::run() {
+    while (true) {
+        // 可以补传时不等待（退避中等到重传时间），否则等总线消息或采集方唤醒
+        uint32_t wait_ms = portMAX_DELAY;
+        if (drainable()) {
+            int64_t remaining_us = retry_at_us_ - esp_timer_get_time();
+            wait_ms = remaining_us > 0 ? static_cast<uint32_t>((remaining_us + 999) / 1000) : 0;
+        }
+        bus::Message message;
+        if (subscriber_.receive(message, wait_ms)) {
+            do {
+                onMessage(message);
+            } while (subscriber_.tryReceive(message));
+        }
+        storeFragments();
+        if (drainable() && esp_timer_get_time() >= retry_at_us_) drainOne();
+    }
+}
+
+void UtteranceSpool::onMessage(const bus::Message& message) {
+    switch (message.topic) {
+        case bus::Topic::NETWORK_STATE: {
+            NetworkState state = bus::payload<bus::Topic::NETWORK_STATE>(message).state;
+            bool online = state == NetworkState::WIFI_CONNECTED || state == NetworkState::LTE_CONNECTED;
+            if (online != online_) {
+                online_ = online;
+                // 换了链路：上传到一半的语音从头重传，退避重新计算
+                uploading_ = false;
+                backoff_ms_ = 0;
+                retry_at_us_ = 0;
+                uint32_t pending = queue_.stats().pending;
+                if (online && pending) CF_LOGI(TAG, "已联网，开始补传 %u 段语音", static_cast<unsigned>(pending));
+            }
+            break;
+        }
+        case bus::Topic::SYSTEM_STATE: {
+            SystemState state = bus::payload<bus::Topic::SYSTEM_STATE>(message);
+            live_ = state == SystemState::LISTENING || state == SystemState::THINKING ||
+                    state == SystemState::SPEAKING || state == SystemState::UPGRADING;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void UtteranceSpool::storeFragments() {
+    uint8_t index;
+    while (ready_.tryPop(index)) {
+        const Fragment& f = pool_[index];
+        esp_err_t err = queue_.append(f.entry, f.flags, f.data, f.length);
+        if (err != ESP_OK) {
+            // 本段语音缺了一片，不会被补传
+            CF_LOGE(TAG, "第 %u 段语音写入 Flash 失败: %d", static_cast<unsigned>(f.entry), err);
+        } else if (f.flags & spool::kLast) {
+            queued_++;
+            s_queued.inc();
+        }
+        free_.tryPush(index);
+    }
+    s_pending.set(static_cast<int32_t>(queue_.stats().pending));
+}
+
+bool UtteranceSpool::drainable() const {
+    return online_ && !live_ && uploader_.load() && queue_.stats().pending > 0;
+}
+
+void UtteranceSpool::drainOne() {
+    if (!uploading_) {
+        if (!queue_.front(entry_)) return;
+        cursor_ = entry_.first;
+        offset_ = 0;
+        uploading_ = true;
+    }
+    size_t len = 0;
+    bool last = false;
+    esp_err_t err = queue_.read(entry_, cursor_, buf_, sizeof(buf_), len, last);
+    if (err == ESP_OK && offset_ == 0) {
+        if (len < sizeof(info_)) {
+            err = ESP_ERR_INVALID_SIZE;
+        } else {
+            memcpy(&info_, buf_, sizeof(info_));
+        }
+    }
+    if (err == ESP_ERR_NOT_FOUND) {
+        // 队列满时被新录的语音挤掉了
+        uploading_ = false;
+        return;
+    }
+    if (err != ESP_OK) {
+        CF_LOGW(TAG, "第 %u 段语音数据损坏，丢弃: %d", static_cast<unsigned>(entry_.id), err);
+        queue_.ack(entry_);
+        uploading_ = false;
+        dropped_++;
+        s_dropped.inc();
+        return;
+    }
+    const uint8_t* data = buf_;
+    if (offset_ == 0) {
+        data += sizeof(info_);
+        len -= sizeof(info_);
+    }
+    Uploader uploader = uploader_.load();
+    err = uploader(entry_.id, info_, offset_, data, len, last, uploader_arg_.load());
+    if (err != ESP_OK) {
+        backoff_ms_ = backoff_ms_ ? std::min(backoff_ms_ * 2, kMaxBackoffMs) : kFirstBackoffMs;
+        retry_at_us_ = esp_timer_get_time() + static_cast<int64_t>(backoff_ms_) * 1000;
+        uploading_ = false;
+        upload_failures_++;
+        s_upload_failures.inc();
+        CF_LOGW(TAG, "第 %u 段语音上传失败: %d，%u ms 后重传", static_cast<unsigned>(entry_.id), err,
+                static_cast<unsigned>(backoff_ms_));
+        return;
+    }
+    offset_ += static_cast<uint32_t>(len);
+    if (!last) return;
+    queue_.ack(entry_);
+    uploading_ = false;
+    backoff_ms_ = 0;
+    uploaded_++;
+    s_uploaded.inc();
+    s_pending.set(static_cast<int32_t>(queue_.stats().pending));
+}
+
+} // namespace chunfeng